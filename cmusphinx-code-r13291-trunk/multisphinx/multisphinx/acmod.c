@@ -122,6 +122,16 @@ acmod_init_am(acmod_t *acmod)
     return 0;
 }
 
+static void
+acmod_init_wake_frames(acmod_t *acmod)
+{
+    acmod->wake_frames = 1;
+    if (cmd_ln_exists_r(acmod->config, "-wakeframes"))
+        acmod->wake_frames = cmd_ln_int32_r(acmod->config, "-wakeframes");
+    if (acmod->wake_frames < 1)
+        acmod->wake_frames = 1;
+}
+
 acmod_t *
 acmod_init(cmd_ln_t *config, logmath_t *lmath, featbuf_t *fb)
 {
@@ -133,6 +143,8 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, featbuf_t *fb)
     acmod->lmath = logmath_retain(lmath);
     acmod->fb = featbuf_retain(fb);
     acmod->fcb = featbuf_get_fcb(acmod->fb);
+    if ((acmod->fb_consumer = featbuf_consumer_add(acmod->fb)) < 0)
+        goto error_out;
 
     /* Load acoustic model parameters. */
     if (acmod_init_am(acmod) < 0)
@@ -146,6 +158,7 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, featbuf_t *fb)
                                                      sizeof(*acmod->senone_active));
     acmod->log_zero = logmath_get_zero(acmod->lmath);
     acmod->compallsen = cmd_ln_boolean_r(config, "-compallsen");
+    acmod_init_wake_frames(acmod);
 
     acmod->feat_buf = feat_array_alloc(acmod->fcb, 1);
     return acmod;
@@ -174,8 +187,12 @@ acmod_free(acmod_t *acmod)
     if (acmod->mgau)
         ps_mgau_free(acmod->mgau);
 
-    featbuf_free(acmod->fb);
-    feat_array_free(acmod->feat_buf);
+    if (acmod->fb) {
+        featbuf_consumer_remove(acmod->fb, acmod->fb_consumer);
+        featbuf_free(acmod->fb);
+    }
+    if (acmod->feat_buf)
+        feat_array_free(acmod->feat_buf);
     logmath_free(acmod->lmath);
     cmd_ln_free_r(acmod->config);
     ckd_free(acmod);
@@ -203,6 +220,10 @@ acmod_copy(acmod_t *other)
     acmod->mgau = ps_mgau_copy(other->mgau);
     acmod->fb = featbuf_retain(other->fb);
     acmod->fcb = other->fcb; /* Implicitly retained with fb, I think */
+    if ((acmod->fb_consumer = featbuf_consumer_add(acmod->fb)) < 0) {
+        acmod_free(acmod);
+        return NULL;
+    }
 
     /* Senone computation stuff. */
     acmod->senone_scores = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
@@ -212,6 +233,7 @@ acmod_copy(acmod_t *other)
                                                      sizeof(*acmod->senone_active));
     acmod->log_zero = logmath_get_zero(acmod->lmath);
     acmod->compallsen = cmd_ln_boolean_r(acmod->config, "-compallsen");
+    acmod->wake_frames = other->wake_frames;
 
     acmod->feat_buf = feat_array_alloc(acmod->fcb, 1);
 
@@ -223,21 +245,34 @@ acmod_consumer_wait(acmod_t *acmod, int timeout)
 {
     int rv;
 
-    if ((rv = featbuf_consumer_wait(acmod->fb, acmod->output_frame,
-                                    timeout, acmod->feat_buf[0][0])) < 0) {
-        E_INFO("EOU in frame %d\n", acmod->output_frame);
-        /* This means end of utterance. */
-        acmod->eou = TRUE;
-        return rv;
+    /* Wait for a whole batch of frames if the last one is used up,
+     * so we are not woken up for every frame. */
+    if (acmod->output_frame >= acmod->batch_end) {
+        if ((rv = featbuf_consumer_wait_batch(acmod->fb, acmod->fb_consumer,
+                                              acmod->output_frame,
+                                              acmod->wake_frames,
+                                              timeout)) < 0)
+            goto eou;
+        acmod->batch_end = acmod->output_frame + rv;
     }
+    if ((rv = featbuf_consumer_wait(acmod->fb, acmod->fb_consumer,
+                                    acmod->output_frame,
+                                    0, acmod->feat_buf[0][0])) < 0)
+        goto eou;
     return acmod->output_frame++;
+
+eou:
+    E_INFO("EOU in frame %d\n", acmod->output_frame);
+    /* This means end of utterance. */
+    acmod->eou = TRUE;
+    return rv;
 }
 
 int16 const *
 acmod_score(acmod_t *acmod, int frame_idx)
 {
     /* Obtain the frame to be scored. */
-    if (featbuf_consumer_wait(acmod->fb, frame_idx,
+    if (featbuf_consumer_wait(acmod->fb, acmod->fb_consumer, frame_idx,
                               0, acmod->feat_buf[0][0]) < 0)
         return NULL;
 
@@ -259,7 +294,8 @@ acmod_score(acmod_t *acmod, int frame_idx)
 int
 acmod_consumer_release(acmod_t *acmod, int frame_idx)
 {
-    return featbuf_consumer_release(acmod->fb, frame_idx, frame_idx + 1);
+    return featbuf_consumer_release(acmod->fb, acmod->fb_consumer,
+                                    frame_idx, frame_idx + 1);
 }
 
 int
@@ -279,12 +315,14 @@ acmod_consumer_start_utt(acmod_t *acmod, int timeout)
 {
     int rc;
 
-    if ((rc = featbuf_consumer_start_utt(acmod->fb, timeout)) < 0) {
+    if ((rc = featbuf_consumer_start_utt(acmod->fb, acmod->fb_consumer,
+                                         timeout)) < 0) {
         return rc;
     }
     
     E_INFO("Finished waiting for start of utt\n");
     acmod->output_frame = 0;
+    acmod->batch_end = 0;
     acmod->eou = FALSE;
     acmod->uttid = featbuf_uttid(acmod->fb);
 
@@ -294,7 +332,8 @@ acmod_consumer_start_utt(acmod_t *acmod, int timeout)
 int
 acmod_consumer_end_utt(acmod_t *acmod)
 {
-    featbuf_consumer_end_utt(acmod->fb, acmod->output_frame);
+    featbuf_consumer_end_utt(acmod->fb, acmod->fb_consumer,
+                             acmod->output_frame);
     acmod->eou = TRUE;
 
     return 0;
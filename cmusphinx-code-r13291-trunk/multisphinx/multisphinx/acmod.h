@@ -120,6 +120,7 @@ struct acmod_s {
     logmath_t *lmath;          /**< Log-math computation. */
     glist_t strings;           /**< Temporary acoustic model filenames. */
     featbuf_t *fb;             /**< Source of features. */
+    int fb_consumer;           /**< Consumer ID in @a fb. */
     feat_t *fcb;               /**< Feature parameters (belongs to @a fb) */
 
     /* Model parameters: */
@@ -137,6 +138,8 @@ struct acmod_s {
 
     /* Flags and counters: */
     int output_frame;          /**< Index of next frame to score. */
+    int batch_end;             /**< One past last frame known to be available. */
+    int wake_frames;           /**< Number of frames to wait for at once. */
     int compallsen;            /**< Compute all senone scores. */
     int eou;                   /**< At end of utterance input. */
     char *uttid;
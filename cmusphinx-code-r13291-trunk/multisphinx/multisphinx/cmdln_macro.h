@@ -137,6 +137,10 @@
       ARG_BOOLEAN,                                                                              \
       "no",                                                                                     \
       "Compute all senone scores in every frame (can be faster when there are many senones)" }, \
+{ "-wakeframes",                                                                                \
+      ARG_INT32,                                                                                \
+      "1",                                                                                      \
+      "Number of new frames a search pass waits for before it is woken up" },                   \
 { "-fwdtree",                                                                                   \
       ARG_BOOLEAN,                                                                              \
       "yes",                                                                                    \
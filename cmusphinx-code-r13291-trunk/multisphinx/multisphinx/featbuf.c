@@ -46,7 +46,6 @@
 #include <config.h>
 
 /* SphinxBase headers. */
-#include <sphinxbase/sync_array.h>
 #include <sphinxbase/sbthread.h>
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/byteorder.h>
@@ -59,9 +58,63 @@
 #define WORDS_BIGENDIAN 0
 #endif
 
+/*
+ * Frame indices shared between the producer and the consumers are
+ * only ever read and written with these, which are sequentially
+ * consistent, so no locks are needed to pass frames around.
+ */
+#if defined(__GNUC__)
+#define FB_LOAD(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define FB_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#define FB_CAS(x, old, new)                                     \
+    __atomic_compare_exchange_n(&(x), &(old), (new), FALSE,     \
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#elif defined(_WIN32)
+#include <windows.h>
+#define FB_LOAD(x) InterlockedCompareExchange((LONG volatile *)&(x), 0, 0)
+#define FB_STORE(x, v) InterlockedExchange((LONG volatile *)&(x), (v))
+#define FB_CAS(x, old, new)                                             \
+    (InterlockedCompareExchange((LONG volatile *)&(x), (new), (old)) == (old))
+#else
+#error "Atomic operations are not available for this compiler"
+#endif
+
+/** Number of frames in each block of the ring. */
+#define FEATBUF_BLOCK_FRAMES 128
+/** Number of blocks in the ring (bounds how far behind the slowest
+ *  consumer can fall before the producer has to wait for it). */
+#define FEATBUF_MAX_BLOCKS 4096
+/** Cursor value for a consumer which is not reading an utterance. */
+#define FEATBUF_DONE 0x7fffffff
+
+/**
+ * Per-consumer state.
+ */
+typedef struct featbuf_consumer_s {
+    int32 active;     /**< Is this slot in use (protected by mtx). */
+    int32 cursor;     /**< First frame not yet released (atomic). */
+    int32 wake_idx;   /**< Signal evt once this frame is available,
+                         or -1 if not waiting (atomic). */
+    sbevent_t *evt;   /**< Wakeup for this consumer. */
+} featbuf_consumer_t;
+
 struct featbuf_s {
     int refcount;
-    sync_array_t *sa;
+
+    /**
+     * Ring of blocks of frames.  Frame i lives in block (i /
+     * FEATBUF_BLOCK_FRAMES) % FEATBUF_MAX_BLOCKS, which is allocated
+     * when first needed, so the ring grows without moving frames.
+     */
+    mfcc_t **blocks;
+    int frame_size;          /**< Number of mfcc_t in a frame. */
+    int32 next_idx;          /**< Frames before this are available (atomic). */
+    int32 final_idx;         /**< End of utterance, or -1 (atomic). */
+    int32 producer_waiting;  /**< Producer is waiting for space (atomic). */
+    sbevent_t *space;        /**< Signalled when consumers release frames. */
+    featbuf_consumer_t consumers[FEATBUF_MAX_CONSUMERS];
+    sbmtx_t *mtx;            /**< Protects consumer registration. */
+
     cmd_ln_t *config;
     fe_t *fe;
     feat_t *fcb;
@@ -147,6 +200,7 @@ featbuf_t *
 featbuf_init(cmd_ln_t *config)
 {
     featbuf_t *fb;
+    int i;
 
     fb = ckd_calloc(1, sizeof(*fb));
     fb->refcount = 1;
@@ -161,10 +215,14 @@ featbuf_init(cmd_ln_t *config)
                             sizeof(*fb->cepbuf));
     fb->featbuf = feat_array_alloc(fb->fcb,
                                    feat_window_size(fb->fcb) + 1);
-    /* Each element is a complete (flattened) frame of features. */
-    fb->sa = sync_array_init(0,
-                             feat_dimension(fb->fcb)
-                             * sizeof(mfcc_t));
+    /* Each frame in the ring is a complete (flattened) frame of features. */
+    fb->frame_size = feat_dimension(fb->fcb);
+    fb->blocks = ckd_calloc(FEATBUF_MAX_BLOCKS, sizeof(*fb->blocks));
+    fb->final_idx = -1;
+    for (i = 0; i < FEATBUF_MAX_CONSUMERS; ++i)
+        fb->consumers[i].wake_idx = -1;
+    fb->space = sbevent_init(FALSE);
+    fb->mtx = sbmtx_init();
     fb->start = sbsem_init("featbuf:start",0);
     fb->release = sbsem_init("featbuf:release",0);
     return fb;
@@ -177,16 +235,16 @@ featbuf_t *
 featbuf_retain(featbuf_t *fb)
 {
     ++fb->refcount;
-    sync_array_retain(fb->sa);
     return fb;
 }
 
 int
 featbuf_free(featbuf_t *fb)
 {
+    int i;
+
     if (fb == NULL)
         return 0;
-    sync_array_free(fb->sa);
     if (--fb->refcount > 0)
         return fb->refcount;
 
@@ -201,6 +259,18 @@ featbuf_free(featbuf_t *fb)
     sbsem_free(fb->start);
     ckd_free(fb->cepbuf);
     feat_array_free(fb->featbuf);
+    if (fb->blocks) {
+        for (i = 0; i < FEATBUF_MAX_BLOCKS; ++i)
+            ckd_free(fb->blocks[i]);
+        ckd_free(fb->blocks);
+    }
+    for (i = 0; i < FEATBUF_MAX_CONSUMERS; ++i)
+        if (fb->consumers[i].evt)
+            sbevent_free(fb->consumers[i].evt);
+    if (fb->space)
+        sbevent_free(fb->space);
+    if (fb->mtx)
+        sbmtx_free(fb->mtx);
     if (fb->mfcfh)
         fclose(fb->mfcfh);
     if (fb->rawfh)
@@ -221,14 +291,108 @@ featbuf_get_fcb(featbuf_t *fb)
     return fb->fcb;
 }
 
+/**
+ * Get a pointer to frame fidx in the ring.
+ */
+static mfcc_t *
+featbuf_frame(featbuf_t *fb, int fidx)
+{
+    return fb->blocks[(fidx / FEATBUF_BLOCK_FRAMES) % FEATBUF_MAX_BLOCKS]
+        + (fidx % FEATBUF_BLOCK_FRAMES) * fb->frame_size;
+}
+
+/**
+ * Get the first frame not yet released by all consumers.
+ */
+static int
+featbuf_min_cursor(featbuf_t *fb)
+{
+    int32 next, i;
+
+    next = FB_LOAD(fb->next_idx);
+    for (i = 0; i < FEATBUF_MAX_CONSUMERS; ++i) {
+        int32 cursor;
+        if (!FB_LOAD(fb->consumers[i].active))
+            continue;
+        cursor = FB_LOAD(fb->consumers[i].cursor);
+        if (cursor < next)
+            next = cursor;
+    }
+    return next;
+}
+
+/**
+ * Wake up any consumers whose batch of frames is complete.
+ *
+ * If @a all is TRUE, wake up all waiting consumers, because the end
+ * of the utterance has been reached.
+ */
+static void
+featbuf_wake(featbuf_t *fb, int32 next_idx, int all)
+{
+    int i;
+
+    for (i = 0; i < FEATBUF_MAX_CONSUMERS; ++i) {
+        featbuf_consumer_t *c = &fb->consumers[i];
+        int32 want = FB_LOAD(c->wake_idx);
+
+        if (want == -1 || (!all && want >= next_idx))
+            continue;
+        /* Only signal it once, even if it re-arms meanwhile. */
+        if (FB_CAS(c->wake_idx, want, -1))
+            sbevent_signal(c->evt);
+    }
+}
+
 int
 featbuf_next(featbuf_t *fb)
 {
-    return sync_array_next_idx(fb->sa);
+    return FB_LOAD(fb->next_idx);
+}
+
+int
+featbuf_consumer_add(featbuf_t *fb)
+{
+    int i;
+
+    sbmtx_lock(fb->mtx);
+    for (i = 0; i < FEATBUF_MAX_CONSUMERS; ++i) {
+        featbuf_consumer_t *c = &fb->consumers[i];
+        if (c->active)
+            continue;
+        if (c->evt == NULL)
+            c->evt = sbevent_init(FALSE);
+        /* It does not take part until it starts an utterance. */
+        FB_STORE(c->cursor, FEATBUF_DONE);
+        FB_STORE(c->wake_idx, -1);
+        FB_STORE(c->active, TRUE);
+        break;
+    }
+    sbmtx_unlock(fb->mtx);
+    if (i == FEATBUF_MAX_CONSUMERS) {
+        E_ERROR("Too many consumers for feature buffer (max %d)\n",
+                FEATBUF_MAX_CONSUMERS);
+        return -1;
+    }
+    return i;
+}
+
+int
+featbuf_consumer_remove(featbuf_t *fb, int cid)
+{
+    if (cid < 0 || cid >= FEATBUF_MAX_CONSUMERS)
+        return -1;
+    sbmtx_lock(fb->mtx);
+    FB_STORE(fb->consumers[cid].active, FALSE);
+    sbmtx_unlock(fb->mtx);
+    /* The producer might have been waiting for it. */
+    if (FB_LOAD(fb->producer_waiting))
+        sbevent_signal(fb->space);
+    return 0;
 }
 
 int
-featbuf_consumer_start_utt(featbuf_t *fb, int timeout)
+featbuf_consumer_start_utt(featbuf_t *fb, int cid, int timeout)
 {
     int s = (timeout == -1) ? -1 : 0;
     int rc;
@@ -239,44 +403,92 @@ featbuf_consumer_start_utt(featbuf_t *fb, int timeout)
         return rc;
     if (fb->canceled)
         return -1;
+    FB_STORE(fb->consumers[cid].cursor, 0);
     return 0;
 }
 
 int
-featbuf_consumer_wait(featbuf_t *fb, int fidx, int timeout, mfcc_t *out_frame)
+featbuf_consumer_wait_batch(featbuf_t *fb, int cid, int fidx,
+                            int nfr, int timeout)
 {
+    featbuf_consumer_t *c = &fb->consumers[cid];
     int s = timeout == -1 ? -1 : 0;
+    int32 want, next, final;
+
+    if (nfr < 1)
+        nfr = 1;
+    want = fidx + nfr - 1;
+    while (TRUE) {
+        next = FB_LOAD(fb->next_idx);
+        if (next > want)
+            return next - fidx;
+        final = FB_LOAD(fb->final_idx);
+        if (final != -1)
+            /* The producer may have added more after we looked. */
+            return (final > fidx) ? final - fidx : -1;
+        if (timeout == 0)
+            return (next > fidx) ? next - fidx : -1;
+
+        /* Ask to be woken up, then check again in case the producer
+         * got there before it could see the request. */
+        FB_STORE(c->wake_idx, want);
+        if (FB_LOAD(fb->next_idx) > want
+            || FB_LOAD(fb->final_idx) != -1) {
+            FB_STORE(c->wake_idx, -1);
+            continue;
+        }
+        if (sbevent_wait(c->evt, s, timeout) < 0) {
+            FB_STORE(c->wake_idx, -1);
+            /* One last look before giving up. */
+            timeout = 0;
+        }
+    }
+}
+
+int
+featbuf_consumer_wait(featbuf_t *fb, int cid, int fidx,
+                      int timeout, mfcc_t *out_frame)
+{
     int rc;
 
-    /* Wait for the frame in sync array.  <0 means timeout or end of
-     * utterance.*/
-    if ((rc = sync_array_wait(fb->sa, fidx, s, timeout)) < 0)
+    /* <0 means timeout or end of utterance. */
+    if ((rc = featbuf_consumer_wait_batch(fb, cid, fidx, 1, timeout)) < 0)
         return rc;
+    if (fidx < FB_LOAD(fb->consumers[cid].cursor)) {
+        E_ERROR("Frame %d was already released by consumer %d\n",
+                fidx, cid);
+        return -1;
+    }
 
     /* Copy it. */
-    sync_array_get(fb->sa, fidx, out_frame);
+    memcpy(out_frame, featbuf_frame(fb, fidx),
+           fb->frame_size * sizeof(*out_frame));
 
     return 0;
 }
 
 int
-featbuf_consumer_release(featbuf_t *fb, int sidx, int eidx)
+featbuf_consumer_release(featbuf_t *fb, int cid, int sidx, int eidx)
 {
-    int rv;
+    featbuf_consumer_t *c = &fb->consumers[cid];
 
     if (eidx == -1)
-        eidx = sync_array_next_idx(fb->sa);
-    if ((rv = sync_array_release(fb->sa, sidx, eidx)) < 0)
-        return rv;
-    return rv;
+        eidx = FEATBUF_DONE;
+    /* Only the consumer itself moves its cursor, so no need to CAS. */
+    if (eidx > FB_LOAD(c->cursor)) {
+        FB_STORE(c->cursor, eidx);
+        if (FB_LOAD(fb->producer_waiting))
+            sbevent_signal(fb->space);
+    }
+    return featbuf_get_window_start(fb);
 }
 
 int
-featbuf_consumer_end_utt(featbuf_t *fb, int sidx)
+featbuf_consumer_end_utt(featbuf_t *fb, int cid, int sidx)
 {
     int rv;
 
-    if ((rv = featbuf_consumer_release(fb, sidx, -1)) < 0)
+    if ((rv = featbuf_consumer_release(fb, cid, sidx, -1)) < 0)
         return rv;
     /* Record this thread as having finished. */
     sbsem_up(fb->release);
@@ -286,8 +498,9 @@ featbuf_consumer_end_utt(featbuf_t *fb, int sidx)
 int
 featbuf_producer_start_utt(featbuf_t *fb, char *uttid)
 {
-    /* Reset the sync array. */
-    sync_array_reset(fb->sa);
+    /* Reset the ring (consumers reset their cursors when they start). */
+    FB_STORE(fb->next_idx, 0);
+    FB_STORE(fb->final_idx, -1);
 
     /* Set utterance processing state. */
     fb->beginutt = TRUE;
@@ -310,7 +523,6 @@ int
 featbuf_producer_end_utt(featbuf_t *fb)
 {
     int nfr, i, rc, nth;
-    size_t last_idx;
 
     /* Set utterance processing state. */
     fb->endutt = TRUE;
@@ -347,7 +559,8 @@ featbuf_producer_end_utt(featbuf_t *fb)
 
     /* Finalize. */
     E_INFO("Finalizing frame array\n");
-    last_idx = sync_array_finalize(fb->sa);
+    FB_STORE(fb->final_idx, fb->next_idx);
+    featbuf_wake(fb, fb->next_idx, TRUE);
 
     /* Wait for everybody to be done. */
     for (i = 0; i < nth; ++i)
@@ -532,9 +745,36 @@ int
 featbuf_producer_process_feat(featbuf_t *fb,
                               mfcc_t **feat)
 {
-    /* This one is easy, at least... */
-    if (sync_array_append(fb->sa, feat[0]) < 0)
+    int32 idx = fb->next_idx;
+    int blk = idx / FEATBUF_BLOCK_FRAMES;
+    mfcc_t **slot = &fb->blocks[blk % FEATBUF_MAX_BLOCKS];
+
+    if (FB_LOAD(fb->final_idx) != -1) {
+        E_ERROR("Attempted to add frame %d after end of utterance\n", idx);
         return -1;
+    }
+
+    /* Starting a block which was used before: wait until everybody
+     * has moved past the frames that were in it. */
+    if (idx % FEATBUF_BLOCK_FRAMES == 0 && blk >= FEATBUF_MAX_BLOCKS) {
+        int32 need = (blk - FEATBUF_MAX_BLOCKS + 1) * FEATBUF_BLOCK_FRAMES;
+        while (featbuf_min_cursor(fb) < need) {
+            FB_STORE(fb->producer_waiting, TRUE);
+            if (featbuf_min_cursor(fb) >= need)
+                break;
+            sbevent_wait(fb->space, 0, 50000000);
+        }
+        FB_STORE(fb->producer_waiting, FALSE);
+    }
+    if (*slot == NULL)
+        *slot = ckd_calloc(FEATBUF_BLOCK_FRAMES * fb->frame_size,
+                           sizeof(**slot));
+
+    /* Copy it in, then publish it. */
+    memcpy(featbuf_frame(fb, idx), feat[0],
+           fb->frame_size * sizeof(**slot));
+    FB_STORE(fb->next_idx, idx + 1);
+    featbuf_wake(fb, idx + 1, FALSE);
     return 1;
 }
 
@@ -568,11 +808,11 @@ featbuf_uttid(featbuf_t *fb)
 int
 featbuf_get_window_start(featbuf_t *fb)
 {
-    return sync_array_available(fb->sa);
+    return featbuf_min_cursor(fb);
 }
 
 int
 featbuf_get_window_end(featbuf_t *fb)
 {
-    return sync_array_next_idx(fb->sa);
+    return FB_LOAD(fb->next_idx);
 }
@@ -55,6 +55,9 @@
 
 /* Local headers. */
 
+/** Maximum number of consumers of a feature buffer. */
+#define FEATBUF_MAX_CONSUMERS 32
+
 typedef struct featbuf_s featbuf_t;
 
 /**
@@ -86,16 +89,39 @@ fe_t *featbuf_get_fe(featbuf_t *fb);
  */
 feat_t *featbuf_get_fcb(featbuf_t *fb);
 
+/**
+ * Register a consumer of frames.
+ *
+ * Each consumer has its own read cursor, which marks the first frame
+ * it has not yet released.  Frames are only recycled once every
+ * registered consumer has moved past them.
+ *
+ * @param fb Feature buffer.
+ * @return Consumer ID to pass to the consumer functions below, or <0
+ *         if there are already FEATBUF_MAX_CONSUMERS consumers.
+ */
+int featbuf_consumer_add(featbuf_t *fb);
+
+/**
+ * Unregister a consumer of frames.
+ *
+ * @param fb Feature buffer.
+ * @param cid Consumer ID returned by featbuf_consumer_add().
+ * @return 0, or <0 on error.
+ */
+int featbuf_consumer_remove(featbuf_t *fb, int cid);
+
 /**
  * Wait for the beginning of an utterance.
  *
  * If an utterance is already in progress this returns immediately.
  *
  * @param fb Feature buffer.
+ * @param cid Consumer ID.
  * @param timeout Maximum time to wait, in nanoseconds, or -1 to wait forever.
  * @return 0, or <0 on timeout or failure.
  */
-int featbuf_consumer_start_utt(featbuf_t *fb, int timeout);
+int featbuf_consumer_start_utt(featbuf_t *fb, int cid, int timeout);
 
 /**
  * Get the index of the next frame to become available.
@@ -131,19 +157,44 @@ int featbuf_next(featbuf_t *fb);
  * e.g. if you have allocated mfcc ***x, pass x[frame][0].
  *
  * @param fb Feature buffer.
+ * @param cid Consumer ID.
  * @param fidx Index of frame requested.
  * @param timeout Maximum time to wait, in nanoseconds, or -1 to wait forever.
  * @param out_frame Memory region to which the requested frame will be copied.
  * @return 0, or <0 for timeout or failure.
  */
-int featbuf_consumer_wait(featbuf_t *fb, int fidx, int timeout, mfcc_t *out_frame);
+int featbuf_consumer_wait(featbuf_t *fb, int cid, int fidx,
+                          int timeout, mfcc_t *out_frame);
+
+/**
+ * Wait for a batch of frames to become available.
+ *
+ * This is like featbuf_consumer_wait(), except that the consumer is
+ * only woken up once @a nfr frames starting at @a fidx are available,
+ * or the utterance has ended.  Consumers which can make use of
+ * several frames at once should use this to avoid a thread switch
+ * for every frame.  The frames can then be obtained with
+ * featbuf_consumer_wait() with a timeout of zero.
+ *
+ * @param fb Feature buffer.
+ * @param cid Consumer ID.
+ * @param fidx Index of first frame requested.
+ * @param nfr Number of frames to wait for.
+ * @param timeout Maximum time to wait, in nanoseconds, or -1 to wait forever.
+ * @return Number of frames available starting at @a fidx, which may
+ *         be less than @a nfr at the end of the utterance or on
+ *         timeout, or <0 if none are available.
+ */
+int featbuf_consumer_wait_batch(featbuf_t *fb, int cid, int fidx,
+                                int nfr, int timeout);
 
 /**
  * Relinquish interest in a series of frames.
  *
- * Once all consumers (defined as all objects retaining a reference to
- * @a fb) release a frame, it will no longer be available to any of
- * them.
+ * Once all consumers (defined as all IDs registered with
+ * featbuf_consumer_add()) release a frame, it will no longer be
+ * available to any of them.  Each consumer releases frames in order,
+ * so releasing up to @a eidx also releases any earlier frames.
  *
  * This can be thought of as the "up" operation for frames, where the
  * featbuf has an implicit "down" pending which removes frames from
@@ -160,12 +211,13 @@ int featbuf_consumer_wait(featbuf_t *fb, int fidx, int timeout, mfcc_t *out_fram
  * be passed.
  *
  * @param fb Feature buffer.
+ * @param cid Consumer ID.
  * @param sidx Index of first frame to be released.
  * @param eidx One past index of last frame to be released, or -1 to
  *             release all remaining frames.
  * @return 0, or <0 on error (but that is unlikely)
  */
-int featbuf_consumer_release(featbuf_t *fb, int sidx, int eidx);
+int featbuf_consumer_release(featbuf_t *fb, int cid, int sidx, int eidx);
 
 /**
  * Relinquish interest in a series of frames.
@@ -175,10 +227,11 @@ int featbuf_consumer_release(featbuf_t *fb, int sidx, int eidx);
  * released is also not known, @a sidx of 0 can also be passed.
  *
  * @param fb Feature buffer.
+ * @param cid Consumer ID.
  * @param sidx Index of first frame to be released.
  * @return 0, or <0 on error (but that is unlikely)
  */
-int featbuf_consumer_end_utt(featbuf_t *fb, int sidx);
+int featbuf_consumer_end_utt(featbuf_t *fb, int cid, int sidx);
 
 /**
  * Start processing for an utterance.
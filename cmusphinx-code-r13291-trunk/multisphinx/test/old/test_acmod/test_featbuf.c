@@ -11,6 +11,7 @@
 /* This will be a prototype for how acmod works. */
 typedef struct feat_reader_s {
 	featbuf_t *src;
+	int cid;
 	int fr;
 } feat_reader_t;
 
@@ -21,9 +22,11 @@ consumer(sbthread_t *th)
 	mfcc_t feat[52];
 
 	printf("Consumer %p started\n", fr);
+	if (featbuf_consumer_start_utt(fr->src, fr->cid, -1) < 0)
+		return -1;
 	while (1) {
 		/* Wait for frame to be available. */
-		if (featbuf_consumer_wait(fr->src, fr->fr, -1, feat) < 0)
+		if (featbuf_consumer_wait(fr->src, fr->cid, fr->fr, -1, feat) < 0)
 			break;
 
 		/* Do something with that frame. */
@@ -31,10 +34,10 @@ consumer(sbthread_t *th)
 		       fr, fr->fr, feat[0], feat[1]);
 
 		/* Release that frame. */
-		featbuf_consumer_release(fr->src, fr->fr, fr->fr + 1);
+		featbuf_consumer_release(fr->src, fr->cid, fr->fr, fr->fr + 1);
 		++fr->fr;
 	}
-	featbuf_consumer_end_utt(fr->src, fr->fr);
+	featbuf_consumer_end_utt(fr->src, fr->cid, fr->fr);
 	printf("Consumer %p done\n", fr);
 	sleep(2);
 	printf("Consumer %p exiting\n", fr);
@@ -72,6 +75,7 @@ main(int argc, char *argv[])
 	for (i = 0; i < 5; ++i) {
 		fr[i] = ckd_calloc(1, sizeof(**fr));
 		fr[i]->src = featbuf_retain(fb);
+		fr[i]->cid = featbuf_consumer_add(fb);
 		thr[i] = sbthread_start(NULL, consumer, fr[i]);
 	}
 
@@ -93,6 +97,7 @@ main(int argc, char *argv[])
 	for (i = 0; i < 5; ++i) {
 		sbthread_wait(thr[i]);
 		sbthread_free(thr[i]);
+		featbuf_consumer_remove(fr[i]->src, fr[i]->cid);
 		printf("featbuf rc %d\n", featbuf_free(fr[i]->src));
 		ckd_free(fr[i]);
 		printf("Reaped consumer %p\n", fr[i]);
@@ -0,0 +1,188 @@
+/**
+ * @file test_featbuf.c Test several consumers of a feature buffer.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <sphinxbase/feat.h>
+#include <sphinxbase/sbthread.h>
+
+#include <multisphinx/search_factory.h>
+#include <multisphinx/acmod.h>
+
+#include "test_macros.h"
+
+#define N_READERS 3
+
+static mfcc_t ***feat;
+static int nfr;
+
+/* Reads frames straight from the feature buffer, nbatch at a time. */
+typedef struct reader_s {
+    featbuf_t *fb;
+    int cid;
+    int nbatch;
+    int n_frames;
+    int n_wakeups;
+    int short_batch;
+} reader_t;
+
+static int
+reader_main(sbthread_t *th)
+{
+    reader_t *r = sbthread_arg(th);
+    mfcc_t *frame;
+    int fr, end, n;
+
+    frame = ckd_calloc(feat_dimension(featbuf_get_fcb(r->fb)),
+                       sizeof(*frame));
+    TEST_EQUAL(0, featbuf_consumer_start_utt(r->fb, r->cid, -1));
+    fr = end = 0;
+    while (TRUE) {
+        if (fr == end) {
+            if ((n = featbuf_consumer_wait_batch(r->fb, r->cid,
+                                                 fr, r->nbatch, -1)) < 0)
+                break;
+            /* Only the end of the utterance gives a short batch. */
+            if (n < r->nbatch)
+                ++r->short_batch;
+            ++r->n_wakeups;
+            end = fr + n;
+        }
+        /* The whole batch is there, so this does not block. */
+        TEST_EQUAL(0, featbuf_consumer_wait(r->fb, r->cid, fr, 0, frame));
+        TEST_EQUAL(0, memcmp(frame, feat[fr][0],
+                             feat_dimension(featbuf_get_fcb(r->fb))
+                             * sizeof(*frame)));
+        featbuf_consumer_release(r->fb, r->cid, fr, fr + 1);
+        ++fr;
+    }
+    r->n_frames = fr;
+    featbuf_consumer_end_utt(r->fb, r->cid, fr);
+    ckd_free(frame);
+    return 0;
+}
+
+/* Scores frames with the acoustic model, which waits for -wakeframes. */
+typedef struct scorer_s {
+    acmod_t *acmod;
+    int n_frames;
+    int n_wakeups;
+    int short_batch;
+} scorer_t;
+
+static int
+scorer_main(sbthread_t *th)
+{
+    scorer_t *s = sbthread_arg(th);
+    int frame_idx, batch_end;
+
+    TEST_EQUAL(0, acmod_consumer_start_utt(s->acmod, -1));
+    batch_end = 0;
+    while ((frame_idx = acmod_consumer_wait(s->acmod, -1)) >= 0) {
+        TEST_EQUAL(s->n_frames, frame_idx);
+        if (s->acmod->batch_end != batch_end) {
+            if (s->acmod->batch_end - frame_idx < s->acmod->wake_frames)
+                ++s->short_batch;
+            ++s->n_wakeups;
+            batch_end = s->acmod->batch_end;
+        }
+        TEST_ASSERT(acmod_score(s->acmod, frame_idx) != NULL);
+        acmod_consumer_release(s->acmod, frame_idx);
+        ++s->n_frames;
+    }
+    TEST_ASSERT(acmod_eou(s->acmod));
+    acmod_consumer_end_utt(s->acmod);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    search_factory_t *dcf;
+    featbuf_t *fb;
+    acmod_t *acmod;
+    reader_t readers[N_READERS];
+    scorer_t scorer;
+    sbthread_t *thr[N_READERS + 1];
+    int i, j;
+
+    dcf = search_factory_init("-hmm", TESTDATADIR "/hub4wsj_sc_8k",
+                              "-dict", TESTDATADIR "/bn10000.dic",
+                              "-samprate", "8000",
+                              "-wakeframes", "4", NULL);
+    TEST_ASSERT(dcf != NULL);
+    fb = search_factory_featbuf(dcf);
+    acmod = search_factory_acmod(dcf);
+    TEST_EQUAL(4, acmod->wake_frames);
+
+    nfr = feat_s2mfc2feat(acmod->fcb, "chan3", TESTDATADIR, ".mfc", 0, -1,
+                          NULL, -1);
+    TEST_ASSERT(nfr > 0);
+    feat = feat_array_alloc(acmod->fcb, nfr);
+    TEST_EQUAL(nfr, feat_s2mfc2feat(acmod->fcb, "chan3", TESTDATADIR,
+                                    ".mfc", 0, -1, feat, -1));
+
+    /* Readers waiting for different numbers of frames at a time. */
+    for (i = 0; i < N_READERS; ++i) {
+        readers[i].fb = featbuf_retain(fb);
+        TEST_ASSERT((readers[i].cid = featbuf_consumer_add(fb)) >= 0);
+        readers[i].nbatch = 1 + i * 7;
+    }
+
+    /* Every consumer sees every frame of each utterance, and is only
+     * woken up once its whole batch is there.  The first utterance is
+     * there before anyone looks, the second comes in slower than the
+     * consumers read it. */
+    for (j = 0; j < 2; ++j) {
+        for (i = 0; i < N_READERS; ++i) {
+            readers[i].n_frames = readers[i].n_wakeups = 0;
+            readers[i].short_batch = 0;
+            thr[i] = sbthread_start(NULL, reader_main, &readers[i]);
+        }
+        memset(&scorer, 0, sizeof(scorer));
+        scorer.acmod = acmod;
+        thr[N_READERS] = sbthread_start(NULL, scorer_main, &scorer);
+
+        featbuf_producer_start_utt(fb, NULL);
+        for (i = 0; i < nfr; ++i) {
+            TEST_EQUAL(1, featbuf_producer_process_feat(fb, feat[i]));
+            if (j > 0)
+                usleep(200);
+        }
+        featbuf_producer_end_utt(fb);
+
+        for (i = 0; i <= N_READERS; ++i) {
+            sbthread_wait(thr[i]);
+            sbthread_free(thr[i]);
+        }
+        for (i = 0; i < N_READERS; ++i) {
+            E_INFO("Reader %d: %d frames, %d wakeups for %d at a time\n",
+                   i, readers[i].n_frames, readers[i].n_wakeups,
+                   readers[i].nbatch);
+            TEST_EQUAL(nfr, readers[i].n_frames);
+            TEST_ASSERT(readers[i].n_wakeups
+                        <= (nfr + readers[i].nbatch - 1) / readers[i].nbatch);
+            TEST_ASSERT(readers[i].short_batch <= 1);
+            if (j > 0)
+                TEST_ASSERT(readers[i].n_wakeups > 1);
+        }
+        E_INFO("Scorer: %d frames, %d wakeups\n",
+               scorer.n_frames, scorer.n_wakeups);
+        TEST_EQUAL(nfr, scorer.n_frames);
+        TEST_ASSERT(scorer.n_wakeups <= (nfr + 3) / 4);
+        TEST_ASSERT(scorer.short_batch <= 1);
+        if (j > 0)
+            TEST_ASSERT(scorer.n_wakeups > 1);
+    }
+
+    for (i = 0; i < N_READERS; ++i) {
+        featbuf_consumer_remove(fb, readers[i].cid);
+        featbuf_free(fb);
+    }
+    feat_array_free(feat);
+    search_factory_free(dcf);
+
+    return 0;
+}
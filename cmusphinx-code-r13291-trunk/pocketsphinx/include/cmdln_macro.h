@@ -155,6 +155,14 @@
       ARG_INT32,                                                                                \
       "5000",                                                                                   \
       "Initial backpointer table size" },                                                       \
+{ "-bpgc",                                                                                      \
+      ARG_BOOLEAN,                                                                              \
+      "no",                                                                                     \
+      "Garbage collect the backpointer table to decode long utterances (no fwdflat)" },         \
+{ "-latthreads",                                                                                \
+      ARG_INT32,                                                                                \
+      "1",                                                                                      \
+      "Number of threads for bestpath search and posteriors on large lattices" },               \
 { "-maxwpf",                                                                                    \
       ARG_INT32,                                                                                \
       "-1",                                                                                     \
@@ -314,6 +322,10 @@
       ARG_STRING,                                                               \
       NULL,                                                                     \
       "Model definition input file" },                                          \
+{ "-ambin",                                                                     \
+      ARG_STRING,                                                               \
+      NULL,                                                                     \
+      "Packed binary acoustic model input file (files given with -mdef, -tmat, -mean/-var or -sendump/-mixw override it)" }, \
 { "-senmgau", \
       ARG_STRING,                                                               \
       NULL,                                                                     \
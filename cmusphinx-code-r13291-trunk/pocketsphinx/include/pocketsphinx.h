@@ -118,6 +118,33 @@ ps_decoder_t *ps_init(cmd_ln_t *config);
 POCKETSPHINX_EXPORT
 int ps_reinit(ps_decoder_t *ps, cmd_ln_t *config);
 
+/**
+ * Create a new decoder which shares models with an existing one.
+ *
+ * The new decoder uses the same configuration, acoustic model,
+ * dictionary and language models or grammars as <code>other</code>,
+ * without loading or copying any of them.  Only the state needed to
+ * process audio and search is allocated, so this is much faster and
+ * uses much less memory than calling ps_init() again.  The two
+ * decoders may then be used independently, for instance in separate
+ * threads.
+ *
+ * @note Shared acoustic model parameters cannot be modified, so
+ * ps_update_mllr() will fail on either decoder while both exist.
+ * Each N-Gram and allphone search gets its own copy of every language
+ * model, with the same one selected or the same interpolation
+ * weights, but the N-Gram parameters themselves are shared, so words
+ * must be added to the language model before cloning.  Words added
+ * with ps_add_word() go into the shared dictionary, so do not add
+ * words while another decoder is running.
+ *
+ * @param other Decoder to share models with.
+ * @return Newly created decoder, or NULL on failure.  Free it with
+ *         ps_free().
+ */
+POCKETSPHINX_EXPORT
+ps_decoder_t *ps_clone(ps_decoder_t *other);
+
 /**
  * Returns the argument definitions used in ps_init().
  *
@@ -408,6 +435,46 @@ int ps_end_utt(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 char const *ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score);
 
+/**
+ * Get partial hypothesis string and the part of it which is final.
+ *
+ * While an utterance is being decoded, words which are shared by all
+ * paths still alive in the search can no longer change.  They form a
+ * stable prefix of the hypothesis, which grows as decoding goes on.
+ * This is also cheaper than ps_get_hyp() when polled often, since the
+ * stable words are only traced back once.
+ *
+ * @note With the N-Gram search, the prefix is stable with respect to
+ * the first pass only.  If -fwdflat or -bestpath are enabled, they
+ * may still change it at the end of the utterance.  Other searches
+ * report no stable words until the utterance has ended.
+ *
+ * @param ps Decoder.
+ * @param out_n_stable Output: number of words at the start of the
+ *                     hypothesis which are stable.
+ * @return String containing best hypothesis at this point in
+ *         decoding.  NULL if no hypothesis is available.
+ */
+POCKETSPHINX_EXPORT
+char const *ps_get_partial_hyp(ps_decoder_t *ps, int32 *out_n_stable);
+
+/**
+ * Release search memory held for the stable part of the hypothesis.
+ *
+ * Calling this after ps_get_partial_hyp() lets long utterances be
+ * decoded without the search keeping the whole of them in memory.
+ * The released part can no longer be rescored, so afterwards no word
+ * lattice is available for the utterance, the -fwdflat and -bestpath
+ * passes are skipped, and ps_seg_iter() only returns the words after
+ * the released part.  ps_get_hyp() still returns all the words.
+ *
+ * @param ps Decoder.
+ * @return Number of search entries released, or <0 if the current
+ *         search does not support this.
+ */
+POCKETSPHINX_EXPORT
+int ps_release_stable(ps_decoder_t *ps);
+
 /**
  * Get posterior probability.
  *
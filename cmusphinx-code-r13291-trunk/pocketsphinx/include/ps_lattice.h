@@ -93,6 +93,10 @@ struct ps_decoder_s;
 /**
  * Read a lattice from a file on disk.
  *
+ * Both the Sphinx-III text format written by ps_lattice_write() and
+ * the binary format written by ps_lattice_write_bin() are accepted,
+ * and compressed files are decompressed on the fly.
+ *
  * @param ps Decoder to use for processing this lattice, or NULL.
  * @param file Path to lattice file.
  * @return Newly created lattice, or NULL for failure.
@@ -137,6 +141,27 @@ int ps_lattice_write(ps_lattice_t *dag, char const *filename);
 POCKETSPHINX_EXPORT
 int ps_lattice_write_htk(ps_lattice_t *dag, char const *filename);
 
+/**
+ * Write a lattice to disk in binary format.
+ *
+ * The file begins with a standard Sphinx binary header giving the
+ * format version and log base.  It is followed by variable-length
+ * integers (see bio_fwrite_varint()): the number of frames, a table
+ * of the distinct words used (length and spelling of each), the nodes
+ * (word index, start frame, first end frame relative to the start
+ * frame, last end frame relative to the first, and node ID, the last
+ * three zig-zag coded), the initial and final node, and the links in
+ * order of their source node
+ * (zig-zag coded source relative to the previous link, destination
+ * relative to the source, and negated acoustic score in the same
+ * units as ps_lattice_write()).  A checksum ends the file.  Files
+ * named with a compressed extension such as ".gz" are compressed.
+ *
+ * @return 0 for success, <0 on failure.
+ */
+POCKETSPHINX_EXPORT
+int ps_lattice_write_bin(ps_lattice_t *dag, char const *filename);
+
 /**
  * Get the log-math computation object for this lattice
  *
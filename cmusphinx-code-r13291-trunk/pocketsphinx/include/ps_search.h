@@ -212,7 +212,10 @@ fsg_model_t *ps_get_fsg(ps_decoder_t *ps, const char *name);
  * Adds new search based on finite state grammar.
  *
  * Associates FSG search with the provided name. The search can be activated
- * using ps_set_search().
+ * using ps_set_search().  If there is already an FSG search with this
+ * name, it is switched to the new grammar, and only the parts of its
+ * search network for states whose words have changed are rebuilt.
+ * The same goes for ps_set_jsgf_file() and ps_set_jsgf_string().
  *
  * @see ps_set_search
  */
@@ -233,6 +236,10 @@ int ps_set_jsgf_file(ps_decoder_t *ps, const char *name, const char *path);
  * Adds new search using JSGF model.
  *
  * Convenience method to parse JSGF model from string and create a search.
+ * The grammars built this way that were used most recently are kept,
+ * so setting the same string again does not parse it again.  They are shared with the
+ * searches using them, so the grammar returned by ps_get_fsg() for such
+ * a search should not be modified.
  *
  * @see ps_set_fsg
  */
@@ -254,7 +261,10 @@ const char* ps_get_kws(ps_decoder_t *ps, const char *name);
  * Adds keyphrases from a file to spotting
  *
  * Associates KWS search with the provided name. The search can be activated
- * using ps_set_search().
+ * using ps_set_search().  If there is already a KWS search with this
+ * name, its keyphrases are replaced with those in the file, which is
+ * much faster than creating a new search when only a few of them
+ * have changed.
  *
  * @see ps_set_search
  */
@@ -265,7 +275,8 @@ int ps_set_kws(ps_decoder_t *ps, const char *name, const char *keyfile);
  * Adds new keyphrase to spot
  *
  * Associates KWS search with the provided name. The search can be activated
- * using ps_set_search().
+ * using ps_set_search().  If there is already a KWS search with this
+ * name, its keyphrases are replaced with this one.
  *
  * @see ps_set_search
  */
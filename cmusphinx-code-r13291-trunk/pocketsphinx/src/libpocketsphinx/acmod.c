@@ -54,6 +54,7 @@
 #include <sphinxbase/byteorder.h>
 #include <sphinxbase/feat.h>
 #include <sphinxbase/bio.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "cmdln_macro.h"
@@ -64,42 +65,69 @@
 
 static int32 acmod_process_mfcbuf(acmod_t *acmod);
 
+bin_am_t *
+acmod_am_for(acmod_t *acmod, char const *arg, char const *arg2)
+{
+    if (acmod->am == NULL)
+        return NULL;
+    if (cmd_ln_str_r(acmod->config, arg)
+        || (arg2 && cmd_ln_str_r(acmod->config, arg2)))
+        return NULL;
+    return acmod->am;
+}
+
 static int
 acmod_init_am(acmod_t *acmod)
 {
-    char const *mdeffn, *tmatfn, *mllrfn, *hmmdir;
+    char const *mdeffn, *tmatfn, *mllrfn, *hmmdir, *ambin;
+
+    /* Use the binary acoustic model for whatever it contains. */
+    if (cmd_ln_exists_r(acmod->config, "_ambin")
+        && (ambin = cmd_ln_str_r(acmod->config, "_ambin"))
+        && (acmod->am = bin_am_read(acmod->config, ambin)) == NULL)
+        E_WARN("Failed to read binary acoustic model %s, "
+               "using separate files\n", ambin);
 
     /* Read model definition. */
-    if ((mdeffn = cmd_ln_str_r(acmod->config, "_mdef")) == NULL) {
-        if ((hmmdir = cmd_ln_str_r(acmod->config, "-hmm")) == NULL)
-            E_ERROR("Acoustic model definition is not specified either "
-                    "with -mdef option or with -hmm\n");
-        else
-            E_ERROR("Folder '%s' does not contain acoustic model "
-                    "definition 'mdef'\n", hmmdir);
+    if (acmod_am_for(acmod, "-mdef", NULL))
+        acmod->mdef = bin_mdef_read_am(acmod->am);
+    if (acmod->mdef == NULL) {
+        if ((mdeffn = cmd_ln_str_r(acmod->config, "_mdef")) == NULL) {
+            if ((hmmdir = cmd_ln_str_r(acmod->config, "-hmm")) == NULL)
+                E_ERROR("Acoustic model definition is not specified either "
+                        "with -mdef option or with -hmm\n");
+            else
+                E_ERROR("Folder '%s' does not contain acoustic model "
+                        "definition 'mdef'\n", hmmdir);
 
-        return -1;
-    }
+            return -1;
+        }
 
-    if ((acmod->mdef = bin_mdef_read(acmod->config, mdeffn)) == NULL) {
-        E_ERROR("Failed to read acoustic model definition from %s\n", mdeffn);
-        return -1;
+        if ((acmod->mdef = bin_mdef_read(acmod->config, mdeffn)) == NULL) {
+            E_ERROR("Failed to read acoustic model definition from %s\n", mdeffn);
+            return -1;
+        }
     }
 
     /* Read transition matrices. */
-    if ((tmatfn = cmd_ln_str_r(acmod->config, "_tmat")) == NULL) {
-        E_ERROR("No tmat file specified\n");
-        return -1;
+    if (acmod_am_for(acmod, "-tmat", NULL))
+        acmod->tmat = tmat_init_am(acmod->am, acmod->lmath);
+    if (acmod->tmat == NULL) {
+        if ((tmatfn = cmd_ln_str_r(acmod->config, "_tmat")) == NULL) {
+            E_ERROR("No tmat file specified\n");
+            return -1;
+        }
+        acmod->tmat = tmat_init(tmatfn, acmod->lmath,
+                                cmd_ln_float32_r(acmod->config, "-tmatfloor"),
+                                TRUE);
     }
-    acmod->tmat = tmat_init(tmatfn, acmod->lmath,
-                            cmd_ln_float32_r(acmod->config, "-tmatfloor"),
-                            TRUE);
 
     /* Read the acoustic models. */
-    if ((cmd_ln_str_r(acmod->config, "_mean") == NULL)
-        || (cmd_ln_str_r(acmod->config, "_var") == NULL)
-        || (cmd_ln_str_r(acmod->config, "_tmat") == NULL)) {
-        E_ERROR("No mean/var/tmat files specified\n");
+    if ((acmod_am_for(acmod, "-mean", "-var") == NULL
+         || bin_am_section(acmod->am, BIN_AM_GAUDEN, NULL) == NULL)
+        && ((cmd_ln_str_r(acmod->config, "_mean") == NULL)
+            || (cmd_ln_str_r(acmod->config, "_var") == NULL))) {
+        E_ERROR("No mean/var files specified\n");
         return -1;
     }
 
@@ -224,6 +252,33 @@ acmod_feat_mismatch(acmod_t *acmod, feat_t *fcb)
     return FALSE;
 }
 
+static void
+acmod_init_buffers(acmod_t *acmod)
+{
+    /* The MFCC buffer needs to be at least as large as the dynamic
+     * feature window.  */
+    acmod->n_mfc_alloc = acmod->fcb->window_size * 2 + 1;
+    acmod->mfc_buf = (mfcc_t **)
+        ckd_calloc_2d(acmod->n_mfc_alloc, acmod->fcb->cepsize,
+                      sizeof(**acmod->mfc_buf));
+
+    /* Feature buffer has to be at least as large as MFCC buffer. */
+    acmod->n_feat_alloc = acmod->n_mfc_alloc + cmd_ln_int32_r(acmod->config, "-pl_window");
+    acmod->feat_buf = feat_array_alloc(acmod->fcb, acmod->n_feat_alloc);
+    acmod->framepos = ckd_calloc(acmod->n_feat_alloc, sizeof(*acmod->framepos));
+
+    acmod->utt_start_frame = 0;
+
+    /* Senone computation stuff. */
+    acmod->senone_scores = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                                     sizeof(*acmod->senone_scores));
+    acmod->senone_active_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
+    acmod->senone_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                                     sizeof(*acmod->senone_active));
+    acmod->log_zero = logmath_get_zero(acmod->lmath);
+    acmod->compallsen = cmd_ln_boolean_r(acmod->config, "-compallsen");
+}
+
 acmod_t *
 acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
 {
@@ -266,28 +321,48 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
         goto error_out;
 
 
-    /* The MFCC buffer needs to be at least as large as the dynamic
-     * feature window.  */
-    acmod->n_mfc_alloc = acmod->fcb->window_size * 2 + 1;
-    acmod->mfc_buf = (mfcc_t **)
-        ckd_calloc_2d(acmod->n_mfc_alloc, acmod->fcb->cepsize,
-                      sizeof(**acmod->mfc_buf));
+    acmod_init_buffers(acmod);
+    return acmod;
 
-    /* Feature buffer has to be at least as large as MFCC buffer. */
-    acmod->n_feat_alloc = acmod->n_mfc_alloc + cmd_ln_int32_r(config, "-pl_window");
-    acmod->feat_buf = feat_array_alloc(acmod->fcb, acmod->n_feat_alloc);
-    acmod->framepos = ckd_calloc(acmod->n_feat_alloc, sizeof(*acmod->framepos));
+error_out:
+    acmod_free(acmod);
+    return NULL;
+}
 
-    acmod->utt_start_frame = 0;
+acmod_t *
+acmod_copy(acmod_t *other)
+{
+    acmod_t *acmod;
 
-    /* Senone computation stuff. */
-    acmod->senone_scores = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
-                                                     sizeof(*acmod->senone_scores));
-    acmod->senone_active_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
-    acmod->senone_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
-                                                     sizeof(*acmod->senone_active));
-    acmod->log_zero = logmath_get_zero(acmod->lmath);
-    acmod->compallsen = cmd_ln_boolean_r(config, "-compallsen");
+    if (other->mgau == NULL || ps_mgau_base(other->mgau)->vt->copy == NULL) {
+        E_ERROR("Acoustic model of type %s cannot be shared\n",
+                other->mgau ? ps_mgau_base(other->mgau)->vt->name : "(none)");
+        return NULL;
+    }
+
+    acmod = ckd_calloc(1, sizeof(*acmod));
+    acmod->config = cmd_ln_retain(other->config);
+    acmod->lmath = other->lmath;
+    acmod->state = ACMOD_IDLE;
+
+    /* Feature computation has state, so it is not shared. */
+    if ((acmod->fe = fe_init_auto_r(acmod->config)) == NULL)
+        goto error_out;
+    if (acmod_init_feat(acmod) < 0)
+        goto error_out;
+
+    /* Share model parameters. */
+    acmod->mdef = bin_mdef_retain(other->mdef);
+    acmod->tmat = tmat_retain(other->tmat);
+    if (other->am)
+        acmod->am = bin_am_retain(other->am);
+    if ((acmod->mgau = ps_mgau_copy(other->mgau)) == NULL)
+        goto error_out;
+    /* Parameters are already transformed, if there is a transform. */
+    if (other->mllr)
+        acmod->mllr = ps_mllr_retain(other->mllr);
+
+    acmod_init_buffers(acmod);
     return acmod;
 
 error_out:
@@ -295,6 +370,169 @@ error_out:
     return NULL;
 }
 
+int
+acmod_write_am(acmod_t *acmod, const char *filename)
+{
+    bin_am_data_t sections[11];
+    bin_am_tmat_t tmathdr;
+    bin_am_gauden_t *gauhdr;
+    bin_am_sendump_t sdhdr;
+    bin_am_senone_t *senhdr;
+    char const *name;
+    gauden_t *g;
+    senone_t *sen;
+    uint8 ***mixw, *mixw_cb, *mdefbuf, *mixwbuf;
+    size_t gausize, sensize, n_param;
+    FILE *fh;
+    long mdefsize;
+    int32 f, d, n_sec, veclen;
+    int rv;
+
+    /* Get the parameters from whichever computation module we have. */
+    name = ps_mgau_base(acmod->mgau)->vt->name;
+    mixw = NULL;
+    mixw_cb = NULL;
+    sen = NULL;
+    if (0 == strcmp(name, "ptm")) {
+        ptm_mgau_t *s = (ptm_mgau_t *)acmod->mgau;
+        g = s->g;
+        mixw = s->mixw;
+        mixw_cb = s->mixw_cb;
+    }
+    else if (0 == strcmp(name, "s2_semi")) {
+        s2_semi_mgau_t *s = (s2_semi_mgau_t *)acmod->mgau;
+        g = s->g;
+        mixw = s->mixw;
+        mixw_cb = s->mixw_cb;
+    }
+    else if (0 == strcmp(name, "ms")) {
+        g = ((ms_mgau_model_t *)acmod->mgau)->g;
+        sen = ((ms_mgau_model_t *)acmod->mgau)->s;
+    }
+    else {
+        E_ERROR("Cannot write acoustic model of type %s\n", name);
+        return -1;
+    }
+
+    /* The model definition is easiest to get from its own writer, so
+     * use the output file as a scratch space for it. */
+    if (bin_mdef_write(acmod->mdef, filename) < 0
+        || (fh = fopen(filename, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to write model definition to %s", filename);
+        return -1;
+    }
+    fseek(fh, 0, SEEK_END);
+    mdefsize = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+    mdefbuf = ckd_malloc(mdefsize);
+    if (fread(mdefbuf, 1, mdefsize, fh) != (size_t)mdefsize) {
+        E_ERROR_SYSTEM("Failed to read model definition from %s", filename);
+        fclose(fh);
+        ckd_free(mdefbuf);
+        return -1;
+    }
+    fclose(fh);
+
+    n_sec = 0;
+    sections[n_sec].id = BIN_AM_MDEF;
+    sections[n_sec].data = mdefbuf;
+    sections[n_sec++].size = mdefsize;
+
+    tmathdr.n_tmat = acmod->tmat->n_tmat;
+    tmathdr.n_state = acmod->tmat->n_state;
+    sections[n_sec].id = BIN_AM_TMAT;
+    sections[n_sec].data = &tmathdr;
+    sections[n_sec++].size = sizeof(tmathdr);
+    sections[n_sec].id = BIN_AM_TMAT_DATA;
+    sections[n_sec].data = acmod->tmat->tp[0][0];
+    sections[n_sec++].size = (size_t)tmathdr.n_tmat * tmathdr.n_state
+        * (tmathdr.n_state + 1);
+
+    gausize = sizeof(*gauhdr) + g->n_feat * sizeof(int32);
+    gauhdr = ckd_calloc(1, gausize);
+    gauhdr->n_mgau = g->n_mgau;
+    gauhdr->n_feat = g->n_feat;
+    gauhdr->n_density = g->n_density;
+    gauhdr->n_blk = g->blk_mean ? g->n_blk : 0;
+    memcpy(gauhdr + 1, g->featlen, g->n_feat * sizeof(int32));
+    for (f = 0, veclen = 0; f < g->n_feat; ++f)
+        veclen += g->featlen[f];
+    n_param = (size_t)g->n_mgau * g->n_density * veclen;
+    sections[n_sec].id = BIN_AM_GAUDEN;
+    sections[n_sec].data = gauhdr;
+    sections[n_sec++].size = gausize;
+    sections[n_sec].id = BIN_AM_MEAN;
+    sections[n_sec].data = g->mean[0][0][0];
+    sections[n_sec++].size = n_param * sizeof(mfcc_t);
+    sections[n_sec].id = BIN_AM_VAR;
+    sections[n_sec].data = g->var[0][0][0];
+    sections[n_sec++].size = n_param * sizeof(mfcc_t);
+    sections[n_sec].id = BIN_AM_DET;
+    sections[n_sec].data = g->det[0][0];
+    sections[n_sec++].size = (size_t)g->n_mgau * g->n_feat
+        * g->n_density * sizeof(mfcc_t);
+    if (g->blk_mean) {
+        sections[n_sec].id = BIN_AM_BLOCKED;
+        sections[n_sec].data = g->blk_mean[0][0];
+        sections[n_sec++].size = gauden_blk_size(g);
+    }
+
+    /* Mixture weight rows are not necessarily contiguous. */
+    mixwbuf = NULL;
+    if (mixw) {
+        sdhdr.n_feat = g->n_feat;
+        sdhdr.n_density = g->n_density;
+        sdhdr.n_sen = bin_mdef_n_sen(acmod->mdef);
+        sdhdr.stride = mixw_cb ? (sdhdr.n_sen + 1) / 2 : sdhdr.n_sen;
+        mixwbuf = ckd_malloc((size_t)sdhdr.n_feat * sdhdr.n_density
+                             * sdhdr.stride);
+        for (f = 0; f < sdhdr.n_feat; ++f)
+            for (d = 0; d < sdhdr.n_density; ++d)
+                memcpy(mixwbuf + ((size_t)f * sdhdr.n_density + d)
+                       * sdhdr.stride, mixw[f][d], sdhdr.stride);
+        sections[n_sec].id = BIN_AM_SENDUMP;
+        sections[n_sec].data = &sdhdr;
+        sections[n_sec++].size = sizeof(sdhdr);
+        if (mixw_cb) {
+            sections[n_sec].id = BIN_AM_MIXW_CB;
+            sections[n_sec].data = mixw_cb;
+            sections[n_sec++].size = 16;
+        }
+        sections[n_sec].id = BIN_AM_MIXW;
+        sections[n_sec].data = mixwbuf;
+        sections[n_sec++].size = (size_t)sdhdr.n_feat * sdhdr.n_density
+            * sdhdr.stride;
+    }
+
+    senhdr = NULL;
+    if (sen) {
+        sensize = sizeof(*senhdr) + sen->n_sen * sizeof(*sen->mgau);
+        senhdr = ckd_calloc(1, sensize);
+        senhdr->n_sen = sen->n_sen;
+        senhdr->n_feat = sen->n_feat;
+        senhdr->n_cw = sen->n_cw;
+        senhdr->n_gauden = sen->n_gauden;
+        senhdr->mixwfloor = sen->mixwfloor;
+        memcpy(senhdr + 1, sen->mgau, sen->n_sen * sizeof(*sen->mgau));
+        sections[n_sec].id = BIN_AM_SENONE;
+        sections[n_sec].data = senhdr;
+        sections[n_sec++].size = sensize;
+        /* Both senone_init() and senone_init_am() keep the weights
+         * in one block. */
+        sections[n_sec].id = BIN_AM_SENONE_PDF;
+        sections[n_sec].data = sen->pdf[0][0];
+        sections[n_sec++].size = (size_t)sen->n_sen * sen->n_feat
+            * sen->n_cw * sizeof(senprob_t);
+    }
+
+    rv = bin_am_write(acmod->config, filename, sections, n_sec);
+    ckd_free(senhdr);
+    ckd_free(mixwbuf);
+    ckd_free(gauhdr);
+    ckd_free(mdefbuf);
+    return rv;
+}
+
 void
 acmod_free(acmod_t *acmod)
 {
@@ -322,6 +560,8 @@ acmod_free(acmod_t *acmod)
     ckd_free(acmod->senone_active_vec);
     ckd_free(acmod->senone_active);
     ckd_free(acmod->rawdata);
+    ckd_free(acmod->batch_frames);
+    ckd_free(acmod->batch_acmods);
 
     if (acmod->mdef)
         bin_mdef_free(acmod->mdef);
@@ -331,6 +571,7 @@ acmod_free(acmod_t *acmod)
         ps_mgau_free(acmod->mgau);
     if (acmod->mllr)
         ps_mllr_free(acmod->mllr);
+    bin_am_free(acmod->am);
 
     ckd_free(acmod);
 }
@@ -338,6 +579,18 @@ acmod_free(acmod_t *acmod)
 ps_mllr_t *
 acmod_update_mllr(acmod_t *acmod, ps_mllr_t *mllr)
 {
+    if (ps_mgau_is_shared(acmod->mgau)) {
+        E_ERROR("Cannot transform acoustic model parameters shared "
+                "with another decoder\n");
+        return NULL;
+    }
+    /* Precomputed parameters have to be reloaded to be transformed. */
+    if (acmod_am_for(acmod, "-mean", "-var")
+        && cmd_ln_str_r(acmod->config, "_mean") == NULL) {
+        E_ERROR("Cannot transform a binary acoustic model "
+                "without the original means and variances\n");
+        return NULL;
+    }
     if (acmod->mllr)
         ps_mllr_free(acmod->mllr);
     acmod->mllr = mllr;
@@ -1102,6 +1355,28 @@ acmod_get_frame(acmod_t *acmod, int *inout_frame_idx)
     return acmod->feat_buf[feat_idx];
 }
 
+/**
+ * Record that scores for frame_idx are in senone_scores and write them
+ * to the senone dump file if there is one.
+ */
+static int
+acmod_score_done(acmod_t *acmod, int frame_idx)
+{
+    acmod->senscr_frame = frame_idx;
+
+    /* Dump scores to the senone dump file if one exists. */
+    if (acmod->senfh) {
+        if (acmod_write_scores(acmod, acmod->n_senone_active,
+                               acmod->senone_active,
+                               acmod->senone_scores,
+                               acmod->senfh) < 0)
+            return -1;
+        E_DEBUG("Frame %d has %d active states\n", frame_idx,
+                acmod->n_senone_active);
+    }
+    return 0;
+}
+
 int16 const *
 acmod_score(acmod_t *acmod, int *inout_frame_idx)
 {
@@ -1148,20 +1423,105 @@ acmod_score(acmod_t *acmod, int *inout_frame_idx)
 
     if (inout_frame_idx)
         *inout_frame_idx = frame_idx;
-    acmod->senscr_frame = frame_idx;
+    if (acmod_score_done(acmod, frame_idx) < 0)
+        return NULL;
 
-    /* Dump scores to the senone dump file if one exists. */
-    if (acmod->senfh) {
-        if (acmod_write_scores(acmod, acmod->n_senone_active,
-                               acmod->senone_active,
-                               acmod->senone_scores,
-                               acmod->senfh) < 0)
-            return NULL;
-        E_DEBUG("Frame %d has %d active states\n", frame_idx,
-                acmod->n_senone_active);
+    return acmod->senone_scores;
+}
+
+ps_mgau_t *
+ps_mgau_retain(ps_mgau_t *mg)
+{
+    /* Copies in other threads retain and free the original. */
+    sbatomic_add(&mg->refcount, 1);
+    return mg;
+}
+
+int
+ps_mgau_batch_eval(ps_mgau_frame_t *frames, int32 n_frames)
+{
+    int32 i;
+
+    if (n_frames == 0)
+        return 0;
+    for (i = 1; i < n_frames; ++i)
+        if (frames[i].mgau->vt != frames[0].mgau->vt)
+            break;
+    /* Only batch if they are all the same kind of model. */
+    if (i == n_frames && frames[0].mgau->vt->batch_eval)
+        return (*frames[0].mgau->vt->batch_eval)(frames, n_frames);
+    for (i = 0; i < n_frames; ++i) {
+        ps_mgau_frame_eval(frames[i].mgau,
+                           frames[i].senscr,
+                           frames[i].senone_active,
+                           frames[i].n_senone_active,
+                           frames[i].feat,
+                           frames[i].frame,
+                           frames[i].compallsen);
     }
+    return 0;
+}
 
-    return acmod->senone_scores;
+int
+acmod_score_batch(acmod_t **acmods, int32 n_acmod, int *out_frame_idx)
+{
+    ps_mgau_frame_t *frames;
+    acmod_t **batched;
+    int32 i, n_frames;
+    int rv = 0;
+
+    if (n_acmod == 0)
+        return 0;
+    /* Keep scratch space in the first one rather than allocating it
+     * for every frame. */
+    if (acmods[0]->n_batch_alloc < n_acmod) {
+        acmods[0]->batch_frames =
+            ckd_realloc(acmods[0]->batch_frames,
+                        n_acmod * sizeof(*acmods[0]->batch_frames));
+        acmods[0]->batch_acmods =
+            ckd_realloc(acmods[0]->batch_acmods,
+                        n_acmod * sizeof(*acmods[0]->batch_acmods));
+        acmods[0]->n_batch_alloc = n_acmod;
+    }
+    frames = acmods[0]->batch_frames;
+    batched = acmods[0]->batch_acmods;
+    for (n_frames = i = 0; i < n_acmod; ++i) {
+        acmod_t *acmod = acmods[i];
+        int frame_idx, feat_idx;
+
+        frame_idx = calc_frame_idx(acmod, NULL);
+        if (out_frame_idx)
+            out_frame_idx[i] = frame_idx;
+        /* Scores from a file or already computed are not batched. */
+        if (acmod->insenfh
+            || (acmod->compallsen && frame_idx == acmod->senscr_frame)) {
+            if (acmod_score(acmod, NULL) == NULL)
+                rv = -1;
+            continue;
+        }
+        if ((feat_idx = calc_feat_idx(acmod, frame_idx)) < 0) {
+            rv = -1;
+            continue;
+        }
+        acmod_flags2list(acmod);
+        frames[n_frames].mgau = acmod->mgau;
+        frames[n_frames].senscr = acmod->senone_scores;
+        frames[n_frames].senone_active = acmod->senone_active;
+        frames[n_frames].n_senone_active = acmod->n_senone_active;
+        frames[n_frames].feat = acmod->feat_buf[feat_idx];
+        frames[n_frames].frame = frame_idx;
+        frames[n_frames].compallsen = acmod->compallsen;
+        batched[n_frames++] = acmod;
+    }
+
+    ps_mgau_batch_eval(frames, n_frames);
+
+    for (i = 0; i < n_frames; ++i) {
+        if (acmod_score_done(batched[i], frames[i].frame) < 0)
+            rv = -1;
+    }
+
+    return rv;
 }
 
 int
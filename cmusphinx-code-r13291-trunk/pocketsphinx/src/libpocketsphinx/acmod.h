@@ -60,6 +60,7 @@
 #include "bin_mdef.h"
 #include "tmat.h"
 #include "hmm.h"
+#include "bin_am.h"
 
 /**
  * States in utterance processing.
@@ -95,6 +96,26 @@ struct ps_mllr_s {
  */
 typedef struct ps_mgau_s ps_mgau_t;
 
+/**
+ * One frame of one stream to be scored by ps_mgau_batch_eval().
+ */
+typedef struct ps_mgau_frame_s {
+    ps_mgau_t *mgau;         /**< Model parameters for this stream. */
+    int16 *senscr;           /**< Output senone scores. */
+    uint8 *senone_active;    /**< Array of deltas to active GMMs. */
+    int32 n_senone_active;   /**< Number of active GMMs. */
+    mfcc_t **feat;           /**< Dynamic features for this frame. */
+    int32 frame;             /**< Frame index in this stream. */
+    int32 compallsen;        /**< Compute all senones? */
+
+    /* Working space for batch_eval(), kept with the frame so that it
+     * is not allocated for every frame. */
+    int32 eval_idx;          /**< Model-specific state from frame setup. */
+    int32 bestscore;         /**< Best senone score in this frame. */
+    int32 *sen;              /**< Senones to score, grouped by codebook. */
+    int32 *sen_idx;          /**< Start of each codebook's senones in sen. */
+} ps_mgau_frame_t;
+
 typedef struct ps_mgaufuncs_s {
     char const *name;
 
@@ -108,11 +129,27 @@ typedef struct ps_mgaufuncs_s {
     int (*transform)(ps_mgau_t *mgau,
                      ps_mllr_t *mllr);
     void (*free)(ps_mgau_t *mgau);
+    /**
+     * Score one frame from each of several streams together.  All
+     * of them must use the same type of model (this vtable), and
+     * should share the same parameters, which will be traversed once
+     * for all streams rather than once per stream.  May be NULL, in
+     * which case frame_eval is called for each frame.
+     */
+    int (*batch_eval)(ps_mgau_frame_t *frames,
+                      int32 n_frames);
+    /**
+     * Create a new instance which shares the (read-only) parameters
+     * of this one, but has its own scoring state.
+     */
+    ps_mgau_t *(*copy)(ps_mgau_t *mgau);
 } ps_mgaufuncs_t;    
 
 struct ps_mgau_s {
     ps_mgaufuncs_t *vt;  /**< vtable of mgau functions. */
     int frame_idx;       /**< frame counter. */
+    int refcount;        /**< Reference count. */
+    ps_mgau_t *shared;   /**< Instance owning the parameters, or NULL if this one does. */
 };
 
 #define ps_mgau_base(mg) ((ps_mgau_t *)(mg))
@@ -123,6 +160,21 @@ struct ps_mgau_s {
     (*ps_mgau_base(mg)->vt->transform)(mg, mllr)
 #define ps_mgau_free(mg)                                  \
     (*ps_mgau_base(mg)->vt->free)(mg)
+#define ps_mgau_copy(mg)                                  \
+    (*ps_mgau_base(mg)->vt->copy)(mg)
+/** Are the parameters of this model shared with any other instance? */
+#define ps_mgau_is_shared(mg)                                           \
+    (ps_mgau_base(mg)->shared != NULL || ps_mgau_base(mg)->refcount > 1)
+
+/**
+ * Retain a pointer to a set of model parameters.
+ */
+ps_mgau_t *ps_mgau_retain(ps_mgau_t *mg);
+
+/**
+ * Score one frame from each of several streams, as a batch if possible.
+ */
+int ps_mgau_batch_eval(ps_mgau_frame_t *frames, int32 n_frames);
 
 /**
  * Acoustic model structure.
@@ -159,6 +211,7 @@ struct acmod_s {
     bin_mdef_t *mdef;          /**< Model definition. */
     tmat_t *tmat;              /**< Transition matrices. */
     ps_mgau_t *mgau;           /**< Model parameters. */
+    bin_am_t *am;              /**< Binary acoustic model (if any). */
     ps_mllr_t *mllr;           /**< Speaker transformation. */
 
     /* Senone scoring: */
@@ -168,6 +221,9 @@ struct acmod_s {
     int senscr_frame;          /**< Frame index for senone_scores. */
     int n_senone_active;       /**< Number of active GMMs. */
     int log_zero;              /**< Zero log-probability value. */
+    ps_mgau_frame_t *batch_frames; /**< Scratch for acmod_score_batch(). */
+    struct acmod_s **batch_acmods; /**< Scratch for acmod_score_batch(). */
+    int32 n_batch_alloc;       /**< Number of entries in batch scratch. */
 
     /* Utterance processing: */
     mfcc_t **mfc_buf;   /**< Temporary buffer of acoustic features. */
@@ -219,6 +275,48 @@ typedef struct acmod_s acmod_t;
  */
 acmod_t *acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb);
 
+/**
+ * Create an acoustic model which shares parameters with another one.
+ *
+ * The model definition, transition matrices and Gaussian mixture
+ * parameters of <code>other</code> are shared (and retained), while
+ * feature extraction and all per-utterance state are newly
+ * allocated.  Shared parameters cannot be modified, so
+ * acmod_update_mllr() will fail on either of the two objects.
+ *
+ * @param other acoustic model to share parameters with.
+ * @return a newly initialized acmod_t, or NULL on failure.
+ */
+acmod_t *acmod_copy(acmod_t *other);
+
+/**
+ * Write the parameters of an acoustic model to a binary acoustic
+ * model file, which can be loaded with the -ambin option.
+ *
+ * The parameters are written as they are used for scoring, so they
+ * can only be used with the same -logbase, -varfloor and -tmatfloor
+ * as this acoustic model.  Mixture weights for the general
+ * multi-stream computation also depend on -mixwfloor, and are read
+ * from the -mixw file instead if it does not match.
+ *
+ * @return 0 for success, <0 on error.
+ */
+POCKETSPHINX_EXPORT
+int acmod_write_am(acmod_t *acmod, const char *filename);
+
+/**
+ * Get the binary acoustic model to take a part of the model from.
+ *
+ * Parts whose own file was given explicitly (for instance -mean for
+ * the Gaussians) are read from that file instead of the -ambin
+ * container.
+ *
+ * @param arg option naming the file for this part.
+ * @param arg2 another such option, or NULL.
+ * @return the container, or NULL if this part comes from its own file.
+ */
+bin_am_t *acmod_am_for(acmod_t *acmod, char const *arg, char const *arg2);
+
 /**
  * Adapt acoustic model using a linear transform.
  *
@@ -406,6 +504,28 @@ mfcc_t **acmod_get_frame(acmod_t *acmod, int *inout_frame_idx);
 int16 const *acmod_score(acmod_t *acmod,
                          int *inout_frame_idx);
 
+/**
+ * Score the most recent frame of data for several acoustic models at
+ * once.
+ *
+ * This is equivalent to calling acmod_score() with a NULL frame index
+ * on each of them, except that, where they use the same kind of
+ * model, the model parameters are traversed once for all of them
+ * rather than once for each one.
+ *
+ * @param acmods Array of acoustic models to score.  Each one must
+ *               have at least one frame of features available.  The
+ *               first one holds scratch space for the batch, so it
+ *               should not be scored from two threads at once.
+ * @param n_acmod Number of acoustic models.
+ * @param out_frame_idx Output: frame index scored for each acoustic
+ *                      model, or NULL.
+ * @return 0 for success, <0 if any frame could not be scored.  The
+ *         scores are in each acoustic model's senone_scores.
+ */
+int acmod_score_batch(acmod_t **acmods, int32 n_acmod,
+                      int *out_frame_idx);
+
 /**
  * Write senone dump file header.
  */
@@ -0,0 +1,325 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced
+ * Research Projects Agency and the National Science Foundation of the
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file bin_am.c
+ *
+ * Binary acoustic model container.
+ */
+
+/* System headers. */
+#include <stdio.h>
+#include <string.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/fe.h>
+#include <sphinxbase/sbthread.h>
+
+/* Local headers. */
+#include "bin_am.h"
+
+struct bin_am_s {
+    int refcount;
+    mmio_file_t *filemap; /**< File map (if memory-mapped) */
+    void *buf;            /**< Storage (if not memory-mapped) */
+    char *base;           /**< Start of file data */
+    size_t size;          /**< Size of file data */
+    bin_am_header_t *hdr;
+    bin_am_section_t *sections;
+};
+
+#define BIN_AM_ALIGN_UP(x) (((x) + BIN_AM_ALIGN - 1) & ~((size_t)BIN_AM_ALIGN - 1))
+
+static void
+bin_am_header_init(bin_am_header_t *hdr, cmd_ln_t *config)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, BIN_AM_MAGIC, sizeof(hdr->magic));
+    hdr->byte_order = BIN_AM_BYTE_ORDER;
+    hdr->version = BIN_AM_FORMAT_VERSION;
+    hdr->mfcc_size = sizeof(mfcc_t);
+#ifdef FIXED_POINT
+    hdr->fixed_point = DEFAULT_RADIX;
+#endif
+    hdr->logbase = cmd_ln_float32_r(config, "-logbase");
+    hdr->varfloor = cmd_ln_float32_r(config, "-varfloor");
+    hdr->tmatfloor = cmd_ln_float32_r(config, "-tmatfloor");
+}
+
+static int
+bin_am_header_check(bin_am_header_t const *hdr, cmd_ln_t *config,
+                    const char *filename)
+{
+    bin_am_header_t ref;
+
+    bin_am_header_init(&ref, config);
+    if (memcmp(hdr->magic, ref.magic, sizeof(hdr->magic)) != 0) {
+        E_ERROR("%s is not a binary acoustic model\n", filename);
+        return -1;
+    }
+    if (hdr->byte_order != ref.byte_order) {
+        E_ERROR("%s was written on a machine with different byte order\n",
+                filename);
+        return -1;
+    }
+    if (hdr->version > ref.version) {
+        E_ERROR("File format version %d for %s is newer than library\n",
+                hdr->version, filename);
+        return -1;
+    }
+    if (hdr->mfcc_size != ref.mfcc_size
+        || hdr->fixed_point != ref.fixed_point) {
+        E_ERROR("%s was precomputed for a different arithmetic (%s)\n",
+                filename, hdr->fixed_point ? "fixed-point" : "floating-point");
+        return -1;
+    }
+    if (hdr->logbase != ref.logbase
+        || hdr->varfloor != ref.varfloor
+        || hdr->tmatfloor != ref.tmatfloor) {
+        E_ERROR("%s was precomputed with -logbase %g -varfloor %g -tmatfloor %g\n",
+                filename, hdr->logbase, hdr->varfloor, hdr->tmatfloor);
+        return -1;
+    }
+    return 0;
+}
+
+bin_am_t *
+bin_am_read(cmd_ln_t *config, const char *filename)
+{
+    bin_am_t *am;
+    bin_am_header_t hdr;
+    FILE *fh;
+    long end;
+    uint32 i;
+
+    E_INFO("Reading binary acoustic model: %s\n", filename);
+    if ((fh = fopen(filename, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s", filename);
+        return NULL;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fh) != 1) {
+        E_ERROR_SYSTEM("Failed to read header from %s", filename);
+        fclose(fh);
+        return NULL;
+    }
+    if (bin_am_header_check(&hdr, config, filename) < 0) {
+        fclose(fh);
+        return NULL;
+    }
+    fseek(fh, 0, SEEK_END);
+    end = ftell(fh);
+
+    am = ckd_calloc(1, sizeof(*am));
+    am->refcount = 1;
+    am->size = end;
+    if (cmd_ln_boolean_r(config, "-mmap")
+        && (am->filemap = mmio_file_read(filename)) != NULL) {
+        am->base = mmio_file_ptr(am->filemap);
+    }
+    else {
+        /* Sections are aligned relative to the start of the file, so
+         * the buffer has to be aligned too. */
+        am->buf = ckd_malloc(am->size + BIN_AM_ALIGN);
+        am->base = (char *)BIN_AM_ALIGN_UP((size_t)am->buf);
+        fseek(fh, 0, SEEK_SET);
+        if (fread(am->base, 1, am->size, fh) != am->size) {
+            E_ERROR_SYSTEM("Failed to read %ld bytes from %s", end, filename);
+            fclose(fh);
+            bin_am_free(am);
+            return NULL;
+        }
+    }
+    fclose(fh);
+
+    am->hdr = (bin_am_header_t *)am->base;
+    am->sections = (bin_am_section_t *)(am->hdr + 1);
+    if (sizeof(hdr) + (size_t)hdr.n_section * sizeof(*am->sections) > am->size) {
+        E_ERROR("Section table in %s is truncated\n", filename);
+        bin_am_free(am);
+        return NULL;
+    }
+    for (i = 0; i < hdr.n_section; ++i) {
+        bin_am_section_t const *s = am->sections + i;
+        if (s->offset % BIN_AM_ALIGN != 0
+            || s->offset > am->size || s->size > am->size - s->offset) {
+            E_ERROR("Section %d in %s is misaligned or truncated\n",
+                    i, filename);
+            bin_am_free(am);
+            return NULL;
+        }
+    }
+    E_INFO("%d sections, %ld bytes%s\n", hdr.n_section, end,
+           am->filemap ? " (memory-mapped)" : "");
+
+    return am;
+}
+
+bin_am_t *
+bin_am_retain(bin_am_t *am)
+{
+    sbatomic_add(&am->refcount, 1);
+    return am;
+}
+
+int
+bin_am_free(bin_am_t *am)
+{
+    int refcount;
+
+    if (am == NULL)
+        return 0;
+    if ((refcount = sbatomic_add(&am->refcount, -1)) > 0)
+        return refcount;
+    if (am->filemap)
+        mmio_file_unmap(am->filemap);
+    ckd_free(am->buf);
+    ckd_free(am);
+    return 0;
+}
+
+void *
+bin_am_section(bin_am_t *am, uint32 id, size_t *out_size)
+{
+    uint32 i;
+
+    for (i = 0; i < am->hdr->n_section; ++i) {
+        if (am->sections[i].id == id) {
+            if (out_size)
+                *out_size = am->sections[i].size;
+            return am->base + am->sections[i].offset;
+        }
+    }
+    if (out_size)
+        *out_size = 0;
+    return NULL;
+}
+
+int
+bin_am_write(cmd_ln_t *config, const char *filename,
+             bin_am_data_t const *sections, int n_sections)
+{
+    static const char pad[BIN_AM_ALIGN];
+    bin_am_header_t hdr;
+    bin_am_section_t *table;
+    size_t offset;
+    FILE *fh;
+    int i, rv;
+
+    bin_am_header_init(&hdr, config);
+    hdr.n_section = n_sections;
+
+    table = ckd_calloc(n_sections, sizeof(*table));
+    offset = BIN_AM_ALIGN_UP(sizeof(hdr) + n_sections * sizeof(*table));
+    for (i = 0; i < n_sections; ++i) {
+        table[i].id = sections[i].id;
+        table[i].offset = offset;
+        table[i].size = sections[i].size;
+        offset = BIN_AM_ALIGN_UP(offset + sections[i].size);
+    }
+
+    if ((fh = fopen(filename, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", filename);
+        ckd_free(table);
+        return -1;
+    }
+    rv = -1;
+    offset = sizeof(hdr) + n_sections * sizeof(*table);
+    if (fwrite(&hdr, sizeof(hdr), 1, fh) != 1
+        || fwrite(table, sizeof(*table), n_sections, fh) != (size_t)n_sections)
+        goto error_out;
+    for (i = 0; i < n_sections; ++i) {
+        if (fwrite(pad, 1, table[i].offset - offset, fh)
+            != table[i].offset - offset)
+            goto error_out;
+        if (fwrite(sections[i].data, 1, sections[i].size, fh)
+            != sections[i].size)
+            goto error_out;
+        offset = table[i].offset + sections[i].size;
+    }
+    rv = 0;
+    E_INFO("Wrote %d sections, %ld bytes to %s\n",
+           n_sections, (long)offset, filename);
+
+error_out:
+    if (rv < 0)
+        E_ERROR_SYSTEM("Failed to write %s", filename);
+    fclose(fh);
+    ckd_free(table);
+    return rv;
+}
+
+uint8 ***
+bin_am_sendump(bin_am_t *am, int32 n_feat, int32 n_density,
+               int32 n_sen, uint8 **out_mixw_cb)
+{
+    bin_am_sendump_t const *sd;
+    uint8 ***mixw;
+    uint8 *data;
+    size_t size;
+    int32 f, d;
+
+    if ((sd = bin_am_section(am, BIN_AM_SENDUMP, &size)) == NULL
+        || size < sizeof(*sd))
+        return NULL;
+    if (sd->n_feat != n_feat || sd->n_density != n_density
+        || sd->n_sen != n_sen) {
+        E_ERROR("Mixture weights are %dx%dx%d, expected %dx%dx%d\n",
+                sd->n_feat, sd->n_density, sd->n_sen,
+                n_feat, n_density, n_sen);
+        return NULL;
+    }
+    *out_mixw_cb = bin_am_section(am, BIN_AM_MIXW_CB, &size);
+    if (*out_mixw_cb && size != 16) {
+        E_ERROR("Mixture weight codebook has %d entries, expected 16\n",
+                (int)size);
+        return NULL;
+    }
+    data = bin_am_section(am, BIN_AM_MIXW, &size);
+    if (data == NULL || size < (size_t)n_feat * n_density * sd->stride
+        || sd->stride < (*out_mixw_cb ? (n_sen + 1) / 2 : n_sen)) {
+        E_ERROR("Mixture weights are missing or truncated\n");
+        return NULL;
+    }
+
+    mixw = (uint8 ***)ckd_calloc_2d(n_feat, n_density, sizeof(*mixw[0]));
+    for (f = 0; f < n_feat; ++f)
+        for (d = 0; d < n_density; ++d)
+            mixw[f][d] = data + ((size_t)f * n_density + d) * sd->stride;
+    return mixw;
+}
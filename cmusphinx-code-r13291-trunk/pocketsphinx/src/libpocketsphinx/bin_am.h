@@ -0,0 +1,230 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced
+ * Research Projects Agency and the National Science Foundation of the
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file bin_am.h
+ *
+ * Binary acoustic model container.
+ *
+ * This holds all of the parameters of an acoustic model, already
+ * precomputed and laid out the way the scoring code uses them, in a
+ * single native-endian file which can be memory-mapped and used
+ * without any parsing.  It consists of a header, a table of
+ * sections, and the sections themselves, each of which is aligned
+ * to BIN_AM_ALIGN bytes.
+ *
+ * Since the precomputed parameters depend on some decoder settings
+ * (log base, variance and transition floors, fixed or floating
+ * point), these are recorded in the header, and the file is rejected
+ * if they do not match.
+ */
+
+#ifndef __BIN_AM_H__
+#define __BIN_AM_H__
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/mmio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+/* Fool Emacs. */
+}
+#endif
+
+#define BIN_AM_FORMAT_VERSION 1
+#define BIN_AM_MAGIC "PSAMODEL"
+#define BIN_AM_BYTE_ORDER 0x11223344
+/** Alignment of sections, enough for any SIMD loads in the scoring code. */
+#define BIN_AM_ALIGN 32
+
+/** Make a section identifier from four characters. */
+#define BIN_AM_ID(a,b,c,d)                                      \
+    ((uint32)(a) | ((uint32)(b) << 8) | ((uint32)(c) << 16) | ((uint32)(d) << 24))
+
+/**
+ * Section identifiers.
+ */
+enum bin_am_section_e {
+    BIN_AM_MDEF = BIN_AM_ID('M','D','E','F'), /**< Binary mdef file, as written by bin_mdef_write() */
+    BIN_AM_TMAT = BIN_AM_ID('T','M','A','T'), /**< Quantized transition matrices (bin_am_tmat_t) */
+    BIN_AM_TMAT_DATA = BIN_AM_ID('T','M','D','T'), /**< uint8 [n_tmat][n_state][n_state+1] */
+    BIN_AM_GAUDEN = BIN_AM_ID('G','A','U','D'), /**< Gaussian dimensions (bin_am_gauden_t) */
+    BIN_AM_MEAN = BIN_AM_ID('M','E','A','N'), /**< mfcc_t [n_mgau][n_feat][n_density][featlen] */
+    BIN_AM_VAR = BIN_AM_ID('V','A','R',' '), /**< Precomputed variances, laid out as means */
+    BIN_AM_DET = BIN_AM_ID('D','E','T',' '), /**< mfcc_t [n_mgau][n_feat][n_density] */
+    BIN_AM_BLOCKED = BIN_AM_ID('G','B','L','K'), /**< Blocked means, variances, determinants */
+    BIN_AM_SENDUMP = BIN_AM_ID('S','D','M','P'), /**< Quantized mixture weights (bin_am_sendump_t) */
+    BIN_AM_MIXW_CB = BIN_AM_ID('S','D','C','B'), /**< Mixture weight codebook (16 bytes) */
+    BIN_AM_MIXW = BIN_AM_ID('S','D','D','T'),  /**< uint8 [n_feat][n_density][stride] */
+    BIN_AM_SENONE = BIN_AM_ID('S','E','N','O'), /**< Multi-stream senones (bin_am_senone_t) */
+    BIN_AM_SENONE_PDF = BIN_AM_ID('S','E','N','P') /**< Quantized mixture weights, laid out as in senone_t */
+};
+
+/**
+ * File header.
+ */
+typedef struct bin_am_header_s {
+    char magic[8];       /**< BIN_AM_MAGIC */
+    uint32 byte_order;   /**< BIN_AM_BYTE_ORDER, in native byte order */
+    uint32 version;      /**< BIN_AM_FORMAT_VERSION */
+    uint32 mfcc_size;    /**< sizeof(mfcc_t) */
+    uint32 fixed_point;  /**< Non-zero if mfcc_t is fixed-point */
+    float64 logbase;     /**< -logbase used for precomputation */
+    float32 varfloor;    /**< -varfloor used for precomputation */
+    float32 tmatfloor;   /**< -tmatfloor used for precomputation */
+    uint32 n_section;    /**< Number of entries in section table */
+    uint32 reserved;
+} bin_am_header_t;
+
+/**
+ * Entry in the section table, which follows the header.
+ */
+typedef struct bin_am_section_s {
+    uint32 id;           /**< Section identifier */
+    uint32 reserved;
+    uint64 offset;       /**< Offset from start of file (aligned) */
+    uint64 size;         /**< Size in bytes */
+} bin_am_section_t;
+
+/** Contents of BIN_AM_TMAT section. */
+typedef struct bin_am_tmat_s {
+    int32 n_tmat;
+    int32 n_state;
+} bin_am_tmat_t;
+
+/** Contents of BIN_AM_GAUDEN section, followed by int32 featlen[n_feat]. */
+typedef struct bin_am_gauden_s {
+    int32 n_mgau;
+    int32 n_feat;
+    int32 n_density;
+    int32 n_blk;         /**< Number of density blocks in BIN_AM_BLOCKED, if any */
+} bin_am_gauden_t;
+
+/** Contents of BIN_AM_SENDUMP section. */
+typedef struct bin_am_sendump_s {
+    int32 n_feat;
+    int32 n_density;
+    int32 n_sen;
+    int32 stride;        /**< Bytes per row of mixture weights */
+} bin_am_sendump_t;
+
+/**
+ * Contents of BIN_AM_SENONE section, followed by uint32 mgau[n_sen].
+ * The mixture weights in BIN_AM_SENONE_PDF are [n_sen][n_feat][n_cw]
+ * if n_gauden > 1, otherwise [n_feat][n_cw][n_sen].
+ */
+typedef struct bin_am_senone_s {
+    int32 n_sen;
+    int32 n_feat;
+    int32 n_cw;
+    int32 n_gauden;
+    float32 mixwfloor;   /**< -mixwfloor used for quantization */
+    int32 reserved;
+} bin_am_senone_t;
+
+/**
+ * Binary acoustic model container.
+ */
+typedef struct bin_am_s bin_am_t;
+
+/**
+ * Section to be written with bin_am_write().
+ */
+typedef struct bin_am_data_s {
+    uint32 id;
+    void const *data;
+    size_t size;
+} bin_am_data_t;
+
+/**
+ * Open a binary acoustic model, memory-mapping it if -mmap is set.
+ *
+ * @return the container, or NULL if it could not be read or was
+ *         precomputed with different settings from those in config.
+ */
+bin_am_t *bin_am_read(cmd_ln_t *config, const char *filename);
+
+/**
+ * Retain a pointer to a binary acoustic model.
+ */
+bin_am_t *bin_am_retain(bin_am_t *am);
+
+/**
+ * Release a pointer to a binary acoustic model.
+ *
+ * @return new reference count (0 if freed)
+ */
+int bin_am_free(bin_am_t *am);
+
+/**
+ * Get a section of a binary acoustic model.
+ *
+ * @param out_size output, size of the section in bytes (may be NULL).
+ * @return pointer to section data, or NULL if not present.  This may
+ *         be in read-only memory and must not be modified.
+ */
+void *bin_am_section(bin_am_t *am, uint32 id, size_t *out_size);
+
+/**
+ * Write a binary acoustic model.
+ *
+ * @param config decoder configuration used to precompute parameters.
+ * @return 0 for success, <0 on error.
+ */
+int bin_am_write(cmd_ln_t *config, const char *filename,
+                 bin_am_data_t const *sections, int n_sections);
+
+/**
+ * Get quantized mixture weights from a binary acoustic model.
+ *
+ * @param out_mixw_cb output, mixture weight codebook, or NULL if
+ *                    there is none.
+ * @return array of pointers to rows of mixture weights, indexed by
+ *         feature and density, to be freed with ckd_free_2d(), or NULL
+ *         if there are none or they do not match the given dimensions.
+ */
+uint8 ***bin_am_sendump(bin_am_t *am, int32 n_feat, int32 n_density,
+                        int32 n_sen, uint8 **out_mixw_cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BIN_AM_H__ */
@@ -57,6 +57,7 @@
 #include <sphinxbase/byteorder.h>
 #include <sphinxbase/case.h>
 #include <sphinxbase/err.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "mdef.h"
@@ -264,17 +265,19 @@ bin_mdef_read_text(cmd_ln_t *config, const char *filename)
 bin_mdef_t *
 bin_mdef_retain(bin_mdef_t *m)
 {
-    ++m->refcnt;
+    sbatomic_add(&m->refcnt, 1);
     return m;
 }
 
 int
 bin_mdef_free(bin_mdef_t * m)
 {
+    int refcnt;
+
     if (m == NULL)
         return 0;
-    if (--m->refcnt > 0)
-        return m->refcnt;
+    if ((refcnt = sbatomic_add(&m->refcnt, -1)) > 0)
+        return refcnt;
 
     switch (m->alloc_mode) {
     case BIN_MDEF_FROM_TEXT:
@@ -287,10 +290,12 @@ bin_mdef_free(bin_mdef_t * m)
         ckd_free(m->ciname[0]);
         break;
     case BIN_MDEF_ON_DISK:
+    case BIN_MDEF_IN_CONTAINER:
         break;
     }
     if (m->filemap)
         mmio_file_unmap(m->filemap);
+    bin_am_free(m->am);
     ckd_free(m->cd2cisen);
     ckd_free(m->sen2cimap);
     ckd_free(m->ciname);
@@ -319,15 +324,111 @@ static const char format_desc[] =
     "int8 sseq_len[];    /**< Number of states in each sseq (none if homogeneous) */\n"
     "END FILE FORMAT DESCRIPTION\n";
 
+/**
+ * Set up pointers into the data following the header, which begins
+ * at m->ciname[0], and build the CD-to-CI mappings.
+ */
+static void
+bin_mdef_setup(bin_mdef_t *m, int swap)
+{
+    size_t tree_start;
+    int32 i;
+    int32 *sseq_size;
+
+    for (i = 1; i < m->n_ciphone; ++i)
+        m->ciname[i] = m->ciname[i - 1] + strlen(m->ciname[i - 1]) + 1;
+
+    /* Skip past the padding. */
+    tree_start =
+        m->ciname[i - 1] + strlen(m->ciname[i - 1]) + 1 - m->ciname[0];
+    tree_start = (tree_start + 3) & ~3;
+    m->cd_tree = (cd_tree_t *) (m->ciname[0] + tree_start);
+    if (swap) {
+        for (i = 0; i < m->n_cd_tree; ++i) {
+            SWAP_INT16(&m->cd_tree[i].ctx);
+            SWAP_INT16(&m->cd_tree[i].n_down);
+            SWAP_INT32(&m->cd_tree[i].c.down);
+        }
+    }
+    m->phone = (mdef_entry_t *) (m->cd_tree + m->n_cd_tree);
+    if (swap) {
+        for (i = 0; i < m->n_phone; ++i) {
+            SWAP_INT32(&m->phone[i].ssid);
+            SWAP_INT32(&m->phone[i].tmat);
+        }
+    }
+    sseq_size = (int32 *) (m->phone + m->n_phone);
+    if (swap)
+        SWAP_INT32(sseq_size);
+    m->sseq = ckd_calloc(m->n_sseq, sizeof(*m->sseq));
+    m->sseq[0] = (uint16 *) (sseq_size + 1);
+    if (swap) {
+        for (i = 0; i < *sseq_size; ++i)
+            SWAP_INT16(m->sseq[0] + i);
+    }
+    if (m->n_emit_state) {
+        for (i = 1; i < m->n_sseq; ++i)
+            m->sseq[i] = m->sseq[0] + i * m->n_emit_state;
+    }
+    else {
+        m->sseq_len = (uint8 *) (m->sseq[0] + *sseq_size);
+        for (i = 1; i < m->n_sseq; ++i)
+            m->sseq[i] = m->sseq[i - 1] + m->sseq_len[i - 1];
+    }
+
+    /* Now build the CD-to-CI mappings using the senone sequences.
+     * This is the only really accurate way to do it, though it is
+     * still inaccurate in the case of heterogeneous topologies or
+     * cross-state tying. */
+    m->cd2cisen = (int16 *) ckd_malloc(m->n_sen * sizeof(*m->cd2cisen));
+    m->sen2cimap = (int16 *) ckd_malloc(m->n_sen * sizeof(*m->sen2cimap));
+
+    /* Default mappings (identity, none) */
+    for (i = 0; i < m->n_ci_sen; ++i)
+        m->cd2cisen[i] = i;
+    for (; i < m->n_sen; ++i)
+        m->cd2cisen[i] = -1;
+    for (i = 0; i < m->n_sen; ++i)
+        m->sen2cimap[i] = -1;
+    for (i = 0; i < m->n_phone; ++i) {
+        int32 j, ssid = m->phone[i].ssid;
+
+        for (j = 0; j < bin_mdef_n_emit_state_phone(m, i); ++j) {
+            int s = bin_mdef_sseq2sen(m, ssid, j);
+            int ci = bin_mdef_pid2ci(m, i);
+            /* Take the first one and warn if we have cross-state tying. */
+            if (m->sen2cimap[s] == -1)
+                m->sen2cimap[s] = ci;
+            if (m->sen2cimap[s] != ci)
+                E_WARN
+                    ("Senone %d is shared between multiple base phones\n",
+                     s);
+
+            if (j > bin_mdef_n_emit_state_phone(m, ci))
+                E_WARN("CD phone %d has fewer states than CI phone %d\n",
+                       i, ci);
+            else
+                m->cd2cisen[s] =
+                    bin_mdef_sseq2sen(m, m->phone[ci].ssid, j);
+        }
+    }
+
+    /* Set the silence phone. */
+    m->sil = bin_mdef_ciphone_id(m, S3_SILENCE_CIPHONE);
+
+    E_INFO
+        ("%d CI-phone, %d CD-phone, %d emitstate/phone, %d CI-sen, %d Sen, %d Sen-Seq\n",
+         m->n_ciphone, m->n_phone - m->n_ciphone, m->n_emit_state,
+         m->n_ci_sen, m->n_sen, m->n_sseq);
+}
+
 bin_mdef_t *
 bin_mdef_read(cmd_ln_t *config, const char *filename)
 {
     bin_mdef_t *m;
     FILE *fh;
-    size_t tree_start;
-    int32 val, i, do_mmap, swap;
+    int32 val, do_mmap, swap;
     long pos, end;
-    int32 *sseq_size;
 
     /* Try to read it as text first. */
     if ((m = bin_mdef_read_text(config, filename)) != NULL)
@@ -429,93 +530,50 @@ bin_mdef_read(cmd_ln_t *config, const char *filename)
             E_FATAL("Failed to read %d bytes of data from %s\n", end - pos, filename);
     }
 
-    for (i = 1; i < m->n_ciphone; ++i)
-        m->ciname[i] = m->ciname[i - 1] + strlen(m->ciname[i - 1]) + 1;
-
-    /* Skip past the padding. */
-    tree_start =
-        m->ciname[i - 1] + strlen(m->ciname[i - 1]) + 1 - m->ciname[0];
-    tree_start = (tree_start + 3) & ~3;
-    m->cd_tree = (cd_tree_t *) (m->ciname[0] + tree_start);
-    if (swap) {
-        for (i = 0; i < m->n_cd_tree; ++i) {
-            SWAP_INT16(&m->cd_tree[i].ctx);
-            SWAP_INT16(&m->cd_tree[i].n_down);
-            SWAP_INT32(&m->cd_tree[i].c.down);
-        }
-    }
-    m->phone = (mdef_entry_t *) (m->cd_tree + m->n_cd_tree);
-    if (swap) {
-        for (i = 0; i < m->n_phone; ++i) {
-            SWAP_INT32(&m->phone[i].ssid);
-            SWAP_INT32(&m->phone[i].tmat);
-        }
-    }
-    sseq_size = (int32 *) (m->phone + m->n_phone);
-    if (swap)
-        SWAP_INT32(sseq_size);
-    m->sseq = ckd_calloc(m->n_sseq, sizeof(*m->sseq));
-    m->sseq[0] = (uint16 *) (sseq_size + 1);
-    if (swap) {
-        for (i = 0; i < *sseq_size; ++i)
-            SWAP_INT16(m->sseq[0] + i);
-    }
-    if (m->n_emit_state) {
-        for (i = 1; i < m->n_sseq; ++i)
-            m->sseq[i] = m->sseq[0] + i * m->n_emit_state;
-    }
-    else {
-        m->sseq_len = (uint8 *) (m->sseq[0] + *sseq_size);
-        for (i = 1; i < m->n_sseq; ++i)
-            m->sseq[i] = m->sseq[i - 1] + m->sseq_len[i - 1];
-    }
-
-    /* Now build the CD-to-CI mappings using the senone sequences.
-     * This is the only really accurate way to do it, though it is
-     * still inaccurate in the case of heterogeneous topologies or
-     * cross-state tying. */
-    m->cd2cisen = (int16 *) ckd_malloc(m->n_sen * sizeof(*m->cd2cisen));
-    m->sen2cimap = (int16 *) ckd_malloc(m->n_sen * sizeof(*m->sen2cimap));
+    fclose(fh);
 
-    /* Default mappings (identity, none) */
-    for (i = 0; i < m->n_ci_sen; ++i)
-        m->cd2cisen[i] = i;
-    for (; i < m->n_sen; ++i)
-        m->cd2cisen[i] = -1;
-    for (i = 0; i < m->n_sen; ++i)
-        m->sen2cimap[i] = -1;
-    for (i = 0; i < m->n_phone; ++i) {
-        int32 j, ssid = m->phone[i].ssid;
+    bin_mdef_setup(m, swap);
+    return m;
+}
 
-        for (j = 0; j < bin_mdef_n_emit_state_phone(m, i); ++j) {
-            int s = bin_mdef_sseq2sen(m, ssid, j);
-            int ci = bin_mdef_pid2ci(m, i);
-            /* Take the first one and warn if we have cross-state tying. */
-            if (m->sen2cimap[s] == -1)
-                m->sen2cimap[s] = ci;
-            if (m->sen2cimap[s] != ci)
-                E_WARN
-                    ("Senone %d is shared between multiple base phones\n",
-                     s);
+bin_mdef_t *
+bin_mdef_read_am(bin_am_t *am)
+{
+    bin_mdef_t *m;
+    char *data;
+    size_t size, pos;
+    int32 hdr[3];
 
-            if (j > bin_mdef_n_emit_state_phone(m, ci))
-                E_WARN("CD phone %d has fewer states than CI phone %d\n",
-                       i, ci);
-            else
-                m->cd2cisen[s] =
-                    bin_mdef_sseq2sen(m, m->phone[ci].ssid, j);
-        }
+    if ((data = bin_am_section(am, BIN_AM_MDEF, &size)) == NULL)
+        return NULL;
+    /* Byte order, version, header length, format descriptor, then
+     * the ten int32 fields of bin_mdef_t. */
+    if (size < sizeof(hdr))
+        goto truncated;
+    memcpy(hdr, data, sizeof(hdr));
+    if (hdr[0] != BIN_MDEF_NATIVE_ENDIAN || hdr[1] > BIN_MDEF_FORMAT_VERSION) {
+        E_ERROR("Model definition in binary acoustic model is invalid\n");
+        return NULL;
     }
+    pos = sizeof(hdr) + hdr[2];
+    if (hdr[2] < 0 || pos + 10 * sizeof(int32) > size)
+        goto truncated;
 
-    /* Set the silence phone. */
-    m->sil = bin_mdef_ciphone_id(m, S3_SILENCE_CIPHONE);
+    m = ckd_calloc(1, sizeof(*m));
+    m->refcnt = 1;
+    memcpy(&m->n_ciphone, data + pos, 10 * sizeof(int32));
+    pos += 10 * sizeof(int32);
+    m->ciname = ckd_calloc(m->n_ciphone, sizeof(*m->ciname));
+    m->ciname[0] = data + pos;
+    m->alloc_mode = BIN_MDEF_IN_CONTAINER;
+    m->am = bin_am_retain(am);
 
-    E_INFO
-        ("%d CI-phone, %d CD-phone, %d emitstate/phone, %d CI-sen, %d Sen, %d Sen-Seq\n",
-         m->n_ciphone, m->n_phone - m->n_ciphone, m->n_emit_state,
-         m->n_ci_sen, m->n_sen, m->n_sseq);
-    fclose(fh);
+    bin_mdef_setup(m, FALSE);
     return m;
+
+truncated:
+    E_ERROR("Model definition in binary acoustic model is truncated\n");
+    return NULL;
 }
 
 int
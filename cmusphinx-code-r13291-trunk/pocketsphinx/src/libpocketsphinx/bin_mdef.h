@@ -55,6 +55,7 @@ extern "C" {
 #include <pocketsphinx_export.h>
 
 #include "mdef.h"
+#include "bin_am.h"
 
 #define BIN_MDEF_FORMAT_VERSION 1
 /* Little-endian machines will write "BMDF" to disk, big-endian ones "FDMB". */
@@ -128,6 +129,7 @@ struct bin_mdef_s {
 	int32 sil;	    /**< CI phone ID for silence */
 
 	mmio_file_t *filemap;/**< File map for this file (if any) */
+	bin_am_t *am;        /**< Binary acoustic model containing this (if any) */
 	char **ciname;       /**< CI phone names */
 	cd_tree_t *cd_tree;  /**< Tree mapping CD phones to phone IDs */
 	mdef_entry_t *phone; /**< All phone structures */
@@ -139,7 +141,8 @@ struct bin_mdef_s {
 	int16 *sen2cimap;	/**< Parent CI-phone for each senone (CI or CD) */
 
 	/** Allocation mode for this object. */
-	enum { BIN_MDEF_FROM_TEXT, BIN_MDEF_IN_MEMORY, BIN_MDEF_ON_DISK } alloc_mode;
+	enum { BIN_MDEF_FROM_TEXT, BIN_MDEF_IN_MEMORY, BIN_MDEF_ON_DISK,
+	       BIN_MDEF_IN_CONTAINER } alloc_mode;
 };
 
 #define bin_mdef_is_fillerphone(m,p)	(((p) < (m)->n_ciphone) \
@@ -172,6 +175,10 @@ bin_mdef_t *bin_mdef_read(cmd_ln_t *config, const char *filename);
  */
 POCKETSPHINX_EXPORT
 bin_mdef_t *bin_mdef_read_text(cmd_ln_t *config, const char *filename);
+/**
+ * Get a binary mdef from a binary acoustic model, without copying it.
+ */
+bin_mdef_t *bin_mdef_read_am(bin_am_t *am);
 /**
  * Write a binary mdef to a file.
  */
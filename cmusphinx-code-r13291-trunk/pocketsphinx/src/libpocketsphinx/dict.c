@@ -41,6 +41,7 @@
 /* SphinxBase headers. */
 #include <sphinxbase/pio.h>
 #include <sphinxbase/strfuncs.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "dict.h"
@@ -460,20 +461,21 @@ dict_word2basestr(char *word)
 dict_t *
 dict_retain(dict_t *d)
 {
-    ++d->refcnt;
+    sbatomic_add(&d->refcnt, 1);
     return d;
 }
 
 int
 dict_free(dict_t * d)
 {
-    int i;
+    int i, refcnt;
     dictword_t *word;
 
     if (d == NULL)
         return 0;
-    if (--d->refcnt > 0)
-        return d->refcnt;
+    /* Decoders in other threads may be sharing it. */
+    if ((refcnt = sbatomic_add(&d->refcnt, -1)) > 0)
+        return refcnt;
 
     /* First Step, free all memory allocated for each word */
     for (i = 0; i < d->n_word; i++) {
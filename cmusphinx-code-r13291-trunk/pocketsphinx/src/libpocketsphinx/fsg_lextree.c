@@ -59,6 +59,17 @@ typedef struct fsg_glist_linklist_t {
     struct   fsg_glist_linklist_t *next;
 } fsg_glist_linklist_t;
 
+/* A subtree not used by the current FSG, kept for fsg_lextree_update() */
+typedef struct fsg_psubtree_cache_s {
+    int32 *sig;
+    fsg_pnode_t *root;
+    fsg_pnode_t *alloc_head;
+    int32 *leaf_arc;	/* Arc of each leaf, relative to the first arc out
+			   of its state, in allocation order */
+    int32 n_update;	/* Update in which this was retired */
+    struct fsg_psubtree_cache_s *next; /* Others with the same signature */
+} fsg_psubtree_cache_t;
+
 /**
  * Build the phone lextree for all transitions out of state from_state.
  * Return the root node of this tree.
@@ -111,35 +122,33 @@ fsg_lextree_lc_rc(fsg_lextree_t *lextree)
 
 
     for (s = 0; s < fsg->n_state; s++) {
-        fsg_arciter_t *itor;
-        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor)) {
-            fsg_link_t *l = fsg_arciter_get(itor);
+        fsg_link_t *l, *end;
+        end = fsg_model_null_arcs_begin(fsg, s);
+        for (l = fsg_model_arcs_begin(fsg, s); l < end; ++l) {
             int32 dictwid; /**< Dictionary (not FSG) word ID!! */
 
-            if (fsg_link_wid(l) >= 0) {
-                dictwid = dict_wordid(lextree->dict,
-                                      fsg_model_word_str(lextree->fsg, l->wid));
-
-                /*
-                 * Add the first CIphone of l->wid to the rclist of state s, and
-                 * the last CIphone to lclist of state d.
-                 * (Filler phones are a pain to deal with.  There is no direct
-                 * marking of a filler phone; but only filler words are supposed to
-                 * use such phones, so we use that fact.  HACK!!  FRAGILE!!)
-                 *
-                 * UPD: tests carsh here if .fsg model used with wrong hmm and
-                 *      dictionary
-                 */
-                if (fsg_model_is_filler(fsg, fsg_link_wid(l))) {
-                    /* Filler phone; use silence phone as context */
-                    lextree->rc[fsg_link_from_state(l)][silcipid] = 1;
-                    lextree->lc[fsg_link_to_state(l)][silcipid] = 1;
-                }
-                else {
-                    len = dict_pronlen(lextree->dict, dictwid);
-                    lextree->rc[fsg_link_from_state(l)][dict_pron(lextree->dict, dictwid, 0)] = 1;
-                    lextree->lc[fsg_link_to_state(l)][dict_pron(lextree->dict, dictwid, len - 1)] = 1;
-                }
+            dictwid = dict_wordid(lextree->dict,
+                                  fsg_model_word_str(lextree->fsg, l->wid));
+
+            /*
+             * Add the first CIphone of l->wid to the rclist of state s, and
+             * the last CIphone to lclist of state d.
+             * (Filler phones are a pain to deal with.  There is no direct
+             * marking of a filler phone; but only filler words are supposed to
+             * use such phones, so we use that fact.  HACK!!  FRAGILE!!)
+             *
+             * UPD: tests carsh here if .fsg model used with wrong hmm and
+             *      dictionary
+             */
+            if (fsg_model_is_filler(fsg, fsg_link_wid(l))) {
+                /* Filler phone; use silence phone as context */
+                lextree->rc[fsg_link_from_state(l)][silcipid] = 1;
+                lextree->lc[fsg_link_to_state(l)][silcipid] = 1;
+            }
+            else {
+                len = dict_pronlen(lextree->dict, dictwid);
+                lextree->rc[fsg_link_from_state(l)][dict_pron(lextree->dict, dictwid, 0)] = 1;
+                lextree->lc[fsg_link_to_state(l)][dict_pron(lextree->dict, dictwid, len - 1)] = 1;
             }
         }
     }
@@ -165,24 +174,22 @@ fsg_lextree_lc_rc(fsg_lextree_t *lextree)
      * contexts and only then we can propagate them.
      */
     for (s = 0; s < fsg->n_state; s++) {
-        fsg_arciter_t *itor;
-        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor)) {
-            fsg_link_t *l = fsg_arciter_get(itor);
-            if (fsg_link_wid(l) < 0) {
-                /*
-                 * lclist(d) |= lclist(s), because all the words ending up at s, can
-                 * now also end at d, becoming the left context for words leaving d.
-                 */
-                for (i = 0; i < n_ci; i++)
-                    lextree->lc[fsg_link_to_state(l)][i] |= lextree->lc[fsg_link_from_state(l)][i];
-                /*
-                 * Similarly, rclist(s) |= rclist(d), because all the words leaving d
-                 * can equivalently leave s, becoming the right context for words
-                 * ending up at s.
-                 */
-                for (i = 0; i < n_ci; i++)
-                    lextree->rc[fsg_link_from_state(l)][i] |= lextree->rc[fsg_link_to_state(l)][i];
-            }
+        fsg_link_t *l, *end;
+        end = fsg_model_arcs_end(fsg, s);
+        for (l = fsg_model_null_arcs_begin(fsg, s); l < end; ++l) {
+            /*
+             * lclist(d) |= lclist(s), because all the words ending up at s, can
+             * now also end at d, becoming the left context for words leaving d.
+             */
+            for (i = 0; i < n_ci; i++)
+                lextree->lc[fsg_link_to_state(l)][i] |= lextree->lc[fsg_link_from_state(l)][i];
+            /*
+             * Similarly, rclist(s) |= rclist(d), because all the words leaving d
+             * can equivalently leave s, becoming the right context for words
+             * ending up at s.
+             */
+            for (i = 0; i < n_ci; i++)
+                lextree->rc[fsg_link_from_state(l)][i] |= lextree->rc[fsg_link_to_state(l)][i];
         }
     }
 
@@ -208,6 +215,170 @@ fsg_lextree_lc_rc(fsg_lextree_t *lextree)
     }
 }
 
+/*
+ * Signature of the subtree for state s: everything that
+ * fsg_psubtree_init() uses to build it.  This is the left context list
+ * of s, followed by the dictionary word ID, transition probability, and
+ * right context list of the destination for each word arc.  Lists are
+ * terminated by -1, and sig[0] is the length of the whole thing.
+ */
+static int32 *
+fsg_psubtree_sig(fsg_lextree_t *lextree, fsg_model_t *fsg, int32 s)
+{
+    fsg_link_t *l, *end;
+    int32 *sig;
+    int32 i, n;
+
+    end = fsg_model_null_arcs_begin(fsg, s);
+    n = 2;
+    for (i = 0; lextree->lc[s][i] >= 0; ++i)
+        ++n;
+    for (l = fsg_model_arcs_begin(fsg, s); l < end; ++l) {
+        n += 3;
+        for (i = 0; lextree->rc[fsg_link_to_state(l)][i] >= 0; ++i)
+            ++n;
+    }
+
+    sig = ckd_calloc(n, sizeof(*sig));
+    sig[0] = n;
+    n = 1;
+    for (i = 0; lextree->lc[s][i] >= 0; ++i)
+        sig[n++] = lextree->lc[s][i];
+    sig[n++] = -1;
+    for (l = fsg_model_arcs_begin(fsg, s); l < end; ++l) {
+        int16 *rc = lextree->rc[fsg_link_to_state(l)];
+        sig[n++] = dict_wordid(lextree->dict,
+                               fsg_model_word_str(fsg, fsg_link_wid(l)));
+        sig[n++] = fsg_link_logs2prob(l);
+        for (i = 0; rc[i] >= 0; ++i)
+            sig[n++] = rc[i];
+        sig[n++] = -1;
+    }
+    assert(n == sig[0]);
+
+    return sig;
+}
+
+/*
+ * Move the subtree for state s to the cache.
+ */
+static void
+fsg_lextree_retire(fsg_lextree_t *lextree, int32 s)
+{
+    fsg_psubtree_cache_t *ent, *head;
+    fsg_pnode_t *pn;
+    int32 n_leaf;
+
+    if (lextree->alloc_head[s] == NULL) {
+        ckd_free(lextree->sig[s]);
+        return;
+    }
+
+    ent = ckd_calloc(1, sizeof(*ent));
+    ent->sig = lextree->sig[s];
+    ent->root = lextree->root[s];
+    ent->alloc_head = lextree->alloc_head[s];
+    ent->n_update = lextree->n_update;
+    n_leaf = 0;
+    for (pn = ent->alloc_head; pn; pn = pn->alloc_next)
+        if (pn->leaf)
+            ++n_leaf;
+    ent->leaf_arc = ckd_calloc(n_leaf, sizeof(*ent->leaf_arc));
+    n_leaf = 0;
+    for (pn = ent->alloc_head; pn; pn = pn->alloc_next)
+        if (pn->leaf)
+            ent->leaf_arc[n_leaf++] = pn->next.fsglink - lextree->arcs[s];
+
+    head = hash_table_enter_bkey(lextree->cache, (char *)ent->sig,
+                                 ent->sig[0] * sizeof(*ent->sig), ent);
+    if (head != ent) {
+        ent->next = head->next;
+        head->next = ent;
+    }
+}
+
+/*
+ * Take a subtree for state s from the cache if there is one matching
+ * its signature.
+ */
+static int
+fsg_lextree_revive(fsg_lextree_t *lextree, int32 s)
+{
+    fsg_psubtree_cache_t *ent, *head;
+    fsg_pnode_t *pn;
+    int32 n_leaf;
+    void *val;
+
+    if (hash_table_lookup_bkey(lextree->cache, (char *)lextree->sig[s],
+                               lextree->sig[s][0] * sizeof(**lextree->sig),
+                               &val) < 0)
+        return FALSE;
+    head = val;
+    if (head->next) {
+        ent = head->next;
+        head->next = ent->next;
+    }
+    else {
+        ent = head;
+        hash_table_delete_bkey(lextree->cache, (char *)ent->sig,
+                               ent->sig[0] * sizeof(*ent->sig));
+    }
+
+    lextree->root[s] = ent->root;
+    lextree->alloc_head[s] = ent->alloc_head;
+    n_leaf = 0;
+    for (pn = ent->alloc_head; pn; pn = pn->alloc_next)
+        if (pn->leaf)
+            pn->next.fsglink = lextree->arcs[s] + ent->leaf_arc[n_leaf++];
+    ckd_free(ent->leaf_arc);
+    ckd_free(ent->sig);
+    ckd_free(ent);
+
+    return TRUE;
+}
+
+/*
+ * Free cached subtrees retired before the given update.
+ */
+static void
+fsg_lextree_flush_cache(fsg_lextree_t *lextree, int32 n_update)
+{
+    hash_iter_t *itor;
+    glist_t heads;
+    gnode_t *gn;
+
+    /* Collect them first, since we will modify the table. */
+    heads = NULL;
+    for (itor = hash_table_iter(lextree->cache); itor;
+         itor = hash_table_iter_next(itor))
+        heads = glist_add_ptr(heads, hash_entry_val(itor->ent));
+
+    for (gn = heads; gn; gn = gnode_next(gn)) {
+        fsg_psubtree_cache_t *ent, *next, *keep;
+
+        ent = gnode_ptr(gn);
+        hash_table_delete_bkey(lextree->cache, (char *)ent->sig,
+                               ent->sig[0] * sizeof(*ent->sig));
+        keep = NULL;
+        for (; ent; ent = next) {
+            next = ent->next;
+            if (ent->n_update >= n_update) {
+                ent->next = keep;
+                keep = ent;
+                continue;
+            }
+            fsg_psubtree_free(ent->alloc_head);
+            ckd_free(ent->leaf_arc);
+            ckd_free(ent->sig);
+            ckd_free(ent);
+        }
+        if (keep)
+            hash_table_enter_bkey(lextree->cache, (char *)keep->sig,
+                                  keep->sig[0] * sizeof(*keep->sig), keep);
+    }
+    glist_free(heads);
+}
+
 /*
  * For now, allocate the entire lextree statically.
  */
@@ -222,6 +393,7 @@ fsg_lextree_init(fsg_model_t * fsg, dict_t *dict, dict2pid_t *d2p,
 
     lextree = ckd_calloc(1, sizeof(fsg_lextree_t));
     lextree->fsg = fsg;
+    lextree->n_compile = fsg->n_compile;
     lextree->root = ckd_calloc(fsg_model_n_state(fsg),
                                sizeof(fsg_pnode_t *));
     lextree->alloc_head = ckd_calloc(fsg_model_n_state(fsg),
@@ -232,6 +404,10 @@ fsg_lextree_init(fsg_model_t * fsg, dict_t *dict, dict2pid_t *d2p,
     lextree->mdef = mdef;
     lextree->wip = wip;
     lextree->pip = pip;
+    lextree->n_state = fsg_model_n_state(fsg);
+    lextree->sig = ckd_calloc(fsg_model_n_state(fsg), sizeof(*lextree->sig));
+    lextree->arcs = ckd_calloc(fsg_model_n_state(fsg), sizeof(*lextree->arcs));
+    lextree->cache = hash_table_new(fsg_model_n_state(fsg), HASH_CASE_YES);
 
     /* Compute lc and rc for fsg. */
     fsg_lextree_lc_rc(lextree);
@@ -243,6 +419,8 @@ fsg_lextree_init(fsg_model_t * fsg, dict_t *dict, dict2pid_t *d2p,
     lextree->n_pnode = 0;
     n_leaves = 0;
     for (s = 0; s < fsg_model_n_state(fsg); s++) {
+        lextree->sig[s] = fsg_psubtree_sig(lextree, fsg, s);
+        lextree->arcs[s] = fsg_model_arcs_begin(fsg, s);
         lextree->root[s] =
             fsg_psubtree_init(lextree, fsg, s, &(lextree->alloc_head[s]));
 
@@ -282,6 +460,61 @@ fsg_lextree_dump(fsg_lextree_t * lextree, FILE * fp)
 }
 
 
+int32
+fsg_lextree_update(fsg_lextree_t * lextree, fsg_model_t * fsg)
+{
+    int32 s, n_built;
+    fsg_pnode_t *pn;
+
+    assert(fsg_model_is_compiled(fsg));
+
+    /* Move all the current subtrees to the cache. */
+    ++lextree->n_update;
+    for (s = 0; s < lextree->n_state; s++)
+        fsg_lextree_retire(lextree, s);
+    ckd_free(lextree->root);
+    ckd_free(lextree->alloc_head);
+    ckd_free(lextree->sig);
+    ckd_free(lextree->arcs);
+    ckd_free_2d(lextree->lc);
+    ckd_free_2d(lextree->rc);
+
+    lextree->fsg = fsg;
+    lextree->n_compile = fsg->n_compile;
+    lextree->n_state = fsg_model_n_state(fsg);
+    lextree->root = ckd_calloc(lextree->n_state, sizeof(*lextree->root));
+    lextree->alloc_head = ckd_calloc(lextree->n_state,
+                                     sizeof(*lextree->alloc_head));
+    lextree->sig = ckd_calloc(lextree->n_state, sizeof(*lextree->sig));
+    lextree->arcs = ckd_calloc(lextree->n_state, sizeof(*lextree->arcs));
+    fsg_lextree_lc_rc(lextree);
+
+    /* Take the ones that have not changed back, build the others. */
+    lextree->n_pnode = 0;
+    n_built = 0;
+    for (s = 0; s < lextree->n_state; s++) {
+        lextree->sig[s] = fsg_psubtree_sig(lextree, fsg, s);
+        lextree->arcs[s] = fsg_model_arcs_begin(fsg, s);
+        if (!fsg_lextree_revive(lextree, s)) {
+            lextree->root[s] =
+                fsg_psubtree_init(lextree, fsg, s, &(lextree->alloc_head[s]));
+            if (lextree->alloc_head[s])
+                ++n_built;
+        }
+        for (pn = lextree->alloc_head[s]; pn; pn = pn->alloc_next)
+            lextree->n_pnode++;
+    }
+
+    /* Only keep the leftovers from the previous FSG. */
+    fsg_lextree_flush_cache(lextree, lextree->n_update);
+
+    E_INFO("Rebuilt lextrees for %d of %d states, %d HMM nodes\n",
+           n_built, lextree->n_state, lextree->n_pnode);
+
+    return n_built;
+}
+
+
 void
 fsg_lextree_free(fsg_lextree_t * lextree)
 {
@@ -290,14 +523,21 @@ fsg_lextree_free(fsg_lextree_t * lextree)
     if (lextree == NULL)
         return;
 
-    if (lextree->fsg)
-        for (s = 0; s < fsg_model_n_state(lextree->fsg); s++)
-            fsg_psubtree_free(lextree->alloc_head[s]);
+    for (s = 0; s < lextree->n_state; s++) {
+        fsg_psubtree_free(lextree->alloc_head[s]);
+        ckd_free(lextree->sig[s]);
+    }
+    if (lextree->cache) {
+        fsg_lextree_flush_cache(lextree, lextree->n_update + 1);
+        hash_table_free(lextree->cache);
+    }
 
     ckd_free_2d(lextree->lc);
     ckd_free_2d(lextree->rc);
     ckd_free(lextree->root);
     ckd_free(lextree->alloc_head);
+    ckd_free(lextree->sig);
+    ckd_free(lextree->arcs);
     ckd_free(lextree);
 }
 
@@ -702,8 +942,7 @@ fsg_psubtree_init(fsg_lextree_t *lextree,
                   fsg_model_t * fsg, int32 from_state,
                   fsg_pnode_t ** alloc_head)
 {
-    fsg_arciter_t *itor;
-    fsg_link_t *fsglink;
+    fsg_link_t *fsglink, *end;
     fsg_pnode_t *root;
     int32 n_ci, n_arc;
     fsg_glist_linklist_t *glist = NULL;
@@ -719,15 +958,12 @@ fsg_psubtree_init(fsg_lextree_t *lextree,
     }
 
     n_arc = 0;
-    for (itor = fsg_model_arcs(fsg, from_state); itor; 
-         itor = fsg_arciter_next(itor)) {
+    end = fsg_model_null_arcs_begin(fsg, from_state);
+    for (fsglink = fsg_model_arcs_begin(fsg, from_state);
+         fsglink < end; ++fsglink) {
         int32 dst;
-        fsglink = fsg_arciter_get(itor);
         dst = fsglink->to_state;
 
-        if (fsg_link_wid(fsglink) < 0)
-            continue;
-
         E_DEBUG("Building lextree for arc from %d to %d: %s\n",
                 from_state, dst, fsg_model_word_str(fsg, fsg_link_wid(fsglink)));
         root = psubtree_add_trans(lextree, root, &glist, fsglink,
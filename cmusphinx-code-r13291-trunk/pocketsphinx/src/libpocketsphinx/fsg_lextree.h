@@ -42,6 +42,7 @@
 /* SphinxBase headers. */
 #include <sphinxbase/cmd_ln.h>
 #include <sphinxbase/fsg_model.h>
+#include <sphinxbase/hash_table.h>
 
 /* Local headers. */
 #include "hmm.h"
@@ -213,6 +214,22 @@ typedef struct fsg_lextree_s {
     int32 n_pnode;	/* #HMM nodes in search structure */
     int32 wip;
     int32 pip;
+
+    /*
+     * To update the lextree for a new FSG, the subtrees of states whose
+     * words and contexts have not changed are reused.  sig[s] is a
+     * signature of everything root[s] was built from (see
+     * fsg_psubtree_sig()), and arcs[s] the first arc out of s, which
+     * leaf nodes point into.  Subtrees not used by the current FSG are
+     * kept in cache, keyed by signature, until the next update, so that
+     * switching back and forth between grammars is also cheap.
+     */
+    int32 n_state;	/* Number of entries in root, alloc_head, sig, arcs */
+    int32 **sig;
+    fsg_link_t **arcs;
+    hash_table_t *cache;
+    int32 n_update;	/* Number of updates so far */
+    int32 n_compile;	/* Compilation of fsg that arcs[] point into */
 } fsg_lextree_t;
 
 /* Access macros */
@@ -227,6 +244,17 @@ fsg_lextree_t *fsg_lextree_init(fsg_model_t *fsg, dict_t *dict,
 				bin_mdef_t *mdef, hmm_context_t *ctx,
 				int32 wip, int32 pip);
 
+/**
+ * Update lextrees for a new or modified FSG.
+ *
+ * Only the subtrees of states whose outgoing words, probabilities or
+ * phonetic contexts have changed are rebuilt.  The FSG must be
+ * compiled, and the lextree must not be in use by an utterance.
+ *
+ * @return number of subtrees rebuilt.
+ */
+int32 fsg_lextree_update(fsg_lextree_t *lextree, fsg_model_t *fsg);
+
 /**
  * Free lextrees for an FSG.
  */
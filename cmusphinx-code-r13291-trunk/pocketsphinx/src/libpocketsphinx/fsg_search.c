@@ -174,6 +174,26 @@ fsg_search_add_altpron(fsg_search_t *fsgs, fsg_model_t *fsg)
     return n_alt;
 }
 
+/* Check the FSG and add fillers and alternates to it as configured. */
+static int
+fsg_search_prepare_fsg(fsg_search_t *fsgs, fsg_model_t *fsg)
+{
+    cmd_ln_t *config = ps_search_config(fsgs);
+
+    if (!fsg_search_check_dict(fsgs, fsg))
+        return -1;
+
+    if (cmd_ln_boolean_r(config, "-fsgusefiller") &&
+        !fsg_model_has_sil(fsg))
+        fsg_search_add_silences(fsgs, fsg);
+
+    if (cmd_ln_boolean_r(config, "-fsgusealtpron") &&
+        !fsg_model_has_alt(fsg))
+        fsg_search_add_altpron(fsgs, fsg);
+
+    return 0;
+}
+
 ps_search_t *
 fsg_search_init(const char *name,
 		fsg_model_t *fsg,
@@ -226,19 +246,11 @@ fsg_search_init(const char *name,
            fsgs->beam_orig, fsgs->pbeam_orig, fsgs->wbeam_orig,
            fsgs->wip, fsgs->pip);
 
-    if (!fsg_search_check_dict(fsgs, fsg)) {
+    if (fsg_search_prepare_fsg(fsgs, fsg) < 0) {
         fsg_search_free(ps_search_base(fsgs));
         return NULL;
     }
 
-    if (cmd_ln_boolean_r(config, "-fsgusefiller") &&
-        !fsg_model_has_sil(fsg))
-        fsg_search_add_silences(fsgs, fsg);
-
-    if (cmd_ln_boolean_r(config, "-fsgusealtpron") &&
-        !fsg_model_has_alt(fsg))
-        fsg_search_add_altpron(fsgs, fsg);
-
     if (fsg_search_reinit(ps_search_base(fsgs),
                           ps_search_dict(fsgs),
                           ps_search_dict2pid(fsgs)) < 0)
@@ -294,6 +306,10 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     /* Update the number of words (not used by this module though). */
     search->n_words = dict_size(dict);
 
+    /* Lay out the FSG's arcs for searching */
+    if (fsg_model_compile(fsgs->fsg) < 0)
+        return -1;
+
     /* Allocate new lextree for the given FSG */
     fsgs->lextree = fsg_lextree_init(fsgs->fsg, dict, d2p,
                                      ps_search_acmod(fsgs)->mdef,
@@ -305,6 +321,29 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     return 0;
 }
 
+int
+fsg_search_update(ps_search_t *search, fsg_model_t *fsg)
+{
+    fsg_search_t *fsgs = (fsg_search_t *)search;
+    fsg_model_t *old_fsg;
+
+    if (fsg_search_prepare_fsg(fsgs, fsg) < 0)
+        return -1;
+    if (fsg_model_compile(fsg) < 0)
+        return -1;
+
+    /* History entries point to the arcs of the old FSG. */
+    fsg_history_reset(fsgs->history);
+
+    old_fsg = fsgs->fsg;
+    fsgs->fsg = fsg_model_retain(fsg);
+    fsg_lextree_update(fsgs->lextree, fsgs->fsg);
+    fsg_history_set_fsg(fsgs->history, fsgs->fsg, ps_search_dict(fsgs));
+    fsg_model_free(old_fsg);
+
+    return 0;
+}
+
 
 static void
 fsg_search_sen_active(fsg_search_t *fsgs)
@@ -567,7 +606,7 @@ fsg_search_null_prop(fsg_search_t *fsgs)
     n_entries = fsg_history_n_entries(fsgs->history);
 
     for (bpidx = fsgs->bpidx_start; bpidx < n_entries; bpidx++) {
-        fsg_arciter_t *itor;
+        fsg_link_t *end;
         hist_entry = fsg_history_entry_get(fsgs->history, bpidx);
 
         l = fsg_hist_entry_fsglink(hist_entry);
@@ -580,11 +619,9 @@ fsg_search_null_prop(fsg_search_t *fsgs)
          * propagate one step, since FSG contains transitive closure of null
          * transitions.)
          */
-        /* Add all links from from_state to dst */
-        for (itor = fsg_model_arcs(fsg, s); itor;
-             itor = fsg_arciter_next(itor)) {
-            fsg_link_t *l = fsg_arciter_get(itor);
-
+        /* Add all null links from from_state to dst */
+        end = fsg_model_arcs_end(fsg, s);
+        for (l = fsg_model_null_arcs_begin(fsg, s); l < end; ++l) {
             /* FIXME: Need to deal with tag transitions somehow. */
             if (fsg_link_wid(l) != -1)
                 continue;
@@ -781,6 +818,16 @@ fsg_search_start(ps_search_t *search)
 
     silcipid = bin_mdef_ciphone_id(ps_search_acmod(fsgs)->mdef, "SIL");
 
+    /* The FSG may have been modified since it was searched last, in
+     * which case its arcs have moved out from under the lextree. */
+    if (fsg_model_compile(fsgs->fsg) < 0)
+        return -1;
+    if (fsgs->lextree->n_compile != fsgs->fsg->n_compile) {
+        fsg_history_reset(fsgs->history);
+        fsg_lextree_update(fsgs->lextree, fsgs->fsg);
+        fsg_history_set_fsg(fsgs->history, fsgs->fsg, ps_search_dict(fsgs));
+    }
+
     /* Initialize EVERYTHING to be inactive */
     assert(fsgs->pnode_active == NULL);
     assert(fsgs->pnode_active_next == NULL);
@@ -1440,7 +1487,8 @@ fsg_search_lattice(ps_search_t *search)
     n = fsg_history_n_entries(fsgs->history);
     for (i = 0; i < n; ++i) {
         fsg_hist_entry_t *fh = fsg_history_entry_get(fsgs->history, i);
-        fsg_arciter_t *itor;
+        fsg_link_t *link, *end;
+        int32 s;
         ps_latnode_t *src, *dest;
         int32 ascr;
         int sf;
@@ -1462,10 +1510,9 @@ fsg_search_lattice(ps_search_t *search)
         src = find_node(dag, fsg, sf, fh->fsglink->wid, fsg_link_to_state(fh->fsglink));
         sf = fh->frame + 1;
 
-        for (itor = fsg_model_arcs(fsg, fsg_link_to_state(fh->fsglink));
-             itor; itor = fsg_arciter_next(itor)) {
-            fsg_link_t *link = fsg_arciter_get(itor);
-            
+        s = fsg_link_to_state(fh->fsglink);
+        end = fsg_model_arcs_end(fsg, s);
+        for (link = fsg_model_arcs_begin(fsg, s); link < end; ++link) {
             /* FIXME: Need to figure out what to do about tag transitions. */
             if (link->wid >= 0) {
                 /*
@@ -1480,17 +1527,13 @@ fsg_search_lattice(ps_search_t *search)
                  * Transitive closure on nulls has already been done, so we
                  * just need to look one link forward from them.
                  */
-                fsg_arciter_t *itor2;
-                
+                fsg_link_t *link2, *end2;
+                int32 j = fsg_link_to_state(link);
+
                 /* Add all non-null links out of j. */
-                for (itor2 = fsg_model_arcs(fsg, fsg_link_to_state(link));
-                     itor2; itor2 = fsg_arciter_next(itor2)) {
-                    fsg_link_t *link = fsg_arciter_get(itor2);
-
-                    if (link->wid == -1)
-                        continue;
-                    
-                    if ((dest = find_node(dag, fsg, sf, link->wid, fsg_link_to_state(link))) != NULL) {
+                end2 = fsg_model_null_arcs_begin(fsg, j);
+                for (link2 = fsg_model_arcs_begin(fsg, j); link2 < end2; ++link2) {
+                    if ((dest = find_node(dag, fsg, sf, link2->wid, fsg_link_to_state(link2))) != NULL) {
                         ps_lattice_link(dag, src, dest, ascr, fh->frame);
                     }
                 }
@@ -129,6 +129,14 @@ void fsg_search_free(ps_search_t *search);
  */
 int fsg_search_reinit(ps_search_t *fsgs, dict_t *dict, dict2pid_t *d2p);
 
+/**
+ * Switch the FSG search module to a new FSG.
+ *
+ * Unlike creating a new search, this only rebuilds the parts of the
+ * lextree for states whose words or contexts have changed.
+ */
+int fsg_search_update(ps_search_t *search, fsg_model_t *fsg);
+
 /**
  * Prepare the FSG search structure for beginning decoding of the next
  * utterance.
@@ -52,6 +52,11 @@
 /* Local headers. */
 #include "hmm.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define HMM_HAVE_SSE2
+#endif
+
 hmm_context_t *
 hmm_context_init(int32 n_emit_state,
 		 uint8 ** const *tp,
@@ -806,6 +811,253 @@ hmm_vit_eval(hmm_t * hmm)
     }
 }
 
+hmm_pool_t *
+hmm_pool_init(void)
+{
+    return ckd_calloc(1, sizeof(hmm_pool_t));
+}
+
+void
+hmm_pool_free(hmm_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    ckd_free(pool->hmm);
+    ckd_free(pool->other);
+    ckd_free(pool->tprob);
+    ckd_free(pool);
+}
+
+void
+hmm_pool_add(hmm_pool_t *pool, hmm_t *hmm)
+{
+    if (!hmm_is_mpx(hmm) && hmm_n_emit_state(hmm) == 3) {
+        if (pool->n_hmm == pool->n_hmm_alloc) {
+            pool->n_hmm_alloc = pool->n_hmm_alloc ? pool->n_hmm_alloc * 2 : 256;
+            pool->hmm = ckd_realloc(pool->hmm,
+                                    pool->n_hmm_alloc * sizeof(*pool->hmm));
+        }
+        pool->hmm[pool->n_hmm++] = hmm;
+    }
+    else {
+        if (pool->n_other == pool->n_other_alloc) {
+            pool->n_other_alloc = pool->n_other_alloc ? pool->n_other_alloc * 2 : 256;
+            pool->other = ckd_realloc(pool->other,
+                                      pool->n_other_alloc * sizeof(*pool->other));
+        }
+        pool->other[pool->n_other++] = hmm;
+    }
+}
+
+#ifdef HMM_HAVE_SSE2
+/* Select a where mask is set, otherwise b. */
+#define SEL(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a),    \
+                                     _mm_andnot_si128(mask, b))
+/* Clamp to WORST_SCORE. */
+#define FLOOR(x) SEL(_mm_cmpgt_epi32(worst, x), worst, x)
+/* Keep the better of two scores. */
+#define BEST(x, y) SEL(_mm_cmpgt_epi32(x, y), x, y)
+/* Emission and transition scores, one from each HMM. */
+#define SENSCR(st) _mm_set_epi32(-h[3]->ctx->senscore[h[3]->senid[st]], \
+                                 -h[2]->ctx->senscore[h[2]->senid[st]], \
+                                 -h[1]->ctx->senscore[h[1]->senid[st]], \
+                                 -h[0]->ctx->senscore[h[0]->senid[st]])
+/* Transpose four vectors of four int32. */
+#define TRANSPOSE4(r0, r1, r2, r3) do {                 \
+        __m128i u0 = _mm_unpacklo_epi32(r0, r1);        \
+        __m128i u1 = _mm_unpacklo_epi32(r2, r3);        \
+        __m128i u2 = _mm_unpackhi_epi32(r0, r1);        \
+        __m128i u3 = _mm_unpackhi_epi32(r2, r3);        \
+        r0 = _mm_unpacklo_epi64(u0, u1);                \
+        r1 = _mm_unpackhi_epi64(u0, u1);                \
+        r2 = _mm_unpacklo_epi64(u2, u3);                \
+        r3 = _mm_unpackhi_epi64(u2, u3);                \
+    } while (0)
+
+/**
+ * Get the non-zero transition scores for a 3-state HMM, in the
+ * order 0-0, 0-1, 0-2, 1-1, 1-2, 1-3, 2-2, 2-3.
+ */
+static int32 const *
+hmm_pool_tprob(hmm_pool_t *pool, hmm_t const *hmm)
+{
+    int32 tmatid = hmm_tmatid(hmm);
+
+    /* Unpack each transition matrix the first time it is seen. */
+    if (pool->tp != hmm->ctx->tp) {
+        pool->tp = hmm->ctx->tp;
+        pool->n_tprob = 0;
+    }
+    if (tmatid >= pool->n_tprob) {
+        int32 i, n = tmatid + 1;
+        pool->tprob = ckd_realloc(pool->tprob, n * sizeof(*pool->tprob));
+        for (i = pool->n_tprob; i < n; ++i)
+            pool->tprob[i][0] = 1; /* Not unpacked yet. */
+        pool->n_tprob = n;
+    }
+    if (pool->tprob[tmatid][0] > 0) {
+        uint8 const *tp = hmm->ctx->tp[tmatid][0];
+        int32 *tprob = pool->tprob[tmatid];
+        tprob[0] = hmm_tprob_3st(0, 0);
+        tprob[1] = hmm_tprob_3st(0, 1);
+        tprob[2] = hmm_tprob_3st(0, 2);
+        tprob[3] = hmm_tprob_3st(1, 1);
+        tprob[4] = hmm_tprob_3st(1, 2);
+        tprob[5] = hmm_tprob_3st(1, 3);
+        tprob[6] = hmm_tprob_3st(2, 2);
+        tprob[7] = hmm_tprob_3st(2, 3);
+    }
+    return pool->tprob[tmatid];
+}
+
+/**
+ * Viterbi evaluation of four non-multiplex 3-state HMMs at once.
+ *
+ * The state scores and histories of the HMMs are transposed into one
+ * vector per state, and the branches in hmm_vit_eval_3st_lr() become
+ * comparison masks.  The results are exactly the same, including the
+ * way t2 carries over from the exit state to state 2.
+ */
+static int32
+hmm_vit_eval_3st_lr_x4(hmm_pool_t *pool, hmm_t **h)
+{
+    __m128i const worst = _mm_set1_epi32(WORST_SCORE);
+    __m128i const tmat_worst = _mm_set1_epi32(TMAT_WORST_SCORE);
+    __m128i s0, s1, s2, sx, h0, h1, h2, hx;
+    __m128i t0, t1, t2, c, live, best, out, out_h;
+    __m128i tp00, tp01, tp02, tp11, tp12, tp13, tp22, tp23;
+    int32 o_score[4], o_history[4], o_best[4];
+    int32 bestScore;
+    int i;
+
+    /* Gather transition scores. */
+#define TPROB(k, a, b) do {                                     \
+        int32 const *tprob = hmm_pool_tprob(pool, h[k]);        \
+        a = _mm_loadu_si128((__m128i *)tprob);                  \
+        b = _mm_loadu_si128((__m128i *)(tprob + 4));            \
+    } while (0)
+    TPROB(0, tp00, tp12);
+    TPROB(1, tp01, tp13);
+    TPROB(2, tp02, tp22);
+    TPROB(3, tp11, tp23);
+#undef TPROB
+    TRANSPOSE4(tp00, tp01, tp02, tp11);
+    TRANSPOSE4(tp12, tp13, tp22, tp23);
+
+    /* Gather state scores and histories. */
+    s0 = _mm_loadu_si128((__m128i *)h[0]->score);
+    s1 = _mm_loadu_si128((__m128i *)h[1]->score);
+    s2 = _mm_loadu_si128((__m128i *)h[2]->score);
+    sx = _mm_loadu_si128((__m128i *)h[3]->score);
+    TRANSPOSE4(s0, s1, s2, sx);
+    h0 = _mm_loadu_si128((__m128i *)h[0]->history);
+    h1 = _mm_loadu_si128((__m128i *)h[1]->history);
+    h2 = _mm_loadu_si128((__m128i *)h[2]->history);
+    hx = _mm_loadu_si128((__m128i *)h[3]->history);
+    TRANSPOSE4(h0, h1, h2, hx);
+    out = _mm_set_epi32(h[3]->out_score, h[2]->out_score,
+                        h[1]->out_score, h[0]->out_score);
+    out_h = _mm_set_epi32(h[3]->out_history, h[2]->out_history,
+                          h[1]->out_history, h[0]->out_history);
+
+    s0 = _mm_add_epi32(s0, SENSCR(0));
+    s1 = _mm_add_epi32(s1, SENSCR(1));
+    s2 = _mm_add_epi32(s2, SENSCR(2));
+
+    /* Transitions into non-emitting state 3, where s1 is live */
+    live = _mm_cmpgt_epi32(s1, worst);
+    t1 = _mm_add_epi32(s2, tp23);
+    t0 = tp13;
+    t2 = SEL(_mm_and_si128(live, _mm_cmpgt_epi32(t0, tmat_worst)),
+             _mm_add_epi32(s1, t0), _mm_set1_epi32(INT_MIN));
+    c = _mm_cmpgt_epi32(t1, t2);
+    t0 = FLOOR(SEL(c, t1, t2));
+    out = SEL(live, t0, out);
+    out_h = SEL(live, SEL(c, h2, h1), out_h);
+    best = SEL(live, t0, worst);
+
+    /* All transitions into state 2 */
+    t0 = _mm_add_epi32(s2, tp22);
+    t1 = _mm_add_epi32(s1, tp12);
+    c = tp02;
+    t2 = SEL(_mm_cmpgt_epi32(c, tmat_worst), _mm_add_epi32(s0, c), t2);
+    c = _mm_cmpgt_epi32(t0, t1);
+    t0 = SEL(c, t0, t1);
+    h2 = SEL(c, h2, h1);
+    c = _mm_cmpgt_epi32(t2, t0);
+    s2 = FLOOR(SEL(c, t2, t0));
+    h2 = SEL(c, h0, h2);
+    best = BEST(s2, best);
+
+    /* All transitions into state 1 */
+    t0 = _mm_add_epi32(s1, tp11);
+    t1 = _mm_add_epi32(s0, tp01);
+    c = _mm_cmpgt_epi32(t0, t1);
+    s1 = FLOOR(SEL(c, t0, t1));
+    h1 = SEL(c, h1, h0);
+    best = BEST(s1, best);
+
+    /* All transitions into state 0 */
+    s0 = FLOOR(_mm_add_epi32(s0, tp00));
+    best = BEST(s0, best);
+
+    /* Scatter them back. */
+    TRANSPOSE4(s0, s1, s2, sx);
+    _mm_storeu_si128((__m128i *)h[0]->score, s0);
+    _mm_storeu_si128((__m128i *)h[1]->score, s1);
+    _mm_storeu_si128((__m128i *)h[2]->score, s2);
+    _mm_storeu_si128((__m128i *)h[3]->score, sx);
+    TRANSPOSE4(h0, h1, h2, hx);
+    _mm_storeu_si128((__m128i *)h[0]->history, h0);
+    _mm_storeu_si128((__m128i *)h[1]->history, h1);
+    _mm_storeu_si128((__m128i *)h[2]->history, h2);
+    _mm_storeu_si128((__m128i *)h[3]->history, hx);
+    _mm_storeu_si128((__m128i *)o_score, out);
+    _mm_storeu_si128((__m128i *)o_history, out_h);
+    _mm_storeu_si128((__m128i *)o_best, best);
+    bestScore = WORST_SCORE;
+    for (i = 0; i < 4; ++i) {
+        hmm_out_score(h[i]) = o_score[i];
+        hmm_out_history(h[i]) = o_history[i];
+        hmm_bestscore(h[i]) = o_best[i];
+        if (o_best[i] BETTER_THAN bestScore)
+            bestScore = o_best[i];
+    }
+    return bestScore;
+}
+#undef SEL
+#undef FLOOR
+#undef BEST
+#undef SENSCR
+#undef TRANSPOSE4
+#endif /* HMM_HAVE_SSE2 */
+
+int32
+hmm_pool_eval(hmm_pool_t *pool)
+{
+    int32 best, bs;
+    int i;
+
+    best = WORST_SCORE;
+    i = 0;
+#ifdef HMM_HAVE_SSE2
+    for (; i + 4 <= pool->n_hmm; i += 4) {
+        if ((bs = hmm_vit_eval_3st_lr_x4(pool, pool->hmm + i)) BETTER_THAN best)
+            best = bs;
+    }
+#endif
+    for (; i < pool->n_hmm; ++i) {
+        if ((bs = hmm_vit_eval_3st_lr(pool->hmm[i])) BETTER_THAN best)
+            best = bs;
+    }
+    for (i = 0; i < pool->n_other; ++i) {
+        if ((bs = hmm_vit_eval(pool->other[i])) BETTER_THAN best)
+            best = bs;
+    }
+    hmm_pool_reset(pool);
+    return best;
+}
+
 int32
 hmm_dump_vit_eval(hmm_t * hmm, FILE * fp)
 {
@@ -283,6 +283,61 @@ void hmm_enter(hmm_t *h, int32 score,
 int32 hmm_vit_eval(hmm_t *hmm);
   
 
+/**
+ * @struct hmm_pool_t
+ * @brief A set of HMMs to be evaluated together.
+ *
+ * HMMs are added to the pool with hmm_pool_add() and then all
+ * evaluated by hmm_pool_eval().  They are grouped by topology, and
+ * those with a batched implementation (currently non-multiplex
+ * 3-state left-to-right HMMs) are evaluated several at a time, with
+ * their state scores and histories transposed into one SIMD vector
+ * per state.  The others are evaluated one at a time with
+ * hmm_vit_eval().
+ */
+typedef struct hmm_pool_s {
+    hmm_t **hmm;        /**< HMMs with a batched implementation. */
+    int32 n_hmm;        /**< Number of entries in hmm. */
+    int32 n_hmm_alloc;  /**< Number of entries allocated in hmm. */
+    hmm_t **other;      /**< HMMs which are evaluated one at a time. */
+    int32 n_other;      /**< Number of entries in other. */
+    int32 n_other_alloc;/**< Number of entries allocated in other. */
+    uint8 ** const *tp; /**< Transition matrices tprob was built from. */
+    int32 (*tprob)[8];  /**< Non-zero 3-state transition scores, by tmatid. */
+    int32 n_tprob;      /**< Number of entries in tprob. */
+} hmm_pool_t;
+
+/**
+ * Create an empty HMM pool.
+ */
+hmm_pool_t *hmm_pool_init(void);
+
+/**
+ * Free an HMM pool (but not the HMMs in it).
+ */
+void hmm_pool_free(hmm_pool_t *pool);
+
+/**
+ * Remove all HMMs from a pool.
+ */
+#define hmm_pool_reset(pool) ((pool)->n_hmm = (pool)->n_other = 0)
+
+/**
+ * Add an HMM to be evaluated.
+ */
+void hmm_pool_add(hmm_pool_t *pool, hmm_t *hmm);
+
+/**
+ * Viterbi evaluation of all HMMs in a pool.
+ *
+ * This gives exactly the same results as calling hmm_vit_eval() on
+ * each of them.  The pool is emptied afterwards.
+ *
+ * @return best score of all HMMs in the pool, or WORST_SCORE if it
+ *         is empty.
+ */
+int32 hmm_pool_eval(hmm_pool_t *pool);
+
 /**
  * Like hmm_vit_eval, but dump HMM state and relevant senscr to fp first, for debugging;.
  */
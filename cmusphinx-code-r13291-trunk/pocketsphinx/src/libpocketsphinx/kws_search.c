@@ -45,6 +45,7 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/pio.h>
 #include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/hash_table.h>
 
 #include "pocketsphinx_internal.h"
 #include "kws_search.h"
@@ -157,7 +158,6 @@ static void
 kws_search_sen_active(kws_search_t * kwss)
 {
     int i;
-    gnode_t *gn;
 
     acmod_clear_active(ps_search_acmod(kwss));
 
@@ -166,13 +166,9 @@ kws_search_sen_active(kws_search_t * kwss)
         acmod_activate_hmm(ps_search_acmod(kwss), &kwss->pl_hmms[i]);
 
     /* activate hmms in active nodes */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-            if (hmm_is_active(kws_nth_hmm(keyphrase, i)))
-                acmod_activate_hmm(ps_search_acmod(kwss), kws_nth_hmm(keyphrase, i));
-        }
-    }
+    for (i = 0; i < kwss->n_active; i++)
+        acmod_activate_hmm(ps_search_acmod(kwss),
+                           &kwss->nodes[kwss->active[i]].hmm);
 }
 
 /*
@@ -183,34 +179,25 @@ static void
 kws_search_hmm_eval(kws_search_t * kwss, int16 const *senscr)
 {
     int32 i;
-    gnode_t *gn;
     int32 bestscore = WORST_SCORE;
+    int32 score;
 
     hmm_context_set_senscore(kwss->hmmctx, senscr);
 
     /* evaluate hmms from phone loop */
     for (i = 0; i < kwss->n_pl; ++i) {
         hmm_t *hmm = &kwss->pl_hmms[i];
-        int32 score;
 
         score = hmm_vit_eval(hmm);
         if (score BETTER_THAN bestscore)
             bestscore = score;
     }
     /* evaluate hmms for active nodes */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-            hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-
-            if (hmm_is_active(hmm)) {
-                int32 score;
-                score = hmm_vit_eval(hmm);
-                if (score BETTER_THAN bestscore)
-                    bestscore = score;
-            }
-        }
-    }
+    for (i = 0; i < kwss->n_active; i++)
+        hmm_pool_add(kwss->hmm_pool, &kwss->nodes[kwss->active[i]].hmm);
+    score = hmm_pool_eval(kwss->hmm_pool);
+    if (score BETTER_THAN bestscore)
+        bestscore = score;
 
     kwss->bestscore = bestscore;
 }
@@ -222,21 +209,33 @@ kws_search_hmm_eval(kws_search_t * kwss, int16 const *senscr)
 static void
 kws_search_hmm_prune(kws_search_t * kwss)
 {
-    int32 thresh, i;
-    gnode_t *gn;
+    int32 thresh, i, n;
 
     thresh = kwss->bestscore + kwss->beam;
 
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-    	    hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-            if (hmm_is_active(hmm) && hmm_bestscore(hmm) < thresh)
-                hmm_clear(hmm);
-        }
+    for (i = n = 0; i < kwss->n_active; i++) {
+        hmm_t *hmm = &kwss->nodes[kwss->active[i]].hmm;
+        if (hmm_bestscore(hmm) < thresh)
+            hmm_clear(hmm);
+        else
+            kwss->active[n++] = kwss->active[i];
     }
+    kwss->n_active = n;
 }
 
+/**
+ * Enter a node, adding it to the active list if necessary.
+ */
+static void
+kws_search_enter(kws_search_t * kwss, int32 nidx,
+                 int32 score, int32 histid)
+{
+    hmm_t *hmm = &kwss->nodes[nidx].hmm;
+
+    if (!hmm_is_active(hmm))
+        kwss->active[kwss->n_active++] = nidx;
+    hmm_enter(hmm, score, histid, kwss->frame + 1);
+}
 
 /**
 * Do phone transitions
@@ -246,8 +245,7 @@ kws_search_trans(kws_search_t * kwss)
 {
     hmm_t *pl_best_hmm = NULL;
     int32 best_out_score = WORST_SCORE;
-    int i;
-    gnode_t *gn;
+    int i, n_active;
 
     /* select best hmm in phone-loop to be a predecessor */
     for (i = 0; i < kwss->n_pl; i++)
@@ -261,29 +259,27 @@ kws_search_trans(kws_search_t * kwss)
         return;
 
     /* Check whether keyphrase wasn't spotted yet */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        hmm_t *last_hmm;
-        
-        if (keyphrase->n_hmms < 1)
-    	    continue;
-        
-        last_hmm = kws_nth_hmm(keyphrase, keyphrase->n_hmms - 1);
-
-        if (hmm_is_active(last_hmm)
-            && hmm_out_score(pl_best_hmm) BETTER_THAN WORST_SCORE) {
-
-            if (hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) 
-                >= keyphrase->threshold) {
-
-                int32 prob = hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) - KWS_MAX;
-                kws_detections_add(kwss->detections, keyphrase->word,
-                                  hmm_out_history(last_hmm),
-                                  kwss->frame, prob,
-                                  hmm_out_score(last_hmm));
-            } /* keyphrase is spotted */
-        } /* last hmm of keyphrase is active */
-    } /* keyphrase loop */
+    if (hmm_out_score(pl_best_hmm) BETTER_THAN WORST_SCORE) {
+        for (i = 0; i < kwss->n_active; i++) {
+            kws_node_t *node = &kwss->nodes[kwss->active[i]];
+            hmm_t *last_hmm = &node->hmm;
+            gnode_t *gn;
+
+            for (gn = node->keyphrases; gn; gn = gnode_next(gn)) {
+                kws_keyphrase_t *keyphrase = gnode_ptr(gn);
+
+                if (hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) 
+                    >= keyphrase->threshold) {
+
+                    int32 prob = hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) - KWS_MAX;
+                    kws_detections_add(kwss->detections, keyphrase->word,
+                                      hmm_out_history(last_hmm),
+                                      kwss->frame, prob,
+                                      hmm_out_score(last_hmm));
+                } /* keyphrase is spotted */
+            } /* keyphrases ending in this node */
+        } /* active node loop */
+    }
 
     /* Make transition for all phone loop hmms */
     for (i = 0; i < kwss->n_pl; i++) {
@@ -295,36 +291,54 @@ kws_search_trans(kws_search_t * kwss)
         }
     }
 
-    /* Activate new keyphrase nodes, enter their hmms */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        
-        if (keyphrase->n_hmms < 1)
-    	    continue;
-        
-        for (i = keyphrase->n_hmms - 1; i > 0; i--) {
-            hmm_t *pred_hmm = kws_nth_hmm(keyphrase, i - 1);
-            hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-
-            if (hmm_is_active(pred_hmm)) {    
-                if (!hmm_is_active(hmm)
-                    || hmm_out_score(pred_hmm) BETTER_THAN
-                    hmm_in_score(hmm))
-                        hmm_enter(hmm, hmm_out_score(pred_hmm),
-                                  hmm_out_history(pred_hmm), kwss->frame + 1);
-            }
+    /* Activate successors of active nodes, enter their hmms (only
+     * those which were active before, not the ones entered here) */
+    n_active = kwss->n_active;
+    for (i = 0; i < n_active; i++) {
+        hmm_t *pred_hmm = &kwss->nodes[kwss->active[i]].hmm;
+        int32 c;
+
+        for (c = kwss->nodes[kwss->active[i]].first_child;
+             c != -1; c = kwss->nodes[c].next_sibling) {
+            hmm_t *hmm = &kwss->nodes[c].hmm;
+
+            if (!hmm_is_active(hmm)
+                || hmm_out_score(pred_hmm) BETTER_THAN hmm_in_score(hmm))
+                kws_search_enter(kwss, c, hmm_out_score(pred_hmm),
+                                 hmm_out_history(pred_hmm));
         }
+    }
 
-        /* Enter keyphrase start node from phone loop */
+    /* Enter keyphrase start nodes from phone loop */
+    for (i = kwss->first_root; i != -1; i = kwss->nodes[i].next_sibling) {
         if (hmm_out_score(pl_best_hmm) BETTER_THAN
-            hmm_in_score(kws_nth_hmm(keyphrase, 0)))
-                hmm_enter(kws_nth_hmm(keyphrase, 0), hmm_out_score(pl_best_hmm),
-                    kwss->frame, kwss->frame + 1);
+            hmm_in_score(&kwss->nodes[i].hmm))
+            kws_search_enter(kwss, i, hmm_out_score(pl_best_hmm),
+                             kwss->frame);
     }
 }
 
+static kws_keyphrase_t *
+kws_keyphrase_new(const char *word, int32 threshold)
+{
+    kws_keyphrase_t *keyphrase = ckd_calloc(1, sizeof(*keyphrase));
+
+    keyphrase->word = ckd_salloc(word);
+    keyphrase->threshold = threshold;
+    keyphrase->node = -1;
+    return keyphrase;
+}
+
+static void
+kws_keyphrase_free(kws_keyphrase_t *keyphrase)
+{
+    ckd_free(keyphrase->word);
+    ckd_free(keyphrase);
+}
+
 static int
-kws_search_read_list(kws_search_t *kwss, const char* keyfile)
+kws_search_read_list(kws_search_t *kwss, const char* keyfile,
+                     glist_t *out_keyphrases)
 {
     FILE *list_file;
     lineiter_t *li;
@@ -335,18 +349,16 @@ kws_search_read_list(kws_search_t *kwss, const char* keyfile)
         return -1;
     }
 
-    kwss->keyphrases = NULL;
+    *out_keyphrases = NULL;
 
     /* read keyphrases */
     for (li = lineiter_start_clean(list_file); li; li = lineiter_next(li)) {
         size_t begin, end;
-        kws_keyphrase_t *keyphrase;
+        int32 threshold;
 	
 	if (li->len == 0)
 	    continue;
 
-	keyphrase = ckd_calloc(1, sizeof(kws_keyphrase_t));
-
         line = li->buf;
         end = strlen(line) - 1;
 	begin = end - 1;
@@ -355,33 +367,231 @@ kws_search_read_list(kws_search_t *kwss, const char* keyfile)
                 begin--;
             line[end] = 0;
             line[begin] = 0;
-            keyphrase->threshold = (int32) logmath_log(kwss->base.acmod->lmath, atof_c(line + begin + 1)) 
+            threshold = (int32) logmath_log(kwss->base.acmod->lmath, atof_c(line + begin + 1)) 
                                           >> SENSCR_SHIFT;
         } else {
-            keyphrase->threshold = kwss->def_threshold;
+            threshold = kwss->def_threshold;
         }
 
-        keyphrase->word = ckd_salloc(line);
-
-        kwss->keyphrases = glist_add_ptr(kwss->keyphrases, keyphrase);
+        *out_keyphrases = glist_add_ptr(*out_keyphrases,
+                                        kws_keyphrase_new(line, threshold));
     }
 
     fclose(list_file);
     return 0;
 }
 
-ps_search_t *
-kws_search_init(const char *name,
-                const char *keyphrase,
-                const char *keyfile,
-                cmd_ln_t * config,
-                acmod_t * acmod, dict_t * dict, dict2pid_t * d2p)
+/**
+ * Get a node for a phone, reusing a free one if possible, and link
+ * it in after its parent.
+ */
+static int32
+kws_search_node_alloc(kws_search_t *kwss, int32 parent,
+                      int32 ssid, int32 tmatid)
+{
+    kws_node_t *node;
+    int32 nidx;
+
+    if (kwss->free_node != -1) {
+        nidx = kwss->free_node;
+        kwss->free_node = kwss->nodes[nidx].next_sibling;
+    }
+    else {
+        if (kwss->n_nodes == kwss->n_nodes_alloc) {
+            kwss->n_nodes_alloc = kwss->n_nodes_alloc
+                ? kwss->n_nodes_alloc * 2 : 256;
+            kwss->nodes = ckd_realloc(kwss->nodes, kwss->n_nodes_alloc
+                                      * sizeof(*kwss->nodes));
+            kwss->active = ckd_realloc(kwss->active, kwss->n_nodes_alloc
+                                       * sizeof(*kwss->active));
+        }
+        nidx = kwss->n_nodes++;
+    }
+
+    node = &kwss->nodes[nidx];
+    hmm_init(kwss->hmmctx, &node->hmm, FALSE, ssid, tmatid);
+    node->parent = parent;
+    node->first_child = -1;
+    node->n_ref = 0;
+    node->keyphrases = NULL;
+    if (parent == -1) {
+        node->next_sibling = kwss->first_root;
+        kwss->first_root = nidx;
+    }
+    else {
+        node->next_sibling = kwss->nodes[parent].first_child;
+        kwss->nodes[parent].first_child = nidx;
+    }
+
+    return nidx;
+}
+
+/**
+ * Unlink a node from its parent and put it on the free list.
+ */
+static void
+kws_search_node_free(kws_search_t *kwss, int32 nidx)
+{
+    kws_node_t *node = &kwss->nodes[nidx];
+    int32 *prev;
+
+    if (node->parent == -1)
+        prev = &kwss->first_root;
+    else
+        prev = &kwss->nodes[node->parent].first_child;
+    while (*prev != nidx)
+        prev = &kwss->nodes[*prev].next_sibling;
+    *prev = node->next_sibling;
+
+    hmm_deinit(&node->hmm);
+    node->next_sibling = kwss->free_node;
+    kwss->free_node = nidx;
+}
+
+/**
+ * Add the phones of a keyphrase to the tree.
+ */
+static void
+kws_search_add_keyphrase(kws_search_t *kwss, kws_keyphrase_t *keyphrase)
+{
+    dict_t *dict = ps_search_dict(kwss);
+    dict2pid_t *d2p = ps_search_dict2pid(kwss);
+    bin_mdef_t *mdef = ps_search_acmod(kwss)->mdef;
+    int32 silcipid = bin_mdef_silphone(mdef);
+    char **wrdptr;
+    char *tmp_keyphrase;
+    int32 wid, pronlen;
+    int32 n_wrds, nidx;
+    int32 ssid, tmatid;
+    int i, p;
+
+    keyphrase->node = -1;
+
+    tmp_keyphrase = (char *) ckd_salloc(keyphrase->word);
+    n_wrds = str2words(tmp_keyphrase, NULL, 0);
+    wrdptr = (char **) ckd_calloc(n_wrds, sizeof(*wrdptr));
+    str2words(tmp_keyphrase, wrdptr, n_wrds);
+
+    for (i = 0; i < n_wrds; i++) {
+        if (dict_wordid(dict, wrdptr[i]) == BAD_S3WID) {
+            E_ERROR("Word '%s' in phrase '%s' is missing in the dictionary\n", wrdptr[i], keyphrase->word);
+            ckd_free(wrdptr);
+            ckd_free(tmp_keyphrase);
+            return;
+        }
+    }
+
+    /* Follow the phones down the tree, adding nodes where needed */
+    nidx = -1;
+    for (i = 0; i < n_wrds; i++) {
+        wid = dict_wordid(dict, wrdptr[i]);
+        pronlen = dict_pronlen(dict, wid);
+        for (p = 0; p < pronlen; p++) {
+            int32 ci = dict_pron(dict, wid, p);
+            int32 c;
+
+            if (p == 0) {
+                /* first phone of word */
+                int32 rc =
+                    pronlen > 1 ? dict_pron(dict, wid, 1) : silcipid;
+                ssid = dict2pid_ldiph_lc(d2p, ci, rc, silcipid);
+            }
+            else if (p == pronlen - 1) {
+                /* last phone of the word */
+                int32 lc = dict_pron(dict, wid, p - 1);
+                xwdssid_t *rssid = dict2pid_rssid(d2p, ci, lc);
+                int j = rssid->cimap[silcipid];
+                ssid = rssid->ssid[j];
+            }
+            else {
+                /* word internal phone */
+                ssid = dict2pid_internal(d2p, wid, p);
+            }
+            tmatid = bin_mdef_pid2tmatid(mdef, ci);
+
+            c = (nidx == -1) ? kwss->first_root : kwss->nodes[nidx].first_child;
+            for (; c != -1; c = kwss->nodes[c].next_sibling) {
+                hmm_t *hmm = &kwss->nodes[c].hmm;
+                if (hmm_nonmpx_ssid(hmm) == ssid && hmm_tmatid(hmm) == tmatid)
+                    break;
+            }
+            if (c == -1)
+                c = kws_search_node_alloc(kwss, nidx, ssid, tmatid);
+            ++kwss->nodes[c].n_ref;
+            nidx = c;
+        }
+    }
+
+    if (nidx != -1) {
+        kwss->nodes[nidx].keyphrases =
+            glist_add_ptr(kwss->nodes[nidx].keyphrases, keyphrase);
+        keyphrase->node = nidx;
+    }
+
+    ckd_free(wrdptr);
+    ckd_free(tmp_keyphrase);
+}
+
+/**
+ * Remove a keyphrase from the tree, freeing nodes no longer used.
+ */
+static void
+kws_search_remove_keyphrase(kws_search_t *kwss, kws_keyphrase_t *keyphrase)
+{
+    gnode_t *gn, *prev;
+    int32 nidx;
+
+    if ((nidx = keyphrase->node) == -1)
+        return;
+    keyphrase->node = -1;
+
+    prev = NULL;
+    for (gn = kwss->nodes[nidx].keyphrases; gn; gn = gnode_next(gn)) {
+        if (gnode_ptr(gn) == keyphrase)
+            break;
+        prev = gn;
+    }
+    assert(gn != NULL);
+    if (prev)
+        gnode_free(gn, prev);
+    else
+        kwss->nodes[nidx].keyphrases = gnode_free(gn, NULL);
+
+    while (nidx != -1) {
+        int32 parent = kwss->nodes[nidx].parent;
+        if (--kwss->nodes[nidx].n_ref == 0)
+            kws_search_node_free(kwss, nidx);
+        nidx = parent;
+    }
+}
+
+/**
+ * Deactivate all nodes and forget all detections.
+ */
+static void
+kws_search_reset(kws_search_t *kwss)
+{
+    int i;
+
+    for (i = 0; i < kwss->n_active; i++)
+        hmm_clear(&kwss->nodes[kwss->active[i]].hmm);
+    kwss->n_active = 0;
+    kws_detections_reset(kwss->detections);
+}
+
+static kws_search_t *
+kws_search_alloc(const char *name,
+                 cmd_ln_t * config,
+                 acmod_t * acmod, dict_t * dict, dict2pid_t * d2p)
 {
     kws_search_t *kwss = (kws_search_t *) ckd_calloc(1, sizeof(*kwss));
     ps_search_init(ps_search_base(kwss), &kws_funcs, PS_SEARCH_TYPE_KWS, name, config, acmod, dict,
                    d2p);
 
     kwss->detections = (kws_detections_t *)ckd_calloc(1, sizeof(*kwss->detections));
+    kwss->first_root = -1;
+    kwss->free_node = -1;
+    kwss->hmm_pool = hmm_pool_init();
 
     kwss->beam =
         (int32) logmath_log(acmod->lmath,
@@ -405,19 +615,12 @@ kws_search_init(const char *name,
     E_INFO("KWS(beam: %d, plp: %d, default threshold %d, delay %d)\n",
            kwss->beam, kwss->plp, kwss->def_threshold, kwss->delay);
 
-    if (keyfile) {
-	if (kws_search_read_list(kwss, keyfile) < 0) {
-	    E_ERROR("Failed to create kws search\n");
-	    kws_search_free(ps_search_base(kwss));
-	    return NULL;
-	}
-    } else {
-        kws_keyphrase_t *k = ckd_calloc(1, sizeof(kws_keyphrase_t));
-        k->threshold = kwss->def_threshold;
-        k->word = ckd_salloc(keyphrase);
-        kwss->keyphrases = glist_add_ptr(NULL, k);
-    }
+    return kwss;
+}
 
+static ps_search_t *
+kws_search_setup(kws_search_t *kwss)
+{
     /* Reinit for provided keyphrase */
     if (kws_search_reinit(ps_search_base(kwss),
                           ps_search_dict(kwss),
@@ -431,12 +634,57 @@ kws_search_init(const char *name,
     return ps_search_base(kwss);
 }
 
+ps_search_t *
+kws_search_init(const char *name,
+                const char *keyphrase,
+                const char *keyfile,
+                cmd_ln_t * config,
+                acmod_t * acmod, dict_t * dict, dict2pid_t * d2p)
+{
+    kws_search_t *kwss = kws_search_alloc(name, config, acmod, dict, d2p);
+
+    if (keyfile) {
+	if (kws_search_read_list(kwss, keyfile, &kwss->keyphrases) < 0) {
+	    E_ERROR("Failed to create kws search\n");
+	    kws_search_free(ps_search_base(kwss));
+	    return NULL;
+	}
+    } else {
+        kwss->keyphrases = glist_add_ptr(NULL,
+                                         kws_keyphrase_new(keyphrase,
+                                                           kwss->def_threshold));
+    }
+
+    return kws_search_setup(kwss);
+}
+
+ps_search_t *
+kws_search_copy(const char *name,
+                ps_search_t * other,
+                cmd_ln_t * config,
+                acmod_t * acmod, dict_t * dict, dict2pid_t * d2p)
+{
+    kws_search_t *kwss = kws_search_alloc(name, config, acmod, dict, d2p);
+    gnode_t *gn;
+
+    for (gn = ((kws_search_t *) other)->keyphrases; gn; gn = gnode_next(gn)) {
+        kws_keyphrase_t *ok = gnode_ptr(gn);
+        kwss->keyphrases = glist_add_ptr(kwss->keyphrases,
+                                         kws_keyphrase_new(ok->word,
+                                                           ok->threshold));
+    }
+    kwss->keyphrases = glist_reverse(kwss->keyphrases);
+
+    return kws_search_setup(kwss);
+}
+
 void
 kws_search_free(ps_search_t * search)
 {
     kws_search_t *kwss;
     double n_speech;
     gnode_t *gn;
+    int i;
 
     kwss = (kws_search_t *) search;
 
@@ -457,12 +705,13 @@ kws_search_free(ps_search_t * search)
     ckd_free(kwss->detections);
 
     ckd_free(kwss->pl_hmms);
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-	kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        ckd_free(keyphrase->hmms);
-        ckd_free(keyphrase->word);
-        ckd_free(keyphrase);
-    }
+    for (i = 0; i < kwss->n_nodes; i++)
+        glist_free(kwss->nodes[i].keyphrases);
+    ckd_free(kwss->nodes);
+    ckd_free(kwss->active);
+    hmm_pool_free(kwss->hmm_pool);
+    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn))
+        kws_keyphrase_free(gnode_ptr(gn));
     glist_free(kwss->keyphrases);
     ckd_free(kwss);
 }
@@ -470,16 +719,9 @@ kws_search_free(ps_search_t * search)
 int
 kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
 {
-    char **wrdptr;
-    char *tmp_keyphrase;
-    int32 wid, pronlen, in_dict;
-    int32 n_hmms, n_wrds;
-    int32 ssid, tmatid;
-    int i, j, p;
     kws_search_t *kwss = (kws_search_t *) search;
-    bin_mdef_t *mdef = search->acmod->mdef;
-    int32 silcipid = bin_mdef_silphone(mdef);
     gnode_t *gn;
+    int i;
 
     /* Free old dict2pid, dict */
     ps_search_base_reinit(search, dict, d2p);
@@ -510,78 +752,94 @@ kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
                  bin_mdef_pid2tmatid(search->acmod->mdef, i));
     }
 
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-
-        /* Initialize keyphrase HMMs */
-        tmp_keyphrase = (char *) ckd_salloc(keyphrase->word);
-        n_wrds = str2words(tmp_keyphrase, NULL, 0);
-        wrdptr = (char **) ckd_calloc(n_wrds, sizeof(*wrdptr));
-        str2words(tmp_keyphrase, wrdptr, n_wrds);
-
-        /* count amount of hmms */
-        n_hmms = 0;
-        in_dict = TRUE;
-        for (i = 0; i < n_wrds; i++) {
-            wid = dict_wordid(dict, wrdptr[i]);
-            if (wid == BAD_S3WID) {
-        	E_ERROR("Word '%s' in phrase '%s' is missing in the dictionary\n", wrdptr[i], keyphrase->word);
-        	in_dict = FALSE;
-        	break;
-            }
-            pronlen = dict_pronlen(dict, wid);
-            n_hmms += pronlen;
-        }
-        
-        if (!in_dict) {
-            ckd_free(wrdptr);
-            ckd_free(tmp_keyphrase);
-    	    continue;
-        }
+    /* Rebuild the keyphrase tree from scratch. */
+    kws_detections_reset(kwss->detections);
+    for (i = 0; i < kwss->n_nodes; i++)
+        glist_free(kwss->nodes[i].keyphrases);
+    kwss->n_nodes = 0;
+    kwss->n_active = 0;
+    kwss->first_root = -1;
+    kwss->free_node = -1;
+    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn))
+        kws_search_add_keyphrase(kwss, gnode_ptr(gn));
+    E_INFO("%d keyphrases in %d tree nodes\n",
+           glist_count(kwss->keyphrases), kwss->n_nodes);
 
-        /* allocate node array */
-        if (keyphrase->hmms)
-            ckd_free(keyphrase->hmms);
-        keyphrase->hmms = (hmm_t *) ckd_calloc(n_hmms, sizeof(hmm_t));
-        keyphrase->n_hmms = n_hmms;
-
-        /* fill node array */
-        j = 0;
-        for (i = 0; i < n_wrds; i++) {
-            wid = dict_wordid(dict, wrdptr[i]);
-            pronlen = dict_pronlen(dict, wid);
-            for (p = 0; p < pronlen; p++) {
-                int32 ci = dict_pron(dict, wid, p);
-                if (p == 0) {
-                    /* first phone of word */
-                    int32 rc =
-                        pronlen > 1 ? dict_pron(dict, wid, 1) : silcipid;
-                    ssid = dict2pid_ldiph_lc(d2p, ci, rc, silcipid);
-                }
-                else if (p == pronlen - 1) {
-                    /* last phone of the word */
-                    int32 lc = dict_pron(dict, wid, p - 1);
-                    xwdssid_t *rssid = dict2pid_rssid(d2p, ci, lc);
-                    int j = rssid->cimap[silcipid];
-                    ssid = rssid->ssid[j];
-                }
-                else {
-                    /* word internal phone */
-                    ssid = dict2pid_internal(d2p, wid, p);
-                }
-                tmatid = bin_mdef_pid2tmatid(mdef, ci);
-                hmm_init(kwss->hmmctx, &keyphrase->hmms[j], FALSE, ssid,
-                         tmatid);
-                j++;
-            }
-        }
+    return 0;
+}
+
+int
+kws_search_update(ps_search_t * search,
+                  const char *keyphrase, const char *keyfile)
+{
+    kws_search_t *kwss = (kws_search_t *) search;
+    kws_keyphrase_t **old;
+    hash_table_t *old_idx;
+    glist_t keyphrases, new_keyphrases;
+    gnode_t *gn;
+    int32 n_old, n_added, n_removed;
+    int i;
 
-        ckd_free(wrdptr);
-        ckd_free(tmp_keyphrase);
+    if (keyfile) {
+        if (kws_search_read_list(kwss, keyfile, &keyphrases) < 0)
+            return -1;
+    }
+    else {
+        keyphrases = glist_add_ptr(NULL,
+                                   kws_keyphrase_new(keyphrase,
+                                                     kwss->def_threshold));
     }
 
-    
+    /* Detections point to the old keyphrases. */
+    kws_search_reset(kwss);
+
+    /* Index the current keyphrases by text. */
+    n_old = glist_count(kwss->keyphrases);
+    old = ckd_calloc(n_old + 1, sizeof(*old));
+    old_idx = hash_table_new(n_old + 1, HASH_CASE_YES);
+    for (i = 0, gn = kwss->keyphrases; gn; gn = gnode_next(gn), ++i) {
+        old[i] = gnode_ptr(gn);
+        (void) hash_table_enter_int32(old_idx, old[i]->word, i);
+    }
 
+    /* Keep the ones which are still wanted, add the others. */
+    n_added = 0;
+    new_keyphrases = NULL;
+    for (gn = keyphrases; gn; gn = gnode_next(gn)) {
+        kws_keyphrase_t *k = gnode_ptr(gn);
+        int32 idx;
+
+        if (hash_table_lookup_int32(old_idx, k->word, &idx) == 0) {
+            hash_table_delete(old_idx, k->word);
+            old[idx]->threshold = k->threshold;
+            kws_keyphrase_free(k);
+            k = old[idx];
+            old[idx] = NULL;
+        }
+        else {
+            kws_search_add_keyphrase(kwss, k);
+            ++n_added;
+        }
+        new_keyphrases = glist_add_ptr(new_keyphrases, k);
+    }
+    glist_free(keyphrases);
+    hash_table_free(old_idx);
+
+    /* Remove the others, only now so that shared nodes survive. */
+    n_removed = 0;
+    for (i = 0; i < n_old; ++i) {
+        if (old[i] == NULL)
+            continue;
+        kws_search_remove_keyphrase(kwss, old[i]);
+        kws_keyphrase_free(old[i]);
+        ++n_removed;
+    }
+    ckd_free(old);
+    glist_free(kwss->keyphrases);
+    kwss->keyphrases = glist_reverse(new_keyphrases);
+
+    E_INFO("Updated keyphrases: %d added, %d removed\n",
+           n_added, n_removed);
     return 0;
 }
 
@@ -593,7 +851,7 @@ kws_search_start(ps_search_t * search)
 
     kwss->frame = 0;
     kwss->bestscore = 0;
-    kws_detections_reset(kwss->detections);
+    kws_search_reset(kwss);
 
     /* Reset and enter all phone-loop HMMs. */
     for (i = 0; i < kwss->n_pl; ++i) {
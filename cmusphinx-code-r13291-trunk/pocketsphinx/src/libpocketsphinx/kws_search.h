@@ -60,10 +60,27 @@ typedef struct kws_seg_s {
 typedef struct kws_keyphrase_s {
     char* word;
     int32 threshold;
-    hmm_t* hmms;
-    int32 n_hmms;
+    int32 node;          /**< Last node of the keyphrase in the tree, or -1
+                            if it could not be added. */
 } kws_keyphrase_t;
 
+/**
+ * Node in the keyphrase tree.
+ *
+ * Keyphrases are compiled into a tree of phone HMMs, so that
+ * keyphrases which start with the same phones share the HMMs for
+ * them, and are only scored once.
+ */
+typedef struct kws_node_s {
+    hmm_t hmm;           /**< HMM for this phone. */
+    int32 parent;        /**< Previous phone, or -1 for the first one. */
+    int32 first_child;   /**< First of the following phones, or -1. */
+    int32 next_sibling;  /**< Next phone with the same parent (or next
+                            free node), or -1. */
+    int32 n_ref;         /**< Number of keyphrases going through this node. */
+    glist_t keyphrases;  /**< Keyphrases ending at this node. */
+} kws_node_t;
+
 /**
  * Implementation of KWS search structure.
  */
@@ -74,6 +91,15 @@ typedef struct kws_search_s {
 
     glist_t keyphrases;          /**< Keyphrases to spot */
 
+    kws_node_t *nodes;           /**< Keyphrase tree nodes. */
+    int32 n_nodes;               /**< Number of nodes used (including free ones). */
+    int32 n_nodes_alloc;         /**< Number of nodes allocated. */
+    int32 first_root;            /**< First node of the first level, or -1. */
+    int32 free_node;             /**< First free node, or -1. */
+    int32 *active;               /**< Active nodes. */
+    int32 n_active;              /**< Number of active nodes. */
+    hmm_pool_t *hmm_pool;        /**< For evaluating active nodes. */
+
     kws_detections_t *detections; /**< Keyword spotting history */
     frame_idx_t frame;            /**< Frame index */
 
@@ -103,11 +129,37 @@ ps_search_t *kws_search_init(const char *name,
                              acmod_t * acmod,
                              dict_t * dict, dict2pid_t * d2p);
 
+/**
+ * Create a search module with the same keyphrases and thresholds as
+ * an existing one.
+ */
+ps_search_t *kws_search_copy(const char *name,
+                             ps_search_t * other,
+                             cmd_ln_t * config,
+                             acmod_t * acmod,
+                             dict_t * dict, dict2pid_t * d2p);
+
 /**
  * Deallocate search structure.
  */
 void kws_search_free(ps_search_t * search);
 
+/**
+ * Replace the keyphrases in a KWS search module.
+ *
+ * Keyphrases which are already present keep their place in the tree,
+ * and only the nodes for new keyphrases are added (and those for
+ * removed ones freed), so this is much faster than creating a new
+ * search for a large list which changes a little.  Any detections
+ * and partial matches are discarded.
+ *
+ * @param keyphrase single keyphrase to spot, or NULL to use keyfile.
+ * @param keyfile file with a list of keyphrases and thresholds.
+ * @return 0 for success, <0 on error (the search is not modified).
+ */
+int kws_search_update(ps_search_t * search,
+                      const char *keyphrase, const char *keyfile);
+
 /**
  * Update KWS search module for new key phrase.
  */
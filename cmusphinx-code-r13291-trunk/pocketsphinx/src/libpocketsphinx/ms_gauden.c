@@ -54,6 +54,15 @@
 
 #define WORST_DIST	(int32)(0x80000000)
 
+/* Threshold which disables early exit in the distance kernels. */
+#ifdef FIXED_POINT
+#define NO_PRUNE_DIST	WORST_DIST
+#else
+#define NO_PRUNE_DIST	(-FLT_MAX)
+#endif
+
+static void gauden_blk_free(gauden_t *g);
+
 void
 gauden_dump(const gauden_t * g)
 {
@@ -253,6 +262,33 @@ gauden_param_free(mfcc_t **** p)
     ckd_free_3d(p);
 }
 
+/* Free the parameters, which may be in a binary acoustic model. */
+static void
+gauden_params_free(gauden_t *g)
+{
+    if (g->am) {
+        /* Only the pointers are ours. */
+        ckd_free_3d(g->mean);
+        ckd_free_3d(g->var);
+        ckd_free_2d(g->det);
+        bin_am_free(g->am);
+        g->am = NULL;
+    }
+    else {
+        if (g->mean)
+            gauden_param_free(g->mean);
+        if (g->var)
+            gauden_param_free(g->var);
+        if (g->det)
+            ckd_free_3d(g->det);
+    }
+    if (g->featlen)
+        ckd_free(g->featlen);
+    g->mean = g->var = NULL;
+    g->det = NULL;
+    g->featlen = NULL;
+}
+
 /*
  * Some of the gaussian density computation can be carried out in advance:
  * 	log(determinant) calculation,
@@ -354,60 +390,343 @@ gauden_init(char const *meanfile, char const *varfile, float32 varfloor, logmath
     return g;
 }
 
+gauden_t *
+gauden_init_am(bin_am_t *am, logmath_t *lmath)
+{
+    bin_am_gauden_t const *hdr;
+    int32 const *featlen;
+    mfcc_t *mean, *var, *det;
+    size_t size, n_param, veclen;
+    int32 m, f, d;
+    gauden_t *g;
+
+    if ((hdr = bin_am_section(am, BIN_AM_GAUDEN, &size)) == NULL)
+        return NULL;
+    if (size < sizeof(*hdr) + hdr->n_feat * sizeof(*featlen)) {
+        E_ERROR("Gaussian parameters in binary acoustic model are truncated\n");
+        return NULL;
+    }
+    featlen = (int32 const *)(hdr + 1);
+    for (f = 0, veclen = 0; f < hdr->n_feat; ++f)
+        veclen += featlen[f];
+    n_param = (size_t)hdr->n_mgau * hdr->n_density * veclen;
+    mean = bin_am_section(am, BIN_AM_MEAN, &size);
+    if (mean == NULL || size < n_param * sizeof(mfcc_t))
+        goto truncated;
+    var = bin_am_section(am, BIN_AM_VAR, &size);
+    if (var == NULL || size < n_param * sizeof(mfcc_t))
+        goto truncated;
+    det = bin_am_section(am, BIN_AM_DET, &size);
+    if (det == NULL || size < (size_t)hdr->n_mgau * hdr->n_feat
+        * hdr->n_density * sizeof(mfcc_t))
+        goto truncated;
+
+    g = (gauden_t *) ckd_calloc(1, sizeof(gauden_t));
+    g->lmath = lmath;
+    g->n_mgau = hdr->n_mgau;
+    g->n_feat = hdr->n_feat;
+    g->n_density = hdr->n_density;
+    g->featlen = ckd_calloc(g->n_feat, sizeof(*g->featlen));
+    memcpy(g->featlen, featlen, g->n_feat * sizeof(*g->featlen));
+    g->mean = (mfcc_t ****)ckd_calloc_3d(g->n_mgau, g->n_feat, g->n_density,
+                                         sizeof(mfcc_t *));
+    g->var = (mfcc_t ****)ckd_calloc_3d(g->n_mgau, g->n_feat, g->n_density,
+                                        sizeof(mfcc_t *));
+    g->det = (mfcc_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(mfcc_t *));
+    /* Same layout as gauden_param_read() and gauden_dist_precompute(). */
+    for (m = 0; m < g->n_mgau; ++m) {
+        for (f = 0; f < g->n_feat; ++f) {
+            g->det[m][f] = det;
+            det += g->n_density;
+            for (d = 0; d < g->n_density; ++d) {
+                g->mean[m][f][d] = mean;
+                g->var[m][f][d] = var;
+                mean += g->featlen[f];
+                var += g->featlen[f];
+            }
+        }
+    }
+    g->am = bin_am_retain(am);
+
+    return g;
+
+truncated:
+    E_ERROR("Gaussian parameters in binary acoustic model are truncated\n");
+    return NULL;
+}
+
 void
 gauden_free(gauden_t * g)
 {
     if (g == NULL)
         return;
-    if (g->mean)
-        gauden_param_free(g->mean);
-    if (g->var)
-        gauden_param_free(g->var);
-    if (g->det)
-        ckd_free_3d(g->det);
-    if (g->featlen)
-        ckd_free(g->featlen);
+    gauden_blk_free(g);
+    gauden_params_free(g);
     ckd_free(g);
 }
 
-/* See compute_dist below */
-static int32
-compute_dist_all(gauden_dist_t * out_dist, mfcc_t* obs, int32 featlen,
-                 mfcc_t ** mean, mfcc_t ** var, mfcc_t * det,
-                 int32 n_density)
+/*
+ * Distance kernels.  Each one scores a block of GAUDEN_BLK densities
+ * laid out by gauden_blk_init(), i.e. mean[i * GAUDEN_BLK + lane] is
+ * dimension i of the lane'th density in the block.  The arithmetic is
+ * done in the same order in all of them, so they give identical
+ * results.
+ */
+#if !defined(FIXED_POINT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define GAUDEN_HAVE_SSE2
+
+/* How many dimensions to accumulate between early-exit checks. */
+#define GAUDEN_PRUNE_STRIDE 4
+
+static int
+gauden_blk_eval_sse2(mfcc_t *out, mfcc_t const *obs, int32 featlen,
+                     mfcc_t const *mean, mfcc_t const *var,
+                     mfcc_t const *det, mfcc_t worst)
 {
-    int32 i, d;
+    __m128 d0, d1, w;
+    int32 i;
+
+    d0 = _mm_load_ps(det);
+    d1 = _mm_load_ps(det + 4);
+    w = _mm_set1_ps(worst);
+    for (i = 0; i < featlen; ++i) {
+        __m128 x, diff0, diff1;
+
+        x = _mm_set1_ps(obs[i]);
+        diff0 = _mm_sub_ps(x, _mm_load_ps(mean));
+        diff1 = _mm_sub_ps(x, _mm_load_ps(mean + 4));
+        d0 = _mm_sub_ps(d0, _mm_mul_ps(_mm_mul_ps(diff0, diff0),
+                                       _mm_load_ps(var)));
+        d1 = _mm_sub_ps(d1, _mm_mul_ps(_mm_mul_ps(diff1, diff1),
+                                       _mm_load_ps(var + 4)));
+        mean += GAUDEN_BLK;
+        var += GAUDEN_BLK;
+        if ((i % GAUDEN_PRUNE_STRIDE) == GAUDEN_PRUNE_STRIDE - 1
+            && _mm_movemask_ps(_mm_or_ps(_mm_cmpge_ps(d0, w),
+                                         _mm_cmpge_ps(d1, w))) == 0)
+            break;
+    }
+    _mm_storeu_ps(out, d0);
+    _mm_storeu_ps(out + 4, d1);
+
+    return (i < featlen) ? 0 : GAUDEN_BLK;
+}
+
+/* AVX kernel, compiled for the target regardless of -march and only
+ * used if the CPU actually supports it. */
+#if (defined(__x86_64__) || defined(__i386__))                          \
+    && (defined(__clang__)                                              \
+        || (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define GAUDEN_HAVE_AVX
+
+__attribute__((target("avx")))
+static int
+gauden_blk_eval_avx(mfcc_t *out, mfcc_t const *obs, int32 featlen,
+                    mfcc_t const *mean, mfcc_t const *var,
+                    mfcc_t const *det, mfcc_t worst)
+{
+    __m256 d, w;
+    int32 i;
+
+    d = _mm256_load_ps(det);
+    w = _mm256_set1_ps(worst);
+    for (i = 0; i < featlen; ++i) {
+        __m256 diff;
+
+        diff = _mm256_sub_ps(_mm256_set1_ps(obs[i]), _mm256_load_ps(mean));
+        d = _mm256_sub_ps(d, _mm256_mul_ps(_mm256_mul_ps(diff, diff),
+                                           _mm256_load_ps(var)));
+        mean += GAUDEN_BLK;
+        var += GAUDEN_BLK;
+        if ((i % GAUDEN_PRUNE_STRIDE) == GAUDEN_PRUNE_STRIDE - 1
+            && _mm256_movemask_ps(_mm256_cmp_ps(d, w, _CMP_GE_OQ)) == 0)
+            break;
+    }
+    _mm256_storeu_ps(out, d);
 
-    for (d = 0; d < n_density; ++d) {
-        mfcc_t *m;
-        mfcc_t *v;
-        mfcc_t dval;
+    return (i < featlen) ? 0 : GAUDEN_BLK;
+}
+#endif /* AVX */
+#endif /* SSE2 */
+
+#ifndef GAUDEN_HAVE_SSE2
+static int
+gauden_blk_eval_scalar(mfcc_t *out, mfcc_t const *obs, int32 featlen,
+                       mfcc_t const *mean, mfcc_t const *var,
+                       mfcc_t const *det, mfcc_t worst)
+{
+    int32 i, l, n_live;
 
-        m = mean[d];
-        v = var[d];
-        dval = det[d];
+    n_live = 0;
+    for (l = 0; l < GAUDEN_BLK; ++l) {
+        mfcc_t dval = det[l];
 
-        for (i = 0; i < featlen; i++) {
+        for (i = 0; (i < featlen) && (dval >= worst); i++) {
             mfcc_t diff;
 #ifdef FIXED_POINT
             /* Have to check for underflows here. */
             mfcc_t pdval = dval;
-            diff = obs[i] - m[i];
-            dval -= MFCCMUL(MFCCMUL(diff, diff), v[i]);
+            diff = obs[i] - mean[i * GAUDEN_BLK + l];
+            dval -= MFCCMUL(MFCCMUL(diff, diff), var[i * GAUDEN_BLK + l]);
             if (dval > pdval) {
                 dval = WORST_SCORE;
                 break;
             }
 #else
-            diff = obs[i] - m[i];
+            diff = obs[i] - mean[i * GAUDEN_BLK + l];
             /* The compiler really likes this to be a single
              * expression, for whatever reason. */
-            dval -= diff * diff * v[i];
+            dval -= diff * diff * var[i * GAUDEN_BLK + l];
+#endif
+        }
+        out[l] = dval;
+        if (dval >= worst)
+            ++n_live;
+    }
+
+    return n_live;
+}
+#endif /* !SSE2 */
+
+
+static gauden_blk_eval_t
+gauden_blk_eval_select(char const **out_name)
+{
+#ifdef GAUDEN_HAVE_AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        *out_name = "AVX";
+        return &gauden_blk_eval_avx;
+    }
 #endif
+#ifdef GAUDEN_HAVE_SSE2
+    *out_name = "SSE2";
+    return &gauden_blk_eval_sse2;
+#else
+    *out_name = "scalar";
+    return &gauden_blk_eval_scalar;
+#endif
+}
+
+static void
+gauden_blk_free(gauden_t *g)
+{
+    ckd_free(g->blk_buf);
+    ckd_free_2d(g->blk_mean);
+    ckd_free_2d(g->blk_var);
+    ckd_free_2d(g->blk_det);
+    g->blk_buf = NULL;
+    g->blk_mean = g->blk_var = g->blk_det = NULL;
+}
+
+size_t
+gauden_blk_size(gauden_t *g)
+{
+    int32 f, blklen, n_pad;
+
+    n_pad = (g->n_density + GAUDEN_BLK - 1) / GAUDEN_BLK * GAUDEN_BLK;
+    for (f = 0, blklen = 0; f < g->n_feat; ++f)
+        blklen += g->featlen[f];
+    return (size_t)g->n_mgau * n_pad * (2 * blklen + g->n_feat) * sizeof(mfcc_t);
+}
+
+int32
+gauden_blk_init(gauden_t *g)
+{
+    int32 m, f, d, i, n_pad;
+    size_t n_param, size;
+    mfcc_t *ptr;
+    char const *name;
+    int fill;
+
+    gauden_blk_free(g);
+
+    g->n_blk = (g->n_density + GAUDEN_BLK - 1) / GAUDEN_BLK;
+    n_pad = g->n_blk * GAUDEN_BLK;
+
+    /* Everything goes in one buffer, aligned to the size of a
+     * block.  Each array is a whole number of blocks long, so every
+     * block starts on an aligned boundary.  A binary acoustic model
+     * may already contain it. */
+    n_param = gauden_blk_size(g) / sizeof(mfcc_t);
+    ptr = NULL;
+    if (g->am)
+        ptr = bin_am_section(g->am, BIN_AM_BLOCKED, &size);
+    if (ptr && size == n_param * sizeof(mfcc_t)) {
+        fill = FALSE;
+    }
+    else {
+        fill = TRUE;
+        g->blk_buf = ckd_calloc(n_param + GAUDEN_BLK, sizeof(mfcc_t));
+        ptr = (mfcc_t *)(((size_t)g->blk_buf + GAUDEN_BLK * sizeof(mfcc_t) - 1)
+                         & ~(GAUDEN_BLK * sizeof(mfcc_t) - 1));
+    }
+
+    g->blk_mean = (mfcc_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(mfcc_t *));
+    g->blk_var = (mfcc_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(mfcc_t *));
+    g->blk_det = (mfcc_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(mfcc_t *));
+    for (m = 0; m < g->n_mgau; ++m) {
+        for (f = 0; f < g->n_feat; ++f) {
+            int32 flen = g->featlen[f];
+
+            g->blk_mean[m][f] = ptr;
+            ptr += (size_t)n_pad * flen;
+            g->blk_var[m][f] = ptr;
+            ptr += (size_t)n_pad * flen;
+            g->blk_det[m][f] = ptr;
+            ptr += n_pad;
+            if (!fill)
+                continue;
+
+            /* Padding densities keep a zero mean and variance and
+             * the worst possible determinant, so they never win. */
+            for (d = 0; d < n_pad; ++d) {
+                size_t base = (size_t)(d / GAUDEN_BLK) * flen * GAUDEN_BLK
+                    + d % GAUDEN_BLK;
+                if (d >= g->n_density) {
+                    g->blk_det[m][f][d] = WORST_DIST;
+                    continue;
+                }
+                g->blk_det[m][f][d] = g->det[m][f][d];
+                for (i = 0; i < flen; ++i) {
+                    g->blk_mean[m][f][base + i * GAUDEN_BLK]
+                        = g->mean[m][f][d][i];
+                    g->blk_var[m][f][base + i * GAUDEN_BLK]
+                        = g->var[m][f][d][i];
+                }
+            }
         }
+    }
+
+    g->blk_eval = gauden_blk_eval_select(&name);
+    E_INFO("Using %s Gaussian distance kernel\n", name);
+
+    return 0;
+}
 
-        out_dist[d].dist = dval;
-        out_dist[d].id = d;
+/* See compute_dist below */
+static int32
+compute_dist_all(gauden_dist_t * out_dist, mfcc_t* obs, int32 featlen,
+                 mfcc_t * mean, mfcc_t * var, mfcc_t * det,
+                 int32 n_density, gauden_blk_eval_t blk_eval)
+{
+    mfcc_t dval[GAUDEN_BLK];
+    int32 d, l, n;
+
+    for (d = 0; d < n_density; d += GAUDEN_BLK) {
+        (*blk_eval)(dval, obs, featlen, mean, var, det + d, NO_PRUNE_DIST);
+        mean += featlen * GAUDEN_BLK;
+        var += featlen * GAUDEN_BLK;
+
+        n = n_density - d;
+        if (n > GAUDEN_BLK)
+            n = GAUDEN_BLK;
+        for (l = 0; l < n; ++l) {
+            out_dist[d + l].dist = dval[l];
+            out_dist[d + l].id = d + l;
+        }
     }
 
     return 0;
@@ -421,59 +740,44 @@ compute_dist_all(gauden_dist_t * out_dist, mfcc_t* obs, int32 featlen,
 static int32
 compute_dist(gauden_dist_t * out_dist, int32 n_top,
              mfcc_t * obs, int32 featlen,
-             mfcc_t ** mean, mfcc_t ** var, mfcc_t * det,
-             int32 n_density)
+             mfcc_t * mean, mfcc_t * var, mfcc_t * det,
+             int32 n_density, gauden_blk_eval_t blk_eval)
 {
-    int32 i, j, d;
+    mfcc_t dval[GAUDEN_BLK];
+    int32 i, j, d, l, n;
     gauden_dist_t *worst;
 
     /* Special case optimization when n_density <= n_top */
     if (n_top >= n_density)
         return (compute_dist_all
-                (out_dist, obs, featlen, mean, var, det, n_density));
+                (out_dist, obs, featlen, mean, var, det, n_density, blk_eval));
 
     for (i = 0; i < n_top; i++)
         out_dist[i].dist = WORST_DIST;
     worst = &(out_dist[n_top - 1]);
 
-    for (d = 0; d < n_density; d++) {
-        mfcc_t *m;
-        mfcc_t *v;
-        mfcc_t dval;
-
-        m = mean[d];
-        v = var[d];
-        dval = det[d];
-
-        for (i = 0; (i < featlen) && (dval >= worst->dist); i++) {
-            mfcc_t diff;
-#ifdef FIXED_POINT
-            /* Have to check for underflows here. */
-            mfcc_t pdval = dval;
-            diff = obs[i] - m[i];
-            dval -= MFCCMUL(MFCCMUL(diff, diff), v[i]);
-            if (dval > pdval) {
-                dval = WORST_SCORE;
-                break;
-            }
-#else
-            diff = obs[i] - m[i];
-            /* The compiler really likes this to be a single
-             * expression, for whatever reason. */
-            dval -= diff * diff * v[i];
-#endif
-        }
-
-        if ((i < featlen) || (dval < worst->dist))     /* Codeword d worse than worst */
+    for (d = 0; d < n_density; d += GAUDEN_BLK,
+             mean += featlen * GAUDEN_BLK, var += featlen * GAUDEN_BLK) {
+        /* Whole block worse than worst */
+        if ((*blk_eval)(dval, obs, featlen, mean, var, det + d,
+                        worst->dist) == 0)
             continue;
 
-        /* Codeword d at least as good as worst so far; insert in the ordered list */
-        for (i = 0; (i < n_top) && (dval < out_dist[i].dist); i++);
-        assert(i < n_top);
-        for (j = n_top - 1; j > i; --j)
-            out_dist[j] = out_dist[j - 1];
-        out_dist[i].dist = dval;
-        out_dist[i].id = d;
+        n = n_density - d;
+        if (n > GAUDEN_BLK)
+            n = GAUDEN_BLK;
+        for (l = 0; l < n; ++l) {
+            if (dval[l] < worst->dist)     /* Codeword d + l worse than worst */
+                continue;
+
+            /* Codeword at least as good as worst so far; insert in the ordered list */
+            for (i = 0; (i < n_top) && (dval[l] < out_dist[i].dist); i++);
+            assert(i < n_top);
+            for (j = n_top - 1; j > i; --j)
+                out_dist[j] = out_dist[j - 1];
+            out_dist[i].dist = dval[l];
+            out_dist[i].id = d + l;
+        }
     }
 
     return 0;
@@ -492,12 +796,14 @@ gauden_dist(gauden_t * g,
     int32 f;
 
     assert((n_top > 0) && (n_top <= g->n_density));
+    assert(g->blk_mean != NULL);
 
     for (f = 0; f < g->n_feat; f++) {
         compute_dist(out_dist[f], n_top,
                      obs[f], g->featlen[f],
-                     g->mean[mgau][f], g->var[mgau][f], g->det[mgau][f],
-                     g->n_density);
+                     g->blk_mean[mgau][f], g->blk_var[mgau][f],
+                     g->blk_det[mgau][f],
+                     g->n_density, g->blk_eval);
         E_DEBUG("Top CW(%d,%d) = %d %d\n", mgau, f, out_dist[f][0].id,
                 (int)out_dist[f][0].dist >> SENSCR_SHIFT);
     }
@@ -511,16 +817,7 @@ gauden_mllr_transform(gauden_t *g, ps_mllr_t *mllr, cmd_ln_t *config)
     int32 i, m, f, d, *flen;
 
     /* Free data if already here */
-    if (g->mean)
-        gauden_param_free(g->mean);
-    if (g->var)
-        gauden_param_free(g->var);
-    if (g->det)
-        ckd_free_3d(g->det);
-    if (g->featlen)
-        ckd_free(g->featlen);
-    g->det = NULL;
-    g->featlen = NULL;
+    gauden_params_free(g);
 
     /* Reload means and variances (un-precomputed). */
     g->mean = (mfcc_t ****)gauden_param_read(cmd_ln_str_r(config, "_mean"), &g->n_mgau, &g->n_feat, &g->n_density,
@@ -565,5 +862,7 @@ gauden_mllr_transform(gauden_t *g, ps_mllr_t *mllr, cmd_ln_t *config)
     /* Re-precompute (if we aren't adapting variances this isn't
      * actually necessary...) */
     gauden_dist_precompute(g, g->lmath, cmd_ln_float32_r(config, "-varfloor"));
+    if (g->blk_mean)
+        gauden_blk_init(g);
     return 0;
 }
@@ -59,6 +59,7 @@
 #include "vector.h"
 #include "pocketsphinx_internal.h"
 #include "hmm.h"
+#include "bin_am.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,6 +76,25 @@ typedef struct {
 
 } gauden_dist_t;
 
+/**
+ * Number of densities scored together by the distance kernels.  The
+ * blocked parameter layout in gauden_t is padded to a multiple of
+ * this.
+ */
+#define GAUDEN_BLK 8
+
+/**
+ * Distance kernel for one block of GAUDEN_BLK densities.
+ *
+ * Writes the (partial) density values for each lane to out, and
+ * returns the number of lanes which may still be at least as good as
+ * worst.  Lanes worse than worst may have stopped accumulating early,
+ * so their values are only meaningful for comparison with worst.
+ */
+typedef int (*gauden_blk_eval_t)(mfcc_t *out, mfcc_t const *obs, int32 featlen,
+                                 mfcc_t const *mean, mfcc_t const *var,
+                                 mfcc_t const *det, mfcc_t worst);
+
 /**
  * \struct gauden_t
  * \brief Multivariate gaussian mixture density parameters
@@ -89,6 +109,18 @@ typedef struct {
     int32 n_feat;	/**< Number feature streams in each codebook */
     int32 n_density;	/**< Number gaussian densities in each codebook-feature stream */
     int32 *featlen;	/**< feature length for each feature */
+
+    /* Blocked copies of mean, var and det used by gauden_dist(). */
+    int32 n_blk;        /**< Number of GAUDEN_BLK-wide blocks per codebook-feature */
+    mfcc_t ***blk_mean; /**< blk_mean[codebook][feature], block-major, then
+                           dimension-major, with GAUDEN_BLK densities
+                           contiguous for each dimension */
+    mfcc_t ***blk_var;  /**< like blk_mean */
+    mfcc_t ***blk_det;  /**< blk_det[codebook][feature][density], padded */
+    void *blk_buf;      /**< Storage for the above (unaligned) */
+    gauden_blk_eval_t blk_eval; /**< Distance kernel selected at runtime */
+
+    bin_am_t *am;       /**< Binary acoustic model holding the parameters (if any) */
 } gauden_t;
 
 
@@ -105,6 +137,27 @@ gauden_init (char const *meanfile,/**< Input: File containing means of mixture g
              logmath_t *lmath
     );
 
+/**
+ * Get precomputed mixture gaussian codebooks from a binary acoustic
+ * model, without copying them.
+ * @return the codebooks, or NULL if not present.
+ */
+gauden_t *gauden_init_am(bin_am_t *am, logmath_t *lmath);
+
+/**
+ * Build the blocked parameter layout used by gauden_dist() and select
+ * the fastest distance kernel for this CPU.  Only needed by users of
+ * gauden_dist(); re-built automatically by gauden_mllr_transform().
+ * @return 0 if successful, -1 otherwise.
+ */
+int32 gauden_blk_init(gauden_t *g);
+
+/**
+ * Size in bytes of the blocked parameters, which are contiguous
+ * starting at blk_mean[0][0].
+ */
+size_t gauden_blk_size(gauden_t *g);
+
 /** Release memory allocated by gauden_init. */
 void gauden_free(gauden_t *g); /**< In: The gauden_t to free */
 
@@ -114,7 +167,8 @@ int32 gauden_mllr_transform(gauden_t *s, ps_mllr_t *mllr, cmd_ln_t *config);
 /**
  * Compute gaussian density values for the given input observation vector wrt the
  * specified mixture gaussian codebook (which may consist of several feature streams).
- * Density values are left UNnormalized.
+ * Density values are left UNnormalized.  gauden_blk_init() must have
+ * been called first.
  * @return 0 if successful, -1 otherwise.
  */
 int32
@@ -68,6 +68,9 @@
  *
  */
 
+/* SphinxBase headers. */
+#include <sphinxbase/sbthread.h>
+
 /* Local headers. */
 #include "ms_mgau.h"
 
@@ -75,9 +78,25 @@ static ps_mgaufuncs_t ms_mgau_funcs = {
     "ms",
     ms_cont_mgau_frame_eval, /* frame_eval */
     ms_mgau_mllr_transform,  /* transform */
-    ms_mgau_free             /* free */
+    ms_mgau_free,            /* free */
+    ms_mgau_batch_eval,      /* batch_eval */
+    ms_mgau_copy             /* copy */
 };
 
+/*
+ * Allocate scoring state which is not shared between instances.
+ */
+static void
+ms_mgau_init_state(ms_mgau_model_t *msg)
+{
+    gauden_t *g = ms_mgau_gauden(msg);
+
+    msg->dist = (gauden_dist_t ***)
+        ckd_calloc_3d(g->n_mgau, g->n_feat, msg->topn,
+                      sizeof(gauden_dist_t));
+    msg->mgau_active = ckd_calloc(g->n_mgau, sizeof(int8));
+}
+
 ps_mgau_t *
 ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
 {
@@ -96,13 +115,21 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
     msg->g = NULL;
     msg->s = NULL;
     
-    if ((g = msg->g = gauden_init(cmd_ln_str_r(config, "_mean"),
-                             cmd_ln_str_r(config, "_var"),
-                             cmd_ln_float32_r(config, "-varfloor"),
-                             lmath)) == NULL) {
+    if (acmod_am_for(acmod, "-mean", "-var"))
+        msg->g = gauden_init_am(acmod->am, lmath);
+    if (msg->g == NULL
+        && (msg->g = gauden_init(cmd_ln_str_r(config, "_mean"),
+                                 cmd_ln_str_r(config, "_var"),
+                                 cmd_ln_float32_r(config, "-varfloor"),
+                                 lmath)) == NULL) {
 	E_ERROR("Failed to read means and variances\n");	
 	goto error_out;
     }
+    g = msg->g;
+    if (gauden_blk_init(g) < 0) {
+        E_ERROR("Failed to set up Gaussian distance computation\n");
+        goto error_out;
+    }
 
     /* Verify n_feat and veclen, against acmod. */
     if (g->n_feat != feat_dimension1(acmod->fcb)) {
@@ -118,11 +145,17 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
         }
     }
 
-    s = msg->s = senone_init(msg->g,
+    if (acmod_am_for(acmod, "-mixw", "-senmgau"))
+        msg->s = senone_init_am(acmod->am,
+                                cmd_ln_float32_r(config, "-mixwfloor"),
+                                lmath);
+    if (msg->s == NULL)
+        msg->s = senone_init(msg->g,
                              cmd_ln_str_r(config, "_mixw"),
                              cmd_ln_str_r(config, "_senmgau"),
                              cmd_ln_float32_r(config, "-mixwfloor"),
                              lmath, mdef);
+    s = msg->s;
 
     s->aw = cmd_ln_int32_r(config, "-aw");
 
@@ -149,13 +182,11 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
         msg->topn = msg->g->n_density;
     }
 
-    msg->dist = (gauden_dist_t ***)
-        ckd_calloc_3d(g->n_mgau, g->n_feat, msg->topn,
-                      sizeof(gauden_dist_t));
-    msg->mgau_active = ckd_calloc(g->n_mgau, sizeof(int8));
+    ms_mgau_init_state(msg);
 
     mg = (ps_mgau_t *)msg;
     mg->vt = &ms_mgau_funcs;
+    mg->refcount = 1;
     return mg;
 error_out:
     ms_mgau_free(ps_mgau_base(msg));
@@ -168,19 +199,47 @@ ms_mgau_free(ps_mgau_t * mg)
     ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
     if (msg == NULL)
         return;
+    if (sbatomic_add(&mg->refcount, -1) > 0)
+        return;
 
-    if (msg->g)
-	gauden_free(msg->g);
-    if (msg->s)
-        senone_free(msg->s);
     if (msg->dist)
         ckd_free_3d((void *) msg->dist);
     if (msg->mgau_active)
         ckd_free(msg->mgau_active);
+
+    /* Parameters belong to another instance. */
+    if (mg->shared) {
+        ps_mgau_free(mg->shared);
+        ckd_free(msg);
+        return;
+    }
+
+    if (msg->g)
+	gauden_free(msg->g);
+    if (msg->s)
+        senone_free(msg->s);
     
     ckd_free(msg);
 }
 
+ps_mgau_t *
+ms_mgau_copy(ps_mgau_t * mg)
+{
+    ms_mgau_model_t *msg;
+
+    /* Start with the same parameters and settings. */
+    msg = (ms_mgau_model_t *) ckd_calloc(1, sizeof(ms_mgau_model_t));
+    *msg = *(ms_mgau_model_t *)mg;
+    msg->base.frame_idx = 0;
+    msg->base.refcount = 1;
+    msg->base.shared = ps_mgau_retain(mg->shared ? mg->shared : mg);
+
+    /* But not the same state. */
+    ms_mgau_init_state(msg);
+
+    return ps_mgau_base(msg);
+}
+
 int
 ms_mgau_mllr_transform(ps_mgau_t *s,
 		       ps_mllr_t *mllr)
@@ -189,32 +248,55 @@ ms_mgau_mllr_transform(ps_mgau_t *s,
     return gauden_mllr_transform(msg->g, mllr, msg->config);
 }
 
-int32
-ms_cont_mgau_frame_eval(ps_mgau_t * mg,
-			int16 *senscr,
-			uint8 *senone_active,
-			int32 n_senone_active,
-                        mfcc_t ** feat,
-			int32 frame,
-			int32 compallsen)
+/*
+ * Flag all active mixture-gaussian codebooks.
+ */
+static void
+ms_mgau_calc_active(ms_mgau_model_t *msg,
+                    uint8 *senone_active,
+                    int32 n_senone_active,
+                    int32 compallsen)
 {
-    ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
-    int32 gid;
-    int32 topn;
-    int32 best;
-    gauden_t *g;
-    senone_t *sen;
+    gauden_t *g = ms_mgau_gauden(msg);
+    senone_t *sen = ms_mgau_senone(msg);
+    int32 gid, i, n;
 
-    topn = ms_mgau_topn(msg);
-    g = ms_mgau_gauden(msg);
-    sen = ms_mgau_senone(msg);
+    if (compallsen) {
+	for (gid = 0; gid < g->n_mgau; gid++)
+	    msg->mgau_active[gid] = 1;
+	return;
+    }
+
+    for (gid = 0; gid < g->n_mgau; gid++)
+	msg->mgau_active[gid] = 0;
+
+    n = 0;
+    for (i = 0; i < n_senone_active; i++) {
+	/* senone_active consists of deltas. */
+	int32 s = senone_active[i] + n;
+	msg->mgau_active[sen->mgau[s]] = 1;
+	n = s;
+    }
+}
+
+/*
+ * Compute and normalize senone scores from the topn gaussian density
+ * values in msg->dist.
+ */
+static void
+ms_mgau_senone_eval(ms_mgau_model_t *msg,
+                    int16 *senscr,
+                    uint8 *senone_active,
+                    int32 n_senone_active,
+                    int32 compallsen)
+{
+    int32 topn = ms_mgau_topn(msg);
+    senone_t *sen = ms_mgau_senone(msg);
+    int32 best;
 
     if (compallsen) {
 	int32 s;
 
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-
 	best = (int32) 0x7fffffff;
 	for (s = 0; s < sen->n_sen; s++) {
 	    senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
@@ -235,23 +317,6 @@ ms_cont_mgau_frame_eval(ps_mgau_t * mg,
     }
     else {
 	int32 i, n;
-	/* Flag all active mixture-gaussian codebooks */
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    msg->mgau_active[gid] = 0;
-
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    /* senone_active consists of deltas. */
-	    int32 s = senone_active[i] + n;
-	    msg->mgau_active[sen->mgau[s]] = 1;
-	    n = s;
-	}
-
-	/* Compute topn gaussian density values (for active codebooks) */
-	for (gid = 0; gid < g->n_mgau; gid++) {
-	    if (msg->mgau_active[gid])
-		gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-	}
 
 	best = (int32) 0x7fffffff;
 	n = 0;
@@ -277,6 +342,72 @@ ms_cont_mgau_frame_eval(ps_mgau_t * mg,
 	    n = s;
 	}
     }
+}
+
+int32
+ms_cont_mgau_frame_eval(ps_mgau_t * mg,
+			int16 *senscr,
+			uint8 *senone_active,
+			int32 n_senone_active,
+                        mfcc_t ** feat,
+			int32 frame,
+			int32 compallsen)
+{
+    ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
+    int32 gid;
+    int32 topn;
+    gauden_t *g;
+
+    topn = ms_mgau_topn(msg);
+    g = ms_mgau_gauden(msg);
+
+    ms_mgau_calc_active(msg, senone_active, n_senone_active, compallsen);
+
+    /* Compute topn gaussian density values (for active codebooks) */
+    for (gid = 0; gid < g->n_mgau; gid++) {
+	if (msg->mgau_active[gid])
+	    gauden_dist(g, gid, topn, feat, msg->dist[gid]);
+    }
+
+    ms_mgau_senone_eval(msg, senscr, senone_active,
+                        n_senone_active, compallsen);
+
+    return 0;
+}
+
+int
+ms_mgau_batch_eval(ps_mgau_frame_t *frames, int32 n_frames)
+{
+    int32 gid, n_mgau, i;
+
+    n_mgau = 0;
+    for (i = 0; i < n_frames; ++i) {
+        ms_mgau_model_t *msg = (ms_mgau_model_t *)frames[i].mgau;
+        ms_mgau_calc_active(msg, frames[i].senone_active,
+                            frames[i].n_senone_active,
+                            frames[i].compallsen);
+        if (ms_mgau_gauden(msg)->n_mgau > n_mgau)
+            n_mgau = ms_mgau_gauden(msg)->n_mgau;
+    }
+
+    /* Compute topn gaussian density values one codebook at a time,
+     * so that its parameters are only brought into cache once. */
+    for (gid = 0; gid < n_mgau; gid++) {
+        for (i = 0; i < n_frames; ++i) {
+            ms_mgau_model_t *msg = (ms_mgau_model_t *)frames[i].mgau;
+            gauden_t *g = ms_mgau_gauden(msg);
+
+            if (gid < g->n_mgau && msg->mgau_active[gid])
+                gauden_dist(g, gid, ms_mgau_topn(msg),
+                            frames[i].feat, msg->dist[gid]);
+        }
+    }
+
+    for (i = 0; i < n_frames; ++i)
+        ms_mgau_senone_eval((ms_mgau_model_t *)frames[i].mgau,
+                            frames[i].senscr, frames[i].senone_active,
+                            frames[i].n_senone_active,
+                            frames[i].compallsen);
 
     return 0;
 }
@@ -136,6 +136,9 @@ int32 ms_cont_mgau_frame_eval(ps_mgau_t * msg,
                               mfcc_t ** feat,
                               int32 frame,
                               int32 compallsen);
+ps_mgau_t *ms_mgau_copy(ps_mgau_t *g);
+int ms_mgau_batch_eval(ps_mgau_frame_t *frames,
+                       int32 n_frames);
 int32 ms_mgau_mllr_transform(ps_mgau_t *s,
                              ps_mllr_t *mllr);
 
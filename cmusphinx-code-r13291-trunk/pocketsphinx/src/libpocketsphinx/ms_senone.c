@@ -337,12 +337,76 @@ senone_init(gauden_t *g, char const *mixwfile, char const *sen2mgau_map_file,
     return s;
 }
 
+senone_t *
+senone_init_am(bin_am_t *am, float32 mixwfloor, logmath_t *lmath)
+{
+    bin_am_senone_t const *hdr;
+    senone_t *s;
+    senprob_t *pdf;
+    size_t size;
+    uint32 i, j, d1, d2, d3;
+
+    if ((hdr = bin_am_section(am, BIN_AM_SENONE, &size)) == NULL)
+        return NULL;
+    if (size < sizeof(*hdr) + hdr->n_sen * sizeof(*s->mgau)) {
+        E_ERROR("Senones in binary acoustic model are truncated\n");
+        return NULL;
+    }
+    if (hdr->mixwfloor != mixwfloor) {
+        E_ERROR("Senones in binary acoustic model were quantized with "
+                "-mixwfloor %g\n", hdr->mixwfloor);
+        return NULL;
+    }
+    pdf = bin_am_section(am, BIN_AM_SENONE_PDF, &size);
+    if (pdf == NULL
+        || size < (size_t)hdr->n_sen * hdr->n_feat * hdr->n_cw) {
+        E_ERROR("Senone mixture weights are missing or truncated\n");
+        return NULL;
+    }
+
+    s = (senone_t *) ckd_calloc(1, sizeof(senone_t));
+    s->lmath = logmath_init(logmath_get_base(lmath), SENSCR_SHIFT, TRUE);
+    s->mixwfloor = mixwfloor;
+    s->n_sen = hdr->n_sen;
+    s->n_feat = hdr->n_feat;
+    s->n_cw = hdr->n_cw;
+    s->n_gauden = hdr->n_gauden;
+    s->mgau = (uint32 *) ckd_calloc(s->n_sen, sizeof(*s->mgau));
+    memcpy(s->mgau, hdr + 1, s->n_sen * sizeof(*s->mgau));
+
+    /* Same layout as senone_mixw_read(). */
+    if (s->n_gauden > 1) {
+        d1 = s->n_sen;
+        d2 = s->n_feat;
+        d3 = s->n_cw;
+    }
+    else {
+        d1 = s->n_feat;
+        d2 = s->n_cw;
+        d3 = s->n_sen;
+    }
+    s->pdf = (senprob_t ***) ckd_calloc_2d(d1, d2, sizeof(senprob_t *));
+    for (i = 0; i < d1; ++i)
+        for (j = 0; j < d2; ++j)
+            s->pdf[i][j] = pdf + ((size_t)i * d2 + j) * d3;
+    s->am = bin_am_retain(am);
+
+    E_INFO("Using mixture weights for %d senones from binary acoustic model\n",
+           s->n_sen);
+    return s;
+}
+
 void
 senone_free(senone_t * s)
 {
     if (s == NULL)
         return;
-    if (s->pdf)
+    if (s->am) {
+        /* Only the pointers are ours. */
+        ckd_free_2d((void *) s->pdf);
+        bin_am_free(s->am);
+    }
+    else if (s->pdf)
         ckd_free_3d((void *) s->pdf);
     if (s->mgau)
         ckd_free(s->mgau);
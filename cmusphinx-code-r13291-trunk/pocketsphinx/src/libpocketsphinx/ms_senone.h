@@ -90,6 +90,7 @@ typedef struct {
     uint32 *mgau;		/**< senone-id -> mgau-id mapping for senones in this set */
     int32 *featscr;              /**< The feature score for every senone, will be initialized inside senone_eval_all */
     int32 aw;			/**< Inverse acoustic weight */
+    bin_am_t *am;               /**< Binary acoustic model holding pdf (if any) */
 } senone_t;
 
 
@@ -109,6 +110,16 @@ senone_t *senone_init (gauden_t *g,             /**< In: codebooks */
                        bin_mdef_t *mdef         /**< In: model definition */
     );
 
+/**
+ * Use a set of senones from a binary acoustic model in place.
+ * @return pointer to senone structure, or NULL if the model has none
+ *         or they were quantized with a different mixwfloor.
+ */
+senone_t *senone_init_am(bin_am_t *am,          /**< In: binary acoustic model */
+                         float32 mixwfloor,     /**< In: Floor value for senone weights */
+                         logmath_t *lmath       /**< In: log math computation */
+    );
+
 /** Release memory allocated by senone_init. */
 void senone_free(senone_t *s); /**< In: The senone_t to free */
 
@@ -62,6 +62,9 @@ static int ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2
 static char const *ngram_search_hyp(ps_search_t *search, int32 *out_score);
 static int32 ngram_search_prob(ps_search_t *search);
 static ps_seg_t *ngram_search_seg_iter(ps_search_t *search);
+static char const *ngram_search_partial_hyp(ps_search_t *search,
+                                            int32 *out_n_stable);
+static int ngram_search_release(ps_search_t *search);
 
 static ps_searchfuncs_t ngram_funcs = {
     /* start: */  ngram_search_start,
@@ -73,10 +76,16 @@ static ps_searchfuncs_t ngram_funcs = {
     /* hyp: */      ngram_search_hyp,
     /* prob: */     ngram_search_prob,
     /* seg_iter: */ ngram_search_seg_iter,
+    /* partial_hyp: */ ngram_search_partial_hyp,
+    /* release: */ ngram_search_release,
 };
 
 static ngram_model_t *default_lm;
 
+/* Is the backpointer table still there in its entirety? */
+#define ngram_search_bp_complete(ngs) \
+    ((ngs)->n_bp_released == 0 && (ngs)->n_bp_retired == 0)
+
 static void
 ngram_search_update_widmap(ngram_search_t *ngs)
 {
@@ -93,6 +102,42 @@ ngram_search_update_widmap(ngram_search_t *ngs)
     ckd_free(words);
 }
 
+static void
+ngram_search_lm_flush(ngram_search_t *ngs)
+{
+    int i;
+
+    for (i = 0; i < NGRAM_LM_CACHE_SIZE; ++i)
+        ngs->lm_cache[i].wid = -1;
+}
+
+int32
+ngram_search_lm_score(ngram_search_t *ngs, int32 w,
+                      int32 h1, int32 h2, int32 *n_used)
+{
+    ngram_lm_cache_t *entry;
+    uint32 h;
+
+    /* Unused entries are marked with an invalid word ID. */
+    if (w < 0)
+        return ngram_tg_score(ngs->lmset, w, h1, h2, n_used);
+    /* Fibonacci hashing to spread nearby word IDs over the cache. */
+    h = ((uint32)w * 31 + (uint32)h1) * 31 + (uint32)h2;
+    entry = &ngs->lm_cache[(h * 2654435761U) >> (32 - NGRAM_LM_CACHE_BITS)];
+    if (entry->wid == w && entry->hist[0] == h1 && entry->hist[1] == h2) {
+        ++ngs->st.n_lm_cache_hit;
+        *n_used = entry->n_used;
+        return entry->lscr;
+    }
+    ++ngs->st.n_lm_cache_miss;
+    entry->lscr = ngram_tg_score(ngs->lmset, w, h1, h2, n_used);
+    entry->wid = w;
+    entry->hist[0] = h1;
+    entry->hist[1] = h2;
+    entry->n_used = *n_used;
+    return entry->lscr;
+}
+
 static void
 ngram_search_calc_beams(ngram_search_t *ngs)
 {
@@ -136,21 +181,22 @@ ngram_search_calc_beams(ngram_search_t *ngs)
     ngs->ascale = 1.0 / cmd_ln_float32_r(config, "-ascale");
 }
 
-ps_search_t *
-ngram_search_init(const char *name,
-                  ngram_model_t *lm,
-                  cmd_ln_t *config,
-                  acmod_t *acmod,
-                  dict_t *dict,
-                  dict2pid_t *d2p)
+/* Takes ownership of lmset. */
+static ps_search_t *
+ngram_search_init_lmset(const char *name,
+                        ngram_model_t *lmset,
+                        cmd_ln_t *config,
+                        acmod_t *acmod,
+                        dict_t *dict,
+                        dict2pid_t *d2p)
 {
     ngram_search_t *ngs;
-    static char *lmname = "default";
 
     /* Make the acmod's feature buffer growable if we are doing two-pass
      * search. */
     acmod_set_grow(acmod, cmd_ln_boolean_r(config, "-fwdflat") &&
-                          cmd_ln_boolean_r(config, "-fwdtree"));
+                          cmd_ln_boolean_r(config, "-fwdtree") &&
+                          !cmd_ln_boolean_r(config, "-bpgc"));
 
     ngs = ckd_calloc(1, sizeof(*ngs));
     ps_search_init(&ngs->base, &ngram_funcs, PS_SEARCH_TYPE_NGRAM, name, config, acmod, dict, d2p);
@@ -159,6 +205,7 @@ ngram_search_init(const char *name,
                                    acmod->tmat->tp, NULL, acmod->mdef->sseq);
     if (ngs->hmmctx == NULL) {
         ps_search_free(ps_search_base(ngs));
+        ngram_model_free(lmset);
         return NULL;
     }
     ngs->chan_alloc = listelem_alloc_init(sizeof(chan_t));
@@ -190,14 +237,15 @@ ngram_search_init(const char *name,
     ngs->bp_table_idx = ckd_calloc(ngs->n_frame_alloc + 1,
                                    sizeof(*ngs->bp_table_idx));
     ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
+    ngs->stable_bp = NO_BP;
 
     /* Allocate active word list array */
     ngs->active_word_list = ckd_calloc_2d(2, dict_size(dict),
                                           sizeof(**ngs->active_word_list));
 
-    ngs->lmset = ngram_model_set_init(config, &lm, &lmname, NULL, 1);
-    if (!ngs->lmset)
-        goto error_out;
+    ngs->lmset = lmset;
+    ngs->lm_cache = ckd_calloc(NGRAM_LM_CACHE_SIZE, sizeof(*ngs->lm_cache));
+    ngram_search_lm_flush(ngs);
 
     if (ngram_wid(ngs->lmset, S3_FINISH_WORD) ==
         ngram_unknown_wid(ngs->lmset))
@@ -217,7 +265,11 @@ ngram_search_init(const char *name,
         ngs->fwdtree_perf.name = "fwdtree";
         ptmr_init(&ngs->fwdtree_perf);
     }
-    if (cmd_ln_boolean_r(config, "-fwdflat")) {
+    /* A second pass needs the whole backpointer table. */
+    ngs->bp_gc = cmd_ln_boolean_r(config, "-bpgc");
+    if (ngs->bp_gc && ngs->fwdtree && cmd_ln_boolean_r(config, "-fwdflat"))
+        E_INFO("Backpointer table garbage collection disables fwdflat search\n");
+    else if (cmd_ln_boolean_r(config, "-fwdflat")) {
         ngram_fwdflat_init(ngs);
         ngs->fwdflat = TRUE;
         ngs->fwdflat_perf.name = "fwdflat";
@@ -236,6 +288,74 @@ error_out:
     return NULL;
 }
 
+ps_search_t *
+ngram_search_init(const char *name,
+                  ngram_model_t *lm,
+                  cmd_ln_t *config,
+                  acmod_t *acmod,
+                  dict_t *dict,
+                  dict2pid_t *d2p)
+{
+    ngram_model_t *lmset;
+    static char *lmname = "default";
+
+    if ((lmset = ngram_model_set_init(config, &lm, &lmname, NULL, 1)) == NULL)
+        return NULL;
+    return ngram_search_init_lmset(name, lmset, config, acmod, dict, d2p);
+}
+
+ps_search_t *
+ngram_search_copy(const char *name,
+                  ps_search_t *other,
+                  cmd_ln_t *config,
+                  acmod_t *acmod,
+                  dict_t *dict,
+                  dict2pid_t *d2p)
+{
+    ngram_model_t *lmset = ((ngram_search_t *)other)->lmset;
+    ngram_model_set_iter_t *itor;
+    ngram_model_t **lms;
+    char **names;
+    int32 i, n_models;
+
+    /* Scoring updates caches in the models, so copy each of them
+     * rather than the set itself, whose word mappings stay with the
+     * original and could not be rebuilt for this search. */
+    n_models = ngram_model_set_count(lmset);
+    lms = ckd_calloc(n_models, sizeof(*lms));
+    names = ckd_calloc(n_models, sizeof(*names));
+    for (i = 0, itor = ngram_model_set_iter(lmset);
+         itor; ++i, itor = ngram_model_set_iter_next(itor)) {
+        char const *lmname;
+        lms[i] = ngram_model_copy(ngram_model_set_iter_model(itor, &lmname));
+        names[i] = (char *)lmname;
+        if (lms[i] == NULL) {
+            ngram_model_set_iter_free(itor);
+            n_models = i;
+            lmset = NULL;
+            goto done;
+        }
+    }
+    lmset = ngram_model_set_init(config, lms, names, NULL, n_models);
+    /* Score with the same weights or selected model as the original. */
+    if (lmset && ngram_model_set_interp_copy(lmset,
+                                             ((ngram_search_t *)other)->lmset)
+        == NULL) {
+        ngram_model_free(lmset);
+        lmset = NULL;
+    }
+
+done:
+    /* The set retains its models. */
+    for (i = 0; i < n_models; ++i)
+        ngram_model_free(lms[i]);
+    ckd_free(lms);
+    ckd_free(names);
+    if (lmset == NULL)
+        return NULL;
+    return ngram_search_init_lmset(name, lmset, config, acmod, dict, d2p);
+}
+
 static int
 ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 {
@@ -269,8 +389,9 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     /* Update beam widths. */
     ngram_search_calc_beams(ngs);
 
-    /* Update word mappings. */
+    /* Update word mappings, which invalidates any cached scores. */
     ngram_search_update_widmap(ngs);
+    ngram_search_lm_flush(ngs);
 
     /* Now rebuild lextrees. */
     if (ngs->fwdtree) {
@@ -305,6 +426,8 @@ ngram_search_free(ps_search_t *search)
                ngs->bestpath_perf.t_tot_elapsed,
                ngs->bestpath_perf.t_tot_elapsed / n_speech);
     }
+    E_INFO("TOTAL %d language model scores cached, %d looked up\n",
+           ngs->n_tot_lm_cache_hit, ngs->n_tot_lm_cache_miss);
 
     ps_search_base_free(search);
     hmm_context_free(ngs->hmmctx);
@@ -312,9 +435,13 @@ ngram_search_free(ps_search_t *search)
     listelem_alloc_free(ngs->root_chan_alloc);
     listelem_alloc_free(ngs->latnode_alloc);
     ngram_model_free(ngs->lmset);
+    ckd_free(ngs->lm_cache);
 
     ckd_free(ngs->word_chan);
     ckd_free(ngs->word_lat_idx);
+    ckd_free(ngs->stable_str);
+    ckd_free(ngs->live_bp);
+    ckd_free(ngs->live_frame);
     bitvec_free(ngs->word_active);
     ckd_free(ngs->bp_table);
     ckd_free(ngs->bscore_stack);
@@ -551,20 +678,24 @@ ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
 {
     ps_search_t *base = ps_search_base(ngs);
     char *c;
-    size_t len;
+    size_t len, stable_len;
     int bp;
 
     if (bpidx == NO_BP)
         return NULL;
 
+    /* Only trace back as far as the stable prefix, if there is one. */
     bp = bpidx;
     len = 0;
-    while (bp != NO_BP) {
+    while (bp != NO_BP && bp != ngs->stable_bp) {
         bptbl_t *be = &ngs->bp_table[bp];
         bp = be->bp;
         if (dict_real_word(ps_search_dict(ngs), be->wid))
             len += strlen(dict_basestr(ps_search_dict(ngs), be->wid)) + 1;
     }
+    stable_len = (bp == ngs->stable_bp) ? ngs->stable_len : 0;
+    if (stable_len > 0)
+        len += stable_len + 1;
 
     ckd_free(base->hyp_str);
     if (len == 0) {
@@ -572,10 +703,12 @@ ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
 	return base->hyp_str;
     }
     base->hyp_str = ckd_calloc(1, len);
+    if (stable_len > 0)
+        memcpy(base->hyp_str, ngs->stable_str, stable_len);
 
     bp = bpidx;
     c = base->hyp_str + len - 1;
-    while (bp != NO_BP) {
+    while (bp != NO_BP && bp != ngs->stable_bp) {
         bptbl_t *be = &ngs->bp_table[bp];
         size_t len;
 
@@ -723,13 +856,371 @@ ngram_compute_seg_score(ngram_search_t *ngs, bptbl_t *be, float32 lwf,
     *out_ascr = be->score - start_score - *out_lscr;
 }
 
+void
+ngram_search_hmm_history(ngram_search_t *ngs, hmm_t *hmm,
+                         ngram_history_func_t func, void *udata)
+{
+    int i;
+
+    for (i = 0; i < hmm_n_emit_state(hmm); ++i)
+        (*func)(ngs, &hmm_history(hmm, i), hmm_score(hmm, i), udata);
+    (*func)(ngs, &hmm_out_history(hmm), hmm_out_score(hmm), udata);
+}
+
+static void
+ngram_search_foreach_history(ngram_search_t *ngs,
+                             ngram_history_func_t func, void *udata)
+{
+    if (ngs->fwdtree)
+        ngram_fwdtree_foreach_history(ngs, func, udata);
+    else if (ngs->fwdflat)
+        ngram_fwdflat_foreach_history(ngs, func, udata);
+}
+
+static void
+ngram_search_reset_stable(ngram_search_t *ngs)
+{
+    ngs->stable_bp = NO_BP;
+    ngs->stable_len = 0;
+    ngs->n_stable_word = 0;
+}
+
+static void
+mark_live_history(ngram_search_t *ngs, int32 *bp, int32 score, void *udata)
+{
+    int *root = (int *)udata;
+
+    if (!(score BETTER_THAN WORST_SCORE))
+        return;
+    if (*bp == NO_BP)
+        *root = TRUE;
+    else {
+        ngs->live_frame[ngs->bp_table[*bp].frame] = TRUE;
+        ngs->live_bp[*bp] = TRUE;
+    }
+}
+
+/*
+ * Flag the backpointer entries from lo onwards which live paths can
+ * still be extended from or end in, in live_bp.
+ *
+ * A new word can attach to any valid entry in the end frame of a
+ * live history (see last_phone_transition()), so all of those count,
+ * as do the entries from which a hypothesis can currently be read.
+ *
+ * @return FALSE if some live path has no predecessor at all.
+ */
+static int
+ngram_search_mark_live(ngram_search_t *ngs, int32 lo)
+{
+    int root;
+    int32 lo_frame, f, bp;
+
+    if (ngs->live_bp_size < ngs->bp_table_size) {
+        ckd_free(ngs->live_bp);
+        ngs->live_bp_size = ngs->bp_table_size;
+        ngs->live_bp = ckd_calloc(ngs->live_bp_size, sizeof(*ngs->live_bp));
+    }
+    if (ngs->live_frame_size < ngs->n_frame_alloc) {
+        ckd_free(ngs->live_frame);
+        ngs->live_frame_size = ngs->n_frame_alloc;
+        ngs->live_frame = ckd_calloc(ngs->live_frame_size,
+                                     sizeof(*ngs->live_frame));
+    }
+    lo_frame = (lo == 0) ? 0 : ngs->bp_table[lo].frame;
+    memset(ngs->live_frame + lo_frame, 0, ngs->n_frame - lo_frame);
+    memset(ngs->live_bp + lo, 0, ngs->bpidx - lo);
+
+    if ((bp = ngram_search_find_exit(ngs, -1, NULL)) != NO_BP) {
+        for (f = ngs->bp_table[bp].frame; f < ngs->n_frame; ++f)
+            ngs->live_frame[f] = TRUE;
+    }
+    root = FALSE;
+    ngram_search_foreach_history(ngs, mark_live_history, &root);
+
+    for (f = lo_frame; f < ngs->n_frame; ++f) {
+        int32 end;
+
+        if (!ngs->live_frame[f])
+            continue;
+        end = (f == ngs->n_frame - 1) ? ngs->bpidx : ngs->bp_table_idx[f + 1];
+        for (bp = ngs->bp_table_idx[f]; bp < end; ++bp) {
+            if (bp >= lo && ngs->bp_table[bp].valid)
+                ngs->live_bp[bp] = TRUE;
+        }
+    }
+    return !root;
+}
+
+/*
+ * Advance stable_bp to the last backpointer entry which every path
+ * still alive in the search passes through, and append the words
+ * leading up to it to stable_str.
+ *
+ * The common ancestor of the live entries is found by walking back
+ * from the newest one until only one path remains.  Only the part of
+ * the table after the previous stable_bp is ever examined.
+ */
+static void
+ngram_search_update_stable(ngram_search_t *ngs)
+{
+    int32 lo, bp, n_live, lca, n_word;
+    size_t len, total;
+    char *c;
+
+    if (ngram_search_find_exit(ngs, -1, NULL) == NO_BP)
+        return;
+    lo = (ngs->stable_bp == NO_BP) ? 0 : ngs->stable_bp;
+    if (!ngram_search_mark_live(ngs, lo))
+        return;
+    n_live = 0;
+    for (bp = lo; bp < ngs->bpidx; ++bp)
+        n_live += ngs->live_bp[bp];
+
+    /* Replace each live entry with its predecessor, newest first. */
+    lca = NO_BP;
+    for (bp = ngs->bpidx - 1; bp >= lo && n_live > 0; --bp) {
+        int32 prev;
+
+        if (!ngs->live_bp[bp])
+            continue;
+        if (n_live == 1) {
+            lca = bp;
+            break;
+        }
+        --n_live;
+        prev = ngs->bp_table[bp].bp;
+        if (prev < lo)
+            break;
+        if (!ngs->live_bp[prev]) {
+            ngs->live_bp[prev] = TRUE;
+            ++n_live;
+        }
+    }
+    if (lca == NO_BP || lca == ngs->stable_bp)
+        return;
+
+    /* Append the newly stable words. */
+    len = 0;
+    n_word = 0;
+    for (bp = lca; bp != ngs->stable_bp; bp = ngs->bp_table[bp].bp) {
+        if (dict_real_word(ps_search_dict(ngs), ngs->bp_table[bp].wid)) {
+            len += strlen(dict_basestr(ps_search_dict(ngs),
+                                       ngs->bp_table[bp].wid)) + 1;
+            ++n_word;
+        }
+    }
+    if (n_word > 0) {
+        total = (ngs->stable_len > 0) ? ngs->stable_len + len : len - 1;
+        if (total + 1 > ngs->stable_alloc) {
+            ngs->stable_alloc = (total + 1) * 2;
+            ngs->stable_str = ckd_realloc(ngs->stable_str, ngs->stable_alloc);
+        }
+        c = ngs->stable_str + total;
+        *c = '\0';
+        for (bp = lca; bp != ngs->stable_bp; bp = ngs->bp_table[bp].bp) {
+            bptbl_t *be = &ngs->bp_table[bp];
+
+            if (dict_real_word(ps_search_dict(ngs), be->wid)) {
+                len = strlen(dict_basestr(ps_search_dict(ngs), be->wid));
+                c -= len;
+                memcpy(c, dict_basestr(ps_search_dict(ngs), be->wid), len);
+                if (c > ngs->stable_str) {
+                    --c;
+                    *c = ' ';
+                }
+            }
+        }
+        ngs->stable_len = total;
+        ngs->n_stable_word += n_word;
+    }
+    ngs->stable_bp = lca;
+}
+
+static char const *
+ngram_search_partial_hyp(ps_search_t *search, int32 *out_n_stable)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+
+    ngram_search_update_stable(ngs);
+    if (out_n_stable)
+        *out_n_stable = ngs->n_stable_word;
+    return ngram_search_bp_hyp(ngs, ngram_search_find_exit(ngs, -1, NULL));
+}
+
+/*
+ * Histories are renumbered in two steps, since an HMM may be visited
+ * more than once: first to negative values below NO_BP, then back.
+ * Pruned states are never extended, and may still hold entries from
+ * before an earlier renumbering, so their history is simply dropped.
+ */
+static void
+remap_history(ngram_search_t *ngs, int32 *bp, int32 score, void *udata)
+{
+    int32 *perm = (int32 *)udata;
+
+    if (*bp < 0)
+        return;
+    if (score BETTER_THAN WORST_SCORE && perm[*bp] != NO_BP)
+        *bp = NO_BP - 1 - perm[*bp];
+    else
+        *bp = NO_BP;
+}
+
+static void
+remap_history_done(ngram_search_t *ngs, int32 *bp, int32 score, void *udata)
+{
+    if (*bp < NO_BP)
+        *bp = NO_BP - 1 - *bp;
+}
+
+/*
+ * Compact the backpointer table and score stack down to the entries
+ * flagged in live_bp, and renumber everything that refers to them.
+ *
+ * @return Number of entries removed.
+ */
+static int32
+ngram_search_compact(ngram_search_t *ngs)
+{
+    int32 *perm;
+    int32 src, dest, s_idx, n, f, w;
+
+    perm = ckd_calloc(ngs->bpidx, sizeof(*perm));
+    s_idx = 0;
+    for (src = dest = 0; src < ngs->bpidx; ++src) {
+        bptbl_t *be = &ngs->bp_table[src];
+
+        if (!ngs->live_bp[src]) {
+            perm[src] = NO_BP;
+            continue;
+        }
+        if (be->s_idx != -1) {
+            int32 rcsize = dict2pid_rssid(ps_search_dict2pid(ngs),
+                                          be->last_phone,
+                                          be->last2_phone)->n_ssid;
+            memmove(ngs->bscore_stack + s_idx, ngs->bscore_stack + be->s_idx,
+                    rcsize * sizeof(*ngs->bscore_stack));
+            be->s_idx = s_idx;
+            s_idx += rcsize;
+        }
+        perm[src] = dest;
+        ngs->bp_table[dest++] = *be;
+    }
+    for (src = 0; src < dest; ++src) {
+        bptbl_t *be = &ngs->bp_table[src];
+
+        if (be->bp != NO_BP)
+            be->bp = perm[be->bp];
+    }
+    /* The first surviving entry of each frame. */
+    for (f = -1, src = n = 0; f < ngs->n_frame; ++f) {
+        for (; src < ngs->bp_table_idx[f]; ++src)
+            if (perm[src] != NO_BP)
+                ++n;
+        ngs->bp_table_idx[f] = n;
+    }
+    ngram_search_foreach_history(ngs, remap_history, perm);
+    ngram_search_foreach_history(ngs, remap_history_done, NULL);
+    for (w = 0; w < ps_search_n_words(ngs); ++w) {
+        last_ltrans_t *lt = &ngs->last_ltrans[w];
+
+        if (lt->sf == -1)
+            continue;
+        if (lt->bp < 0 || lt->bp >= ngs->bpidx || perm[lt->bp] == NO_BP)
+            lt->sf = -1;
+        else
+            lt->bp = perm[lt->bp];
+    }
+    if (ngs->stable_bp != NO_BP)
+        ngs->stable_bp = perm[ngs->stable_bp];
+    ckd_free(perm);
+
+    n = ngs->bpidx - dest;
+    ngs->bpidx = dest;
+    ngs->bss_head = s_idx;
+    return n;
+}
+
+static int
+ngram_search_release(ps_search_t *search)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+    int32 n;
+
+    /* The stable entry itself stays, as the root of all live paths. */
+    if (ngs->done || ngs->stable_bp == NO_BP || ngs->stable_bp == 0)
+        return 0;
+    if (ngs->live_bp_size < ngs->bp_table_size) {
+        ckd_free(ngs->live_bp);
+        ngs->live_bp_size = ngs->bp_table_size;
+        ngs->live_bp = ckd_calloc(ngs->live_bp_size, sizeof(*ngs->live_bp));
+    }
+    memset(ngs->live_bp, FALSE, ngs->stable_bp);
+    memset(ngs->live_bp + ngs->stable_bp, TRUE, ngs->bpidx - ngs->stable_bp);
+    n = ngram_search_compact(ngs);
+    ngs->n_bp_released += n;
+    E_DEBUG("Released %d backpointer entries, %d remain\n", n, ngs->bpidx);
+    return n;
+}
+
+/*
+ * Retire the backpointer entries which no live path can reach any
+ * more, i.e. the dead ends of the search, keeping the ones on paths
+ * which may still become part of the hypothesis.  The table is
+ * collected between frames once it is three quarters full, and grown
+ * if less than half of it could be freed, so the cost is amortized.
+ */
+static void
+ngram_search_gc(ngram_search_t *ngs)
+{
+    int32 bp, n;
+
+    if (ngs->bpidx < ngs->bp_table_size / 4 * 3
+        && ngs->bss_head < ngs->bscore_stack_size / 4 * 3)
+        return;
+
+    ngram_search_mark_live(ngs, 0);
+    for (bp = ngs->bpidx - 1; bp >= 0; --bp) {
+        if (ngs->live_bp[bp] && ngs->bp_table[bp].bp != NO_BP) {
+            assert(ngs->bp_table[bp].bp < bp);
+            ngs->live_bp[ngs->bp_table[bp].bp] = TRUE;
+        }
+    }
+    n = ngram_search_compact(ngs);
+    ngs->n_bp_retired += n;
+    E_INFO("Frame %d: retired %d backpointer entries, "
+           "%d (%d KiB) in use\n", ngs->n_frame, n, ngs->bpidx,
+           (int)((ngs->bpidx * sizeof(*ngs->bp_table)
+                  + ngs->bss_head * sizeof(*ngs->bscore_stack)) / 1024));
+
+    if (ngs->bpidx >= ngs->bp_table_size / 2) {
+        ngs->bp_table_size *= 2;
+        ngs->bp_table = ckd_realloc(ngs->bp_table,
+                                    ngs->bp_table_size
+                                    * sizeof(*ngs->bp_table));
+        E_INFO("Resized backpointer table to %d entries\n", ngs->bp_table_size);
+    }
+    if (ngs->bss_head >= ngs->bscore_stack_size / 2) {
+        ngs->bscore_stack_size *= 2;
+        ngs->bscore_stack = ckd_realloc(ngs->bscore_stack,
+                                        ngs->bscore_stack_size
+                                        * sizeof(*ngs->bscore_stack));
+        E_INFO("Resized score stack to %d entries\n", ngs->bscore_stack_size);
+    }
+}
+
 static int
 ngram_search_start(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     ngs->done = FALSE;
+    ngs->n_bp_released = 0;
+    ngs->n_bp_retired = 0;
+    ngram_search_reset_stable(ngs);
     ngram_model_flush(ngs->lmset);
+    ngram_search_lm_flush(ngs);
     if (ngs->fwdtree)
         ngram_fwdtree_start(ngs);
     else if (ngs->fwdflat)
@@ -743,13 +1234,24 @@ static int
 ngram_search_step(ps_search_t *search, int frame_idx)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
+    int32 kib;
+    int nfr;
 
+    if (ngs->bp_gc)
+        ngram_search_gc(ngs);
     if (ngs->fwdtree)
-        return ngram_fwdtree_search(ngs, frame_idx);
+        nfr = ngram_fwdtree_search(ngs, frame_idx);
     else if (ngs->fwdflat)
-        return ngram_fwdflat_search(ngs, frame_idx);
+        nfr = ngram_fwdflat_search(ngs, frame_idx);
     else
         return -1;
+
+    /* Keep track of the memory used by the backpointer table. */
+    kib = (int32)((ngs->bpidx * sizeof(*ngs->bp_table)
+                   + ngs->bss_head * sizeof(*ngs->bscore_stack)) / 1024);
+    if (kib > ngs->st.n_bp_kib_max)
+        ngs->st.n_bp_kib_max = kib;
+    return nfr;
 }
 
 void
@@ -794,12 +1296,17 @@ ngram_search_finish(ps_search_t *search)
         /* dump_bptable(ngs); */
 
         /* Now do fwdflat search in its entirety, if requested. */
-        if (ngs->fwdflat) {
+        if (ngs->fwdflat && !ngram_search_bp_complete(ngs)) {
+            E_WARN("Skipping fwdflat search, part of the backpointer "
+                   "table has been released\n");
+        }
+        else if (ngs->fwdflat) {
             int i;
             /* Rewind the acoustic model. */
             if (acmod_rewind(ps_search_acmod(ngs)) < 0)
                 return -1;
-            /* Now redo search. */
+            /* Now redo search, which rebuilds the backpointer table. */
+            ngram_search_reset_stable(ngs);
             ngram_fwdflat_start(ngs);
             i = 0;
             while (ps_search_acmod(ngs)->n_feat_frame > 0) {
@@ -851,7 +1358,7 @@ ngram_search_hyp(ps_search_t *search, int32 *out_score)
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     /* Only do bestpath search if the utterance is complete. */
-    if (ngs->bestpath && ngs->done) {
+    if (ngs->bestpath && ngs->done && ngram_search_bp_complete(ngs)) {
         ps_lattice_t *dag;
         ps_latlink_t *link;
         char const *hyp;
@@ -962,7 +1469,7 @@ static ps_seg_t *
 ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
 {
     bptbl_seg_t *itor;
-    int bp, cur;
+    int bp, cur, root;
 
     /* Calling this an "iterator" is a bit of a misnomer since we have
      * to get the entire backtrace in order to produce it.  On the
@@ -973,8 +1480,11 @@ ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
     itor->base.search = ps_search_base(ngs);
     itor->base.lwf = lwf;
     itor->n_bpidx = 0;
+    /* Words up to the first entry after a release were already
+     * reported, and their start frames are gone. */
+    root = ngs->n_bp_released ? 0 : NO_BP;
     bp = bpidx;
-    while (bp != NO_BP) {
+    while (bp != NO_BP && bp != root) {
         bptbl_t *be = &ngs->bp_table[bp];
         bp = be->bp;
         ++itor->n_bpidx;
@@ -986,7 +1496,7 @@ ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
     itor->bpidx = ckd_calloc(itor->n_bpidx, sizeof(*itor->bpidx));
     cur = itor->n_bpidx - 1;
     bp = bpidx;
-    while (bp != NO_BP) {
+    while (bp != NO_BP && bp != root) {
         bptbl_t *be = &ngs->bp_table[bp];
         itor->bpidx[cur] = bp;
         bp = be->bp;
@@ -1005,7 +1515,7 @@ ngram_search_seg_iter(ps_search_t *search)
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     /* Only do bestpath search if the utterance is done. */
-    if (ngs->bestpath && ngs->done) {
+    if (ngs->bestpath && ngs->done && ngram_search_bp_complete(ngs)) {
         ps_lattice_t *dag;
         ps_latlink_t *link;
         double n_speech;
@@ -1050,7 +1560,7 @@ ngram_search_prob(ps_search_t *search)
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     /* Only do bestpath search if the utterance is done. */
-    if (ngs->bestpath && ngs->done) {
+    if (ngs->bestpath && ngs->done && ngram_search_bp_complete(ngs)) {
         ps_lattice_t *dag;
         ps_latlink_t *link;
 
@@ -1224,6 +1734,12 @@ ngram_search_lattice(ps_search_t *search)
     ngs = (ngram_search_t *)search;
     min_endfr = cmd_ln_int32_r(ps_search_config(search), "-min_endfr");
 
+    if (!ngram_search_bp_complete(ngs)) {
+        E_ERROR("Cannot build a lattice, part of the backpointer "
+                "table has been released\n");
+        return NULL;
+    }
+
     /* If the best score is WORST_SCORE or worse, there is no way to
      * make a lattice. */
     if (ngs->best_score == WORST_SCORE || ngs->best_score WORSE_THAN WORST_SCORE)
@@ -174,6 +174,24 @@ typedef struct bestbp_rc_s {
 
 #define NO_BP		-1
 
+/**
+ * Number of entries in the language model score cache, as a power of
+ * two.
+ */
+#define NGRAM_LM_CACHE_BITS 12
+#define NGRAM_LM_CACHE_SIZE (1 << NGRAM_LM_CACHE_BITS)
+
+/**
+ * Entry in the language model score cache, holding a previously
+ * computed score for a word in a given trigram history.
+ */
+typedef struct ngram_lm_cache_s {
+    int32 wid;                  /**< Base word ID, or -1 if unused */
+    int32 hist[2];              /**< Previous word, then the one before */
+    int32 lscr;                 /**< Score from ngram_tg_score() */
+    int32 n_used;
+} ngram_lm_cache_t;
+
 /**
  * Various statistics for profiling.
  */
@@ -188,6 +206,9 @@ typedef struct ngram_search_stats_s {
     int32 n_fwdflat_words;
     int32 n_fwdflat_word_transition;
     int32 n_senone_active_utt;
+    int32 n_bp_kib_max; /**< Largest size of the backpointer table in a frame. */
+    int32 n_lm_cache_hit;  /**< Language model scores found in lm_cache. */
+    int32 n_lm_cache_miss; /**< Language model scores looked up in lmset. */
 } ngram_search_stats_t;
 
 
@@ -197,12 +218,15 @@ typedef struct ngram_search_stats_s {
 struct ngram_search_s {
     ps_search_t base;
     ngram_model_t *lmset;  /**< Set of language models. */
+    ngram_lm_cache_t *lm_cache; /**< Recent scores from lmset. */
     hmm_context_t *hmmctx; /**< HMM context. */
+    hmm_pool_t *hmm_pool;  /**< Non-root HMMs being evaluated together. */
 
     /* Flags to quickly indicate which passes are enabled. */
     uint8 fwdtree;
     uint8 fwdflat;
     uint8 bestpath;
+    uint8 bp_gc;     /**< Garbage collect the backpointer table. */
 
     /* State of procesing. */
     uint8 done;
@@ -274,6 +298,13 @@ struct ngram_search_s {
      */
     chan_t ***active_chan_list;
     int32 n_active_chan[2];  /**< Number entries in active_chan_list */
+    /**
+     * Array of active root channels for current and next frame,
+     * similarly to active_chan_list, so that the root channels do
+     * not all have to be checked in every frame.
+     */
+    root_chan_t ***active_root_list;
+    int32 n_active_root[2];  /**< Number entries in active_root_list */
     /**
      * Array of active multi-phone words for current and next frame.
      *
@@ -310,6 +341,22 @@ struct ngram_search_s {
     int32 *word_lat_idx; /* BPTable index for any word in current frame;
                             cleared before each frame */
 
+    /*
+     * Stable prefix of the partial hypothesis, i.e. the words which
+     * all paths still alive in the search have in common.
+     */
+    int32 stable_bp;      /**< Last entry shared by all live paths, or NO_BP. */
+    char *stable_str;     /**< Words up to and including stable_bp. */
+    size_t stable_len;    /**< Length of stable_str. */
+    size_t stable_alloc;  /**< Allocated size of stable_str. */
+    int32 n_stable_word;  /**< Number of words in stable_str. */
+    int32 n_bp_released;  /**< Entries released from the front of bp_table. */
+    int32 n_bp_retired;   /**< Entries removed by garbage collection. */
+    uint8 *live_bp;       /**< Scratch flags for bp_table entries. */
+    int32 live_bp_size;   /**< Number of entries in live_bp. */
+    uint8 *live_frame;    /**< Scratch flags for frames. */
+    int32 live_frame_size; /**< Number of entries in live_frame. */
+
     /*
      * Flat lexicon (2nd pass) search stuff.
      */
@@ -337,6 +384,8 @@ struct ngram_search_s {
     ptmr_t fwdflat_perf;
     ptmr_t bestpath_perf;
     int32 n_tot_frame;
+    int32 n_tot_lm_cache_hit;  /**< Cache hits in all utterances. */
+    int32 n_tot_lm_cache_miss; /**< Cache misses in all utterances. */
 
     /* A collection of beam widths. */
     int32 beam;
@@ -357,6 +406,15 @@ struct ngram_search_s {
 };
 typedef struct ngram_search_s ngram_search_t;
 
+/**
+ * Function called on the path history of an HMM state.
+ *
+ * @param bp Pointer to the history, which may be modified.
+ * @param score Path score of the state.
+ */
+typedef void (*ngram_history_func_t)(ngram_search_t *ngs, int32 *bp,
+                                     int32 score, void *udata);
+
 /**
  * Initialize the N-Gram search module.
  */
@@ -367,11 +425,34 @@ ps_search_t *ngram_search_init(const char *name,
                                dict_t *dict,
                                dict2pid_t *d2p);
 
+/**
+ * Create an N-Gram search module with copies of the language models
+ * of an existing one, with the same model selected.
+ */
+ps_search_t *ngram_search_copy(const char *name,
+                               ps_search_t *other,
+                               cmd_ln_t *config,
+                               acmod_t *acmod,
+                               dict_t *dict,
+                               dict2pid_t *d2p);
+
 /**
  * Finalize the N-Gram search module.
  */
 void ngram_search_free(ps_search_t *ngs);
 
+/**
+ * Get the language model score of a word in a trigram history.
+ *
+ * The search asks for the same few histories over and over, so
+ * recent answers are remembered in a cache which belongs to this
+ * search and is emptied at the start of each utterance.
+ *
+ * @return Score as from ngram_tg_score().
+ */
+int32 ngram_search_lm_score(ngram_search_t *ngs, int32 w,
+                            int32 h1, int32 h2, int32 *n_used);
+
 /**
  * Record the current frame's index in the backpointer table.
  *
@@ -409,6 +490,12 @@ int ngram_search_find_exit(ngram_search_t *ngs, int frame_idx, int32 *out_best_s
  */
 char const *ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx);
 
+/**
+ * Call a function on the path histories of an active HMM.
+ */
+void ngram_search_hmm_history(ngram_search_t *ngs, hmm_t *hmm,
+                              ngram_history_func_t func, void *udata);
+
 /**
  * Compute language and acoustic scores for backpointer table entries.
  */
@@ -414,6 +414,9 @@ ngram_fwdflat_start(ngram_search_t *ngs)
     ngs->st.n_fwdflat_words = 0;
     ngs->st.n_fwdflat_word_transition = 0;
     ngs->st.n_senone_active_utt = 0;
+    ngs->st.n_bp_kib_max = 0;
+    ngs->st.n_lm_cache_hit = 0;
+    ngs->st.n_lm_cache_miss = 0;
 }
 
 static void
@@ -702,11 +705,11 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
                 continue;
             /* FIXME: Floating point... */
             newscore += lwf
-                * (ngram_tg_score(ngs->lmset,
-                                  dict_basewid(dict, w),
-                                  bp->real_wid,
-                                  bp->prev_real_wid,
-                                  &n_used) >> SENSCR_SHIFT);
+                * (ngram_search_lm_score(ngs,
+                                         dict_basewid(dict, w),
+                                         bp->real_wid,
+                                         bp->prev_real_wid,
+                                         &n_used) >> SENSCR_SHIFT);
             newscore += pip;
 
             /* Enter the next word */
@@ -944,8 +947,13 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
     if (cf > 0) {
         double n_speech = (double)(cf + 1)
             / cmd_ln_int32_r(ps_search_config(ngs), "-frate");
+        int32 n_words = ngs->bpidx + ngs->n_bp_retired + ngs->n_bp_released;
+
         E_INFO("%8d words recognized (%d/fr)\n",
-               ngs->bpidx, (ngs->bpidx + (cf >> 1)) / (cf + 1));
+               n_words, (n_words + (cf >> 1)) / (cf + 1));
+        if (ngs->bp_gc)
+            E_INFO("%8d words retired, at most %d KiB in use\n",
+                   ngs->n_bp_retired, ngs->st.n_bp_kib_max);
         E_INFO("%8d senones evaluated (%d/fr)\n", ngs->st.n_senone_active_utt,
                (ngs->st.n_senone_active_utt + (cf >> 1)) / (cf + 1));
         E_INFO("%8d channels searched (%d/fr)\n",
@@ -955,6 +963,8 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
         E_INFO("%8d word transitions (%d/fr)\n",
                ngs->st.n_fwdflat_word_transition,
                ngs->st.n_fwdflat_word_transition / (cf + 1));
+        E_INFO("%8d language model scores cached, %d looked up\n",
+               ngs->st.n_lm_cache_hit, ngs->st.n_lm_cache_miss);
         E_INFO("fwdflat %.2f CPU %.3f xRT\n",
                ngs->fwdflat_perf.t_cpu,
                ngs->fwdflat_perf.t_cpu / n_speech);
@@ -962,4 +972,28 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
                ngs->fwdflat_perf.t_elapsed,
                ngs->fwdflat_perf.t_elapsed / n_speech);
     }
+    ngs->n_tot_lm_cache_hit += ngs->st.n_lm_cache_hit;
+    ngs->n_tot_lm_cache_miss += ngs->st.n_lm_cache_miss;
+}
+
+void
+ngram_fwdflat_foreach_history(ngram_search_t *ngs,
+                              ngram_history_func_t func, void *udata)
+{
+    root_chan_t *rhmm;
+    chan_t *hmm;
+    int32 i, nw, nf, *awl;
+
+    nf = ngs->n_frame;
+    nw = ngs->n_active_word[nf & 0x1];
+    awl = ngs->active_word_list[nf & 0x1];
+    for (i = 0; i < nw; i++) {
+        rhmm = (root_chan_t *) ngs->word_chan[*(awl++)];
+        if (hmm_frame(&rhmm->hmm) == nf)
+            ngram_search_hmm_history(ngs, &rhmm->hmm, func, udata);
+        for (hmm = rhmm->next; hmm; hmm = hmm->next) {
+            if (hmm_frame(&hmm->hmm) == nf)
+                ngram_search_hmm_history(ngs, &hmm->hmm, func, udata);
+        }
+    }
 }
@@ -77,5 +77,13 @@ int ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx);
  */
 void ngram_fwdflat_finish(ngram_search_t *ngs);
 
+/**
+ * Visit the path histories of all HMMs active in the next frame.
+ *
+ * An HMM may be visited more than once.
+ */
+void ngram_fwdflat_foreach_history(ngram_search_t *ngs,
+                                   ngram_history_func_t func, void *udata);
+
 
 #endif /* __NGRAM_SEARCH_FWDFLAT_H__ */
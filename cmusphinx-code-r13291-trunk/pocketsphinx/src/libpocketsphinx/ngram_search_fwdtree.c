@@ -124,6 +124,8 @@ init_search_tree(ngram_search_t *ngs)
         ngs->root_chan[i].penult_phn_wid = -1;
         ngs->root_chan[i].next = NULL;
     }
+    ngs->active_root_list = ckd_calloc_2d(2, ngs->n_root_chan_alloc,
+                                          sizeof(**ngs->active_root_list));
 
     /* Permanently allocate and initialize channels for single-phone
      * words (1/word). */
@@ -385,6 +387,7 @@ ngram_fwdtree_init(ngram_search_t *ngs)
                                 sizeof(*ngs->bestbp_rc));
     ngs->lastphn_cand = ckd_calloc(ps_search_n_words(ngs),
                                    sizeof(*ngs->lastphn_cand));
+    ngs->hmm_pool = hmm_pool_init();
     init_search_tree(ngs);
     create_search_channels(ngs);
 }
@@ -412,6 +415,8 @@ deinit_search_tree(ngram_search_t *ngs)
     ngs->n_root_chan_alloc = 0;
     ckd_free(ngs->root_chan);
     ngs->root_chan = NULL;
+    ckd_free_2d(ngs->active_root_list);
+    ngs->active_root_list = NULL;
     ckd_free(ngs->single_phone_wid);
     ngs->single_phone_wid = NULL;
     ckd_free(ngs->homophone_set);
@@ -445,6 +450,8 @@ ngram_fwdtree_deinit(ngram_search_t *ngs)
     ngs->bestbp_rc = NULL;
     ckd_free(ngs->lastphn_cand);
     ngs->lastphn_cand = NULL;
+    hmm_pool_free(ngs->hmm_pool);
+    ngs->hmm_pool = NULL;
 }
 
 int
@@ -490,6 +497,7 @@ ngram_fwdtree_start(ngram_search_t *ngs)
         ngs->word_lat_idx[i] = NO_BP;
 
     /* Reset active HMM and word lists. */
+    ngs->n_active_root[0] = ngs->n_active_root[1] = 0;
     ngs->n_active_chan[0] = ngs->n_active_chan[1] = 0;
     ngs->n_active_word[0] = ngs->n_active_word[1] = 0;
 
@@ -527,17 +535,17 @@ ngram_fwdtree_start(ngram_search_t *ngs)
 static void
 compute_sen_active(ngram_search_t *ngs, int frame_idx)
 {
-    root_chan_t *rhmm;
+    root_chan_t *rhmm, **arl;
     chan_t *hmm, **acl;
     int32 i, w, *awl;
 
     acmod_clear_active(ps_search_acmod(ngs));
 
     /* Flag active senones for root channels */
-    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
-        if (hmm_frame(&rhmm->hmm) == frame_idx)
-            acmod_activate_hmm(ps_search_acmod(ngs), &rhmm->hmm);
-    }
+    i = ngs->n_active_root[frame_idx & 0x1];
+    arl = ngs->active_root_list[frame_idx & 0x1];
+    for (; i > 0; --i, arl++)
+        acmod_activate_hmm(ps_search_acmod(ngs), &(*arl)->hmm);
 
     /* Flag active senones for nonroot channels in HMM tree */
     i = ngs->n_active_chan[frame_idx & 0x1];
@@ -566,16 +574,15 @@ compute_sen_active(ngram_search_t *ngs, int frame_idx)
 static void
 renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
 {
-    root_chan_t *rhmm;
+    root_chan_t *rhmm, **arl;
     chan_t *hmm, **acl;
     int32 i, w, *awl;
 
     /* Renormalize root channels */
-    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
-        if (hmm_frame(&rhmm->hmm) == frame_idx) {
-            hmm_normalize(&rhmm->hmm, norm);
-        }
-    }
+    i = ngs->n_active_root[frame_idx & 0x1];
+    arl = ngs->active_root_list[frame_idx & 0x1];
+    for (; i > 0; --i, arl++)
+        hmm_normalize(&(*arl)->hmm, norm);
 
     /* Renormalize nonroot channels in HMM tree */
     i = ngs->n_active_chan[frame_idx & 0x1];
@@ -606,17 +613,19 @@ renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
 static int32
 eval_root_chan(ngram_search_t *ngs, int frame_idx)
 {
-    root_chan_t *rhmm;
+    root_chan_t **arl;
     int32 i, bestscore;
 
+    i = ngs->n_active_root[frame_idx & 0x1];
+    arl = ngs->active_root_list[frame_idx & 0x1];
     bestscore = WORST_SCORE;
-    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
-        if (hmm_frame(&rhmm->hmm) == frame_idx) {
-            int32 score = chan_v_eval(rhmm);
-            if (score BETTER_THAN bestscore)
-                bestscore = score;
-            ++ngs->st.n_root_chan_eval;
-        }
+    ngs->st.n_root_chan_eval += i;
+
+    for (; i > 0; --i, arl++) {
+        int32 score = chan_v_eval(*arl);
+        assert(hmm_frame(&(*arl)->hmm) == frame_idx);
+        if (score BETTER_THAN bestscore)
+            bestscore = score;
     }
     return (bestscore);
 }
@@ -629,15 +638,13 @@ eval_nonroot_chan(ngram_search_t *ngs, int frame_idx)
 
     i = ngs->n_active_chan[frame_idx & 0x1];
     acl = ngs->active_chan_list[frame_idx & 0x1];
-    bestscore = WORST_SCORE;
     ngs->st.n_nonroot_chan_eval += i;
 
     for (hmm = *(acl++); i > 0; --i, hmm = *(acl++)) {
-        int32 score = chan_v_eval(hmm);
         assert(hmm_frame(&hmm->hmm) == frame_idx);
-        if (score BETTER_THAN bestscore)
-            bestscore = score;
+        hmm_pool_add(ngs->hmm_pool, &hmm->hmm);
     }
+    bestscore = hmm_pool_eval(ngs->hmm_pool);
 
     return bestscore;
 }
@@ -650,7 +657,6 @@ eval_word_chan(ngram_search_t *ngs, int frame_idx)
     int32 i, w, bestscore, *awl, j, k;
 
     k = 0;
-    bestscore = WORST_SCORE;
     awl = ngs->active_word_list[frame_idx & 0x1];
 
     i = ngs->n_active_word[frame_idx & 0x1];
@@ -660,18 +666,12 @@ eval_word_chan(ngram_search_t *ngs, int frame_idx)
         assert(ngs->word_chan[w] != NULL);
 
         for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next) {
-            int32 score;
-
             assert(hmm_frame(&hmm->hmm) == frame_idx);
-            score = chan_v_eval(hmm);
-            /*printf("eval word chan %d score %d\n", w, score); */
-
-            if (score BETTER_THAN bestscore)
-                bestscore = score;
-
+            hmm_pool_add(ngs->hmm_pool, &hmm->hmm);
             k++;
         }
     }
+    bestscore = hmm_pool_eval(ngs->hmm_pool);
 
     /* Similarly for statically allocated single-phone words */
     j = 0;
@@ -723,7 +723,7 @@ evaluate_channels(ngram_search_t *ngs, int16 const *senone_scores, int frame_idx
 static void
 prune_root_chan(ngram_search_t *ngs, int frame_idx)
 {
-    root_chan_t *rhmm;
+    root_chan_t *rhmm, **arl, **narl;
     chan_t *hmm;
     int32 i, nf, w;
     int32 thresh, newphone_thresh, lastphn_thresh, newphone_score;
@@ -736,18 +736,21 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
     newphone_thresh = ngs->best_score + ngs->pbeam;
     lastphn_thresh = ngs->best_score + ngs->lpbeam;
     nacl = ngs->active_chan_list[nf & 0x1];
+    arl = ngs->active_root_list[frame_idx & 0x1];
+    narl = ngs->active_root_list[nf & 0x1];
     pls = (phone_loop_search_t *)ps_search_lookahead(ngs);
 
-    for (i = 0, rhmm = ngs->root_chan; i < ngs->n_root_chan; i++, rhmm++) {
+    for (i = ngs->n_active_root[frame_idx & 0x1]; i > 0; --i) {
+        rhmm = *(arl++);
         E_DEBUG("Root channel %d frame %d score %d thresh %d\n",
-                i, hmm_frame(&rhmm->hmm), hmm_bestscore(&rhmm->hmm), thresh);
-        /* First check if this channel was active in current frame */
-        if (hmm_frame(&rhmm->hmm) < frame_idx)
-            continue;
+                (int)(rhmm - ngs->root_chan), hmm_frame(&rhmm->hmm),
+                hmm_bestscore(&rhmm->hmm), thresh);
 
         if (hmm_bestscore(&rhmm->hmm) BETTER_THAN thresh) {
             hmm_frame(&rhmm->hmm) = nf;  /* rhmm will be active in next frame */
-            E_DEBUG("Preserving root channel %d score %d\n", i, hmm_bestscore(&rhmm->hmm));
+            *(narl++) = rhmm;
+            E_DEBUG("Preserving root channel %d score %d\n",
+                    (int)(rhmm - ngs->root_chan), hmm_bestscore(&rhmm->hmm));
             /* transitions out of this root channel */
             /* transition to all next-level channels in the HMM tree */
             newphone_score = hmm_out_score(&rhmm->hmm) + ngs->pip;
@@ -791,6 +794,7 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
         }
     }
     ngs->n_active_chan[nf & 0x1] = (int)(nacl - ngs->active_chan_list[nf & 0x1]);
+    ngs->n_active_root[nf & 0x1] = (int)(narl - ngs->active_root_list[nf & 0x1]);
 }
 
 /*
@@ -980,11 +984,11 @@ last_phone_transition(ngram_search_t *ngs, int frame_idx)
                     (ngs, bpe, dict_first_phone(ps_search_dict(ngs), candp->wid));
                 if (dscr BETTER_THAN WORST_SCORE) {
                     assert(!dict_filler_word(ps_search_dict(ngs), candp->wid));
-                    dscr += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(ps_search_dict(ngs), candp->wid),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+                    dscr += ngram_search_lm_score(ngs,
+                                                  dict_basewid(ps_search_dict(ngs), candp->wid),
+                                                  bpe->real_wid,
+                                                  bpe->prev_real_wid,
+                                                  &n_used)>>SENSCR_SHIFT;
                 }
 
                 if (dscr BETTER_THAN ngs->last_ltrans[candp->wid].dscr) {
@@ -1318,6 +1322,9 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         if (pl_newscore BETTER_THAN thresh) {
             if ((hmm_frame(&rhmm->hmm) < frame_idx)
                 || (newscore BETTER_THAN hmm_in_score(&rhmm->hmm))) {
+                if (hmm_frame(&rhmm->hmm) != nf)
+                    ngs->active_root_list[nf & 0x1]
+                        [ngs->n_active_root[nf & 0x1]++] = rhmm;
                 hmm_enter(&rhmm->hmm, newscore,
                           bestbp_rc_ptr->path, nf);
                 /* DICT2PID: Another place where mpx ssids are entered. */
@@ -1350,11 +1357,11 @@ word_transition(ngram_search_t *ngs, int frame_idx)
             E_DEBUG("initial newscore for %s: %d\n",
                     dict_wordstr(dict, w), newscore);
             if (newscore != WORST_SCORE)
-                newscore += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(dict, w),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+                newscore += ngram_search_lm_score(ngs,
+                                                  dict_basewid(dict, w),
+                                                  bpe->real_wid,
+                                                  bpe->prev_real_wid,
+                                                  &n_used)>>SENSCR_SHIFT;
 
             /* FIXME: Not sure how WORST_SCORE could be better, but it
              * apparently happens. */
@@ -1432,13 +1439,15 @@ word_transition(ngram_search_t *ngs, int frame_idx)
 static void
 deactivate_channels(ngram_search_t *ngs, int frame_idx)
 {
-    root_chan_t *rhmm;
+    root_chan_t *rhmm, **arl;
     int i;
 
     /* Clear score[] of pruned root channels */
-    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
-        if (hmm_frame(&rhmm->hmm) == frame_idx) {
-            hmm_clear(&rhmm->hmm);
+    i = ngs->n_active_root[frame_idx & 0x1];
+    arl = ngs->active_root_list[frame_idx & 0x1];
+    for (; i > 0; --i, arl++) {
+        if (hmm_frame(&(*arl)->hmm) == frame_idx) {
+            hmm_clear(&(*arl)->hmm);
         }
     }
     /* Clear score[] of pruned single-phone channels */
@@ -1546,8 +1555,13 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
     if (cf > 0) {
         double n_speech = (double)(cf + 1)
             / cmd_ln_int32_r(ps_search_config(ngs), "-frate");
+        int32 n_words = ngs->bpidx + ngs->n_bp_retired + ngs->n_bp_released;
+
         E_INFO("%8d words recognized (%d/fr)\n",
-               ngs->bpidx, (ngs->bpidx + (cf >> 1)) / (cf + 1));
+               n_words, (n_words + (cf >> 1)) / (cf + 1));
+        if (ngs->bp_gc)
+            E_INFO("%8d words retired, at most %d KiB in use\n",
+                   ngs->n_bp_retired, ngs->st.n_bp_kib_max);
         E_INFO("%8d senones evaluated (%d/fr)\n", ngs->st.n_senone_active_utt,
                (ngs->st.n_senone_active_utt + (cf >> 1)) / (cf + 1));
         E_INFO("%8d channels searched (%d/fr), %d 1st, %d last\n",
@@ -1559,6 +1573,8 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
                ngs->st.n_word_lastchan_eval / (cf + 1));
         E_INFO("%8d candidate words for entering last phone (%d/fr)\n",
                ngs->st.n_lastphn_cand_utt, ngs->st.n_lastphn_cand_utt / (cf + 1));
+        E_INFO("%8d language model scores cached, %d looked up\n",
+               ngs->st.n_lm_cache_hit, ngs->st.n_lm_cache_miss);
         E_INFO("fwdtree %.2f CPU %.3f xRT\n",
                ngs->fwdtree_perf.t_cpu,
                ngs->fwdtree_perf.t_cpu / n_speech);
@@ -1566,5 +1582,48 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
                ngs->fwdtree_perf.t_elapsed,
                ngs->fwdtree_perf.t_elapsed / n_speech);
     }
+    ngs->n_tot_lm_cache_hit += ngs->st.n_lm_cache_hit;
+    ngs->n_tot_lm_cache_miss += ngs->st.n_lm_cache_miss;
     /* dump_bptable(ngs); */
 }
+
+void
+ngram_fwdtree_foreach_history(ngram_search_t *ngs,
+                              ngram_history_func_t func, void *udata)
+{
+    root_chan_t *rhmm, **arl;
+    chan_t *hmm, **acl;
+    int32 i, w, nf, *awl;
+
+    nf = ngs->n_frame;
+
+    /* Root channels */
+    i = ngs->n_active_root[nf & 0x1];
+    arl = ngs->active_root_list[nf & 0x1];
+    for (; i > 0; --i, arl++)
+        ngram_search_hmm_history(ngs, &(*arl)->hmm, func, udata);
+
+    /* Nonroot channels in HMM tree */
+    i = ngs->n_active_chan[nf & 0x1];
+    acl = ngs->active_chan_list[nf & 0x1];
+    for (; i > 0; --i, acl++)
+        ngram_search_hmm_history(ngs, &(*acl)->hmm, func, udata);
+
+    /* Last phones of multi-phone words */
+    i = ngs->n_active_word[nf & 0x1];
+    awl = ngs->active_word_list[nf & 0x1];
+    for (; i > 0; --i, awl++) {
+        for (hmm = ngs->word_chan[*awl]; hmm; hmm = hmm->next) {
+            if (hmm_frame(&hmm->hmm) == nf)
+                ngram_search_hmm_history(ngs, &hmm->hmm, func, udata);
+        }
+    }
+
+    /* Single-phone words */
+    for (i = 0; i < ngs->n_1ph_words; i++) {
+        w = ngs->single_phone_wid[i];
+        rhmm = (root_chan_t *) ngs->word_chan[w];
+        if (hmm_frame(&rhmm->hmm) == nf)
+            ngram_search_hmm_history(ngs, &rhmm->hmm, func, udata);
+    }
+}
@@ -79,5 +79,13 @@ int ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx);
  */
 void ngram_fwdtree_finish(ngram_search_t *ngs);
 
+/**
+ * Visit the path histories of all HMMs active in the next frame.
+ *
+ * An HMM may be visited more than once.
+ */
+void ngram_fwdtree_foreach_history(ngram_search_t *ngs,
+                                   ngram_history_func_t func, void *udata);
+
 
 #endif /* __NGRAM_SEARCH_FWDTREE_H__ */
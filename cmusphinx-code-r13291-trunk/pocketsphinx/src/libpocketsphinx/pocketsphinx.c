@@ -69,6 +69,8 @@ static const arg_t ps_args_def[] = {
     CMDLN_EMPTY_OPTION
 };
 
+static int set_search_internal(ps_decoder_t *ps, ps_search_t *search);
+
 /* I'm not sure what the portable way to do this is. */
 static int
 file_exists(const char *path)
@@ -134,6 +136,9 @@ ps_expand_model_config(ps_decoder_t *ps)
     /* Get acoustic model filenames and add them to the command-line */
     hmmdir = cmd_ln_str_r(ps->config, "-hmm");
     ps_expand_file_config(ps, "-mdef", "_mdef", hmmdir, "mdef");
+    /* Only an explicit -ambin, so that a container left in the model
+     * directory never hides the separate files. */
+    ps_expand_file_config(ps, "-ambin", "_ambin", NULL, NULL);
     ps_expand_file_config(ps, "-mean", "_mean", hmmdir, "means");
     ps_expand_file_config(ps, "-var", "_var", hmmdir, "variances");
     ps_expand_file_config(ps, "-tmat", "_tmat", hmmdir, "transition_matrices");
@@ -158,6 +163,66 @@ ps_expand_model_config(ps_decoder_t *ps)
     }
 }
 
+/* Maximum number of grammars to keep in ps->jsgf_cache. */
+#define PS_JSGF_CACHE_SIZE 16
+
+static void
+ps_free_jsgf_cache(ps_decoder_t *ps)
+{
+    hash_iter_t *itor;
+
+    if (ps->jsgf_cache == NULL)
+        return;
+    for (itor = hash_table_iter(ps->jsgf_cache); itor;
+         itor = hash_table_iter_next(itor)) {
+        ckd_free((char *)hash_entry_key(itor->ent));
+        fsg_model_free(hash_entry_val(itor->ent));
+    }
+    hash_table_free(ps->jsgf_cache);
+    glist_free(ps->jsgf_lru);
+    ps->jsgf_cache = NULL;
+    ps->jsgf_lru = NULL;
+}
+
+/* Move a cached grammar text to the front of ps->jsgf_lru. */
+static void
+ps_touch_jsgf_cache(ps_decoder_t *ps, char const *jsgf_string)
+{
+    gnode_t *gn, *prev;
+    char *key;
+
+    prev = NULL;
+    for (gn = ps->jsgf_lru; gn; gn = gnode_next(gn)) {
+        if (0 == strcmp(gnode_ptr(gn), jsgf_string))
+            break;
+        prev = gn;
+    }
+    if (gn == NULL || prev == NULL)
+        return;
+    key = gnode_ptr(gn);
+    gnode_free(gn, prev);
+    ps->jsgf_lru = glist_add_ptr(ps->jsgf_lru, key);
+}
+
+/* Drop the cached grammar that has gone unused the longest. */
+static void
+ps_evict_jsgf_cache(ps_decoder_t *ps)
+{
+    gnode_t *gn, *prev;
+    char *key;
+
+    prev = NULL;
+    for (gn = ps->jsgf_lru; gnode_next(gn); gn = gnode_next(gn))
+        prev = gn;
+    key = gnode_ptr(gn);
+    fsg_model_free(hash_table_delete(ps->jsgf_cache, key));
+    ckd_free(key);
+    if (prev)
+        gnode_free(gn, prev);
+    else
+        ps->jsgf_lru = gnode_free(gn, NULL);
+}
+
 static void
 ps_free_searches(ps_decoder_t *ps)
 {
@@ -172,6 +237,8 @@ ps_free_searches(ps_decoder_t *ps)
 
     ps->searches = NULL;
     ps->search = NULL;
+    /* Cached grammars depend on the dictionary and weights. */
+    ps_free_jsgf_cache(ps);
 }
 
 static ps_search_t *
@@ -402,6 +469,97 @@ ps_init(cmd_ln_t *config)
     return ps;
 }
 
+/* Create a search like an existing one, sharing its models. */
+static int
+ps_copy_search(ps_decoder_t *ps, ps_search_t *search)
+{
+    char const *name = ps_search_name(search);
+    char const *type = ps_search_type(search);
+
+    if (0 == strcmp(type, PS_SEARCH_TYPE_NGRAM))
+        return set_search_internal(ps, ngram_search_copy(name, search,
+                                                         ps->config,
+                                                         ps->acmod, ps->dict,
+                                                         ps->d2p));
+    else if (0 == strcmp(type, PS_SEARCH_TYPE_FSG))
+        return ps_set_fsg(ps, name, ((fsg_search_t *)search)->fsg);
+    else if (0 == strcmp(type, PS_SEARCH_TYPE_ALLPHONE)) {
+        /* Scoring updates caches in the model, so give each decoder
+         * its own copy of them, in case they run in other threads. */
+        ngram_model_t *lm = ((allphone_search_t *)search)->lm;
+        int rv;
+
+        if (lm && (lm = ngram_model_copy(lm)) == NULL)
+            return -1;
+        rv = ps_set_allphone(ps, name, lm);
+        ngram_model_free(lm);
+        return rv;
+    }
+    else if (0 == strcmp(type, PS_SEARCH_TYPE_KWS))
+        return set_search_internal(ps, kws_search_copy(name, search, ps->config,
+                                                       ps->acmod, ps->dict,
+                                                       ps->d2p));
+
+    E_WARN("Not copying search %s of type %s\n", name, type);
+    return 0;
+}
+
+ps_decoder_t *
+ps_clone(ps_decoder_t *other)
+{
+    ps_decoder_t *ps;
+    hash_iter_t *search_it;
+
+    ps = ckd_calloc(1, sizeof(*ps));
+    ps->refcount = 1;
+    ps->config = cmd_ln_retain(other->config);
+    ps->mfclogdir = other->mfclogdir;
+    ps->rawlogdir = other->rawlogdir;
+    ps->senlogdir = other->senlogdir;
+    ps->lmath = logmath_retain(other->lmath);
+    ps->searches = hash_table_new(3, HASH_CASE_YES);
+
+    /* Acoustic model parameters and dictionary are shared. */
+    if ((ps->acmod = acmod_copy(other->acmod)) == NULL)
+        goto error_out;
+    ps->dict = dict_retain(other->dict);
+    ps->d2p = dict2pid_retain(other->d2p);
+
+    if (other->phone_loop) {
+        if ((ps->phone_loop =
+             phone_loop_search_init(ps->config, ps->acmod, ps->dict)) == NULL)
+            goto error_out;
+        hash_table_enter(ps->searches,
+                         ps_search_name(ps->phone_loop),
+                         ps->phone_loop);
+    }
+
+    /* Searches are not, but their language models and grammars are. */
+    for (search_it = hash_table_iter(other->searches); search_it;
+         search_it = hash_table_iter_next(search_it)) {
+        ps_search_t *search = hash_entry_val(search_it->ent);
+        if (search == other->phone_loop)
+            continue;
+        if (ps_copy_search(ps, search) < 0) {
+            hash_table_iter_free(search_it);
+            goto error_out;
+        }
+    }
+    if (other->search
+        && ps_find_search(ps, ps_search_name(other->search))
+        && ps_set_search(ps, ps_search_name(other->search)) < 0)
+        goto error_out;
+
+    ps->perf.name = "decode";
+    ptmr_init(&ps->perf);
+
+    return ps;
+
+error_out:
+    ps_free(ps);
+    return NULL;
+}
+
 arg_t const *
 ps_args(void)
 {
@@ -631,6 +789,12 @@ int
 ps_set_kws(ps_decoder_t *ps, const char *name, const char *keyfile)
 {
     ps_search_t *search;
+
+    /* Update an existing keyphrase search in place. */
+    search = ps_find_search(ps, name);
+    if (search && 0 == strcmp(PS_SEARCH_TYPE_KWS, ps_search_type(search)))
+        return kws_search_update(search, NULL, keyfile);
+
     search = kws_search_init(name, NULL, keyfile, ps->config, ps->acmod, ps->dict, ps->d2p);
     return set_search_internal(ps, search);
 }
@@ -639,6 +803,11 @@ int
 ps_set_keyphrase(ps_decoder_t *ps, const char *name, const char *keyphrase)
 {
     ps_search_t *search;
+
+    search = ps_find_search(ps, name);
+    if (search && 0 == strcmp(PS_SEARCH_TYPE_KWS, ps_search_type(search)))
+        return kws_search_update(search, keyphrase, NULL);
+
     search = kws_search_init(name, keyphrase, NULL, ps->config, ps->acmod, ps->dict, ps->d2p);
     return set_search_internal(ps, search);
 }
@@ -647,6 +816,11 @@ int
 ps_set_fsg(ps_decoder_t *ps, const char *name, fsg_model_t *fsg)
 {
     ps_search_t *search;
+
+    search = ps_find_search(ps, name);
+    if (search && 0 == strcmp(PS_SEARCH_TYPE_FSG, ps_search_type(search)))
+        return fsg_search_update(search, fsg);
+
     search = fsg_search_init(name, fsg, ps->config, ps->acmod, ps->dict, ps->d2p);
     return set_search_internal(ps, search);
 }
@@ -696,10 +870,20 @@ ps_set_jsgf_string(ps_decoder_t *ps, const char *name, const char *jsgf_string)
   fsg_model_t *fsg;
   jsgf_rule_t *rule;
   char const *toprule;
-  jsgf_t *jsgf = jsgf_parse_string(jsgf_string, NULL);
+  jsgf_t *jsgf;
   float lw;
   int result;
+  void *val;
+  char *key;
+
+  /* Grammars are often switched back and forth, reuse them. */
+  if (ps->jsgf_cache
+      && hash_table_lookup(ps->jsgf_cache, jsgf_string, &val) == 0) {
+      ps_touch_jsgf_cache(ps, jsgf_string);
+      return ps_set_fsg(ps, name, (fsg_model_t *)val);
+  }
 
+  jsgf = jsgf_parse_string(jsgf_string, NULL);
   if (!jsgf)
       return -1;
 
@@ -724,6 +908,16 @@ ps_set_jsgf_string(ps_decoder_t *ps, const char *name, const char *jsgf_string)
   lw = cmd_ln_float32_r(ps->config, "-lw");
   fsg = jsgf_build_fsg(jsgf, rule, ps->lmath, lw);
   result = ps_set_fsg(ps, name, fsg);
+  if (result == 0) {
+      /* The search has added fillers and compiled it, so keep that. */
+      if (ps->jsgf_cache == NULL)
+          ps->jsgf_cache = hash_table_new(PS_JSGF_CACHE_SIZE, HASH_CASE_YES);
+      else if (hash_table_inuse(ps->jsgf_cache) >= PS_JSGF_CACHE_SIZE)
+          ps_evict_jsgf_cache(ps);
+      key = ckd_salloc(jsgf_string);
+      hash_table_enter(ps->jsgf_cache, key, fsg_model_retain(fsg));
+      ps->jsgf_lru = glist_add_ptr(ps->jsgf_lru, key);
+  }
   fsg_model_free(fsg);
   jsgf_grammar_free(jsgf);
   return result;
@@ -772,6 +966,7 @@ ps_load_dict(ps_decoder_t *ps, char const *dictfile,
     ps->d2p = d2p;
 
     /* And tell all searches to reconfigure themselves. */
+    ps_free_jsgf_cache(ps);
     for (search_it = hash_table_iter(ps->searches); search_it;
        search_it = hash_table_iter_next(search_it)) {
         if (ps_search_reinit(hash_entry_val(search_it->ent), dict, d2p) < 0) {
@@ -824,6 +1019,7 @@ ps_add_word(ps_decoder_t *ps,
     ckd_free(tmp);
 
     /* Add it to the dictionary. */
+    ps_free_jsgf_cache(ps);
     if ((wid = dict_add_word(ps->dict, word, pron, np)) == -1) {
         ckd_free(pron);
         return -1;
@@ -1199,6 +1395,42 @@ ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score)
     return hyp;
 }
 
+char const *
+ps_get_partial_hyp(ps_decoder_t *ps, int32 *out_n_stable)
+{
+    char const *hyp, *c;
+    int32 n_stable;
+
+    ptmr_start(&ps->perf);
+    n_stable = 0;
+    if (ps->acmod->state == ACMOD_ENDED) {
+        /* Nothing can change any more. */
+        hyp = ps_search_hyp(ps->search, NULL);
+        if (hyp && *hyp) {
+            n_stable = 1;
+            for (c = hyp; *c; ++c)
+                if (*c == ' ')
+                    ++n_stable;
+        }
+    }
+    else if (ps->search->vt->partial_hyp)
+        hyp = (*ps->search->vt->partial_hyp)(ps->search, &n_stable);
+    else
+        hyp = ps_search_hyp(ps->search, NULL);
+    ptmr_stop(&ps->perf);
+    if (out_n_stable)
+        *out_n_stable = n_stable;
+    return hyp;
+}
+
+int
+ps_release_stable(ps_decoder_t *ps)
+{
+    if (ps->search->vt->release == NULL)
+        return -1;
+    return (*ps->search->vt->release)(ps->search);
+}
+
 int32
 ps_get_prob(ps_decoder_t *ps)
 {
@@ -1411,12 +1643,15 @@ ps_search_base_free(ps_search_t *search)
     dict2pid_free(search->d2p);
     ckd_free(search->hyp_str);
     ps_lattice_free(search->dag);
+    ps_lattice_pass_free(search->latpass);
 }
 
 void
 ps_search_base_reinit(ps_search_t *search, dict_t *dict,
                       dict2pid_t *d2p)
 {
+    /* The language model may have changed too. */
+    ps_lattice_pass_flush(search->latpass);
     dict_free(search->dict);
     dict2pid_free(search->d2p);
     /* FIXME: _retain() should just return NULL if passed NULL. */
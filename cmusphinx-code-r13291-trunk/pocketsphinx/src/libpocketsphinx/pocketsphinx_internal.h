@@ -90,6 +90,10 @@ typedef struct ps_searchfuncs_s {
     char const *(*hyp)(ps_search_t *search, int32 *out_score);
     int32 (*prob)(ps_search_t *search);
     ps_seg_t *(*seg_iter)(ps_search_t *search);
+
+    /* Optional, may be NULL. */
+    char const *(*partial_hyp)(ps_search_t *search, int32 *out_n_stable);
+    int (*release)(ps_search_t *search);
 } ps_searchfuncs_t;
 
 /**
@@ -109,6 +113,8 @@ struct ps_search_s {
     char *hyp_str;         /**< Current hypothesis string. */
     ps_lattice_t *dag;	   /**< Current hypothesis word graph. */
     ps_latlink_t *last_link; /**< Final link in best path. */
+    struct latpass_s *latpass; /**< Threads for bestpath and posterior
+                                  passes, kept between utterances. */
     int32 post;            /**< Utterance posterior probability. */
     int32 n_words;         /**< Number of words known to search (may
                               be less than in the dictionary) */
@@ -216,6 +222,10 @@ struct ps_decoder_s {
     ps_search_t *search;     /**< Currently active search module. */
     ps_search_t *phone_loop; /**< Phone loop search for lookahead. */
     int pl_window;           /**< Window size for phoneme lookahead. */
+    hash_table_t *jsgf_cache; /**< FSGs built by ps_set_jsgf_string(),
+                                   by grammar text. */
+    glist_t jsgf_lru;         /**< Grammar texts in jsgf_cache, most
+                                   recently used first. */
 
     /* Utterance-processing related stuff. */
     uint32 uttno;       /**< Utterance counter. */
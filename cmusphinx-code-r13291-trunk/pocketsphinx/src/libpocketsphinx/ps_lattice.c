@@ -50,6 +50,8 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/pio.h>
+#include <sphinxbase/bio.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "pocketsphinx_internal.h"
@@ -57,6 +59,8 @@
 #include "ngram_search.h"
 #include "dict.h"
 
+static void ps_lattice_unsort(ps_lattice_t *dag);
+
 /*
  * Create a directed link between "from" and "to" nodes, but if a link already exists,
  * choose one with the best ascr.
@@ -77,6 +81,8 @@ ps_lattice_link(ps_lattice_t *dag, ps_latnode_t *from, ps_latnode_t *to,
         ps_latlink_t *link;
 
         /* No link between the two nodes; create a new one */
+        if (dag->links)
+            ps_lattice_unsort(dag);
         link = listelem_malloc(dag->latlink_alloc);
         fwdlink = listelem_malloc(dag->latlink_list_alloc);
         revlink = listelem_malloc(dag->latlink_list_alloc);
@@ -176,6 +182,7 @@ ps_lattice_delete_unreachable(ps_lattice_t *dag)
     ps_latnode_t *node, *prev_node, *next_node;
     int i;
 
+    ps_lattice_unsort(dag);
     /* Remove unreachable nodes from the list of nodes. */
     prev_node = NULL;
     for (node = dag->nodes; node; node = next_node) {
@@ -346,6 +353,99 @@ ps_lattice_write_htk(ps_lattice_t *dag, char const *filename)
     return 0;
 }
 
+/* Version of the binary lattice format. */
+#define LATTICE_BIN_VERSION "1.0"
+
+int
+ps_lattice_write_bin(ps_lattice_t *dag, char const *filename)
+{
+    FILE *fp;
+    int32 ispipe;
+    int32 *widx, *words;
+    int32 i, n_words, n_nodes, n_links, prev;
+    uint32 chksum;
+    ps_latnode_t *d;
+    char logbase[32];
+
+    E_INFO("Writing binary lattice file: %s\n", filename);
+    if ((fp = fopen_comp(filename, "w", &ispipe)) == NULL) {
+        E_ERROR_SYSTEM("Failed to open lattice file '%s' for writing", filename);
+        return -1;
+    }
+    sprintf(logbase, "%e", logmath_get_base(dag->lmath));
+    bio_writehdr(fp, "version", LATTICE_BIN_VERSION,
+                 "logbase", logbase, "chksum0", "yes", NULL);
+
+    /* Number the nodes, collect the words they use and count links. */
+    widx = ckd_calloc(dict_size(dag->dict), sizeof(*widx));
+    memset(widx, -1, dict_size(dag->dict) * sizeof(*widx));
+    for (n_nodes = 0, d = dag->nodes; d; d = d->next, n_nodes++);
+    words = ckd_calloc(n_nodes, sizeof(*words));
+    n_words = n_links = 0;
+    for (i = 0, d = dag->nodes; d; d = d->next, i++) {
+        latlink_list_t *l;
+
+        d->id = i;
+        if (widx[d->wid] == -1) {
+            widx[d->wid] = n_words;
+            words[n_words++] = d->wid;
+        }
+        for (l = d->exits; l; l = l->next) {
+            if (l->link->ascr WORSE_THAN WORST_SCORE || l->link->ascr BETTER_THAN 0)
+                continue;
+            ++n_links;
+        }
+    }
+
+    chksum = 0;
+    bio_fwrite_varint(dag->n_frames, fp, &chksum);
+    bio_fwrite_varint(n_words, fp, &chksum);
+    for (i = 0; i < n_words; ++i) {
+        char const *wstr = dict_wordstr(dag->dict, words[i]);
+        int32 len = strlen(wstr);
+
+        bio_fwrite_varint(len, fp, &chksum);
+        bio_fwrite(wstr, 1, len, fp, 0, &chksum);
+    }
+    bio_fwrite_varint(n_nodes, fp, &chksum);
+    for (d = dag->nodes; d; d = d->next) {
+        bio_fwrite_varint(widx[d->wid], fp, &chksum);
+        bio_fwrite_varint(d->sf, fp, &chksum);
+        bio_fwrite_svarint(d->fef - d->sf, fp, &chksum);
+        bio_fwrite_svarint(d->lef - d->fef, fp, &chksum);
+        bio_fwrite_svarint(d->node_id, fp, &chksum);
+    }
+    bio_fwrite_varint(dag->start->id, fp, &chksum);
+    bio_fwrite_varint(dag->end->id, fp, &chksum);
+
+    /* Links are written in order of their source node, so the source
+     * is delta coded, and the destination is relative to it. */
+    bio_fwrite_varint(n_links, fp, &chksum);
+    prev = 0;
+    for (d = dag->nodes; d; d = d->next) {
+        latlink_list_t *l;
+        for (l = d->exits; l; l = l->next) {
+            if (l->link->ascr WORSE_THAN WORST_SCORE || l->link->ascr BETTER_THAN 0)
+                continue;
+            bio_fwrite_svarint(d->id - prev, fp, &chksum);
+            bio_fwrite_svarint(l->link->to->id - d->id, fp, &chksum);
+            bio_fwrite_varint(-(l->link->ascr << SENSCR_SHIFT), fp, &chksum);
+            prev = d->id;
+        }
+    }
+    bio_fwrite(&chksum, sizeof(chksum), 1, fp, 0, NULL);
+    ckd_free(widx);
+    ckd_free(words);
+
+    if (ferror(fp)) {
+        E_ERROR_SYSTEM("Failed to write lattice file '%s'", filename);
+        fclose_comp(fp, ispipe);
+        return -1;
+    }
+    fclose_comp(fp, ispipe);
+    return 0;
+}
+
 /* Read parameter from a lattice file*/
 static int
 dag_param_read(lineiter_t *li, char *param)
@@ -383,46 +483,71 @@ dag_mark_reachable(ps_latnode_t * d)
             dag_mark_reachable(l->link->from);
 }
 
-ps_lattice_t *
-ps_lattice_read(ps_decoder_t *ps,
-                char const *file)
+/* Compensation factor for scores from a lattice with log base lb. */
+static float32
+dag_logratio(ps_lattice_t *dag, float64 lb)
+{
+    float32 pb = logmath_get_base(dag->lmath);
+    float32 logratio = 1.0f;
+
+    if (fabs(lb - pb) >= 0.0001) {
+        E_WARN("Inconsistent logbases: %f vs %f: will compensate\n", lb, pb);
+        logratio = (float32)(log(lb) / log(pb));
+        E_INFO("Lattice log ratio: %f\n", logratio);
+    }
+    return logratio;
+}
+
+/* Look up a word from a lattice file, adding it if we have no decoder. */
+static int32
+dag_wordid(ps_lattice_t *dag, char const *wd)
+{
+    int32 w;
+
+    w = dict_wordid(dag->dict, wd);
+    if (w < 0 && dag->search == NULL) {
+        char *ww = ckd_salloc(wd);
+        if (dict_word2basestr(ww) != -1) {
+            if (dict_wordid(dag->dict, ww) == BAD_S3WID)
+                dict_add_word(dag->dict, ww, NULL, 0);
+        }
+        ckd_free(ww);
+        w = dict_add_word(dag->dict, wd, NULL, 0);
+    }
+    return w;
+}
+
+/* Create a node for a lattice read from a file. */
+static ps_latnode_t *
+dag_new_node(ps_lattice_t *dag, int32 w, int32 id, int32 sf, int32 fef, int32 lef)
+{
+    ps_latnode_t *node;
+
+    node = listelem_malloc(dag->latnode_alloc);
+    node->wid = w;
+    node->basewid = dict_basewid(dag->dict, w);
+    node->id = id;
+    node->sf = sf;
+    node->fef = fef;
+    node->lef = lef;
+    node->node_id = 0;
+    node->reachable = 0;
+    node->exits = node->entries = NULL;
+    node->next = NULL;
+    return node;
+}
+
+/* Read the nodes and links of a lattice in Sphinx-III text format. */
+static int
+dag_read_text(ps_lattice_t *dag, FILE *fp, char const *file)
 {
-    FILE *fp;
-    int32 ispipe;
     lineiter_t *line;
     float64 lb;
     float32 logratio;
     ps_latnode_t **darray;
-    ps_lattice_t *dag;
     int i, k, n_nodes;
-    int32 pip, silpen, fillpen;
-
-    dag = ckd_calloc(1, sizeof(*dag));
-
-    if (ps) {
-        dag->search = ps->search;
-        dag->dict = dict_retain(ps->dict);
-        dag->lmath = logmath_retain(ps->lmath);
-        dag->frate = cmd_ln_int32_r(dag->search->config, "-frate");
-    }
-    else {
-        dag->dict = dict_init(NULL, NULL);
-        dag->lmath = logmath_init(1.0001, 0, FALSE);
-        dag->frate = 100;
-    }
-    dag->silence = dict_silwid(dag->dict);
-    dag->latnode_alloc = listelem_alloc_init(sizeof(ps_latnode_t));
-    dag->latlink_alloc = listelem_alloc_init(sizeof(ps_latlink_t));
-    dag->latlink_list_alloc = listelem_alloc_init(sizeof(latlink_list_t));
-    dag->refcount = 1;
 
     darray = NULL;
-
-    E_INFO("Reading DAG file: %s\n", file);
-    if ((fp = fopen_compchk(file, &ispipe)) == NULL) {
-        E_ERROR_SYSTEM("Failed to open DAG file '%s' for reading", file);
-        return NULL;
-    }
     line = lineiter_start(fp);
 
     /* Read and verify logbase (ONE BIG HACK!!) */
@@ -443,17 +568,7 @@ ps_lattice_read(ps_decoder_t *ps,
         E_WARN("%s: Cannot find -logbase in header\n", file);
         lb = 1.0001;
     }
-    logratio = 1.0f;
-    if (dag->lmath == NULL)
-        dag->lmath = logmath_init(lb, 0, TRUE);
-    else {
-        float32 pb = logmath_get_base(dag->lmath);
-        if (fabs(lb - pb) >= 0.0001) {
-            E_WARN("Inconsistent logbases: %f vs %f: will compensate\n", lb, pb);
-            logratio = (float32)(log(lb) / log(pb));
-            E_INFO("Lattice log ratio: %f\n", logratio);
-        }
-    }
+    logratio = dag_logratio(dag, lb);
     /* Read Frames parameter */
     dag->n_frames = dag_param_read(line, "Frames");
     if (dag->n_frames <= 0) {
@@ -487,21 +602,9 @@ ps_lattice_read(ps_decoder_t *ps,
             goto load_error;
         }
 
-        w = dict_wordid(dag->dict, wd);
-        if (w < 0) {
-            if (dag->search == NULL) {
-                char *ww = ckd_salloc(wd);
-                if (dict_word2basestr(ww) != -1) {
-                    if (dict_wordid(dag->dict, ww) == BAD_S3WID)
-                        dict_add_word(dag->dict, ww, NULL, 0);
-                }
-                ckd_free(ww);
-                w = dict_add_word(dag->dict, wd, NULL, 0);
-            }
-            if (w < 0) {
-                E_ERROR("Unknown word in line: %s\n", line->buf);
-                goto load_error;
-            }
+        if ((w = dag_wordid(dag, wd)) < 0) {
+            E_ERROR("Unknown word in line: %s\n", line->buf);
+            goto load_error;
         }
 
         if (seqid != i) {
@@ -509,19 +612,8 @@ ps_lattice_read(ps_decoder_t *ps,
             goto load_error;
         }
 
-        *pnodes = listelem_malloc(dag->latnode_alloc);
-        ps_latnode_t *node = *pnodes;
-        darray[i] = node;
-        node->wid = w;
-        node->basewid = dict_basewid(dag->dict, w);
-        node->id = seqid;
-        node->sf = sf;
-        node->fef = fef;
-        node->lef = lef;
-        node->reachable = 0;
-        node->exits = node->entries = NULL;
-        node->next = NULL;
-        pnodes = &node->next;
+        *pnodes = darray[i] = dag_new_node(dag, w, seqid, sf, fef, lef);
+        pnodes = &darray[i]->next;
     }
 
     /* Read initial node ID */
@@ -576,15 +668,211 @@ ps_lattice_read(ps_decoder_t *ps,
         d = darray[to];
         if (logratio != 1.0f)
             ascr = (int32)(ascr * logratio);
-        ps_lattice_link(dag, pd, d, ascr, d->sf - 1);
+        /* Scores are written unscaled, as in the binary format. */
+        ps_lattice_link(dag, pd, d, ascr >> SENSCR_SHIFT, d->sf - 1);
     }
     if (strcmp(line->buf, "End\n") != 0) {
         E_ERROR("Terminating 'End' missing\n");
         goto load_error;
     }
     lineiter_free(line);
-    fclose_comp(fp, ispipe);
     ckd_free(darray);
+    return 0;
+
+  load_error:
+    lineiter_free(line);
+    ckd_free(darray);
+    return -1;
+}
+
+/*
+ * Read the nodes and links of a lattice in binary format (see
+ * ps_lattice_write_bin()).  Links are created as they are read, so
+ * only the node array is held in memory.
+ */
+static int
+dag_read_bin(ps_lattice_t *dag, FILE *fp, char const *file)
+{
+    char **argname, **argval;
+    int32 swap, do_chksum;
+    uint32 chksum, file_chksum;
+    uint32 n_frames, n_words, n_nodes, n_links, u;
+    float64 lb;
+    float32 logratio;
+    int32 *wids;
+    ps_latnode_t **darray, **pnodes;
+    char *wd;
+    int32 i, from;
+
+    if (bio_readhdr(fp, &argname, &argval, &swap) < 0) {
+        E_ERROR("Failed to read header from %s\n", file);
+        return -1;
+    }
+    lb = 1.0001;
+    do_chksum = FALSE;
+    for (i = 0; argname[i]; i++) {
+        if (strcmp(argname[i], "version") == 0) {
+            if (strcmp(argval[i], LATTICE_BIN_VERSION) != 0)
+                E_WARN("Version mismatch(%s): %s, expecting %s\n",
+                       file, argval[i], LATTICE_BIN_VERSION);
+        }
+        else if (strcmp(argname[i], "logbase") == 0)
+            lb = atof_c(argval[i]);
+        else if (strcmp(argname[i], "chksum0") == 0)
+            do_chksum = TRUE;
+    }
+    bio_hdrarg_free(argname, argval);
+    logratio = dag_logratio(dag, lb);
+
+    wids = NULL;
+    darray = NULL;
+    wd = NULL;
+    chksum = 0;
+    if (bio_fread_varint(&n_frames, fp, &chksum) < 0
+        || bio_fread_varint(&n_words, fp, &chksum) < 0)
+        goto read_error;
+    dag->n_frames = n_frames;
+
+    /* Look up each distinct word once. */
+    wids = ckd_calloc(n_words, sizeof(*wids));
+    for (u = 0; u < n_words; ++u) {
+        uint32 len;
+
+        if (bio_fread_varint(&len, fp, &chksum) < 0 || len > 4096)
+            goto read_error;
+        wd = ckd_malloc(len + 1);
+        if (bio_fread(wd, 1, len, fp, 0, &chksum) != (int32)len)
+            goto read_error;
+        wd[len] = '\0';
+        if ((wids[u] = dag_wordid(dag, wd)) < 0) {
+            E_ERROR("Unknown word in %s: %s\n", file, wd);
+            goto load_error;
+        }
+        ckd_free(wd);
+        wd = NULL;
+    }
+
+    if (bio_fread_varint(&n_nodes, fp, &chksum) < 0 || n_nodes == 0)
+        goto read_error;
+    darray = ckd_calloc(n_nodes, sizeof(*darray));
+    pnodes = &dag->nodes;
+    for (u = 0; u < n_nodes; ++u) {
+        uint32 w, sf;
+        int32 fef, lef, node_id;
+
+        if (bio_fread_varint(&w, fp, &chksum) < 0
+            || bio_fread_varint(&sf, fp, &chksum) < 0
+            || bio_fread_svarint(&fef, fp, &chksum) < 0
+            || bio_fread_svarint(&lef, fp, &chksum) < 0
+            || bio_fread_svarint(&node_id, fp, &chksum) < 0
+            || w >= n_words)
+            goto read_error;
+        fef += sf;
+        lef += fef;
+        *pnodes = darray[u] = dag_new_node(dag, wids[w], u, sf, fef, lef);
+        darray[u]->node_id = node_id;
+        pnodes = &darray[u]->next;
+    }
+
+    if (bio_fread_varint(&u, fp, &chksum) < 0 || u >= n_nodes)
+        goto read_error;
+    dag->start = darray[u];
+    if (bio_fread_varint(&u, fp, &chksum) < 0 || u >= n_nodes)
+        goto read_error;
+    dag->end = darray[u];
+
+    if (bio_fread_varint(&n_links, fp, &chksum) < 0)
+        goto read_error;
+    from = 0;
+    for (u = 0; u < n_links; ++u) {
+        int32 dfrom, to, ascr;
+        uint32 nascr;
+
+        if (bio_fread_svarint(&dfrom, fp, &chksum) < 0
+            || bio_fread_svarint(&to, fp, &chksum) < 0
+            || bio_fread_varint(&nascr, fp, &chksum) < 0)
+            goto read_error;
+        from += dfrom;
+        to += from;
+        if (from < 0 || (uint32)from >= n_nodes
+            || to < 0 || (uint32)to >= n_nodes)
+            goto read_error;
+        ascr = -(int32)nascr;
+        if (logratio != 1.0f)
+            ascr = (int32)(ascr * logratio);
+        ps_lattice_link(dag, darray[from], darray[to],
+                        ascr >> SENSCR_SHIFT, darray[to]->sf - 1);
+    }
+
+    if (do_chksum) {
+        if (bio_fread(&file_chksum, sizeof(file_chksum), 1, fp, swap, NULL) != 1)
+            goto read_error;
+        if (file_chksum != chksum) {
+            E_ERROR("Checksum error in %s; file-checksum %08x, computed %08x\n",
+                    file, file_chksum, chksum);
+            goto load_error;
+        }
+    }
+    ckd_free(wids);
+    ckd_free(darray);
+    return 0;
+
+  read_error:
+    E_ERROR("Premature EOF or invalid data in %s\n", file);
+  load_error:
+    ckd_free(wd);
+    ckd_free(wids);
+    ckd_free(darray);
+    return -1;
+}
+
+ps_lattice_t *
+ps_lattice_read(ps_decoder_t *ps,
+                char const *file)
+{
+    FILE *fp;
+    int32 ispipe;
+    ps_lattice_t *dag;
+    int c, rv;
+    int32 pip, silpen, fillpen;
+
+    dag = ckd_calloc(1, sizeof(*dag));
+
+    if (ps) {
+        dag->search = ps->search;
+        dag->dict = dict_retain(ps->dict);
+        dag->lmath = logmath_retain(ps->lmath);
+        dag->frate = cmd_ln_int32_r(dag->search->config, "-frate");
+        dag->n_threads = cmd_ln_int32_r(ps->config, "-latthreads");
+    }
+    else {
+        dag->dict = dict_init(NULL, NULL);
+        dag->lmath = logmath_init(1.0001, 0, FALSE);
+        dag->frate = 100;
+    }
+    dag->silence = dict_silwid(dag->dict);
+    dag->latnode_alloc = listelem_alloc_init(sizeof(ps_latnode_t));
+    dag->latlink_alloc = listelem_alloc_init(sizeof(ps_latlink_t));
+    dag->latlink_list_alloc = listelem_alloc_init(sizeof(latlink_list_t));
+    dag->refcount = 1;
+
+    E_INFO("Reading DAG file: %s\n", file);
+    if ((fp = fopen_compchk(file, &ispipe)) == NULL) {
+        E_ERROR_SYSTEM("Failed to open DAG file '%s' for reading", file);
+        return NULL;
+    }
+    /* Binary lattices start with an "s3" header, text ones with a comment. */
+    c = getc(fp);
+    ungetc(c, fp);
+    if (c == 's')
+        rv = dag_read_bin(dag, fp, file);
+    else
+        rv = dag_read_text(dag, fp, file);
+    fclose_comp(fp, ispipe);
+    if (rv < 0) {
+        E_ERROR("Failed to load %s\n", file);
+        return NULL;
+    }
 
     /* Minor hack: If the final node is a filler word and not </s>,
      * then set its base word ID to </s>, so that the language model
@@ -614,13 +902,6 @@ ps_lattice_read(ps_decoder_t *ps,
     }
 
     return dag;
-
-  load_error:
-    E_ERROR("Failed to load %s\n", file);
-    lineiter_free(line);
-    fclose_comp(fp, ispipe);
-    ckd_free(darray);
-    return NULL;
 }
 
 int
@@ -639,6 +920,7 @@ ps_lattice_init_search(ps_search_t *search, int n_frame)
     dag->dict = dict_retain(search->dict);
     dag->lmath = logmath_retain(search->acmod->lmath);
     dag->frate = cmd_ln_int32_r(dag->search->config, "-frate");
+    dag->n_threads = cmd_ln_int32_r(dag->search->config, "-latthreads");
     dag->silence = dict_silwid(dag->dict);
     dag->n_frames = n_frame;
     dag->latnode_alloc = listelem_alloc_init(sizeof(ps_latnode_t));
@@ -667,6 +949,7 @@ ps_lattice_free(ps_lattice_t *dag)
     listelem_alloc_free(dag->latnode_alloc);
     listelem_alloc_free(dag->latlink_alloc);
     listelem_alloc_free(dag->latlink_list_alloc);    
+    ps_lattice_unsort(dag);
     ckd_free(dag->hyp_str);
     ckd_free(dag);
     return 0;
@@ -1195,140 +1478,604 @@ ps_lattice_reverse_next(ps_lattice_t *dag, ps_latnode_t *start)
 }
 
 /*
- * Find the best score from dag->start to end point of any link and
- * use it to update links further down the path.  This is like
- * single-source shortest path search, except that it is done over
- * edges rather than nodes, which allows us to do exact trigram scoring.
+ * Throw away the sorted form of the lattice, when it changes.
+ */
+static void
+ps_lattice_unsort(ps_lattice_t *dag)
+{
+    ckd_free(dag->sorted);
+    ckd_free(dag->level);
+    ckd_free(dag->links);
+    ckd_free(dag->exit_idx);
+    ckd_free(dag->entries);
+    ckd_free(dag->entry_idx);
+    ckd_free(dag->lmctx);
+    dag->sorted = NULL;
+    dag->level = NULL;
+    dag->links = NULL;
+    dag->exit_idx = NULL;
+    dag->entries = NULL;
+    dag->entry_idx = NULL;
+    dag->lmctx = NULL;
+    dag->lmctx_lm = NULL;
+    dag->n_sorted = dag->n_level = dag->n_links = 0;
+}
+
+/*
+ * Sort the nodes of the lattice into levels, such that all links go
+ * from one level to a later one, and lay out their links in arrays.
  *
- * Helpfully enough, we get half of the posterior probability
- * calculation for free that way too.  (interesting research topic: is
- * there a reliable Viterbi analogue to word-level Forward-Backward
- * like there is for state-level?  Or, is it just lattice density?)
+ * Each node goes into the level after the last of its predecessors,
+ * so the links out of one level only depend on those before it, and
+ * can be scored all at once in the forward pass (and likewise the
+ * links into one level in the backward pass).
  */
-ps_latlink_t *
-ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
-                    float32 lwf, float32 ascale)
+static int
+ps_lattice_sort(ps_lattice_t *dag)
 {
-    ps_search_t *search;
     ps_latnode_t *node;
-    ps_latlink_t *link;
-    ps_latlink_t *bestend;
     latlink_list_t *x;
-    logmath_t *lmath;
-    int32 bestescr;
+    int32 n_node, head, tail, i, j;
 
-    search = dag->search;
-    lmath = dag->lmath;
+    if (dag->links)
+        return 0;
 
-    /* Initialize path scores for all links exiting dag->start, and
-     * set all other scores to the minimum.  Also initialize alphas to
-     * log-zero. */
+    n_node = dag->n_links = 0;
     for (node = dag->nodes; node; node = node->next) {
-        for (x = node->exits; x; x = x->next) {
-            x->link->path_scr = MAX_NEG_INT32;
-            x->link->alpha = logmath_get_zero(lmath);
+        node->info.fanin = 0;
+        for (x = node->entries; x; x = x->next)
+            ++node->info.fanin;
+        for (x = node->exits; x; x = x->next)
+            ++dag->n_links;
+        ++n_node;
+    }
+
+    /* Peel off the nodes with no remaining entries, level by level. */
+    dag->sorted = ckd_calloc(n_node, sizeof(*dag->sorted));
+    dag->level = ckd_calloc(n_node + 1, sizeof(*dag->level));
+    tail = 0;
+    for (node = dag->nodes; node; node = node->next)
+        if (node->info.fanin == 0)
+            dag->sorted[tail++] = node;
+    for (head = 0; head < tail; ) {
+        int32 end = tail;
+
+        dag->level[dag->n_level++] = head;
+        for (; head < end; ++head) {
+            for (x = dag->sorted[head]->exits; x; x = x->next)
+                if (--x->link->to->info.fanin == 0)
+                    dag->sorted[tail++] = x->link->to;
         }
     }
-    for (x = dag->start->exits; x; x = x->next) {
-        int32 n_used;
-        int16 to_is_fil;
+    dag->level[dag->n_level] = tail;
+    dag->n_sorted = tail;
+    if (tail < n_node) {
+        E_ERROR("Lattice contains a cycle, %d of %d nodes cannot be sorted\n",
+                n_node - tail, n_node);
+        ps_lattice_unsort(dag);
+        return -1;
+    }
 
-        to_is_fil = dict_filler_word(ps_search_dict(search), x->link->to->basewid) && x->link->to != dag->end;
+    /* Exits are stored in order, entries as indices of exits. */
+    dag->links = ckd_calloc(dag->n_links, sizeof(*dag->links));
+    dag->exit_idx = ckd_calloc(n_node + 1, sizeof(*dag->exit_idx));
+    dag->entry_idx = ckd_calloc(n_node + 1, sizeof(*dag->entry_idx));
+    for (i = j = 0; i < n_node; ++i) {
+        /* Remember the position of each node for the next step. */
+        dag->sorted[i]->info.fanin = i;
+        dag->exit_idx[i] = j;
+        for (x = dag->sorted[i]->exits; x; x = x->next)
+            dag->links[j++] = x->link;
+    }
+    dag->exit_idx[n_node] = j;
+    for (j = 0; j < dag->n_links; ++j)
+        ++dag->entry_idx[dag->links[j]->to->info.fanin + 1];
+    for (i = 0; i < n_node; ++i)
+        dag->entry_idx[i + 1] += dag->entry_idx[i];
+    dag->entries = ckd_calloc(dag->n_links, sizeof(*dag->entries));
+    for (j = 0; j < dag->n_links; ++j) {
+        i = dag->links[j]->to->info.fanin;
+        /* Use entry_idx[i] as a cursor, and shift it back below. */
+        dag->entries[dag->entry_idx[i]++] = j;
+    }
+    for (i = n_node; i > 0; --i)
+        dag->entry_idx[i] = dag->entry_idx[i - 1];
+    dag->entry_idx[0] = 0;
+    dag->lmctx = ckd_calloc(dag->n_links, sizeof(*dag->lmctx));
+
+    E_INFO("Sorted %d nodes and %d links into %d levels\n",
+           n_node, dag->n_links, dag->n_level);
+    return 0;
+}
 
-        /* Best path points to dag->start, obviously. */
-        x->link->path_scr = x->link->ascr;
-        if (lmset && !to_is_fil)
-            x->link->path_scr += (ngram_bg_score(lmset, x->link->to->basewid,
-                                ps_search_start_wid(search), &n_used) >> SENSCR_SHIFT) * lwf;
-        x->link->best_prev = NULL;
-        /* No predecessors for start links. */
-        x->link->alpha = 0;
+/*
+ * Find the language model context of a link from its best path, and
+ * the probability of its to-word in that context.
+ */
+static void
+latlink_lmctx(ps_lattice_t *dag, ngram_model_t *lmset,
+              ps_latlink_t *link, latlink_lmctx_t *ctx)
+{
+    ps_latlink_t *prev_link;
+    int32 w3_wid, w2_wid, n_used;
+    int16 w3_is_fil, w2_is_fil;
+
+    /* Find word predecessor if from-word is filler */
+    w3_wid = link->from->basewid;
+    w2_wid = link->to->basewid;
+    w3_is_fil = dict_filler_word(dag->dict, w3_wid) && link->from != dag->start;
+    w2_is_fil = dict_filler_word(dag->dict, w2_wid) && link->to != dag->end;
+    prev_link = link;
+
+    if (w3_is_fil) {
+        while (prev_link->best_prev != NULL) {
+            prev_link = prev_link->best_prev;
+            w3_wid = prev_link->from->basewid;
+            if (!dict_filler_word(dag->dict, w3_wid) || prev_link->from == dag->start) {
+                w3_is_fil = FALSE;
+                break;
+            }
+        }
     }
 
-    /* Traverse the edges in the graph, updating path scores. */
-    for (link = ps_lattice_traverse_edges(dag, NULL, NULL);
-         link; link = ps_lattice_traverse_next(dag, NULL)) {
-        int32 bprob, n_used;
-        int32 w3_wid, w2_wid;
-        int16 w3_is_fil, w2_is_fil;
-        ps_latlink_t *prev_link;
-
-        /* Sanity check, we should not be traversing edges that
-         * weren't previously updated, otherwise nasty overflows will result. */
-        assert(link->path_scr != MAX_NEG_INT32);
-
-        /* Find word predecessor if from-word is filler */
-        w3_wid = link->from->basewid;
-        w2_wid = link->to->basewid;
-        w3_is_fil = dict_filler_word(ps_search_dict(search), link->from->basewid) && link->from != dag->start;
-        w2_is_fil = dict_filler_word(ps_search_dict(search), w2_wid) && link->to != dag->end;
-        prev_link = link;
-
-        if (w3_is_fil) {
-            while (prev_link->best_prev != NULL) {
-                prev_link = prev_link->best_prev;
-                w3_wid = prev_link->from->basewid;
-                if (!dict_filler_word(ps_search_dict(search), w3_wid) || prev_link->from == dag->start) {
-                    w3_is_fil = FALSE;
-                    break;
-                }
+    /* Calculate common bigram probability for all alphas. */
+    if (lmset && !w3_is_fil && !w2_is_fil)
+        ctx->bprob = ngram_ng_prob(lmset, w2_wid, &w3_wid, 1, &n_used);
+    else
+        ctx->bprob = 0;
+
+    /* Shift the history back past a filler to-word. */
+    if (w2_is_fil) {
+        w2_is_fil = w3_is_fil;
+        w3_is_fil = TRUE;
+        w2_wid = w3_wid;
+        while (prev_link->best_prev != NULL) {
+            prev_link = prev_link->best_prev;
+            w3_wid = prev_link->from->basewid;
+            if (!dict_filler_word(dag->dict, w3_wid) || prev_link->from == dag->start) {
+                w3_is_fil = FALSE;
+                break;
             }
         }
+    }
+    ctx->w2 = w2_wid;
+    ctx->w3 = w3_wid;
+    ctx->w2_is_fil = w2_is_fil;
+    ctx->w3_is_fil = w3_is_fil;
+}
 
-        /* Calculate common bigram probability for all alphas. */
-        if (lmset && !w3_is_fil && !w2_is_fil)
-            bprob = ngram_ng_prob(lmset, w2_wid, &w3_wid, 1, &n_used);
-        else
-            bprob = 0;
-        /* Add in this link's acoustic score, which was a constant
-           factor in previous computations (if any). */
-        link->alpha += (link->ascr << SENSCR_SHIFT) * ascale;
-
-        if (w2_is_fil) {
-            w2_is_fil = w3_is_fil;
-            w3_is_fil = TRUE;
-            w2_wid = w3_wid;
-            while (prev_link->best_prev != NULL) {
-                prev_link = prev_link->best_prev;
-                w3_wid = prev_link->from->basewid;
-                if (!dict_filler_word(ps_search_dict(search), w3_wid) || prev_link->from == dag->start) {
-                    w3_is_fil = FALSE;
-                    break;
-                }
-            }
+/* Fewest links in a level worth handing out to other threads. */
+#define LATPASS_MIN_LINKS 256
+/* Number of nodes taken by a thread at a time. */
+#define LATPASS_CHUNK 8
+
+struct latpass_s;
+typedef void (*latpass_func_t)(struct latpass_s *pass,
+                               ngram_model_t *lmset, int32 i);
+
+/**
+ * Thread helping with a pass over the lattice.
+ */
+typedef struct latworker_s {
+    struct latpass_s *pass;
+    sbthread_t *th;         /**< Thread running this worker. */
+    sbevent_t *start;       /**< Signalled when a level is ready. */
+    ngram_model_t *lmset;   /**< Own copy of the language model. */
+} latworker_t;
+
+/**
+ * Forward or backward pass over the sorted lattice.
+ *
+ * The nodes of each level are handed out a few at a time to the
+ * calling thread and the workers, which wait for the next level once
+ * they are all done.  Language model lookups update caches in the
+ * model, so each worker scores with its own copy of it.
+ *
+ * A search keeps its workers and their copies from one pass to the
+ * next, until it is reinitialized or freed.
+ */
+typedef struct latpass_s {
+    ps_lattice_t *dag;
+    ngram_model_t *lmset;
+    float32 lwf;
+    float32 ascale;
+    latpass_func_t func;    /**< Function applied to each node. */
+    int next;               /**< Next node to be taken in this level. */
+    int end;                /**< End of this level. */
+    int n_busy;             /**< Threads still working on this level. */
+    int done;               /**< Workers should exit. */
+    sbevent_t *finished;    /**< Signalled when a level is done. */
+    int n_alloc;            /**< Number of workers allocated. */
+    int n_workers;          /**< Number of workers started. */
+    int n_active;           /**< Number of workers helping with this pass. */
+    latworker_t *workers;
+    ngram_model_t *lm_src;  /**< Model the workers' copies were made from. */
+} latpass_t;
+
+static void
+latpass_work(latpass_t *pass, ngram_model_t *lmset)
+{
+    int i, end;
+
+    while ((i = sbatomic_add(&pass->next, LATPASS_CHUNK) - LATPASS_CHUNK)
+           < pass->end) {
+        end = i + LATPASS_CHUNK;
+        if (end > pass->end)
+            end = pass->end;
+        for (; i < end; ++i)
+            (*pass->func)(pass, lmset, i);
+    }
+}
+
+static int
+latworker_main(sbthread_t *th)
+{
+    latworker_t *w = sbthread_arg(th);
+    latpass_t *pass = w->pass;
+
+    for (;;) {
+        sbevent_wait(w->start, -1, 0);
+        if (pass->done)
+            break;
+        latpass_work(pass, w->lmset);
+        if (sbatomic_add(&pass->n_busy, -1) == 0)
+            sbevent_signal(pass->finished);
+    }
+    return 0;
+}
+
+static int32
+latpass_level_links(ps_lattice_t *dag, int32 l)
+{
+    return dag->exit_idx[dag->level[l + 1]] - dag->exit_idx[dag->level[l]]
+        + dag->entry_idx[dag->level[l + 1]] - dag->entry_idx[dag->level[l]];
+}
+
+/*
+ * Give every worker its own copy of lmset, returning the number of
+ * workers that have one.
+ */
+static int
+latpass_copy_lm(latpass_t *pass, ngram_model_t *lmset)
+{
+    int i;
+
+    if (lmset == pass->lm_src)
+        return pass->n_workers;
+    for (i = 0; i < pass->n_workers; ++i) {
+        latworker_t *w = &pass->workers[i];
+
+        ngram_model_free(w->lmset);
+        w->lmset = NULL;
+        if (lmset && (w->lmset = ngram_model_copy(lmset)) == NULL)
+            break;
+    }
+    /* Try again next time if some copies failed. */
+    pass->lm_src = (i == pass->n_workers) ? lmset : NULL;
+    return i;
+}
+
+static latpass_t *
+latpass_init(ps_lattice_t *dag, ngram_model_t *lmset,
+             float32 lwf, float32 ascale)
+{
+    latpass_t *pass;
+    int32 l, n_workers;
+
+    if (dag->search && dag->search->latpass)
+        pass = dag->search->latpass;
+    else {
+        pass = ckd_calloc(1, sizeof(*pass));
+        if (dag->search)
+            dag->search->latpass = pass;
+    }
+    pass->dag = dag;
+    pass->lmset = lmset;
+    pass->lwf = lwf;
+    pass->ascale = ascale;
+    pass->n_active = 0;
+
+    /* Only use threads if some level is big enough to share. */
+    n_workers = dag->n_threads - 1;
+    for (l = 0; n_workers > 0 && l < dag->n_level; ++l)
+        if (latpass_level_links(dag, l) >= LATPASS_MIN_LINKS)
+            break;
+    if (l == dag->n_level)
+        n_workers = 0;
+    if (n_workers <= 0)
+        return pass;
+
+    /* Bring the copies of the workers started for earlier passes up
+     * to date, then start the ones this search has not needed yet. */
+    pass->n_active = latpass_copy_lm(pass, lmset);
+    if (pass->n_active < pass->n_workers) {
+        E_WARN("Failed to copy language model for lattice thread %d, "
+               "using %d threads\n", pass->n_active + 1, pass->n_active + 1);
+        return pass;
+    }
+    if (pass->workers == NULL) {
+        pass->finished = sbevent_init();
+        pass->workers = ckd_calloc(n_workers, sizeof(*pass->workers));
+        pass->n_alloc = n_workers;
+    }
+    if (n_workers > pass->n_alloc)
+        n_workers = pass->n_alloc;
+    if (pass->n_workers >= n_workers) {
+        pass->n_active = n_workers;
+        return pass;
+    }
+    for (; pass->n_workers < n_workers; ++pass->n_workers) {
+        latworker_t *w = &pass->workers[pass->n_workers];
+
+        memset(w, 0, sizeof(*w));
+        w->pass = pass;
+        if (lmset && (w->lmset = ngram_model_copy(lmset)) == NULL)
+            break;
+        w->start = sbevent_init();
+        if ((w->th = sbthread_start(NULL, latworker_main, w)) == NULL) {
+            sbevent_free(w->start);
+            ngram_model_free(w->lmset);
+            break;
         }
+    }
+    if (pass->n_workers < n_workers)
+        E_WARN("Failed to start lattice thread %d, using %d threads\n",
+               pass->n_workers + 1, pass->n_workers + 1);
+    pass->n_active = pass->n_workers;
+    return pass;
+}
 
-        /* Update scores for all paths exiting link->to. */
-        for (x = link->to->exits; x; x = x->next) {
-            int32 score;
-            int32 w1_wid;
-            int16 w1_is_fil;
+/*
+ * Apply func to every sorted node, one level at a time, going
+ * forward or backward.
+ */
+static void
+latpass_run(latpass_t *pass, latpass_func_t func, int backward)
+{
+    ps_lattice_t *dag = pass->dag;
+    int32 i, l, n;
+
+    pass->func = func;
+    for (n = 0; n < dag->n_level; ++n) {
+        l = backward ? dag->n_level - 1 - n : n;
+        if (pass->n_active == 0
+            || latpass_level_links(dag, l) < LATPASS_MIN_LINKS) {
+            for (i = dag->level[l]; i < dag->level[l + 1]; ++i)
+                (*func)(pass, pass->lmset, i);
+            continue;
+        }
+        pass->next = dag->level[l];
+        pass->end = dag->level[l + 1];
+        pass->n_busy = pass->n_active + 1;
+        for (i = 0; i < pass->n_active; ++i)
+            sbevent_signal(pass->workers[i].start);
+        latpass_work(pass, pass->lmset);
+        if (sbatomic_add(&pass->n_busy, -1) > 0)
+            sbevent_wait(pass->finished, -1, 0);
+    }
+}
 
-            w1_wid = x->link->to->basewid;
-            w1_is_fil = dict_filler_word(ps_search_dict(search), w1_wid) && x->link->to != dag->end;
+/*
+ * Release a pass once it is done, unless a search keeps it.
+ */
+static void
+latpass_finish(latpass_t *pass)
+{
+    if (pass->dag->search == NULL) {
+        ps_lattice_pass_free(pass);
+        return;
+    }
+    pass->dag = NULL;
+    pass->lmset = NULL;
+}
 
-            /* Update alpha with sum of previous alphas. */
-            x->link->alpha = logmath_add(lmath, x->link->alpha, link->alpha + bprob);
+void
+ps_lattice_pass_flush(latpass_t *pass)
+{
+    int i;
+
+    if (pass == NULL)
+        return;
+    for (i = 0; i < pass->n_workers; ++i) {
+        ngram_model_free(pass->workers[i].lmset);
+        pass->workers[i].lmset = NULL;
+    }
+    pass->lm_src = NULL;
+}
+
+void
+ps_lattice_pass_free(latpass_t *pass)
+{
+    int i;
+
+    if (pass == NULL)
+        return;
+    pass->done = TRUE;
+    for (i = 0; i < pass->n_workers; ++i) {
+        latworker_t *w = &pass->workers[i];
+
+        sbevent_signal(w->start);
+        sbthread_wait(w->th);
+        sbthread_free(w->th);
+        sbevent_free(w->start);
+        ngram_model_free(w->lmset);
+    }
+    ckd_free(pass->workers);
+    if (pass->finished)
+        sbevent_free(pass->finished);
+    ckd_free(pass);
+}
+
+/*
+ * Score all links leaving the i-th sorted node.
+ *
+ * The forward probabilities of the links entering the node are summed
+ * once and shared by all of its exits.
+ */
+static void
+bestpath_node(latpass_t *pass, ngram_model_t *lmset, int32 i)
+{
+    ps_lattice_t *dag = pass->dag;
+    ps_latnode_t *node = dag->sorted[i];
+    int32 alpha, e, j;
+
+    if (node == dag->start) {
+        for (j = dag->exit_idx[i]; j < dag->exit_idx[i + 1]; ++j) {
+            ps_latlink_t *link = dag->links[j];
+            int32 n_used;
+            int16 to_is_fil;
+
+            to_is_fil = dict_filler_word(dag->dict, link->to->basewid) && link->to != dag->end;
+
+            /* Best path points to dag->start, obviously. */
+            link->path_scr = link->ascr;
+            if (lmset && !to_is_fil)
+                link->path_scr += (ngram_bg_score(lmset, link->to->basewid,
+                                                  ps_search_start_wid(dag->search),
+                                                  &n_used) >> SENSCR_SHIFT) * pass->lwf;
+            link->best_prev = NULL;
+            /* No predecessors for start links. */
+            link->alpha = (link->ascr << SENSCR_SHIFT) * pass->ascale;
+            latlink_lmctx(dag, lmset, link, &dag->lmctx[j]);
+        }
+        return;
+    }
+
+    /* Sum of previous alphas. */
+    alpha = logmath_get_zero(dag->lmath);
+    for (e = dag->entry_idx[i]; e < dag->entry_idx[i + 1]; ++e) {
+        ps_latlink_t *prev = dag->links[dag->entries[e]];
+
+        if (prev->path_scr != MAX_NEG_INT32)
+            alpha = logmath_add(dag->lmath, alpha,
+                                prev->alpha + dag->lmctx[dag->entries[e]].bprob);
+    }
+
+    for (j = dag->exit_idx[i]; j < dag->exit_idx[i + 1]; ++j) {
+        ps_latlink_t *link = dag->links[j];
+        int32 w1_wid;
+        int16 w1_is_fil;
+
+        w1_wid = link->to->basewid;
+        w1_is_fil = dict_filler_word(dag->dict, w1_wid) && link->to != dag->end;
+        link->path_scr = MAX_NEG_INT32;
+        link->best_prev = NULL;
+        link->alpha = logmath_get_zero(dag->lmath);
+
+        /* Find the best path into this link. */
+        for (e = dag->entry_idx[i]; e < dag->entry_idx[i + 1]; ++e) {
+            ps_latlink_t *prev = dag->links[dag->entries[e]];
+            latlink_lmctx_t *ctx = &dag->lmctx[dag->entries[e]];
+            int32 score, n_used;
 
-            /* Update link score with maximum link score. */
-            score = link->path_scr + x->link->ascr;
+            /* Not reachable from the start node. */
+            if (prev->path_scr == MAX_NEG_INT32)
+                continue;
+            score = prev->path_scr + link->ascr;
             /* Calculate language score for bestpath if possible */
-            if (lmset && !w1_is_fil && !w2_is_fil) {
-                if (w3_is_fil)
+            if (lmset && !w1_is_fil && !ctx->w2_is_fil) {
+                if (ctx->w3_is_fil)
                     /* partial context available */
-                    score += (ngram_bg_score(lmset, w1_wid, w2_wid, &n_used) >> SENSCR_SHIFT) * lwf;
+                    score += (ngram_bg_score(lmset, w1_wid, ctx->w2, &n_used)
+                              >> SENSCR_SHIFT) * pass->lwf;
                 else
                     /* full context available */
-                    score += (ngram_tg_score(lmset, w1_wid, w2_wid, w3_wid, &n_used) >> SENSCR_SHIFT) * lwf;
+                    score += (ngram_tg_score(lmset, w1_wid, ctx->w2, ctx->w3,
+                                             &n_used) >> SENSCR_SHIFT) * pass->lwf;
             }
-
-            if (score BETTER_THAN x->link->path_scr) {
-                x->link->path_scr = score;
-                x->link->best_prev = link;
+            if (score BETTER_THAN link->path_scr) {
+                link->path_scr = score;
+                link->best_prev = prev;
             }
         }
+        if (link->path_scr == MAX_NEG_INT32)
+            continue;
+        /* Add in this link's acoustic score. */
+        link->alpha = alpha + (link->ascr << SENSCR_SHIFT) * pass->ascale;
+        latlink_lmctx(dag, lmset, link, &dag->lmctx[j]);
+    }
+}
+
+/*
+ * Compute backward probabilities for all links entering the i-th
+ * sorted node, from the sum over its exits.
+ */
+static void
+posterior_node(latpass_t *pass, ngram_model_t *lmset, int32 i)
+{
+    ps_lattice_t *dag = pass->dag;
+    ps_latnode_t *node = dag->sorted[i];
+    int32 beta, e, j;
+
+    if (node == dag->end) {
+        /* Imaginary exit link from final node has beta = 1.0 */
+        beta = (dag->final_node_ascr << SENSCR_SHIFT) * pass->ascale;
+    }
+    else if (dag->exit_idx[i] == dag->exit_idx[i + 1]) {
+        /* Dead end, nothing to add the LM probability to. */
+        for (e = dag->entry_idx[i]; e < dag->entry_idx[i + 1]; ++e)
+            dag->links[dag->entries[e]]->beta = logmath_get_zero(dag->lmath);
+        return;
+    }
+    else {
+        beta = logmath_get_zero(dag->lmath);
+        for (j = dag->exit_idx[i]; j < dag->exit_idx[i + 1]; ++j) {
+            ps_latlink_t *link = dag->links[j];
+
+            beta = logmath_add(dag->lmath, beta, link->beta
+                               + (link->ascr << SENSCR_SHIFT) * pass->ascale);
+        }
     }
 
+    for (e = dag->entry_idx[i]; e < dag->entry_idx[i + 1]; ++e) {
+        ps_latlink_t *link = dag->links[dag->entries[e]];
+        latlink_lmctx_t ctx;
+
+        /* Reuse the LM probability from bestpath search if possible. */
+        if (lmset == dag->lmctx_lm)
+            link->beta = beta + dag->lmctx[dag->entries[e]].bprob;
+        else {
+            latlink_lmctx(dag, lmset, link, &ctx);
+            link->beta = beta + ctx.bprob;
+        }
+    }
+}
+
+/*
+ * Find the best score from dag->start to end point of any link and
+ * use it to update links further down the path.  This is like
+ * single-source shortest path search, except that it is done over
+ * edges rather than nodes, which allows us to do exact trigram scoring.
+ *
+ * Helpfully enough, we get half of the posterior probability
+ * calculation for free that way too.  (interesting research topic: is
+ * there a reliable Viterbi analogue to word-level Forward-Backward
+ * like there is for state-level?  Or, is it just lattice density?)
+ */
+ps_latlink_t *
+ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
+                    float32 lwf, float32 ascale)
+{
+    ps_search_t *search;
+    ps_latlink_t *bestend;
+    latlink_list_t *x;
+    logmath_t *lmath;
+    latpass_t *pass;
+    int32 bestescr;
+
+    search = dag->search;
+    lmath = dag->lmath;
+
+    if (ps_lattice_sort(dag) < 0)
+        return NULL;
+
+    /* Go through the links in topological order, updating path
+     * scores and alphas, level by level. */
+    pass = latpass_init(dag, lmset, lwf, ascale);
+    latpass_run(pass, bestpath_node, FALSE);
+    latpass_finish(pass);
+    dag->lmctx_lm = lmset;
+
     /* Find best link entering final node, and calculate normalizer
      * for posterior probabilities. */
     bestend = NULL;
@@ -1440,73 +2187,28 @@ int32
 ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
                      float32 ascale)
 {
-    logmath_t *lmath;
-    ps_latnode_t *node;
-    ps_latlink_t *link;
     latlink_list_t *x;
     ps_latlink_t *bestend;
+    latpass_t *pass;
     int32 bestescr;
 
-    lmath = dag->lmath;
+    /* Normally this is still sorted from bestpath search. */
+    if (ps_lattice_sort(dag) < 0)
+        return 0;
 
-    /* Reset all betas to zero. */
-    for (node = dag->nodes; node; node = node->next) {
-        for (x = node->exits; x; x = x->next) {
-            x->link->beta = logmath_get_zero(lmath);
-        }
-    }
+    /* Accumulate backward probabilities for all links. */
+    pass = latpass_init(dag, lmset, 0, ascale);
+    latpass_run(pass, posterior_node, TRUE);
+    latpass_finish(pass);
 
+    /* Track the best path - we will backtrace in order to calculate
+       the unscaled joint probability for sentence posterior. */
     bestend = NULL;
     bestescr = MAX_NEG_INT32;
-    /* Accumulate backward probabilities for all links. */
-    for (link = ps_lattice_reverse_edges(dag, NULL, NULL);
-         link; link = ps_lattice_reverse_next(dag, NULL)) {
-        int32 bprob, n_used;
-        int32 from_wid, to_wid;
-        int16 from_is_fil, to_is_fil;
-
-        from_wid = link->from->basewid;
-        to_wid = link->to->basewid;
-        from_is_fil = dict_filler_word(dag->dict, from_wid) && link->from != dag->start;
-        to_is_fil = dict_filler_word(dag->dict, to_wid) && link->to != dag->end;
-
-        /* Find word predecessor if from-word is filler */
-        if (!to_is_fil && from_is_fil) {
-            ps_latlink_t *prev_link = link;
-            while (prev_link->best_prev != NULL) {
-                prev_link = prev_link->best_prev;
-                from_wid = prev_link->from->basewid;
-                if (!dict_filler_word(dag->dict, from_wid) || prev_link->from == dag->start) {
-                    from_is_fil = FALSE;
-                    break;
-                }
-            }
-        }
-
-        /* Calculate LM probability. */
-        if (lmset && !from_is_fil && !to_is_fil)
-            bprob = ngram_ng_prob(lmset, to_wid, &from_wid, 1, &n_used);
-        else
-            bprob = 0;
-
-        if (link->to == dag->end) {
-            /* Track the best path - we will backtrace in order to
-               calculate the unscaled joint probability for sentence
-               posterior. */
-            if (link->path_scr BETTER_THAN bestescr) {
-                bestescr = link->path_scr;
-                bestend = link;
-            }
-            /* Imaginary exit link from final node has beta = 1.0 */
-            link->beta = bprob + (dag->final_node_ascr << SENSCR_SHIFT) * ascale;
-        }
-        else {
-            /* Update beta from all outgoing betas. */
-            for (x = link->to->exits; x; x = x->next) {
-                link->beta = logmath_add(lmath, link->beta,
-                                         x->link->beta + bprob
-                                         + (x->link->ascr << SENSCR_SHIFT) * ascale);
-            }
+    for (x = dag->end->entries; x; x = x->next) {
+        if (x->link->path_scr BETTER_THAN bestescr) {
+            bestescr = x->link->path_scr;
+            bestend = x->link;
         }
     }
 
@@ -1520,6 +2222,7 @@ ps_lattice_posterior_prune(ps_lattice_t *dag, int32 beam)
     ps_latlink_t *link;
     int npruned = 0;
 
+    ps_lattice_unsort(dag);
     for (link = ps_lattice_traverse_edges(dag, dag->start, dag->end);
          link; link = ps_lattice_traverse_next(dag, dag->end)) {
         link->from->reachable = FALSE;
@@ -1560,7 +2263,8 @@ ps_lattice_posterior_prune(ps_lattice_t *dag, int32 beam)
 
 
 /* Parameters to prune n-best alternatives search */
-#define MAX_PATHS	500     /* Max allowed active paths at any time */
+#define MAX_PATHS	500     /* Active paths kept by pruning (never more than twice this) */
+#define MAX_SEEN	2000    /* Expanded paths remembered to find duplicates */
 #define MAX_HYP_TRIES	10000
 
 /*
@@ -1597,53 +2301,203 @@ best_rem_score(ps_astar_t *nbest, ps_latnode_t * from)
     return bestscore;
 }
 
+/* Total score of a partial path: exact score so far plus the A* heuristic. */
+#define path_total(p) ((p)->score + (p)->node->info.rem_score)
+
+static void
+heap_up(ps_latpath_t **heap, int32 i)
+{
+    ps_latpath_t *path = heap[i];
+    int32 total = path_total(path);
+
+    while (i > 0) {
+        int32 parent = (i - 1) / 2;
+        if (path_total(heap[parent]) >= total)
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = path;
+}
+
+static void
+heap_down(ps_latpath_t **heap, int32 n, int32 i)
+{
+    ps_latpath_t *path = heap[i];
+    int32 total = path_total(path);
+
+    while (2 * i + 1 < n) {
+        int32 c = 2 * i + 1;
+        if (c + 1 < n && path_total(heap[c + 1]) > path_total(heap[c]))
+            ++c;
+        if (path_total(heap[c]) <= total)
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = path;
+}
+
 /*
- * Insert newpath in sorted (by path score) list of paths.  But if newpath is
- * too far down the list, drop it (FIXME: necessary?)
- * total_score = path score (newpath) + rem_score to end of utt.
+ * Drop a reference to a path, freeing it and any of its ancestors
+ * which are no longer needed.
  */
 static void
-path_insert(ps_astar_t *nbest, ps_latpath_t *newpath, int32 total_score)
+path_release(ps_astar_t *nbest, ps_latpath_t *path)
 {
-    ps_latpath_t *prev, *p;
+    while (path && --path->refcount == 0) {
+        ps_latpath_t *parent = path->parent;
+        listelem_free(nbest->latpath_alloc, path);
+        path = parent;
+    }
+}
+
+/*
+ * Cut the heap down to the MAX_PATHS best partial paths.  This is a
+ * partial heapsort which leaves the survivors at the end of the heap
+ * in increasing order; reversed, they form a valid heap again.
+ */
+static void
+path_prune(ps_astar_t *nbest)
+{
+    ps_latpath_t **heap = nbest->heap;
+    int32 n = nbest->n_path;
     int32 i;
 
-    prev = NULL;
-    for (i = 0, p = nbest->path_list; (i < MAX_PATHS) && p; p = p->next, i++) {
-        if ((p->score + p->node->info.rem_score) < total_score)
-            break;
-        prev = p;
+    for (i = n - 1; i >= n - MAX_PATHS; --i) {
+        ps_latpath_t *best = heap[0];
+        heap[0] = heap[i];
+        heap_down(heap, i, 0);
+        heap[i] = best;
     }
+    for (i = 0; i < n - MAX_PATHS; ++i) {
+        path_release(nbest, heap[i]);
+        nbest->n_hyp_reject++;
+    }
+    for (i = 0; i < MAX_PATHS; ++i)
+        heap[i] = heap[n - 1 - i];
+    nbest->n_path = MAX_PATHS;
+}
 
-    /* newpath should be inserted between prev and p */
-    if (i < MAX_PATHS) {
-        /* Insert new partial hyp */
-        newpath->next = p;
-        if (!prev)
-            nbest->path_list = newpath;
-        else
-            prev->next = newpath;
-        if (!p)
-            nbest->path_tail = newpath;
+/*
+ * Add newpath to the heap of partial paths.  The heap holds up to
+ * twice MAX_PATHS entries, and is pruned back to MAX_PATHS when it
+ * fills up, so pruning costs O(log n) per path.
+ */
+static void
+path_insert(ps_astar_t *nbest, ps_latpath_t *newpath)
+{
+    if (nbest->n_path == 2 * MAX_PATHS)
+        path_prune(nbest);
+    nbest->heap[nbest->n_path] = newpath;
+    heap_up(nbest->heap, nbest->n_path);
+    nbest->n_path++;
+    nbest->n_hyp_insert++;
+}
+
+static ps_latpath_t *
+path_pop(ps_astar_t *nbest)
+{
+    ps_latpath_t *top;
 
-        nbest->n_path++;
-        nbest->n_hyp_insert++;
-        nbest->insert_depth += i;
+    if (nbest->n_path == 0)
+        return NULL;
+    top = nbest->heap[0];
+    if (--nbest->n_path > 0) {
+        nbest->heap[0] = nbest->heap[nbest->n_path];
+        heap_down(nbest->heap, nbest->n_path, 0);
     }
-    else {
-        /* newpath score too low; reject it and also prune paths beyond MAX_PATHS */
-        nbest->path_tail = prev;
-        prev->next = NULL;
-        nbest->n_path = MAX_PATHS;
-        listelem_free(nbest->latpath_alloc, newpath);
+    return top;
+}
 
-        nbest->n_hyp_reject++;
-        for (; p; p = newpath) {
-            newpath = p->next;
-            listelem_free(nbest->latpath_alloc, p);
-            nbest->n_hyp_reject++;
-        }
+/* Does this node contribute a word to the hypothesis string? */
+static int
+path_real_word(ps_astar_t *nbest, ps_latnode_t *node)
+{
+    return dict_real_word(nbest->dag->dict, node->basewid);
+}
+
+/* Extend the hash of the word sequence of parent with node. */
+static uint32
+path_hash(ps_astar_t *nbest, ps_latpath_t *parent, ps_latnode_t *node)
+{
+    uint32 whash = parent ? parent->whash : 0;
+
+    if (path_real_word(nbest, node))
+        whash = whash * 31 + node->basewid + 1;
+    return whash;
+}
+
+/* Do two paths produce the same hypothesis string? */
+static int
+path_same_words(ps_astar_t *nbest, ps_latpath_t *a, ps_latpath_t *b)
+{
+    while (a != b) {
+        while (a && !path_real_word(nbest, a->node))
+            a = a->parent;
+        while (b && !path_real_word(nbest, b->node))
+            b = b->parent;
+        if (a == NULL || b == NULL)
+            return a == b;
+        if (a->node->basewid != b->node->basewid)
+            return FALSE;
+        a = a->parent;
+        b = b->parent;
+    }
+    return TRUE;
+}
+
+/* Forget all the partial paths remembered by path_seen(). */
+static void
+path_seen_flush(ps_astar_t *nbest)
+{
+    glist_t entries;
+    gnode_t *gn;
+
+    entries = hash_table_tolist(nbest->seen, NULL);
+    for (gn = entries; gn; gn = gnode_next(gn)) {
+        hash_entry_t *ent = gnode_ptr(gn);
+        listelem_free(nbest->seen_alloc, (void *)hash_entry_key(ent));
+        path_release(nbest, hash_entry_val(ent));
     }
+    glist_free(entries);
+    hash_table_empty(nbest->seen);
+}
+
+/*
+ * Check whether an equivalent path was already popped from the heap,
+ * and remember this one otherwise.  Complete paths are equivalent if
+ * they have the same words.  Partial paths must also end in the same
+ * node with the same language model context, so that any extension of
+ * the later (and therefore worse) one is also worse than the same
+ * extension of the earlier one.
+ */
+static int
+path_seen(ps_astar_t *nbest, ps_latpath_t *path, int complete)
+{
+    hash_table_t *table = complete ? nbest->returned : nbest->seen;
+    int32 *key;
+    ps_latpath_t *prev;
+
+    /* Only MAX_SEEN partial paths are remembered, which at worst lets
+     * a duplicate be expanded again.  Every returned path is
+     * remembered, so that no hypothesis is returned twice. */
+    if (!complete && hash_table_inuse(table) >= MAX_SEEN)
+        path_seen_flush(nbest);
+    key = listelem_malloc(nbest->seen_alloc);
+    key[0] = complete ? -1 : path->node->id;
+    key[1] = (complete || path->parent == NULL)
+        ? -1 : path->parent->node->basewid;
+    key[2] = (int32)path->whash;
+    prev = hash_table_enter_bkey(table, (char const *)key,
+                                 3 * sizeof(*key), path);
+    if (prev == path) {
+        ++path->refcount;
+        return FALSE;
+    }
+    listelem_free(nbest->seen_alloc, key);
+    /* Hash collisions are not duplicates, just don't record them. */
+    return path_same_words(nbest, prev, path);
 }
 
 /* Find all possible extensions to given partial path */
@@ -1652,7 +2506,6 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
 {
     latlink_list_t *x;
     ps_latpath_t *newpath;
-    int32 total_score, tail_score;
 
     /* Consider all successors of path->node */
     for (x = path->node->exits; x; x = x->next) {
@@ -1666,7 +2519,10 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
         newpath = listelem_malloc(nbest->latpath_alloc);
         newpath->node = x->link->to;
         newpath->parent = path;
+        newpath->refcount = 1;
+        ++path->refcount;
         newpath->score = path->score + x->link->ascr;
+        newpath->whash = path_hash(nbest, path, newpath->node);
         if (nbest->lmset) {
             if (path->parent) {
                 newpath->score += nbest->lwf
@@ -1682,23 +2538,8 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
                        >> SENSCR_SHIFT);
         }
 
-        /* Insert new partial path hypothesis into sorted path_list */
         nbest->n_hyp_tried++;
-        total_score = newpath->score + newpath->node->info.rem_score;
-
-        /* First see if hyp would be worse than the worst */
-        if (nbest->n_path >= MAX_PATHS) {
-            tail_score =
-                nbest->path_tail->score
-                + nbest->path_tail->node->info.rem_score;
-            if (total_score < tail_score) {
-                listelem_free(nbest->latpath_alloc, newpath);
-                nbest->n_hyp_reject++;
-                continue;
-            }
-        }
-
-        path_insert(nbest, newpath, total_score);
+        path_insert(nbest, newpath);
     }
 }
 
@@ -1724,6 +2565,10 @@ ps_astar_start(ps_lattice_t *dag,
     nbest->w1 = w1;
     nbest->w2 = w2;
     nbest->latpath_alloc = listelem_alloc_init(sizeof(ps_latpath_t));
+    nbest->heap = ckd_calloc(2 * MAX_PATHS, sizeof(*nbest->heap));
+    nbest->seen = hash_table_new(MAX_SEEN, HASH_CASE_YES);
+    nbest->returned = hash_table_new(MAX_PATHS, HASH_CASE_YES);
+    nbest->seen_alloc = listelem_alloc_init(3 * sizeof(int32));
 
     /* Initialize rem_score (A* heuristic) to default values */
     for (node = dag->nodes; node; node = node->next) {
@@ -1735,8 +2580,7 @@ ps_astar_start(ps_lattice_t *dag,
             node->info.rem_score = 1;   /* +ve => unknown value */
     }
 
-    /* Create initial partial hypotheses list consisting of nodes starting at sf */
-    nbest->path_list = nbest->path_tail = NULL;
+    /* Create initial partial hypotheses consisting of nodes starting at sf */
     for (node = dag->nodes; node; node = node->next) {
         if (node->sf == sf) {
             ps_latpath_t *path;
@@ -1746,6 +2590,8 @@ ps_astar_start(ps_lattice_t *dag,
             path = listelem_malloc(nbest->latpath_alloc);
             path->node = node;
             path->parent = NULL;
+            path->refcount = 1;
+            path->whash = path_hash(nbest, NULL, node);
             if (nbest->lmset)
                 path->score = nbest->lwf *
                     ((w1 < 0)
@@ -1754,7 +2600,7 @@ ps_astar_start(ps_lattice_t *dag,
             else
                 path->score = 0;
             path->score >>= SENSCR_SHIFT;
-            path_insert(nbest, path, path->score + node->info.rem_score);
+            path_insert(nbest, path);
         }
     }
 
@@ -1769,25 +2615,27 @@ ps_astar_next(ps_astar_t *nbest)
     dag = nbest->dag;
 
     /* Pop the top (best) partial hypothesis */
-    while ((nbest->top = nbest->path_list) != NULL) {
-        nbest->path_list = nbest->path_list->next;
-        if (nbest->top == nbest->path_tail)
-            nbest->path_tail = NULL;
-        nbest->n_path--;
-
-        /* Complete hypothesis? */
-        if ((nbest->top->node->sf >= nbest->ef)
+    while ((nbest->top = path_pop(nbest)) != NULL) {
+        int complete;
+
+        complete = (nbest->top->node->sf >= nbest->ef)
             || ((nbest->top->node == dag->end) &&
-                (nbest->ef > dag->end->sf))) {
-            /* FIXME: Verify that it is non-empty.  Also we may want
-             * to verify that it is actually distinct from other
-             * paths, since often this is not the case*/
-            return nbest->top;
-        }
-        else {
-            if (nbest->top->node->fef < nbest->ef)
-                path_extend(nbest, nbest->top);
+                (nbest->ef > dag->end->sf));
+        /* Popped paths have no extensions yet, so duplicates can
+         * simply be discarded. */
+        if (path_seen(nbest, nbest->top, complete)) {
+            path_release(nbest, nbest->top);
+            nbest->n_hyp_dup++;
+            continue;
         }
+        /* Returned paths keep the heap's reference until
+         * ps_astar_finish(), as the caller may still use them. */
+        if (complete)
+            return nbest->top;
+        if (nbest->top->node->fef < nbest->ef)
+            path_extend(nbest, nbest->top);
+        /* Now only its extensions and path_seen() need it. */
+        path_release(nbest, nbest->top);
     }
 
     /* Did not find any more paths to extend. */
@@ -1927,6 +2775,10 @@ ps_astar_finish(ps_astar_t *nbest)
     glist_free(nbest->hyps);
     /* Free all paths. */
     listelem_alloc_free(nbest->latpath_alloc);
+    ckd_free(nbest->heap);
+    hash_table_free(nbest->seen);
+    hash_table_free(nbest->returned);
+    listelem_alloc_free(nbest->seen_alloc);
     /* Free the Henge. */
     ckd_free(nbest);
 }
@@ -55,6 +55,20 @@ typedef struct latlink_list_s {
     struct latlink_list_s *next;
 } latlink_list_t;
 
+/**
+ * Language model context of a link, as seen by the links following it.
+ *
+ * Filled in by bestpath search, which finds the word history of each
+ * link by following best_prev back past any filler words.
+ */
+typedef struct latlink_lmctx_s {
+    int32 bprob;       /**< Unscaled LM probability of to-word given from-word. */
+    int32 w2;          /**< Last word of the history, or a filler. */
+    int32 w3;          /**< Word before w2, or a filler. */
+    int16 w2_is_fil;   /**< No word was found for w2. */
+    int16 w3_is_fil;   /**< No word was found for w3. */
+} latlink_lmctx_t;
+
 /**
  * Word graph structure used in bestpath/nbest search.
  */
@@ -84,6 +98,21 @@ struct ps_lattice_s {
     /* This will probably be replaced with a heap. */
     latlink_list_t *q_head; /**< Queue of links for traversal. */
     latlink_list_t *q_tail; /**< Queue of links for traversal. */
+
+    /* Topologically sorted form, built by bestpath search and thrown
+     * away when links are added or removed. */
+    int32 n_sorted;         /**< Number of nodes in sorted. */
+    int32 n_level;          /**< Number of levels in sorted. */
+    ps_latnode_t **sorted;  /**< Nodes by length of the longest path reaching them. */
+    int32 *level;           /**< Start of each level in sorted (n_level + 1). */
+    int32 n_links;          /**< Number of links in links. */
+    ps_latlink_t **links;   /**< Links grouped by from-node, in the order of sorted. */
+    int32 *exit_idx;        /**< Start of each sorted node's exits in links (n_sorted + 1). */
+    int32 *entries;         /**< Indices in links of the entries of each sorted node. */
+    int32 *entry_idx;       /**< Start of each sorted node's entries in entries (n_sorted + 1). */
+    latlink_lmctx_t *lmctx; /**< Language model context of each link in links. */
+    ngram_model_t *lmctx_lm; /**< Language model lmctx was computed with. */
+    int n_threads;          /**< Number of threads for bestpath and posteriors. */
 };
 
 /**
@@ -153,8 +182,9 @@ typedef struct dag_seg_s {
 typedef struct ps_latpath_s {
     ps_latnode_t *node;            /**< Node ending this path. */
     struct ps_latpath_s *parent;   /**< Previous element in this path. */
-    struct ps_latpath_s *next;     /**< Pointer to next path in list of paths. */
     int32 score;                  /**< Exact score from start node up to node->sf. */
+    uint32 whash;                 /**< Hash of the real words in this path. */
+    int32 refcount;               /**< Extensions, plus the heap or table holding it. */
 } ps_latpath_t;
 
 /**
@@ -173,13 +203,15 @@ typedef struct ps_astar_s {
     int32 n_hyp_tried;
     int32 n_hyp_insert;
     int32 n_hyp_reject;
-    int32 insert_depth;
+    int32 n_hyp_dup;
     int32 n_path;
 
-    ps_latpath_t *path_list;
-    ps_latpath_t *path_tail;
+    ps_latpath_t **heap;       /**< Partial paths, a max-heap on total score. */
     ps_latpath_t *top;
 
+    hash_table_t *seen;        /**< Partial paths already expanded (bounded). */
+    hash_table_t *returned;    /**< Word sequences already returned. */
+    listelem_alloc_t *seen_alloc;    /**< Keys for seen and returned. */
     glist_t hyps;	             /**< List of hypothesis strings. */
     listelem_alloc_t *latpath_alloc; /**< Path allocator for N-best search. */
 } ps_astar_t;
@@ -199,6 +231,17 @@ typedef struct astar_seg_s {
  */
 ps_lattice_t *ps_lattice_init_search(ps_search_t *search, int n_frame);
 
+/**
+ * Free the language model copies of a search's lattice threads, so
+ * that the next bestpath or posterior pass makes them again.
+ */
+void ps_lattice_pass_flush(struct latpass_s *pass);
+
+/**
+ * Stop a search's lattice threads and free their language models.
+ */
+void ps_lattice_pass_free(struct latpass_s *pass);
+
 /**
  * Insert penalty for fillers
  */
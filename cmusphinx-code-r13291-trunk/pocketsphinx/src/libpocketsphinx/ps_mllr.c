@@ -44,6 +44,7 @@
 
 /* SphinxBase headers. */
 #include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "acmod.h"
@@ -137,19 +138,19 @@ error_out:
 ps_mllr_t *
 ps_mllr_retain(ps_mllr_t *mllr)
 {
-    ++mllr->refcnt;
+    sbatomic_add(&mllr->refcnt, 1);
     return mllr;
 }
 
 int
 ps_mllr_free(ps_mllr_t *mllr)
 {
-    int i;
+    int i, refcnt;
 
     if (mllr == NULL)
         return 0;
-    if (--mllr->refcnt > 0)
-        return mllr->refcnt;
+    if ((refcnt = sbatomic_add(&mllr->refcnt, -1)) > 0)
+        return refcnt;
 
     for (i = 0; i < mllr->n_feat; ++i) {
         if (mllr->A)
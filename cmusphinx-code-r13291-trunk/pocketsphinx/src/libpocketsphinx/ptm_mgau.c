@@ -55,6 +55,7 @@
 #include <sphinxbase/bio.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/prim_type.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers */
 #include "tied_mgau_common.h"
@@ -64,7 +65,9 @@ static ps_mgaufuncs_t ptm_mgau_funcs = {
     "ptm",
     ptm_mgau_frame_eval,      /* frame_eval */
     ptm_mgau_mllr_transform,  /* transform */
-    ptm_mgau_free             /* free */
+    ptm_mgau_free,            /* free */
+    ptm_mgau_batch_eval,      /* batch_eval */
+    ptm_mgau_copy             /* copy */
 };
 
 #define COMPUTE_GMM_MAP(_idx)                           \
@@ -226,30 +229,38 @@ eval_cb(ptm_mgau_t *s, int cb, int feat, mfcc_t *z)
 }
 
 /**
- * Compute top-N densities for active codebooks (and prune)
+ * Compute top-N densities for one codebook, if active.
  */
-static int
-ptm_mgau_codebook_eval(ptm_mgau_t *s, mfcc_t **z, int frame)
+static void
+ptm_mgau_codebook_eval_cb(ptm_mgau_t *s, int cb, mfcc_t **z, int frame)
 {
-    int i, j;
+    int j;
 
     /* First evaluate top-N from previous frame. */
-    for (i = 0; i < s->g->n_mgau; ++i)
-        for (j = 0; j < s->g->n_feat; ++j)
-            eval_topn(s, i, j, z[j]);
+    for (j = 0; j < s->g->n_feat; ++j)
+        eval_topn(s, cb, j, z[j]);
 
     /* If frame downsampling is in effect, possibly do nothing else. */
     if (frame % s->ds_ratio)
-        return 0;
+        return;
 
     /* Evaluate remaining codebooks. */
-    for (i = 0; i < s->g->n_mgau; ++i) {
-        if (bitvec_is_clear(s->f->mgau_active, i))
-            continue;
-        for (j = 0; j < s->g->n_feat; ++j) {
-            eval_cb(s, i, j, z[j]);
-        }
-    }
+    if (bitvec_is_clear(s->f->mgau_active, cb))
+        return;
+    for (j = 0; j < s->g->n_feat; ++j)
+        eval_cb(s, cb, j, z[j]);
+}
+
+/**
+ * Compute top-N densities for active codebooks (and prune)
+ */
+static int
+ptm_mgau_codebook_eval(ptm_mgau_t *s, mfcc_t **z, int frame)
+{
+    int i;
+
+    for (i = 0; i < s->g->n_mgau; ++i)
+        ptm_mgau_codebook_eval_cb(s, i, z, frame);
     return 0;
 }
 
@@ -320,99 +331,182 @@ ptm_mgau_calc_cb_active(ptm_mgau_t *s, uint8 *senone_active,
 }
 
 /**
- * Compute senone scores from top-N densities for active codebooks.
+ * Sort active senones by codebook (counting sort, since they are
+ * already sorted by senone ID within each codebook).
  */
-static int
-ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
-                     uint8 *senone_active, int32 n_senone_active,
-                     int compall)
+static void
+ptm_mgau_sort_active(ptm_mgau_t *s, uint8 *senone_active,
+                     int32 n_senone_active)
 {
-    int i, lastsen, bestscore;
+    int32 *idx = s->active_idx;
+    int i, cb, lastsen;
 
-    memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
-    /* FIXME: This is the non-cache-efficient way to do this.  We want
-     * to evaluate one codeword at a time but this requires us to have
-     * a reverse codebook to senone mapping, which we don't have
-     * (yet), since different codebooks have different top-N
-     * codewords. */
-    if (compall)
-        n_senone_active = s->n_sen;
-    bestscore = 0x7fffffff;
+    memset(idx, 0, (s->g->n_mgau + 1) * sizeof(*idx));
     for (lastsen = i = 0; i < n_senone_active; ++i) {
-        int sen, f, cb;
-        int ascore;
-
-        if (compall)
-            sen = i;
-        else
-            sen = senone_active[i] + lastsen;
+        int sen = senone_active[i] + lastsen;
+        ++idx[s->sen2cb[sen] + 1];
         lastsen = sen;
-        cb = s->sen2cb[sen];
-
-        if (bitvec_is_clear(s->f->mgau_active, cb)) {
-            int j;
-            /* Because senone_active is deltas we can't really "knock
-             * out" senones from pruned codebooks, and in any case,
-             * it wouldn't make any difference to the search code,
-             * which doesn't expect senone_active to change. */
-            for (f = 0; f < s->g->n_feat; ++f) {
-                for (j = 0; j < s->max_topn; ++j) {
-                    s->f->topn[cb][f][j].score = MAX_NEG_ASCR;
-                }
-            }
-        }
-        /* For each feature, log-sum codeword scores + mixw to get
-         * feature density, then sum (multiply) to get ascore */
-        ascore = 0;
+    }
+    for (cb = 0; cb < s->g->n_mgau; ++cb)
+        idx[cb + 1] += idx[cb];
+    /* Fill in, advancing each codebook's start to its end... */
+    for (lastsen = i = 0; i < n_senone_active; ++i) {
+        int sen = senone_active[i] + lastsen;
+        s->active_sen[idx[s->sen2cb[sen]]++] = sen;
+        lastsen = sen;
+    }
+    /* ...then shift them back. */
+    for (cb = s->g->n_mgau; cb > 0; --cb)
+        idx[cb] = idx[cb - 1];
+    idx[0] = 0;
+}
+
+/**
+ * Get the senones to be scored, sorted by codebook.
+ */
+static void
+ptm_mgau_senone_list(ptm_mgau_t *s, uint8 *senone_active,
+                     int32 n_senone_active, int compall,
+                     int32 **out_sen, int32 **out_sen_idx)
+{
+    if (compall) {
+        *out_sen_idx = s->cb2sen_idx;
+        *out_sen = s->cb2sen;
+    }
+    else {
+        ptm_mgau_sort_active(s, senone_active, n_senone_active);
+        *out_sen_idx = s->active_idx;
+        *out_sen = s->active_sen;
+    }
+}
+
+/**
+ * Compute senone scores from top-N densities for one codebook,
+ * returning the best one.
+ *
+ * This is done one codeword at a time, so that each row of mixture
+ * weights is read once, sequentially, for all the senones which share
+ * the codebook.
+ */
+static int
+ptm_mgau_senone_eval_cb(ptm_mgau_t *s, int16 *senone_scores, int cb,
+                        int32 const *cbsen, int n_cbsen)
+{
+    int32 *fden = s->fden;
+    int32 *ascore = s->ascore;
+    int f, k, bestscore;
+
+    if (bitvec_is_clear(s->f->mgau_active, cb)) {
+        int j;
+        /* Because senone_active is deltas we can't really "knock
+         * out" senones from pruned codebooks, and in any case,
+         * it wouldn't make any difference to the search code,
+         * which doesn't expect senone_active to change. */
         for (f = 0; f < s->g->n_feat; ++f) {
-            ptm_topn_t *topn;
-            int j, fden = 0;
-            topn = s->f->topn[cb][f];
             for (j = 0; j < s->max_topn; ++j) {
-                int mixw;
-                /* Find mixture weight for this codeword. */
-                if (s->mixw_cb) {
-                    int dcw = s->mixw[f][topn[j].cw][sen/2];
+                s->f->topn[cb][f][j].score = MAX_NEG_ASCR;
+            }
+        }
+    }
+    /* For each feature, log-sum codeword scores + mixw to get
+     * feature density, then sum (multiply) to get ascore */
+    memset(ascore, 0, n_cbsen * sizeof(*ascore));
+    for (f = 0; f < s->g->n_feat; ++f) {
+        ptm_topn_t *topn = s->f->topn[cb][f];
+        int j;
+
+        for (j = 0; j < s->max_topn; ++j) {
+            uint8 *mixw = s->mixw[f][topn[j].cw];
+            int32 score = topn[j].score;
+
+            /* Find mixture weight for this codeword. */
+            if (s->mixw_cb) {
+                for (k = 0; k < n_cbsen; ++k) {
+                    int dcw = mixw[cbsen[k] / 2];
                     dcw = (dcw & 1) ? dcw >> 4 : dcw & 0x0f;
-                    mixw = s->mixw_cb[dcw];
+                    if (j == 0)
+                        fden[k] = s->mixw_cb[dcw] + score;
+                    else
+                        fden[k] = fast_logmath_add(s->lmath_8b, fden[k],
+                                                   s->mixw_cb[dcw] + score);
                 }
-                else {
-                    mixw = s->mixw[f][topn[j].cw][sen];
-                }
-                if (j == 0)
-                    fden = mixw + topn[j].score;
-                else
-                    fden = fast_logmath_add(s->lmath_8b, fden,
-                                       mixw + topn[j].score);
-                E_DEBUG("fden[%d][%d] l+= %d + %d = %d\n",
-                        sen, f, mixw, topn[j].score, fden);
             }
-            ascore += fden;
+            else if (j == 0) {
+                for (k = 0; k < n_cbsen; ++k)
+                    fden[k] = mixw[cbsen[k]] + score;
+            }
+            else {
+                for (k = 0; k < n_cbsen; ++k)
+                    fden[k] = fast_logmath_add(s->lmath_8b, fden[k],
+                                               mixw[cbsen[k]] + score);
+            }
         }
-        if (ascore < bestscore) bestscore = ascore;
-        senone_scores[sen] = ascore;
+        for (k = 0; k < n_cbsen; ++k)
+            ascore[k] += fden[k];
+    }
+    bestscore = 0x7fffffff;
+    for (k = 0; k < n_cbsen; ++k) {
+        if (ascore[k] < bestscore) bestscore = ascore[k];
+        senone_scores[cbsen[k]] = ascore[k];
     }
-    /* Normalize the scores again (finishing the job we started above
-     * in ptm_mgau_codebook_eval...) */
+    return bestscore;
+}
+
+/**
+ * Normalize the scores again (finishing the job we started above in
+ * ptm_mgau_codebook_eval...)
+ */
+static void
+ptm_mgau_senone_norm(ptm_mgau_t *s, int16 *senone_scores, int bestscore)
+{
+    int i;
+
     for (i = 0; i < s->n_sen; ++i) {
         senone_scores[i] -= bestscore;
     }
+}
+
+/**
+ * Compute senone scores from top-N densities for active codebooks.
+ */
+static int
+ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
+                     uint8 *senone_active, int32 n_senone_active,
+                     int compall)
+{
+    int32 *sen_idx, *sen;
+    int cb, bestscore;
+
+    memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
+    ptm_mgau_senone_list(s, senone_active, n_senone_active, compall,
+                         &sen, &sen_idx);
+    bestscore = 0x7fffffff;
+    for (cb = 0; cb < s->g->n_mgau; ++cb) {
+        int n_cbsen = sen_idx[cb + 1] - sen_idx[cb];
+        int cbbest;
+
+        if (n_cbsen == 0)
+            continue;
+        cbbest = ptm_mgau_senone_eval_cb(s, senone_scores, cb,
+                                         sen + sen_idx[cb], n_cbsen);
+        if (cbbest < bestscore)
+            bestscore = cbbest;
+    }
+    ptm_mgau_senone_norm(s, senone_scores, bestscore);
 
     return 0;
 }
 
 /**
- * Compute senone scores for the active senones.
+ * Set up top-N history for a frame.  Returns TRUE if codebooks need
+ * to be evaluated for it, FALSE if it is a past frame for which we
+ * already have them.
  */
-int32
-ptm_mgau_frame_eval(ps_mgau_t *ps,
-                    int16 *senone_scores,
-                    uint8 *senone_active,
-                    int32 n_senone_active,
-                    mfcc_t ** featbuf, int32 frame,
-                    int32 compallsen)
+static int
+ptm_mgau_frame_start(ptm_mgau_t *s, uint8 *senone_active,
+                     int32 n_senone_active, int32 frame,
+                     int32 compallsen)
 {
-    ptm_mgau_t *s = (ptm_mgau_t *)ps;
     int fast_eval_idx;
 
     /* Find the appropriate frame in the rotating history buffer
@@ -426,7 +520,7 @@ ptm_mgau_frame_eval(ps_mgau_t *ps,
     /* Compute the top-N codewords for every codebook, unless this
      * is a past frame, in which case we already have them (we
      * hope!) */
-    if (frame >= ps_mgau_base(ps)->frame_idx) {
+    if (frame >= ps_mgau_base(s)->frame_idx) {
         ptm_fast_eval_t *lastf;
         /* Get the previous frame's top-N information (on the
          * first frame of the input this is just all WORST_DIST,
@@ -441,6 +535,26 @@ ptm_mgau_frame_eval(ps_mgau_t *ps,
         /* Generate initial active codebook list (this might not be
          * necessary) */
         ptm_mgau_calc_cb_active(s, senone_active, n_senone_active, compallsen);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Compute senone scores for the active senones.
+ */
+int32
+ptm_mgau_frame_eval(ps_mgau_t *ps,
+                    int16 *senone_scores,
+                    uint8 *senone_active,
+                    int32 n_senone_active,
+                    mfcc_t ** featbuf, int32 frame,
+                    int32 compallsen)
+{
+    ptm_mgau_t *s = (ptm_mgau_t *)ps;
+
+    if (ptm_mgau_frame_start(s, senone_active, n_senone_active,
+                             frame, compallsen)) {
         /* Now evaluate top-N, prune, and evaluate remaining codebooks. */
         ptm_mgau_codebook_eval(s, featbuf, frame);
         ptm_mgau_codebook_norm(s, featbuf, frame);
@@ -452,6 +566,74 @@ ptm_mgau_frame_eval(ps_mgau_t *ps,
     return 0;
 }
 
+/**
+ * Compute senone scores for one frame of several streams, one
+ * codebook at a time.
+ */
+int
+ptm_mgau_batch_eval(ps_mgau_frame_t *frames, int32 n_frames)
+{
+    int i, cb, n_mgau;
+
+    /* eval_idx is set if the top-N codewords must be computed. */
+    n_mgau = 0;
+    for (i = 0; i < n_frames; ++i) {
+        ptm_mgau_t *s = (ptm_mgau_t *)frames[i].mgau;
+        frames[i].eval_idx = ptm_mgau_frame_start(s, frames[i].senone_active,
+                                                  frames[i].n_senone_active,
+                                                  frames[i].frame,
+                                                  frames[i].compallsen);
+        if (s->g->n_mgau > n_mgau)
+            n_mgau = s->g->n_mgau;
+    }
+
+    /* Top-N densities, for each codebook in all streams. */
+    for (cb = 0; cb < n_mgau; ++cb) {
+        for (i = 0; i < n_frames; ++i) {
+            ptm_mgau_t *s = (ptm_mgau_t *)frames[i].mgau;
+            if (frames[i].eval_idx && cb < s->g->n_mgau)
+                ptm_mgau_codebook_eval_cb(s, cb, frames[i].feat,
+                                          frames[i].frame);
+        }
+    }
+    for (i = 0; i < n_frames; ++i) {
+        ptm_mgau_t *s = (ptm_mgau_t *)frames[i].mgau;
+        if (frames[i].eval_idx)
+            ptm_mgau_codebook_norm(s, frames[i].feat, frames[i].frame);
+        memset(frames[i].senscr, 0, s->n_sen * sizeof(*frames[i].senscr));
+        ptm_mgau_senone_list(s, frames[i].senone_active,
+                             frames[i].n_senone_active,
+                             frames[i].compallsen,
+                             &frames[i].sen, &frames[i].sen_idx);
+        frames[i].bestscore = 0x7fffffff;
+    }
+
+    /* Senone scores, for each codebook in all streams. */
+    for (cb = 0; cb < n_mgau; ++cb) {
+        for (i = 0; i < n_frames; ++i) {
+            ptm_mgau_t *s = (ptm_mgau_t *)frames[i].mgau;
+            int32 *sen_idx = frames[i].sen_idx;
+            int n_cbsen, cbbest;
+
+            if (cb >= s->g->n_mgau)
+                continue;
+            n_cbsen = sen_idx[cb + 1] - sen_idx[cb];
+            if (n_cbsen == 0)
+                continue;
+            cbbest = ptm_mgau_senone_eval_cb(s, frames[i].senscr, cb,
+                                             frames[i].sen + sen_idx[cb],
+                                             n_cbsen);
+            if (cbbest < frames[i].bestscore)
+                frames[i].bestscore = cbbest;
+        }
+    }
+    for (i = 0; i < n_frames; ++i)
+        ptm_mgau_senone_norm((ptm_mgau_t *)frames[i].mgau,
+                             frames[i].senscr, frames[i].bestscore);
+
+    return 0;
+}
+
 static int32
 read_sendump(ptm_mgau_t *s, bin_mdef_t *mdef, char const *file)
 {
@@ -765,12 +947,51 @@ read_mixw(ptm_mgau_t * s, char const *file_name, double SmoothMin)
     return n_sen;
 }
 
+/**
+ * Allocate scoring state which is not shared between instances.
+ */
+static void
+ptm_mgau_init_state(ptm_mgau_t *s)
+{
+    int i;
+
+    s->active_idx = ckd_calloc(s->g->n_mgau + 1, sizeof(*s->active_idx));
+    s->active_sen = ckd_calloc(s->n_sen, sizeof(*s->active_sen));
+    s->fden = ckd_calloc(s->n_sen, sizeof(*s->fden));
+    s->ascore = ckd_calloc(s->n_sen, sizeof(*s->ascore));
+
+    s->hist = ckd_calloc(s->n_fast_hist, sizeof(*s->hist));
+    /* s->f will be a rotating pointer into s->hist. */
+    s->f = s->hist;
+    for (i = 0; i < s->n_fast_hist; ++i) {
+        int j, k, m;
+        /* Top-N codewords for every codebook and feature. */
+        s->hist[i].topn = ckd_calloc_3d(s->g->n_mgau, s->g->n_feat,
+                                        s->max_topn, sizeof(ptm_topn_t));
+        /* Initialize them to sane (yet arbitrary) defaults. */
+        for (j = 0; j < s->g->n_mgau; ++j) {
+            for (k = 0; k < s->g->n_feat; ++k) {
+                for (m = 0; m < s->max_topn; ++m) {
+                    s->hist[i].topn[j][k][m].cw = m;
+                    s->hist[i].topn[j][k][m].score = WORST_DIST;
+                }
+            }
+        }
+        /* Active codebook mapping (just codebook, not features,
+           at least not yet) */
+        s->hist[i].mgau_active = bitvec_alloc(s->g->n_mgau);
+        /* Start with them all on, prune them later. */
+        bitvec_set_all(s->hist[i].mgau_active, s->g->n_mgau);
+    }
+}
+
 ps_mgau_t *
 ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
 {
     ptm_mgau_t *s;
     ps_mgau_t *ps;
     char const *sendump_path;
+    int32 *n_cbsen;
     int i;
 
     s = ckd_calloc(1, sizeof(*s));
@@ -789,10 +1010,13 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
     }
 
     /* Read means and variances. */
-    if ((s->g = gauden_init(cmd_ln_str_r(s->config, "_mean"),
-                            cmd_ln_str_r(s->config, "_var"),
-                            cmd_ln_float32_r(s->config, "-varfloor"),
-                            s->lmath)) == NULL) {
+    if (acmod_am_for(acmod, "-mean", "-var"))
+        s->g = gauden_init_am(acmod->am, s->lmath);
+    if (s->g == NULL
+        && (s->g = gauden_init(cmd_ln_str_r(s->config, "_mean"),
+                               cmd_ln_str_r(s->config, "_var"),
+                               cmd_ln_float32_r(s->config, "-varfloor"),
+                               s->lmath)) == NULL) {
         E_ERROR("Failed to read means and variances\n");	
         goto error_out;
     }
@@ -821,7 +1045,14 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
         }
     }
     /* Read mixture weights. */
-    if ((sendump_path = cmd_ln_str_r(s->config, "_sendump"))) {
+    if (acmod_am_for(acmod, "-sendump", "-mixw")
+        && (s->mixw = bin_am_sendump(acmod->am, s->g->n_feat, s->g->n_density,
+                                     bin_mdef_n_sen(mdef),
+                                     &s->mixw_cb)) != NULL) {
+        s->n_sen = bin_mdef_n_sen(mdef);
+        s->am = bin_am_retain(acmod->am);
+    }
+    else if ((sendump_path = cmd_ln_str_r(s->config, "_sendump"))) {
         if (read_sendump(s, acmod->mdef, sendump_path) < 0) {
             goto error_out;
         }
@@ -842,36 +1073,29 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
     for (i = 0; i < s->n_sen; ++i)
         s->sen2cb[i] = bin_mdef_sen2cimap(acmod->mdef, i);
 
+    /* Build the reverse mapping, for codeword-major evaluation. */
+    s->cb2sen_idx = ckd_calloc(s->g->n_mgau + 1, sizeof(*s->cb2sen_idx));
+    s->cb2sen = ckd_calloc(s->n_sen, sizeof(*s->cb2sen));
+    for (i = 0; i < s->n_sen; ++i)
+        ++s->cb2sen_idx[s->sen2cb[i] + 1];
+    for (i = 0; i < s->g->n_mgau; ++i)
+        s->cb2sen_idx[i + 1] += s->cb2sen_idx[i];
+    n_cbsen = ckd_calloc(s->g->n_mgau, sizeof(*n_cbsen));
+    for (i = 0; i < s->n_sen; ++i) {
+        int cb = s->sen2cb[i];
+        s->cb2sen[s->cb2sen_idx[cb] + n_cbsen[cb]++] = i;
+    }
+    ckd_free(n_cbsen);
+
     /* Allocate fast-match history buffers.  We need enough for the
      * phoneme lookahead window, plus the current frame, plus one for
      * good measure? (FIXME: I don't remember why) */
     s->n_fast_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2;
-    s->hist = ckd_calloc(s->n_fast_hist, sizeof(*s->hist));
-    /* s->f will be a rotating pointer into s->hist. */
-    s->f = s->hist;
-    for (i = 0; i < s->n_fast_hist; ++i) {
-        int j, k, m;
-        /* Top-N codewords for every codebook and feature. */
-        s->hist[i].topn = ckd_calloc_3d(s->g->n_mgau, s->g->n_feat,
-                                        s->max_topn, sizeof(ptm_topn_t));
-        /* Initialize them to sane (yet arbitrary) defaults. */
-        for (j = 0; j < s->g->n_mgau; ++j) {
-            for (k = 0; k < s->g->n_feat; ++k) {
-                for (m = 0; m < s->max_topn; ++m) {
-                    s->hist[i].topn[j][k][m].cw = m;
-                    s->hist[i].topn[j][k][m].score = WORST_DIST;
-                }
-            }
-        }
-        /* Active codebook mapping (just codebook, not features,
-           at least not yet) */
-        s->hist[i].mgau_active = bitvec_alloc(s->g->n_mgau);
-        /* Start with them all on, prune them later. */
-        bitvec_set_all(s->hist[i].mgau_active, s->g->n_mgau);
-    }
+    ptm_mgau_init_state(s);
 
     ps = (ps_mgau_t *)s;
     ps->vt = &ptm_mgau_funcs;
+    ps->refcount = 1;
     return ps;
 error_out:
     ptm_mgau_free(ps_mgau_base(s));
@@ -892,9 +1116,35 @@ ptm_mgau_free(ps_mgau_t *ps)
     int i;
     ptm_mgau_t *s = (ptm_mgau_t *)ps;
 
+    if (sbatomic_add(&ps->refcount, -1) > 0)
+        return;
+
     logmath_free(s->lmath);
     logmath_free(s->lmath_8b);
-    if (s->sendump_mmap) {
+    ckd_free(s->active_sen);
+    ckd_free(s->active_idx);
+    ckd_free(s->fden);
+    ckd_free(s->ascore);
+    if (s->hist) {
+        for (i = 0; i < s->n_fast_hist; i++) {
+            ckd_free_3d(s->hist[i].topn);
+            bitvec_free(s->hist[i].mgau_active);
+        }
+        ckd_free(s->hist);
+    }
+
+    /* Parameters belong to another instance. */
+    if (ps->shared) {
+        ps_mgau_free(ps->shared);
+        ckd_free(s);
+        return;
+    }
+
+    if (s->am) {
+        ckd_free_2d(s->mixw);
+        bin_am_free(s->am);
+    }
+    else if (s->sendump_mmap) {
         ckd_free_2d(s->mixw); 
         mmio_file_unmap(s->sendump_mmap);
     }
@@ -902,13 +1152,29 @@ ptm_mgau_free(ps_mgau_t *ps)
         ckd_free_3d(s->mixw);
     }
     ckd_free(s->sen2cb);
-    
-    for (i = 0; i < s->n_fast_hist; i++) {
-	ckd_free_3d(s->hist[i].topn);
-	bitvec_free(s->hist[i].mgau_active);
-    }
-    ckd_free(s->hist);
-    
+    ckd_free(s->cb2sen);
+    ckd_free(s->cb2sen_idx);
     gauden_free(s->g);
     ckd_free(s);
 }
+
+ps_mgau_t *
+ptm_mgau_copy(ps_mgau_t *ps)
+{
+    ptm_mgau_t *other = (ptm_mgau_t *)ps;
+    ptm_mgau_t *s;
+
+    /* Start with the same parameters and settings. */
+    s = ckd_calloc(1, sizeof(*s));
+    *s = *other;
+    s->base.frame_idx = 0;
+    s->base.refcount = 1;
+    s->base.shared = ps_mgau_retain(ps->shared ? ps->shared : ps);
+    s->lmath = logmath_retain(other->lmath);
+    s->lmath_8b = logmath_retain(other->lmath_8b);
+
+    /* But not the same state. */
+    ptm_mgau_init_state(s);
+
+    return ps_mgau_base(s);
+}
@@ -71,9 +71,16 @@ struct ptm_mgau_s {
     gauden_t *g;        /**< Set of Gaussians. */
     int32 n_sen;       /**< Number of senones. */
     uint8 *sen2cb;     /**< Senone to codebook mapping. */
+    int32 *cb2sen;     /**< Senones sorted by codebook (reverse of sen2cb). */
+    int32 *cb2sen_idx; /**< Start of each codebook's senones in cb2sen (n_mgau + 1). */
+    int32 *active_sen; /**< Active senones for current frame, sorted by codebook. */
+    int32 *active_idx; /**< Start of each codebook's senones in active_sen (n_mgau + 1). */
+    int32 *fden;       /**< Feature densities for senones in one codebook. */
+    int32 *ascore;     /**< Acoustic scores for senones in one codebook. */
     uint8 ***mixw;     /**< Mixture weight distributions by feature, codeword, senone */
     mmio_file_t *sendump_mmap;/* Memory map for mixw (or NULL if not mmap) */
     uint8 *mixw_cb;    /* Mixture weight codebook, if any (assume it contains 16 values) */
+    bin_am_t *am;      /**< Binary acoustic model holding mixw (if any) */
     int16 max_topn;
     int16 ds_ratio;
 
@@ -96,6 +103,9 @@ int ptm_mgau_frame_eval(ps_mgau_t *s,
                         mfcc_t **featbuf,
                         int32 frame,
                         int32 compallsen);
+ps_mgau_t *ptm_mgau_copy(ps_mgau_t *s);
+int ptm_mgau_batch_eval(ps_mgau_frame_t *frames,
+                        int32 n_frames);
 int ptm_mgau_mllr_transform(ps_mgau_t *s,
                             ps_mllr_t *mllr);
 
@@ -55,6 +55,7 @@
 #include <sphinxbase/bio.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/prim_type.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers */
 #include "s2_semi_mgau.h"
@@ -64,7 +65,9 @@ static ps_mgaufuncs_t s2_semi_mgau_funcs = {
     "s2_semi",
     s2_semi_mgau_frame_eval,      /* frame_eval */
     s2_semi_mgau_mllr_transform,  /* transform */
-    s2_semi_mgau_free             /* free */
+    s2_semi_mgau_free,            /* free */
+    s2_semi_mgau_batch_eval,      /* batch_eval */
+    s2_semi_mgau_copy             /* copy */
 };
 
 struct vqFeature_s {
@@ -829,6 +832,62 @@ get_scores_4b_feat_all(s2_semi_mgau_t * s, int i, int topn, int16 *senone_scores
     return 0;
 }
 
+/*
+ * Set up top-N history for a frame.
+ */
+static int
+s2_semi_mgau_frame_start(s2_semi_mgau_t *s, int16 *senone_scores,
+                         int32 frame)
+{
+    int topn_idx;
+
+    memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
+    /* No bounds checking is done here, which just means you'll get
+     * semi-random crap if you request a frame in the future or one
+     * that's too far in the past. */
+    topn_idx = frame % s->n_topn_hist;
+    s->f = s->topn_hist[topn_idx];
+    return topn_idx;
+}
+
+/*
+ * Compute top-N codewords and senone scores for one feature stream.
+ */
+static void
+s2_semi_mgau_feat_eval(s2_semi_mgau_t *s, int i, int topn_idx,
+                       int16 *senone_scores,
+                       uint8 *senone_active,
+                       int32 n_senone_active,
+                       mfcc_t *feat, int32 frame,
+                       int32 compallsen)
+{
+    /* For past frames this will already be computed. */
+    if (frame >= ps_mgau_base(s)->frame_idx) {
+        vqFeature_t **lastf;
+        if (topn_idx == 0)
+            lastf = s->topn_hist[s->n_topn_hist-1];
+        else
+            lastf = s->topn_hist[topn_idx-1];
+        memcpy(s->f[i], lastf[i], sizeof(vqFeature_t) * s->max_topn);
+        mgau_dist(s, frame, i, feat);
+        s->topn_hist_n[topn_idx][i] = mgau_norm(s, i);
+    }
+    if (s->mixw_cb) {
+        if (compallsen)
+            get_scores_4b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
+        else
+            get_scores_4b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
+                               senone_active, n_senone_active);
+    }
+    else {
+        if (compallsen)
+            get_scores_8b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
+        else
+            get_scores_8b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
+                               senone_active, n_senone_active);
+    }
+}
+
 /*
  * Compute senone scores for the active senones.
  */
@@ -844,37 +903,44 @@ s2_semi_mgau_frame_eval(ps_mgau_t *ps,
     int i, topn_idx;
     int n_feat = s->g->n_feat;
 
-    memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
-    /* No bounds checking is done here, which just means you'll get
-     * semi-random crap if you request a frame in the future or one
-     * that's too far in the past. */
-    topn_idx = frame % s->n_topn_hist;
-    s->f = s->topn_hist[topn_idx];
+    topn_idx = s2_semi_mgau_frame_start(s, senone_scores, frame);
+    for (i = 0; i < n_feat; ++i)
+        s2_semi_mgau_feat_eval(s, i, topn_idx, senone_scores,
+                               senone_active, n_senone_active,
+                               featbuf[i], frame, compallsen);
+
+    return 0;
+}
+
+/*
+ * Compute senone scores for one frame of several streams.
+ */
+int
+s2_semi_mgau_batch_eval(ps_mgau_frame_t *frames, int32 n_frames)
+{
+    int i, j, n_feat;
+
+    /* eval_idx is the slot in the top-N history for this frame. */
+    n_feat = 0;
+    for (j = 0; j < n_frames; ++j) {
+        s2_semi_mgau_t *s = (s2_semi_mgau_t *)frames[j].mgau;
+        frames[j].eval_idx = s2_semi_mgau_frame_start(s, frames[j].senscr,
+                                                      frames[j].frame);
+        if (s->g->n_feat > n_feat)
+            n_feat = s->g->n_feat;
+    }
+    /* Evaluate each feature's codebook for all streams together, so
+     * that its parameters and mixture weights stay in cache. */
     for (i = 0; i < n_feat; ++i) {
-        /* For past frames this will already be computed. */
-        if (frame >= ps_mgau_base(ps)->frame_idx) {
-            vqFeature_t **lastf;
-            if (topn_idx == 0)
-                lastf = s->topn_hist[s->n_topn_hist-1];
-            else
-                lastf = s->topn_hist[topn_idx-1];
-            memcpy(s->f[i], lastf[i], sizeof(vqFeature_t) * s->max_topn);
-            mgau_dist(s, frame, i, featbuf[i]);
-            s->topn_hist_n[topn_idx][i] = mgau_norm(s, i);
-        }
-        if (s->mixw_cb) {
-            if (compallsen)
-                get_scores_4b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
-            else
-                get_scores_4b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
-                                   senone_active, n_senone_active);
-        }
-        else {
-            if (compallsen)
-                get_scores_8b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
-            else
-                get_scores_8b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
-                                   senone_active, n_senone_active);
+        for (j = 0; j < n_frames; ++j) {
+            s2_semi_mgau_t *s = (s2_semi_mgau_t *)frames[j].mgau;
+            if (i < s->g->n_feat)
+                s2_semi_mgau_feat_eval(s, i, frames[j].eval_idx,
+                                       frames[j].senscr,
+                                       frames[j].senone_active,
+                                       frames[j].n_senone_active,
+                                       frames[j].feat[i], frames[j].frame,
+                                       frames[j].compallsen);
         }
     }
 
@@ -1224,6 +1290,31 @@ split_topn(char const *str, uint8 *out, int nfeat)
 }
 
 
+/*
+ * Allocate scoring state which is not shared between instances.
+ */
+static void
+s2_semi_mgau_init_state(s2_semi_mgau_t *s)
+{
+    int i, n_feat = s->g->n_feat;
+
+    s->topn_hist = (vqFeature_t ***)
+        ckd_calloc_3d(s->n_topn_hist, n_feat, s->max_topn,
+                      sizeof(***s->topn_hist));
+    s->topn_hist_n = ckd_calloc_2d(s->n_topn_hist, n_feat,
+                                   sizeof(**s->topn_hist_n));
+    for (i = 0; i < s->n_topn_hist; ++i) {
+        int j;
+        for (j = 0; j < n_feat; ++j) {
+            int k;
+            for (k = 0; k < s->max_topn; ++k) {
+                s->topn_hist[i][j][k].score = WORST_DIST;
+                s->topn_hist[i][j][k].codeword = k;
+            }
+        }
+    }
+}
+
 ps_mgau_t *
 s2_semi_mgau_init(acmod_t *acmod)
 {
@@ -1249,10 +1340,13 @@ s2_semi_mgau_init(acmod_t *acmod)
     }
 
     /* Read means and variances. */
-    if ((s->g = gauden_init(cmd_ln_str_r(s->config, "_mean"),
-                            cmd_ln_str_r(s->config, "_var"),
-                            cmd_ln_float32_r(s->config, "-varfloor"),
-                            s->lmath)) == NULL) {
+    if (acmod_am_for(acmod, "-mean", "-var"))
+        s->g = gauden_init_am(acmod->am, s->lmath);
+    if (s->g == NULL
+        && (s->g = gauden_init(cmd_ln_str_r(s->config, "_mean"),
+                               cmd_ln_str_r(s->config, "_var"),
+                               cmd_ln_float32_r(s->config, "-varfloor"),
+                               s->lmath)) == NULL) {
         E_ERROR("Failed to read means and variances\n");	
         goto error_out;
     }
@@ -1277,7 +1371,14 @@ s2_semi_mgau_init(acmod_t *acmod)
         }
     }
     /* Read mixture weights */
-    if ((sendump_path = cmd_ln_str_r(s->config, "_sendump"))) {
+    if (acmod_am_for(acmod, "-sendump", "-mixw")
+        && (s->mixw = bin_am_sendump(acmod->am, s->g->n_feat, s->g->n_density,
+                                     bin_mdef_n_sen(acmod->mdef),
+                                     &s->mixw_cb)) != NULL) {
+        s->n_sen = bin_mdef_n_sen(acmod->mdef);
+        s->am = bin_am_retain(acmod->am);
+    }
+    else if ((sendump_path = cmd_ln_str_r(s->config, "_sendump"))) {
         if (read_sendump(s, acmod->mdef, sendump_path) < 0) {
             goto error_out;
         }
@@ -1303,24 +1404,11 @@ s2_semi_mgau_init(acmod_t *acmod)
 
     /* Top-N scores from recent frames */
     s->n_topn_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2;
-    s->topn_hist = (vqFeature_t ***)
-        ckd_calloc_3d(s->n_topn_hist, n_feat, s->max_topn,
-                      sizeof(***s->topn_hist));
-    s->topn_hist_n = ckd_calloc_2d(s->n_topn_hist, n_feat,
-                                   sizeof(**s->topn_hist_n));
-    for (i = 0; i < s->n_topn_hist; ++i) {
-        int j;
-        for (j = 0; j < n_feat; ++j) {
-            int k;
-            for (k = 0; k < s->max_topn; ++k) {
-                s->topn_hist[i][j][k].score = WORST_DIST;
-                s->topn_hist[i][j][k].codeword = k;
-            }
-        }
-    }
+    s2_semi_mgau_init_state(s);
 
     ps = (ps_mgau_t *)s;
     ps->vt = &s2_semi_mgau_funcs;
+    ps->refcount = 1;
     return ps;
 error_out:
     s2_semi_mgau_free(ps_mgau_base(s));
@@ -1340,9 +1428,28 @@ s2_semi_mgau_free(ps_mgau_t *ps)
 {
     s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
 
+    if (sbatomic_add(&ps->refcount, -1) > 0)
+        return;
+
     logmath_free(s->lmath);
     logmath_free(s->lmath_8b);
-    if (s->sendump_mmap) {
+    if (s->topn_hist_n)
+        ckd_free_2d(s->topn_hist_n);
+    if (s->topn_hist)
+        ckd_free_3d((void **)s->topn_hist);
+
+    /* Parameters belong to another instance. */
+    if (ps->shared) {
+        ps_mgau_free(ps->shared);
+        ckd_free(s);
+        return;
+    }
+
+    if (s->am) {
+        ckd_free_2d(s->mixw);
+        bin_am_free(s->am);
+    }
+    else if (s->sendump_mmap) {
         ckd_free_2d(s->mixw); 
         mmio_file_unmap(s->sendump_mmap);
     }
@@ -1353,7 +1460,26 @@ s2_semi_mgau_free(ps_mgau_t *ps)
     }
     gauden_free(s->g);
     ckd_free(s->topn_beam);
-    ckd_free_2d(s->topn_hist_n);
-    ckd_free_3d((void **)s->topn_hist);
     ckd_free(s);
 }
+
+ps_mgau_t *
+s2_semi_mgau_copy(ps_mgau_t *ps)
+{
+    s2_semi_mgau_t *other = (s2_semi_mgau_t *)ps;
+    s2_semi_mgau_t *s;
+
+    /* Start with the same parameters and settings. */
+    s = ckd_calloc(1, sizeof(*s));
+    *s = *other;
+    s->base.frame_idx = 0;
+    s->base.refcount = 1;
+    s->base.shared = ps_mgau_retain(ps->shared ? ps->shared : ps);
+    s->lmath = logmath_retain(other->lmath);
+    s->lmath_8b = logmath_retain(other->lmath_8b);
+
+    /* But not the same state. */
+    s2_semi_mgau_init_state(s);
+
+    return ps_mgau_base(s);
+}
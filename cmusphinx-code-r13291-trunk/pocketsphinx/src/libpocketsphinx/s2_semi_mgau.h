@@ -66,6 +66,7 @@ struct s2_semi_mgau_s {
     mmio_file_t *sendump_mmap;/* memory map for mixw (or NULL if not mmap) */
 
     uint8 *mixw_cb;    /* mixture weight codebook, if any (assume it contains 16 values) */
+    bin_am_t *am;      /* binary acoustic model holding mixw (if any) */
     int32 n_sen;	/* Number of senones */
     uint8 *topn_beam;   /* Beam for determining per-frame top-N densities */
     int16 max_topn;
@@ -91,6 +92,9 @@ int s2_semi_mgau_frame_eval(ps_mgau_t *s,
                             mfcc_t **featbuf,
                             int32 frame,
                             int32 compallsen);
+ps_mgau_t *s2_semi_mgau_copy(ps_mgau_t *s);
+int s2_semi_mgau_batch_eval(ps_mgau_frame_t *frames,
+                            int32 n_frames);
 int s2_semi_mgau_mllr_transform(ps_mgau_t *s,
                                 ps_mllr_t *mllr);
 
@@ -43,6 +43,7 @@
 #include <sphinxbase/err.h>
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/bio.h>
+#include <sphinxbase/sbthread.h>
 
 /* Local headers. */
 #include "tmat.h"
@@ -150,6 +151,7 @@ tmat_init(char const *file_name, logmath_t *lmath, float64 tpfloor, int32 brepor
     }
 
     t = (tmat_t *) ckd_calloc(1, sizeof(tmat_t));
+    t->refcount = 1;
 
     if ((fp = fopen(file_name, "rb")) == NULL)
         E_FATAL_SYSTEM("Failed to open transition file '%s' for reading", file_name);
@@ -258,6 +260,43 @@ tmat_init(char const *file_name, logmath_t *lmath, float64 tpfloor, int32 brepor
     return t;
 }
 
+tmat_t *
+tmat_init_am(bin_am_t *am, logmath_t *lmath)
+{
+    bin_am_tmat_t const *hdr;
+    uint8 *data;
+    size_t size;
+    int32 i, j;
+    tmat_t *t;
+
+    if ((hdr = bin_am_section(am, BIN_AM_TMAT, &size)) == NULL
+        || size < sizeof(*hdr))
+        return NULL;
+    data = bin_am_section(am, BIN_AM_TMAT_DATA, &size);
+    if (data == NULL
+        || size < (size_t)hdr->n_tmat * hdr->n_state * (hdr->n_state + 1)) {
+        E_ERROR("Transition matrices in binary acoustic model are truncated\n");
+        return NULL;
+    }
+
+    t = (tmat_t *) ckd_calloc(1, sizeof(tmat_t));
+    t->refcount = 1;
+    t->n_tmat = hdr->n_tmat;
+    t->n_state = hdr->n_state;
+    t->tp = (uint8 ***)ckd_calloc_2d(t->n_tmat, t->n_state, sizeof(**t->tp));
+    for (i = 0; i < t->n_tmat; ++i)
+        for (j = 0; j < t->n_state; ++j)
+            t->tp[i][j] = data + ((size_t)i * t->n_state + j) * (t->n_state + 1);
+    t->am = bin_am_retain(am);
+
+    if (tmat_chk_uppertri(t, lmath) < 0 || tmat_chk_1skip(t, lmath) < 0) {
+        E_ERROR("Transition matrices in binary acoustic model are invalid\n");
+        tmat_free(t);
+        return NULL;
+    }
+    return t;
+}
+
 void
 tmat_report(tmat_t * t)
 {
@@ -271,11 +310,25 @@ tmat_report(tmat_t * t)
 /* 
  *  RAH, Free memory allocated in tmat_init ()
  */
+tmat_t *
+tmat_retain(tmat_t * t)
+{
+    sbatomic_add(&t->refcount, 1);
+    return t;
+}
+
 void
 tmat_free(tmat_t * t)
 {
     if (t) {
-        if (t->tp)
+        if (sbatomic_add(&t->refcount, -1) > 0)
+            return;
+        if (t->am) {
+            /* Only the pointers are ours. */
+            ckd_free_2d(t->tp);
+            bin_am_free(t->am);
+        }
+        else if (t->tp)
             ckd_free_3d(t->tp);
         ckd_free(t);
     }
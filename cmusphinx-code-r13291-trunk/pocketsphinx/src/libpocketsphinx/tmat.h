@@ -40,6 +40,8 @@
 #include <stdio.h>
 #include <sphinxbase/logmath.h>
 
+#include "bin_am.h"
+
 /** \file tmat.h
  *  \brief Transition matrix data structure.
  */
@@ -58,6 +60,8 @@ typedef struct {
     int16 n_tmat;	/**< Number matrices */
     int16 n_state;	/**< Number source states in matrix (only the emitting states);
 			   Number destination states = n_state+1, it includes the exit state */
+    int refcount;       /**< Reference count. */
+    bin_am_t *am;       /**< Binary acoustic model holding tp (if any) */
 } tmat_t;
 
 
@@ -71,6 +75,18 @@ tmat_t *tmat_init (char const *tmatfile,/**< In: input file */
 					    
 
 
+/**
+ * Get transition matrices from a binary acoustic model, without
+ * copying them.
+ * @return the transition matrices, or NULL if not present.
+ */
+tmat_t *tmat_init_am(bin_am_t *am, logmath_t *lmath);
+
+/**
+ * Retain a pointer to a transition matrix.
+ */
+tmat_t *tmat_retain(tmat_t *t);
+
 /** Dumping the transition matrix for debugging */
 
 void tmat_dump (tmat_t *tmat,  /**< In: transition matrix */
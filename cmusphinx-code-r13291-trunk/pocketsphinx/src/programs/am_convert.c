@@ -0,0 +1,87 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2006 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * am_convert.c - pack an acoustic model into a single binary file
+ *
+ * The resulting file contains the model definition, transition
+ * matrices, Gaussian parameters and quantized mixture weights, all
+ * precomputed, so that it can be memory-mapped and used directly by
+ * the decoder with -ambin.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pocketsphinx.h>
+
+#include "pocketsphinx_internal.h"
+#include "acmod.h"
+
+int
+main(int argc, char *argv[])
+{
+    const char *outfile;
+    cmd_ln_t *config;
+    ps_decoder_t *ps;
+    int rv;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s HMMDIR OUTPUT [DECODER ARGUMENTS...]\n",
+                argv[0]);
+        return 1;
+    }
+    outfile = argv[2];
+
+    /* The output depends on the decoder arguments (-logbase,
+     * -varfloor, -tmatfloor), so they can be given here too. */
+    if ((config = cmd_ln_parse_r(NULL, ps_args(), argc - 3, argv + 3, TRUE))
+        == NULL)
+        return 1;
+    cmd_ln_set_str_r(config, "-hmm", argv[1]);
+    /* Don't map the output file in case it is already in HMMDIR. */
+    cmd_ln_set_boolean_r(config, "-mmap", FALSE);
+    if ((ps = ps_init(config)) == NULL) {
+        cmd_ln_free_r(config);
+        return 1;
+    }
+
+    rv = acmod_write_am(ps->acmod, outfile);
+
+    ps_free(ps);
+    cmd_ln_free_r(config);
+    return rv < 0 ? 1 : 0;
+}
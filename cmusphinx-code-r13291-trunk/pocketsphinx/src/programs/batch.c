@@ -37,6 +37,7 @@
 
 /* System headers. */
 #include <stdio.h>
+#include <stdlib.h>
 
 /* SphinxBase headers. */
 #include <sphinxbase/pio.h>
@@ -44,6 +45,8 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/filename.h>
 #include <sphinxbase/byteorder.h>
+#include <sphinxbase/profile.h>
+#include <sphinxbase/sbthread.h>
 
 /* PocketSphinx headers. */
 #include <pocketsphinx.h>
@@ -82,6 +85,10 @@ static const arg_t ps_args_def[] = {
       ARG_INT32,
       "1",
       "Do every Nth line in the control file" },
+    { "-nthreads",
+      ARG_INT32,
+      "1",
+      "Number of utterances to decode in parallel, each with its own decoder sharing the models" },
     { "-mllrctl",
       ARG_STRING,
       NULL,
@@ -153,7 +160,7 @@ static const arg_t ps_args_def[] = {
     { "-outlatfmt",
       ARG_STRING,
       "s3",
-      "Format for dumping word lattices (s3 or htk)" },
+      "Format for dumping word lattices (s3, htk or bin)" },
     { "-outlatext",
       ARG_STRING,
       ".lat",
@@ -363,12 +370,23 @@ build_outdirs(cmd_ln_t *config, char const *uttid)
     return 0;
 }
 
+static char *
+build_infile(cmd_ln_t *config, char const *file)
+{
+    char const *cepdir, *cepext;
+
+    cepdir = cmd_ln_str_r(config, "-cepdir");
+    cepext = cmd_ln_str_r(config, "-cepext");
+    return string_join(cepdir ? cepdir : "",
+                       "/", file,
+                       cepext ? cepext : "", NULL);
+}
+
 static int
 process_ctl_line(ps_decoder_t *ps, cmd_ln_t *config,
                  char const *file, char const *uttid, int32 sf, int32 ef)
 {
     FILE *infh;
-    char const *cepdir, *cepext;
     char *infile;
 
     if (ef != -1 && ef < sf) {
@@ -376,13 +394,8 @@ process_ctl_line(ps_decoder_t *ps, cmd_ln_t *config,
         return -1;
     }
     
-    cepdir = cmd_ln_str_r(config, "-cepdir");
-    cepext = cmd_ln_str_r(config, "-cepext");
-
     /* Build input filename. */
-    infile = string_join(cepdir ? cepdir : "",
-                         "/", file,
-                         cepext ? cepext : "", NULL);
+    infile = build_infile(config, file);
     if (uttid == NULL) uttid = file;
 
     if ((infh = fopen(infile, "rb")) == NULL) {
@@ -461,6 +474,12 @@ write_lattice(ps_decoder_t *ps, char const *latdir, char const *uttid)
             return -1;
         }
     }
+    else if (0 == strcmp("bin", cmd_ln_str_r(config, "-outlatfmt"))) {
+        if (ps_lattice_write_bin(lat, outfile) < 0) {
+            E_ERROR("Failed to write lattice to %s\n", outfile);
+            return -1;
+        }
+    }
     else {
         if (ps_lattice_write(lat, outfile) < 0) {
             E_ERROR("Failed to write lattice to %s\n", outfile);
@@ -589,6 +608,457 @@ write_ctm(FILE *fh, ps_decoder_t *ps, ps_seg_t *itor, char const *uttid, int32 f
     return 0;
 }
 
+/**
+ * Utterance from the control file, waiting to be decoded by one of
+ * the threads in a batch_pool_t, along with its results.
+ */
+typedef struct batch_utt_s {
+    char *line;          /**< Control file line, holding file and uttid. */
+    char *lmline;        /**< LM name control line, holding lmname. */
+    char *fsgline;       /**< FSG control line, holding fsgfile. */
+    char const *file;
+    char const *uttid;
+    char const *lmname;
+    char const *fsgfile;
+    int32 sf, ef;
+    long len;            /**< Estimated length, for scheduling. */
+    int done;            /**< Results are ready to be written. */
+    char *hyp;           /**< Output for -hyp, or NULL. */
+    char *hypseg;        /**< Output for -hypseg, or NULL. */
+    char *ctm;           /**< Output for -ctm, or NULL. */
+} batch_utt_t;
+
+/**
+ * Thread decoding utterances with its own decoder.
+ */
+typedef struct batch_worker_s {
+    struct batch_pool_s *pool;
+    int id;              /**< Index of this worker. */
+    ps_decoder_t *ps;    /**< Decoder sharing models with the others. */
+    sbthread_t *th;      /**< Thread running this worker. */
+    sbmtx_t *mtx;        /**< Protects queue, head and tail. */
+    int32 *queue;        /**< Utterances to decode, longest first. */
+    int32 head, tail;
+    FILE *scratch;       /**< Scratch file for formatting output. */
+    int32 n_utt;         /**< Number of utterances decoded. */
+    double n_speech;     /**< Seconds of speech decoded. */
+    ptmr_t busy;         /**< Time spent decoding. */
+} batch_worker_t;
+
+/**
+ * Pool of threads decoding the control file in parallel.
+ *
+ * Utterances are dealt out to the workers longest first, so that the
+ * short ones are left to fill in the gaps at the end.  Each worker
+ * takes the longest utterance from the front of its own queue, and
+ * when that is empty, steals the shortest one from the back of
+ * another's.  Results are written out in control file order.
+ */
+typedef struct batch_pool_s {
+    cmd_ln_t *config;
+    batch_utt_t *utts;   /**< Utterances in control file order. */
+    int32 n_utt, n_alloc;
+    batch_worker_t *workers;
+    int nthreads;
+    sbmtx_t *mtx;        /**< Protects the done flags of utterances. */
+    sbevent_t *evt;      /**< Signalled when an utterance is done. */
+    int want_hyp, want_hypseg, want_ctm;
+} batch_pool_t;
+
+static batch_pool_t *
+batch_pool_init(cmd_ln_t *config, int nthreads)
+{
+    batch_pool_t *pool;
+
+    pool = ckd_calloc(1, sizeof(*pool));
+    pool->config = config;
+    pool->nthreads = nthreads;
+    pool->want_hyp = (cmd_ln_str_r(config, "-hyp") != NULL);
+    pool->want_hypseg = (cmd_ln_str_r(config, "-hypseg") != NULL);
+    pool->want_ctm = (cmd_ln_str_r(config, "-ctm") != NULL);
+    return pool;
+}
+
+/**
+ * Estimate the length of an utterance in frames, without reading it.
+ */
+static long
+utt_length(cmd_ln_t *config, char const *file, int32 sf, int32 ef)
+{
+    FILE *infh;
+    char *infile;
+    long len;
+
+    if (ef != -1)
+        return ef - sf;
+    infile = build_infile(config, file);
+    if ((infh = fopen(infile, "rb")) == NULL) {
+        /* Let the decoder complain about it. */
+        ckd_free(infile);
+        return 0;
+    }
+    fseek(infh, 0, SEEK_END);
+    len = ftell(infh);
+    fclose(infh);
+    ckd_free(infile);
+
+    if (cmd_ln_boolean_r(config, "-senin"))
+        return len; /* Not in frames, but all the same type. */
+    else if (cmd_ln_boolean_r(config, "-adcin"))
+        len = (long)((len - cmd_ln_int32_r(config, "-adchdr")) / sizeof(int16)
+                     / (cmd_ln_float32_r(config, "-samprate")
+                        / cmd_ln_int32_r(config, "-frate")));
+    else
+        len = len / 4 / cmd_ln_int32_r(config, "-ceplen");
+    return len - sf;
+}
+
+/**
+ * Queue an utterance, taking ownership of the control file lines.
+ */
+static void
+batch_pool_add(batch_pool_t *pool, char *line, char const *file,
+               char const *uttid, int32 sf, int32 ef,
+               char *lmline, char const *lmname,
+               char *fsgline, char const *fsgfile)
+{
+    batch_utt_t *utt;
+
+    if (pool->n_utt == pool->n_alloc) {
+        pool->n_alloc = pool->n_alloc ? pool->n_alloc * 2 : 256;
+        pool->utts = ckd_realloc(pool->utts,
+                                 pool->n_alloc * sizeof(*pool->utts));
+    }
+    utt = &pool->utts[pool->n_utt++];
+    memset(utt, 0, sizeof(*utt));
+    utt->line = line;
+    utt->lmline = lmline;
+    utt->fsgline = fsgline;
+    utt->file = file;
+    utt->uttid = uttid;
+    utt->lmname = lmname;
+    utt->fsgfile = fsgfile;
+    utt->sf = sf;
+    utt->ef = ef;
+    utt->len = utt_length(pool->config, file, sf, ef);
+}
+
+/**
+ * Return what was written to a scratch file since it was rewound.
+ */
+static char *
+scratch_string(FILE *fh)
+{
+    char *str;
+    long len;
+
+    len = ftell(fh);
+    str = ckd_malloc(len + 1);
+    rewind(fh);
+    if (fread(str, 1, len, fh) != (size_t)len) {
+        E_ERROR_SYSTEM("Failed to read back %ld bytes of output", len);
+        len = 0;
+    }
+    str[len] = '\0';
+    rewind(fh);
+    return str;
+}
+
+static void
+batch_decode_utt(batch_worker_t *w, batch_utt_t *utt)
+{
+    batch_pool_t *pool = w->pool;
+    cmd_ln_t *config = pool->config;
+    ps_decoder_t *ps = w->ps;
+    char const *outlatdir, *nbestdir, *hyp;
+    double n_speech, n_cpu, n_wall;
+    int32 score;
+
+    outlatdir = cmd_ln_str_r(config, "-outlatdir");
+    nbestdir = cmd_ln_str_r(config, "-nbestdir");
+
+    E_INFO("Decoding '%s'\n", utt->uttid);
+    if (process_lmnamectl_line(ps, config, utt->lmname) < 0)
+        return;
+    if (process_fsgctl_line(ps, config, utt->fsgfile) < 0)
+        return;
+    if (process_ctl_line(ps, config, utt->file, utt->uttid,
+                         utt->sf, utt->ef) < 0)
+        return;
+    hyp = ps_get_hyp(ps, &score);
+
+    /* The writers print to a FILE, so format the results in the
+     * scratch file and keep them until they can go out in order. */
+    if (pool->want_hyp) {
+        fprintf(w->scratch, "%s (%s %d)\n", hyp ? hyp : "", utt->uttid, score);
+        utt->hyp = scratch_string(w->scratch);
+    }
+    if (pool->want_hypseg) {
+        write_hypseg(w->scratch, ps, utt->uttid);
+        utt->hypseg = scratch_string(w->scratch);
+    }
+    if (pool->want_ctm) {
+        write_ctm(w->scratch, ps, ps_seg_iter(ps), utt->uttid,
+                  cmd_ln_int32_r(config, "-frate"));
+        utt->ctm = scratch_string(w->scratch);
+    }
+    if (outlatdir) {
+        write_lattice(ps, outlatdir, utt->uttid);
+    }
+    if (nbestdir) {
+        write_nbest(ps, nbestdir, utt->uttid);
+    }
+
+    /* CPU time is shared by all threads, only wall time is ours. */
+    ps_get_utt_time(ps, &n_speech, &n_cpu, &n_wall);
+    ++w->n_utt;
+    w->n_speech += n_speech;
+    E_INFO("%s: %.2f seconds speech, %.2f seconds wall, %.2f xRT (elapsed)\n",
+           utt->uttid, n_speech, n_wall, n_wall / n_speech);
+    E_INFO_NOFN("%s (%s %d)\n", hyp ? hyp : "", utt->uttid, score);
+    E_INFO_NOFN("%s done --------------------------------------\n", utt->uttid);
+}
+
+/**
+ * Take the next utterance to decode, or -1 if there are none left.
+ */
+static int32
+batch_worker_next(batch_worker_t *w)
+{
+    batch_pool_t *pool = w->pool;
+    int32 idx = -1;
+    int i;
+
+    sbmtx_lock(w->mtx);
+    if (w->head < w->tail)
+        idx = w->queue[w->head++];
+    sbmtx_unlock(w->mtx);
+    for (i = 1; idx == -1 && i < pool->nthreads; ++i) {
+        batch_worker_t *other = &pool->workers[(w->id + i) % pool->nthreads];
+
+        sbmtx_lock(other->mtx);
+        if (other->head < other->tail)
+            idx = other->queue[--other->tail];
+        sbmtx_unlock(other->mtx);
+    }
+    return idx;
+}
+
+static int
+batch_worker_main(sbthread_t *th)
+{
+    batch_worker_t *w = sbthread_arg(th);
+    batch_pool_t *pool = w->pool;
+    int32 idx;
+
+    while ((idx = batch_worker_next(w)) != -1) {
+        batch_utt_t *utt = &pool->utts[idx];
+
+        ptmr_start(&w->busy);
+        batch_decode_utt(w, utt);
+        ptmr_stop(&w->busy);
+        sbmtx_lock(pool->mtx);
+        utt->done = TRUE;
+        sbmtx_unlock(pool->mtx);
+        sbevent_signal(pool->evt);
+    }
+    return 0;
+}
+
+static int
+cmp_utt_len(const void *a, const void *b)
+{
+    batch_utt_t const *ua = *(batch_utt_t const **)a;
+    batch_utt_t const *ub = *(batch_utt_t const **)b;
+
+    if (ua->len != ub->len)
+        return ua->len > ub->len ? -1 : 1;
+    /* Otherwise keep them in control file order. */
+    return ua < ub ? -1 : (ua > ub);
+}
+
+/**
+ * Deal the utterances out to the workers, longest first.
+ */
+static int
+batch_pool_start(batch_pool_t *pool, ps_decoder_t *ps)
+{
+    batch_utt_t **sorted;
+    int32 i;
+
+    if (pool->nthreads > pool->n_utt)
+        pool->nthreads = pool->n_utt;
+    pool->workers = ckd_calloc(pool->nthreads, sizeof(*pool->workers));
+    for (i = 0; i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+
+        if (i == 0)
+            w->ps = ps_retain(ps);
+        else if ((w->ps = ps_clone(ps)) == NULL) {
+            E_ERROR("Failed to create decoder for thread %d, using %d threads\n",
+                    i, i);
+            break;
+        }
+        if ((w->scratch = tmpfile()) == NULL) {
+            E_ERROR_SYSTEM("Failed to create scratch file for thread %d", i);
+            ps_free(w->ps);
+            w->ps = NULL;
+            break;
+        }
+    }
+    /* Fall back to the workers that could be set up. */
+    pool->nthreads = i;
+    if (pool->nthreads == 0)
+        return -1;
+    for (i = 0; i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->id = i;
+        w->mtx = sbmtx_init();
+        w->queue = ckd_calloc(pool->n_utt / pool->nthreads + 1,
+                              sizeof(*w->queue));
+        ptmr_init(&w->busy);
+    }
+
+    sorted = ckd_calloc(pool->n_utt, sizeof(*sorted));
+    for (i = 0; i < pool->n_utt; ++i)
+        sorted[i] = &pool->utts[i];
+    qsort(sorted, pool->n_utt, sizeof(*sorted), cmp_utt_len);
+    for (i = 0; i < pool->n_utt; ++i) {
+        batch_worker_t *w = &pool->workers[i % pool->nthreads];
+        w->queue[w->tail++] = sorted[i] - pool->utts;
+    }
+    ckd_free(sorted);
+
+    pool->mtx = sbmtx_init();
+    pool->evt = sbevent_init();
+    for (i = 0; i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+        if ((w->th = sbthread_start(pool->config, batch_worker_main, w)) == NULL)
+            E_FATAL("Failed to start decoding thread %d\n", i);
+    }
+    E_INFO("Decoding %d utterances with %d threads\n",
+           pool->n_utt, pool->nthreads);
+    return 0;
+}
+
+/**
+ * Write results in control file order as they become available.
+ */
+static void
+batch_pool_write(batch_pool_t *pool, FILE *hypfh, FILE *hypsegfh, FILE *ctmfh)
+{
+    int32 next = 0;
+
+    while (next < pool->n_utt) {
+        int32 end = next;
+
+        sbmtx_lock(pool->mtx);
+        while (end < pool->n_utt && pool->utts[end].done)
+            ++end;
+        sbmtx_unlock(pool->mtx);
+        if (end == next) {
+            sbevent_wait(pool->evt, -1, 0);
+            continue;
+        }
+        for (; next < end; ++next) {
+            batch_utt_t *utt = &pool->utts[next];
+
+            if (hypfh && utt->hyp)
+                fputs(utt->hyp, hypfh);
+            if (hypsegfh && utt->hypseg)
+                fputs(utt->hypseg, hypsegfh);
+            if (ctmfh && utt->ctm)
+                fputs(utt->ctm, ctmfh);
+            ckd_free(utt->hyp);
+            ckd_free(utt->hypseg);
+            ckd_free(utt->ctm);
+            utt->hyp = utt->hypseg = utt->ctm = NULL;
+        }
+    }
+}
+
+static void
+batch_pool_free(batch_pool_t *pool)
+{
+    int32 i;
+
+    for (i = 0; pool->workers && i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+
+        if (w->th) {
+            sbthread_wait(w->th);
+            sbthread_free(w->th);
+        }
+        if (w->scratch)
+            fclose(w->scratch);
+        if (w->mtx)
+            sbmtx_free(w->mtx);
+        ckd_free(w->queue);
+        ps_free(w->ps);
+    }
+    ckd_free(pool->workers);
+    for (i = 0; i < pool->n_utt; ++i) {
+        batch_utt_t *utt = &pool->utts[i];
+
+        ckd_free(utt->line);
+        ckd_free(utt->lmline);
+        ckd_free(utt->fsgline);
+        ckd_free(utt->hyp);
+        ckd_free(utt->hypseg);
+        ckd_free(utt->ctm);
+    }
+    ckd_free(pool->utts);
+    if (pool->mtx)
+        sbmtx_free(pool->mtx);
+    if (pool->evt)
+        sbevent_free(pool->evt);
+    ckd_free(pool);
+}
+
+/**
+ * Decode all queued utterances and report how busy each thread was.
+ */
+static void
+batch_pool_run(batch_pool_t *pool, ps_decoder_t *ps,
+               FILE *hypfh, FILE *hypsegfh, FILE *ctmfh)
+{
+    double n_speech;
+    ptmr_t tm;
+    int32 i;
+
+    if (pool->n_utt == 0)
+        return;
+    ptmr_init(&tm);
+    ptmr_start(&tm);
+    if (batch_pool_start(pool, ps) < 0)
+        E_FATAL("Failed to start decoding threads\n");
+    batch_pool_write(pool, hypfh, hypsegfh, ctmfh);
+    for (i = 0; i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+        sbthread_wait(w->th);
+        sbthread_free(w->th);
+        w->th = NULL;
+    }
+    ptmr_stop(&tm);
+
+    n_speech = 0;
+    for (i = 0; i < pool->nthreads; ++i)
+        n_speech += pool->workers[i].n_speech;
+    E_INFO("TOTAL %.2f seconds speech, %.2f seconds CPU, %.2f seconds wall\n",
+           n_speech, tm.t_cpu, tm.t_elapsed);
+    E_INFO("AVERAGE %.2f xRT (CPU), %.2f xRT (elapsed)\n",
+           tm.t_cpu / n_speech, tm.t_elapsed / n_speech);
+    for (i = 0; i < pool->nthreads; ++i) {
+        batch_worker_t *w = &pool->workers[i];
+        E_INFO("Thread %d: %d utterances, %.2f seconds speech, "
+               "%.2f seconds busy (%.1f%% utilization)\n",
+               i, w->n_utt, w->n_speech, w->busy.t_elapsed,
+               100.0 * w->busy.t_elapsed / tm.t_elapsed);
+    }
+}
+
 static void
 process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
 {
@@ -598,6 +1068,7 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
     size_t len;
     FILE *hypfh = NULL, *hypsegfh = NULL, *ctmfh = NULL;
     FILE *mllrfh = NULL, *lmfh = NULL, *fsgfh = NULL;
+    batch_pool_t *pool = NULL;
     double n_speech, n_cpu, n_wall;
     char const *outlatdir;
     char const *nbestdir;
@@ -656,6 +1127,14 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
         }
         setbuf(ctmfh, NULL);
     }
+    if (cmd_ln_int32_r(config, "-nthreads") > 1) {
+        /* Decoders running in parallel share the acoustic model, so
+         * they cannot each have their own transform. */
+        if (mllrfh)
+            E_WARN("MLLR transforms cannot be changed in parallel, ignoring -nthreads\n");
+        else
+            pool = batch_pool_init(config, cmd_ln_int32_r(config, "-nthreads"));
+    }
 
     i = 0;
     while ((line = fread_line(ctlfh, &len))) {
@@ -726,6 +1205,15 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
             else
         	uttid = file;
 
+            if (pool) {
+                /* Decode it later, the pool owns the lines now. */
+                batch_pool_add(pool, line, file, uttid, sf, ef,
+                               lmline, lmname, fsgline, fsgfile);
+                line = lmline = fsgline = NULL;
+                i += ctlincr;
+                goto nextline;
+            }
+
             E_INFO("Decoding '%s'\n", uttid);
 
             /* Do actual decoding. */
@@ -773,6 +1261,11 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
         ckd_free(line);
     }
 
+    if (pool) {
+        batch_pool_run(pool, ps, hypfh, hypsegfh, ctmfh);
+        goto done;
+    }
+
     ps_get_all_time(ps, &n_speech, &n_cpu, &n_wall);
     E_INFO("TOTAL %.2f seconds speech, %.2f seconds CPU, %.2f seconds wall\n",
            n_speech, n_cpu, n_wall);
@@ -780,6 +1273,8 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
            n_cpu / n_speech, n_wall / n_speech);
 
 done:
+    if (pool)
+        batch_pool_free(pool);
     if (hypfh)
         fclose(hypfh);
     if (hypsegfh)
@@ -0,0 +1,36 @@
+#!/bin/sh
+
+. ../testfuncs.sh
+
+bn=`basename $0 .sh`
+
+echo "Test: $bn"
+for n in 1 4; do
+    run_program pocketsphinx_batch \
+	-hmm $data/tidigits/hmm \
+	-lm $data/tidigits/lm/tidigits.lm.bin \
+	-dict $data/tidigits/lm/tidigits.dic \
+	-ctl $data/tidigits/tidigits.ctl \
+	-cepdir $data/tidigits \
+	-bestpath yes \
+	-nthreads $n \
+	-latthreads $n \
+	-hyp $bn-$n.match \
+	-hypseg $bn-seg-$n.match \
+	> $bn-$n.log 2>&1
+
+    # Test whether it actually completed
+    if [ $? = 0 ]; then
+	pass "run $n"
+    else
+	fail "run $n"
+    fi
+done
+
+# Several threads must give exactly the same results, in the same order
+grep "Decoding .* threads" $bn-4.log
+if cmp $bn-1.match $bn-4.match && cmp $bn-seg-1.match $bn-seg-4.match; then
+    pass "match"
+else
+    fail "match"
+fi
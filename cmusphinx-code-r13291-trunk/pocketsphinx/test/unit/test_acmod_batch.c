@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+#include <pocketsphinx.h>
+
+#include <sphinxbase/logmath.h>
+#include <sphinxbase/strfuncs.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+#define N_ACMOD 3
+
+static acmod_t *
+init_acmod(char const *hmmdir, logmath_t *lmath, int sendump)
+{
+    cmd_ln_t *config;
+    acmod_t *acmod;
+    char *path;
+
+    config = cmd_ln_init(NULL, ps_args(), TRUE,
+                 "-compallsen", "true",
+                 "-cmn", "prior",
+                 "-tmatfloor", "0.0001",
+                 "-mixwfloor", "0.001",
+                 "-varfloor", "0.0001",
+                 "-mmap", "no",
+                 "-topn", "4",
+                 "-ds", "1",
+                 "-samprate", "16000", NULL);
+    TEST_ASSERT(config);
+    path = string_join(hmmdir, "/feat.params", NULL);
+    cmd_ln_parse_file_r(config, ps_args(), path, FALSE);
+    ckd_free(path);
+    /* Every one must compute the same features. */
+    cmd_ln_set_boolean_r(config, "-dither", FALSE);
+
+#define SET_FILE(key, name)                                     \
+    path = string_join(hmmdir, "/" name, NULL);                 \
+    cmd_ln_set_str_extra_r(config, key, path);                  \
+    ckd_free(path)
+    SET_FILE("_mdef", "mdef");
+    SET_FILE("_mean", "means");
+    SET_FILE("_var", "variances");
+    SET_FILE("_tmat", "transition_matrices");
+    if (sendump) {
+        SET_FILE("_sendump", "sendump");
+        cmd_ln_set_str_extra_r(config, "_mixw", NULL);
+    }
+    else {
+        SET_FILE("_mixw", "mixture_weights");
+        cmd_ln_set_str_extra_r(config, "_sendump", NULL);
+    }
+#undef SET_FILE
+    cmd_ln_set_str_extra_r(config, "_lda", NULL);
+    cmd_ln_set_str_extra_r(config, "_senmgau", NULL);
+
+    TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+    cmd_ln_free_r(config);
+    return acmod;
+}
+
+/* Score the first one on its own and the rest in a batch. */
+static void
+compare_batch(acmod_t **acmods)
+{
+    int frame_idx[N_ACMOD];
+    int i, n_frames;
+
+    E_INFO("Scoring with %s\n", ps_mgau_base(acmods[0]->mgau)->vt->name);
+    n_frames = 0;
+    while (acmods[0]->n_feat_frame > 0) {
+        int ref_idx = -1;
+
+        TEST_ASSERT(acmod_score(acmods[0], &ref_idx));
+        TEST_EQUAL(0, acmod_score_batch(acmods + 1, N_ACMOD - 1, frame_idx));
+        for (i = 1; i < N_ACMOD; ++i) {
+            TEST_EQUAL(ref_idx, frame_idx[i - 1]);
+            TEST_EQUAL(0, memcmp(acmods[0]->senone_scores,
+                                 acmods[i]->senone_scores,
+                                 bin_mdef_n_sen(acmods[0]->mdef)
+                                 * sizeof(*acmods[0]->senone_scores)));
+        }
+        for (i = 0; i < N_ACMOD; ++i)
+            acmod_advance(acmods[i]);
+        ++n_frames;
+    }
+    TEST_ASSERT(n_frames > 0);
+}
+
+static void
+test_batch(char const *hmmdir, int sendump, int16 *buf, size_t nsamps)
+{
+    acmod_t *acmods[N_ACMOD];
+    logmath_t *lmath;
+    int i;
+
+    lmath = logmath_init(1.0001, 0, 0);
+    for (i = 0; i < N_ACMOD; ++i) {
+        int16 const *bptr = buf;
+        size_t nread = nsamps;
+
+        acmods[i] = init_acmod(hmmdir, lmath, sendump);
+        TEST_EQUAL(0, acmod_start_utt(acmods[i]));
+        acmod_process_raw(acmods[i], &bptr, &nread, TRUE);
+        TEST_EQUAL(0, acmod_end_utt(acmods[i]));
+    }
+    compare_batch(acmods);
+
+    for (i = 0; i < N_ACMOD; ++i)
+        acmod_free(acmods[i]);
+    logmath_free(lmath);
+}
+
+/* Compute cepstra only once, since dither would make them differ. */
+static mfcc_t **
+compute_cep(fe_t *fe, int16 *buf, size_t nsamps, int32 *out_n_frames)
+{
+    int16 const *bptr = buf;
+    size_t nread = nsamps;
+    mfcc_t **cep;
+    int32 n_frames, n_end;
+
+    TEST_EQUAL(0, fe_start_utt(fe));
+    TEST_ASSERT(fe_process_frames(fe, NULL, &nread, NULL, &n_frames, NULL) >= 0);
+    cep = ckd_calloc_2d(n_frames + 1, fe_get_output_size(fe), sizeof(**cep));
+    TEST_ASSERT(fe_process_frames(fe, &bptr, &nread, cep, &n_frames, NULL) >= 0);
+    TEST_ASSERT(fe_end_utt(fe, cep[n_frames], &n_end) >= 0);
+    *out_n_frames = n_frames + n_end;
+    return cep;
+}
+
+/* Decoders made with ps_clone() share one set of parameters. */
+static void
+test_clone_batch(char const *hmmdir, char const *lm, char const *dict,
+                 int16 *buf, size_t nsamps)
+{
+    ps_decoder_t *ps[N_ACMOD];
+    acmod_t *acmods[N_ACMOD];
+    cmd_ln_t *config;
+    mfcc_t **cep, **tmp;
+    int32 n_cep, ncep;
+    int i;
+
+    TEST_ASSERT(config =
+                cmd_ln_init(NULL, ps_args(), TRUE,
+                            "-hmm", hmmdir,
+                            "-lm", lm,
+                            "-dict", dict,
+                            "-compallsen", "yes",
+                            "-samprate", "16000", NULL));
+    TEST_ASSERT(ps[0] = ps_init(config));
+    for (i = 1; i < N_ACMOD; ++i)
+        TEST_ASSERT(ps[i] = ps_clone(ps[0]));
+    cep = compute_cep(ps[0]->acmod->fe, buf, nsamps, &n_cep);
+    ncep = fe_get_output_size(ps[0]->acmod->fe);
+    tmp = ckd_calloc_2d(n_cep, ncep, sizeof(**tmp));
+    for (i = 0; i < N_ACMOD; ++i) {
+        mfcc_t **cptr = tmp;
+        int n_frames = n_cep;
+
+        /* CMN is done in place, so each one gets its own copy. */
+        memcpy(tmp[0], cep[0], n_cep * ncep * sizeof(**tmp));
+
+        acmods[i] = ps[i]->acmod;
+        TEST_ASSERT(ps_mgau_is_shared(acmods[i]->mgau));
+        TEST_EQUAL(0, acmod_start_utt(acmods[i]));
+        acmod_process_cep(acmods[i], &cptr, &n_frames, TRUE);
+        TEST_EQUAL(0, acmod_end_utt(acmods[i]));
+    }
+    compare_batch(acmods);
+
+    ckd_free_2d(cep);
+    ckd_free_2d(tmp);
+    for (i = 0; i < N_ACMOD; ++i)
+        ps_free(ps[i]);
+    cmd_ln_free_r(config);
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE *rawfh;
+    int16 *buf;
+    size_t nsamps;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    fseek(rawfh, 0, SEEK_END);
+    nsamps = ftell(rawfh) / sizeof(*buf);
+    fseek(rawfh, 0, SEEK_SET);
+    buf = ckd_calloc(nsamps, sizeof(*buf));
+    TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+    fclose(rawfh);
+
+    test_batch(MODELDIR "/en-us/en-us", TRUE, buf, nsamps);
+    test_batch(DATADIR "/an4_ci_cont", FALSE, buf, nsamps);
+    test_batch(DATADIR "/tidigits/hmm", TRUE, buf, nsamps);
+    test_clone_batch(MODELDIR "/en-us/en-us", DATADIR "/turtle.lm.bin",
+                     DATADIR "/turtle.dic", buf, nsamps);
+    test_clone_batch(DATADIR "/tidigits/hmm",
+                     DATADIR "/tidigits/lm/tidigits.lm.bin",
+                     DATADIR "/tidigits/lm/tidigits.dic", buf, nsamps);
+
+    ckd_free(buf);
+    return 0;
+}
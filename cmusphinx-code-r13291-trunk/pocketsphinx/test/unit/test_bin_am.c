@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+#include <pocketsphinx.h>
+
+#include <sphinxbase/logmath.h>
+#include <sphinxbase/strfuncs.h>
+
+#include "pocketsphinx_internal.h"
+#include "acmod.h"
+#include "ptm_mgau.h"
+#include "ms_mgau.h"
+#include "test_macros.h"
+
+#define AMBIN "test_bin_am.bin"
+
+static acmod_t *
+init_acmod(char const *hmmdir, logmath_t *lmath, int sendump, int ambin)
+{
+    cmd_ln_t *config;
+    acmod_t *acmod;
+    char *path;
+
+    config = cmd_ln_init(NULL, ps_args(), TRUE,
+                 "-compallsen", "true",
+                 "-cmn", "prior",
+                 "-tmatfloor", "0.0001",
+                 "-mixwfloor", "0.001",
+                 "-varfloor", "0.0001",
+                 "-mmap", ambin ? "yes" : "no",
+                 "-topn", "4",
+                 "-ds", "1",
+                 "-samprate", "16000", NULL);
+    TEST_ASSERT(config);
+    path = string_join(hmmdir, "/feat.params", NULL);
+    cmd_ln_parse_file_r(config, ps_args(), path, FALSE);
+    ckd_free(path);
+
+    /* Everything comes from the binary model if there is one. */
+#define SET_FILE(key, name)                                     \
+    path = string_join(hmmdir, "/" name, NULL);                 \
+    cmd_ln_set_str_extra_r(config, key, ambin ? NULL : path);   \
+    ckd_free(path)
+    SET_FILE("_mdef", "mdef");
+    SET_FILE("_mean", "means");
+    SET_FILE("_var", "variances");
+    SET_FILE("_tmat", "transition_matrices");
+    if (sendump) {
+        SET_FILE("_sendump", "sendump");
+        cmd_ln_set_str_extra_r(config, "_mixw", NULL);
+    }
+    else {
+        SET_FILE("_mixw", "mixture_weights");
+        cmd_ln_set_str_extra_r(config, "_sendump", NULL);
+    }
+#undef SET_FILE
+    cmd_ln_set_str_extra_r(config, "_ambin", ambin ? AMBIN : NULL);
+    cmd_ln_set_str_extra_r(config, "_lda", NULL);
+    cmd_ln_set_str_extra_r(config, "_senmgau", NULL);
+
+    TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+    cmd_ln_free_r(config);
+    return acmod;
+}
+
+static void
+test_bin_am(char const *hmmdir, int sendump, int16 *buf, size_t nsamps)
+{
+    acmod_t *acmods[2];
+    logmath_t *lmath;
+    int i, n_frames;
+
+    lmath = logmath_init(1.0001, 0, 0);
+    acmods[0] = init_acmod(hmmdir, lmath, sendump, FALSE);
+    TEST_EQUAL(0, acmod_write_am(acmods[0], AMBIN));
+    acmods[1] = init_acmod(hmmdir, lmath, sendump, TRUE);
+
+    /* The parameters really came from the binary model. */
+    TEST_ASSERT(acmods[1]->am);
+    TEST_EQUAL(BIN_MDEF_IN_CONTAINER, acmods[1]->mdef->alloc_mode);
+    TEST_EQUAL(acmods[1]->am, acmods[1]->tmat->am);
+    TEST_EQUAL(0, strcmp(ps_mgau_base(acmods[0]->mgau)->vt->name,
+                         ps_mgau_base(acmods[1]->mgau)->vt->name));
+    TEST_EQUAL(bin_mdef_n_phone(acmods[0]->mdef),
+               bin_mdef_n_phone(acmods[1]->mdef));
+    TEST_EQUAL(bin_mdef_n_sen(acmods[0]->mdef),
+               bin_mdef_n_sen(acmods[1]->mdef));
+    TEST_EQUAL(0, memcmp(acmods[0]->tmat->tp[0][0], acmods[1]->tmat->tp[0][0],
+                         acmods[0]->tmat->n_tmat * acmods[0]->tmat->n_state
+                         * (acmods[0]->tmat->n_state + 1)));
+    if (0 == strcmp(ps_mgau_base(acmods[1]->mgau)->vt->name, "ms")) {
+        senone_t *s = ((ms_mgau_model_t *)acmods[1]->mgau)->s;
+        TEST_EQUAL(acmods[1]->am, s->am);
+    }
+
+    for (i = 0; i < 2; ++i) {
+        int16 const *bptr = buf;
+        size_t nread = nsamps;
+
+        TEST_EQUAL(0, acmod_start_utt(acmods[i]));
+        acmod_process_raw(acmods[i], &bptr, &nread, TRUE);
+        TEST_EQUAL(0, acmod_end_utt(acmods[i]));
+    }
+    /* And they give exactly the same scores. */
+    n_frames = 0;
+    while (acmods[0]->n_feat_frame > 0) {
+        int frame_idx[2] = { -1, -1 };
+
+        TEST_ASSERT(acmod_score(acmods[0], &frame_idx[0]));
+        TEST_ASSERT(acmod_score(acmods[1], &frame_idx[1]));
+        TEST_EQUAL(frame_idx[0], frame_idx[1]);
+        TEST_EQUAL(0, memcmp(acmods[0]->senone_scores,
+                             acmods[1]->senone_scores,
+                             bin_mdef_n_sen(acmods[0]->mdef)
+                             * sizeof(*acmods[0]->senone_scores)));
+        for (i = 0; i < 2; ++i)
+            acmod_advance(acmods[i]);
+        ++n_frames;
+    }
+    TEST_ASSERT(n_frames > 0);
+
+    for (i = 0; i < 2; ++i)
+        acmod_free(acmods[i]);
+    logmath_free(lmath);
+    remove(AMBIN);
+}
+
+static ps_decoder_t *
+init_decoder(char const *hmmdir, char const *ambin)
+{
+    cmd_ln_t *config;
+    ps_decoder_t *ps;
+    char *mean, *var, *featparams;
+
+    mean = string_join(hmmdir, "/means", NULL);
+    var = string_join(hmmdir, "/variances", NULL);
+    featparams = string_join(hmmdir, "/feat.params", NULL);
+    /* The model directory only holds am.bin, and -mdef, -tmat and
+     * -sendump are not given, so they can only come from -ambin. */
+    TEST_ASSERT(config = cmd_ln_init(NULL, ps_args(), TRUE,
+                                     "-hmm", ".",
+                                     "-featparams", featparams,
+                                     "-mean", mean,
+                                     "-var", var,
+                                     "-dict", DATADIR "/turtle.dic",
+                                     "-samprate", "16000", NULL));
+    if (ambin)
+        cmd_ln_set_str_r(config, "-ambin", ambin);
+    ps = ps_init(config);
+    cmd_ln_free_r(config);
+    ckd_free(mean);
+    ckd_free(var);
+    ckd_free(featparams);
+    return ps;
+}
+
+/* Files given explicitly take precedence over a binary model. */
+static void
+test_explicit_files(char const *hmmdir)
+{
+    acmod_t *acmod;
+    ps_decoder_t *ps;
+    ptm_mgau_t *ptm;
+    logmath_t *lmath;
+
+    lmath = logmath_init(1.0001, 0, 0);
+    acmod = init_acmod(hmmdir, lmath, TRUE, FALSE);
+    TEST_EQUAL(0, acmod_write_am(acmod, "am.bin"));
+    acmod_free(acmod);
+    logmath_free(lmath);
+
+    /* An am.bin in -hmm is not used unless it is asked for. */
+    TEST_ASSERT(init_decoder(hmmdir, NULL) == NULL);
+
+    TEST_ASSERT(ps = init_decoder(hmmdir, "am.bin"));
+    TEST_ASSERT(ps->acmod->am);
+    TEST_EQUAL(BIN_MDEF_IN_CONTAINER, ps->acmod->mdef->alloc_mode);
+    TEST_EQUAL(ps->acmod->am, ps->acmod->tmat->am);
+    TEST_EQUAL(0, strcmp("ptm", ps_mgau_base(ps->acmod->mgau)->vt->name));
+    ptm = (ptm_mgau_t *)ps->acmod->mgau;
+    /* The mixture weights come from the container, but the Gaussians
+     * come from -mean and -var. */
+    TEST_EQUAL(ps->acmod->am, ptm->am);
+    TEST_ASSERT(ptm->g->am == NULL);
+    ps_free(ps);
+    remove("am.bin");
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE *rawfh;
+    int16 *buf;
+    size_t nsamps;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    fseek(rawfh, 0, SEEK_END);
+    nsamps = ftell(rawfh) / sizeof(*buf);
+    fseek(rawfh, 0, SEEK_SET);
+    buf = ckd_calloc(nsamps, sizeof(*buf));
+    TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+    fclose(rawfh);
+
+    test_bin_am(MODELDIR "/en-us/en-us", TRUE, buf, nsamps);
+    test_bin_am(DATADIR "/an4_ci_cont", FALSE, buf, nsamps);
+    test_explicit_files(MODELDIR "/en-us/en-us");
+
+    ckd_free(buf);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "ngram_search.h"
+#include "test_macros.h"
+
+/* Decode goforward.raw n times over as a single utterance. */
+static char *
+decode(ps_decoder_t *ps, int n)
+{
+    FILE *rawfh;
+    int16 buf[2048];
+    size_t nread;
+    char const *hyp;
+    int i;
+
+    TEST_EQUAL(0, ps_start_utt(ps));
+    for (i = 0; i < n; ++i) {
+        TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+        while ((nread = fread(buf, sizeof(*buf), 2048, rawfh)) > 0)
+            ps_process_raw(ps, buf, nread, FALSE, FALSE);
+        fclose(rawfh);
+    }
+    TEST_EQUAL(0, ps_end_utt(ps));
+    TEST_ASSERT(hyp = ps_get_hyp(ps, NULL));
+    printf("%s\n", hyp);
+    return ckd_salloc(hyp);
+}
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps, *ps_gc;
+    cmd_ln_t *config, *config_gc;
+    ngram_search_t *ngs, *ngs_gc;
+    char *hyp, *hyp_gc;
+    int32 bp_table_size;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-lm", DATADIR "/turtle.lm.bin",
+                "-dict", DATADIR "/turtle.dic",
+                "-fwdflat", "no",
+                "-bestpath", "no",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+    /* A small table, so that it gets collected several times. */
+    TEST_ASSERT(config_gc =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-lm", DATADIR "/turtle.lm.bin",
+                "-dict", DATADIR "/turtle.dic",
+                "-fwdflat", "no",
+                "-bestpath", "no",
+                "-bpgc", "yes",
+                "-latsize", "100",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps_gc = ps_init(config_gc));
+    ngs = (ngram_search_t *)ps->search;
+    ngs_gc = (ngram_search_t *)ps_gc->search;
+
+    /* The table only grows to what one pass over the audio needs. */
+    hyp_gc = decode(ps_gc, 1);
+    ckd_free(hyp_gc);
+    bp_table_size = ngs_gc->bp_table_size;
+
+    hyp = decode(ps, 5);
+    hyp_gc = decode(ps_gc, 5);
+    TEST_EQUAL(0, strcmp(hyp, hyp_gc));
+    printf("bptable: %d entries used, %d with collection"
+           " (%d after one pass), %d retired\n", ngs->bpidx,
+           ngs_gc->bp_table_size, bp_table_size, ngs_gc->n_bp_retired);
+    TEST_EQUAL(0, ngs->n_bp_retired);
+    TEST_ASSERT(ngs_gc->n_bp_retired > 0);
+    TEST_EQUAL(bp_table_size, ngs_gc->bp_table_size);
+    TEST_ASSERT(ngs_gc->bp_table_size < ngs->bpidx);
+    /* The retired entries are gone from the lattice. */
+    TEST_ASSERT(ps_get_lattice(ps_gc) == NULL);
+    ckd_free(hyp);
+    ckd_free(hyp_gc);
+
+    ps_free(ps);
+    ps_free(ps_gc);
+    cmd_ln_free_r(config);
+    cmd_ln_free_r(config_gc);
+
+    return 0;
+}
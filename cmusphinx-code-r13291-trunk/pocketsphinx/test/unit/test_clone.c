@@ -0,0 +1,111 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+static int32
+decode(ps_decoder_t *ps, char const *expect)
+{
+    FILE *rawfh;
+    char const *hyp;
+    int32 score;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    ps_decode_raw(ps, rawfh, -1);
+    fclose(rawfh);
+    hyp = ps_get_hyp(ps, &score);
+    printf("%s (%d)\n", hyp, score);
+    TEST_EQUAL(0, strcmp(expect, hyp));
+    return score;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps, *ps2, *ps3, *ps4;
+    char const *names[] = { "default", "tidigits" };
+    float32 weights[] = { 0.9, 0.1 };
+    int32 score;
+    ngram_model_t *lmset, *lmset2, *lm;
+    cmd_ln_t *config;
+    ps_mllr_t *mllr;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-fsg", DATADIR "/goforward.fsg",
+                "-dict", DATADIR "/turtle.dic",
+                "-bestpath", "no",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+    /* An N-Gram search with two models, the second one selected. */
+    TEST_EQUAL(0, ps_set_lm_file(ps, "lm", DATADIR "/turtle.lm.bin"));
+    TEST_ASSERT(lmset = ps_get_lm(ps, "lm"));
+    TEST_ASSERT(lm = ngram_model_read(config, DATADIR "/tidigits/lm/tidigits.lm.bin",
+                                      NGRAM_BIN, ps_get_logmath(ps)));
+    /* The set takes ownership of the model, and keeps the word IDs
+     * that the search already uses. */
+    TEST_ASSERT(ngram_model_set_add(lmset, lm, "tidigits", 1.0, TRUE));
+    TEST_ASSERT(ngram_model_set_select(lmset, "tidigits"));
+    TEST_ASSERT(ps2 = ps_clone(ps));
+
+    /* Models are shared, state is not. */
+    TEST_ASSERT(ps2->acmod != ps->acmod);
+    TEST_EQUAL(ps2->acmod->mdef, ps->acmod->mdef);
+    TEST_EQUAL(ps2->acmod->tmat, ps->acmod->tmat);
+    TEST_EQUAL(ps_mgau_base(ps2->acmod->mgau)->shared, ps->acmod->mgau);
+    TEST_EQUAL(ps2->dict, ps->dict);
+    TEST_EQUAL(ps2->d2p, ps->d2p);
+    TEST_EQUAL(ps_get_fsg(ps2, PS_DEFAULT_SEARCH),
+               ps_get_fsg(ps, PS_DEFAULT_SEARCH));
+    TEST_EQUAL(0, strcmp(ps_get_search(ps2), ps_get_search(ps)));
+
+    /* Every language model is copied, with the same one selected. */
+    TEST_ASSERT(lmset2 = ps_get_lm(ps2, "lm"));
+    TEST_ASSERT(lmset2 != lmset);
+    TEST_EQUAL(2, ngram_model_set_count(lmset2));
+    TEST_EQUAL(0, strcmp("tidigits", ngram_model_set_current(lmset2)));
+    TEST_ASSERT(ngram_model_set_lookup(lmset2, "default"));
+    TEST_ASSERT(ngram_model_set_lookup(lmset2, "default")
+                != ngram_model_set_lookup(lmset, "default"));
+    TEST_ASSERT(ngram_model_set_lookup(lmset2, "tidigits")
+                != ngram_model_set_lookup(lmset, "tidigits"));
+
+    decode(ps, "go forward ten meters");
+    decode(ps2, "go forward ten meters");
+
+    /* Interpolation weights are copied as well. */
+    TEST_ASSERT(ngram_model_set_interp(lmset, names, weights));
+    TEST_EQUAL(0, ps_set_search(ps, "lm"));
+    TEST_ASSERT(ps4 = ps_clone(ps));
+    TEST_EQUAL(NULL, ngram_model_set_current(ps_get_lm(ps4, "lm")));
+    score = decode(ps, "go forward ten meters");
+    TEST_EQUAL(score, decode(ps4, "go forward ten meters"));
+    /* Which would not be the case with uniform weights. */
+    weights[0] = weights[1] = 0.5;
+    TEST_ASSERT(ngram_model_set_interp(ps_get_lm(ps4, "lm"), names, weights));
+    TEST_ASSERT(score != decode(ps4, "go forward ten meters"));
+    ps_free(ps4);
+    TEST_EQUAL(0, ps_set_search(ps, PS_DEFAULT_SEARCH));
+
+    /* Shared parameters cannot be transformed. */
+    TEST_ASSERT(mllr = ps_mllr_read(DATADIR "/mllr_matrices"));
+    TEST_ASSERT(ps_update_mllr(ps2, mllr) == NULL);
+    ps_mllr_free(mllr);
+
+    /* A clone of a clone shares the original parameters. */
+    TEST_ASSERT(ps3 = ps_clone(ps2));
+    TEST_EQUAL(ps_mgau_base(ps3->acmod->mgau)->shared, ps->acmod->mgau);
+
+    /* Parameters outlive the decoder that loaded them. */
+    ps_free(ps);
+    decode(ps3, "go forward ten meters");
+    ps_free(ps3);
+    decode(ps2, "go forward ten meters");
+    ps_free(ps2);
+    cmd_ln_free_r(config);
+
+    return 0;
+}
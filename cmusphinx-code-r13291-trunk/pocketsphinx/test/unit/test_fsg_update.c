@@ -0,0 +1,118 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "fsg_search_internal.h"
+#include "fsg_lextree.h"
+#include "test_macros.h"
+
+static const char *turtle_jsgf =
+    "#JSGF V1.0;\n"
+    "grammar turtle;\n"
+    "public <move> = go (forward | backward) (two | ten) [meter | meters];\n";
+
+static const char *grammar_jsgf =
+    "#JSGF V1.0;\n"
+    "grammar turtle%d;\n"
+    "public <move> = go forward ten;\n";
+
+static const char *
+decode(ps_decoder_t *ps, int32 *out_score)
+{
+    FILE *rawfh;
+    const char *hyp;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    ps_decode_raw(ps, rawfh, -1);
+    fclose(rawfh);
+    hyp = ps_get_hyp(ps, out_score);
+    printf("%s (%d)\n", hyp, *out_score);
+    return hyp;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps;
+    cmd_ln_t *config;
+    fsg_model_t *fsg, *turtle;
+    fsg_search_t *fsgs;
+    char *hyp, jsgf[100];
+    int32 score, score2, n_update, i;
+    void *val;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-fsg", DATADIR "/goforward.fsg",
+                "-dict", DATADIR "/turtle.dic",
+                "-lw", "7",
+                "-bestpath", "no",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+    hyp = ckd_salloc(decode(ps, &score));
+    TEST_EQUAL(0, strcmp("go forward ten meters", hyp));
+    fsgs = (fsg_search_t *)ps->search;
+
+    /* Updating the existing search gives the same result as a new one. */
+    TEST_EQUAL(0, ps_set_jsgf_string(ps, PS_DEFAULT_SEARCH, turtle_jsgf));
+    TEST_ASSERT(fsgs == (fsg_search_t *)ps->search);
+    TEST_EQUAL(0, ps_set_jsgf_string(ps, "fresh", turtle_jsgf));
+    TEST_EQUAL(0, strcmp("go forward ten meters", decode(ps, &score2)));
+    TEST_EQUAL(0, ps_set_search(ps, "fresh"));
+    TEST_EQUAL(0, strcmp("go forward ten meters", decode(ps, &score)));
+    TEST_EQUAL(score, score2);
+
+    /* Switching back reuses the subtrees of the first grammar, and
+     * nothing at all needs to be rebuilt for the same one. */
+    TEST_EQUAL(0, ps_set_search(ps, PS_DEFAULT_SEARCH));
+    TEST_ASSERT(fsg = fsg_model_readfile(DATADIR "/goforward.fsg",
+                                         ps_get_logmath(ps), 7));
+    TEST_EQUAL(0, ps_set_fsg(ps, PS_DEFAULT_SEARCH, fsg));
+    fsg_model_free(fsg);
+    TEST_EQUAL(0, strcmp(hyp, decode(ps, &score2)));
+    TEST_EQUAL(0, fsg_lextree_update(fsgs->lextree, fsgs->fsg));
+    TEST_EQUAL(0, strcmp(hyp, decode(ps, &score)));
+    TEST_EQUAL(score, score2);
+
+    /* The subtrees of the grammar switched away from are kept. */
+    TEST_ASSERT(fsg_lextree_update(fsgs->lextree,
+                                   ps_get_fsg(ps, "fresh")) > 0);
+    TEST_EQUAL(0, fsg_lextree_update(fsgs->lextree, fsgs->fsg));
+    TEST_EQUAL(0, strcmp(hyp, decode(ps, &score)));
+    TEST_EQUAL(score, score2);
+
+    /* Changing the grammar in place moves its arcs, which the lextree
+     * follows at the start of the next utterance. */
+    n_update = fsgs->lextree->n_update;
+    TEST_ASSERT(fsg_model_add_silence(fsgs->fsg, "<sil>", -1, 0.3) > 0);
+    TEST_ASSERT(!fsg_model_is_compiled(fsgs->fsg));
+    TEST_EQUAL(0, strcmp(hyp, decode(ps, &score)));
+    TEST_EQUAL(n_update + 1, fsgs->lextree->n_update);
+    TEST_ASSERT(fsgs->fsg->old_arcs == NULL);
+
+    /* Grammar strings are cached, dropping the least recently used
+     * one when there are too many. */
+    TEST_EQUAL(0, ps_set_jsgf_string(ps, "cache", turtle_jsgf));
+    turtle = ps_get_fsg(ps, "cache");
+    for (i = 0; i < 20; ++i) {
+        sprintf(jsgf, grammar_jsgf, i);
+        TEST_EQUAL(0, ps_set_jsgf_string(ps, "cache", jsgf));
+        TEST_EQUAL(0, ps_set_jsgf_string(ps, "cache", turtle_jsgf));
+        TEST_ASSERT(turtle == ps_get_fsg(ps, "cache"));
+    }
+    TEST_EQUAL(16, hash_table_inuse(ps->jsgf_cache));
+    TEST_EQUAL(16, glist_count(ps->jsgf_lru));
+    TEST_EQUAL(0, strcmp(turtle_jsgf, gnode_ptr(ps->jsgf_lru)));
+    sprintf(jsgf, grammar_jsgf, 4);
+    TEST_ASSERT(hash_table_lookup(ps->jsgf_cache, jsgf, &val) < 0);
+    sprintf(jsgf, grammar_jsgf, 5);
+    TEST_EQUAL(0, hash_table_lookup(ps->jsgf_cache, jsgf, &val));
+
+    ckd_free(hyp);
+    ps_free(ps);
+    cmd_ln_free_r(config);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sphinxbase/ckd_alloc.h>
+
+#include "hmm.h"
+#include "test_macros.h"
+
+#define N_HMM 1001
+#define N_SEN 500
+#define N_SSEQ 100
+#define N_TMAT 8
+#define N_FRAME 50
+
+int
+main(int argc, char *argv[])
+{
+    uint8 ***tp;
+    uint16 **sseq;
+    int16 *senscore;
+    hmm_context_t *ctx;
+    hmm_pool_t *pool;
+    hmm_t *ref, *hmm;
+    int i, j, k, frame;
+
+    srand(42);
+    tp = (uint8 ***)ckd_calloc_3d(N_TMAT, 3, 4, sizeof(***tp));
+    for (i = 0; i < N_TMAT; ++i) {
+        for (j = 0; j < 3; ++j) {
+            for (k = 0; k < 4; ++k) {
+                if (k == j || k == j + 1)
+                    tp[i][j][k] = rand() % 50;
+                else if (k == j + 2 && rand() % 2)
+                    tp[i][j][k] = rand() % 100;
+                else
+                    tp[i][j][k] = 255;
+            }
+        }
+    }
+    sseq = (uint16 **)ckd_calloc_2d(N_SSEQ, 3, sizeof(**sseq));
+    for (i = 0; i < N_SSEQ; ++i)
+        for (j = 0; j < 3; ++j)
+            sseq[i][j] = rand() % N_SEN;
+    senscore = ckd_calloc(N_SEN, sizeof(*senscore));
+    TEST_ASSERT(ctx = hmm_context_init(3, tp, senscore, sseq));
+
+    /* Mix of multiplex and non-multiplex HMMs, some of them inactive. */
+    ref = ckd_calloc(N_HMM, sizeof(*ref));
+    for (i = 0; i < N_HMM; ++i) {
+        hmm_init(ctx, &ref[i], (i % 7 == 0), rand() % N_SSEQ, rand() % N_TMAT);
+        if (i % 5 != 0)
+            hmm_enter(&ref[i], -(rand() % 10000), i, 0);
+    }
+    hmm = ckd_calloc(N_HMM, sizeof(*hmm));
+    memcpy(hmm, ref, N_HMM * sizeof(*hmm));
+
+    TEST_ASSERT(pool = hmm_pool_init());
+    for (frame = 0; frame < N_FRAME; ++frame) {
+        int32 best, pool_best;
+
+        for (i = 0; i < N_SEN; ++i)
+            senscore[i] = rand() % 3000;
+        best = WORST_SCORE;
+        for (i = 0; i < N_HMM; ++i) {
+            int32 score = hmm_vit_eval(&ref[i]);
+            if (score BETTER_THAN best)
+                best = score;
+            hmm_pool_add(pool, &hmm[i]);
+        }
+        pool_best = hmm_pool_eval(pool);
+        TEST_EQUAL(best, pool_best);
+        for (i = 0; i < N_HMM; ++i) {
+            TEST_EQUAL(0, memcmp(&ref[i], &hmm[i], sizeof(*hmm)));
+        }
+        /* Re-enter some of them to exercise history propagation. */
+        for (i = frame % 3; i < N_HMM; i += 3) {
+            hmm_enter(&ref[i], -(i % 777), i + frame, frame);
+            hmm_enter(&hmm[i], -(i % 777), i + frame, frame);
+        }
+    }
+
+    hmm_pool_free(pool);
+    ckd_free(ref);
+    ckd_free(hmm);
+    hmm_context_free(ctx);
+    ckd_free(senscore);
+    ckd_free_2d(sseq);
+    ckd_free_3d(tp);
+    return 0;
+}
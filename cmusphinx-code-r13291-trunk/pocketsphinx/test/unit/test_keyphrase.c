@@ -6,6 +6,32 @@
 #include "test_macros.h"
 #include "test_ps.c"
 
+static void
+test_update(cmd_ln_t *config)
+{
+    ps_decoder_t *ps;
+    FILE *rawfh;
+    char *kws;
+
+    /* Keyphrases are replaced in place in an existing search. */
+    TEST_ASSERT(ps = ps_init(config));
+    TEST_EQUAL(0, ps_set_keyphrase(ps, PS_DEFAULT_SEARCH, "meters"));
+    kws = (char *)ps_get_kws(ps, PS_DEFAULT_SEARCH);
+    TEST_EQUAL(0, strcmp(kws, "meters"));
+    ckd_free(kws);
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    ps_decode_raw(ps, rawfh, -1);
+    TEST_EQUAL(0, strcmp(ps_get_hyp(ps, NULL), "meters"));
+
+    TEST_EQUAL(0, ps_set_kws(ps, PS_DEFAULT_SEARCH, DATADIR "/goforward.kws"));
+    clearerr(rawfh);
+    fseek(rawfh, 0, SEEK_SET);
+    ps_decode_raw(ps, rawfh, -1);
+    TEST_EQUAL(0, strcmp(ps_get_hyp(ps, NULL), "forward"));
+    fclose(rawfh);
+    ps_free(ps);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -16,5 +42,6 @@ main(int argc, char *argv[])
                 "-hmm", MODELDIR "/en-us/en-us",
                 "-kws", DATADIR "/goforward.kws",
                 "-dict", MODELDIR "/en-us/cmudict-en-us.dict", NULL));
+    test_update(config);
     return ps_decoder_test(config, "KEYPHRASE", "forward");
 }
@@ -92,6 +92,35 @@ test_remaining_nodes(ps_lattice_t *dag) {
 }
 
 
+/* Check that two lattices read from files have the same structure. */
+static int
+test_same_lattice(ps_lattice_t *a, ps_lattice_t *b)
+{
+	ps_latnode_t *na, *nb;
+
+	TEST_EQUAL(a->n_frames, b->n_frames);
+	TEST_EQUAL(a->start->id, b->start->id);
+	TEST_EQUAL(a->end->id, b->end->id);
+	for (na = a->nodes, nb = b->nodes; na && nb;
+	     na = na->next, nb = nb->next) {
+		latlink_list_t *la, *lb;
+
+		TEST_EQUAL(na->id, nb->id);
+		TEST_EQUAL(na->wid, nb->wid);
+		TEST_EQUAL(na->sf, nb->sf);
+		TEST_EQUAL(na->fef, nb->fef);
+		TEST_EQUAL(na->lef, nb->lef);
+		for (la = na->exits, lb = nb->exits; la && lb;
+		     la = la->next, lb = lb->next) {
+			TEST_EQUAL(la->link->to->id, lb->link->to->id);
+			TEST_EQUAL(la->link->ascr, lb->link->ascr);
+		}
+		TEST_ASSERT(la == NULL && lb == NULL);
+	}
+	TEST_ASSERT(na == NULL && nb == NULL);
+	return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -126,6 +155,7 @@ main(int argc, char *argv[])
 	test_nodes_and_stuff(dag);
 
 	TEST_EQUAL(0, ps_lattice_write(dag, "goforward.lat"));
+	TEST_EQUAL(0, ps_lattice_write_bin(dag, "goforward_bin.lat"));
 
 	dag = ps_lattice_read(ps, "goforward.lat");
 	TEST_ASSERT(dag);
@@ -134,6 +164,15 @@ main(int argc, char *argv[])
 	printf("P(S|O) = %d\n", score);
 	test_nodes_and_stuff(dag);
 	ps_lattice_free(dag);
+
+	/* The binary lattice gives the same result. */
+	dag = ps_lattice_read(ps, "goforward_bin.lat");
+	TEST_ASSERT(dag);
+	ps_lattice_bestpath(dag, ps_get_lm(ps, PS_DEFAULT_SEARCH), 1.0, 1.0/15.0);
+	score = ps_lattice_posterior(dag, ps_get_lm(ps, PS_DEFAULT_SEARCH), 1.0/15.0);
+	printf("P(S|O) = %d\n", score);
+	test_nodes_and_stuff(dag);
+	ps_lattice_free(dag);
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
@@ -141,6 +180,13 @@ main(int argc, char *argv[])
 	dag = ps_lattice_read(NULL, "goforward.lat");
 	TEST_ASSERT(dag);
 	test_nodes_and_stuff(dag);
+	{
+		ps_lattice_t *bdag;
+
+		TEST_ASSERT(bdag = ps_lattice_read(NULL, "goforward_bin.lat"));
+		test_same_lattice(dag, bdag);
+		ps_lattice_free(bdag);
+	}
 	ps_lattice_free(dag);
 
 	/* Test stripping the unreachable nodes. */
@@ -0,0 +1,91 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "ngram_search.h"
+#include "test_macros.h"
+
+static void
+decode(ps_decoder_t *ps)
+{
+    FILE *rawfh;
+    int16 buf[2048];
+    size_t nread;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    while ((nread = fread(buf, sizeof(*buf), 2048, rawfh)) > 0)
+        ps_process_raw(ps, buf, nread, FALSE, FALSE);
+    fclose(rawfh);
+}
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps;
+    cmd_ln_t *config;
+    ngram_search_t *ngs;
+    int32 go, forward, ten, start;
+    int32 score, n_used, n_used2, hit, miss;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-lm", DATADIR "/turtle.lm.bin",
+                "-dict", DATADIR "/turtle.dic",
+                "-fwdflat", "no",
+                "-bestpath", "no",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+    ngs = (ngram_search_t *)ps->search;
+    go = ngram_wid(ngs->lmset, "go");
+    forward = ngram_wid(ngs->lmset, "forward");
+    ten = ngram_wid(ngs->lmset, "ten");
+    start = ngram_wid(ngs->lmset, "<s>");
+
+    /* The first query misses and the same one then hits. */
+    TEST_EQUAL(0, ps_start_utt(ps));
+    TEST_EQUAL(0, ngs->st.n_lm_cache_hit);
+    TEST_EQUAL(0, ngs->st.n_lm_cache_miss);
+    score = ngram_search_lm_score(ngs, forward, go, start, &n_used);
+    TEST_EQUAL(score, ngram_tg_score(ngs->lmset, forward, go, start, &n_used2));
+    TEST_EQUAL(n_used, n_used2);
+    TEST_EQUAL(0, ngs->st.n_lm_cache_hit);
+    TEST_EQUAL(1, ngs->st.n_lm_cache_miss);
+    n_used = 0;
+    TEST_EQUAL(score, ngram_search_lm_score(ngs, forward, go, start, &n_used));
+    TEST_EQUAL(n_used, n_used2);
+    TEST_EQUAL(1, ngs->st.n_lm_cache_hit);
+    TEST_EQUAL(1, ngs->st.n_lm_cache_miss);
+    /* Another word or history is looked up. */
+    ngram_search_lm_score(ngs, ten, go, start, &n_used);
+    ngram_search_lm_score(ngs, forward, go, go, &n_used);
+    TEST_EQUAL(1, ngs->st.n_lm_cache_hit);
+    TEST_EQUAL(3, ngs->st.n_lm_cache_miss);
+
+    /* The search then finds most of its scores in the cache. */
+    decode(ps);
+    TEST_EQUAL(0, ps_end_utt(ps));
+    hit = ngs->st.n_lm_cache_hit;
+    miss = ngs->st.n_lm_cache_miss;
+    printf("%d hits %d misses\n", hit, miss);
+    TEST_ASSERT(hit > miss);
+    TEST_EQUAL(hit, ngs->n_tot_lm_cache_hit);
+    TEST_EQUAL(miss, ngs->n_tot_lm_cache_miss);
+
+    /* Starting an utterance empties the cache. */
+    TEST_EQUAL(0, ps_start_utt(ps));
+    TEST_EQUAL(score, ngram_search_lm_score(ngs, forward, go, start, &n_used));
+    TEST_EQUAL(0, ngs->st.n_lm_cache_hit);
+    TEST_EQUAL(1, ngs->st.n_lm_cache_miss);
+    decode(ps);
+    TEST_EQUAL(0, ps_end_utt(ps));
+    /* Totals are kept over all utterances. */
+    TEST_EQUAL(hit + ngs->st.n_lm_cache_hit, ngs->n_tot_lm_cache_hit);
+    TEST_EQUAL(miss + ngs->st.n_lm_cache_miss, ngs->n_tot_lm_cache_miss);
+
+    ps_free(ps);
+    cmd_ln_free_r(config);
+
+    return 0;
+}
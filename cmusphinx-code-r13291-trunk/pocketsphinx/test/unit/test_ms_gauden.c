@@ -0,0 +1,92 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "ms_gauden.h"
+#include "test_macros.h"
+
+/* Reference implementation over the unblocked parameters. */
+static mfcc_t
+ref_dist(gauden_t *g, int mgau, int feat, int d, mfcc_t *obs)
+{
+	mfcc_t dval = g->det[mgau][feat][d];
+	int i;
+
+	for (i = 0; i < g->featlen[feat]; ++i) {
+		mfcc_t diff = obs[i] - g->mean[mgau][feat][d][i];
+		dval -= MFCCMUL(MFCCMUL(diff, diff), g->var[mgau][feat][d][i]);
+	}
+	return dval;
+}
+
+static void
+check_codebook(gauden_t *g, int mgau, int n_top, mfcc_t **obs,
+	       gauden_dist_t **dist)
+{
+	int f, i, d;
+
+	TEST_EQUAL(0, gauden_dist(g, mgau, n_top, obs, dist));
+	for (f = 0; f < g->n_feat; ++f) {
+		for (i = 0; i < n_top; ++i) {
+			int n_better = 0;
+			/* Each result is what the reference computes. */
+			TEST_EQUAL(dist[f][i].dist,
+				   ref_dist(g, mgau, f, dist[f][i].id, obs[f]));
+			if (n_top == g->n_density) {
+				TEST_EQUAL(i, dist[f][i].id);
+				continue;
+			}
+			/* And it is in the right place in the top-N. */
+			if (i > 0)
+				TEST_ASSERT(dist[f][i].dist <= dist[f][i-1].dist);
+			for (d = 0; d < g->n_density; ++d)
+				if (ref_dist(g, mgau, f, d, obs[f]) > dist[f][i].dist)
+					++n_better;
+			TEST_ASSERT(n_better <= i);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	gauden_t *g;
+	gauden_dist_t **dist;
+	mfcc_t **obs;
+	int m, f, i;
+
+	lmath = logmath_init(1.0001, 0, 0);
+	TEST_ASSERT(g = gauden_init(MODELDIR "/en-us/en-us/means",
+				    MODELDIR "/en-us/en-us/variances",
+				    0.0001, lmath));
+	TEST_EQUAL(0, gauden_blk_init(g));
+	TEST_ASSERT(g->blk_eval);
+
+	dist = (gauden_dist_t **)ckd_calloc_2d(g->n_feat, g->n_density,
+					       sizeof(**dist));
+	obs = (mfcc_t **)ckd_calloc(g->n_feat, sizeof(*obs));
+	for (f = 0; f < g->n_feat; ++f)
+		obs[f] = ckd_calloc(g->featlen[f], sizeof(**obs));
+
+	for (m = 0; m < g->n_mgau; ++m) {
+		/* Perturb one of the means so there is a clear winner. */
+		for (f = 0; f < g->n_feat; ++f)
+			for (i = 0; i < g->featlen[f]; ++i)
+				obs[f][i] = g->mean[m][f][(m * 7) % g->n_density][i]
+					+ FLOAT2MFCC(0.1) * ((i % 3) - 1);
+		check_codebook(g, m, 1, obs, dist);
+		check_codebook(g, m, 4, obs, dist);
+		check_codebook(g, m, g->n_density, obs, dist);
+	}
+
+	for (f = 0; f < g->n_feat; ++f)
+		ckd_free(obs[f]);
+	ckd_free(obs);
+	ckd_free_2d(dist);
+	gauden_free(g);
+	logmath_free(lmath);
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sphinxbase/hash_table.h>
+
+#include "pocketsphinx_internal.h"
+#include "ps_lattice_internal.h"
+#include "test_macros.h"
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps;
+    ps_nbest_t *nbest;
+    cmd_ln_t *config;
+    hash_table_t *hyps;
+    FILE *rawfh;
+    int32 n, n_dup;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-lm", DATADIR "/turtle.lm.bin",
+                "-dict", DATADIR "/turtle.dic",
+                "-fwdtree", "yes",
+                "-fwdflat", "no",
+                "-bestpath", "yes",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    ps_decode_raw(ps, rawfh, -1);
+    fclose(rawfh);
+
+    /* The lattice has many paths for each word sequence, differing
+     * only in timing and fillers, but each one is returned once. */
+    hyps = hash_table_new(100, HASH_CASE_YES);
+    n_dup = 0;
+    for (n = 0, nbest = ps_nbest(ps); nbest && n < 100;
+         nbest = ps_nbest_next(nbest), n++) {
+        char const *hyp;
+
+        TEST_ASSERT(hyp = ps_nbest_hyp(nbest, NULL));
+        printf("NBEST %d: %s\n", n, hyp);
+        TEST_ASSERT(hash_table_enter(hyps, hyp, (void *)hyp) == (void *)hyp);
+        n_dup = nbest->n_hyp_dup;
+    }
+    printf("%d hypotheses, %d duplicates skipped\n", n, n_dup);
+    TEST_ASSERT(n > 1);
+    TEST_ASSERT(n_dup > 0);
+    if (nbest)
+        ps_nbest_free(nbest);
+    hash_table_free(hyps);
+
+    ps_free(ps);
+    cmd_ln_free_r(config);
+    return 0;
+}
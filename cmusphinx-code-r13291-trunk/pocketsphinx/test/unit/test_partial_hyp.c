@@ -0,0 +1,94 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+/* Length of the first n words of hyp. */
+static size_t
+prefix_len(char const *hyp, int32 n)
+{
+    char const *c;
+
+    if (n == 0)
+        return 0;
+    for (c = hyp; *c; ++c)
+        if (*c == ' ' && --n == 0)
+            break;
+    return c - hyp;
+}
+
+static int
+decode(ps_decoder_t *ps, int release, char const *expect)
+{
+    FILE *rawfh;
+    int16 buf[2048];
+    size_t nread;
+    char stable[256];
+    char const *hyp;
+    int32 n_stable;
+    int n_released;
+
+    TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+    TEST_EQUAL(0, ps_start_utt(ps));
+    stable[0] = '\0';
+    n_released = 0;
+    while ((nread = fread(buf, sizeof(*buf), 2048, rawfh)) > 0) {
+        size_t len;
+
+        ps_process_raw(ps, buf, nread, FALSE, FALSE);
+        hyp = ps_get_partial_hyp(ps, &n_stable);
+        printf("%d: %s\n", n_stable, hyp ? hyp : "(null)");
+        if (hyp == NULL)
+            continue;
+        /* Stable words never change. */
+        len = prefix_len(hyp, n_stable);
+        TEST_ASSERT(len >= strlen(stable));
+        TEST_EQUAL(0, strncmp(stable, hyp, strlen(stable)));
+        memcpy(stable, hyp, len);
+        stable[len] = '\0';
+        if (release)
+            n_released += ps_release_stable(ps);
+    }
+    fclose(rawfh);
+    TEST_EQUAL(0, ps_end_utt(ps));
+
+    hyp = ps_get_partial_hyp(ps, &n_stable);
+    printf("%d: %s\n", n_stable, hyp);
+    TEST_EQUAL(0, strcmp(expect, hyp));
+    TEST_EQUAL(4, n_stable);
+    TEST_EQUAL(0, strncmp(stable, hyp, strlen(stable)));
+    TEST_EQUAL(0, strcmp(expect, ps_get_hyp(ps, NULL)));
+
+    return n_released;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ps_decoder_t *ps;
+    cmd_ln_t *config;
+
+    TEST_ASSERT(config =
+            cmd_ln_init(NULL, ps_args(), TRUE,
+                "-hmm", MODELDIR "/en-us/en-us",
+                "-lm", DATADIR "/turtle.lm.bin",
+                "-dict", DATADIR "/turtle.dic",
+                "-fwdflat", "no",
+                "-bestpath", "no",
+                "-samprate", "16000", NULL));
+    TEST_ASSERT(ps = ps_init(config));
+
+    TEST_EQUAL(0, decode(ps, FALSE, "go forward ten meters"));
+    TEST_ASSERT(decode(ps, TRUE, "go forward ten meters") > 0);
+    /* The released part of the utterance has no lattice. */
+    TEST_ASSERT(ps_get_lattice(ps) == NULL);
+    /* The decoder still works normally afterwards. */
+    TEST_EQUAL(0, decode(ps, FALSE, "go forward ten meters"));
+
+    ps_free(ps);
+    cmd_ln_free_r(config);
+
+    return 0;
+}
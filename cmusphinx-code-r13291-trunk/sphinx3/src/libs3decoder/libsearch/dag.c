@@ -161,6 +161,8 @@
 
 #include <sphinxbase/listelem_alloc.h>
 #include <sphinxbase/pio.h>
+#include <sphinxbase/bio.h>
+#include <sphinxbase/strfuncs.h>
 
 #include "dag.h"
 #include "vithist.h"
@@ -1111,6 +1113,174 @@ dag_remove_bypass_links(dag_t *dag)
     }
 }
 
+/*
+ * Read the nodes and edges of a DAG in the binary format written by
+ * PocketSphinx's ps_lattice_write_bin().  Edges are linked as they are
+ * read.  Returns 0 if successful, -1 otherwise.
+ */
+static int32
+dag_read_bin(dag_t * dag, FILE * fp, char *file, dict_t * dict,
+             dagnode_t *** out_darray)
+{
+    char **argname, **argval;
+    int32 swap, do_chksum, i;
+    uint32 chksum, file_chksum;
+    uint32 nfrm, nword, nnode, nlink, u;
+    int32 from, to, dfrom;
+    s3wid_t *wids, finishwid;
+    dagnode_t *d, *tail, **darray;
+    float32 lb, f32arg;
+    char *wd;
+
+    if (bio_readhdr(fp, &argname, &argval, &swap) < 0) {
+        E_ERROR("Failed to read header from %s\n", file);
+        return -1;
+    }
+    lb = 0.0;
+    do_chksum = FALSE;
+    for (i = 0; argname[i]; i++) {
+        if (strcmp(argname[i], "logbase") == 0)
+            lb = atof_c(argval[i]);
+        else if (strcmp(argname[i], "chksum0") == 0)
+            do_chksum = TRUE;
+    }
+    bio_hdrarg_free(argname, argval);
+    f32arg = cmd_ln_float32_r(dag->config, "-logbase");
+    if (lb != 0.0 && (lb - f32arg > 0.0001 || f32arg - lb > 0.0001))
+        E_ERROR("%s: logbase inconsistent: %e\n", file, lb);
+
+    finishwid = dict_wordid(dict, S3_FINISH_WORD);
+    wids = NULL;
+    darray = NULL;
+    wd = NULL;
+    chksum = 0;
+    if (bio_fread_varint(&nfrm, fp, &chksum) < 0
+        || bio_fread_varint(&nword, fp, &chksum) < 0)
+        goto read_error;
+    dag->nfrm = nfrm;
+
+    wids = ckd_calloc(nword, sizeof(*wids));
+    for (u = 0; u < nword; u++) {
+        uint32 len;
+
+        if (bio_fread_varint(&len, fp, &chksum) < 0 || len > 4096)
+            goto read_error;
+        wd = ckd_malloc(len + 1);
+        if (bio_fread(wd, 1, len, fp, 0, &chksum) != (int32) len)
+            goto read_error;
+        wd[len] = '\0';
+        wids[u] = dict_wordid(dict, wd);
+        if (NOT_S3WID(wids[u])) {
+            E_ERROR("Unknown word in %s: %s\n", file, wd);
+            goto load_error;
+        }
+        ckd_free(wd);
+        wd = NULL;
+    }
+
+    if (bio_fread_varint(&nnode, fp, &chksum) < 0 || nnode == 0)
+        goto read_error;
+    dag->nnode = nnode;
+    darray = (dagnode_t **) ckd_calloc(nnode, sizeof(dagnode_t *));
+    tail = NULL;
+    for (u = 0; u < nnode; u++) {
+        uint32 w, sf;
+        int32 fef, lef, node_id;
+
+        if (bio_fread_varint(&w, fp, &chksum) < 0
+            || bio_fread_varint(&sf, fp, &chksum) < 0
+            || bio_fread_svarint(&fef, fp, &chksum) < 0
+            || bio_fread_svarint(&lef, fp, &chksum) < 0
+            || bio_fread_svarint(&node_id, fp, &chksum) < 0
+            || w >= nword)
+            goto read_error;
+
+        d = listelem_malloc(dag->node_alloc);
+        darray[u] = d;
+        d->wid = wids[w];
+        d->seqid = u;
+        d->sf = sf;
+        d->fef = sf + fef;
+        d->lef = d->fef + lef;
+        d->reachable = 0;
+        d->succlist = NULL;
+        d->predlist = NULL;
+        d->alloc_next = NULL;
+        d->node_ascr = d->node_lscr = 0;
+
+        if (!dag->list)
+            dag->list = d;
+        else
+            tail->alloc_next = d;
+        tail = d;
+    }
+
+    if (bio_fread_varint(&u, fp, &chksum) < 0 || u >= nnode)
+        goto read_error;
+    dag->entry.node = darray[u];
+    dag->entry.ascr = 0;
+    dag->entry.next = NULL;
+    dag->entry.pscr_valid = 0;
+
+    if (bio_fread_varint(&u, fp, &chksum) < 0 || u >= nnode)
+        goto read_error;
+    dag->end = darray[u];
+    dag->final.node = darray[u];
+    dag->final.ascr = 0;
+    dag->final.next = NULL;
+    dag->final.pscr_valid = 0;
+    dag->final.bypass = NULL;
+
+    if (bio_fread_varint(&nlink, fp, &chksum) < 0)
+        goto read_error;
+    from = 0;
+    for (u = 0; u < nlink; u++) {
+        uint32 nascr;
+
+        if (bio_fread_svarint(&dfrom, fp, &chksum) < 0
+            || bio_fread_svarint(&to, fp, &chksum) < 0
+            || bio_fread_varint(&nascr, fp, &chksum) < 0)
+            goto read_error;
+        from += dfrom;
+        to += from;
+        if (from < 0 || (uint32) from >= nnode
+            || to < 0 || (uint32) to >= nnode)
+            goto read_error;
+        if (darray[from]->wid == finishwid) {
+            E_WARN("Dag has edges going out of sentence end node %d\n", from);
+            continue;
+        }
+        d = darray[to];
+        if (dag_link(dag, darray[from], d, -(int32) nascr, 0,
+                     d->sf - 1, NULL) < 0) {
+            E_ERROR("%s: maxedge limit (%d) exceeded\n", file,
+                    dag->maxedge);
+            goto load_error;
+        }
+    }
+
+    if (do_chksum) {
+        if (bio_fread(&file_chksum, sizeof(file_chksum), 1, fp, swap, NULL) != 1)
+            goto read_error;
+        if (file_chksum != chksum) {
+            E_ERROR("Checksum error in %s; file-checksum %08x, computed %08x\n",
+                    file, file_chksum, chksum);
+            goto load_error;
+        }
+    }
+    ckd_free(wids);
+    *out_darray = darray;
+    return 0;
+
+  read_error:
+    E_ERROR("Premature EOF or invalid data in %s\n", file);
+  load_error:
+    ckd_free(wd);
+    ckd_free(wids);
+    *out_darray = darray;
+    return -1;
+}
+
 dag_t *
 dag_load(char *file,          /**< Input: File to lod from */
            int32 maxedge,        /**< Maximum # of edges */
@@ -1162,6 +1332,18 @@ dag_load(char *file,          /**< Input: File to lod from */
         return NULL;
     }
 
+    /* Min. endframes value that a node must persist for it to be not ignored */
+    min_ef_range = cmd_ln_int32_r(dag->config, "-min_endfr");
+
+    /* Binary DAGs start with an "s3" header, text ones with a comment. */
+    k = getc(fp);
+    ungetc(k, fp);
+    if (k == 's') {
+        if (dag_read_bin(dag, fp, file, dict, &darray) < 0)
+            goto load_error;
+        goto edges_done;
+    }
+
     /* Read and verify logbase (ONE BIG HACK!!) */
     if (fgets(line, sizeof(line), fp) == NULL) {
         E_ERROR("Premature EOF(%s)\n", file);
@@ -1203,9 +1385,6 @@ dag_load(char *file,          /**< Input: File to lod from */
     }
 
 
-    /* Min. endframes value that a node must persist for it to be not ignored */
-    min_ef_range = cmd_ln_int32_r(dag->config, "-min_endfr");
-
     /* Read Frames parameter */
     dag->nfrm = dag_param_read(fp, "Frames", &lineno);
     if (dag->nfrm <= 0) {
@@ -1424,6 +1603,8 @@ dag_load(char *file,          /**< Input: File to lod from */
         }
     }
 #endif
+
+  edges_done:
     dag->hook = NULL;
 
     /* Find initial node.  (BUG HERE: There may be > 1 initial node for multiple <s>) */
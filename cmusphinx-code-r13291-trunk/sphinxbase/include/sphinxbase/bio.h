@@ -252,6 +252,54 @@ void bio_verify_chksum (FILE *fp,	/**< In: File to read */
 			);
 
 
+/**
+ * Write an unsigned integer as a variable-length integer: seven bits
+ * per byte, least significant first, with the high bit set on all
+ * but the last byte.  Checksum accumulation performed as necessary.
+ *
+ * @return number of bytes written, or -1 if error.
+ */
+SPHINXBASE_EXPORT
+int32 bio_fwrite_varint(uint32 val,     /**< In: Value to write */
+                        FILE *fp,       /**< In: File to write to */
+                        uint32 *chksum  /**< In/Out: Checksum accumulator */
+                        );
+
+/**
+ * Read a variable-length integer written by bio_fwrite_varint().
+ * Checksum accumulation performed as necessary.
+ *
+ * @return number of bytes read, or -1 if error.
+ */
+SPHINXBASE_EXPORT
+int32 bio_fread_varint(uint32 *val,     /**< Out: Value read */
+                       FILE *fp,        /**< In: File to read */
+                       uint32 *chksum   /**< In/Out: Checksum accumulator */
+                       );
+
+/**
+ * Write a signed integer as a zig-zag encoded variable-length integer,
+ * so that values of small magnitude take few bytes regardless of sign.
+ *
+ * @return number of bytes written, or -1 if error.
+ */
+SPHINXBASE_EXPORT
+int32 bio_fwrite_svarint(int32 val,     /**< In: Value to write */
+                         FILE *fp,      /**< In: File to write to */
+                         uint32 *chksum /**< In/Out: Checksum accumulator */
+                         );
+
+/**
+ * Read a signed integer written by bio_fwrite_svarint().
+ *
+ * @return number of bytes read, or -1 if error.
+ */
+SPHINXBASE_EXPORT
+int32 bio_fread_svarint(int32 *val,     /**< Out: Value read */
+                        FILE *fp,       /**< In: File to read */
+                        uint32 *chksum  /**< In/Out: Checksum accumulator */
+                        );
+
 
 /**
  * Write a 1-d array.
@@ -58,6 +58,7 @@
 #include <sphinxbase/bitvec.h>
 #include <sphinxbase/hash_table.h>
 #include <sphinxbase/listelem_alloc.h>
+#include <sphinxbase/mmio.h>
 #include <sphinxbase/sphinxbase_export.h>
 
 #ifdef __cplusplus
@@ -112,6 +113,18 @@ typedef struct fsg_model_s {
 			   logprobs */
     trans_list_t *trans; /**< Transitions out of each state, if any. */
     listelem_alloc_t *link_alloc; /**< Allocator for FSG links. */
+    int32 n_arc;        /**< Number of compiled arcs. */
+    int32 *arc_idx;     /**< Index of first compiled arc out of each state
+                           (n_state + 1 entries), or NULL if not compiled. */
+    int32 *null_idx;    /**< Index of first compiled null arc out of each state. */
+    fsg_link_t *arcs;   /**< Compiled arcs, ordered by source state. */
+    int32 arcs_mapped;  /**< Are arcs in filemap? */
+    fsg_link_t *old_arcs; /**< Arcs from the previous compilation, which
+                             links obtained from them may still point to
+                             until the next one frees them. */
+    int32 n_compile;    /**< Number of times the arcs were compiled, so
+                           users of the links can tell they have moved. */
+    mmio_file_t *filemap; /**< Memory map for binary FSG, if any. */
 } fsg_model_t;
 
 /* Access macros */
@@ -124,6 +137,25 @@ typedef struct fsg_model_s {
 #define fsg_model_n_word(f)		((f)->n_word)
 #define fsg_model_word_str(f,wid)       (wid == -1 ? "(NULL)" : (f)->vocab[wid])
 
+/**
+ * Has the FSG been compiled with fsg_model_compile()?
+ */
+#define fsg_model_is_compiled(f)        ((f)->arc_idx != NULL)
+
+/**
+ * First compiled arc out of state s.  The arcs out of a state are
+ * contiguous, with word arcs before null arcs.
+ */
+#define fsg_model_arcs_begin(f,s)       ((f)->arcs + (f)->arc_idx[s])
+/**
+ * First compiled null arc out of state s.
+ */
+#define fsg_model_null_arcs_begin(f,s)  ((f)->arcs + (f)->null_idx[s])
+/**
+ * End of the compiled arcs out of state s.
+ */
+#define fsg_model_arcs_end(f,s)         ((f)->arcs + (f)->arc_idx[(s) + 1])
+
 /**
  * Iterator over arcs.
  */
@@ -189,10 +221,34 @@ fsg_model_t *fsg_model_init(char const *name, logmath_t *lmath,
  * 
  * Return value: a new fsg_model_t structure if the file is successfully
  * read, NULL otherwise.
+ *
+ * Binary FSG files written by fsg_model_write_bin() are also
+ * recognized, and read with fsg_model_read_bin().
  */
 SPHINXBASE_EXPORT
 fsg_model_t *fsg_model_readfile(const char *file, logmath_t *lmath, float32 lw);
 
+/**
+ * Read a binary FSG written by fsg_model_write_bin().
+ *
+ * The compiled arcs are memory-mapped if possible, so there is no
+ * parsing or null transition closure to do.  If it was written with
+ * a different log base or language weight, the transition scores are
+ * read into memory and rescaled instead.
+ *
+ * @return a new, compiled, fsg_model_t, or NULL on error.
+ */
+SPHINXBASE_EXPORT
+fsg_model_t *fsg_model_read_bin(const char *file, logmath_t *lmath, float32 lw);
+
+/**
+ * Write an FSG in binary format, compiling it first if necessary.
+ *
+ * @return 0 for success, <0 on error.
+ */
+SPHINXBASE_EXPORT
+int fsg_model_write_bin(fsg_model_t *fsg, const char *file);
+
 /**
  * Like fsg_model_readfile(), but from an already open stream.
  */
@@ -281,6 +337,25 @@ int32 fsg_model_tag_trans_add(fsg_model_t * fsg, int32 from, int32 to,
 SPHINXBASE_EXPORT
 glist_t fsg_model_null_trans_closure(fsg_model_t * fsg, glist_t nulls);
 
+/**
+ * Compile the transitions of an FSG into a flat array.
+ *
+ * The arcs out of each state are stored contiguously, ordered by
+ * source state, and can be accessed with fsg_model_arcs_begin(),
+ * fsg_model_null_arcs_begin() and fsg_model_arcs_end(), as well as
+ * with fsg_model_arcs().  Null transitions are not closed here, so
+ * this should be done first, which fsg_model_read() and
+ * jsgf_build_fsg() already do.
+ *
+ * Any further change to the transitions discards the compiled arcs,
+ * though they stay allocated until the FSG is freed, since links to
+ * them may still be in use.
+ *
+ * @return 0 for success (or if already compiled), <0 on error.
+ */
+SPHINXBASE_EXPORT
+int fsg_model_compile(fsg_model_t *fsg);
+
 /**
  * Get the list of transitions (if any) from state i to j.
  */
@@ -77,7 +77,8 @@ typedef enum ngram_file_type_e {
     NGRAM_INVALID = -1, /**< Not a valid file type. */
     NGRAM_AUTO,  /**< Determine file type automatically. */
     NGRAM_ARPA,  /**< ARPABO text format (the standard). */
-    NGRAM_BIN    /**< Sphinx .DMP format. */
+    NGRAM_BIN,   /**< Sphinx .DMP format. */
+    NGRAM_BIN_MMAP /**< Binary trie format aligned for memory-mapped I/O. */
 } ngram_file_type_t;
 
 #define NGRAM_INVALID_WID -1 /**< Impossible word ID */
@@ -149,6 +150,20 @@ char const *ngram_type_to_str(int type);
 SPHINXBASE_EXPORT
 ngram_model_t *ngram_model_retain(ngram_model_t *model);
 
+/**
+ * Create a copy of an N-Gram model which shares its parameters.
+ *
+ * The copy has its own weights and lookup caches, so the original and
+ * its copies can be scored concurrently from different threads.  No
+ * words or classes can be added to the copy, and none must be added
+ * to the original while copies of it exist.
+ *
+ * @return Newly created model, or NULL if this type of model cannot
+ * be copied.
+ */
+SPHINXBASE_EXPORT
+ngram_model_t *ngram_model_copy(ngram_model_t *model);
+
 /**
  * Release memory associated with an N-Gram model.
  *
@@ -626,6 +641,19 @@ ngram_model_t *ngram_model_set_interp(ngram_model_t *set,
                                       const char **names,
                                       const float32 *weights);
 
+/**
+ * Use the interpolation weights and the selected model of another set.
+ *
+ * Models are matched by name, so that a set rebuilt from copies of
+ * the models in <code>other</code> scores the same way.
+ *
+ * @return <code>set</code>, or NULL if <code>other</code> holds a
+ * model that <code>set</code> does not.
+ */
+SPHINXBASE_EXPORT
+ngram_model_t *ngram_model_set_interp_copy(ngram_model_t *set,
+                                           ngram_model_t *other);
+
 /**
  * Add a language model to a set.
  *
@@ -212,6 +212,15 @@ int sbevent_signal(sbevent_t *evt);
 SPHINXBASE_EXPORT
 int sbevent_wait(sbevent_t *evt, int sec, int nsec);
 
+/**
+ * Atomically add to an integer, such as the reference count of an
+ * object shared between threads.
+ *
+ * @return New value of the integer.
+ */
+SPHINXBASE_EXPORT
+int sbatomic_add(int *x, int n);
+
 
 #ifdef __cplusplus
 }
@@ -292,7 +292,7 @@ fe_init_auto_r(cmd_ln_t *config)
     fe->spec = ckd_calloc(fe->fft_size, sizeof(*fe->spec));
     fe->mfspec = ckd_calloc(fe->mel_fb->num_filters, sizeof(*fe->mfspec));
 
-    /* create twiddle factors */
+    /* create twiddle factors and FFT plan */
     fe->ccc = ckd_calloc(fe->fft_size / 4, sizeof(*fe->ccc));
     fe->sss = ckd_calloc(fe->fft_size / 4, sizeof(*fe->sss));
     fe_create_twiddle(fe);
@@ -652,6 +652,8 @@ fe_free(fe_t * fe)
     ckd_free(fe->frame);
     ckd_free(fe->ccc);
     ckd_free(fe->sss);
+    ckd_free(fe->fft_swap);
+    ckd_free(fe->fft_twiddle);
     ckd_free(fe->spec);
     ckd_free(fe->mfspec);
     ckd_free(fe->overflow_samps);
@@ -146,6 +146,12 @@ struct fe_s {
 
     /* Twiddle factors for FFT. */
     frame_t *ccc, *sss;
+    /* Precomputed FFT plan: pairs of indices exchanged by the
+     * bit-reversal permutation, and twiddle factors (cosine, sine)
+     * for each butterfly stage in the order they are used. */
+    int32 *fft_swap;
+    int32 n_fft_swap;
+    frame_t *fft_twiddle;
     /* Mel filter parameters. */
     melfb_t *mel_fb;
     /* Half of a Hamming Window. */
@@ -77,6 +77,14 @@
 #define COSMUL(x,y) ((x)*(y))
 #endif
 
+/* Inner products of spectra with filter and DCT coefficients can use
+ * SSE2 in floating-point (the fixed-point filterbank is done in the
+ * log domain and does not use them). */
+#if !defined(FIXED_POINT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define FE_HAVE_SSE2
+#endif
+
 #ifdef FIXED_POINT
 
 /* Internal log-addition table for natural log with radix point at 8
@@ -865,15 +873,18 @@ fe_shift_frame(fe_t * fe, int16 const *in, int32 len)
 }
 
 /**
- * Create arrays of twiddle factors.
+ * Create arrays of twiddle factors, and the plan for the FFT.
  */
 void
 fe_create_twiddle(fe_t * fe)
 {
-    int i;
+    int i, j, k, m, n, n_twiddle;
+    frame_t *tw;
 
-    for (i = 0; i < fe->fft_size / 4; ++i) {
-        float64 a = 2 * M_PI * i / fe->fft_size;
+    m = fe->fft_order;
+    n = fe->fft_size;
+    for (i = 0; i < n / 4; ++i) {
+        float64 a = 2 * M_PI * i / n;
 #if defined(FIXED_POINT)
         fe->ccc[i] = FLOAT2COS(cos(a));
         fe->sss[i] = FLOAT2COS(sin(a));
@@ -882,6 +893,40 @@ fe_create_twiddle(fe_t * fe)
         fe->sss[i] = sin(a);
 #endif
     }
+
+    /* The bit-reversal permutation, as a list of exchanges (there
+     * are fewer than n/2 of them). */
+    fe->fft_swap = ckd_calloc(n, sizeof(*fe->fft_swap));
+    fe->n_fft_swap = 0;
+    j = 0;
+    for (i = 0; i < n - 1; ++i) {
+        if (i < j) {
+            fe->fft_swap[fe->n_fft_swap * 2] = i;
+            fe->fft_swap[fe->n_fft_swap * 2 + 1] = j;
+            ++fe->n_fft_swap;
+        }
+        k = n / 2;
+        while (k <= j) {
+            j -= k;
+            k /= 2;
+        }
+        j += k;
+    }
+
+    /* Twiddle factors for the complex butterflies in stages 2..m,
+     * stored contiguously so that each stage reads them in order. */
+    n_twiddle = 0;
+    for (k = 2; k < m; ++k)
+        n_twiddle += (1 << (k - 1)) - 1;
+    fe->fft_twiddle = ckd_calloc(n_twiddle * 2 + 1,
+                                 sizeof(*fe->fft_twiddle));
+    tw = fe->fft_twiddle;
+    for (k = 2; k < m; ++k) {
+        for (j = 1; j < (1 << (k - 1)); ++j) {
+            *tw++ = fe->ccc[j << (m - k - 1)];
+            *tw++ = fe->sss[j << (m - k - 1)];
+        }
+    }
 }
 
 
@@ -889,40 +934,58 @@ static int
 fe_fft_real(fe_t * fe)
 {
     int i, j, k, m, n;
-    frame_t *x, xt;
+    frame_t *x, *tw, xt;
 
     x = fe->frame;
     m = fe->fft_order;
     n = fe->fft_size;
 
     /* Bit-reverse the input. */
-    j = 0;
-    for (i = 0; i < n - 1; ++i) {
-        if (i < j) {
-            xt = x[j];
-            x[j] = x[i];
-            x[i] = xt;
-        }
-        k = n / 2;
-        while (k <= j) {
-            j -= k;
-            k /= 2;
+    for (i = 0; i < fe->n_fft_swap; ++i) {
+        int32 a = fe->fft_swap[i * 2];
+        int32 b = fe->fft_swap[i * 2 + 1];
+
+        xt = x[a];
+        x[a] = x[b];
+        x[b] = xt;
+    }
+
+    if (m < 2) {
+        /* Basic butterflies (2-point FFT, real twiddle factors):
+         * x[i]   = x[i] +  1 * x[i+1]
+         * x[i+1] = x[i] + -1 * x[i+1]
+         */
+        for (i = 0; i < n; i += 2) {
+            xt = x[i];
+            x[i] = (xt + x[i + 1]);
+            x[i + 1] = (xt - x[i + 1]);
         }
-        j += k;
+        return m;
     }
 
-    /* Basic butterflies (2-point FFT, real twiddle factors):
-     * x[i]   = x[i] +  1 * x[i+1]
-     * x[i+1] = x[i] + -1 * x[i+1]
+    /* The first two stages have only real twiddle factors, so do
+     * them together as 4-point butterflies:
+     * x[i]   = (x[i] + x[i+1]) + (x[i+2] + x[i+3])
+     * x[i+1] = (x[i] - x[i+1])
+     * x[i+2] = (x[i] + x[i+1]) - (x[i+2] + x[i+3])
+     * x[i+3] = -(x[i+2] - x[i+3])
      */
-    for (i = 0; i < n; i += 2) {
-        xt = x[i];
-        x[i] = (xt + x[i + 1]);
-        x[i + 1] = (xt - x[i + 1]);
+    for (i = 0; i < n; i += 4) {
+        frame_t t0, t1, t2, t3;
+
+        t0 = x[i] + x[i + 1];
+        t1 = x[i] - x[i + 1];
+        t2 = x[i + 2] + x[i + 3];
+        t3 = x[i + 2] - x[i + 3];
+        x[i] = t0 + t2;
+        x[i + 1] = t1;
+        x[i + 2] = t0 - t2;
+        x[i + 3] = -t3;
     }
 
-    /* The rest of the butterflies, in stages from 1..m */
-    for (k = 1; k < m; ++k) {
+    /* The rest of the butterflies, in stages from 2..m */
+    tw = fe->fft_twiddle;
+    for (k = 2; k < m; ++k) {
         int n1, n2, n4;
 
         n4 = k - 1;
@@ -945,7 +1008,6 @@ fe_fft_real(fe_t * fe)
              *   = 1 * x[i + (1<<k-1)] +  0 * x[i + (1<<k) + (1<<k-1)]
              */
             x[i + (1 << n2) + (1 << n4)] = -x[i + (1 << n2) + (1 << n4)];
-            x[i + (1 << n4)] = x[i + (1 << n4)];
 
             /* Butterflies with complex twiddle factors.
              * There are (1<<k-1) of them.
@@ -963,8 +1025,8 @@ fe_fft_real(fe_t * fe)
                  * cc = real(W[j * n / (1<<(k+1))])
                  * ss = imag(W[j * n / (1<<(k+1))])
                  */
-                cc = fe->ccc[j << (m - n1)];
-                ss = fe->sss[j << (m - n1)];
+                cc = tw[(j - 1) * 2];
+                ss = tw[(j - 1) * 2 + 1];
 
                 /* There are some symmetry properties which allow us
                  * to get away with only four multiplications here. */
@@ -977,6 +1039,7 @@ fe_fft_real(fe_t * fe)
                 x[i1] = (x[i1] + t1);
             }
         }
+        tw += ((1 << n4) - 1) * 2;
     }
 
     /* This isn't used, but return it for completeness. */
@@ -1022,6 +1085,37 @@ fe_spec_magnitude(fe_t * fe)
     }
 }
 
+/**
+ * Inner product of part of a spectrum with a row of filter or DCT
+ * coefficients.
+ */
+static powspec_t
+fe_dot(const powspec_t * x, const mfcc_t * c, int32 n)
+{
+    powspec_t sum;
+    int32 i;
+
+#ifdef FE_HAVE_SSE2
+    __m128d acc = _mm_setzero_pd();
+    double part[2];
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128 cf = _mm_castsi128_ps(_mm_loadl_epi64((__m128i const *)
+                                                     (c + i)));
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(x + i),
+                                         _mm_cvtps_pd(cf)));
+    }
+    _mm_storeu_pd(part, acc);
+    sum = part[0] + part[1];
+#else
+    sum = 0;
+    i = 0;
+#endif
+    for (; i < n; ++i)
+        sum += COSMUL(x[i], c[i]);
+    return sum;
+}
+
 static void
 fe_mel_spec(fe_t * fe)
 {
@@ -1032,26 +1126,29 @@ fe_mel_spec(fe_t * fe)
     spec = fe->spec;
     mfspec = fe->mfspec;
     for (whichfilt = 0; whichfilt < fe->mel_fb->num_filters; whichfilt++) {
-        int spec_start, filt_start, i;
+        int spec_start, filt_start;
 
         spec_start = fe->mel_fb->spec_start[whichfilt];
         filt_start = fe->mel_fb->filt_start[whichfilt];
 
 #ifdef FIXED_POINT
-        mfspec[whichfilt] =
-            spec[spec_start] + fe->mel_fb->filt_coeffs[filt_start];
-        for (i = 1; i < fe->mel_fb->filt_width[whichfilt]; i++) {
-            mfspec[whichfilt] = fe_log_add(mfspec[whichfilt],
-                                           spec[spec_start + i] +
-                                           fe->mel_fb->
-                                           filt_coeffs[filt_start + i]);
+        {
+            int i;
+
+            mfspec[whichfilt] =
+                spec[spec_start] + fe->mel_fb->filt_coeffs[filt_start];
+            for (i = 1; i < fe->mel_fb->filt_width[whichfilt]; i++) {
+                mfspec[whichfilt] = fe_log_add(mfspec[whichfilt],
+                                               spec[spec_start + i] +
+                                               fe->mel_fb->
+                                               filt_coeffs[filt_start + i]);
+            }
         }
 #else                           /* !FIXED_POINT */
-        mfspec[whichfilt] = 0;
-        for (i = 0; i < fe->mel_fb->filt_width[whichfilt]; i++)
-            mfspec[whichfilt] +=
-                spec[spec_start + i] * fe->mel_fb->filt_coeffs[filt_start +
-                                                               i];
+        /* Each filter only covers a band of the spectrum. */
+        mfspec[whichfilt] = fe_dot(spec + spec_start,
+                                   fe->mel_fb->filt_coeffs + filt_start,
+                                   fe->mel_fb->filt_width[whichfilt]);
 #endif                          /* !FIXED_POINT */
     }
 
@@ -1102,7 +1199,7 @@ fe_mel_cep(fe_t * fe, mfcc_t * mfcep)
 void
 fe_spec2cep(fe_t * fe, const powspec_t * mflogspec, mfcc_t * mfcep)
 {
-    int32 i, j, beta;
+    int32 i, j;
 
     /* Compute C0 separately (its basis vector is 1) to avoid
      * costly multiplications. */
@@ -1112,15 +1209,10 @@ fe_spec2cep(fe_t * fe, const powspec_t * mflogspec, mfcc_t * mfcep)
     mfcep[0] /= (frame_t) fe->mel_fb->num_filters;
 
     for (i = 1; i < fe->num_cepstra; ++i) {
-        mfcep[i] = 0;
-        for (j = 0; j < fe->mel_fb->num_filters; j++) {
-            if (j == 0)
-                beta = 1;       /* 0.5 */
-            else
-                beta = 2;       /* 1.0 */
-            mfcep[i] += COSMUL(mflogspec[j],
-                               fe->mel_fb->mel_cosine[i][j]) * beta;
-        }
+        /* beta = 0.5 for the first filter and 1.0 for the rest. */
+        mfcep[i] = COSMUL(mflogspec[0], fe->mel_fb->mel_cosine[i][0])
+            + fe_dot(mflogspec + 1, fe->mel_fb->mel_cosine[i] + 1,
+                     fe->mel_fb->num_filters - 1) * 2;
         /* Note that this actually normalizes by num_filters, like the
          * original Sphinx front-end, due to the doubled 'beta' factor
          * above.  */
@@ -1144,11 +1236,9 @@ fe_dct2(fe_t * fe, const powspec_t * mflogspec, mfcc_t * mfcep, int htk)
         mfcep[0] = COSMUL(mfcep[0], fe->mel_fb->sqrt_inv_n);
 
     for (i = 1; i < fe->num_cepstra; ++i) {
-        mfcep[i] = 0;
-        for (j = 0; j < fe->mel_fb->num_filters; j++) {
-            mfcep[i] += COSMUL(mflogspec[j], fe->mel_fb->mel_cosine[i][j]);
-        }
-        mfcep[i] = COSMUL(mfcep[i], fe->mel_fb->sqrt_inv_2n);
+        mfcep[i] = COSMUL(fe_dot(mflogspec, fe->mel_fb->mel_cosine[i],
+                                 fe->mel_fb->num_filters),
+                          fe->mel_fb->sqrt_inv_2n);
     }
 }
 
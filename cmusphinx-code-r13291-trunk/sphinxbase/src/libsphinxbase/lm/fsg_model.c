@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 /* SphinxBase headers. */
 #include "sphinxbase/err.h"
@@ -45,6 +46,8 @@
 #include "sphinxbase/hash_table.h"
 #include "sphinxbase/fsg_model.h"
 #include "sphinxbase/bitvec.h"
+#include "sphinxbase/mmio.h"
+#include "sphinxbase/sbthread.h"
 
 /**
  * Adjacency list (opaque) for a state in an FSG.
@@ -64,8 +67,39 @@ struct trans_list_s {
 struct fsg_arciter_s {
     hash_iter_t *itor, *null_itor;
     gnode_t *gn;
+    fsg_link_t *arc, *end;      /* For compiled FSGs. */
 };
 
+/**
+ * Header of binary FSG file, followed by int32 arc_idx[n_state + 1],
+ * int32 null_idx[n_state], fsg_link_t arcs[n_arc], the silence and
+ * alternate word bit vectors if present, and finally the name and
+ * the vocabulary as NUL-terminated strings.  Everything is in native
+ * byte order.
+ */
+typedef struct fsg_model_bin_header_s {
+    char magic[8];              /* FSG_MODEL_BIN_MAGIC */
+    uint32 byte_order;          /* FSG_MODEL_BIN_BYTE_ORDER */
+    uint32 version;             /* FSG_MODEL_BIN_VERSION */
+    float64 logbase;
+    int32 logshift;
+    float32 lw;
+    int32 n_state;
+    int32 start_state;
+    int32 final_state;
+    int32 n_word;
+    int32 n_arc;
+    uint32 flags;               /* FSG_MODEL_BIN_SIL, FSG_MODEL_BIN_ALT */
+    uint32 strlen;              /* Total size of strings. */
+    uint32 reserved;
+} fsg_model_bin_header_t;
+
+#define FSG_MODEL_BIN_MAGIC "FSGMODEL"
+#define FSG_MODEL_BIN_BYTE_ORDER 0x11223344
+#define FSG_MODEL_BIN_VERSION 1
+#define FSG_MODEL_BIN_SIL 1
+#define FSG_MODEL_BIN_ALT 2
+
 #define FSG_MODEL_BEGIN_DECL		"FSG_BEGIN"
 #define FSG_MODEL_END_DECL		"FSG_END"
 #define FSG_MODEL_N_DECL			"N"
@@ -109,9 +143,14 @@ nextline_str2words(FILE * fp, int32 * lineno,
     }
 }
 
-void
-fsg_model_trans_add(fsg_model_t * fsg,
-                    int32 from, int32 to, int32 logp, int32 wid)
+static void fsg_model_thaw(fsg_model_t * fsg);
+
+/*
+ * Add a transition, assuming that the FSG is not compiled.
+ */
+static void
+fsg_model_trans_add_link(fsg_model_t * fsg,
+                         int32 from, int32 to, int32 logp, int32 wid)
 {
     fsg_link_t *link;
     glist_t gl;
@@ -144,9 +183,12 @@ fsg_model_trans_add(fsg_model_t * fsg,
                             sizeof(link->to_state), gl);
 }
 
-int32
-fsg_model_tag_trans_add(fsg_model_t * fsg, int32 from, int32 to,
-                        int32 logp, int32 wid)
+/*
+ * Add a null or tag transition, assuming that the FSG is not compiled.
+ */
+static int32
+fsg_model_null_trans_add_link(fsg_model_t * fsg, int32 from, int32 to,
+                              int32 logp, int32 wid)
 {
     fsg_link_t *link, *link2;
 
@@ -190,6 +232,65 @@ fsg_model_tag_trans_add(fsg_model_t * fsg, int32 from, int32 to,
     return 1;
 }
 
+/*
+ * Discard the compiled arcs before changing the transitions.
+ */
+static void
+fsg_model_uncompile(fsg_model_t * fsg)
+{
+    fsg_model_thaw(fsg);
+    if (!fsg_model_is_compiled(fsg))
+        return;
+    ckd_free(fsg->arc_idx);
+    ckd_free(fsg->null_idx);
+    if (!fsg->arcs_mapped)
+        fsg->old_arcs = fsg->arcs;
+    fsg->arc_idx = fsg->null_idx = NULL;
+    fsg->arcs = NULL;
+    fsg->arcs_mapped = FALSE;
+    fsg->n_arc = 0;
+}
+
+/*
+ * Rebuild the transition tables of an FSG which was read in compiled
+ * form, so that they can be looked up and changed.
+ */
+static void
+fsg_model_thaw(fsg_model_t * fsg)
+{
+    int32 s;
+
+    if (fsg->trans != NULL)
+        return;
+    fsg->trans = ckd_calloc(fsg->n_state, sizeof(*fsg->trans));
+    for (s = 0; s < fsg->n_state; ++s) {
+        fsg_link_t *l;
+        for (l = fsg_model_arcs_begin(fsg, s);
+             l < fsg_model_null_arcs_begin(fsg, s); ++l)
+            fsg_model_trans_add_link(fsg, l->from_state, l->to_state,
+                                     l->logs2prob, l->wid);
+        for (; l < fsg_model_arcs_end(fsg, s); ++l)
+            fsg_model_null_trans_add_link(fsg, l->from_state, l->to_state,
+                                          l->logs2prob, l->wid);
+    }
+}
+
+void
+fsg_model_trans_add(fsg_model_t * fsg,
+                    int32 from, int32 to, int32 logp, int32 wid)
+{
+    fsg_model_uncompile(fsg);
+    fsg_model_trans_add_link(fsg, from, to, logp, wid);
+}
+
+int32
+fsg_model_tag_trans_add(fsg_model_t * fsg, int32 from, int32 to,
+                        int32 logp, int32 wid)
+{
+    fsg_model_uncompile(fsg);
+    return fsg_model_null_trans_add_link(fsg, from, to, logp, wid);
+}
+
 int32
 fsg_model_null_trans_add(fsg_model_t * fsg, int32 from, int32 to,
                          int32 logp)
@@ -197,6 +298,64 @@ fsg_model_null_trans_add(fsg_model_t * fsg, int32 from, int32 to,
     return fsg_model_tag_trans_add(fsg, from, to, logp, -1);
 }
 
+int
+fsg_model_compile(fsg_model_t * fsg)
+{
+    int32 s, n;
+
+    if (fsg_model_is_compiled(fsg))
+        return 0;
+
+    /* Links into the previous arcs have had a chance to move on. */
+    ckd_free(fsg->old_arcs);
+    fsg->old_arcs = NULL;
+    ++fsg->n_compile;
+
+    /* Count the arcs first. */
+    n = 0;
+    for (s = 0; s < fsg->n_state; ++s) {
+        hash_iter_t *itor;
+        if (fsg->trans[s].trans) {
+            for (itor = hash_table_iter(fsg->trans[s].trans);
+                 itor; itor = hash_table_iter_next(itor))
+                n += glist_count((glist_t) hash_entry_val(itor->ent));
+        }
+        if (fsg->trans[s].null_trans)
+            n += hash_table_inuse(fsg->trans[s].null_trans);
+    }
+
+    /* Now copy them in the same order as fsg_arciter_next(). */
+    fsg->n_arc = n;
+    fsg->arcs = ckd_calloc(n + 1, sizeof(*fsg->arcs));
+    fsg->arc_idx = ckd_calloc(fsg->n_state + 1, sizeof(*fsg->arc_idx));
+    fsg->null_idx = ckd_calloc(fsg->n_state, sizeof(*fsg->null_idx));
+    n = 0;
+    for (s = 0; s < fsg->n_state; ++s) {
+        hash_iter_t *itor;
+        gnode_t *gn;
+
+        fsg->arc_idx[s] = n;
+        if (fsg->trans[s].trans) {
+            for (itor = hash_table_iter(fsg->trans[s].trans);
+                 itor; itor = hash_table_iter_next(itor))
+                for (gn = hash_entry_val(itor->ent); gn; gn = gnode_next(gn))
+                    fsg->arcs[n++] = *(fsg_link_t *) gnode_ptr(gn);
+        }
+        fsg->null_idx[s] = n;
+        if (fsg->trans[s].null_trans) {
+            for (itor = hash_table_iter(fsg->trans[s].null_trans);
+                 itor; itor = hash_table_iter_next(itor))
+                fsg->arcs[n++] = *(fsg_link_t *) hash_entry_val(itor->ent);
+        }
+    }
+    fsg->arc_idx[s] = n;
+    assert(n == fsg->n_arc);
+    fsg->arcs_mapped = FALSE;
+
+    E_INFO("Compiled FSG: %d states, %d arcs\n", fsg->n_state, fsg->n_arc);
+    return 0;
+}
+
 glist_t
 fsg_model_null_trans_closure(fsg_model_t * fsg, glist_t nulls)
 {
@@ -206,6 +365,7 @@ fsg_model_null_trans_closure(fsg_model_t * fsg, glist_t nulls)
     int32 k, n;
 
     E_INFO("Computing transitive closure for null transitions\n");
+    fsg_model_uncompile(fsg);
 
     /* If our caller didn't give us a list of null-transitions,
        make such a list. Just loop through all the FSG states, 
@@ -277,6 +437,7 @@ fsg_model_trans(fsg_model_t * fsg, int32 i, int32 j)
 {
     void *val;
 
+    fsg_model_thaw(fsg);
     if (fsg->trans[i].trans == NULL)
         return NULL;
     if (hash_table_lookup_bkey(fsg->trans[i].trans, (char const *) &j,
@@ -290,6 +451,7 @@ fsg_model_null_trans(fsg_model_t * fsg, int32 i, int32 j)
 {
     void *val;
 
+    fsg_model_thaw(fsg);
     if (fsg->trans[i].null_trans == NULL)
         return NULL;
     if (hash_table_lookup_bkey(fsg->trans[i].null_trans, (char const *) &j,
@@ -303,6 +465,14 @@ fsg_model_arcs(fsg_model_t * fsg, int32 i)
 {
     fsg_arciter_t *itor;
 
+    if (fsg_model_is_compiled(fsg)) {
+        if (fsg->arc_idx[i] == fsg->arc_idx[i + 1])
+            return NULL;
+        itor = ckd_calloc(1, sizeof(*itor));
+        itor->arc = fsg_model_arcs_begin(fsg, i);
+        itor->end = fsg_model_arcs_end(fsg, i);
+        return itor;
+    }
     if (fsg->trans[i].trans == NULL && fsg->trans[i].null_trans == NULL)
         return NULL;
     itor = ckd_calloc(1, sizeof(*itor));
@@ -318,6 +488,8 @@ fsg_model_arcs(fsg_model_t * fsg, int32 i)
 fsg_link_t *
 fsg_arciter_get(fsg_arciter_t * itor)
 {
+    if (itor->end)
+        return itor->arc;
     /* Iterate over non-null arcs first. */
     if (itor->gn)
         return (fsg_link_t *) gnode_ptr(itor->gn);
@@ -330,6 +502,11 @@ fsg_arciter_get(fsg_arciter_t * itor)
 fsg_arciter_t *
 fsg_arciter_next(fsg_arciter_t * itor)
 {
+    if (itor->end) {
+        if (++itor->arc == itor->end)
+            goto stop_iteration;
+        return itor;
+    }
     /* Iterate over non-null arcs first. */
     if (itor->gn) {
         itor->gn = gnode_next(itor->gn);
@@ -451,6 +628,8 @@ fsg_model_add_alt(fsg_model_t * fsg, char const *baseword,
     int i, basewid, altwid;
     int ntrans;
 
+    fsg_model_uncompile(fsg);
+
     /* FIXME: This will get slow, eventually... */
     for (basewid = 0; basewid < fsg->n_word; ++basewid)
         if (0 == strcmp(fsg->vocab[basewid], baseword))
@@ -740,20 +919,230 @@ fsg_model_readfile(const char *file, logmath_t * lmath, float32 lw)
 {
     FILE *fp;
     fsg_model_t *fsg;
+    char magic[sizeof(FSG_MODEL_BIN_MAGIC) - 1];
 
-    if ((fp = fopen(file, "r")) == NULL) {
+    if ((fp = fopen(file, "rb")) == NULL) {
         E_ERROR_SYSTEM("Failed to open FSG file '%s' for reading", file);
         return NULL;
     }
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+        && 0 == memcmp(magic, FSG_MODEL_BIN_MAGIC, sizeof(magic))) {
+        fclose(fp);
+        return fsg_model_read_bin(file, lmath, lw);
+    }
+    rewind(fp);
     fsg = fsg_model_read(fp, lmath, lw);
     fclose(fp);
     return fsg;
 }
 
+fsg_model_t *
+fsg_model_read_bin(const char *file, logmath_t * lmath, float32 lw)
+{
+    fsg_model_bin_header_t hdr;
+    fsg_model_t *fsg;
+    FILE *fp;
+    char *strs, *c;
+    size_t arcs_pos;
+    float64 scale;
+    int32 i, bvsize;
+
+    if ((fp = fopen(file, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open FSG file '%s' for reading", file);
+        return NULL;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+        || 0 != memcmp(hdr.magic, FSG_MODEL_BIN_MAGIC, sizeof(hdr.magic))) {
+        E_ERROR("%s is not a binary FSG file\n", file);
+        goto error_out;
+    }
+    if (hdr.byte_order != FSG_MODEL_BIN_BYTE_ORDER
+        || hdr.version != FSG_MODEL_BIN_VERSION) {
+        E_ERROR("%s was written on a different platform or version\n", file);
+        goto error_out;
+    }
+    if (hdr.n_state <= 0 || hdr.n_arc < 0 || hdr.n_word < 0
+        || hdr.start_state < 0 || hdr.start_state >= hdr.n_state
+        || hdr.final_state < 0 || hdr.final_state >= hdr.n_state
+        || hdr.logbase <= 1.0 || hdr.lw <= 0
+        || hdr.logshift < 0 || hdr.logshift > 30) {
+        E_ERROR("%s has an invalid header\n", file);
+        goto error_out;
+    }
+    /* Factor to convert stored scores to this log base and weight. */
+    scale = (log(hdr.logbase) * (1 << hdr.logshift) / hdr.lw)
+        / (log(logmath_get_base(lmath)) * (1 << logmath_get_shift(lmath)) / lw);
+
+    fsg = fsg_model_init(NULL, lmath, lw, hdr.n_state);
+    fsg->start_state = hdr.start_state;
+    fsg->final_state = hdr.final_state;
+    /* Transition tables are only built if they are needed. */
+    ckd_free(fsg->trans);
+    fsg->trans = NULL;
+
+    fsg->arc_idx = ckd_calloc(hdr.n_state + 1, sizeof(*fsg->arc_idx));
+    fsg->null_idx = ckd_calloc(hdr.n_state, sizeof(*fsg->null_idx));
+    if (fread(fsg->arc_idx, sizeof(*fsg->arc_idx), hdr.n_state + 1, fp)
+        != (size_t)hdr.n_state + 1
+        || fread(fsg->null_idx, sizeof(*fsg->null_idx), hdr.n_state, fp)
+        != (size_t)hdr.n_state)
+        goto error_fsg;
+    for (i = 0; i < hdr.n_state; ++i) {
+        if (fsg->arc_idx[i] > fsg->null_idx[i]
+            || fsg->null_idx[i] > fsg->arc_idx[i + 1])
+            goto error_fsg;
+    }
+    if (fsg->arc_idx[0] != 0 || fsg->arc_idx[hdr.n_state] != hdr.n_arc)
+        goto error_fsg;
+
+    /* Map the arcs in place if they need no rescaling. */
+    fsg->n_arc = hdr.n_arc;
+    arcs_pos = ftell(fp);
+    if (fabs(scale - 1.0) < 1e-6 && hdr.n_arc > 0
+        && (fsg->filemap = mmio_file_read(file)) != NULL) {
+        fsg->arcs = (fsg_link_t *)
+            ((char *)mmio_file_ptr(fsg->filemap) + arcs_pos);
+        fsg->arcs_mapped = TRUE;
+        fseek(fp, hdr.n_arc * sizeof(*fsg->arcs), SEEK_CUR);
+    }
+    else {
+        fsg->arcs = ckd_calloc(hdr.n_arc + 1, sizeof(*fsg->arcs));
+        if (fread(fsg->arcs, sizeof(*fsg->arcs), hdr.n_arc, fp)
+            != (size_t)hdr.n_arc)
+            goto error_fsg;
+        if (fabs(scale - 1.0) >= 1e-6) {
+            E_INFO("Rescaling transition scores by %f (lw %f, base %f)\n",
+                   scale, hdr.lw, hdr.logbase);
+            for (i = 0; i < hdr.n_arc; ++i)
+                fsg->arcs[i].logs2prob =
+                    (int32) (fsg->arcs[i].logs2prob * scale);
+        }
+    }
+    /* Arcs must stay within this FSG's states and vocabulary, and only
+     * null arcs may lack a word. */
+    for (i = 0; i < hdr.n_state; ++i) {
+        int32 j;
+        for (j = fsg->arc_idx[i]; j < fsg->arc_idx[i + 1]; ++j) {
+            fsg_link_t const *l = fsg->arcs + j;
+            if (l->from_state != i
+                || l->to_state < 0 || l->to_state >= hdr.n_state
+                || l->wid < (j < fsg->null_idx[i] ? 0 : -1)
+                || l->wid >= hdr.n_word) {
+                E_ERROR("Arc %d from state %d in %s is out of range\n",
+                        j, i, file);
+                goto error_fsg;
+            }
+        }
+    }
+
+    fsg->n_word_alloc = hdr.n_word + 10;
+    bvsize = bitvec_size(hdr.n_word);
+    if (hdr.flags & FSG_MODEL_BIN_SIL) {
+        fsg->silwords = bitvec_alloc(fsg->n_word_alloc);
+        if (fread(fsg->silwords, sizeof(*fsg->silwords), bvsize, fp)
+            != (size_t)bvsize)
+            goto error_fsg;
+    }
+    if (hdr.flags & FSG_MODEL_BIN_ALT) {
+        fsg->altwords = bitvec_alloc(fsg->n_word_alloc);
+        if (fread(fsg->altwords, sizeof(*fsg->altwords), bvsize, fp)
+            != (size_t)bvsize)
+            goto error_fsg;
+    }
+
+    fsg->vocab = ckd_calloc(fsg->n_word_alloc, sizeof(*fsg->vocab));
+    strs = ckd_calloc(hdr.strlen + 1, 1);
+    if (fread(strs, 1, hdr.strlen, fp) != hdr.strlen) {
+        ckd_free(strs);
+        goto error_fsg;
+    }
+    c = strs;
+    fsg->name = ckd_salloc(c);
+    while (fsg->n_word < hdr.n_word) {
+        c += strlen(c) + 1;
+        if (c >= strs + hdr.strlen) {
+            ckd_free(strs);
+            goto error_fsg;
+        }
+        fsg->vocab[fsg->n_word++] = ckd_salloc(c);
+    }
+    ckd_free(strs);
+    fclose(fp);
+
+    E_INFO("FSG: %d states, %d unique words, %d arcs%s\n",
+           fsg->n_state, fsg->n_word, fsg->n_arc,
+           fsg->arcs_mapped ? " (memory-mapped)" : "");
+    return fsg;
+
+  error_fsg:
+    E_ERROR("%s is truncated or corrupt\n", file);
+    fsg_model_free(fsg);
+  error_out:
+    fclose(fp);
+    return NULL;
+}
+
+int
+fsg_model_write_bin(fsg_model_t * fsg, const char *file)
+{
+    fsg_model_bin_header_t hdr;
+    FILE *fp;
+    int32 i, bvsize;
+
+    if (fsg_model_compile(fsg) < 0)
+        return -1;
+
+    E_INFO("Writing binary FSG file '%s'\n", file);
+    if ((fp = fopen(file, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open FSG file '%s' for writing", file);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FSG_MODEL_BIN_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = FSG_MODEL_BIN_BYTE_ORDER;
+    hdr.version = FSG_MODEL_BIN_VERSION;
+    hdr.logbase = logmath_get_base(fsg->lmath);
+    hdr.logshift = logmath_get_shift(fsg->lmath);
+    hdr.lw = fsg->lw;
+    hdr.n_state = fsg->n_state;
+    hdr.start_state = fsg->start_state;
+    hdr.final_state = fsg->final_state;
+    hdr.n_word = fsg->n_word;
+    hdr.n_arc = fsg->n_arc;
+    if (fsg->silwords)
+        hdr.flags |= FSG_MODEL_BIN_SIL;
+    if (fsg->altwords)
+        hdr.flags |= FSG_MODEL_BIN_ALT;
+    hdr.strlen = (fsg->name ? strlen(fsg->name) : 0) + 1;
+    for (i = 0; i < fsg->n_word; ++i)
+        hdr.strlen += strlen(fsg->vocab[i]) + 1;
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(fsg->arc_idx, sizeof(*fsg->arc_idx), fsg->n_state + 1, fp);
+    fwrite(fsg->null_idx, sizeof(*fsg->null_idx), fsg->n_state, fp);
+    fwrite(fsg->arcs, sizeof(*fsg->arcs), fsg->n_arc, fp);
+    bvsize = bitvec_size(fsg->n_word);
+    if (fsg->silwords)
+        fwrite(fsg->silwords, sizeof(*fsg->silwords), bvsize, fp);
+    if (fsg->altwords)
+        fwrite(fsg->altwords, sizeof(*fsg->altwords), bvsize, fp);
+    fwrite(fsg->name ? fsg->name : "", 1,
+           (fsg->name ? strlen(fsg->name) : 0) + 1, fp);
+    for (i = 0; i < fsg->n_word; ++i)
+        fwrite(fsg->vocab[i], 1, strlen(fsg->vocab[i]) + 1, fp);
+
+    if (fclose(fp) != 0) {
+        E_ERROR_SYSTEM("Failed to write FSG file '%s'", file);
+        return -1;
+    }
+    return 0;
+}
+
 fsg_model_t *
 fsg_model_retain(fsg_model_t * fsg)
 {
-    ++fsg->refcount;
+    sbatomic_add(&fsg->refcount, 1);
     return fsg;
 }
 
@@ -779,19 +1168,28 @@ trans_list_free(fsg_model_t * fsg, int32 i)
 int
 fsg_model_free(fsg_model_t * fsg)
 {
-    int i;
+    int i, refcount;
 
     if (fsg == NULL)
         return 0;
 
-    if (--fsg->refcount > 0)
-        return fsg->refcount;
+    if ((refcount = sbatomic_add(&fsg->refcount, -1)) > 0)
+        return refcount;
 
     for (i = 0; i < fsg->n_word; ++i)
         ckd_free(fsg->vocab[i]);
-    for (i = 0; i < fsg->n_state; ++i)
-        trans_list_free(fsg, i);
+    if (fsg->trans) {
+        for (i = 0; i < fsg->n_state; ++i)
+            trans_list_free(fsg, i);
+    }
     ckd_free(fsg->trans);
+    ckd_free(fsg->arc_idx);
+    ckd_free(fsg->null_idx);
+    if (!fsg->arcs_mapped)
+        ckd_free(fsg->arcs);
+    ckd_free(fsg->old_arcs);
+    if (fsg->filemap)
+        mmio_file_unmap(fsg->filemap);
     ckd_free(fsg->vocab);
     listelem_alloc_free(fsg->link_alloc);
     bitvec_free(fsg->silwords);
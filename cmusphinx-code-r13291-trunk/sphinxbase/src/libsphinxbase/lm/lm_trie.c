@@ -48,6 +48,10 @@
 #include "lm_trie_quant.h"
 
 static void lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order);
+static size_t lm_trie_ngram_size(lm_trie_t * trie, uint32 * counts, int order);
+static void lm_trie_init_ngram(lm_trie_t * trie, uint32 * counts, int order);
+
+#define LM_TRIE_PAD(pos) ((LM_TRIE_ALIGN - (pos) % LM_TRIE_ALIGN) % LM_TRIE_ALIGN)
 
 static uint32
 base_size(uint32 entries, uint32 max_vocab, uint8 remaining_bits)
@@ -387,6 +391,68 @@ lm_trie_read_bin(uint32 * counts, int order, FILE * fp)
     return trie;
 }
 
+lm_trie_t *
+lm_trie_read_bin_aligned(uint32 * counts, int order, FILE * fp,
+                         size_t * pos)
+{
+    lm_trie_t *trie = lm_trie_init(counts[0]);
+
+    lm_trie_read_pad(fp, pos);
+    if (order > 1) {
+        trie->quant = lm_trie_quant_read_tables(fp, order);
+        *pos += lm_trie_quant_size(order);
+    }
+    fread(trie->unigrams, sizeof(*trie->unigrams), (counts[0] + 1), fp);
+    *pos += sizeof(*trie->unigrams) * (counts[0] + 1);
+    if (order > 1) {
+        lm_trie_read_pad(fp, pos);
+        lm_trie_alloc_ngram(trie, counts, order);
+        fread(trie->ngram_mem, 1, trie->ngram_mem_size, fp);
+        *pos += trie->ngram_mem_size;
+    }
+    return trie;
+}
+
+lm_trie_t *
+lm_trie_map_bin(uint32 * counts, int order, mmio_file_t * filemap,
+                size_t size, size_t * pos)
+{
+    lm_trie_t *trie;
+    uint8 *mem = (uint8 *) mmio_file_ptr(filemap);
+    size_t unigram_size = sizeof(*trie->unigrams) * (counts[0] + 1);
+    size_t ngram_size;
+
+    *pos += LM_TRIE_PAD(*pos);
+    if (order > 1 && *pos + lm_trie_quant_size(order) > size)
+        return NULL;
+    trie = lm_trie_init(counts[0]);
+    if (order > 1) {
+        trie->quant = lm_trie_quant_map(mem + *pos, order);
+        *pos += lm_trie_quant_size(order);
+    }
+    if (*pos + unigram_size > size) {
+        lm_trie_free(trie);
+        return NULL;
+    }
+    /* Unigrams are small, and change when words are added. */
+    memcpy(trie->unigrams, mem + *pos, unigram_size);
+    *pos += unigram_size;
+    if (order > 1) {
+        *pos += LM_TRIE_PAD(*pos);
+        ngram_size = lm_trie_ngram_size(trie, counts, order);
+        if (*pos + ngram_size > size) {
+            lm_trie_free(trie);
+            return NULL;
+        }
+        trie->ngram_mem = mem + *pos;
+        trie->ngram_mem_size = ngram_size;
+        lm_trie_init_ngram(trie, counts, order);
+        *pos += ngram_size;
+    }
+    trie->filemap = filemap;
+    return trie;
+}
+
 void
 lm_trie_write_bin(lm_trie_t * trie, uint32 unigram_count, FILE * fp)
 {
@@ -399,39 +465,113 @@ lm_trie_write_bin(lm_trie_t * trie, uint32 unigram_count, FILE * fp)
         fwrite(trie->ngram_mem, 1, trie->ngram_mem_size, fp);
 }
 
+void
+lm_trie_write_bin_aligned(lm_trie_t * trie, uint32 unigram_count,
+                          FILE * fp, size_t * pos)
+{
+    lm_trie_write_pad(fp, pos);
+    if (trie->quant)
+        *pos += lm_trie_quant_write_tables(trie->quant, fp);
+    fwrite(trie->unigrams, sizeof(*trie->unigrams), (unigram_count + 1),
+           fp);
+    *pos += sizeof(*trie->unigrams) * (unigram_count + 1);
+    if (trie->ngram_mem) {
+        lm_trie_write_pad(fp, pos);
+        fwrite(trie->ngram_mem, 1, trie->ngram_mem_size, fp);
+        *pos += trie->ngram_mem_size;
+    }
+}
+
+void
+lm_trie_read_pad(FILE * fp, size_t * pos)
+{
+    uint8 pad[LM_TRIE_ALIGN];
+    size_t n = LM_TRIE_PAD(*pos);
+
+    fread(pad, 1, n, fp);
+    *pos += n;
+}
+
+void
+lm_trie_write_pad(FILE * fp, size_t * pos)
+{
+    static const uint8 pad[LM_TRIE_ALIGN];
+    size_t n = LM_TRIE_PAD(*pos);
+
+    fwrite(pad, 1, n, fp);
+    *pos += n;
+}
+
+lm_trie_t *
+lm_trie_copy(lm_trie_t * other)
+{
+    lm_trie_t *trie;
+
+    trie = (lm_trie_t *) ckd_malloc(sizeof(*trie));
+    memcpy(trie, other, sizeof(*trie));
+    trie->is_copy = TRUE;
+    memset(trie->hist_cache, -1, sizeof(trie->hist_cache));
+    memset(trie->backoff_cache, 0, sizeof(trie->backoff_cache));
+    return trie;
+}
+
 void
 lm_trie_free(lm_trie_t * trie)
 {
+    if (trie->is_copy) {
+        ckd_free(trie);
+        return;
+    }
     if (trie->ngram_mem) {
-        ckd_free(trie->ngram_mem);
+        if (trie->filemap == NULL)
+            ckd_free(trie->ngram_mem);
         ckd_free(trie->middle_begin);
         ckd_free(trie->longest);
     }
     if (trie->quant)
         lm_trie_quant_free(trie->quant);
+    if (trie->filemap)
+        mmio_file_unmap(trie->filemap);
     ckd_free(trie->unigrams);
     ckd_free(trie);
 }
 
-static void
-lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
+static size_t
+lm_trie_ngram_size(lm_trie_t * trie, uint32 * counts, int order)
 {
+    size_t size;
     int i;
-    uint8 *mem_ptr;
-    uint8 **middle_starts;
 
-    trie->ngram_mem_size = 0;
+    size = 0;
     for (i = 1; i < order - 1; i++) {
-        trie->ngram_mem_size +=
+        size +=
             middle_size(lm_trie_quant_msize(trie->quant), counts[i],
                         counts[0], counts[i + 1]);
     }
-    trie->ngram_mem_size +=
+    size +=
         longest_size(lm_trie_quant_lsize(trie->quant), counts[order - 1],
                      counts[0]);
+    return size;
+}
+
+static void
+lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
+{
+    trie->ngram_mem_size = lm_trie_ngram_size(trie, counts, order);
     trie->ngram_mem =
         (uint8 *) ckd_calloc(trie->ngram_mem_size,
                              sizeof(*trie->ngram_mem));
+    lm_trie_init_ngram(trie, counts, order);
+}
+
+/* Set up middle and longest n-grams in trie->ngram_mem. */
+static void
+lm_trie_init_ngram(lm_trie_t * trie, uint32 * counts, int order)
+{
+    int i;
+    uint8 *mem_ptr;
+    uint8 **middle_starts;
+
     mem_ptr = trie->ngram_mem;
     trie->middle_begin =
         (middle_t *) ckd_calloc(order - 2, sizeof(*trie->middle_begin));
@@ -461,6 +601,7 @@ lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
                  counts[0]);
 }
 
+
 void
 lm_trie_build(lm_trie_t * trie, ngram_raw_t ** raw_ngrams, uint32 * counts, uint32 *out_counts,
               int order)
@@ -694,7 +835,7 @@ lm_trie_nobo_score(lm_trie_t * trie, int32 wid, int32 * hist,
 
 static float
 lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
-                   int32 * n_used)
+                   float *backoff, int32 * n_used)
 {
     float prob;
     int i, j;
@@ -709,7 +850,7 @@ lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
         address = middle_find(&trie->middle_begin[i], hist[i], &node);
         if (address.base == NULL) {
             for (j = i; j < n_hist; j++) {
-                prob += trie->backoff_cache[j];
+                prob += backoff[j];
             }
             return prob;
         }
@@ -720,7 +861,7 @@ lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
     }
     address = longest_find(trie->longest, hist[n_hist - 1], &node);
     if (address.base == NULL) {
-        return prob + trie->backoff_cache[n_hist - 1];
+        return prob + backoff[n_hist - 1];
     }
     else {
         (*n_used)++;
@@ -741,39 +882,48 @@ history_matches(int32 * hist, int32 * prev_hist, int32 n_hist)
 }
 
 static void
-update_backoff(lm_trie_t * trie, int32 * hist, int32 n_hist)
+update_backoff(lm_trie_t * trie, int32 * hist, int32 n_hist,
+               float *backoff)
 {
     int i;
     node_range_t node;
     bitarr_address_t address;
 
-    memset(trie->backoff_cache, 0, sizeof(trie->backoff_cache));
-    trie->backoff_cache[0] = unigram_find(trie->unigrams, hist[0], &node)->bo;
+    memset(backoff, 0, NGRAM_MAX_ORDER * sizeof(*backoff));
+    backoff[0] = unigram_find(trie->unigrams, hist[0], &node)->bo;
     for (i = 1; i < n_hist; i++) {
         address = middle_find(&trie->middle_begin[i - 1], hist[i], &node);
         if (address.base == NULL) {
             break;
         }
-        trie->backoff_cache[i] =
-            lm_trie_quant_mboread(trie->quant, address, i - 1);
+        backoff[i] = lm_trie_quant_mboread(trie->quant, address, i - 1);
     }
-    memcpy(trie->hist_cache, hist, n_hist * sizeof(*hist));
 }
 
 float
 lm_trie_score(lm_trie_t * trie, int order, int32 wid, int32 * hist,
               int32 n_hist, int32 * n_used)
 {
+    uint32 h;
+    int i;
+
     if (n_hist < order - 1) {
         return lm_trie_nobo_score(trie, wid, hist, order, n_hist, n_used);
     }
-    else {
-        assert(n_hist == order - 1);
-        if (!history_matches(hist, (int32 *) trie->hist_cache, n_hist)) {
-            update_backoff(trie, hist, n_hist);
-        }
-        return lm_trie_hist_score(trie, wid, hist, n_hist, n_used);
-    }
+    assert(n_hist == order - 1);
+    /* Word exits in the search score many words against the same few
+     * histories, so keep the backoff weights of recent ones.  The
+     * trie is stored word-first, so the nodes reached for the history
+     * depend on the word and only the backoffs can be reused. */
+    for (h = 0, i = 0; i < n_hist; i++)
+        h = h * 31 + (uint32) hist[i];
+    h = (h * 2654435761U) >> (32 - LM_TRIE_HIST_CACHE_BITS);
+    if (!history_matches(hist, trie->hist_cache[h], n_hist)) {
+        update_backoff(trie, hist, n_hist, trie->backoff_cache[h]);
+        memcpy(trie->hist_cache[h], hist, n_hist * sizeof(*hist));
+    }
+    return lm_trie_hist_score(trie, wid, hist, n_hist,
+                              trie->backoff_cache[h], n_used);
 }
 
 void
@@ -40,10 +40,17 @@
 
 #include <sphinxbase/pio.h>
 #include <sphinxbase/bitarr.h>
+#include <sphinxbase/mmio.h>
 
 #include "ngram_model_internal.h"
 #include "lm_trie_quant.h"
 
+/**
+ * Alignment of the sections of the binary trie, relative to the start
+ * of the file, so they can be used in place from a memory map.
+ */
+#define LM_TRIE_ALIGN 8
+
 typedef struct unigram_s {
     float prob;
     float bo;
@@ -76,6 +83,13 @@ typedef struct longest_s {
     uint8 quant_bits;
 } longest_t;
 
+/**
+ * Number of recent histories whose backoff weights are kept, as a
+ * power of two.
+ */
+#define LM_TRIE_HIST_CACHE_BITS 6
+#define LM_TRIE_HIST_CACHE_SIZE (1 << LM_TRIE_HIST_CACHE_BITS)
+
 typedef struct lm_trie_s {
     uint8 *ngram_mem;
     size_t ngram_mem_size;
@@ -84,9 +98,14 @@ typedef struct lm_trie_s {
     middle_t *middle_end;
     longest_t *longest;
     lm_trie_quant_t *quant;
+    mmio_file_t *filemap;       /**< Mapping holding ngram_mem and quant tables (if any) */
 
-    float backoff_cache[NGRAM_MAX_ORDER];
-    uint32 hist_cache[NGRAM_MAX_ORDER - 1];
+    /** Backoff weights of recently resolved histories, indexed by a
+     * hash of the history in hist_cache. */
+    float backoff_cache[LM_TRIE_HIST_CACHE_SIZE][NGRAM_MAX_ORDER];
+    int32 hist_cache[LM_TRIE_HIST_CACHE_SIZE][NGRAM_MAX_ORDER - 1];
+
+    uint8 is_copy;              /**< Tables belong to another lm_trie_t */
 } lm_trie_t;
 
 /**
@@ -94,12 +113,62 @@ typedef struct lm_trie_s {
  */
 lm_trie_t *lm_trie_create(uint32 unigram_count, int order);
 
+/**
+ * Reads trie from binary file in the original (unaligned) format
+ */
 lm_trie_t *lm_trie_read_bin(uint32 * counts, int order, FILE * fp);
 
+/**
+ * Reads trie from binary file written by lm_trie_write_bin_aligned().
+ * @param pos current offset in the file, updated on return.
+ */
+lm_trie_t *lm_trie_read_bin_aligned(uint32 * counts, int order, FILE * fp,
+                                    size_t * pos);
+
+/**
+ * Uses trie from memory-mapped binary file written by
+ * lm_trie_write_bin_aligned() in place.  Only the unigrams are copied, so
+ * that words can be added.  On success the trie takes ownership of
+ * filemap.
+ * @param size size of the file in bytes.
+ * @param pos current offset in the file, updated on return.
+ * @return trie, or NULL if the file is truncated.
+ */
+lm_trie_t *lm_trie_map_bin(uint32 * counts, int order, mmio_file_t * filemap,
+                           size_t size, size_t * pos);
+
+/**
+ * Writes trie to binary file in the original (unaligned) format
+ */
 void lm_trie_write_bin(lm_trie_t * trie, uint32 unigram_count, FILE * fp);
 
+/**
+ * Writes trie to binary file, with each section aligned to LM_TRIE_ALIGN.
+ * @param pos current offset in the file, updated on return.
+ */
+void lm_trie_write_bin_aligned(lm_trie_t * trie, uint32 unigram_count,
+                               FILE * fp, size_t * pos);
+
+/**
+ * Skips padding up to the next multiple of LM_TRIE_ALIGN
+ */
+void lm_trie_read_pad(FILE * fp, size_t * pos);
+
+/**
+ * Writes padding up to the next multiple of LM_TRIE_ALIGN
+ */
+void lm_trie_write_pad(FILE * fp, size_t * pos);
+
 void lm_trie_free(lm_trie_t * trie);
 
+/**
+ * Creates a trie sharing the tables of another one, but with its own
+ * caches, so that both can be queried from different threads.  The
+ * original must outlive the copy and must not be modified while it
+ * exists.
+ */
+lm_trie_t *lm_trie_copy(lm_trie_t * other);
+
 void lm_trie_build(lm_trie_t * trie, ngram_raw_t ** raw_ngrams,
                    uint32 * counts, uint32 *out_counts, int order);
 
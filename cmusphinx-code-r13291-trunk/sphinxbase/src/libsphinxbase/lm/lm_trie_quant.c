@@ -56,6 +56,7 @@ struct lm_trie_quant_s {
     bins_t *longest;
     uint8 *mem;
     size_t mem_size;
+    uint8 mem_mapped;  /**< mem is not ours (e.g. in a memory-mapped file) */
     uint8 prob_bits;
     uint8 bo_bits;
     uint32 prob_mask;
@@ -108,8 +109,8 @@ bins_decode(bins_t * bins, size_t off)
     return bins->begin[off];
 }
 
-static size_t
-quant_size(int order)
+size_t
+lm_trie_quant_size(int order)
 {
     int prob_bits = 16;
     int bo_bits = 16;
@@ -119,17 +120,13 @@ quant_size(int order)
     return (order - 2) * middle_table + longest_table;
 }
 
-lm_trie_quant_t *
-lm_trie_quant_create(int order)
+static void
+lm_trie_quant_init(lm_trie_quant_t * quant, int order)
 {
     float *start;
     int i;
-    lm_trie_quant_t *quant =
-        (lm_trie_quant_t *) ckd_calloc(1, sizeof(*quant));
-    quant->mem_size = quant_size(order);
-    quant->mem =
-        (uint8 *) ckd_calloc(quant->mem_size, sizeof(*quant->mem));
 
+    quant->mem_size = lm_trie_quant_size(order);
     quant->prob_bits = 16;
     quant->bo_bits = 16;
     quant->prob_mask = (1U << quant->prob_bits) - 1;
@@ -144,17 +141,45 @@ lm_trie_quant_create(int order)
     }
     bins_create(&quant->tables[order - 2][0], quant->prob_bits, start);
     quant->longest = &quant->tables[order - 2][0];
+}
+
+lm_trie_quant_t *
+lm_trie_quant_create(int order)
+{
+    lm_trie_quant_t *quant =
+        (lm_trie_quant_t *) ckd_calloc(1, sizeof(*quant));
+    quant->mem =
+        (uint8 *) ckd_calloc(lm_trie_quant_size(order), sizeof(*quant->mem));
+    lm_trie_quant_init(quant, order);
     return quant;
 }
 
+lm_trie_quant_t *
+lm_trie_quant_map(uint8 * mem, int order)
+{
+    lm_trie_quant_t *quant =
+        (lm_trie_quant_t *) ckd_calloc(1, sizeof(*quant));
+    quant->mem = mem;
+    quant->mem_mapped = TRUE;
+    lm_trie_quant_init(quant, order);
+    return quant;
+}
 
 lm_trie_quant_t *
 lm_trie_quant_read_bin(FILE * fp, int order)
 {
     int dummy;
-    lm_trie_quant_t *quant;
 
+    /* Before it was quantization type */
     fread(&dummy, sizeof(dummy), 1, fp);
+    return lm_trie_quant_read_tables(fp, order);
+}
+
+lm_trie_quant_t *
+lm_trie_quant_read_tables(FILE * fp, int order)
+{
+    lm_trie_quant_t *quant;
+
     quant = lm_trie_quant_create(order);
     fread(quant->mem, sizeof(*quant->mem), quant->mem_size, fp);
 
@@ -167,13 +192,20 @@ lm_trie_quant_write_bin(lm_trie_quant_t * quant, FILE * fp)
     /* Before it was quantization type */
     int dummy = 1;
     fwrite(&dummy, sizeof(dummy), 1, fp);
+    lm_trie_quant_write_tables(quant, fp);
+}
+
+size_t
+lm_trie_quant_write_tables(lm_trie_quant_t * quant, FILE * fp)
+{
     fwrite(quant->mem, sizeof(*quant->mem), quant->mem_size, fp);
+    return quant->mem_size;
 }
 
 void
 lm_trie_quant_free(lm_trie_quant_t * quant)
 {
-    if (quant->mem)
+    if (quant->mem && !quant->mem_mapped)
         ckd_free(quant->mem);
     ckd_free(quant);
 }
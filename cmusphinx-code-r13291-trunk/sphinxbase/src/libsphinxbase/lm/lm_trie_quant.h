@@ -49,15 +49,37 @@ typedef struct lm_trie_quant_s lm_trie_quant_t;
 lm_trie_quant_t *lm_trie_quant_create(int order);
 
 /**
- * Write quant data to binary file
+ * Size in bytes of the quantization tables for the given order
+ */
+size_t lm_trie_quant_size(int order);
+
+/**
+ * Read quant data from binary file in the original (unaligned) format
  */
 lm_trie_quant_t *lm_trie_quant_read_bin(FILE * fp, int order);
 
 /**
- * Write quant data to binary file
+ * Read quantization tables from binary file
+ */
+lm_trie_quant_t *lm_trie_quant_read_tables(FILE * fp, int order);
+
+/**
+ * Use quantization tables in place (e.g. in a memory-mapped file)
+ * without copying them.  They must be aligned for float access.
+ */
+lm_trie_quant_t *lm_trie_quant_map(uint8 * mem, int order);
+
+/**
+ * Write quant data to binary file in the original (unaligned) format
  */
 void lm_trie_quant_write_bin(lm_trie_quant_t * quant, FILE * fp);
 
+/**
+ * Write quantization tables to binary file
+ * @return number of bytes written
+ */
+size_t lm_trie_quant_write_tables(lm_trie_quant_t * quant, FILE * fp);
+
 /**
  * Free quant
  */
@@ -55,6 +55,7 @@
 #include "sphinxbase/logmath.h"
 #include "sphinxbase/strfuncs.h"
 #include "sphinxbase/case.h"
+#include "sphinxbase/sbthread.h"
 
 #include "ngram_model_internal.h"
 #include "ngram_model_trie.h"
@@ -103,6 +104,8 @@ ngram_str_to_type(const char *str_name)
     if (0 == strcmp_nocase(str_name, "dmp")
         || 0 == strcmp_nocase(str_name, "bin"))
         return NGRAM_BIN;
+    if (0 == strcmp_nocase(str_name, "mmap"))
+        return NGRAM_BIN_MMAP;
     return NGRAM_INVALID;
 }
 
@@ -114,6 +117,8 @@ ngram_type_to_str(int type)
         return "arpa";
     case NGRAM_BIN:
         return "dmp/bin";
+    case NGRAM_BIN_MMAP:
+        return "mmap";
     default:
         return NULL;
     }
@@ -146,6 +151,7 @@ ngram_model_read(cmd_ln_t * config,
         model = ngram_model_trie_read_arpa(config, file_name, lmath);
         break;
     case NGRAM_BIN:
+    case NGRAM_BIN_MMAP:
         if ((model =
              ngram_model_trie_read_bin(config, file_name, lmath)) != NULL)
             break;
@@ -189,7 +195,9 @@ ngram_model_write(ngram_model_t * model, const char *file_name,
     case NGRAM_ARPA:
         return ngram_model_trie_write_arpa(model, file_name);
     case NGRAM_BIN:
-        return ngram_model_trie_write_bin(model, file_name);
+        return ngram_model_trie_write_bin(model, file_name, FALSE);
+    case NGRAM_BIN_MMAP:
+        return ngram_model_trie_write_bin(model, file_name, TRUE);
     default:
         E_ERROR("language model file type not supported\n");
         return -1;
@@ -248,7 +256,7 @@ ngram_model_init(ngram_model_t * base,
 ngram_model_t *
 ngram_model_retain(ngram_model_t * model)
 {
-    ++model->refcount;
+    sbatomic_add(&model->refcount, 1);
     return model;
 }
 
@@ -262,14 +270,21 @@ ngram_model_flush(ngram_model_t * model)
 int
 ngram_model_free(ngram_model_t * model)
 {
-    int i;
+    int i, refcount;
 
     if (model == NULL)
         return 0;
-    if (--model->refcount > 0)
-        return model->refcount;
+    /* Copies in other threads retain and free the original. */
+    if ((refcount = sbatomic_add(&model->refcount, -1)) > 0)
+        return refcount;
     if (model->funcs && model->funcs->free)
         (*model->funcs->free) (model);
+    /* Copies share everything else with the original. */
+    if (model->shared) {
+        ngram_model_free(model->shared);
+        ckd_free(model);
+        return 0;
+    }
     if (model->writable) {
         /* Free all words. */
         for (i = 0; i < model->n_words; ++i) {
@@ -304,6 +319,16 @@ ngram_model_free(ngram_model_t * model)
     return 0;
 }
 
+ngram_model_t *
+ngram_model_copy(ngram_model_t * model)
+{
+    if (model->funcs == NULL || model->funcs->copy == NULL) {
+        E_ERROR("This type of language model cannot be copied\n");
+        return NULL;
+    }
+    return (*model->funcs->copy) (model);
+}
+
 int
 ngram_model_casefold(ngram_model_t * model, int kase)
 {
@@ -652,6 +677,10 @@ ngram_model_add_word(ngram_model_t * model,
     int32 wid, prob = model->log_zero;
 
     /* If we add word to unwritable model, we need to make it writable */
+    if (model->shared) {
+        E_WARN("Can't add word '%s' to a copy of a language model\n", word);
+        return -1;
+    }
     if (!model->writable) {
         E_WARN("Can't add word '%s' to read-only language model. "
                "Disable mmap with '-mmap no' to make it writable\n", word);
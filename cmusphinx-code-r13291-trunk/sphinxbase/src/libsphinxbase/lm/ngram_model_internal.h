@@ -73,6 +73,7 @@ struct ngram_model_s {
     int32 *tmp_wids;    /**< Temporary array of word IDs for ngram_model_get_ngram() */
     struct ngram_class_s **classes; /**< Word class definitions. */
     struct ngram_funcs_s *funcs;   /**< Implementation-specific methods. */
+    struct ngram_model_s *shared;  /**< Model owning the parameters, for copies. */
 };
 
 /**
@@ -146,6 +147,12 @@ typedef struct ngram_funcs_s {
      * Implementation-specific function for purging N-Gram cache
      */
     void (*flush) (ngram_model_t * model);
+
+    /**
+     * Implementation-specific function for creating a copy which
+     * shares parameters with this model (may be NULL).
+     */
+    ngram_model_t *(*copy) (ngram_model_t * model);
 } ngram_funcs_t;
 
 /**
@@ -520,6 +520,31 @@ ngram_model_set_interp(ngram_model_t * base,
     return base;
 }
 
+ngram_model_t *
+ngram_model_set_interp_copy(ngram_model_t * base, ngram_model_t * other)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *) base;
+    ngram_model_set_t *oset = (ngram_model_set_t *) other;
+    int32 i, j;
+
+    set->cur = -1;
+    for (i = 0; i < oset->n_models; ++i) {
+        for (j = 0; j < set->n_models; ++j)
+            if (0 == strcmp(oset->names[i], set->names[j]))
+                break;
+        if (j == set->n_models) {
+            E_ERROR("Unknown LM name %s\n", oset->names[i]);
+            return NULL;
+        }
+        /* Copy the log weights as is, going through probabilities
+         * would not give the same scores. */
+        set->lweights[j] = oset->lweights[i];
+        if (oset->cur == i)
+            set->cur = j;
+    }
+    return base;
+}
+
 ngram_model_t *
 ngram_model_set_add(ngram_model_t * base,
                     ngram_model_t * model,
@@ -529,6 +554,10 @@ ngram_model_set_add(ngram_model_t * base,
     float32 fprob;
     int32 scale, i;
 
+    if (base->shared) {
+        E_ERROR("Can't change the models in a copy of a language model set\n");
+        return NULL;
+    }
     /* Add it to the array of lms. */
     ++set->n_models;
     set->lms = ckd_realloc(set->lms, set->n_models * sizeof(*set->lms));
@@ -588,6 +617,10 @@ ngram_model_set_remove(ngram_model_t * base,
     int32 lmidx, scale, n, i;
     float32 fprob;
 
+    if (base->shared) {
+        E_ERROR("Can't change the models in a copy of a language model set\n");
+        return NULL;
+    }
     for (lmidx = 0; lmidx < set->n_models; ++lmidx)
         if (0 == strcmp(name, set->names[lmidx]))
             break;
@@ -642,6 +675,10 @@ ngram_model_set_map_words(ngram_model_t * base,
     ngram_model_set_t *set = (ngram_model_set_t *) base;
     int32 i;
 
+    if (base->shared) {
+        E_ERROR("Can't remap the words of a copy of a language model set\n");
+        return;
+    }
     /* Recreate the word mapping. */
     if (base->writable) {
         for (i = 0; i < base->n_words; ++i) {
@@ -849,18 +886,61 @@ ngram_model_set_free(ngram_model_t * base)
     for (i = 0; i < set->n_models; ++i)
         ngram_model_free(set->lms[i]);
     ckd_free(set->lms);
+    ckd_free(set->lweights);
+    ckd_free(set->maphist);
+    /* Names and word mappings belong to the original. */
+    if (base->shared)
+        return;
     for (i = 0; i < set->n_models; ++i)
         ckd_free(set->names[i]);
     ckd_free(set->names);
-    ckd_free(set->lweights);
-    ckd_free(set->maphist);
     ckd_free_2d((void **) set->widmap);
 }
 
+static ngram_model_t *
+ngram_model_set_copy(ngram_model_t * base)
+{
+    ngram_model_set_t *other = (ngram_model_set_t *) base;
+    ngram_model_set_t *set;
+    int32 i;
+
+    set = (ngram_model_set_t *) ckd_calloc(1, sizeof(*set));
+    memcpy(set, other, sizeof(*set));
+    set->base.refcount = 1;
+    set->base.writable = FALSE;
+    set->base.shared =
+        ngram_model_retain(base->shared ? base->shared : base);
+    set->lweights = ckd_calloc(set->n_models, sizeof(*set->lweights));
+    memcpy(set->lweights, other->lweights,
+           set->n_models * sizeof(*set->lweights));
+    set->maphist = ckd_calloc(set->base.n - 1, sizeof(*set->maphist));
+    set->lms = ckd_calloc(set->n_models, sizeof(*set->lms));
+    for (i = 0; i < set->n_models; ++i) {
+        if ((set->lms[i] = ngram_model_copy(other->lms[i])) == NULL) {
+            set->n_models = i;
+            ngram_model_free(&set->base);
+            return NULL;
+        }
+    }
+    return &set->base;
+}
+
+static void
+ngram_model_set_flush(ngram_model_t * base)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *) base;
+    int32 i;
+
+    for (i = 0; i < set->n_models; ++i)
+        ngram_model_flush(set->lms[i]);
+}
+
 static ngram_funcs_t ngram_model_set_funcs = {
     ngram_model_set_free,       /* free */
     ngram_model_set_apply_weights,      /* apply_weights */
     ngram_model_set_score,      /* score */
     ngram_model_set_raw_score,  /* raw_score */
     ngram_model_set_add_ug,     /* add_ug */
+    ngram_model_set_flush,      /* flush */
+    ngram_model_set_copy        /* copy */
 };
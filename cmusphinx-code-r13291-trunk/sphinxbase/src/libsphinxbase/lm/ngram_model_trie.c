@@ -47,6 +47,7 @@
 #include "ngram_model_trie.h"
 
 static const char trie_hdr[] = "Trie Language Model";
+static const char trie_hdr_aligned[] = "Aligned Trie Language Model";
 static const char dmp_hdr[] = "Darpa Trigram LM";
 static ngram_funcs_t ngram_model_trie_funcs;
 
@@ -337,15 +338,49 @@ read_word_str(ngram_model_t * base, FILE * fp)
     free(tmp_word_str);
 }
 
+/*
+ * Use the trie in place from a memory map, if the file can be mapped.
+ * On return, fp is positioned after the trie.
+ */
+static lm_trie_t *
+ngram_model_trie_map_bin(const char *path, FILE * fp, uint32 * counts,
+                         int order, size_t * pos)
+{
+    mmio_file_t *filemap;
+    lm_trie_t *trie;
+    size_t size, start;
+
+    start = *pos;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    if ((filemap = mmio_file_read(path)) == NULL) {
+        fseek(fp, start, SEEK_SET);
+        return NULL;
+    }
+    /* Make sure it's the same file we have been reading. */
+    if (size < strlen(trie_hdr_aligned)
+        || memcmp(mmio_file_ptr(filemap), trie_hdr_aligned,
+                  strlen(trie_hdr_aligned)) != 0
+        || (trie = lm_trie_map_bin(counts, order, filemap,
+                                   size, pos)) == NULL) {
+        mmio_file_unmap(filemap);
+        *pos = start;
+        fseek(fp, start, SEEK_SET);
+        return NULL;
+    }
+    fseek(fp, *pos, SEEK_SET);
+    return trie;
+}
+
 ngram_model_t *
 ngram_model_trie_read_bin(cmd_ln_t * config,
                           const char *path, logmath_t * lmath)
 {
     int32 is_pipe;
     FILE *fp;
-    size_t hdr_size;
+    size_t hdr_size, pos;
     char *hdr;
-    int cmp_res;
+    int aligned, do_mmap;
     uint8 i, order;
     uint32 counts[NGRAM_MAX_ORDER];
     ngram_model_trie_t *model;
@@ -356,29 +391,54 @@ ngram_model_trie_read_bin(cmd_ln_t * config,
         E_ERROR("File %s not found\n", path);
         return NULL;
     }
+    /* The original header is shorter than, and not a prefix of, the
+     * header for the aligned format. */
     hdr_size = strlen(trie_hdr);
-    hdr = (char *) ckd_calloc(hdr_size + 1, sizeof(*hdr));
+    hdr = (char *) ckd_calloc(strlen(trie_hdr_aligned) + 1, sizeof(*hdr));
     fread(hdr, sizeof(*hdr), hdr_size, fp);
-    cmp_res = strcmp(hdr, trie_hdr);
-    ckd_free(hdr);
-    if (cmp_res) {
+    aligned = FALSE;
+    if (strcmp(hdr, trie_hdr) != 0
+        && strncmp(hdr, trie_hdr_aligned, hdr_size) == 0) {
+        fread(hdr + hdr_size, sizeof(*hdr),
+              strlen(trie_hdr_aligned) - hdr_size, fp);
+        hdr_size = strlen(trie_hdr_aligned);
+        aligned = (strcmp(hdr, trie_hdr_aligned) == 0);
+    }
+    if (strcmp(hdr, trie_hdr) != 0 && !aligned) {
         E_INFO("Header doesn't match\n");
+        ckd_free(hdr);
         fclose_comp(fp, is_pipe);
         return NULL;
     }
+    ckd_free(hdr);
     model = (ngram_model_trie_t *) ckd_calloc(1, sizeof(*model));
     base = &model->base;
     fread(&order, sizeof(order), 1, fp);
     for (i = 0; i < order; i++) {
         fread(&counts[i], sizeof(counts[i]), 1, fp);
     }
+    pos = hdr_size + sizeof(order) + order * sizeof(*counts);
     ngram_model_init(base, &ngram_model_trie_funcs, lmath, order,
                      (int32) counts[0]);
     for (i = 0; i < order; i++) {
         base->n_counts[i] = counts[i];
     }
 
-    model->trie = lm_trie_read_bin(counts, order, fp);
+    if (aligned) {
+        do_mmap = (config && cmd_ln_exists_r(config, "-mmap"))
+            ? cmd_ln_boolean_r(config, "-mmap") : TRUE;
+        model->trie = NULL;
+        if (do_mmap && !is_pipe)
+            model->trie = ngram_model_trie_map_bin(path, fp, counts,
+                                                   order, &pos);
+        if (model->trie)
+            E_INFO("Using memory-mapped I/O for LM trie\n");
+        else
+            model->trie = lm_trie_read_bin_aligned(counts, order, fp, &pos);
+    }
+    else {
+        model->trie = lm_trie_read_bin(counts, order, fp);
+    }
     read_word_str(base, fp);
     fclose_comp(fp, is_pipe);
 
@@ -400,10 +460,13 @@ write_word_str(FILE * fp, ngram_model_t * model)
 }
 
 int
-ngram_model_trie_write_bin(ngram_model_t * base, const char *path)
+ngram_model_trie_write_bin(ngram_model_t * base, const char *path,
+                           int aligned)
 {
     int i;
     int32 is_pipe;
+    size_t pos;
+    const char *hdr = aligned ? trie_hdr_aligned : trie_hdr;
     ngram_model_trie_t *model = (ngram_model_trie_t *) base;
     FILE *fp = fopen_comp(path, "wb", &is_pipe);
     if (!fp) {
@@ -411,13 +474,20 @@ ngram_model_trie_write_bin(ngram_model_t * base, const char *path)
         return -1;
     }
 
-    fwrite(trie_hdr, sizeof(*trie_hdr), strlen(trie_hdr), fp);
+    fwrite(hdr, sizeof(*hdr), strlen(hdr), fp);
     fwrite(&model->base.n, sizeof(model->base.n), 1, fp);
     for (i = 0; i < model->base.n; i++) {
         fwrite(&model->base.n_counts[i], sizeof(model->base.n_counts[i]),
                1, fp);
     }
-    lm_trie_write_bin(model->trie, base->n_counts[0], fp);
+    if (aligned) {
+        pos = strlen(hdr) + sizeof(model->base.n)
+            + model->base.n * sizeof(*model->base.n_counts);
+        lm_trie_write_bin_aligned(model->trie, base->n_counts[0], fp, &pos);
+    }
+    else {
+        lm_trie_write_bin(model->trie, base->n_counts[0], fp);
+    }
     write_word_str(fp, base);
     fclose_comp(fp, is_pipe);
     return 0;
@@ -683,11 +753,29 @@ lm_trie_flush(ngram_model_t * base)
     return;
 }
 
+static ngram_model_t *
+ngram_model_trie_copy(ngram_model_t * base)
+{
+    ngram_model_trie_t *other = (ngram_model_trie_t *) base;
+    ngram_model_trie_t *model;
+
+    model = (ngram_model_trie_t *) ckd_calloc(1, sizeof(*model));
+    memcpy(&model->base, base, sizeof(*base));
+    model->base.refcount = 1;
+    /* Word strings and unigrams belong to the original. */
+    model->base.writable = FALSE;
+    model->base.shared =
+        ngram_model_retain(base->shared ? base->shared : base);
+    model->trie = lm_trie_copy(other->trie);
+    return &model->base;
+}
+
 static ngram_funcs_t ngram_model_trie_funcs = {
     ngram_model_trie_free,      /* free */
     trie_apply_weights,         /* apply_weights */
     ngram_model_trie_score,     /* score */
     ngram_model_trie_raw_score, /* raw_score */
     lm_trie_add_ug,             /* add_ug */
-    lm_trie_flush               /* flush */
+    lm_trie_flush,              /* flush */
+    ngram_model_trie_copy       /* copy */
 };
@@ -69,8 +69,11 @@ ngram_model_t *ngram_model_trie_read_bin(cmd_ln_t * config,
 
 /**
  * Write trie to binary file
+ * @param aligned write the aligned format, which can be memory-mapped
+ * but is not understood by older readers.
  */
-int ngram_model_trie_write_bin(ngram_model_t * model, const char *path);
+int ngram_model_trie_write_bin(ngram_model_t * model, const char *path,
+                               int aligned);
 
 /**
  * Read N-Gram model from DMP file and arrange it in trie structure
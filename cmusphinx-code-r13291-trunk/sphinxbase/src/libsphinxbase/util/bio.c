@@ -503,6 +503,72 @@ bio_verify_chksum(FILE * fp, int32 byteswap, uint32 chksum)
              file_chksum, chksum);
 }
 
+int32
+bio_fwrite_varint(uint32 val, FILE *fp, uint32 *chksum)
+{
+    uint8 buf[5];
+    int32 n;
+
+    n = 0;
+    do {
+        buf[n] = val & 0x7f;
+        val >>= 7;
+        if (val)
+            buf[n] |= 0x80;
+        ++n;
+    } while (val);
+
+    if (bio_fwrite(buf, 1, n, fp, 0, chksum) != n)
+        return -1;
+    return n;
+}
+
+int32
+bio_fread_varint(uint32 *val, FILE *fp, uint32 *chksum)
+{
+    uint32 v;
+    int32 n;
+
+    v = 0;
+    for (n = 0; n < 5; ++n) {
+        int c;
+        uint8 b;
+
+        if ((c = getc(fp)) == EOF)
+            return -1;
+        b = (uint8)c;
+        if (chksum)
+            *chksum = chksum_accum(&b, 1, 1, *chksum);
+        v |= (uint32)(b & 0x7f) << (7 * n);
+        if ((b & 0x80) == 0) {
+            *val = v;
+            return n + 1;
+        }
+    }
+    E_ERROR("Variable-length integer is longer than 5 bytes\n");
+    return -1;
+}
+
+int32
+bio_fwrite_svarint(int32 val, FILE *fp, uint32 *chksum)
+{
+    /* Zig-zag encoding, so that small negative values stay short. */
+    return bio_fwrite_varint(((uint32)val << 1) ^ (uint32)(val >> 31),
+                             fp, chksum);
+}
+
+int32
+bio_fread_svarint(int32 *val, FILE *fp, uint32 *chksum)
+{
+    uint32 v;
+    int32 n;
+
+    if ((n = bio_fread_varint(&v, fp, chksum)) < 0)
+        return -1;
+    *val = (int32)(v >> 1) ^ -(int32)(v & 1);
+    return n;
+}
+
 int
 bio_fwrite_3d(void ***arr,
 	   size_t e_sz,
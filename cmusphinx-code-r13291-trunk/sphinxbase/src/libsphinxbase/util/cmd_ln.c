@@ -81,6 +81,7 @@
 #include "sphinxbase/hash_table.h"
 #include "sphinxbase/case.h"
 #include "sphinxbase/strfuncs.h"
+#include "sphinxbase/sbthread.h"
 
 typedef struct cmd_ln_val_s {
     anytype_t val;
@@ -1038,17 +1039,19 @@ cmd_ln_set_float_r(cmd_ln_t *cmdln, char const *name, double fv)
 cmd_ln_t *
 cmd_ln_retain(cmd_ln_t *cmdln)
 {
-    ++cmdln->refcount;
+    sbatomic_add(&cmdln->refcount, 1);
     return cmdln;
 }
 
 int
 cmd_ln_free_r(cmd_ln_t *cmdln)
 {
+    int refcount;
+
     if (cmdln == NULL)
         return 0;
-    if (--cmdln->refcount > 0)
-        return cmdln->refcount;
+    if ((refcount = sbatomic_add(&cmdln->refcount, -1)) > 0)
+        return refcount;
 
     if (cmdln->ht) {
         glist_t entries;
@@ -45,6 +45,7 @@
 #include "sphinxbase/mmio.h"
 #include "sphinxbase/bio.h"
 #include "sphinxbase/strfuncs.h"
+#include "sphinxbase/sbthread.h"
 
 struct logmath_s {
     logadd_t t;
@@ -334,17 +335,20 @@ error_out:
 logmath_t *
 logmath_retain(logmath_t *lmath)
 {
-    ++lmath->refcount;
+    sbatomic_add(&lmath->refcount, 1);
     return lmath;
 }
 
 int
 logmath_free(logmath_t *lmath)
 {
+    int refcount;
+
     if (lmath == NULL)
         return 0;
-    if (--lmath->refcount > 0)
-        return lmath->refcount;
+    /* Decoders in other threads may be sharing it. */
+    if ((refcount = sbatomic_add(&lmath->refcount, -1)) > 0)
+        return refcount;
     if (lmath->filemap)
         mmio_file_unmap(lmath->filemap);
     else
@@ -356,6 +356,12 @@ sbmsgq_wait(sbmsgq_t *q, size_t *out_len, int sec, int nsec)
     return q->msg;
 }
 
+int
+sbatomic_add(int *x, int n)
+{
+    return InterlockedExchangeAdd((LONG volatile *)x, n) + n;
+}
+
 #else /* POSIX */
 #include <pthread.h>
 #include <sys/time.h>
@@ -704,6 +710,27 @@ sbmtx_free(sbmtx_t *mtx)
     pthread_mutex_destroy(&mtx->mtx);
     ckd_free(mtx);
 }
+
+#if defined(__GNUC__)
+int
+sbatomic_add(int *x, int n)
+{
+    return __atomic_add_fetch(x, n, __ATOMIC_SEQ_CST);
+}
+#else
+static pthread_mutex_t atomic_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+int
+sbatomic_add(int *x, int n)
+{
+    int rv;
+
+    pthread_mutex_lock(&atomic_mtx);
+    rv = (*x += n);
+    pthread_mutex_unlock(&atomic_mtx);
+    return rv;
+}
+#endif
 #endif /* not WIN32 */
 
 cmd_ln_t *
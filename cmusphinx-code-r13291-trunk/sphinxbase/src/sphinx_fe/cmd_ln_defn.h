@@ -129,6 +129,11 @@ static arg_t defn[] = {
     ARG_INT32,
     "0",
     "Number of parts to run in (supersedes -nskip and -runlen if non-zero)" },
+
+  { "-nthreads",
+    ARG_INT32,
+    "1",
+    "If a control file was specified, the number of files to convert in parallel" },
   
   { "-di",
     ARG_STRING,
@@ -53,6 +53,7 @@
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/byteorder.h>
 #include <sphinxbase/hash_table.h>
+#include <sphinxbase/sbthread.h>
 
 #include "sphinx_wave2feat.h"
 #include "cmd_ln_defn.h"
@@ -934,14 +935,130 @@ build_filenames(cmd_ln_t *config, char const *basename,
     }
 }
 
+/**
+ * File to be converted by a worker thread.
+ */
+typedef struct convert_job_s {
+    char const *infile;  /**< Input file, or NULL to exit. */
+    char const *outfile; /**< Output file. */
+} convert_job_t;
+
+/**
+ * Worker thread for converting files in parallel.
+ */
+typedef struct convert_worker_s {
+    int id;                  /**< Index of this worker. */
+    sphinx_wave2feat_t *wtf; /**< Converter (and front end) for this worker. */
+    sbmsgq_t *ready;         /**< Queue on which to announce we are idle. */
+    sbthread_t *th;          /**< Thread running this worker. */
+} convert_worker_t;
+
+/**
+ * Pool of worker threads fed from the control file.
+ */
+typedef struct convert_pool_s {
+    convert_worker_t *workers;
+    int nthreads;
+    sbmsgq_t *ready;         /**< IDs of idle workers. */
+} convert_pool_t;
+
+static int
+convert_worker_main(sbthread_t *th)
+{
+    convert_worker_t *w = sbthread_arg(th);
+
+    while (TRUE) {
+        convert_job_t job;
+        void *msg;
+
+        /* Ask for work, then wait for it. */
+        sbmsgq_send(w->ready, sizeof(w->id), &w->id);
+        while ((msg = sbmsgq_wait(sbthread_msgq(th), NULL, -1, 0)) == NULL)
+            ;
+        memcpy(&job, msg, sizeof(job));
+        if (job.infile == NULL)
+            break;
+        sphinx_wave2feat_convert_file(w->wtf, job.infile, job.outfile);
+    }
+    return 0;
+}
+
+static convert_pool_t *
+convert_pool_init(sphinx_wave2feat_t *wtf, int nthreads)
+{
+    convert_pool_t *pool;
+    int i;
+
+    pool = ckd_calloc(1, sizeof(*pool));
+    pool->nthreads = nthreads;
+    /* Every worker can be waiting at once. */
+    pool->ready = sbmsgq_init((sizeof(size_t) + sizeof(int)) * (nthreads + 1));
+    pool->workers = ckd_calloc(nthreads, sizeof(*pool->workers));
+    for (i = 0; i < nthreads; ++i) {
+        convert_worker_t *w = &pool->workers[i];
+
+        w->id = i;
+        w->ready = pool->ready;
+        /* Each worker needs its own front end, since it holds the
+         * state of the file being converted. */
+        if (i == 0)
+            w->wtf = sphinx_wave2feat_retain(wtf);
+        else if ((w->wtf = sphinx_wave2feat_init(wtf->config)) == NULL)
+            E_FATAL("Failed to initialize wave2feat object\n");
+        if ((w->th = sbthread_start(wtf->config, convert_worker_main, w)) == NULL)
+            E_FATAL("Failed to start conversion thread %d\n", i);
+    }
+    E_INFO("Converting files with %d threads\n", nthreads);
+    return pool;
+}
+
+/**
+ * Give a file to the next idle worker.
+ */
+static void
+convert_pool_send(convert_pool_t *pool, char const *infile, char const *outfile)
+{
+    convert_job_t job;
+    void *msg;
+    int id;
+
+    while ((msg = sbmsgq_wait(pool->ready, NULL, -1, 0)) == NULL)
+        ;
+    memcpy(&id, msg, sizeof(id));
+    job.infile = infile;
+    job.outfile = outfile;
+    sbthread_send(pool->workers[id].th, sizeof(job), &job);
+}
+
+/**
+ * Wait for all files to be converted and shut down the workers.
+ */
+static void
+convert_pool_free(convert_pool_t *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->nthreads; ++i)
+        convert_pool_send(pool, NULL, NULL);
+    for (i = 0; i < pool->nthreads; ++i) {
+        sbthread_wait(pool->workers[i].th);
+        sbthread_free(pool->workers[i].th);
+        sphinx_wave2feat_free(pool->workers[i].wtf);
+    }
+    sbmsgq_free(pool->ready);
+    ckd_free(pool->workers);
+    ckd_free(pool);
+}
+
 static int
 run_control_file(sphinx_wave2feat_t *wtf, char const *ctlfile)
 {
+    convert_pool_t *pool = NULL;
     hash_table_t *files;
     hash_iter_t *itor;
     lineiter_t *li;
     FILE *ctlfh;
-    int nskip, runlen, npart;
+    int nskip, runlen, npart, nthreads;
 
     if ((ctlfh = fopen(ctlfile, "r")) == NULL) {
         E_ERROR_SYSTEM("Failed to open control file %s", ctlfile);
@@ -963,6 +1080,17 @@ run_control_file(sphinx_wave2feat_t *wtf, char const *ctlfile)
         else
             runlen = partlen;
     }
+    /* Files are independent, so they can be converted in any order
+     * by any number of threads.  Dithering, however, draws from a
+     * single random number generator shared by all front ends. */
+    nthreads = cmd_ln_int32_r(wtf->config, "-nthreads");
+    if (nthreads > 1 && cmd_ln_boolean_r(wtf->config, "-dither")) {
+        E_WARN("Dithering requires converting one file at a time, ignoring -nthreads\n");
+        nthreads = 1;
+    }
+    if (nthreads > 1)
+        pool = convert_pool_init(wtf, nthreads);
+
     if (runlen != -1){
         E_INFO("Processing %d utterances at position %d\n", runlen, nskip);
         files = hash_table_new(runlen, HASH_CASE_YES);
@@ -993,9 +1121,15 @@ run_control_file(sphinx_wave2feat_t *wtf, char const *ctlfile)
         build_filenames(wtf->config, li->buf, &infile, &outfile);
         if (hash_table_lookup(files, infile, NULL) == 0)
             continue;
-        sphinx_wave2feat_convert_file(wtf, infile, outfile);
+        if (pool)
+            convert_pool_send(pool, infile, outfile);
+        else
+            sphinx_wave2feat_convert_file(wtf, infile, outfile);
         hash_table_enter(files, infile, outfile);
     }
+    /* Wait for the workers before freeing the file names. */
+    if (pool)
+        convert_pool_free(pool);
     for (itor = hash_table_iter(files); itor;
          itor = hash_table_iter_next(itor)) {
         ckd_free((void *)hash_entry_key(itor->ent));
@@ -79,6 +79,21 @@ static const arg_t defn[] = {
     "no",
     "Compute grammar closure to speedup loading"},
 
+  { "-bin",
+    ARG_STRING,
+    NULL,
+    "Output grammar in binary format (implies -compile)"},
+
+  { "-lw",
+    ARG_FLOAT32,
+    "1.0",
+    "Language weight for binary output (use the decoder's -lw to memory-map it)"},
+
+  { "-logbase",
+    ARG_FLOAT32,
+    "1.0001",
+    "Base in which all log-likelihoods calculated (as for the decoder)"},
+
   { NULL, 0, NULL, NULL }
 };
 
@@ -88,13 +103,13 @@ usagemsg(char *pgm)
 {
     E_INFO("Usage: %s -jsgf <input.jsgf> -toprule <rule name>\\\n", pgm);
     E_INFOCONT("\t[-fsm yes/no] [-compile yes/no]\n");
-    E_INFOCONT("\t-fsg <output.fsg>\n");
+    E_INFOCONT("\t-fsg <output.fsg> | -bin <output.fsg.bin> [-lw <lw>] [-logbase <base>]\n");
 
     exit(0);
 }
 
 static fsg_model_t *
-get_fsg(jsgf_t *grammar, const char *name)
+get_fsg(jsgf_t *grammar, const char *name, float32 logbase, float32 lw)
 {
     logmath_t *lmath;
     fsg_model_t *fsg;
@@ -119,8 +134,8 @@ get_fsg(jsgf_t *grammar, const char *name)
          }
     }
 
-    lmath = logmath_init(1.0001, 0, 0);
-    fsg = jsgf_build_fsg_raw(grammar, rule, lmath, 1.0);
+    lmath = logmath_init(logbase, 0, 0);
+    fsg = jsgf_build_fsg_raw(grammar, rule, lmath, lw);
     return fsg;
 }
 
@@ -145,7 +160,8 @@ main(int argc, char *argv[])
     }
 
     rule = cmd_ln_str_r(config, "-toprule") ? cmd_ln_str_r(config, "-toprule") : NULL;
-    if (!(fsg = get_fsg(jsgf, rule))) {
+    if (!(fsg = get_fsg(jsgf, rule, cmd_ln_float32_r(config, "-logbase"),
+                        cmd_ln_float32_r(config, "-lw")))) {
         E_ERROR("No fsg was built for the given rule '%s'.\n"
                 "Check rule name; it should be qualified (with grammar name)\n"
                 "and not enclosed in angle brackets (e.g. 'grammar.rulename').",
@@ -154,12 +170,17 @@ main(int argc, char *argv[])
     }
 
 
-    if (cmd_ln_boolean_r(config, "-compile")) {
+    if (cmd_ln_boolean_r(config, "-compile")
+        || cmd_ln_str_r(config, "-bin")) {
 	fsg_model_null_trans_closure(fsg, NULL);
     }
 
     
-    if (cmd_ln_str_r(config, "-fsm")) {
+    if (cmd_ln_str_r(config, "-bin")) {
+        if (fsg_model_write_bin(fsg, cmd_ln_str_r(config, "-bin")) < 0)
+            return 1;
+    }
+    else if (cmd_ln_str_r(config, "-fsm")) {
 	const char* outfile = cmd_ln_str_r(config, "-fsm");
 	const char* symfile = cmd_ln_str_r(config, "-symtab");
         if (outfile)
@@ -79,7 +79,7 @@ static const arg_t defn[] = {
   { "-ofmt",
     ARG_STRING,
     NULL,
-    "Output language model file (will guess if not specified)"},
+    "Output language model file (will guess if not specified, use 'mmap' for a binary file that can be memory-mapped)"},
 
   { "-case",
     ARG_STRING,
@@ -0,0 +1,144 @@
+#include <fsg_model.h>
+
+#include "test_macros.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Write a copy of a binary FSG whose last arc is changed. */
+static void
+write_bad_arc(fsg_model_t *fsg, char const *infile, char const *outfile,
+	      int32 to, int32 wid)
+{
+	FILE *fp;
+	char buf[65536], *c;
+	size_t len, arcsize;
+	fsg_link_t *l;
+
+	TEST_ASSERT(fp = fopen(infile, "rb"));
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+	TEST_ASSERT(len < sizeof(buf));
+
+	/* Arcs are stored as they are compiled. */
+	arcsize = fsg->n_arc * sizeof(*fsg->arcs);
+	for (c = buf; c + arcsize <= buf + len; ++c)
+		if (0 == memcmp(c, fsg->arcs, arcsize))
+			break;
+	TEST_ASSERT(c + arcsize <= buf + len);
+	l = (fsg_link_t *)c + fsg->n_arc - 1;
+	l->to_state = to;
+	l->wid = wid;
+
+	TEST_ASSERT(fp = fopen(outfile, "wb"));
+	TEST_EQUAL(len, fwrite(buf, 1, len, fp));
+	fclose(fp);
+}
+
+static void
+compare_arcs(fsg_model_t *a, fsg_model_t *b)
+{
+	int32 s;
+
+	TEST_EQUAL(fsg_model_n_state(a), fsg_model_n_state(b));
+	TEST_EQUAL(fsg_model_start_state(a), fsg_model_start_state(b));
+	TEST_EQUAL(fsg_model_final_state(a), fsg_model_final_state(b));
+	TEST_EQUAL(fsg_model_n_word(a), fsg_model_n_word(b));
+	for (s = 0; s < fsg_model_n_word(a); ++s)
+		TEST_EQUAL(0, strcmp(fsg_model_word_str(a, s),
+				     fsg_model_word_str(b, s)));
+	for (s = 0; s < fsg_model_n_state(a); ++s) {
+		fsg_arciter_t *itor;
+		fsg_link_t *l;
+
+		/* Iterator and compiled arcs are in the same order. */
+		l = fsg_model_arcs_begin(b, s);
+		for (itor = fsg_model_arcs(a, s);
+		     itor; itor = fsg_arciter_next(itor)) {
+			fsg_link_t *link = fsg_arciter_get(itor);
+			TEST_ASSERT(l < fsg_model_arcs_end(b, s));
+			TEST_EQUAL(fsg_link_from_state(link), s);
+			TEST_EQUAL(fsg_link_from_state(l), s);
+			TEST_EQUAL(fsg_link_to_state(link), fsg_link_to_state(l));
+			TEST_EQUAL(fsg_link_wid(link), fsg_link_wid(l));
+			TEST_EQUAL(fsg_link_logs2prob(link),
+				   fsg_link_logs2prob(l));
+			TEST_EQUAL(fsg_link_wid(l) < 0,
+				   l >= fsg_model_null_arcs_begin(b, s));
+			++l;
+		}
+		TEST_ASSERT(l == fsg_model_arcs_end(b, s));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	fsg_model_t *fsg, *fsg2, *bad;
+	int32 wid;
+
+	lmath = logmath_init(1.0001, 0, 0);
+	fsg = fsg_model_readfile(LMDIR "/goforward.fsg", lmath, 7.5);
+	TEST_ASSERT(fsg);
+	TEST_ASSERT(fsg_model_add_silence(fsg, "<sil>", -1, 0.3));
+	TEST_ASSERT(fsg_model_add_alt(fsg, "FORWARD", "FORWARD(2)"));
+
+	/* Compiled arcs match the transition tables. */
+	TEST_ASSERT(!fsg_model_is_compiled(fsg));
+	TEST_EQUAL(0, fsg_model_compile(fsg));
+	TEST_ASSERT(fsg_model_is_compiled(fsg));
+	TEST_EQUAL(0, fsg_model_write_bin(fsg, "goforward.fsg.bin"));
+
+	/* Binary file reads back the same, compiled. */
+	fsg2 = fsg_model_readfile("goforward.fsg.bin", lmath, 7.5);
+	TEST_ASSERT(fsg2);
+	TEST_ASSERT(fsg_model_is_compiled(fsg2));
+	TEST_ASSERT(fsg_model_has_sil(fsg2));
+	TEST_ASSERT(fsg_model_has_alt(fsg2));
+	TEST_ASSERT(fsg_model_is_filler(fsg2, fsg_model_word_id(fsg2, "<sil>")));
+	compare_arcs(fsg, fsg2);
+	fsg_model_write(fsg2, stdout);
+
+	/* Arcs to states or words that do not exist are refused. */
+	wid = fsg_link_wid(fsg->arcs + fsg->n_arc - 1);
+	write_bad_arc(fsg, "goforward.fsg.bin", "badarc.fsg.bin",
+		      fsg_model_n_state(fsg), wid);
+	TEST_ASSERT(NULL == fsg_model_readfile("badarc.fsg.bin", lmath, 7.5));
+	write_bad_arc(fsg, "goforward.fsg.bin", "badarc.fsg.bin", -1, wid);
+	TEST_ASSERT(NULL == fsg_model_readfile("badarc.fsg.bin", lmath, 7.5));
+	write_bad_arc(fsg, "goforward.fsg.bin", "badarc.fsg.bin",
+		      0, fsg_model_n_word(fsg));
+	TEST_ASSERT(NULL == fsg_model_readfile("badarc.fsg.bin", lmath, 7.5));
+	/* But any existing state will do. */
+	write_bad_arc(fsg, "goforward.fsg.bin", "badarc.fsg.bin", 0, wid);
+	TEST_ASSERT(bad = fsg_model_readfile("badarc.fsg.bin", lmath, 7.5));
+	fsg_model_free(bad);
+
+	/* It can still be modified and recompiled. */
+	TEST_ASSERT(fsg_model_add_silence(fsg, "++NOISE++", -1, 0.3));
+	TEST_ASSERT(!fsg_model_is_compiled(fsg));
+	TEST_ASSERT(fsg_model_add_silence(fsg2, "++NOISE++", -1, 0.3));
+	TEST_ASSERT(!fsg_model_is_compiled(fsg2));
+	TEST_EQUAL(0, fsg_model_compile(fsg2));
+	compare_arcs(fsg2, fsg2);
+	TEST_EQUAL(fsg_model_n_word(fsg), fsg_model_n_word(fsg2));
+	TEST_ASSERT(fsg_model_null_trans(fsg2, 2, 4) != NULL);
+
+	/* Arcs of an earlier compilation are freed by the next one. */
+	TEST_EQUAL(1, fsg->n_compile);
+	TEST_EQUAL(0, fsg_model_compile(fsg));
+	TEST_EQUAL(2, fsg->n_compile);
+	TEST_ASSERT(fsg->old_arcs == NULL);
+	TEST_ASSERT(fsg_model_add_silence(fsg, "++BREATH++", -1, 0.3));
+	TEST_ASSERT(fsg->old_arcs != NULL);
+	TEST_EQUAL(0, fsg_model_compile(fsg));
+	TEST_EQUAL(3, fsg->n_compile);
+	TEST_ASSERT(fsg->old_arcs == NULL);
+
+	fsg_model_free(fsg);
+	fsg_model_free(fsg2);
+	logmath_free(lmath);
+
+	return 0;
+}
@@ -11,7 +11,7 @@
 void
 run_tests(ngram_model_t *model)
 {
-	int32 n_used;
+	int32 n_used, score[3];
 
 	ngram_tg_score(model,
 		       ngram_wid(model, "daines"),
@@ -65,13 +65,23 @@ run_tests(ngram_model_t *model)
 		       ngram_wid(model, "huggins"),
 		       ngram_wid(model, "david"), &n_used);
 	TEST_EQUAL(n_used, 3);
+
+	/* Backoffs of recent histories are remembered, in any order. */
+	score[0] = ngram_score(model, "huggins", "david", "david", NULL);
+	score[1] = ngram_score(model, "daines", "david", "huggins", NULL);
+	score[2] = ngram_score(model, "daines", "huggins", "david", NULL);
+	ngram_model_flush(model);
+	TEST_EQUAL(ngram_score(model, "daines", "huggins", "david", NULL), score[2]);
+	TEST_EQUAL(ngram_score(model, "huggins", "david", "david", NULL), score[0]);
+	TEST_EQUAL(ngram_score(model, "daines", "david", "huggins", NULL), score[1]);
+	TEST_EQUAL(ngram_score(model, "huggins", "david", "david", NULL), score[0]);
 }
 
 int
 main(int argc, char *argv[])
 {
 	logmath_t *lmath;
-	ngram_model_t *model;
+	ngram_model_t *model, *copy;
 
 	lmath = logmath_init(1.0001, 0, 0);
 
@@ -83,6 +93,17 @@ main(int argc, char *argv[])
 	run_tests(model);
 	ngram_model_free(model);
 
+	/* A copy scores the same, and outlives the original. */
+	model = ngram_model_read(NULL, LMDIR "/100.lm.bin", NGRAM_BIN, lmath);
+	TEST_ASSERT(copy = ngram_model_copy(model));
+	TEST_ASSERT(ngram_model_add_word(copy, "foobie", 1.0) < 0);
+	ngram_model_free(model);
+	run_tests(copy);
+	model = ngram_model_copy(copy);
+	ngram_model_free(copy);
+	run_tests(model);
+	ngram_model_free(model);
+
 	logmath_free(lmath);
 	return 0;
 }
@@ -175,6 +175,22 @@ main(int argc, char *argv[])
 	TEST_EQUAL_LOG(ngram_score(lmset, "apparently", "karybdis:scylla", NULL),
 		       logmath_log10_to_log(lmath, -0.5172));
 
+	/* A copy scores the same, with its own selection. */
+	{
+		ngram_model_t *copy;
+
+		TEST_ASSERT(copy = ngram_model_copy(lmset));
+		TEST_EQUAL(ngram_score(copy, "huggins", "david", NULL),
+			   logmath_log10_to_log(lmath, -0.0361));
+		ngram_model_set_select(copy, "102");
+		TEST_EQUAL(ngram_score(copy, "huggins", "david", NULL),
+			   logmath_log10_to_log(lmath, -0.1597));
+		TEST_EQUAL(ngram_score(lmset, "huggins", "david", NULL),
+			   logmath_log10_to_log(lmath, -0.0361));
+		TEST_EQUAL(ngram_model_set_remove(copy, "102", TRUE), NULL);
+		ngram_model_free(copy);
+	}
+
 	/* Test word ID mapping. */
 	ngram_model_set_select(lmset, "turtle");
 	TEST_EQUAL(ngram_wid(lmset, "ROBOMAN"),
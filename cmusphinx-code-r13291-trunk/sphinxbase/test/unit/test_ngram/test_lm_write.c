@@ -1,5 +1,6 @@
 #include <ngram_model.h>
 #include <logmath.h>
+#include <cmd_ln.h>
 #include <strfuncs.h>
 #include <err.h>
 
@@ -37,11 +38,30 @@ test_lm_vals(ngram_model_t *model)
 	return 0;
 }
 
+static int
+test_lm_header(const char *path, const char *hdr)
+{
+	char buf[64];
+	FILE *fp;
+
+	TEST_ASSERT(fp = fopen(path, "rb"));
+	TEST_EQUAL(strlen(hdr), fread(buf, 1, strlen(hdr), fp));
+	fclose(fp);
+	TEST_EQUAL(0, memcmp(buf, hdr, strlen(hdr)));
+	return 0;
+}
+
+static const arg_t mmap_args[] = {
+	{ "-mmap", ARG_BOOLEAN, "yes", "Use memory-mapped I/O" },
+	{ NULL, 0, NULL, NULL }
+};
+
 int
 main(int argc, char *argv[])
 {
 	logmath_t *lmath;
 	ngram_model_t *model;
+	cmd_ln_t *config;
 
 	/* Initialize a logmath object to pass to ngram_read */
 	lmath = logmath_init(1.0001, 0, 0);
@@ -50,6 +70,11 @@ main(int argc, char *argv[])
 	model = ngram_model_read(NULL, LMDIR "/100.lm.bz2", NGRAM_ARPA, lmath);
 	test_lm_vals(model);
 	TEST_EQUAL(0, ngram_model_write(model, "100.tmp.lm.bin", NGRAM_BIN));
+	/* Older readers only understand the original format. */
+	test_lm_header("100.tmp.lm.bin", "Trie Language Model");
+	TEST_EQUAL(0, ngram_model_write(model, "100.tmp.mmap.lm.bin",
+					ngram_str_to_type("mmap")));
+	test_lm_header("100.tmp.mmap.lm.bin", "Aligned Trie Language Model");
 	ngram_model_free(model);
 
 	E_INFO("Converting BIN to ARPA\n");
@@ -63,6 +88,18 @@ main(int argc, char *argv[])
 	test_lm_vals(model);
 	ngram_model_free(model);
 
+	E_INFO("Testing converted memory-mappable BIN\n");
+	model = ngram_model_read(NULL, "100.tmp.mmap.lm.bin", NGRAM_BIN, lmath);
+	test_lm_vals(model);
+	ngram_model_free(model);
+
+	E_INFO("Testing converted memory-mappable BIN without memory-mapping\n");
+	config = cmd_ln_init(NULL, mmap_args, TRUE, "-mmap", "no", NULL);
+	model = ngram_model_read(config, "100.tmp.mmap.lm.bin", NGRAM_BIN, lmath);
+	test_lm_vals(model);
+	ngram_model_free(model);
+	cmd_ln_free_r(config);
+
 	E_INFO("Testing converted ARPA\n");
 	model = ngram_model_read(NULL, "100.tmp.lm", NGRAM_ARPA, lmath);
 	test_lm_vals(model);
@@ -84,6 +121,16 @@ main(int argc, char *argv[])
 	model = ngram_model_read(NULL, LMDIR "/turtle.ug.lm", NGRAM_ARPA, lmath);
 	TEST_EQUAL(0, ngram_model_write(model, "turtle.ug.tmp.lm.bin", NGRAM_BIN));
 	ngram_model_free(model);
+	model = ngram_model_read(NULL, "turtle.ug.tmp.lm.bin", NGRAM_BIN, lmath);
+	TEST_ASSERT(model);
+	TEST_EQUAL(ngram_model_get_size(model), 1);
+	TEST_EQUAL(0, ngram_model_write(model, "turtle.ug.tmp.mmap.lm.bin",
+					NGRAM_BIN_MMAP));
+	ngram_model_free(model);
+	model = ngram_model_read(NULL, "turtle.ug.tmp.mmap.lm.bin", NGRAM_BIN, lmath);
+	TEST_ASSERT(model);
+	TEST_EQUAL(ngram_model_get_size(model), 1);
+	ngram_model_free(model);
 
 	logmath_free(lmath);
 	return 0;
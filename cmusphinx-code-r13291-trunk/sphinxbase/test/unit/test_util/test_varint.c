@@ -0,0 +1,67 @@
+/**
+ * @file test_varint.c Test variable-length integer I/O
+ */
+
+#include "bio.h"
+#include "test_macros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32 uvals[] = {
+    0, 1, 127, 128, 300, 16383, 16384, 0x7fffffff, 0xffffffff
+};
+static const int32 svals[] = {
+    0, -1, 1, -64, 64, -65, 1000000, -1000000, 0x7fffffff, -0x7fffffff - 1
+};
+#define N_UVALS (sizeof(uvals) / sizeof(uvals[0]))
+#define N_SVALS (sizeof(svals) / sizeof(svals[0]))
+
+int
+main(int argc, char *argv[])
+{
+	FILE *fp;
+	uint32 wsum, rsum, u;
+	int32 s;
+	size_t i;
+
+	TEST_ASSERT(fp = tmpfile());
+	wsum = 0;
+	TEST_EQUAL(1, bio_fwrite_varint(127, fp, &wsum));
+	TEST_EQUAL(2, bio_fwrite_varint(128, fp, &wsum));
+	TEST_EQUAL(5, bio_fwrite_varint(0xffffffff, fp, &wsum));
+	TEST_EQUAL(1, bio_fwrite_svarint(-64, fp, &wsum));
+	TEST_EQUAL(2, bio_fwrite_svarint(-65, fp, &wsum));
+	for (i = 0; i < N_UVALS; ++i)
+		TEST_ASSERT(bio_fwrite_varint(uvals[i], fp, &wsum) > 0);
+	for (i = 0; i < N_SVALS; ++i)
+		TEST_ASSERT(bio_fwrite_svarint(svals[i], fp, &wsum) > 0);
+
+	rewind(fp);
+	rsum = 0;
+	TEST_EQUAL(1, bio_fread_varint(&u, fp, &rsum));
+	TEST_EQUAL(127, u);
+	TEST_EQUAL(2, bio_fread_varint(&u, fp, &rsum));
+	TEST_EQUAL(128, u);
+	TEST_EQUAL(5, bio_fread_varint(&u, fp, &rsum));
+	TEST_EQUAL(0xffffffff, u);
+	TEST_EQUAL(1, bio_fread_svarint(&s, fp, &rsum));
+	TEST_EQUAL(-64, s);
+	TEST_EQUAL(2, bio_fread_svarint(&s, fp, &rsum));
+	TEST_EQUAL(-65, s);
+	for (i = 0; i < N_UVALS; ++i) {
+		TEST_ASSERT(bio_fread_varint(&u, fp, &rsum) > 0);
+		TEST_EQUAL(uvals[i], u);
+	}
+	for (i = 0; i < N_SVALS; ++i) {
+		TEST_ASSERT(bio_fread_svarint(&s, fp, &rsum) > 0);
+		TEST_EQUAL(svals[i], s);
+	}
+	TEST_EQUAL(wsum, rsum);
+	/* End of file. */
+	TEST_EQUAL(-1, bio_fread_varint(&u, fp, &rsum));
+	fclose(fp);
+
+	return 0;
+}
@@ -57,6 +57,9 @@ extern "C" {
 #include <sphinxbase/prim_type.h>
 #include <s3/quest.h>
 
+void
+best_q_set_nthreads(uint32 n_thread);
+
 float64
 best_q(float32 ****mixw,
        float32 ****means,
@@ -55,6 +55,7 @@ extern "C" {
 #endif
 
 #include <sphinxbase/prim_type.h>
+#include <sphinxbase/feat.h>
 #include <s3/vector.h>
 #include <s3/acmod_set.h>
 #include <s3/s3phseg_io.h>
@@ -174,6 +175,8 @@ char *
 corpus_utt_brief_name(void);
 char *
 corpus_utt(void);
+char *
+corpus_utt_key(void);
 
 int32
 corpus_provides_sent(void);
@@ -201,6 +204,20 @@ corpus_get_generic_featurevec(vector_t **mfc,
                               int32 *n_frame,
                               uint32 veclen);
 
+/* feature cache configuration function */
+int
+corpus_set_featcache(const char *fn,
+		     feat_t *fcb);
+
+int
+corpus_get_feat(feat_t *fcb,
+		uint32 veclen,
+		int32 min_n_frame,
+		int32 max_n_frame,
+		mfcc_t ****out_feat,
+		int32 *out_n_frame_in,
+		int32 *out_n_frame);
+
 int
 corpus_get_sildel(uint32 **sf,
 		  uint32 **ef,
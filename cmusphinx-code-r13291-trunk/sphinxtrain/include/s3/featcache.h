@@ -0,0 +1,96 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: featcache.h
+ * 
+ * Description: 
+ *	A cache of computed feature vectors.  One file holds the
+ *	output of feat_s2mfc2feat_live() for every utterance of a
+ *	corpus, plus an index from utterance to data, so training
+ *	passes can map it instead of reading cepstra and computing
+ *	CMN, AGC, dynamic features and LDA again.
+ * 
+ *********************************************************************/
+
+#ifndef FEATCACHE_H
+#define FEATCACHE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/feat.h>
+
+typedef struct featcache_s featcache_t;
+typedef struct featcache_writer_s featcache_writer_t;
+
+featcache_t *
+featcache_read(const char *fn,
+	       feat_t *fcb);
+
+int
+featcache_get(featcache_t *fc,
+	      feat_t *fcb,
+	      const char *key,
+	      mfcc_t ****out_feat,
+	      int32 *out_n_frame_in,
+	      int32 *out_n_frame);
+
+void
+featcache_free(featcache_t *fc);
+
+featcache_writer_t *
+featcache_writer_open(const char *fn,
+		      feat_t *fcb);
+
+int
+featcache_writer_add(featcache_writer_t *w,
+		     const char *key,
+		     mfcc_t ***feat,
+		     int32 n_frame_in,
+		     int32 n_frame);
+
+int
+featcache_writer_close(featcache_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FEATCACHE_H */
@@ -61,6 +61,19 @@ extern "C" {
 
 #include <stdio.h>
 
+/* Number of densities scored together by the blocked kernels */
+#define GAUDEN_BLK 4
+
+/* Scores one block of GAUDEN_BLK diagonal densities into out[].
+ * Returns zero if the whole block fell below worst early. */
+typedef int (*gauden_blk_eval_t)(float64 *out,
+				 vector_t obs,
+				 uint32 veclen,
+				 const float32 *mean,
+				 const float64 *var,
+				 const float64 *norm,
+				 float64 worst);
+
 typedef struct gauden_s {
     uint32 n_feat;
     uint32 *veclen;
@@ -83,6 +96,17 @@ typedef struct gauden_s {
     vector_t ***l_vacc;
     vector_t ****l_fullvacc;
     float32  ***l_dnom;
+
+    /* Blocked copy of mean, var and norm built by gauden_blk_init():
+     * for each codebook and feature, GAUDEN_BLK densities are stored
+     * contiguously for each dimension, padded to a whole block. */
+    uint32 n_blk;
+    float32 ***blk_mean;
+    float64 ***blk_var;
+    float64 ***blk_norm;
+    void *blk_buf;
+    gauden_blk_eval_t blk_full;	/* all densities */
+    gauden_blk_eval_t blk_topn;	/* top N with early exit */
 } gauden_t;
 
 #define MAX_LOG_DEN	10.0
@@ -302,6 +326,12 @@ gauden_norm_wt_fullvar(vector_t ****in_var,
 int
 gauden_eval_precomp(gauden_t *g);
 
+int
+gauden_blk_init(gauden_t *g);
+
+void
+gauden_blk_free(gauden_t *g);
+
 int
 gauden_var_thresh_percentile(vector_t ***var,
 			     float32 **var_thresh,
@@ -0,0 +1,123 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: s3accpack_io.h
+ * 
+ * Description: 
+ *	A single binary container for all of the reestimation
+ *	accumulators of one bw part.  The container is written in
+ *	native byte order, each section is aligned and checksummed,
+ *	so that norm can memory-map many parts and sum them in place.
+ * 
+ *********************************************************************/
+
+#ifndef S3ACCPACK_IO_H
+#define S3ACCPACK_IO_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/mmio.h>
+
+#include <stddef.h>
+
+/* Name of the container inside an accumulator directory */
+#define ACCPACK_FILE		"accum_counts"
+
+/* Sections of the container, in file order */
+#define ACCPACK_VECLEN		0
+#define ACCPACK_MIXW		1
+#define ACCPACK_TMAT		2
+#define ACCPACK_MEAN		3
+#define ACCPACK_VAR		4
+#define ACCPACK_DNOM		5
+#define ACCPACK_N_SECT		6
+
+/* Header flags; bit i set means section i is present */
+#define ACCPACK_HAS(s)		(1U << (s))
+#define ACCPACK_FULLVAR		(1U << 8)
+#define ACCPACK_PASS2VAR	(1U << 9)
+
+typedef struct accpack_s {
+    uint32 flags;
+
+    uint32 n_mixw;		/* mixing weight accumulators */
+    uint32 n_mixw_stream;
+    uint32 n_mixw_density;
+
+    uint32 n_tmat;		/* transition matrix accumulators */
+    uint32 n_state_pm;
+
+    uint32 n_mgau;		/* density accumulators */
+    uint32 n_feat;
+    uint32 n_density;
+
+    /* Contiguous section data.  The 32-bit elements are laid out as
+       by ckd_calloc_3d() and gauden_alloc_param(), i.e. the first
+       element of each accumulator array (e.g. mixw_acc[0][0]). */
+    const void *sect[ACCPACK_N_SECT];
+    uint32 chksum[ACCPACK_N_SECT];
+
+    mmio_file_t *mf;		/* set for mapped containers */
+} accpack_t;
+
+size_t
+s3accpack_n_elem(const accpack_t *pk,
+		 int sect);
+
+int
+s3accpack_write(const char *fn,
+		accpack_t *pk);
+
+accpack_t *
+s3accpack_map(const char *fn);
+
+int
+s3accpack_verify(const accpack_t *pk,
+		 int sect);
+
+void
+s3accpack_free(accpack_t *pk);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* S3ACCPACK_IO_H */
@@ -77,11 +77,17 @@ mkdir ($unprunedtreedir,0777);
 
 my $state = 0;
 my $return_value = 0;
-while ( $state < $ST::CFG_STATESPERHMM) {
-    if ($return_value = BuildTree ($phone,$state)) {
-        last;
+if ($phone eq 'ALLTREES') {
+    # All states of all phones in one bldtree run
+    $return_value = BuildTree ($phone);
+}
+else {
+    while ( $state < $ST::CFG_STATESPERHMM) {
+	if ($return_value = BuildTree ($phone,$state)) {
+	    last;
+	}
+	$state++;
     }
-    $state++;
 }
 
 exit $return_value;
@@ -93,9 +99,11 @@ sub BuildTree
     my $phn = shift;
     my $stt = shift;
 
-    my $logfile = "$logdir/${ST::CFG_EXPTNAME}.buildtree.${phn}.${stt}.log";
+    my $logfile = defined($stt)
+	? "$logdir/${ST::CFG_EXPTNAME}.buildtree.${phn}.${stt}.log"
+	: "$logdir/${ST::CFG_EXPTNAME}.buildtree.${phn}.log";
 
-    Log("${phn} ${stt} ", 'result');
+    Log(defined($stt) ? "${phn} ${stt} " : "${phn} ", 'result');
 
     # RAH 7.21.2000 - These were other possible values for these
     # variables, I'm not sure the circumstance that would dictate
@@ -137,18 +145,29 @@ sub BuildTree
     if ($ST::CFG_CROSS_PHONE_TREES eq 'yes') {
 	@phnflag = (-allphones => 'yes');
     }
-    else {
+    elsif ($phn ne 'ALLTREES') {
 	@phnflag = (-phone => $phn);
     }
+
+    # Without a state, bldtree writes <phone>-<state>.dtree for all
+    # of them itself
+    my @treeflag;
+    if (defined($stt)) {
+	@treeflag = (-treefn => "$unprunedtreedir/$phn-$stt.dtree",
+		     -state => $stt);
+    }
+    else {
+	@treeflag = (-treedir => $unprunedtreedir,
+		     -nthreads => $ST::CFG_NPART);
+    }
     return RunTool('bldtree', $logfile, 0,
-		   -treefn => "$unprunedtreedir/$phn-$stt.dtree",
+		   @treeflag,
 		   -moddeffn => "$mdef_file",
 		   -mixwfn => "$mixture_wt_file",
 		   -ts2cbfn => $ST::CFG_HMM_TYPE,
 		   -mwfloor => 1e-8,
 		   -psetfn => $ST::CFG_QUESTION_SET,
 		   @phnflag,
-		   -state => $stt,
 		   -stwt => join(",", @stwt),
 		   @gauflag,
 		   -ssplitmin => 1,
@@ -92,20 +92,18 @@ mkdir ($unprunedtreedir,0777);
 
 # For every phone submit each possible state
 my @jobs;
-if ($ST::CFG_CROSS_PHONE_TREES eq 'yes') {
+if ($ST::CFG_QUEUE_TYPE eq "Queue" or $ST::CFG_QUEUE_TYPE eq "Queue::POSIX") {
+    # On this machine a single bldtree reads the models once and
+    # builds all the trees, $CFG_NPART at a time
+    Log("Processing all phones and states in one run\n", 'result');
+    push @jobs, ['ALLTREES' => LaunchScript("tree.all", ['buildtree.pl', 'ALLTREES'])];
+} elsif ($ST::CFG_CROSS_PHONE_TREES eq 'yes') {
     Log("Processing all phones with each state\n", 'result');
     push @jobs, ['ALLPHONES' => LaunchScript("tree.all", ['buildtree.pl', 'ALLPHONES'])];
 } else {
     Log ("Processing each phone with each state\n", 'result');
     open INPUT,"${ST::CFG_RAWPHONEFILE}";
     foreach $phone (<INPUT>) {
-	if ($ST::CFG_QUEUE_TYPE eq "Queue::POSIX") {
-	    # Use @jobs as a queue (better than nothing for Queue::POSIX)
-	    if (@jobs > $ST::CFG_NPART) {
-		my ($p, $j) = @{shift @jobs};
-		WaitForScript($j);
-	    }
-	}
 	$phone = Trim($phone);
 	if (($phone =~ m/^(\+).*(\+)$/) || ($phone =~ m/^SIL$/)) {
 	    Log ("Skipping $phone\n", 'result');
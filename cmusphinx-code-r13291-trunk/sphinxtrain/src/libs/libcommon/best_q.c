@@ -46,6 +46,7 @@
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/sbthread.h>
 
 #include <s3/best_q.h>
 #include <s3/metric.h>
@@ -55,126 +56,160 @@
 #include <stdio.h>
 #include <string.h>
 
-float64
-best_q(float32 ****mixw,
-       float32 ****means,
-       float32 ****vars,
-       uint32  *veclen,
-       uint32 n_model,
-       uint32 n_state,
-       uint32 n_stream,
-       uint32 n_density,
-       float32 *stwt,
-       uint32 **dfeat,
-       uint32 n_dfeat,
-       quest_t *all_q,
-       uint32 n_all_q,
-       pset_t *pset,
-       uint32 *id,
-       uint32 n_id,
-       float32 ***dist,
-       float64 node_wt_ent,  /* Weighted entropy of node */
-       quest_t **out_best_q)
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/* Below this many accumulated elements (questions x models x
+ * statistics per model) a node is not worth starting threads for. */
+#define BEST_Q_MIN_PAR_WORK	(1 << 20)
+
+static uint32 best_q_n_thread = 1;
+
+/* What every question evaluated for a node needs to know */
+typedef struct best_q_node_s {
+    float32 ****mixw;
+    uint32 *veclen;
+    uint32 n_state;
+    uint32 n_stream;
+    uint32 n_density;
+    uint32 sumveclen;
+    float32 *stwt;
+    uint32 **dfeat;
+    uint32 n_dfeat;
+    quest_t *all_q;
+    uint32 *id;
+    uint32 n_id;
+    float32 ***dist;
+    float64 node_wt_ent;
+    uint32 continuous;
+    float32 varfloor;
+
+    uint32 n_dist_elem;	/* n_state * n_stream * n_density */
+    uint32 n_gau_elem;	/* n_state * n_stream * sumveclen */
+    uint32 n_elem;	/* length of the yes/no accumulators */
+
+    /* For continuous models, the statistics each model adds to the
+       yes or no side, laid out like the accumulators: mixture weight
+       counts, then weighted means, then weighted second moments */
+    float32 *row;
+} best_q_node_t;
+
+/* A range of questions to evaluate, and the best among them */
+typedef struct best_q_part_s {
+    best_q_node_t *node;
+    uint32 q_s;		/* first question */
+    uint32 q_e;		/* one past the last question */
+    float64 b_einc;
+    int32 b_q;		/* -1 if none of them splits the node */
+} best_q_part_t;
+
+/*
+ * Sets the number of threads best_q() may spread the questions for a
+ * node over.
+ */
+void
+best_q_set_nthreads(uint32 n_thread)
+{
+    best_q_n_thread = (n_thread > 0) ? n_thread : 1;
+}
+
+/*
+ * a[k] += b[k].  Each element is a single float addition, so the
+ * vector path gives exactly the same sums as the scalar one.
+ */
+static void
+vec_acc(float32 *a, const float32 *b, uint32 n)
+{
+    uint32 k = 0;
+
+#if defined(__SSE__)
+    for (; k + 4 <= n; k += 4) {
+	_mm_storeu_ps(a + k, _mm_add_ps(_mm_loadu_ps(a + k),
+					_mm_loadu_ps(b + k)));
+    }
+#endif
+    for (; k < n; k++)
+	a[k] += b[k];
+}
+
+static void
+best_q_eval(best_q_part_t *part)
 {
+    best_q_node_t *nd = part->node;
+    float32 *yes_buf, *no_buf, *acc;
     float32 ***yes_dist;
     float32 ***yes_means=0;
     float32 ***yes_vars=0;
-    float32 varfloor=0;
     float64 y_ent;
     float64 yes_dnom, yes_norm;
-    uint32 *yes_id;
     float32 ***no_dist;
     float32 ***no_means=0;
     float32 ***no_vars=0;
     float64 n_ent;
     float64 no_dnom, no_norm;
-    uint32 *no_id;
-    uint32 n_yes, n_b_yes = 0;
-    uint32 n_no, n_b_no = 0;
-    uint32 i, j, k, q, b_q=0, s;
+    uint32 n_yes, n_no;
+    uint32 i, j, k, q, s;
     uint32 ii;
-    float64 einc, b_einc = -1.0e+50;
-
-    const char*  type;
-    uint32 continuous, sumveclen=0;
-
-    type = cmd_ln_str("-ts2cbfn");
-    if (strcmp(type,".semi.")!=0 && strcmp(type,".cont.") != 0)
-        E_FATAL("Type %s unsupported; trees can only be built on types .semi. or .cont.\n",type);
-    if (strcmp(type,".cont.") == 0)
-        continuous = 1;
-    else
-        continuous = 0;
-
-    if (continuous == 1) {
-        varfloor = cmd_ln_float32("-varfloor");
-        /* Allocating for sumveclen is overallocation, but it eases coding */
-        for (ii=0,sumveclen=0;ii<n_stream;ii++) sumveclen += veclen[ii];
-        yes_means = (float32 ***)ckd_calloc_3d(n_state,n_stream,sumveclen,sizeof(float32));
-        yes_vars = (float32 ***)ckd_calloc_3d(n_state,n_stream,sumveclen,sizeof(float32));
-        no_means = (float32 ***)ckd_calloc_3d(n_state,n_stream,sumveclen,sizeof(float32));
-        no_vars = (float32 ***)ckd_calloc_3d(n_state,n_stream,sumveclen,sizeof(float32));
+    uint32 n_state = nd->n_state;
+    uint32 n_stream = nd->n_stream;
+    uint32 n_density = nd->n_density;
+    uint32 *veclen = nd->veclen;
+    float32 varfloor = nd->varfloor;
+    float64 einc;
+
+    yes_buf = (float32 *)ckd_calloc(nd->n_elem, sizeof(float32));
+    no_buf = (float32 *)ckd_calloc(nd->n_elem, sizeof(float32));
+
+    yes_dist = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, n_density,
+					     yes_buf, sizeof(float32));
+    no_dist = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, n_density,
+					    no_buf, sizeof(float32));
+    if (nd->continuous == 1) {
+        yes_means = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, nd->sumveclen,
+						  yes_buf + nd->n_dist_elem,
+						  sizeof(float32));
+        yes_vars = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, nd->sumveclen,
+						 yes_buf + nd->n_dist_elem + nd->n_gau_elem,
+						 sizeof(float32));
+        no_means = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, nd->sumveclen,
+						 no_buf + nd->n_dist_elem,
+						 sizeof(float32));
+        no_vars = (float32 ***)ckd_alloc_3d_ptr(n_state, n_stream, nd->sumveclen,
+						no_buf + nd->n_dist_elem + nd->n_gau_elem,
+						sizeof(float32));
     }
 
-    n_yes = n_no = 0;
+    part->b_einc = -1.0e+50;
+    part->b_q = -1;
 
-    yes_dist = (float32 ***)ckd_calloc_3d(n_state, n_stream, n_density, sizeof(float32));
-    no_dist = (float32 ***)ckd_calloc_3d(n_state, n_stream, n_density, sizeof(float32));
-
-    for (q = 0; q < n_all_q; q++) {
-	memset(&yes_dist[0][0][0], 0, sizeof(float32) * n_state * n_stream * n_density);
-	memset(&no_dist[0][0][0], 0, sizeof(float32) * n_state * n_stream * n_density);
-
-        if (continuous == 1) {
-	    memset(&yes_means[0][0][0], 0, sizeof(float32) * n_state * n_stream * sumveclen);
-	    memset(&yes_vars[0][0][0], 0, sizeof(float32) * n_state * n_stream * sumveclen);
-	    memset(&no_means[0][0][0], 0, sizeof(float32) * n_state * n_stream * sumveclen);
-	    memset(&no_vars[0][0][0], 0, sizeof(float32) * n_state * n_stream * sumveclen);
-        }
+    for (q = part->q_s; q < part->q_e; q++) {
+	memset(yes_buf, 0, sizeof(float32) * nd->n_elem);
+	memset(no_buf, 0, sizeof(float32) * nd->n_elem);
 
 	n_yes = n_no = 0;
 
-	for (ii = 0; ii < n_id; ii++) {
-	    i = id[ii];
-	    if (eval_quest(&all_q[q], dfeat[i], n_dfeat)) {
-	        for (s = 0; s < n_state; s++) {
-		    for (j = 0; j < n_stream; j++) {
-			for (k = 0; k < n_density; k++) {
-			    yes_dist[s][j][k] += mixw[i][s][j][k];
-			}
-		    }
-		}
-                if (continuous == 1) {
-	            for (s = 0; s < n_state; s++) {
-		        for (j = 0; j < n_stream; j++) {
-			    for (k = 0; k < veclen[j]; k++) {
-                                yes_means[s][j][k] += mixw[i][s][j][0] * means[i][s][j][k];
-                                yes_vars[s][j][k] += mixw[i][s][j][0] * (vars[i][s][j][k] + means[i][s][j][k]*means[i][s][j][k]);
-			    }
-		        }
-		    }
-		}
+	for (ii = 0; ii < nd->n_id; ii++) {
+	    i = nd->id[ii];
+	    if (eval_quest(&nd->all_q[q], nd->dfeat[i], nd->n_dfeat)) {
+		acc = yes_buf;
 		++n_yes;
 	    }
+	    else {
+		acc = no_buf;
+		++n_no;
+	    }
+
+	    if (nd->continuous == 1) {
+		vec_acc(acc, nd->row + (size_t)ii * nd->n_elem, nd->n_elem);
+	    }
 	    else {
 		for (s = 0; s < n_state; s++) {
 		    for (j = 0; j < n_stream; j++) {
-			for (k = 0; k < n_density; k++) {
-			    no_dist[s][j][k] += mixw[i][s][j][k];
-			}
-		    }
-		}
-                if (continuous == 1) {
-	            for (s = 0; s < n_state; s++) {
-		        for (j = 0; j < n_stream; j++) {
-			    for (k = 0; k < veclen[j]; k++) {
-                                no_means[s][j][k] += mixw[i][s][j][0] * means[i][s][j][k];
-                                no_vars[s][j][k] += mixw[i][s][j][0] * (vars[i][s][j][k] + means[i][s][j][k]*means[i][s][j][k]);
-			    }
-		        }
+			vec_acc(acc, nd->mixw[i][s][j], n_density);
+			acc += n_density;
 		    }
 		}
-		++n_no;
 	    }
 	}
 	
@@ -215,7 +250,7 @@ best_q(float32 ****mixw,
 		}
 	    }
 
-            if (continuous == 1) {
+            if (nd->continuous == 1) {
                 y_ent = 0;
                 n_ent = 0;
 	        for (j = 0; j < n_stream; j++) {
@@ -238,17 +273,17 @@ best_q(float32 ****mixw,
                     y_ent +=  yes_dnom * ent_cont(yes_means[s][j],yes_vars[s][j],veclen[j]);
                     n_ent +=  no_dnom * ent_cont(no_means[s][j],no_vars[s][j],veclen[j]);
                 }
-                einc += (float64)stwt[s] * (y_ent + n_ent);
+                einc += (float64)nd->stwt[s] * (y_ent + n_ent);
             }
             else {
-	        einc += (float64)stwt[s] * wt_ent_inc(yes_dist[s], yes_dnom,
+	        einc += (float64)nd->stwt[s] * wt_ent_inc(yes_dist[s], yes_dnom,
 	    				     no_dist[s], no_dnom,
-					     dist[s], n_stream, n_density);
+					     nd->dist[s], n_stream, n_density);
             }
 	}
 
-        if (continuous == 1) {
-            einc -=  node_wt_ent;
+        if (nd->continuous == 1) {
+            einc -=  nd->node_wt_ent;
         }
 
 	if (s < n_state) {
@@ -256,64 +291,174 @@ best_q(float32 ****mixw,
 	  continue;
 	}
 	
-	if (einc > b_einc) {
-	    b_einc = einc;
-	    b_q = q;
-	    n_b_yes = n_yes;
-	    n_b_no = n_no;
+	if (einc > part->b_einc) {
+	    part->b_einc = einc;
+	    part->b_q = q;
 	}
     }
 
-    if ((n_b_yes == 0) || (n_b_no == 0)) {
-	/* No best question */
-	*out_best_q = NULL;
-
-	return 0;
+    ckd_free_3d_ptr((void ***)yes_dist);
+    ckd_free_3d_ptr((void ***)no_dist);
+    if (nd->continuous == 1) {
+        ckd_free_3d_ptr((void ***)yes_means);
+        ckd_free_3d_ptr((void ***)yes_vars);
+        ckd_free_3d_ptr((void ***)no_means);
+        ckd_free_3d_ptr((void ***)no_vars);
     }
+    ckd_free(yes_buf);
+    ckd_free(no_buf);
+}
+
+static int
+best_q_thread(sbthread_t *th)
+{
+    best_q_eval((best_q_part_t *)sbthread_arg(th));
 
-    yes_id = (uint32 *)ckd_calloc(n_b_yes, sizeof(uint32));
-    no_id  = (uint32 *)ckd_calloc(n_b_no, sizeof(uint32));
+    return 0;
+}
 
-    memset(&yes_dist[0][0][0], 0, sizeof(float32) * n_state * n_stream * n_density);
-    memset(&no_dist[0][0][0], 0, sizeof(float32) * n_state * n_stream * n_density);
-    n_yes = n_no = 0;
+/*
+ * Finds the simple question that best splits the models id[] of a
+ * node.  Each question adds every model's statistics to its yes or
+ * no side; for continuous models those statistics are computed once
+ * per node into one row per model so this is a single vector add.
+ * With best_q_set_nthreads() > 1, large nodes have their questions
+ * split over threads.  Either way the answer is the first question
+ * with the largest entropy decrease, exactly as in a single pass.
+ */
+float64
+best_q(float32 ****mixw,
+       float32 ****means,
+       float32 ****vars,
+       uint32  *veclen,
+       uint32 n_model,
+       uint32 n_state,
+       uint32 n_stream,
+       uint32 n_density,
+       float32 *stwt,
+       uint32 **dfeat,
+       uint32 n_dfeat,
+       quest_t *all_q,
+       uint32 n_all_q,
+       pset_t *pset,
+       uint32 *id,
+       uint32 n_id,
+       float32 ***dist,
+       float64 node_wt_ent,  /* Weighted entropy of node */
+       quest_t **out_best_q)
+{
+    best_q_node_t nd;
+    best_q_part_t *part;
+    sbthread_t **th;
+    uint32 n_part, p;
+    uint32 i, j, k, s;
+    uint32 ii;
+    int32 b_q;
+    float64 b_einc;
 
-    for (ii = 0; ii < n_id; ii++) {
-	i = id[ii];
-	if (eval_quest(&all_q[b_q], dfeat[i], n_dfeat)) {
+    const char*  type;
+
+    memset(&nd, 0, sizeof(nd));
+
+    type = cmd_ln_str("-ts2cbfn");
+    if (strcmp(type,".semi.")!=0 && strcmp(type,".cont.") != 0)
+        E_FATAL("Type %s unsupported; trees can only be built on types .semi. or .cont.\n",type);
+    if (strcmp(type,".cont.") == 0)
+        nd.continuous = 1;
+    else
+        nd.continuous = 0;
+
+    nd.mixw = mixw;
+    nd.veclen = veclen;
+    nd.n_state = n_state;
+    nd.n_stream = n_stream;
+    nd.n_density = n_density;
+    nd.stwt = stwt;
+    nd.dfeat = dfeat;
+    nd.n_dfeat = n_dfeat;
+    nd.all_q = all_q;
+    nd.id = id;
+    nd.n_id = n_id;
+    nd.dist = dist;
+    nd.node_wt_ent = node_wt_ent;
+
+    nd.n_dist_elem = n_state * n_stream * n_density;
+    nd.n_elem = nd.n_dist_elem;
+
+    if (nd.continuous == 1) {
+        nd.varfloor = cmd_ln_float32("-varfloor");
+        /* Allocating for sumveclen is overallocation, but it eases coding */
+        for (ii=0,nd.sumveclen=0;ii<n_stream;ii++) nd.sumveclen += veclen[ii];
+	nd.n_gau_elem = n_state * n_stream * nd.sumveclen;
+	nd.n_elem += 2 * nd.n_gau_elem;
+
+	nd.row = (float32 *)ckd_calloc((size_t)n_id * nd.n_elem, sizeof(float32));
+	for (ii = 0; ii < n_id; ii++) {
+	    float32 *r = nd.row + (size_t)ii * nd.n_elem;
+
+	    i = id[ii];
 	    for (s = 0; s < n_state; s++) {
 		for (j = 0; j < n_stream; j++) {
+		    float32 *r_dist = r + (s * n_stream + j) * n_density;
+		    float32 *r_mean = r + nd.n_dist_elem + (s * n_stream + j) * nd.sumveclen;
+		    float32 *r_var = r_mean + nd.n_gau_elem;
+
 		    for (k = 0; k < n_density; k++) {
-			yes_dist[s][j][k] += mixw[i][s][j][k];
+			r_dist[k] = mixw[i][s][j][k];
 		    }
-		}
-	    }
-	    yes_id[n_yes] = i;
-	    ++n_yes;
-	}
-	else {
-	    for (s = 0; s < n_state; s++) {
-		for (j = 0; j < n_stream; j++) {
-		    for (k = 0; k < n_density; k++) {
-			no_dist[s][j][k] += mixw[i][s][j][k];
+		    for (k = 0; k < veclen[j]; k++) {
+			r_mean[k] = mixw[i][s][j][0] * means[i][s][j][k];
+			r_var[k] = mixw[i][s][j][0] * (vars[i][s][j][k] + means[i][s][j][k]*means[i][s][j][k]);
 		    }
 		}
 	    }
-	    no_id[n_no] = i;
-	    ++n_no;
 	}
     }
-    
-    ckd_free_3d((void ***)yes_dist);
-    ckd_free((void *)yes_id);
-    ckd_free_3d((void ***)no_dist);
-    ckd_free((void *)no_id);
 
-    if (continuous == 1) {
-        ckd_free_3d((void ***)yes_means);
-        ckd_free_3d((void ***)yes_vars);
-        ckd_free_3d((void ***)no_means);
-        ckd_free_3d((void ***)no_vars);
+    n_part = 1;
+    if ((best_q_n_thread > 1) &&
+	((float64)n_all_q * n_id * nd.n_elem >= BEST_Q_MIN_PAR_WORK)) {
+	n_part = (best_q_n_thread < n_all_q) ? best_q_n_thread : n_all_q;
+    }
+
+    part = (best_q_part_t *)ckd_calloc(n_part, sizeof(best_q_part_t));
+    th = (sbthread_t **)ckd_calloc(n_part, sizeof(sbthread_t *));
+    for (p = 0; p < n_part; p++) {
+	part[p].node = &nd;
+	part[p].q_s = (uint32)((uint64)p * n_all_q / n_part);
+	part[p].q_e = (uint32)((uint64)(p + 1) * n_all_q / n_part);
+    }
+    for (p = 1; p < n_part; p++) {
+	if ((th[p] = sbthread_start(cmd_ln_get(), best_q_thread, &part[p])) == NULL)
+	    best_q_eval(&part[p]);
+    }
+    best_q_eval(&part[0]);
+
+    /* Take the parts in question order, so ties go to the first
+       question as in a single pass */
+    b_q = -1;
+    b_einc = -1.0e+50;
+    for (p = 0; p < n_part; p++) {
+	if (th[p]) {
+	    sbthread_wait(th[p]);
+	    sbthread_free(th[p]);
+	}
+	if ((part[p].b_q >= 0) && (part[p].b_einc > b_einc)) {
+	    b_einc = part[p].b_einc;
+	    b_q = part[p].b_q;
+	}
+    }
+
+    ckd_free(th);
+    ckd_free(part);
+    if (nd.row)
+	ckd_free(nd.row);
+
+    if (b_q < 0) {
+	/* No best question */
+	*out_best_q = NULL;
+
+	return 0;
     }
 
     *out_best_q = &all_q[b_q];
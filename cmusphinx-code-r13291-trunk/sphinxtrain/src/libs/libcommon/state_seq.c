@@ -427,6 +427,73 @@ state_seq_free(state_t *s,
 
     return S3_SUCCESS;
 }
+
+/*********************************************************************
+ *
+ * Function: state_seq_copy
+ *
+ * Description:
+ *    state_seq_make() returns storage which is reused by the next
+ *    call.  This routine makes a private copy of a state sequence,
+ *    with the next and prior state lists packed into single
+ *    allocations the way state_seq_free() expects.
+ *
+ *********************************************************************/
+
+state_t *
+state_seq_copy(state_t *state,
+	       uint32 n_state)
+{
+    state_t *s;
+    uint32 *next_state, *prior_state;
+    float32 *next_tprob, *prior_tprob;
+    uint32 i, total_next, total_prior;
+
+    for (i = 0, total_next = total_prior = 0; i < n_state; i++) {
+	total_next += state[i].n_next;
+	total_prior += state[i].n_prior;
+    }
+
+    s = ckd_calloc(n_state, sizeof(state_t));
+    next_state = ckd_calloc(total_next, sizeof(uint32));
+    next_tprob = ckd_calloc(total_next, sizeof(float32));
+    prior_state = ckd_calloc(total_prior, sizeof(uint32));
+    prior_tprob = ckd_calloc(total_prior, sizeof(float32));
+
+    for (i = 0; i < n_state; i++) {
+	s[i] = state[i];
+	if (s[i].n_next > 0) {
+	    memcpy(next_state, state[i].next_state,
+		   s[i].n_next * sizeof(uint32));
+	    memcpy(next_tprob, state[i].next_tprob,
+		   s[i].n_next * sizeof(float32));
+	    s[i].next_state = next_state;
+	    s[i].next_tprob = next_tprob;
+	    next_state += s[i].n_next;
+	    next_tprob += s[i].n_next;
+	}
+	else {
+	    s[i].next_state = NULL;
+	    s[i].next_tprob = NULL;
+	}
+	if (s[i].n_prior > 0) {
+	    memcpy(prior_state, state[i].prior_state,
+		   s[i].n_prior * sizeof(uint32));
+	    memcpy(prior_tprob, state[i].prior_tprob,
+		   s[i].n_prior * sizeof(float32));
+	    s[i].prior_state = prior_state;
+	    s[i].prior_tprob = prior_tprob;
+	    prior_state += s[i].n_prior;
+	    prior_tprob += s[i].n_prior;
+	}
+	else {
+	    s[i].prior_state = NULL;
+	    s[i].prior_tprob = NULL;
+	}
+    }
+
+    return s;
+}
 
 state_t *
 state_seq_make(uint32 *n_state,
@@ -74,6 +74,7 @@
 
 #include <s3/mllr_io.h>
 #include <s3/acmod_set.h>
+#include <s3/featcache.h>
 #include <s3/s3.h>
 
 #include <stdio.h>
@@ -187,6 +188,9 @@ static int32 requires_phseg = FALSE;
 
 #define UNTIL_EOF	0xffffffff
 
+/* Computed features, if a feature cache was given */
+static featcache_t *featcache = NULL;
+
 static uint32 sv_n_skip = 0;
 static uint32 sv_run_len = UNTIL_EOF;
 
@@ -1190,6 +1194,21 @@ char *corpus_utt_full_name()
     }
 }
 
+/* Identifies the current utterance in a feature cache: the control
+   file path, plus the frame range if there is one */
+char *corpus_utt_key()
+{
+    static char key[MAXPATHLEN+32];
+
+    if ((cur_ctl_sf == NO_FRAME) && (cur_ctl_ef == NO_FRAME))
+	return corpus_utt_full_name();
+
+    sprintf(key, "%.*s %u %u", MAXPATHLEN, corpus_utt_full_name(),
+	    cur_ctl_sf, cur_ctl_ef);
+
+    return key;
+}
+
 static char *
 mk_filename(uint32 type, char *rel_path)
 {
@@ -1368,6 +1387,81 @@ corpus_get_generic_featurevec(vector_t **mfc,
     return S3_SUCCESS;
 }
 
+int
+corpus_set_featcache(const char *fn,
+		     feat_t *fcb)
+{
+    if (featcache)
+	featcache_free(featcache);
+
+    if ((featcache = featcache_read(fn, fcb)) == NULL)
+	return S3_ERROR;
+
+    return S3_SUCCESS;
+}
+
+/*
+ * Gets the feature vectors of the current utterance, either from the
+ * feature cache or by reading the MFCC file and running it through
+ * feat_s2mfc2feat_live().  *out_n_frame_in is the number of MFCC
+ * frames.  If it is below min_n_frame or, when max_n_frame > 0, above
+ * max_n_frame, no features are computed (so live CMN/AGC state is left
+ * alone) and *out_feat is NULL.  Free *out_feat with feat_array_free().
+ */
+int
+corpus_get_feat(feat_t *fcb,
+		uint32 veclen,
+		int32 min_n_frame,
+		int32 max_n_frame,
+		mfcc_t ****out_feat,
+		int32 *out_n_frame_in,
+		int32 *out_n_frame)
+{
+    vector_t *mfcc;
+    int32 n_frame;
+
+    if (featcache) {
+	if (featcache_get(featcache, fcb, corpus_utt_key(),
+			  out_feat, out_n_frame_in, out_n_frame) == S3_SUCCESS) {
+	    n_frame = *out_n_frame_in;
+	    if ((n_frame < min_n_frame) ||
+		((max_n_frame > 0) && (n_frame > max_n_frame))) {
+		if (*out_feat)
+		    feat_array_free(*out_feat);
+		*out_feat = NULL;
+		*out_n_frame = 0;
+	    }
+	    return S3_SUCCESS;
+	}
+
+	E_WARN("%s is not in the feature cache\n", corpus_utt_key());
+    }
+
+    if (corpus_get_generic_featurevec(&mfcc, &n_frame, veclen) < 0)
+	return S3_ERROR;
+
+    *out_n_frame_in = n_frame;
+    if ((n_frame == 0) || (n_frame < min_n_frame) ||
+	((max_n_frame > 0) && (n_frame > max_n_frame))) {
+	if (mfcc) {
+	    ckd_free(mfcc[0]);
+	    ckd_free(mfcc);
+	}
+	*out_feat = NULL;
+	*out_n_frame = 0;
+	return S3_SUCCESS;
+    }
+
+    *out_feat = feat_array_alloc(fcb, n_frame + feat_window_size(fcb));
+    feat_s2mfc2feat_live(fcb, mfcc, &n_frame, TRUE, TRUE, *out_feat);
+    *out_n_frame = n_frame;
+
+    ckd_free(mfcc[0]);
+    ckd_free(mfcc);
+
+    return S3_SUCCESS;
+}
+
 int
 corpus_get_seg(uint16 **seg,
 	       int32 *n_seg)
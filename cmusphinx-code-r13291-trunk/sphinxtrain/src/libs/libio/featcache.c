@@ -0,0 +1,553 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: featcache.c
+ * 
+ * Description: 
+ *	Writing and memory-mapping of feature caches.
+ *
+ *	A cache is a header, the frames of each utterance (native
+ *	byte order, one row of feat_dimension() values per frame,
+ *	aligned to FEATCACHE_ALIGN), an index with one entry per
+ *	utterance and the utterance keys.  The header records the
+ *	feature setup, and a cache is only used with the same one.
+ * 
+ *********************************************************************/
+
+#include <s3/featcache.h>
+#include <s3/s3.h>
+
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/hash_table.h>
+#include <sphinxbase/mmio.h>
+#include <sphinxbase/err.h>
+
+#include <sys_compat/file.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FEATCACHE_MAGIC		"s3featc"
+#define FEATCACHE_BYTE_ORDER	0x11223344
+#define FEATCACHE_VERSION	1
+#define FEATCACHE_ALIGN		64
+#define FEATCACHE_DESC_LEN	512
+
+typedef struct featcache_hdr_s {
+    char magic[8];
+    uint32 byte_order;
+    uint32 version;
+    char desc[FEATCACHE_DESC_LEN];	/* see featcache_desc() */
+    uint32 dim;			/* # of values per frame */
+    uint32 n_utt;
+    uint64 index_off;		/* offset of the utterance index */
+    uint64 key_off;		/* offset of the utterance keys */
+    uint64 key_size;
+    uint32 reserved;
+    uint32 hdr_chksum;		/* over all preceding words */
+} featcache_hdr_t;
+
+typedef struct featcache_utt_s {
+    uint64 off;			/* offset of the first frame */
+    uint32 n_frame_in;		/* # of input cepstrum frames */
+    uint32 n_frame;		/* # of feature frames */
+    uint32 key;			/* offset of the key string */
+    uint32 reserved;
+} featcache_utt_t;
+
+struct featcache_s {
+    mmio_file_t *mf;
+    const char *base;
+    uint32 dim;
+    const featcache_utt_t *utt;
+    hash_table_t *idx;		/* key -> index entry */
+};
+
+struct featcache_writer_s {
+    FILE *fp;
+    char *fn;
+    char *tmp_fn;		/* renamed to fn when complete */
+    featcache_hdr_t hdr;
+    uint64 off;			/* current file offset */
+    featcache_utt_t *utt;
+    uint32 n_utt_alloc;
+    char *key;
+    size_t key_alloc;
+};
+
+static uint32
+featcache_chksum(const uint32 *buf, size_t n)
+{
+    uint32 sum = 0;
+    size_t i;
+
+    /* same rotate and add as the bio checksums */
+    for (i = 0; i < n; i++)
+	sum = (sum << 20 | sum >> 12) + buf[i];
+
+    return sum;
+}
+
+static uint32
+featcache_hdr_chksum(const featcache_hdr_t *hdr)
+{
+    return featcache_chksum((const uint32 *)hdr,
+			    offsetof(featcache_hdr_t, hdr_chksum)
+			    / sizeof(uint32));
+}
+
+static uint32
+featcache_dim(feat_t *fcb)
+{
+    uint32 j, dim;
+
+    for (j = 0, dim = 0; j < feat_dimension1(fcb); j++)
+	dim += feat_dimension2(fcb, j);
+
+    return dim;
+}
+
+/*
+ * Describes everything that goes into the cached vectors, so that a
+ * cache is never used with a different feature setup.  The LDA
+ * matrix and subvector specification are represented by checksums.
+ */
+static void
+featcache_desc(feat_t *fcb, char *desc)
+{
+    char *d;
+    uint32 j;
+    int32 *sv;
+
+    memset(desc, 0, FEATCACHE_DESC_LEN);
+    d = desc;
+    d += sprintf(d, "%.64s ceplen=%d cmn=%d varnorm=%d agc=%d",
+		 feat_name(fcb), feat_cepsize(fcb),
+		 fcb->cmn, fcb->varnorm, fcb->agc);
+    if (fcb->agc == AGC_NOISE)
+	d += sprintf(d, " agcthresh=%g", MFCC2FLOAT(fcb->agc_struct->noise_thresh));
+    if (fcb->lda) {
+	d += sprintf(d, " lda=%u/%08x", fcb->out_dim,
+		     featcache_chksum((const uint32 *)fcb->lda[0][0],
+				      fcb->out_dim * fcb->stream_len[0]));
+    }
+    if (fcb->subvecs) {
+	uint32 sum = 0;
+
+	for (j = 0; j < (uint32)fcb->n_sv; j++) {
+	    for (sv = fcb->subvecs[j]; *sv != -1; sv++)
+		sum = (sum << 20 | sum >> 12) + (uint32)*sv;
+	    sum = (sum << 20 | sum >> 12) + 0xffffffff;
+	}
+	d += sprintf(d, " sv=%08x", sum);
+    }
+    d += sprintf(d, " dims=");
+    for (j = 0; j < feat_dimension1(fcb)
+	     && d - desc < FEATCACHE_DESC_LEN - 16; j++)
+	d += sprintf(d, j ? ",%u" : "%u", feat_dimension2(fcb, j));
+}
+
+/*********************************************************************
+ *
+ * Function: featcache_read
+ * 
+ * Description: 
+ *	Maps the feature cache fn and indexes its utterances.  Fails
+ *	if the cache was built with a feature setup other than fcb.
+ *
+ * Return Values: 
+ *	The cache, or NULL on error.
+ *
+ *********************************************************************/
+featcache_t *
+featcache_read(const char *fn,
+	       feat_t *fcb)
+{
+    featcache_t *fc;
+    const featcache_hdr_t *hdr;
+    const featcache_utt_t *u;
+    const char *key;
+    char desc[FEATCACHE_DESC_LEN];
+    struct stat st;
+    uint64 size, end;
+    uint32 i;
+
+    if (stat(fn, &st) < 0) {
+	E_ERROR_SYSTEM("Unable to stat %s", fn);
+	return NULL;
+    }
+    size = st.st_size;
+    if (size < sizeof(featcache_hdr_t)) {
+	E_ERROR("%s is too short for a feature cache\n", fn);
+	return NULL;
+    }
+
+    fc = ckd_calloc(1, sizeof(*fc));
+    if ((fc->mf = mmio_file_read(fn)) == NULL) {
+	E_ERROR("Unable to map %s\n", fn);
+	goto error_out;
+    }
+    fc->base = mmio_file_ptr(fc->mf);
+    hdr = (const featcache_hdr_t *)fc->base;
+
+    if (strncmp(hdr->magic, FEATCACHE_MAGIC, sizeof(hdr->magic)) != 0) {
+	E_ERROR("%s is not a feature cache\n", fn);
+	goto error_out;
+    }
+    if (hdr->byte_order != FEATCACHE_BYTE_ORDER) {
+	E_ERROR("%s was written with a different byte order\n", fn);
+	goto error_out;
+    }
+    if (hdr->version != FEATCACHE_VERSION) {
+	E_ERROR("%s has version %u, expected %u\n",
+		fn, hdr->version, FEATCACHE_VERSION);
+	goto error_out;
+    }
+    if (hdr->hdr_chksum != featcache_hdr_chksum(hdr)) {
+	E_ERROR("Checksum error in header of %s\n", fn);
+	goto error_out;
+    }
+
+    featcache_desc(fcb, desc);
+    if (strncmp(hdr->desc, desc, FEATCACHE_DESC_LEN) != 0) {
+	E_ERROR("%s holds features '%.*s', but the current setup is '%s'\n",
+		fn, FEATCACHE_DESC_LEN, hdr->desc, desc);
+	goto error_out;
+    }
+    fc->dim = hdr->dim;
+
+    /* check the index and keys before trusting any offset in them */
+    if (hdr->index_off > size ||
+	(size - hdr->index_off) / sizeof(featcache_utt_t) < hdr->n_utt ||
+	hdr->key_off > size || size - hdr->key_off < hdr->key_size ||
+	(hdr->n_utt && (hdr->key_size == 0 ||
+			fc->base[hdr->key_off + hdr->key_size - 1] != '\0'))) {
+	E_ERROR("%s is truncated or corrupt\n", fn);
+	goto error_out;
+    }
+    fc->utt = (const featcache_utt_t *)(fc->base + hdr->index_off);
+    key = fc->base + hdr->key_off;
+
+    fc->idx = hash_table_new(hdr->n_utt, HASH_CASE_YES);
+    for (i = 0; i < hdr->n_utt; i++) {
+	u = &fc->utt[i];
+	end = u->off + (uint64)u->n_frame * fc->dim * sizeof(mfcc_t);
+	if (u->key >= hdr->key_size || end < u->off || end > hdr->index_off) {
+	    E_ERROR("%s has a corrupt index entry %u\n", fn, i);
+	    goto error_out;
+	}
+	/* the first of any duplicate keys wins */
+	hash_table_enter_int32(fc->idx, key + u->key, i);
+    }
+
+    E_INFO("Mapped %u utterances of %s from %s\n", hdr->n_utt, desc, fn);
+
+    return fc;
+
+error_out:
+    featcache_free(fc);
+    return NULL;
+}
+
+/*********************************************************************
+ *
+ * Function: featcache_get
+ * 
+ * Description: 
+ *	Copies the features of utterance key into a new array from
+ *	feat_array_alloc(), which callers free with feat_array_free().
+ *	Utterances with no frames give a NULL array.
+ *
+ * Return Values: 
+ *	S3_SUCCESS, or S3_ERROR if the utterance is not in the cache.
+ *
+ *********************************************************************/
+int
+featcache_get(featcache_t *fc,
+	      feat_t *fcb,
+	      const char *key,
+	      mfcc_t ****out_feat,
+	      int32 *out_n_frame_in,
+	      int32 *out_n_frame)
+{
+    const featcache_utt_t *u;
+    const mfcc_t *src;
+    mfcc_t ***feat;
+    int32 i, stride;
+
+    if (hash_table_lookup_int32(fc->idx, key, &i) < 0)
+	return S3_ERROR;
+    u = &fc->utt[i];
+
+    *out_n_frame_in = u->n_frame_in;
+    *out_n_frame = u->n_frame;
+    if (u->n_frame == 0) {
+	*out_feat = NULL;
+	return S3_SUCCESS;
+    }
+
+    feat = feat_array_alloc(fcb, u->n_frame);
+    src = (const mfcc_t *)(fc->base + u->off);
+
+    /* rows of feat_array_alloc() are sized for the features before
+       LDA and subvector projection */
+    for (i = 0, stride = 0; i < feat_n_stream(fcb); i++)
+	stride += feat_stream_len(fcb, i);
+    if (stride == (int32)fc->dim) {
+	memcpy(feat[0][0], src, u->n_frame * fc->dim * sizeof(mfcc_t));
+    }
+    else {
+	for (i = 0; i < (int32)u->n_frame; i++, src += fc->dim)
+	    memcpy(feat[i][0], src, fc->dim * sizeof(mfcc_t));
+    }
+    *out_feat = feat;
+
+    return S3_SUCCESS;
+}
+
+void
+featcache_free(featcache_t *fc)
+{
+    if (fc == NULL)
+	return;
+    if (fc->idx)
+	hash_table_free(fc->idx);
+    if (fc->mf)
+	mmio_file_unmap(fc->mf);
+    ckd_free(fc);
+}
+
+static int
+featcache_writer_pad(featcache_writer_t *w)
+{
+    static const char zero[FEATCACHE_ALIGN];
+    size_t pad;
+
+    pad = (FEATCACHE_ALIGN - w->off % FEATCACHE_ALIGN) % FEATCACHE_ALIGN;
+    if (fwrite(zero, 1, pad, w->fp) != pad)
+	return S3_ERROR;
+    w->off += pad;
+
+    return S3_SUCCESS;
+}
+
+/*********************************************************************
+ *
+ * Function: featcache_writer_open
+ * 
+ * Description: 
+ *	Starts a feature cache for the feature setup fcb.  The cache
+ *	is written to a temporary file, which featcache_writer_close()
+ *	renames to fn.
+ *
+ *	Features from live CMN or from AGC_EMAX depend on the
+ *	utterances processed before them, so they cannot be cached.
+ *
+ * Return Values: 
+ *	The writer, or NULL on error.
+ *
+ *********************************************************************/
+featcache_writer_t *
+featcache_writer_open(const char *fn,
+		      feat_t *fcb)
+{
+    featcache_writer_t *w;
+
+    if (fcb->cmn == CMN_LIVE || fcb->agc == AGC_EMAX) {
+	E_ERROR("Features with live CMN or AGC_EMAX cannot be cached\n");
+	return NULL;
+    }
+
+    w = ckd_calloc(1, sizeof(*w));
+    w->fn = ckd_salloc(fn);
+    w->tmp_fn = ckd_calloc(strlen(fn) + 5, 1);
+    sprintf(w->tmp_fn, "%s.tmp", fn);
+
+    strcpy(w->hdr.magic, FEATCACHE_MAGIC);
+    w->hdr.byte_order = FEATCACHE_BYTE_ORDER;
+    w->hdr.version = FEATCACHE_VERSION;
+    featcache_desc(fcb, w->hdr.desc);
+    w->hdr.dim = featcache_dim(fcb);
+
+    if ((w->fp = fopen(w->tmp_fn, "wb")) == NULL) {
+	E_ERROR_SYSTEM("Unable to open %s for writing", w->tmp_fn);
+	goto error_out;
+    }
+
+    /* the header is rewritten once the index is known */
+    if (fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1) {
+	E_ERROR_SYSTEM("Unable to write %s", w->tmp_fn);
+	goto error_out;
+    }
+    w->off = sizeof(w->hdr);
+
+    return w;
+
+error_out:
+    if (w->fp) {
+	fclose(w->fp);
+	unlink(w->tmp_fn);
+    }
+    ckd_free(w->fn);
+    ckd_free(w->tmp_fn);
+    ckd_free(w);
+    return NULL;
+}
+
+/*********************************************************************
+ *
+ * Function: featcache_writer_add
+ * 
+ * Description: 
+ *	Appends the n_frame feature vectors in feat (as produced by
+ *	feat_s2mfc2feat_live() from n_frame_in cepstra) under key.
+ *
+ * Return Values: 
+ *	S3_SUCCESS or S3_ERROR.
+ *
+ *********************************************************************/
+int
+featcache_writer_add(featcache_writer_t *w,
+		     const char *key,
+		     mfcc_t ***feat,
+		     int32 n_frame_in,
+		     int32 n_frame)
+{
+    featcache_utt_t *u;
+    size_t len;
+    int32 i;
+
+    if (featcache_writer_pad(w) != S3_SUCCESS)
+	goto error_out;
+
+    if (w->hdr.n_utt == w->n_utt_alloc) {
+	w->n_utt_alloc = w->n_utt_alloc ? 2 * w->n_utt_alloc : 1024;
+	w->utt = ckd_realloc(w->utt, w->n_utt_alloc * sizeof(*w->utt));
+    }
+    len = strlen(key) + 1;
+    while (w->hdr.key_size + len > w->key_alloc) {
+	w->key_alloc = w->key_alloc ? 2 * w->key_alloc : 65536;
+	w->key = ckd_realloc(w->key, w->key_alloc);
+    }
+
+    u = &w->utt[w->hdr.n_utt];
+    memset(u, 0, sizeof(*u));
+    u->off = w->off;
+    u->n_frame_in = n_frame_in;
+    u->n_frame = n_frame;
+    u->key = (uint32)w->hdr.key_size;
+
+    for (i = 0; i < n_frame; i++) {
+	if (fwrite(feat[i][0], sizeof(mfcc_t), w->hdr.dim, w->fp)
+	    != w->hdr.dim)
+	    goto error_out;
+    }
+    w->off += (uint64)n_frame * w->hdr.dim * sizeof(mfcc_t);
+
+    memcpy(w->key + w->hdr.key_size, key, len);
+    w->hdr.key_size += len;
+    ++w->hdr.n_utt;
+
+    return S3_SUCCESS;
+
+error_out:
+    E_ERROR_SYSTEM("Unable to write %s", w->tmp_fn);
+    return S3_ERROR;
+}
+
+/*********************************************************************
+ *
+ * Function: featcache_writer_close
+ * 
+ * Description: 
+ *	Writes the index and keys, completes the header and moves
+ *	the cache into place.  The writer is freed in any case.
+ *
+ * Return Values: 
+ *	S3_SUCCESS or S3_ERROR.
+ *
+ *********************************************************************/
+int
+featcache_writer_close(featcache_writer_t *w)
+{
+    int rv = S3_ERROR;
+
+    if (featcache_writer_pad(w) != S3_SUCCESS)
+	goto error_out;
+    w->hdr.index_off = w->off;
+    if (fwrite(w->utt, sizeof(*w->utt), w->hdr.n_utt, w->fp)
+	!= w->hdr.n_utt)
+	goto error_out;
+    w->hdr.key_off = w->off + w->hdr.n_utt * sizeof(*w->utt);
+    if (fwrite(w->key, 1, w->hdr.key_size, w->fp) != w->hdr.key_size)
+	goto error_out;
+
+    w->hdr.hdr_chksum = featcache_hdr_chksum(&w->hdr);
+    if (fseek(w->fp, 0, SEEK_SET) < 0 ||
+	fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1)
+	goto error_out;
+
+    if (fclose(w->fp) != 0) {
+	w->fp = NULL;
+	goto error_out;
+    }
+    w->fp = NULL;
+
+    if (rename(w->tmp_fn, w->fn) < 0) {
+	E_ERROR_SYSTEM("Unable to rename %s to %s", w->tmp_fn, w->fn);
+	goto free_out;
+    }
+    E_INFO("Wrote %u utterances to %s\n", w->hdr.n_utt, w->fn);
+    rv = S3_SUCCESS;
+    goto free_out;
+
+error_out:
+    E_ERROR_SYSTEM("Unable to write %s", w->tmp_fn);
+free_out:
+    if (w->fp)
+	fclose(w->fp);
+    if (rv != S3_SUCCESS)
+	unlink(w->tmp_fn);
+    ckd_free(w->utt);
+    ckd_free(w->key);
+    ckd_free(w->fn);
+    ckd_free(w->tmp_fn);
+    ckd_free(w);
+
+    return rv;
+}
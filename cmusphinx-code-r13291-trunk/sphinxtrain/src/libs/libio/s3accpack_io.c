@@ -0,0 +1,378 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: s3accpack_io.c
+ * 
+ * Description: 
+ *	Writing and memory-mapping of the packed accumulator container.
+ *
+ *	The container is a fixed header followed by the accumulator
+ *	sections in the order given in s3accpack_io.h.  Every section
+ *	starts on an ACCPACK_ALIGN boundary and holds 32-bit elements
+ *	in the in-memory layout of the accumulators, so a mapped
+ *	container can be used in place.  No byte swapping is done;
+ *	containers are meant to be produced and consumed on the same
+ *	cluster.
+ * 
+ *********************************************************************/
+
+#include <s3/s3accpack_io.h>
+#include <s3/s3.h>
+
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+
+#include <sys_compat/file.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define ACCPACK_MAGIC		"s3accpk"
+#define ACCPACK_BYTE_ORDER	0x11223344
+#define ACCPACK_VERSION		1
+#define ACCPACK_ALIGN		64
+
+typedef struct accpack_hdr_s {
+    char magic[8];
+    uint32 byte_order;
+    uint32 version;
+    uint32 flags;
+    uint32 dim[8];
+    uint32 chksum[ACCPACK_N_SECT];
+    uint32 hdr_chksum;		/* over all preceding words */
+} accpack_hdr_t;
+
+#define ACCPACK_HDR_SIZE \
+    ((sizeof(accpack_hdr_t) + ACCPACK_ALIGN - 1) & ~(size_t)(ACCPACK_ALIGN - 1))
+
+static size_t
+accpack_pad(size_t n_byte)
+{
+    return (n_byte + ACCPACK_ALIGN - 1) & ~(size_t)(ACCPACK_ALIGN - 1);
+}
+
+static uint32
+accpack_chksum(const uint32 *buf, size_t n)
+{
+    uint32 sum = 0;
+    size_t i;
+
+    /* same rotate and add as the bio checksums */
+    for (i = 0; i < n; i++)
+	sum = (sum << 20 | sum >> 12) + buf[i];
+
+    return sum;
+}
+
+/*********************************************************************
+ *
+ * Function: s3accpack_n_elem
+ * 
+ * Description: 
+ *	Returns the number of 32-bit elements in section sect, or zero
+ *	if the section is not present.  The mean and variance sizes
+ *	depend on the veclen section, so it must be set first.
+ *
+ *********************************************************************/
+size_t
+s3accpack_n_elem(const accpack_t *pk,
+		 int sect)
+{
+    const uint32 *veclen;
+    size_t blk;
+    uint32 j;
+
+    if (!(pk->flags & ACCPACK_HAS(sect)))
+	return 0;
+
+    switch (sect) {
+    case ACCPACK_VECLEN:
+	return pk->n_feat;
+    case ACCPACK_MIXW:
+	return (size_t)pk->n_mixw * pk->n_mixw_stream * pk->n_mixw_density;
+    case ACCPACK_TMAT:
+	return (size_t)pk->n_tmat * (pk->n_state_pm - 1) * pk->n_state_pm;
+    case ACCPACK_DNOM:
+	return (size_t)pk->n_mgau * pk->n_feat * pk->n_density;
+    }
+
+    veclen = (const uint32 *)pk->sect[ACCPACK_VECLEN];
+    for (j = 0, blk = 0; j < pk->n_feat; j++)
+	blk += veclen[j];
+
+    /* full covariances use the gauden_alloc_param_full() buffer,
+       which is sized for a single blksize x blksize block */
+    if (sect == ACCPACK_VAR && (pk->flags & ACCPACK_FULLVAR))
+	blk *= blk;
+
+    return (size_t)pk->n_mgau * pk->n_density * blk;
+}
+
+static void
+accpack_hdr_dim(accpack_hdr_t *hdr, const accpack_t *pk)
+{
+    hdr->dim[0] = pk->n_mixw;
+    hdr->dim[1] = pk->n_mixw_stream;
+    hdr->dim[2] = pk->n_mixw_density;
+    hdr->dim[3] = pk->n_tmat;
+    hdr->dim[4] = pk->n_state_pm;
+    hdr->dim[5] = pk->n_mgau;
+    hdr->dim[6] = pk->n_feat;
+    hdr->dim[7] = pk->n_density;
+}
+
+/*********************************************************************
+ *
+ * Function: s3accpack_write
+ * 
+ * Description: 
+ *	Writes the sections flagged in pk->flags to fn and sets
+ *	pk->chksum.  The data are written as is; callers apply the
+ *	flooring done by the s3*_write() routines beforehand.
+ *
+ * Return Values: 
+ *	S3_SUCCESS or S3_ERROR.
+ *
+ *********************************************************************/
+int
+s3accpack_write(const char *fn,
+		accpack_t *pk)
+{
+    static const char zero[ACCPACK_ALIGN];
+    accpack_hdr_t hdr;
+    FILE *fp;
+    size_t n, pad;
+    int s;
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, ACCPACK_MAGIC);
+    hdr.byte_order = ACCPACK_BYTE_ORDER;
+    hdr.version = ACCPACK_VERSION;
+    hdr.flags = pk->flags;
+    accpack_hdr_dim(&hdr, pk);
+    for (s = 0; s < ACCPACK_N_SECT; s++) {
+	n = s3accpack_n_elem(pk, s);
+	pk->chksum[s] = n ? accpack_chksum(pk->sect[s], n) : 0;
+	hdr.chksum[s] = pk->chksum[s];
+    }
+    hdr.hdr_chksum = accpack_chksum((uint32 *)&hdr,
+				    offsetof(accpack_hdr_t, hdr_chksum)
+				    / sizeof(uint32));
+
+    fp = fopen(fn, "wb");
+    if (fp == NULL) {
+	E_ERROR_SYSTEM("Unable to open %s for writing", fn);
+	return S3_ERROR;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(zero, 1, ACCPACK_HDR_SIZE - sizeof(hdr), fp)
+	!= ACCPACK_HDR_SIZE - sizeof(hdr))
+	goto error_out;
+
+    for (s = 0; s < ACCPACK_N_SECT; s++) {
+	n = s3accpack_n_elem(pk, s);
+	if (n == 0)
+	    continue;
+	pad = accpack_pad(n * sizeof(uint32)) - n * sizeof(uint32);
+	if (fwrite(pk->sect[s], sizeof(uint32), n, fp) != n ||
+	    fwrite(zero, 1, pad, fp) != pad)
+	    goto error_out;
+    }
+
+    if (fclose(fp) != 0) {
+	E_ERROR_SYSTEM("Unable to close %s", fn);
+	return S3_ERROR;
+    }
+
+    E_INFO("Wrote %s [flags 0x%x]\n", fn, pk->flags);
+
+    return S3_SUCCESS;
+
+error_out:
+    E_ERROR_SYSTEM("Unable to write %s", fn);
+    fclose(fp);
+
+    return S3_ERROR;
+}
+
+/*********************************************************************
+ *
+ * Function: s3accpack_map
+ * 
+ * Description: 
+ *	Memory-maps a container and sets up the section pointers.
+ *	The header and the veclen section are checked here, since
+ *	all other section sizes are derived from them; the remaining
+ *	sections are checked by s3accpack_verify().
+ *
+ * Return Values: 
+ *	The mapped container, or NULL on error.
+ *
+ *********************************************************************/
+accpack_t *
+s3accpack_map(const char *fn)
+{
+    accpack_t *pk;
+    const accpack_hdr_t *hdr;
+    const char *base;
+    struct stat st;
+    size_t off, n;
+    int s;
+
+    if (stat(fn, &st) < 0) {
+	E_ERROR_SYSTEM("Unable to stat %s", fn);
+	return NULL;
+    }
+    if ((size_t)st.st_size < ACCPACK_HDR_SIZE) {
+	E_ERROR("%s is too short for an accumulator container\n", fn);
+	return NULL;
+    }
+
+    pk = ckd_calloc(1, sizeof(*pk));
+    if ((pk->mf = mmio_file_read(fn)) == NULL) {
+	E_ERROR("Unable to map %s\n", fn);
+	goto error_out;
+    }
+    base = mmio_file_ptr(pk->mf);
+    hdr = (const accpack_hdr_t *)base;
+
+    if (strncmp(hdr->magic, ACCPACK_MAGIC, sizeof(hdr->magic)) != 0) {
+	E_ERROR("%s is not an accumulator container\n", fn);
+	goto error_out;
+    }
+    if (hdr->byte_order != ACCPACK_BYTE_ORDER) {
+	E_ERROR("%s was written with a different byte order\n", fn);
+	goto error_out;
+    }
+    if (hdr->version != ACCPACK_VERSION) {
+	E_ERROR("%s has version %u, expected %u\n",
+		fn, hdr->version, ACCPACK_VERSION);
+	goto error_out;
+    }
+    if (hdr->hdr_chksum !=
+	accpack_chksum((const uint32 *)hdr,
+		       offsetof(accpack_hdr_t, hdr_chksum) / sizeof(uint32))) {
+	E_ERROR("Checksum error in header of %s\n", fn);
+	goto error_out;
+    }
+
+    pk->flags = hdr->flags;
+    pk->n_mixw = hdr->dim[0];
+    pk->n_mixw_stream = hdr->dim[1];
+    pk->n_mixw_density = hdr->dim[2];
+    pk->n_tmat = hdr->dim[3];
+    pk->n_state_pm = hdr->dim[4];
+    pk->n_mgau = hdr->dim[5];
+    pk->n_feat = hdr->dim[6];
+    pk->n_density = hdr->dim[7];
+    memcpy(pk->chksum, hdr->chksum, sizeof(pk->chksum));
+
+    if ((pk->flags & ACCPACK_HAS(ACCPACK_TMAT)) && pk->n_state_pm == 0) {
+	E_ERROR("%s has transition matrices with no states\n", fn);
+	goto error_out;
+    }
+    if ((pk->flags & (ACCPACK_HAS(ACCPACK_MEAN) | ACCPACK_HAS(ACCPACK_VAR)))
+	&& !(pk->flags & ACCPACK_HAS(ACCPACK_VECLEN))) {
+	E_ERROR("%s has density accumulators but no vector lengths\n", fn);
+	goto error_out;
+    }
+
+    for (s = 0, off = ACCPACK_HDR_SIZE; s < ACCPACK_N_SECT; s++) {
+	n = s3accpack_n_elem(pk, s);
+	if (n == 0)
+	    continue;
+	if (off + n * sizeof(uint32) > (size_t)st.st_size) {
+	    E_ERROR("%s is truncated\n", fn);
+	    goto error_out;
+	}
+	pk->sect[s] = base + off;
+	off += accpack_pad(n * sizeof(uint32));
+
+	if (s == ACCPACK_VECLEN && !s3accpack_verify(pk, s)) {
+	    E_ERROR("Checksum error in vector lengths of %s\n", fn);
+	    goto error_out;
+	}
+    }
+    if (off != (size_t)st.st_size) {
+	E_ERROR("%s has %lu bytes, expected %lu\n",
+		fn, (unsigned long)st.st_size, (unsigned long)off);
+	goto error_out;
+    }
+
+    return pk;
+
+error_out:
+    s3accpack_free(pk);
+    return NULL;
+}
+
+/*********************************************************************
+ *
+ * Function: s3accpack_verify
+ * 
+ * Description: 
+ *	Recomputes the checksum of section sect.  Absent sections
+ *	always verify.  Safe to call on several sections or containers
+ *	from different threads.
+ *
+ * Return Values: 
+ *	TRUE if the checksum matches.
+ *
+ *********************************************************************/
+int
+s3accpack_verify(const accpack_t *pk,
+		 int sect)
+{
+    size_t n;
+
+    n = s3accpack_n_elem(pk, sect);
+    if (n == 0)
+	return TRUE;
+
+    return accpack_chksum(pk->sect[sect], n) == pk->chksum[sect];
+}
+
+void
+s3accpack_free(accpack_t *pk)
+{
+    if (pk == NULL)
+	return;
+    if (pk->mf)
+	mmio_file_unmap(pk->mf);
+    ckd_free(pk);
+}
@@ -127,6 +127,9 @@ gauden_free(gauden_t *g)
     if (g->norm)
 	ckd_free_3d((void ***)g->norm);
     g->norm = NULL;
+
+    /* free the blocked copy of the parameters (if any) */
+    gauden_blk_free(g);
     
     if (g->veclen)
 	ckd_free(g->veclen);
@@ -707,126 +710,346 @@ void gauden_free_param_full(vector_t ****p)
     ckd_free_4d((void ****)p);
 }
 
-#if 0
-static void
-dist_unrolled(float32 *out,
-	      uint32 *w_idx,
-	      uint32 n_top,
-	      uint32 n_density,
+/*
+ * Blocked density kernels.  Each one scores a block of GAUDEN_BLK
+ * densities laid out by gauden_blk_init(), i.e. mean[l * GAUDEN_BLK + k]
+ * is component l of the k'th density in the block.  The differences are
+ * taken in single precision and the rest is accumulated in double
+ * precision, in the same order as log_diag_eval() for the full kernels
+ * and log_topn_densities() for the top-N ones, so they give exactly the
+ * same densities as the unblocked code.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GAUDEN_HAVE_SSE2
+
+/* How many components to accumulate between early-exit checks. */
+#define GAUDEN_PRUNE_STRIDE 4
+
+static int
+blk_full_sse2(float64 *out,
+	      vector_t obs,
 	      uint32 veclen,
+	      const float32 *mean,
+	      const float64 *var,
+	      const float64 *norm,
+	      float64 worst)
+{
+    __m128d d0, d1;
+    uint32 l;
+
+    d0 = d1 = _mm_setzero_pd();
+    for (l = 0; l < veclen; l++) {
+	__m128 diff;
+	__m128d lo, hi;
+
+	diff = _mm_sub_ps(_mm_set1_ps(obs[l]), _mm_load_ps(mean));
+	lo = _mm_cvtps_pd(diff);
+	hi = _mm_cvtps_pd(_mm_movehl_ps(diff, diff));
+	d0 = _mm_add_pd(d0, _mm_mul_pd(_mm_mul_pd(_mm_load_pd(var), lo), lo));
+	d1 = _mm_add_pd(d1, _mm_mul_pd(_mm_mul_pd(_mm_load_pd(var + 2), hi), hi));
+	mean += GAUDEN_BLK;
+	var += GAUDEN_BLK;
+    }
+    _mm_storeu_pd(out, _mm_sub_pd(_mm_load_pd(norm), d0));
+    _mm_storeu_pd(out + 2, _mm_sub_pd(_mm_load_pd(norm + 2), d1));
+
+    return GAUDEN_BLK;
+}
+
+static int
+blk_topn_sse2(float64 *out,
 	      vector_t obs,
-	      vector_t *mean,
-	      vector_t *var,
-	      float32 *norm)
+	      uint32 veclen,
+	      const float32 *mean,
+	      const float64 *var,
+	      const float64 *norm,
+	      float64 worst)
 {
-    uint32 i, j, k;
-    vector_t m;
-    vector_t v;
-    vector_t o;
-    float32 diff;
-    float64 dist;
-    float32 worst;
-    
-    assert (n_top > 0);
-    assert (n_top <= n_density);
-    assert (n_density > 0);
-    assert (n_density < 4000000);
-    assert (veclen > 0);
-    assert (veclen < 4000000);
-    
-    for (i = 0; i < n_top; i++) {
-	out[i] = MIN_IEEE_NORM_NEG_FLOAT32;
+    __m128d d0, d1, w;
+    uint32 l;
+
+    d0 = _mm_load_pd(norm);
+    d1 = _mm_load_pd(norm + 2);
+    w = _mm_set1_pd(worst);
+    for (l = 0; l < veclen; l++) {
+	__m128 diff;
+	__m128d lo, hi;
+
+	diff = _mm_sub_ps(_mm_set1_ps(obs[l]), _mm_load_ps(mean));
+	lo = _mm_cvtps_pd(diff);
+	hi = _mm_cvtps_pd(_mm_movehl_ps(diff, diff));
+	d0 = _mm_sub_pd(d0, _mm_mul_pd(_mm_mul_pd(lo, lo), _mm_load_pd(var)));
+	d1 = _mm_sub_pd(d1, _mm_mul_pd(_mm_mul_pd(hi, hi), _mm_load_pd(var + 2)));
+	mean += GAUDEN_BLK;
+	var += GAUDEN_BLK;
+	if ((l % GAUDEN_PRUNE_STRIDE) == GAUDEN_PRUNE_STRIDE - 1
+	    && _mm_movemask_pd(_mm_or_pd(_mm_cmpgt_pd(d0, w),
+					 _mm_cmpgt_pd(d1, w))) == 0)
+	    break;
+    }
+    _mm_storeu_pd(out, d0);
+    _mm_storeu_pd(out + 2, d1);
+
+    return (l < veclen) ? 0 : GAUDEN_BLK;
+}
+
+/* AVX kernels, compiled for the target regardless of -march and only
+ * used if the CPU actually supports it. */
+#if (defined(__x86_64__) || defined(__i386__))				\
+    && (defined(__clang__)						\
+	|| (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define GAUDEN_HAVE_AVX
+
+__attribute__((target("avx")))
+static int
+blk_full_avx(float64 *out,
+	     vector_t obs,
+	     uint32 veclen,
+	     const float32 *mean,
+	     const float64 *var,
+	     const float64 *norm,
+	     float64 worst)
+{
+    __m256d d;
+    uint32 l;
+
+    d = _mm256_setzero_pd();
+    for (l = 0; l < veclen; l++) {
+	__m256d diff;
+
+	diff = _mm256_cvtps_pd(_mm_sub_ps(_mm_set1_ps(obs[l]),
+					  _mm_load_ps(mean)));
+	d = _mm256_add_pd(d, _mm256_mul_pd(_mm256_mul_pd(_mm256_load_pd(var),
+							 diff), diff));
+	mean += GAUDEN_BLK;
+	var += GAUDEN_BLK;
     }
+    _mm256_storeu_pd(out, _mm256_sub_pd(_mm256_load_pd(norm), d));
 
-    worst = out[n_top-1];
+    return GAUDEN_BLK;
+}
 
-    for (i = 0; i < n_density; i++) {
-	m = mean[i];
-	v = var[i];
-	o = obs;
-	
-	dist = norm[i];
+__attribute__((target("avx")))
+static int
+blk_topn_avx(float64 *out,
+	     vector_t obs,
+	     uint32 veclen,
+	     const float32 *mean,
+	     const float64 *var,
+	     const float64 *norm,
+	     float64 worst)
+{
+    __m256d d, w;
+    uint32 l;
 
-	j = veclen;
+    d = _mm256_load_pd(norm);
+    w = _mm256_set1_pd(worst);
+    for (l = 0; l < veclen; l++) {
+	__m256d diff;
 
-	if (j & 1) {
-	    diff = o[0] - m[0];
-	    dist -= (diff * diff) * (v[0]);
-	    o++;
-	    m++;
-	    v++;
-	    j--;
-	}
+	diff = _mm256_cvtps_pd(_mm_sub_ps(_mm_set1_ps(obs[l]),
+					  _mm_load_ps(mean)));
+	d = _mm256_sub_pd(d, _mm256_mul_pd(_mm256_mul_pd(diff, diff),
+					   _mm256_load_pd(var)));
+	mean += GAUDEN_BLK;
+	var += GAUDEN_BLK;
+	if ((l % GAUDEN_PRUNE_STRIDE) == GAUDEN_PRUNE_STRIDE - 1
+	    && _mm256_movemask_pd(_mm256_cmp_pd(d, w, _CMP_GT_OQ)) == 0)
+	    break;
+    }
+    _mm256_storeu_pd(out, d);
 
-	
-	if (j & 2) {
-	    diff = o[0] - m[0];
-	    dist -= (diff * diff) * (v[0]);
-	    diff = o[1] - m[1];
-	    dist -= (diff * diff) * (v[1]);
-	    o += 2;
-	    m += 2;
-	    v += 2;
-	    j -= 2;
+    return (l < veclen) ? 0 : GAUDEN_BLK;
+}
+#endif /* AVX */
+#endif /* SSE2 */
+
+#ifndef GAUDEN_HAVE_SSE2
+static int
+blk_full_scalar(float64 *out,
+		vector_t obs,
+		uint32 veclen,
+		const float32 *mean,
+		const float64 *var,
+		const float64 *norm,
+		float64 worst)
+{
+    float64 d, diff;
+    uint32 k, l;
+
+    for (k = 0; k < GAUDEN_BLK; k++) {
+	d = 0.0;
+	for (l = 0; l < veclen; l++) {
+	    diff = obs[l] - mean[l * GAUDEN_BLK + k];
+	    d += var[l * GAUDEN_BLK + k] * diff * diff;
 	}
-	
-	if (j & 4) {
-	    diff = o[0] - m[0];
-	    dist -= (diff * diff) * (v[0]);
-	    diff = o[1] - m[1];
-	    dist -= (diff * diff) * (v[1]);
-	    diff = o[2] - m[2];
-	    dist -= (diff * diff) * (v[2]);
-	    diff = o[3] - m[3];
-	    dist -= (diff * diff) * (v[3]);
-	    o += 4;
-	    m += 4;
-	    v += 4;
-	    j -= 4;
-	}
-
-	while ((j > 0) && (dist > worst)) {
-	    diff = o[0] - m[0];
-	    dist -= (diff * diff) * (v[0]);
-	    diff = o[1] - m[1];
-	    dist -= (diff * diff) * (v[1]);
-	    diff = o[2] - m[2];
-	    dist -= (diff * diff) * (v[2]);
-	    diff = o[3] - m[3];
-	    dist -= (diff * diff) * (v[3]);
-	    
-	    diff = o[4] - m[4];
-	    dist -= (diff * diff) * (v[4]);
-	    diff = o[5] - m[5];
-	    dist -= (diff * diff) * (v[5]);
-	    diff = o[6] - m[6];
-	    dist -= (diff * diff) * (v[6]);
-	    diff = o[7] - m[7];
-	    dist -= (diff * diff) * (v[7]);
-	    o += 8;
-	    m += 8;
-	    v += 8;
-	    j -= 8;
+	out[k] = norm[k] - d;
+    }
+
+    return GAUDEN_BLK;
+}
+
+static int
+blk_topn_scalar(float64 *out,
+		vector_t obs,
+		uint32 veclen,
+		const float32 *mean,
+		const float64 *var,
+		const float64 *norm,
+		float64 worst)
+{
+    float64 d, diff;
+    uint32 k, l;
+    int n_live;
+
+    n_live = 0;
+    for (k = 0; k < GAUDEN_BLK; k++) {
+	d = norm[k];
+	for (l = 0; (l < veclen) && (d > worst); l++) {
+	    diff = obs[l] - mean[l * GAUDEN_BLK + k];
+	    d -= diff * diff * var[l * GAUDEN_BLK + k];
 	}
-	
-	if (dist > worst) {
-	    for (j = 0; j < n_top; j++)
-		if (out[j] > dist)
-		    break;
-	    
-	    for (k = n_top-1; k > j; k--) {
-		out[k] = out[k-1];
-		w_idx[k] = w_idx[k-1];
+	out[k] = d;
+	if (d > worst)
+	    ++n_live;
+    }
+
+    return n_live;
+}
+#endif /* !SSE2 */
+
+static const char *
+gauden_blk_select(gauden_t *g)
+{
+#ifdef GAUDEN_HAVE_AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+	g->blk_full = &blk_full_avx;
+	g->blk_topn = &blk_topn_avx;
+	return "AVX";
+    }
+#endif
+#ifdef GAUDEN_HAVE_SSE2
+    g->blk_full = &blk_full_sse2;
+    g->blk_topn = &blk_topn_sse2;
+    return "SSE2";
+#else
+    g->blk_full = &blk_full_scalar;
+    g->blk_topn = &blk_topn_scalar;
+    return "scalar";
+#endif
+}
+
+void
+gauden_blk_free(gauden_t *g)
+{
+    if (g->blk_mean)
+	ckd_free_2d((void **)g->blk_mean);
+    if (g->blk_var)
+	ckd_free_2d((void **)g->blk_var);
+    if (g->blk_norm)
+	ckd_free_2d((void **)g->blk_norm);
+    ckd_free(g->blk_buf);
+
+    g->blk_mean = NULL;
+    g->blk_var = NULL;
+    g->blk_norm = NULL;
+    g->blk_buf = NULL;
+    g->n_blk = 0;
+}
+
+/*********************************************************************
+ *
+ * Function: 
+ * 	gauden_blk_init
+ *
+ * Description: 
+ *	Builds the blocked copy of the means, precomputed variances and
+ *	normalization terms which gauden_compute() and
+ *	gauden_compute_log() use when it is present.  This has to be
+ *	called after gauden_eval_precomp() and after any other change
+ *	to the parameters, since the copy is not kept in sync.
+ *	Full covariance densities are not blocked.
+ *
+ * Function Inputs: 
+ *	gauden_t *g -
+ *		The Gaussian density structure.
+ *
+ * Return Values: 
+ *	S3_SUCCESS
+ *
+ *********************************************************************/
+int
+gauden_blk_init(gauden_t *g)
+{
+    uint32 i, j, k, l, n_pad, blklen;
+    size_t n_dbl, n_flt;
+    float64 *dptr;
+    float32 *fptr;
+    const char *name;
+
+    gauden_blk_free(g);
+
+    if (g->fullvar)
+	return S3_SUCCESS;
+
+    g->n_blk = (g->n_density + GAUDEN_BLK - 1) / GAUDEN_BLK;
+    n_pad = g->n_blk * GAUDEN_BLK;
+    for (j = 0, blklen = 0; j < g->n_feat; j++)
+	blklen += g->veclen[j];
+
+    /* The variances and norms go first in one buffer aligned to a
+     * block of doubles, followed by the means.  Every array is a
+     * whole number of blocks long, so each block starts aligned. */
+    n_dbl = (size_t)g->n_mgau * n_pad * (blklen + g->n_feat);
+    n_flt = (size_t)g->n_mgau * n_pad * blklen;
+    g->blk_buf = ckd_calloc(n_dbl * sizeof(float64)
+			    + n_flt * sizeof(float32)
+			    + GAUDEN_BLK * sizeof(float64), 1);
+    dptr = (float64 *)(((size_t)g->blk_buf + GAUDEN_BLK * sizeof(float64) - 1)
+		       & ~(GAUDEN_BLK * sizeof(float64) - 1));
+    fptr = (float32 *)(dptr + n_dbl);
+
+    g->blk_mean = (float32 ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(float32 *));
+    g->blk_var = (float64 ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(float64 *));
+    g->blk_norm = (float64 ***)ckd_calloc_2d(g->n_mgau, g->n_feat, sizeof(float64 *));
+    for (i = 0; i < g->n_mgau; i++) {
+	for (j = 0; j < g->n_feat; j++) {
+	    uint32 veclen = g->veclen[j];
+
+	    g->blk_var[i][j] = dptr;
+	    dptr += (size_t)n_pad * veclen;
+	    g->blk_norm[i][j] = dptr;
+	    dptr += n_pad;
+	    g->blk_mean[i][j] = fptr;
+	    fptr += (size_t)n_pad * veclen;
+
+	    /* Padding densities keep a zero mean and variance and the
+	     * worst possible norm, so they never make the top N. */
+	    for (k = 0; k < n_pad; k++) {
+		size_t base = (size_t)(k / GAUDEN_BLK) * veclen * GAUDEN_BLK
+		    + k % GAUDEN_BLK;
+
+		if (k >= g->n_density) {
+		    g->blk_norm[i][j][k] = MIN_IEEE_NORM_NEG_FLOAT64;
+		    continue;
+		}
+		g->blk_norm[i][j][k] = g->norm[i][j][k];
+		for (l = 0; l < veclen; l++) {
+		    g->blk_mean[i][j][base + l * GAUDEN_BLK] = g->mean[i][j][k][l];
+		    g->blk_var[i][j][base + l * GAUDEN_BLK] = g->var[i][j][k][l];
+		}
 	    }
-	    
-	    out[k] = dist;
-	    w_idx[k] = i;
-	    
-	    worst = out[n_top-1];
 	}
     }
+
+    name = gauden_blk_select(g);
+    E_INFO("Using %s Gaussian density kernels\n", name);
+
+    return S3_SUCCESS;
 }
-#endif
 
 /* This is a most used function during the training. Be very careful
  * when you modify it */
@@ -989,27 +1212,22 @@ log_full_densities_full(float64 *den,
     }
 }
 
+/* Initialize topn using the previous frame's top codeword indices */
 static void
-log_topn_densities(float64 *den,
-		   uint32 *den_idx,
-		   uint32 n_top,
-		   uint32 n_density,
-		   uint32 veclen,
-		   vector_t obs,
-		   vector_t *mean,
-		   vector_t *var,
-		   float32 *log_norm,
-		   uint32 *prev_den_idx)
+log_topn_init(float64 *den,
+	      uint32 *den_idx,
+	      uint32 n_top,
+	      uint32 n_density,
+	      uint32 veclen,
+	      vector_t obs,
+	      vector_t *mean,
+	      vector_t *var,
+	      float32 *log_norm,
+	      uint32 *prev_den_idx)
 {
     uint32 i, j, k;
-    vector_t m;
-    vector_t v;
-    float64 diff;
     float64 d;
-    float64 worst;	/* worst density value of the top N density values
-			   seen so far */
 
-    /* Initialize topn using the previous frame's top codeword indices */
     if (prev_den_idx) {
 	for (j = 0; j < n_top; j++) {
 	    i = prev_den_idx[j];
@@ -1034,6 +1252,30 @@ log_topn_densities(float64 *den,
 	    den_idx[j] = n_density + 1; /* A non-negative invalid value */
 	}
     }
+}
+
+static void
+log_topn_densities(float64 *den,
+		   uint32 *den_idx,
+		   uint32 n_top,
+		   uint32 n_density,
+		   uint32 veclen,
+		   vector_t obs,
+		   vector_t *mean,
+		   vector_t *var,
+		   float32 *log_norm,
+		   uint32 *prev_den_idx)
+{
+    uint32 i, j, k;
+    vector_t m;
+    vector_t v;
+    float64 diff;
+    float64 d;
+    float64 worst;	/* worst density value of the top N density values
+			   seen so far */
+
+    log_topn_init(den, den_idx, n_top, n_density, veclen,
+		  obs, mean, var, log_norm, prev_den_idx);
 
     worst = den[n_top-1];
 
@@ -1072,6 +1314,97 @@ log_topn_densities(float64 *den,
     worst = den[n_top-1];
 }
 
+/* Same as log_full_densities() on the blocked parameters */
+static void
+blk_full_densities(float64 *den,
+		   uint32 *den_idx,
+		   gauden_t *g,
+		   uint32 mgau,
+		   uint32 feat,
+		   vector_t obs)
+{
+    float64 d[GAUDEN_BLK];
+    const float32 *mean = g->blk_mean[mgau][feat];
+    const float64 *var = g->blk_var[mgau][feat];
+    const float64 *norm = g->blk_norm[mgau][feat];
+    uint32 veclen = g->veclen[feat];
+    uint32 i, k, n;
+
+    for (i = 0; i < g->n_density; i += GAUDEN_BLK) {
+	(*g->blk_full)(d, obs, veclen, mean, var, norm + i,
+		       MIN_IEEE_NORM_NEG_FLOAT64);
+	mean += veclen * GAUDEN_BLK;
+	var += veclen * GAUDEN_BLK;
+
+	n = g->n_density - i;
+	if (n > GAUDEN_BLK)
+	    n = GAUDEN_BLK;
+	for (k = 0; k < n; k++) {
+	    den[i + k] = d[k];
+	    den_idx[i + k] = i + k;
+	}
+    }
+}
+
+/* Same as log_topn_densities() on the blocked parameters.  Since the
+ * partial sums only ever decrease, a block which falls below the
+ * worst of the top N early could not have made it at the end, so
+ * this gives the same top N as the unblocked code. */
+static void
+blk_topn_densities(float64 *den,
+		   uint32 *den_idx,
+		   gauden_t *g,
+		   uint32 mgau,
+		   uint32 feat,
+		   vector_t obs,
+		   uint32 *prev_den_idx)
+{
+    float64 d[GAUDEN_BLK];
+    const float32 *mean = g->blk_mean[mgau][feat];
+    const float64 *var = g->blk_var[mgau][feat];
+    const float64 *norm = g->blk_norm[mgau][feat];
+    uint32 veclen = g->veclen[feat];
+    uint32 n_top = g->n_top;
+    uint32 i, j, k, l, n;
+    float64 worst;
+
+    log_topn_init(den, den_idx, n_top, g->n_density, veclen, obs,
+		  g->mean[mgau][feat], g->var[mgau][feat],
+		  g->norm[mgau][feat], prev_den_idx);
+
+    worst = den[n_top-1];
+
+    for (i = 0; i < g->n_density; i += GAUDEN_BLK,
+	     mean += veclen * GAUDEN_BLK, var += veclen * GAUDEN_BLK) {
+	if ((*g->blk_topn)(d, obs, veclen, mean, var, norm + i, worst) == 0)
+	    continue;
+
+	n = g->n_density - i;
+	if (n > GAUDEN_BLK)
+	    n = GAUDEN_BLK;
+	for (l = 0; l < n; l++) {
+	    /* Not in topn, so keep going */
+	    if (d[l] <= worst)
+		continue;
+
+	    /* This may already have been in topn from the initialization pass */
+	    for (j = 0; j < n_top; j++)
+		if (den_idx[j] == i + l)
+		    break;
+	    if (j < n_top)
+		continue; /* It's already there, don't insert it */
+	    for (k = n_top-1; k > 0 && d[l] > den[k-1]; --k) {
+		den_idx[k] = den_idx[k-1];
+		den[k] = den[k-1];
+	    }
+	    den_idx[k] = i + l;
+	    den[k] = d[l];
+
+	    worst = den[n_top-1];
+	}
+    }
+}
+
 static void
 euclidean_dist(float64 *out,
 	       uint32 *w_idx,
@@ -1162,14 +1495,17 @@ gauden_compute(float64 **den,		/* density array for a mixture Gaussian */
     }
     else if (g->n_top == g->n_density) {
 	for (j = 0; j < g->n_feat; j++) {
-	    log_full_densities(den[j],
-			       den_idx[j],
-			       g->n_density,
-			       g->veclen[j],
-			       obs[j],
-			       g->mean[mgau][j],
-			       g->var[mgau][j],
-			       g->norm[mgau][j]);
+	    if (g->blk_mean)
+		blk_full_densities(den[j], den_idx[j], g, mgau, j, obs[j]);
+	    else
+		log_full_densities(den[j],
+				   den_idx[j],
+				   g->n_density,
+				   g->veclen[j],
+				   obs[j],
+				   g->mean[mgau][j],
+				   g->var[mgau][j],
+				   g->norm[mgau][j]);
 
 	    for (k = 0; k < g->n_density; k++) {
 		den[j][k] = exp( den[j][k] );
@@ -1180,16 +1516,20 @@ gauden_compute(float64 **den,		/* density array for a mixture Gaussian */
 	assert(g->n_top < g->n_density);
 
 	for (j = 0; j < g->n_feat; j++) {
-	    log_topn_densities(den[j],
-			       den_idx[j],
-			       g->n_top,
-			       g->n_density,
-			       g->veclen[j],
-			       obs[j],
-			       g->mean[mgau][j],
-			       g->var[mgau][j],
-			       g->norm[mgau][j],
-			       prev_den_idx ? prev_den_idx[j] : NULL);
+	    if (g->blk_mean)
+		blk_topn_densities(den[j], den_idx[j], g, mgau, j, obs[j],
+				   prev_den_idx ? prev_den_idx[j] : NULL);
+	    else
+		log_topn_densities(den[j],
+				   den_idx[j],
+				   g->n_top,
+				   g->n_density,
+				   g->veclen[j],
+				   obs[j],
+				   g->mean[mgau][j],
+				   g->var[mgau][j],
+				   g->norm[mgau][j],
+				   prev_den_idx ? prev_den_idx[j] : NULL);
 
 	    for (k = 0; k < g->n_top; k++) {
 		den[j][k] = exp( den[j][k] );
@@ -1236,30 +1576,37 @@ gauden_compute_log(float64 **den,		/* density array for a mixture Gaussian */
     }
     else if (g->n_top == g->n_density) {
 	for (j = 0; j < g->n_feat; j++) {
-	    log_full_densities(den[j],
-			       den_idx[j],
-			       g->n_density,
-			       g->veclen[j],
-			       obs[j],
-			       g->mean[mgau][j],
-			       g->var[mgau][j],
-			       g->norm[mgau][j]);
+	    if (g->blk_mean)
+		blk_full_densities(den[j], den_idx[j], g, mgau, j, obs[j]);
+	    else
+		log_full_densities(den[j],
+				   den_idx[j],
+				   g->n_density,
+				   g->veclen[j],
+				   obs[j],
+				   g->mean[mgau][j],
+				   g->var[mgau][j],
+				   g->norm[mgau][j]);
 	}
     }
     else {
 	assert(g->n_top < g->n_density);
 
 	for (j = 0; j < g->n_feat; j++) {
-	    log_topn_densities(den[j],
-			       den_idx[j],
-			       g->n_top,
-			       g->n_density,
-			       g->veclen[j],
-			       obs[j],
-			       g->mean[mgau][j],
-			       g->var[mgau][j],
-			       g->norm[mgau][j],
-			       prev_den_idx ? prev_den_idx[j] : NULL);
+	    if (g->blk_mean)
+		blk_topn_densities(den[j], den_idx[j], g, mgau, j, obs[j],
+				   prev_den_idx ? prev_den_idx[j] : NULL);
+	    else
+		log_topn_densities(den[j],
+				   den_idx[j],
+				   g->n_top,
+				   g->n_density,
+				   g->veclen[j],
+				   obs[j],
+				   g->mean[mgau][j],
+				   g->var[mgau][j],
+				   g->norm[mgau][j],
+				   prev_den_idx ? prev_den_idx[j] : NULL);
 	}
     }
 
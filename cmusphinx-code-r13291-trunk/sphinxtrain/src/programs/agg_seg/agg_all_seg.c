@@ -81,8 +81,8 @@ agg_all_seg(feat_t *fcb,
 	    uint32 stride)
 {
     uint32 seq_no;
-    vector_t *mfcc = NULL;
     uint32 mfc_veclen = cmd_ln_int32("-ceplen");
+    int32 n_frame_in;
     int32 n_frame;
     uint32 n_out_frame;
     uint32 blksz=0;
@@ -113,15 +113,14 @@ agg_all_seg(feat_t *fcb,
 
     for (seq_no = corpus_get_begin(), j = 0, n_out_frame = 0;
 	 corpus_next_utt(); seq_no++) {
-	    if (mfcc) {
-		free(mfcc[0]);
-		ckd_free(mfcc);
-
-		mfcc = NULL;
+	    if (feat) {
+		feat_array_free(feat);
+		feat = NULL;
 	    }
 
-	    /* get the MFCC data for the utterance */
-	    if (corpus_get_generic_featurevec(&mfcc, &n_frame, mfc_veclen) < 0) {
+	    /* get the features for the utterance */
+	    if (corpus_get_feat(fcb, mfc_veclen, 9, 0,
+				&feat, &n_frame_in, &n_frame) < 0) {
 	      E_FATAL("Can't read input features from %s\n", corpus_utt());
 	    }
 
@@ -129,24 +128,11 @@ agg_all_seg(feat_t *fcb,
 	    E_INFO("[%u]\n", seq_no);
 	}
 
-	    if (feat) {
-		feat_array_free(feat);
-		feat = NULL;
-	    }
-	    
-	    if (n_frame < 9) {
+	    if (n_frame_in < 9) {
 	      E_WARN("utt %s too short\n", corpus_utt());
-	      if (mfcc) {
-		ckd_free(mfcc[0]);
-		ckd_free(mfcc);
-		mfcc = NULL;
-	      }
 	      continue;
 	    }
 
-	    feat = feat_array_alloc(fcb, n_frame + feat_window_size(fcb));
-	    feat_s2mfc2feat_live(fcb, mfcc, &n_frame, TRUE, TRUE, feat);
-
 	    for (t = feat_window_size(fcb); t < n_frame - feat_window_size(fcb); t++, j++) {
 		if ((j % stride) == 0) {
 		    while (bio_fwrite(&feat[t][0][0],
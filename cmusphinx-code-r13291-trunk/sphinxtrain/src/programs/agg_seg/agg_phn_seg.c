@@ -66,8 +66,8 @@ agg_phn_seg(lexicon_t *lex,
 	    segdmp_type_t type)
 {
     uint16 *seg;
-    vector_t *mfcc;
     vector_t **feat;
+    int32 n_frame_in;
     int32 n_frame;
     uint32 tick_cnt;
 
@@ -155,23 +155,16 @@ agg_phn_seg(lexicon_t *lex,
 	}
 	
 	if (corpus_provides_mfcc()) {
-    	        if (corpus_get_generic_featurevec(&mfcc, &n_frame, mfc_veclen) < 0) {
+    	        if (corpus_get_feat(fcb, mfc_veclen, 9, 0,
+				    &feat, &n_frame_in, &n_frame) < 0) {
 		      E_FATAL("Can't read input features from %s\n", corpus_utt());
 		}
 		
-		if (n_frame < 9) {
+		if (n_frame_in < 9) {
 		  E_WARN("utt %s too short\n", corpus_utt());
-		  if (mfcc) {
-		    ckd_free(mfcc[0]);
-		    ckd_free(mfcc);
-		    mfcc = NULL;
-		  }
 		  continue;
 		}
 
-		feat = feat_array_alloc(fcb, n_frame + feat_window_size(fcb));
-	        feat_s2mfc2feat_live(fcb, mfcc, &n_frame, TRUE, TRUE, feat);
-
 		for (s = 0; s < n_phone; s++) {
 		    segdmp_add_feat(phone[s],
 				    &feat[start[s]],
@@ -179,8 +172,6 @@ agg_phn_seg(lexicon_t *lex,
 		}
 
 		feat_array_free(feat);
-		free(&mfcc[0][0]);
-		ckd_free(mfcc);
 	}
 	else {
 	    E_FATAL("No data type specified\n");
@@ -137,7 +137,7 @@ agg_st_seg(model_def_t *mdef,
 	   segdmp_type_t type)
 {
     uint32 seq_no;
-    vector_t *mfcc = NULL;
+    int32 n_frame_in;
     int32 n_frame;
     vector_t **feat = NULL;
     uint32 *sseq = NULL;
@@ -162,14 +162,13 @@ agg_st_seg(model_def_t *mdef,
 	    E_INFOCONT(" [%u]", seq_no);
 	}
 	
-	    if (mfcc) {
-		free(mfcc[0]);
-		ckd_free(mfcc);
-
-		mfcc = NULL;
+	    if (feat) {
+		feat_array_free(feat);
+		feat = NULL;
 	    }
 
-	    if (corpus_get_generic_featurevec(&mfcc, &n_frame, mfc_veclen) < 0) {
+	    if (corpus_get_feat(fcb, mfc_veclen, 9, 0,
+				&feat, &n_frame_in, &n_frame) < 0) {
 	      E_FATAL("Can't read input features from %s\n", corpus_utt());
 	    }
 
@@ -180,35 +179,18 @@ agg_st_seg(model_def_t *mdef,
 	}
 
 	/* read transcript and convert it into a senone sequence */
-	sseq = get_sseq(mdef, lex, n_frame);
+	sseq = get_sseq(mdef, lex, n_frame_in);
 	if (sseq == NULL) {
 	    E_WARN("senone sequence not produced; skipping.\n");
 
-	    free(mfcc[0]);
-	    ckd_free((void *)mfcc);
-	    feat_array_free(feat);
-
 	    continue;
 	}
-	
-	    if (feat) {
-		feat_array_free(feat);
-		feat = NULL;
-	    }
 
-	    if (n_frame < 9) {
+	    if (n_frame_in < 9) {
 	      E_WARN("utt %s too short\n", corpus_utt());
-	      if (mfcc) {
-		ckd_free(mfcc[0]);
-		ckd_free(mfcc);
-		mfcc = NULL;
-	      }
 	      continue;
 	    }
 
-	    feat = feat_array_alloc(fcb, n_frame + feat_window_size(fcb));
-	    feat_s2mfc2feat_live(fcb, mfcc, &n_frame, TRUE, TRUE, feat);
-
 	    if (corpus_has_xfrm()) {
 		if (a) {
 		    for (i = 0; i < n_mllr_cls; i++) {
@@ -255,13 +237,6 @@ agg_st_seg(model_def_t *mdef,
 	    }
     }
     
-    if (mfcc) {
-	free(mfcc[0]);
-	ckd_free(mfcc);
-	
-	mfcc = NULL;
-    }
-
     if (feat) {
 	feat_array_free(feat);
 	feat = NULL;
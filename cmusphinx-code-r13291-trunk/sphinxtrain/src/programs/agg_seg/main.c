@@ -281,6 +281,11 @@ initialize(lexicon_t **out_lex,
 	}
     }
 
+    if (cmd_ln_str("-featcachefn") &&
+	corpus_set_featcache(cmd_ln_str("-featcachefn"), feat) != S3_SUCCESS) {
+	E_FATAL("Unable to use feature cache %s\n", cmd_ln_str("-featcachefn"));
+    }
+
     if (corpus_init() != S3_SUCCESS) {
 	return S3_ERROR;
     }
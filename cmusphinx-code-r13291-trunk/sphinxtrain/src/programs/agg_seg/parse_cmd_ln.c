@@ -169,6 +169,10 @@ ctl -cepdir cepdir -cepext mfc -ceplen 13 -stride 10 ";
 	  ARG_STRING,
 	  "mfc",
 	  "Extension of the cepstrum files"},
+	{ "-featcachefn",
+	  ARG_STRING,
+	  NULL,
+	  "Feature cache file made by mk_featcache to read features from"},
 	{ "-cachesz",
 	  ARG_INT32,
 	  "200",
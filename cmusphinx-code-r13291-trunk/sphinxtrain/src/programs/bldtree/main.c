@@ -62,9 +62,12 @@
 #include <s3/vector.h>
 #include <s3/s3gau_io.h>
 #include <s3/gauden.h>
+#include <s3/best_q.h>
 
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/err.h>
+#include <sphinxbase/strfuncs.h>
+#include <sphinxbase/sbthread.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -148,105 +151,83 @@ find_triphones(model_def_t *mdef, const char *phn, uint32 *p_s, uint32 *p_e)
     return 0;
 }
 
-static int
-init(model_def_t **out_mdef,
-     const char *phn,
-     uint32 state,
-     uint32 *out_mixw_s,
-     float32 *****out_mixw,
-     float32 *****out_mixw_occ,
-     float32 *****out_mean,
-     float32 *****out_var,
-     uint32   **out_veclen,
-     uint32 *out_n_model,
-     uint32 *out_n_state,
-     uint32 *out_n_stream,
-     uint32 *out_n_density,
-     float32 **out_stwt,
-     uint32 ***out_dfeat,
-     pset_t **out_pset,
-     uint32 *out_n_pset,
-     quest_t **out_all_q,
-     uint32 *out_n_all_q)
-{
-    const char *moddeffn;
-    const char *mixwfn;
-    const char *psetfn;
+/* Model parameters and questions shared by every tree of a run */
+typedef struct bld_data_s {
     model_def_t *mdef;
-    uint32 p, p_s = NO_ID, p_e = NO_ID, s, m;
     int allphones;
-    uint32 mixw_s, mixw_e;
-    uint32 **dfeat;
+    uint32 continuous;
+    uint32 mixw_s;		/* state id of in_mixw[0] */
+    float32 ***in_mixw;
+    uint32 n_stream;
+    uint32 n_density;
+    vector_t ***fullmean;
+    vector_t ***fullvar;
+    vector_t ****fullvar_full;
+    uint32 *veclen;
+    float32 *istwt;		/* normalized -stwt */
+    uint32 n_stwt;
     pset_t *pset;
     uint32 n_pset;
-    acmod_id_t b, l, r;
-    word_posn_t pn;
-    float32 ****mixw;
-    float32 ****mixw_occ;
-    float32 ***in_mixw;
-    uint32 n_state, n_model, n_in_mixw, n_stream, n_density;
-    uint32 i, j, k;
-    float32 *stwt;
-    float32 *istwt;
-    const char **stwt_str;
     quest_t *all_q;
-    uint32 n_l_q, n_r_q;
     uint32 n_all_q;
-    uint32 n_phone_q, n_wdbndry;
-    float64 norm;
-    float64 dnom;
-    float32 mwfloor;
-    float64 wt_ent;
-    float64 s_wt_ent=0;
-    const char*   type;
-    uint32  continuous;
-    uint32  *l_veclen, *t_veclen;
-    uint32  l_nstates, t_nstates;
-    uint32  t_nfeat, t_ndensity;
-    vector_t  ***fullmean;
-    vector_t  ***fullvar = NULL;
-    vector_t  ****fullvar_full = NULL;
-    float32   ****mean;
-    float32   ****var;
-    float32   varfloor;
-    uint32    mm, kk,ll,n,nn,sumveclen;
-    
-    char      *cntflag;
-    float32   cntthreshold,stcnt;
-
-    
-
-    moddeffn = cmd_ln_str("-moddeffn");
-    if (moddeffn == NULL)
-	E_FATAL("Specify -moddeffn\n");
+} bld_data_t;
+
+/* The n-phones trees are built over: those of one base phone, or
+ * all of them with -allphones */
+typedef struct bld_phone_s {
+    const char *name;
+    uint32 p_s;
+    uint32 p_e;
+    uint32 n_model;
+    uint32 n_state;
+    uint32 n_density;
+    float32 ****mixw_occ;
+    float32 ****mean;
+    float32 ****var;
+    uint32 **dfeat;
+} bld_phone_t;
 
-    E_INFO("Reading: %s\n", moddeffn);
-    if (model_def_read(&mdef, moddeffn) != S3_SUCCESS)
-	return S3_ERROR;
+/* One tree of a -treedir run */
+typedef struct bld_job_s {
+    bld_phone_t *phone;
+    uint32 state;
+} bld_job_t;
+
+/* The trees of a -treedir run, taken in turn by the threads */
+typedef struct bld_queue_s {
+    bld_data_t *data;
+    bld_job_t *job;
+    uint32 n_job;
+    uint32 next;
+    const char *treedir;
+    sbmtx_t *mtx;
+} bld_queue_t;
 
-    *out_mdef = mdef;
+static int
+select_phone(bld_data_t *d, const char *phn, bld_phone_t *ph)
+{
+    model_def_t *mdef = d->mdef;
+    uint32 p, i, j;
 
-    allphones = cmd_ln_int32("-allphones");
-    if (allphones) {
-      p_s = acmod_set_n_ci(mdef->acmod_set);
-      p_e = acmod_set_n_acmod(mdef->acmod_set)-1;
-    }
-    else if (phn) {
-	if (find_triphones(mdef, phn, &p_s, &p_e) == -1)
-	  return S3_ERROR;
+    if (d->allphones) {
+	ph->name = "ALLPHONES";
+	ph->p_s = acmod_set_n_ci(mdef->acmod_set);
+	ph->p_e = acmod_set_n_acmod(mdef->acmod_set)-1;
     }
     else {
-      E_FATAL("No -phone, -start_phone, or -end_phone specified!\n");
+	ph->name = phn;
+	if (find_triphones(mdef, phn, &ph->p_s, &ph->p_e) == -1)
+	    return S3_ERROR;
     }
 
-    E_INFO("Building trees for [%s]", acmod_set_id2name(mdef->acmod_set, p_s));
-    E_INFOCONT(" through [%s]\n", acmod_set_id2name(mdef->acmod_set, p_e));
+    E_INFO("Building trees for [%s]", acmod_set_id2name(mdef->acmod_set, ph->p_s));
+    E_INFOCONT(" through [%s]\n", acmod_set_id2name(mdef->acmod_set, ph->p_e));
 
-    for (p = p_s, i = mdef->defn[p_s].state[0]-1; p <= p_e; p++) {
+    for (p = ph->p_s, i = mdef->defn[ph->p_s].state[0]-1; p <= ph->p_e; p++) {
 	for (j = 0; j < mdef->defn[p].n_state; j++) {
 	    if (mdef->defn[p].state[j] != TYING_NON_EMITTING) {
 		if (mdef->defn[p].state[j] != i+1) {
-		    E_ERROR("States in triphones for %s are not consecutive\n", phn);
+		    E_ERROR("States in triphones for %s are not consecutive\n", ph->name);
 		    
 		    return S3_ERROR;
 		}
@@ -256,14 +237,45 @@ init(model_def_t **out_mdef,
 	}
     }
 
-    cntflag = (char *)ckd_calloc(p_e-p_s+1,sizeof(char));
-    cntthreshold = cmd_ln_float32("-cntthresh");
+    ph->n_state = mdef->defn[ph->p_s].n_state - 1;
 
-    /* Find first and last mixing weight used for p_s through p_e */
-    mixw_s = mdef->defn[p_s].state[0];
-    mixw_e = mdef->defn[p_e].state[mdef->defn[p_e].n_state-2];
+    for (i = ph->p_s+1; i <= ph->p_e; i++) {
+	if ((mdef->defn[i].n_state - 1) != ph->n_state) {
+	    E_FATAL("Models do not have uniform topology\n");
+	}
+    }
+
+    return S3_SUCCESS;
+}
+
+/*
+ * Reads the mixing weights of states mixw_s through mixw_e, the
+ * means and variances if building on continuous models, the state
+ * weights and the phone sets, and generates the simple questions.
+ */
+static int
+read_data(bld_data_t *d, uint32 n_state, uint32 mixw_s, uint32 mixw_e)
+{
+    const char *mixwfn;
+    const char *psetfn;
+    pset_t *pset;
+    uint32 n_pset;
+    acmod_id_t l;
+    uint32 n_in_mixw;
+    uint32 i;
+    float32 *istwt;
+    const char **stwt_str;
+    quest_t *all_q;
+    uint32 n_l_q, n_r_q;
+    uint32 n_all_q;
+    uint32 n_phone_q, n_wdbndry;
+    float64 norm;
+    const char*   type;
+    uint32  *t_veclen;
+    uint32  l_nstates, t_nstates;
+    uint32  t_nfeat, t_ndensity;
 
-    *out_mixw_s = mixw_s;
+    d->mixw_s = mixw_s;
 
     E_INFO("Covering states |[%u %u]| == %u\n",
 	   mixw_s, mixw_e, mixw_e - mixw_s + 1);
@@ -274,48 +286,17 @@ init(model_def_t **out_mdef,
 
     E_INFO("Reading: %s\n", mixwfn);
     if (s3mixw_intv_read(mixwfn, mixw_s, mixw_e,
-			 &in_mixw,
+			 &d->in_mixw,
 			 &n_in_mixw,
-			 &n_stream,
-			 &n_density) != S3_SUCCESS)
+			 &d->n_stream,
+			 &d->n_density) != S3_SUCCESS)
 	return S3_ERROR;
 
-    *out_n_stream = n_stream;
-    *out_n_density = n_density;
-    n_state = mdef->defn[p_s].n_state - 1;
-    *out_n_state = n_state;
-
-    for (i = p_s+1; i <= p_e; i++) {
-	if ((mdef->defn[i].n_state - 1) != n_state) {
-	    E_FATAL("Models do not have uniform topology\n");
-	}
-    }
-
-    for (i=p_s,j=0,mm=0; i<=p_e ;i++,j++) { 
-        cntflag[j] = 1;
-        for (k=0; k < n_state; k++) {
-            s = mdef->defn[i].state[k] - mixw_s;
-            for (kk=0; kk<n_stream; kk++) {
-                stcnt = 0;
-                for (ll=0; ll<n_density; ll++) {
-                    stcnt += in_mixw[s][kk][ll];
-                }
-                if (stcnt < cntthreshold) cntflag[j] = 0;
-            }
-        }
-        if (cntflag[j]==1) mm++;
-    }
-
-    n_model = mm;
-    *out_n_model = n_model;
-    E_INFO("%d of %d models have observation count greater than %f\n",n_model,p_e-p_s+1,cntthreshold);
-        
-
     /* Allocate the state weight array for weighting the 
      * similarity of neighboring states */
     istwt = ckd_calloc(n_state, sizeof(float32));
-    stwt = ckd_calloc(n_state, sizeof(float32));
-    *out_stwt = stwt;
+    d->istwt = istwt;
+    d->n_stwt = n_state;
     stwt_str = cmd_ln_str_list("-stwt");
     if (stwt_str == NULL) {
 	E_FATAL("Specify state weights using -stwt\n");
@@ -338,95 +319,37 @@ init(model_def_t **out_mdef,
     for (i = 0; i < n_state; i++)
 	istwt[i] *= norm;
 
-    mk_stwt(stwt, istwt, state, n_state);
-    ckd_free((void *)istwt);
-
-    /*
-     * Build the 4D array:
-     *
-     *     mixw[0..n_model-1][0..n_state-1][0..n_feat-1][0..n_density-1]
-     *
-     * out of the usual mixw[][][] array
-     *
-     */
-    mixw_occ = (float32 ****)ckd_calloc_2d(n_model, n_state, sizeof(float32 **));
-    mixw     = (float32 ****)ckd_calloc_4d(n_model, n_state, n_stream, n_density,
-					   sizeof(float32));
-    *out_mixw_occ = mixw_occ;
-    *out_mixw = mixw;
-
-    for (i = p_s, j = 0, mm = 0; i <= p_e; i++, mm++) {
-        if (cntflag[mm]==1) {
-	    for (k = 0; k < n_state; k++) {
-	        s = mdef->defn[i].state[k] - mixw_s;
-	        mixw_occ[j][k] = in_mixw[s];
-	    }
-            j++;
-	}
-    }
-
-    assert(j == n_model);
-    mwfloor = cmd_ln_float32("-mwfloor");
-
     type = cmd_ln_str("-ts2cbfn");
     if (strcmp(type,".semi.")!=0 && strcmp(type,".cont.") != 0)
         E_FATAL("Type %s unsupported; trees can only be built on types .semi. or .cont.\n",type);
     if (strcmp(type,".cont.") == 0) 
-        continuous = 1;
+        d->continuous = 1;
     else 
-        continuous = 0;
+        d->continuous = 0;
 
 #if 0 /* This is rather arbitrary (in actual fact we should treat all models as continuous) */
    /* Additional check for meaningless input */
-    if (continuous == 0 && n_density < 256) {
-        E_FATAL("Attempt to build trees on semi-continuous HMMs with %d < 256 gaussians!\n****A minimum of 256 gaussians are expected!\n",n_density);
+    if (d->continuous == 0 && d->n_density < 256) {
+        E_FATAL("Attempt to build trees on semi-continuous HMMs with %d < 256 gaussians!\n****A minimum of 256 gaussians are expected!\n",d->n_density);
     }
 #endif
 
-    for (s = 0, wt_ent = 0; s < n_state; s++) {
-	if (continuous==0) s_wt_ent = 0;
-	for (i = 0; i < n_model; i++) {
-	    for (j = 0; j < n_stream; j++) {
-		/* The denominators for each stream should be nearly
-		   identical, but... */
-		for (k = 0, dnom = 0; k < n_density; k++) {
-		    dnom += mixw_occ[i][s][j][k];
-		}
-		if (dnom != 0) {
-		    norm = 1.0 / dnom;
-		    for (k = 0; k < n_density; k++) {
-			mixw[i][s][j][k] = mixw_occ[i][s][j][k] * norm;
-			if (mixw[i][s][j][k] < mwfloor) {
-			    mixw[i][s][j][k] = mwfloor;
-			}
-		    }
-		    if (continuous == 0)
-                        s_wt_ent += dnom * ent_d(mixw[i][s][j], n_density);
-		}
-	    }
-	}
-	if (continuous == 0) wt_ent += stwt[s] * s_wt_ent;
-    }
-
-    if (continuous == 0) E_INFO("%u-class entropy: %e\n", n_model, wt_ent);
-
-    if (continuous == 1) {
+    if (d->continuous == 1) {
 	int32 var_is_full = cmd_ln_int32("-fullvar");
         /* Read Means and Variances; perform consistency checks */
         if (s3gau_read(cmd_ln_str("-meanfn"),
-                       &fullmean,
+                       &d->fullmean,
                        &l_nstates,
                        &t_nfeat,
                        &t_ndensity,
-                       &l_veclen) != S3_SUCCESS)
+                       &d->veclen) != S3_SUCCESS)
             E_FATAL("Error reading mean file %s\n",cmd_ln_str("-meanfn"));
-        *out_veclen = l_veclen;
-        if (t_nfeat != n_stream && t_ndensity != n_density)
+        if (t_nfeat != d->n_stream && t_ndensity != d->n_density)
             E_FATAL("Mismatch between Mean and Mixture weight files\n");
 
 	if (var_is_full) {
 	    if (s3gau_read_full(cmd_ln_str("-varfn"),
-				&fullvar_full,
+				&d->fullvar_full,
 				&t_nstates,
 				&t_nfeat,
 				&t_ndensity,
@@ -435,120 +358,30 @@ init(model_def_t **out_mdef,
 	}
         else {
 	    if (s3gau_read(cmd_ln_str("-varfn"),
-			   &fullvar,
+			   &d->fullvar,
 			   &t_nstates,
 			   &t_nfeat,
 			   &t_ndensity,
 			   &t_veclen) != S3_SUCCESS)
 		E_FATAL("Error reading var file %s\n",cmd_ln_str("-varfn"));
 	}
-        if (t_nfeat != n_stream && t_ndensity != n_density)
+        if (t_nfeat != d->n_stream && t_ndensity != d->n_density)
             E_FATAL("Mismatch between Variance and Mixture weight files\n");
-        for (i=0;i<n_stream;i++)
-            if (t_veclen[i] != l_veclen[i])
-                E_FATAL("Feature length %d in var file != %d in mean file for feature %d\n",t_veclen[i],l_veclen[i],i);
+        for (i=0;i<d->n_stream;i++)
+            if (t_veclen[i] != d->veclen[i])
+                E_FATAL("Feature length %d in var file != %d in mean file for feature %d\n",t_veclen[i],d->veclen[i],i);
         if (l_nstates != t_nstates)
             E_FATAL("Total no. of states %d in var file != %d in mean file\n",t_nstates,l_nstates);
 
         if (t_ndensity > 1)
             E_WARN("The state distributions given have %d gaussians per state;\n..*..shrinking them down to 1 gau per state..\n",t_ndensity);
-
-        /* Allocate for out_mean and out_var. If input are multi_gaussian
-           distributions convert to single gaussians. Copy appropriate
-           states to out_mean and out_var */
-        for (i=0,sumveclen=0; i < n_stream; i++) sumveclen += t_veclen[i];
-        mean = (float32 ****)ckd_calloc_4d(n_model,n_state,n_stream,sumveclen,sizeof(float32));
-	/* Use only the diagonals regardless of whether -varfn is full. */
-        var = (float32 ****)ckd_calloc_4d(n_model,n_state,n_stream,sumveclen,sizeof(float32));
-        varfloor = cmd_ln_float32("-varfloor");
- 
-        for (i = p_s, j = 0, m = mixw_s, mm = 0; i <= p_e; i++, mm++) {
-            if (cntflag[mm]==1) {
-                for (k = 0; k < n_state; k++, m++) {
-                    for (ll = 0; ll < n_stream; ll++) {
-                        float32 *featmean,*featvar;
-
-                        featmean = mean[j][k][ll];
-                        featvar = var[j][k][ll];
-                        dnom  = 0;
-                        for (n = 0; n < n_density; n++) {
-                            float32 mw = mixw_occ[j][k][ll][n];
-                            dnom += mw;
-                            for (nn = 0; nn < l_veclen[ll]; nn++) {
-                                featmean[nn] += mw * fullmean[m][ll][n][nn];
-				if (var_is_full)
-				    featvar[nn] += 
-					mw *(fullmean[m][ll][n][nn]*fullmean[m][ll][n][nn] +
-					     fullvar_full[m][ll][n][nn][nn]);
-				else
-				    featvar[nn] += 
-					mw *(fullmean[m][ll][n][nn]*fullmean[m][ll][n][nn] +
-					     fullvar[m][ll][n][nn]);
-                            }
-                        }
-                        if (dnom != 0) {
-                            for (nn = 0; nn < l_veclen[ll]; nn++) {
-                                featmean[nn] /= dnom;
-                                featvar[nn] = featvar[nn]/dnom - featmean[nn]*featmean[nn];
-                                if (featvar[nn] < varfloor) featvar[nn] = varfloor;
-                            }
-                        }
-                        else {
-                            for (nn = 0; nn < l_veclen[ll]; nn++) {
-                                if (featmean[nn] != 0)
-                                    E_FATAL("dnom = 0, but featmean[nn] != 0, =  %f for ll = %d\n",featmean[nn],ll);
-                            }
-                        }
-                      /* Now on we need only have global counts for the mixws,
-                         so we store them all in mixw_occ[][][0] */
-                        mixw_occ[j][k][ll][0] = dnom;
-                    }
-                }
-                j++;
-            }
-            else m += n_state; /* account for states of skipped model */
-        }
-        assert(j == n_model);
-
-        /* Now n_density = 1 */
-        n_density = 1;
-        *out_n_density = n_density;
-        *out_mean = mean;
-        *out_var = var;
-        ckd_free_4d((void ****)fullmean);
-	if (fullvar)
-	    ckd_free_4d((void ****)fullvar);
-	if (fullvar_full)
-	    gauden_free_param_full(fullvar_full);
     }
 
-
-    /*
-     * Allocate a set of decision tree features
-     * associated with each phone
-     */
-    dfeat = (uint32 **)ckd_calloc_2d(n_model, N_DFEAT, sizeof(uint32));
-    *out_dfeat = dfeat;
-
-    for (p = p_s, j = 0, mm = 0; p <= p_e; p++, mm++) {
-        if (cntflag[mm] == 1) {
-	    acmod_set_id2tri(mdef->acmod_set, &b, &l, &r, &pn, p);
-
-	    dfeat[j][0] = (uint32)l;
-	    dfeat[j][1] = (uint32)b;
-	    dfeat[j][2] = (uint32)r;
-	    dfeat[j][3] = (uint32)pn;
-            j++;
-        }
-    }
-    assert(j == n_model);
-    ckd_free(cntflag);
-
     psetfn = cmd_ln_str("-psetfn");
 
     E_INFO("Reading: %s\n", psetfn);
-    *out_pset = pset = read_pset_file(psetfn, mdef->acmod_set, &n_pset);
-    *out_n_pset = n_pset;
+    d->pset = pset = read_pset_file(psetfn, d->mdef->acmod_set, &n_pset);
+    d->n_pset = n_pset;
 
     /* Determine the # of phone sets and word boundary
      * questions there are */
@@ -564,7 +397,7 @@ init(model_def_t **out_mdef,
                 n_phone_q++;
                 n_r_q++;
             }
-            else if (allphones)
+            else if (d->allphones)
 	      n_phone_q += 3;
 	    else
 	      n_phone_q += 2;
@@ -574,15 +407,15 @@ init(model_def_t **out_mdef,
     }
 
     /* Compute the total number of simple questions */
-    if (allphones) /* Ask questions about the phone itself */
+    if (d->allphones) /* Ask questions about the phone itself */
 	n_all_q = 2 * n_phone_q + 2 * n_wdbndry;
     else
 	n_all_q = 2 * n_phone_q + 2 * n_wdbndry;
-    *out_n_all_q = n_all_q;
+    d->n_all_q = n_all_q;
 
     /* Allocate an array to hold all the simple questions */
     all_q = ckd_calloc(n_all_q, sizeof(quest_t));
-    *out_all_q = all_q;
+    d->all_q = all_q;
 
     E_INFO("%u total simple questions (%u phone; %u word bndry)\n",
 	   n_all_q, 2 * n_phone_q, 2 * n_wdbndry);
@@ -613,7 +446,7 @@ init(model_def_t **out_mdef,
 	        all_q[l].ctxt = 1;    /* one phone to the right of base phone */
 	        l++;
             }
-	    if (allphones
+	    if (d->allphones
 		&& strstr(pset[i].name,"_R") == NULL
 		&& strstr(pset[i].name,"_L") == NULL) {
 		all_q[l].pset = i;
@@ -642,7 +475,7 @@ init(model_def_t **out_mdef,
 	        all_q[l].ctxt = 1;
 	        l++;
             }
-	    if (allphones
+	    if (d->allphones
 		&& strstr(pset[i].name,"_R") == NULL
 		&& strstr(pset[i].name,"_L") == NULL) {
 		all_q[l].pset = i;
@@ -672,80 +505,252 @@ init(model_def_t **out_mdef,
 
     return S3_SUCCESS;
 }
-
 
+/*
+ * Gathers the occupancies, the single Gaussian means and variances
+ * (continuous models) and the decision tree features of the n-phones
+ * of ph with enough observations.
+ */
+static void
+init_phone(bld_data_t *d, bld_phone_t *ph)
+{
+    model_def_t *mdef = d->mdef;
+    uint32 p, s, m;
+    uint32 **dfeat;
+    acmod_id_t b, l, r;
+    word_posn_t pn;
+    float32 ****mixw_occ;
+    float32 ***in_mixw = d->in_mixw;
+    uint32 n_state = ph->n_state;
+    uint32 n_stream = d->n_stream;
+    uint32 n_density = d->n_density;
+    uint32 n_model;
+    uint32 i, j, k;
+    float64 dnom;
+    uint32 *l_veclen = d->veclen;
+    float32   ****mean;
+    float32   ****var;
+    float32   varfloor;
+    uint32    mm, kk,ll,n,nn,sumveclen;
+    
+    char      *cntflag;
+    float32   cntthreshold,stcnt;
+
+    if (n_state != d->n_stwt)
+	E_FATAL("%s has %u states, but -stwt gives %u weights\n",
+		ph->name, n_state, d->n_stwt);
 
-int main(int argc, char *argv[])
+    cntflag = (char *)ckd_calloc(ph->p_e-ph->p_s+1,sizeof(char));
+    cntthreshold = cmd_ln_float32("-cntthresh");
+
+    for (i=ph->p_s,j=0,mm=0; i<=ph->p_e ;i++,j++) { 
+        cntflag[j] = 1;
+        for (k=0; k < n_state; k++) {
+            s = mdef->defn[i].state[k] - d->mixw_s;
+            for (kk=0; kk<n_stream; kk++) {
+                stcnt = 0;
+                for (ll=0; ll<n_density; ll++) {
+                    stcnt += in_mixw[s][kk][ll];
+                }
+                if (stcnt < cntthreshold) cntflag[j] = 0;
+            }
+        }
+        if (cntflag[j]==1) mm++;
+    }
+
+    n_model = mm;
+    ph->n_model = n_model;
+    E_INFO("%s: %d of %d models have observation count greater than %f\n",
+	   ph->name, n_model, ph->p_e-ph->p_s+1, cntthreshold);
+
+    if (d->continuous == 0) {
+	/*
+	 * Build the 4D array:
+	 *
+	 *     mixw_occ[0..n_model-1][0..n_state-1][0..n_feat-1][0..n_density-1]
+	 *
+	 * out of the usual mixw[][][] array
+	 *
+	 */
+	mixw_occ = (float32 ****)ckd_calloc_2d(n_model, n_state, sizeof(float32 **));
+
+	for (i = ph->p_s, j = 0, mm = 0; i <= ph->p_e; i++, mm++) {
+	    if (cntflag[mm]==1) {
+		for (k = 0; k < n_state; k++) {
+		    s = mdef->defn[i].state[k] - d->mixw_s;
+		    mixw_occ[j][k] = in_mixw[s];
+		}
+		j++;
+	    }
+	}
+	assert(j == n_model);
+	ph->n_density = n_density;
+    }
+    else {
+        /* Allocate for mean and var. If input are multi_gaussian
+           distributions convert to single gaussians. Copy appropriate
+           states to mean and var, and only their total counts to
+           mixw_occ */
+        for (i=0,sumveclen=0; i < n_stream; i++) sumveclen += l_veclen[i];
+	mixw_occ = (float32 ****)ckd_calloc_4d(n_model,n_state,n_stream,1,sizeof(float32));
+        mean = (float32 ****)ckd_calloc_4d(n_model,n_state,n_stream,sumveclen,sizeof(float32));
+	/* Use only the diagonals regardless of whether -varfn is full. */
+        var = (float32 ****)ckd_calloc_4d(n_model,n_state,n_stream,sumveclen,sizeof(float32));
+        varfloor = cmd_ln_float32("-varfloor");
+ 
+        for (i = ph->p_s, j = 0, mm = 0; i <= ph->p_e; i++, mm++) {
+            if (cntflag[mm]==1) {
+                for (k = 0; k < n_state; k++) {
+		    m = mdef->defn[i].state[k];
+		    s = m - d->mixw_s;
+                    for (ll = 0; ll < n_stream; ll++) {
+                        float32 *featmean,*featvar;
+
+                        featmean = mean[j][k][ll];
+                        featvar = var[j][k][ll];
+                        dnom  = 0;
+                        for (n = 0; n < n_density; n++) {
+                            float32 mw = in_mixw[s][ll][n];
+                            dnom += mw;
+                            for (nn = 0; nn < l_veclen[ll]; nn++) {
+                                featmean[nn] += mw * d->fullmean[m][ll][n][nn];
+				if (d->fullvar_full)
+				    featvar[nn] += 
+					mw *(d->fullmean[m][ll][n][nn]*d->fullmean[m][ll][n][nn] +
+					     d->fullvar_full[m][ll][n][nn][nn]);
+				else
+				    featvar[nn] += 
+					mw *(d->fullmean[m][ll][n][nn]*d->fullmean[m][ll][n][nn] +
+					     d->fullvar[m][ll][n][nn]);
+                            }
+                        }
+                        if (dnom != 0) {
+                            for (nn = 0; nn < l_veclen[ll]; nn++) {
+                                featmean[nn] /= dnom;
+                                featvar[nn] = featvar[nn]/dnom - featmean[nn]*featmean[nn];
+                                if (featvar[nn] < varfloor) featvar[nn] = varfloor;
+                            }
+                        }
+                        else {
+                            for (nn = 0; nn < l_veclen[ll]; nn++) {
+                                if (featmean[nn] != 0)
+                                    E_FATAL("dnom = 0, but featmean[nn] != 0, =  %f for ll = %d\n",featmean[nn],ll);
+                            }
+                        }
+                      /* Now on we need only have global counts for the mixws */
+                        mixw_occ[j][k][ll][0] = dnom;
+                    }
+                }
+                j++;
+            }
+        }
+        assert(j == n_model);
+
+        /* Now n_density = 1 */
+        ph->n_density = 1;
+        ph->mean = mean;
+        ph->var = var;
+    }
+    ph->mixw_occ = mixw_occ;
+
+    /*
+     * Allocate a set of decision tree features
+     * associated with each phone
+     */
+    dfeat = (uint32 **)ckd_calloc_2d(n_model, N_DFEAT, sizeof(uint32));
+    ph->dfeat = dfeat;
+
+    for (p = ph->p_s, j = 0, mm = 0; p <= ph->p_e; p++, mm++) {
+        if (cntflag[mm] == 1) {
+	    acmod_set_id2tri(mdef->acmod_set, &b, &l, &r, &pn, p);
+
+	    dfeat[j][0] = (uint32)l;
+	    dfeat[j][1] = (uint32)b;
+	    dfeat[j][2] = (uint32)r;
+	    dfeat[j][3] = (uint32)pn;
+            j++;
+        }
+    }
+    assert(j == n_model);
+    ckd_free(cntflag);
+}
+
+static void
+free_phone(bld_data_t *d, bld_phone_t *ph)
 {
-    float32 ****mixw_occ = NULL;
-    float32 ****mixw = NULL;
-    float32 ****means = NULL;
-    float32 ****vars = NULL;
-    uint32  *veclen = NULL;
-    uint32 mixw_s;
-    uint32 n_model = 0;
-    uint32 n_state = 0;
-    uint32 n_stream = 0;
-    uint32 n_density = 0;
-    model_def_t *mdef = NULL;
-    const char *phn;
-    pset_t *pset = NULL;
-    uint32 n_pset;
-    uint32 **dfeat = NULL;
-    quest_t *all_q = NULL;
-    uint32 n_all_q = 0;
-    uint32 m;
+    if (d->continuous) {
+	ckd_free_4d((void ****)ph->mixw_occ);
+	ckd_free_4d((void ****)ph->mean);
+	ckd_free_4d((void ****)ph->var);
+    }
+    else
+	ckd_free_2d((void **)ph->mixw_occ);
+    ckd_free_2d((void **)ph->dfeat);
+}
+
+/* Builds the composite tree for one state of ph */
+static dtree_t *
+bld_tree(bld_data_t *d, bld_phone_t *ph, uint32 state)
+{
+    float32 *stwt;
+    float32 *dist;
     uint32 *id;
-    float32 *stwt = NULL;
-    uint32 state;
-    dtree_t *tr;
-    FILE *fp;
+    uint32 s, i, j, k, m;
+    float64 dnom, norm, wt_ent, s_wt_ent;
     float32 mwfloor;
+    dtree_t *tr;
 
-    parse_cmd_ln(argc, argv);
+    stwt = ckd_calloc(ph->n_state, sizeof(float32));
+    mk_stwt(stwt, d->istwt, state, ph->n_state);
 
-    phn = cmd_ln_str("-phone");
+    mwfloor = cmd_ln_float32("-mwfloor");
 
-    state = cmd_ln_int32("-state");
+    if (d->continuous == 0) {
+	dist = ckd_calloc(ph->n_density, sizeof(float32));
+	for (s = 0, wt_ent = 0; s < ph->n_state; s++) {
+	    s_wt_ent = 0;
+	    for (i = 0; i < ph->n_model; i++) {
+		for (j = 0; j < d->n_stream; j++) {
+		    /* The denominators for each stream should be nearly
+		       identical, but... */
+		    for (k = 0, dnom = 0; k < ph->n_density; k++) {
+			dnom += ph->mixw_occ[i][s][j][k];
+		    }
+		    if (dnom != 0) {
+			norm = 1.0 / dnom;
+			for (k = 0; k < ph->n_density; k++) {
+			    dist[k] = ph->mixw_occ[i][s][j][k] * norm;
+			    if (dist[k] < mwfloor) {
+				dist[k] = mwfloor;
+			    }
+			}
+			s_wt_ent += dnom * ent_d(dist, ph->n_density);
+		    }
+		}
+	    }
+	    wt_ent += stwt[s] * s_wt_ent;
+	}
+	ckd_free(dist);
 
-    if (init(&mdef,
-	     phn,
-	     state,
-	     &mixw_s,
-	     &mixw,
-	     &mixw_occ,
-             &means,
-             &vars,
-             &veclen,
-	     &n_model,
-	     &n_state,
-	     &n_stream,
-	     &n_density,
-	     &stwt,
-	     &dfeat,
-	     &pset,
-	     &n_pset,
-	     &all_q,
-	     &n_all_q) != S3_SUCCESS) {
-	E_FATAL("Initialization failed\n");
+	E_INFO("%u-class entropy: %e\n", ph->n_model, wt_ent);
     }
 
-    mwfloor = cmd_ln_float32("-mwfloor");
-
-    id = (uint32 *)ckd_calloc(n_model, sizeof(uint32));
+    id = (uint32 *)ckd_calloc(ph->n_model, sizeof(uint32));
 
     /* Initially, all states in the same class */
-    for (m = 0; m < n_model; m++) {
+    for (m = 0; m < ph->n_model; m++) {
 	id[m] = m;
     }
 
     /* Build the composite tree.  Recursively generates
     * the composite decision tree.  See dtree.c in libcommon */
-    tr = mk_tree_comp(mixw_occ, means, vars, veclen, n_model, n_state, 
-                      n_stream, n_density, stwt,
-		      id, n_model,
-		      all_q, n_all_q, pset, acmod_set_n_ci(mdef->acmod_set),
-		      dfeat, N_DFEAT,
+    tr = mk_tree_comp(ph->mixw_occ, ph->mean, ph->var, d->veclen,
+		      ph->n_model, ph->n_state, d->n_stream, ph->n_density,
+		      stwt,
+		      id, ph->n_model,
+		      d->all_q, d->n_all_q, d->pset,
+		      acmod_set_n_ci(d->mdef->acmod_set),
+		      ph->dfeat, N_DFEAT,
 		      cmd_ln_int32("-ssplitmin"),
 		      cmd_ln_int32("-ssplitmax"),
 		      cmd_ln_float32("-ssplitthr"),
@@ -754,14 +759,246 @@ int main(int argc, char *argv[])
 		      cmd_ln_float32("-csplitthr"),
 		      mwfloor);
 
+    ckd_free(id);
+    ckd_free(stwt);
+
+    return tr;
+}
+
+static void
+write_tree(const char *treefn, dtree_t *tr, pset_t *pset)
+{
+    FILE *fp;
+
     /* Save it to a file */
-    fp = fopen(cmd_ln_str("-treefn"), "w");
+    fp = fopen(treefn, "w");
     if (fp == NULL) {
-	E_FATAL_SYSTEM("Unable to open %s for writing",
-		       cmd_ln_str("-treefn"));
+	E_FATAL_SYSTEM("Unable to open %s for writing", treefn);
     }
     print_final_tree(fp, &tr->node[0], pset);
     fclose(fp);
+}
+
+static void
+bld_run_queue(bld_queue_t *qu)
+{
+    bld_job_t *job;
+    dtree_t *tr;
+    char state_str[16];
+    char *treefn;
+
+    for (;;) {
+	sbmtx_lock(qu->mtx);
+	job = (qu->next < qu->n_job) ? &qu->job[qu->next++] : NULL;
+	sbmtx_unlock(qu->mtx);
+	if (job == NULL)
+	    break;
+
+	E_INFO("Building tree for %s state %u\n",
+	       job->phone->name, job->state);
+	tr = bld_tree(qu->data, job->phone, job->state);
+
+	sprintf(state_str, "%u", job->state);
+	treefn = string_join(qu->treedir, "/", job->phone->name,
+			     "-", state_str, ".dtree", NULL);
+	write_tree(treefn, tr, qu->data->pset);
+	E_INFO("Wrote %s\n", treefn);
+	ckd_free(treefn);
+	free_tree(tr);
+    }
+}
+
+static int
+bld_tree_main(sbthread_t *th)
+{
+    bld_run_queue((bld_queue_t *)sbthread_arg(th));
+
+    return 0;
+}
+
+/* Larger trees first, so that the last ones to finish are short */
+static int
+cmp_job(const void *a, const void *b)
+{
+    const bld_job_t *ja = (const bld_job_t *)a;
+    const bld_job_t *jb = (const bld_job_t *)b;
+
+    if (ja->phone->n_model != jb->phone->n_model)
+	return (ja->phone->n_model < jb->phone->n_model) ? 1 : -1;
+    if (ja->phone != jb->phone)
+	return (ja->phone < jb->phone) ? -1 : 1;
+    return (ja->state < jb->state) ? -1 : (ja->state > jb->state);
+}
+
+/*
+ * Builds the trees of every state of every phone selected (all the
+ * base phones but fillers and SIL, or the one given by -phone, or
+ * all n-phones with -allphones) into -treedir, -nthreads trees at a
+ * time.  The parameters are read once and shared by all the trees.
+ */
+static void
+bld_all_trees(bld_data_t *d, const char *treedir, uint32 n_thread)
+{
+    model_def_t *mdef = d->mdef;
+    acmod_set_t *acmod_set = mdef->acmod_set;
+    const char *phn = cmd_ln_str("-phone");
+    bld_phone_t *phone;
+    uint32 n_phone, b, i, j;
+    uint32 mixw_s, mixw_e;
+    bld_job_t *job;
+    uint32 n_job;
+    bld_queue_t qu;
+    sbthread_t **th;
+    uint32 n_tree_thread;
+
+    phone = ckd_calloc(acmod_set_n_ci(acmod_set), sizeof(bld_phone_t));
+    n_phone = 0;
+    if (d->allphones || phn) {
+	if (select_phone(d, phn, &phone[0]) != S3_SUCCESS)
+	    E_FATAL("Initialization failed\n");
+	n_phone = 1;
+    }
+    else {
+	for (b = 0; b < acmod_set_n_ci(acmod_set); b++) {
+	    const char *name = acmod_set_id2name(acmod_set, b);
+
+	    if (acmod_set_has_attrib(acmod_set, b, "filler") ||
+		strcmp(name, "SIL") == 0)
+		continue;
+	    if (select_phone(d, name, &phone[n_phone]) == S3_SUCCESS)
+		++n_phone;
+	}
+    }
+    if (n_phone == 0)
+	E_FATAL("No phones to build trees for\n");
+
+    mixw_s = mdef->defn[phone[0].p_s].state[0];
+    mixw_e = mdef->defn[phone[0].p_e].state[phone[0].n_state-1];
+    for (i = 1; i < n_phone; i++) {
+	if (mdef->defn[phone[i].p_s].state[0] < mixw_s)
+	    mixw_s = mdef->defn[phone[i].p_s].state[0];
+	if (mdef->defn[phone[i].p_e].state[phone[i].n_state-1] > mixw_e)
+	    mixw_e = mdef->defn[phone[i].p_e].state[phone[i].n_state-1];
+    }
+    if (read_data(d, phone[0].n_state, mixw_s, mixw_e) != S3_SUCCESS)
+	E_FATAL("Initialization failed\n");
+
+    n_job = 0;
+    for (i = 0; i < n_phone; i++) {
+	init_phone(d, &phone[i]);
+	n_job += phone[i].n_state;
+    }
+    if (d->continuous == 1) {
+	/* Only the per-phone single Gaussians are needed from here on */
+	ckd_free_4d((void ****)d->fullmean);
+	if (d->fullvar)
+	    ckd_free_4d((void ****)d->fullvar);
+	if (d->fullvar_full)
+	    gauden_free_param_full(d->fullvar_full);
+	d->fullmean = NULL;
+	d->fullvar = NULL;
+	d->fullvar_full = NULL;
+    }
+
+    job = ckd_calloc(n_job, sizeof(bld_job_t));
+    for (i = 0, n_job = 0; i < n_phone; i++) {
+	for (j = 0; j < phone[i].n_state; j++, n_job++) {
+	    job[n_job].phone = &phone[i];
+	    job[n_job].state = j;
+	}
+    }
+    qsort(job, n_job, sizeof(bld_job_t), cmp_job);
+
+    /* Trees are built in parallel first; threads left over go to
+       the question search within each tree */
+    n_tree_thread = (n_thread < n_job) ? n_thread : n_job;
+    best_q_set_nthreads(n_thread / n_tree_thread);
+    E_INFO("Building %u trees in %s, %u at a time\n",
+	   n_job, treedir, n_tree_thread);
+
+    qu.data = d;
+    qu.job = job;
+    qu.n_job = n_job;
+    qu.next = 0;
+    qu.treedir = treedir;
+    qu.mtx = sbmtx_init();
+
+    th = ckd_calloc(n_tree_thread, sizeof(sbthread_t *));
+    for (i = 1; i < n_tree_thread; i++) {
+	if ((th[i] = sbthread_start(cmd_ln_get(), bld_tree_main, &qu)) == NULL)
+	    E_FATAL("Failed to start thread %u\n", i);
+    }
+    /* This thread takes trees from the queue as well */
+    bld_run_queue(&qu);
+    for (i = 1; i < n_tree_thread; i++) {
+	sbthread_wait(th[i]);
+	sbthread_free(th[i]);
+    }
+    ckd_free(th);
+    sbmtx_free(qu.mtx);
+
+    for (i = 0; i < n_phone; i++)
+	free_phone(d, &phone[i]);
+    ckd_free(phone);
+    ckd_free(job);
+}
+
+int main(int argc, char *argv[])
+{
+    bld_data_t data;
+    bld_phone_t phone;
+    const char *moddeffn;
+    const char *treedir;
+    uint32 state;
+    int32 n_thread;
+    dtree_t *tr;
+
+    parse_cmd_ln(argc, argv);
+
+    memset(&data, 0, sizeof(data));
+    memset(&phone, 0, sizeof(phone));
+
+    n_thread = cmd_ln_int32("-nthreads");
+    if (n_thread < 1)
+	n_thread = 1;
+
+    moddeffn = cmd_ln_str("-moddeffn");
+    if (moddeffn == NULL)
+	E_FATAL("Specify -moddeffn\n");
+
+    E_INFO("Reading: %s\n", moddeffn);
+    if (model_def_read(&data.mdef, moddeffn) != S3_SUCCESS)
+	E_FATAL("Initialization failed\n");
+
+    data.allphones = cmd_ln_int32("-allphones");
+
+    treedir = cmd_ln_str("-treedir");
+    if (treedir) {
+	bld_all_trees(&data, treedir, n_thread);
+
+	return 0;
+    }
+
+    if (cmd_ln_str("-treefn") == NULL)
+	E_FATAL("Specify -treefn or -treedir\n");
+    if (!data.allphones && cmd_ln_str("-phone") == NULL)
+	E_FATAL("No -phone, -start_phone, or -end_phone specified!\n");
+
+    state = cmd_ln_int32("-state");
+
+    if (select_phone(&data, cmd_ln_str("-phone"), &phone) != S3_SUCCESS)
+	E_FATAL("Initialization failed\n");
+    if (read_data(&data, phone.n_state,
+		  data.mdef->defn[phone.p_s].state[0],
+		  data.mdef->defn[phone.p_e].state[phone.n_state-1]) != S3_SUCCESS)
+	E_FATAL("Initialization failed\n");
+    init_phone(&data, &phone);
+
+    /* All the threads go to the question search */
+    best_q_set_nthreads(n_thread);
+
+    tr = bld_tree(&data, &phone, state);
+    write_tree(cmd_ln_str("-treefn"), tr, data.pset);
 
     return 0;
 }
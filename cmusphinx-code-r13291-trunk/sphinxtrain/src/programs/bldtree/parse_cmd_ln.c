@@ -64,7 +64,9 @@ Given a set of questions. Build decision tree for a set of feature of\n\
 a particular phone.  By default, decision tree are not built for \n\
 filler phones and the phone tagged with SIL.  One very confusing \n\
 parameters of this tool is -stwt, if you are training a n-state \n\
-HMM, you need to specify n values after this flag.  ";
+HMM, you need to specify n values after this flag.  With -treedir,\n\
+the trees for every state of every phone are built by one process\n\
+that reads the models once, on -nthreads threads.";
 
     const char examplestr[] =
 " bld_tree -treefn tree -moddeffn mdef -mixwfn mixw -meanfn mean -varfn \n\
@@ -88,6 +90,11 @@ var -psetfn questions -stwt 1.0 0.05 0.01 -state 0 -ssplitmin 1 \n\
 	  NULL,
 	  "Name of output tree file to produce" },
 
+	{ "-treedir",
+	  ARG_STRING,
+	  NULL,
+	  "Build the trees of all states of all phones (or of -phone, or -allphones) in one run, and write them as <phone>-<state>.dtree in this directory" },
+
 	{ "-moddeffn",
 	  ARG_STRING,
 	  NULL,
@@ -188,6 +195,11 @@ var -psetfn questions -stwt 1.0 0.05 0.01 -state 0 -ssplitmin 1 \n\
 	  "100",
 	  "Minimum # of compound tree splits to do" },
 
+	{ "-nthreads",
+	  ARG_INT32,
+	  "1",
+	  "Number of threads.  With -treedir, trees are built this many at a time; otherwise they share the question search of the one tree" },
+
 	{NULL, 0, NULL, NULL}
     };
 
@@ -97,6 +97,7 @@
 #include <s3/s3gau_io.h>
 #include <s3/s3mixw_io.h>
 #include <s3/s3tmat_io.h>
+#include <s3/s3accpack_io.h>
 #include <s3/corpus.h>
 #include <s3/model_inventory.h>
 #include <s3/model_def.h>
@@ -570,6 +571,95 @@ accum_global(model_inventory_t *inv,
     return S3_SUCCESS;
 }
 
+/*********************************************************************
+ *
+ * Function: 
+ *	accum_merge
+ * 
+ * Description: 
+ *	Add the global reestimation accumulators of one model
+ *	inventory into those of another.  This is used to combine the
+ *	counts gathered by several threads working on separate copies
+ *	of the accumulators.  Only accumulators which are allocated in
+ *	both inventories are added.
+ * 
+ * Function Inputs: 
+ *	model_inventory_t *inv -
+ *		The inventory whose accumulators receive the counts.
+ *
+ *	model_inventory_t *src -
+ *		The inventory whose accumulators are added.  They
+ *		are left unchanged.
+ *
+ * Global Inputs: 
+ *	None
+ * 
+ * Return Values: 
+ *	S3_SUCCESS
+ * 
+ * Global Outputs: 
+ *	None
+ * 
+ * Errors: 
+ * 	None
+ *********************************************************************/
+int32
+accum_merge(model_inventory_t *inv,
+	    model_inventory_t *src)
+{
+    gauden_t *g, *sg;
+    uint32 i, j, k, l, m;
+
+    g = inv->gauden;
+    sg = src->gauden;
+
+    if (inv->mixw_acc && src->mixw_acc) {
+	for (i = 0; i < inv->n_mixw; i++) {
+	    for (j = 0; j < inv->n_feat; j++) {
+		for (k = 0; k < inv->n_density; k++) {
+		    inv->mixw_acc[i][j][k] += src->mixw_acc[i][j][k];
+		}
+	    }
+	}
+    }
+
+    if (inv->tmat_acc && src->tmat_acc) {
+	for (i = 0; i < inv->n_tmat; i++) {
+	    for (j = 0; j < inv->n_state_pm-1; j++) {
+		for (k = 0; k < inv->n_state_pm; k++) {
+		    inv->tmat_acc[i][j][k] += src->tmat_acc[i][j][k];
+		}
+	    }
+	}
+    }
+
+    for (i = 0; i < g->n_mgau; i++) {
+	for (j = 0; j < g->n_feat; j++) {
+	    for (k = 0; k < g->n_density; k++) {
+		if (g->macc && sg->macc) {
+		    for (l = 0; l < g->veclen[j]; l++)
+			g->macc[i][j][k][l] += sg->macc[i][j][k][l];
+		}
+		if (g->vacc && sg->vacc) {
+		    for (l = 0; l < g->veclen[j]; l++)
+			g->vacc[i][j][k][l] += sg->vacc[i][j][k][l];
+		}
+		if (g->fullvacc && sg->fullvacc) {
+		    for (l = 0; l < g->veclen[j]; l++)
+			for (m = 0; m < g->veclen[j]; m++)
+			    g->fullvacc[i][j][k][l][m]
+				+= sg->fullvacc[i][j][k][l][m];
+		}
+		if (g->dnom && sg->dnom) {
+		    g->dnom[i][j][k] += sg->dnom[i][j][k];
+		}
+	    }
+	}
+    }
+
+    return S3_SUCCESS;
+}
+
 /*********************************************************************
  *
  * Function: 
@@ -814,6 +904,120 @@ commit(int32 mixw_reest,
     return S3_SUCCESS;
 }
 
+static int32
+accum_dump_packed(const char *out_dir,
+		  model_inventory_t *inv,
+		  int32 mixw_reest,
+		  int32 tmat_reest,
+		  int32 mean_reest,
+		  int32 var_reest,
+		  int32 pass2var,
+		  int32 var_is_full,
+		  int ckpt)
+{
+    char fn[MAXPATHLEN+1];
+    char fn_bkp[MAXPATHLEN+1];
+    gauden_t *g;
+    accpack_t pk;
+    uint32 i, n_elem;
+    int32 have_bkp = FALSE;
+    FILE *fp;
+
+    g = inv->gauden;
+    memset(&pk, 0, sizeof(pk));
+
+    /* floor the sums the same way as the s3*_write() routines, so
+       that norm produces the same models from either format */
+    if (mixw_reest) {
+	floor_nz_3d(inv->mixw_acc,
+		    inv->n_mixw, g->n_feat, g->n_density, MIN_POS_FLOAT32);
+
+	pk.flags |= ACCPACK_HAS(ACCPACK_MIXW);
+	pk.n_mixw = inv->n_mixw;
+	pk.n_mixw_stream = g->n_feat;
+	pk.n_mixw_density = g->n_density;
+	pk.sect[ACCPACK_MIXW] = inv->mixw_acc[0][0];
+    }
+
+    if (tmat_reest) {
+	floor_nz_3d(inv->tmat_acc,
+		    inv->n_tmat, inv->n_state_pm-1, inv->n_state_pm,
+		    MIN_POS_FLOAT32);
+
+	pk.flags |= ACCPACK_HAS(ACCPACK_TMAT);
+	pk.n_tmat = inv->n_tmat;
+	pk.n_state_pm = inv->n_state_pm;
+	pk.sect[ACCPACK_TMAT] = inv->tmat_acc[0][0];
+    }
+
+    if (mean_reest || var_reest) {
+	pk.flags |= ACCPACK_HAS(ACCPACK_VECLEN);
+	if (pass2var)
+	    pk.flags |= ACCPACK_PASS2VAR;
+	if (var_is_full)
+	    pk.flags |= ACCPACK_FULLVAR;
+	pk.n_mgau = g->n_mgau;
+	pk.n_feat = g->n_feat;
+	pk.n_density = g->n_density;
+	pk.sect[ACCPACK_VECLEN] = g->veclen;
+
+	for (i = 0, n_elem = 0; i < g->n_feat; i++)
+	    n_elem += g->veclen[i];
+	n_elem *= g->n_mgau * g->n_density;
+
+	if (mean_reest) {
+	    band_nz_1d(g->macc[0][0][0], n_elem, MIN_POS_FLOAT32);
+
+	    pk.flags |= ACCPACK_HAS(ACCPACK_MEAN);
+	    pk.sect[ACCPACK_MEAN] = g->macc[0][0][0];
+	}
+	if (var_reest) {
+	    pk.flags |= ACCPACK_HAS(ACCPACK_VAR);
+	    if (var_is_full) {
+		/* full variances are not floored */
+		pk.sect[ACCPACK_VAR] = g->fullvacc[0][0][0][0];
+	    }
+	    else {
+		floor_nz_1d(g->vacc[0][0][0], n_elem, MIN_POS_FLOAT32);
+		pk.sect[ACCPACK_VAR] = g->vacc[0][0][0];
+	    }
+	}
+	if (g->dnom) {
+	    floor_nz_3d(g->dnom,
+			g->n_mgau, g->n_feat, g->n_density, MIN_POS_FLOAT32);
+
+	    pk.flags |= ACCPACK_HAS(ACCPACK_DNOM);
+	    pk.sect[ACCPACK_DNOM] = g->dnom[0][0];
+	}
+    }
+
+    sprintf(fn, "%s/%s", out_dir, ACCPACK_FILE);
+    sprintf(fn_bkp, "%s/%s.bkp", out_dir, ACCPACK_FILE);
+
+    fp = fopen(fn, "rb");
+    if (fp != NULL) {
+	fclose(fp);
+	if (rename(fn, fn_bkp) < 0) {
+	    E_ERROR_SYSTEM("Couldn't backup %s\n", fn);
+	    return S3_ERROR;
+	}
+	have_bkp = TRUE;
+    }
+
+    if (s3accpack_write(fn, &pk) != S3_SUCCESS) {
+	if (have_bkp && rename(fn_bkp, fn) < 0)
+	    E_ERROR_SYSTEM("Couldn't revert to backup of %s\n", fn);
+
+	return S3_ERROR;
+    }
+
+    /* no problem if this fails */
+    if (have_bkp)
+	unlink(fn_bkp);
+
+    return commit(FALSE, FALSE, FALSE, FALSE, ckpt, out_dir);
+}
+
 
 /*********************************************************************
  *
@@ -835,6 +1039,8 @@ commit(int32 mixw_reest,
  *	int32 tmat_reest -
  *	int32 mean_reest -
  *	int32 var_reest -
+ *	int32 packed - Write a single accum_counts container
+ *		instead of the separate count files.
  *
  * Global Inputs: 
  * 	None
@@ -858,6 +1064,7 @@ accum_dump(const char *out_dir,
 	   int32 var_reest,
 	   int32 pass2var,
 	   int32 var_is_full,
+	   int32 packed,
 	   int ckpt)  	    /* checkpoint dump flag */
 {
     char fn[MAXPATHLEN+1];
@@ -867,6 +1074,17 @@ accum_dump(const char *out_dir,
     if (!ckpt)
 	accum_stat(inv, mixw_reest);
 
+    if (packed)
+	return accum_dump_packed(out_dir, inv,
+				 mixw_reest, tmat_reest,
+				 mean_reest, var_reest,
+				 pass2var, var_is_full, ckpt);
+
+    /* norm prefers a container over the separate files, so do not
+       leave one behind from an earlier run */
+    sprintf(fn, "%s/%s", out_dir, ACCPACK_FILE);
+    unlink(fn);
+
     g = inv->gauden;
 
     mk_bkp(mixw_reest, tmat_reest, mean_reest, var_reest, out_dir);
@@ -88,6 +88,10 @@ accum_global(model_inventory_t *inv,
 	     int32 var_reest,
 	     int32 var_is_full);
 
+int32
+accum_merge(model_inventory_t *inv,
+	    model_inventory_t *src);
+
 int32
 accum_dump(const char *out_dir,
 	   model_inventory_t *inv,
@@ -97,6 +101,7 @@ accum_dump(const char *out_dir,
 	   int32 var_reest,
 	   int32 pass2var,
 	   int32 var_is_full,
+	   int32 packed,
 	   int ckpt);
 
 int32
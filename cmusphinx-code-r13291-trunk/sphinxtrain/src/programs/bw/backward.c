@@ -290,6 +290,9 @@ den_terms(float64 **d_term,
  *		A boolean indicating whether or not to do variance
  *		reestimation.
  *
+ *	FILE *statfh -
+ *		Where to print the per utterance beta statistics.
+ *
  * Global Inputs: 
  *	None
  * 
@@ -327,7 +330,8 @@ backward_update(float64 **active_alpha,
 		int32 var_is_full,
 		FILE *pdumpfh,
 		bw_timers_t *timers,
-                feat_t *fcb)
+                feat_t *fcb,
+		FILE *statfh)
 {
     void *tt;			/* temp variable used to do
 				   pointer swapping */
@@ -388,11 +392,11 @@ backward_update(float64 **active_alpha,
     float64 p_reest_term;
     float64 post_j;
     float64 sum_reest_post_j = 0.0;
-    static float64 *p_op = NULL;
-    static float64 *p_ci_op = NULL;
+    float64 *p_op;
+    float64 *p_ci_op;
     float64 op;
-    static float64 **d_term = NULL;
-    static float64 **d_term_ci = NULL;
+    float64 **d_term;
+    float64 **d_term_ci;
 
     uint32 n_feat;
     uint32 n_density;
@@ -431,15 +435,12 @@ backward_update(float64 **active_alpha,
     n_density = gauden_n_density(g);
     n_top = gauden_n_top(g);
 
-    if (p_op == NULL) {
-	p_op    = ckd_calloc(n_feat, sizeof(float64));
-	p_ci_op = ckd_calloc(n_feat, sizeof(float64));
-    }
-
-    if (d_term == NULL) {
-	d_term    = (float64 **)ckd_calloc_2d(n_feat, n_top, sizeof(float64));
-	d_term_ci = (float64 **)ckd_calloc_2d(n_feat, n_top, sizeof(float64));
-    }
+    /* Scratch space is per call so that several utterances can be
+     * processed at once by different threads. */
+    p_op    = ckd_calloc(n_feat, sizeof(float64));
+    p_ci_op = ckd_calloc(n_feat, sizeof(float64));
+    d_term    = (float64 **)ckd_calloc_2d(n_feat, n_top, sizeof(float64));
+    d_term_ci = (float64 **)ckd_calloc_2d(n_feat, n_top, sizeof(float64));
 
     /* Allocate space for source/destination beta */
     beta_a = ckd_calloc(n_state, sizeof(float64));
@@ -1267,9 +1268,9 @@ backward_update(float64 **active_alpha,
 	    ptmr_stop(&timers->rstf_timer);
     }
 
-    printf(" %d", n_active_tot / n_obs);
-    printf(" %d", n_reest_tot / n_obs);
-    printf(" %e", t_pprob / n_obs);
+    fprintf(statfh, " %d", n_active_tot / n_obs);
+    fprintf(statfh, " %d", n_reest_tot / n_obs);
+    fprintf(statfh, " %e", t_pprob / n_obs);
 
 free:
 
@@ -1291,5 +1292,10 @@ free:
     ckd_free_3d((void ***)now_den);
     ckd_free_3d((void ***)now_den_idx);
 
+    ckd_free(p_op);
+    ckd_free(p_ci_op);
+    ckd_free_2d((void **)d_term);
+    ckd_free_2d((void **)d_term_ci);
+
     return (retval);
 }
@@ -76,7 +76,8 @@ backward_update(float64 **active_alpha,
 		int32 var_is_full,
 		FILE *pdumpfn,
 		bw_timers_t *timers,
-		feat_t *fcb);
+		feat_t *fcb,
+		FILE *statfh);
 
 void
 partial_op(float64 *p_op,
@@ -118,6 +118,10 @@
  *      s3phseg_t *phseg -
  *              An optional phone segmentation to use to constrain the
  *              forward lattice.
+ *
+ *	FILE *statfh -
+ *		Where to print the per utterance search statistics.
+ *
  * Global Inputs: 
  *	None
  * 
@@ -147,7 +151,8 @@ baum_welch_update(float64 *log_forw_prob,
 		  int32 var_is_full,
 		  FILE *pdumpfh,
 		  bw_timers_t *timers,
-		  feat_t *fcb)
+		  feat_t *fcb,
+		  FILE *statfh)
 {
     float64 *scale = NULL;
     float64 **dscale = NULL;
@@ -185,7 +190,7 @@ baum_welch_update(float64 *log_forw_prob,
     ret = forward(active_alpha, active_astate, n_active_astate, bp,
 		  scale, dscale,
 		  feature, n_obs, state, n_state,
-		  inv, a_beam, phseg, timers, 0);
+		  inv, a_beam, phseg, timers, 0, statfh);
 
 #if BW_DEBUG
     for (i=0 ; i < n_obs;i++){
@@ -244,7 +249,7 @@ baum_welch_update(float64 *log_forw_prob,
 			  state, n_state,
 			  inv, b_beam, spthresh,
 			  mixw_reest, tmat_reest, mean_reest, var_reest, pass2var,
-			  var_is_full, pdumpfh, timers, fcb);
+			  var_is_full, pdumpfh, timers, fcb, statfh);
     if (timers)
 	ptmr_stop(&timers->bwd_timer);
 
@@ -321,7 +326,5 @@ error:
     ckd_free((void *)active_astate);
     ckd_free(bp);
 
-    E_ERROR("%s ignored\n", corpus_utt_brief_name());
-
     return S3_ERROR;
 }
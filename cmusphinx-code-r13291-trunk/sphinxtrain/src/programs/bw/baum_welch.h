@@ -94,6 +94,7 @@ baum_welch_update(float64 *log_forw_prob,
 		  int32 var_is_full,
 		  FILE *pdumpfh,
 		  bw_timers_t *timers,
-		  feat_t *fcb);
+		  feat_t *fcb,
+		  FILE *statfh);
 
 #endif /* BAUM_WELCH_H */ 
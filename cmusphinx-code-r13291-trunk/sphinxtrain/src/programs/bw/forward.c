@@ -152,6 +152,9 @@
  *              An optional phone segmentation to use to constrain the
  *              forward lattice.
  *
+ *	FILE *statfh -
+ *		Where to print the average number of active states.
+ *
  * Global Inputs: 
  * 	None
  *
@@ -191,7 +194,8 @@ forward(float64 **active_alpha,
 	float64 beam,
 	s3phseg_t *phseg,
 	bw_timers_t *timers,
-	uint32 mmi_train)
+	uint32 mmi_train,
+	FILE *statfh)
 {
     uint32 i, j, s, t, u;
     uint32 l_cb;
@@ -717,7 +721,7 @@ forward(float64 **active_alpha,
 	n_sum_active += n_active;
     }
     if (!mmi_train)
-	printf(" %u ", n_sum_active / n_obs);
+	fprintf(statfh, " %u ", n_sum_active / n_obs);
     
 cleanup:
     ckd_free(active_a);
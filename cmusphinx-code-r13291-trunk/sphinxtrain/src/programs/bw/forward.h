@@ -72,7 +72,8 @@ forward(float64 **active_alpha,
 	float64 beam,
 	s3phseg_t *phseg,
 	bw_timers_t *timers,
-	uint32 mmi_train);
+	uint32 mmi_train,
+	FILE *statfh);
 
 void
 forward_set_viterbi(int state);
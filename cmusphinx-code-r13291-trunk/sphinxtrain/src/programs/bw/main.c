@@ -65,6 +65,7 @@
 #include <s3/mllr_io.h>
 #include <s3/ts2cb.h>
 #include <s3/s3cb2mllr_io.h>
+#include <s3/state_seq.h>
 #include <sys_compat/misc.h>
 #include <sys_compat/time.h>
 #include <sys_compat/file.h>
@@ -72,6 +73,7 @@
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/profile.h>
 #include <sphinxbase/feat.h>
+#include <sphinxbase/sbthread.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -479,6 +481,10 @@ main_initialize(int argc,
     /* set the data directory and extension for cepstrum files */
     corpus_set_mfcc_dir(cmd_ln_str("-cepdir"));
     corpus_set_mfcc_ext(cmd_ln_str("-cepext"));
+    if (cmd_ln_str("-featcachefn") &&
+	corpus_set_featcache(cmd_ln_str("-featcachefn"), feat) != S3_SUCCESS) {
+	E_FATAL("Unable to use feature cache %s\n", cmd_ln_str("-featcachefn"));
+    }
 
     if (cmd_ln_str("-lsnfn")) {
 	/* use a LSN file which has all the transcripts */
@@ -609,9 +615,478 @@ main_initialize(int argc,
 	free_mllr_B(sxfrm_b, n_mllr, tmp_n_stream);
     }
 
+    /* The parameters are final now, so lay them out for the blocked
+     * density kernels. */
+    gauden_blk_init(inv->gauden);
+
     return S3_SUCCESS;
 }
 
+/**
+ * Utterance prepared by the reader thread for a Baum-Welch worker.
+ *
+ * The corpus, the feature computation and the sentence HMM builder
+ * all keep state between utterances, so they are run in order by the
+ * reader, which hands each worker private copies of what it needs.
+ */
+typedef struct bw_job_s {
+    uint32 seq_no;
+    char *uttid;		/* Name printed on the utt> line */
+    char *brief;		/* Name used in error messages */
+    uint32 n_frame_in;		/* # of cepstrum frames read */
+    int32 n_frame;		/* # of feature frames */
+    vector_t **f;
+    state_t *state_seq;
+    uint32 n_state;
+    uint32 *mixw_inverse;	/* Local to global mixw ids for state_seq */
+    uint32 n_mixw_inverse;
+    uint32 *cb_inverse;		/* Local to global codebook ids for state_seq */
+    uint32 n_cb_inverse;
+    s3phseg_t *phseg;
+} bw_job_t;
+
+/**
+ * Thread accumulating reestimation counts into its own model
+ * inventory.  The model parameters are shared with all the others.
+ */
+typedef struct bw_worker_s {
+    struct bw_pool_s *pool;
+    model_inventory_t *inv;
+    sbthread_t *th;
+    FILE *scratch;		/* Collects the statistics for the utt> line */
+    uint32 total_frames;
+    float64 total_log_lik;
+} bw_worker_t;
+
+/**
+ * Pool of threads doing Baum-Welch reestimation.
+ *
+ * The reader puts utterances on a bounded queue and the workers take
+ * them in whatever order they become free.  When the corpus is done,
+ * the counts of the workers are added together pairwise into those
+ * of the first one, which are those of the main model inventory.
+ */
+typedef struct bw_pool_s {
+    bw_worker_t *workers;
+    int nthreads;
+    bw_job_t **queue;
+    int32 n_queue, head, count;
+    int eof;			/* No more utterances will be queued */
+    sbmtx_t *mtx;		/* Protects queue, head, count and eof */
+    sbevent_t *job_evt;		/* Signalled when a job is queued */
+    sbevent_t *space_evt;	/* Signalled when a job is taken */
+    sbmtx_t *out_mtx;		/* Keeps utt> lines whole */
+    feat_t *feat;
+    float64 a_beam;
+    float64 b_beam;
+    float32 spthresh;
+    int32 mixw_reest;
+    int32 tmat_reest;
+    int32 mean_reest;
+    int32 var_reest;
+    int32 pass2var;
+    int32 var_is_full;
+} bw_pool_t;
+
+static void
+bw_job_free(bw_job_t *job)
+{
+    if (job->f)
+	feat_array_free(job->f);
+    if (job->state_seq)
+	state_seq_free(job->state_seq, job->n_state);
+    s3phseg_free(job->phseg);
+    ckd_free(job->mixw_inverse);
+    ckd_free(job->cb_inverse);
+    ckd_free(job->uttid);
+    ckd_free(job->brief);
+    ckd_free(job);
+}
+
+/**
+ * Make a model inventory sharing the parameters of inv with empty
+ * accumulators of its own.
+ */
+static model_inventory_t *
+bw_worker_inv(model_inventory_t *inv)
+{
+    model_inventory_t *winv;
+    gauden_t *g;
+
+    winv = ckd_calloc(1, sizeof(*winv));
+    *winv = *inv;
+    winv->mixw_acc = NULL;
+    winv->l_mixw_acc = NULL;
+    winv->mixw_inverse = NULL;
+    winv->n_mixw_inverse = 0;
+    winv->cb_inverse = NULL;
+    winv->n_cb_inverse = 0;
+    winv->tmat_acc = NULL;
+    winv->l_tmat_acc = NULL;
+
+    g = winv->gauden = ckd_calloc(1, sizeof(*g));
+    *g = *inv->gauden;
+    g->macc = g->vacc = NULL;
+    g->fullvacc = NULL;
+    g->dnom = NULL;
+    g->l_macc = g->l_vacc = NULL;
+    g->l_fullvacc = NULL;
+    g->l_dnom = NULL;
+
+    if (inv->mixw_acc)
+	mod_inv_alloc_mixw_acc(winv);
+    if (inv->tmat_acc)
+	mod_inv_alloc_tmat_acc(winv);
+    if (inv->gauden->macc || inv->gauden->vacc || inv->gauden->fullvacc)
+	mod_inv_alloc_gauden_acc(winv);
+
+    return winv;
+}
+
+static void
+bw_worker_inv_free(model_inventory_t *winv)
+{
+    ckd_free_3d((void ***)winv->mixw_acc);
+    ckd_free_3d((void ***)winv->l_mixw_acc);
+    ckd_free(winv->mixw_inverse);
+    ckd_free(winv->cb_inverse);
+    ckd_free_3d((void ***)winv->tmat_acc);
+    ckd_free_2d((void **)winv->l_tmat_acc);
+    gauden_free_acc(winv->gauden);
+    gauden_free_l_acc(winv->gauden);
+    ckd_free(winv->gauden);
+    ckd_free(winv);
+}
+
+/**
+ * Return what was written to a scratch file since it was rewound.
+ */
+static char *
+scratch_string(FILE *fh)
+{
+    char *str;
+    long len;
+
+    len = ftell(fh);
+    str = ckd_malloc(len + 1);
+    rewind(fh);
+    if (fread(str, 1, len, fh) != (size_t)len) {
+	E_ERROR_SYSTEM("Failed to read back %ld bytes of output", len);
+	len = 0;
+    }
+    str[len] = '\0';
+    rewind(fh);
+    return str;
+}
+
+static void
+bw_pool_push(bw_pool_t *pool, bw_job_t *job)
+{
+    sbmtx_lock(pool->mtx);
+    while (pool->count == pool->n_queue) {
+	sbmtx_unlock(pool->mtx);
+	sbevent_wait(pool->space_evt, -1, 0);
+	sbmtx_lock(pool->mtx);
+    }
+    pool->queue[(pool->head + pool->count) % pool->n_queue] = job;
+    ++pool->count;
+    sbmtx_unlock(pool->mtx);
+    sbevent_signal(pool->job_evt);
+}
+
+/**
+ * Take the next utterance to process, or NULL once the corpus is done.
+ */
+static bw_job_t *
+bw_pool_next(bw_pool_t *pool)
+{
+    bw_job_t *job = NULL;
+    int more;
+
+    sbmtx_lock(pool->mtx);
+    while (pool->count == 0 && !pool->eof) {
+	sbmtx_unlock(pool->mtx);
+	sbevent_wait(pool->job_evt, -1, 0);
+	sbmtx_lock(pool->mtx);
+    }
+    if (pool->count > 0) {
+	job = pool->queue[pool->head];
+	pool->head = (pool->head + 1) % pool->n_queue;
+	--pool->count;
+    }
+    more = (pool->count > 0 || pool->eof);
+    sbmtx_unlock(pool->mtx);
+
+    /* Each signal wakes only one waiting worker, so pass it on. */
+    if (more)
+	sbevent_signal(pool->job_evt);
+    if (job)
+	sbevent_signal(pool->space_evt);
+    return job;
+}
+
+static int
+bw_worker_main(sbthread_t *th)
+{
+    bw_worker_t *w = sbthread_arg(th);
+    bw_pool_t *pool = w->pool;
+    model_inventory_t *inv = w->inv;
+    bw_job_t *job;
+    float64 log_lik;
+    char *stats;
+
+    while ((job = bw_pool_next(pool)) != NULL) {
+	/* Local accumulator ids in the state sequence refer to these. */
+	ckd_free(inv->mixw_inverse);
+	inv->mixw_inverse = job->mixw_inverse;
+	inv->n_mixw_inverse = job->n_mixw_inverse;
+	job->mixw_inverse = NULL;
+	ckd_free(inv->cb_inverse);
+	inv->cb_inverse = job->cb_inverse;
+	inv->n_cb_inverse = job->n_cb_inverse;
+	job->cb_inverse = NULL;
+
+	if (baum_welch_update(&log_lik,
+			      job->f, job->n_frame,
+			      job->state_seq, job->n_state,
+			      inv,
+			      pool->a_beam,
+			      pool->b_beam,
+			      pool->spthresh,
+			      job->phseg,
+			      pool->mixw_reest,
+			      pool->tmat_reest,
+			      pool->mean_reest,
+			      pool->var_reest,
+			      pool->pass2var,
+			      pool->var_is_full,
+			      NULL,
+			      NULL,
+			      pool->feat,
+			      w->scratch) == S3_SUCCESS) {
+	    w->total_frames += job->n_frame;
+	    w->total_log_lik += log_lik;
+
+	    fprintf(w->scratch, " %e %e",
+		    (job->n_frame > 0 ? log_lik / job->n_frame : 0.0),
+		    log_lik);
+	}
+	else {
+	    E_ERROR("%s ignored\n", job->brief);
+	}
+	stats = scratch_string(w->scratch);
+
+	sbmtx_lock(pool->out_mtx);
+	printf("utt> %5u %25s %4u %4u %5u%s\n",
+	       job->seq_no, job->uttid, job->n_frame_in,
+	       job->n_frame - job->n_frame_in, job->n_state, stats);
+	fflush(stdout);
+	sbmtx_unlock(pool->out_mtx);
+
+	ckd_free(stats);
+	bw_job_free(job);
+    }
+
+    return 0;
+}
+
+static bw_pool_t *
+bw_pool_init(model_inventory_t *inv, feat_t *feat, int nthreads)
+{
+    bw_pool_t *pool;
+    int i;
+
+    pool = ckd_calloc(1, sizeof(*pool));
+    pool->feat = feat;
+    pool->a_beam = cmd_ln_float64("-abeam");
+    pool->b_beam = cmd_ln_float64("-bbeam");
+    pool->spthresh = cmd_ln_float32("-spthresh");
+    pool->mixw_reest = cmd_ln_int32("-mixwreest");
+    pool->tmat_reest = cmd_ln_int32("-tmatreest");
+    pool->mean_reest = cmd_ln_int32("-meanreest");
+    pool->var_reest = cmd_ln_int32("-varreest");
+    pool->pass2var = cmd_ln_int32("-2passvar");
+    pool->var_is_full = cmd_ln_int32("-fullvar");
+
+    /* Enough to keep every worker busy while the reader works. */
+    pool->n_queue = 2 * nthreads;
+    pool->queue = ckd_calloc(pool->n_queue, sizeof(*pool->queue));
+    pool->mtx = sbmtx_init();
+    pool->out_mtx = sbmtx_init();
+    pool->job_evt = sbevent_init();
+    pool->space_evt = sbevent_init();
+
+    pool->nthreads = nthreads;
+    pool->workers = ckd_calloc(nthreads, sizeof(*pool->workers));
+    for (i = 0; i < nthreads; i++) {
+	bw_worker_t *w = &pool->workers[i];
+
+	w->pool = pool;
+	/* The first worker accumulates directly into the main inventory. */
+	w->inv = (i == 0) ? inv : bw_worker_inv(inv);
+	if ((w->scratch = tmpfile()) == NULL)
+	    E_FATAL_SYSTEM("Failed to create scratch file");
+	if ((w->th = sbthread_start(cmd_ln_get(), bw_worker_main, w)) == NULL)
+	    E_FATAL("Failed to start reestimation thread %d\n", i);
+    }
+    E_INFO("Reestimating with %d threads\n", nthreads);
+
+    return pool;
+}
+
+/**
+ * Wait for the workers to finish and add up their counts.
+ */
+static void
+bw_pool_finish(bw_pool_t *pool,
+	       uint32 *total_frames,
+	       float64 *total_log_lik)
+{
+    int i, step;
+
+    sbmtx_lock(pool->mtx);
+    pool->eof = TRUE;
+    sbmtx_unlock(pool->mtx);
+    sbevent_signal(pool->job_evt);
+
+    for (i = 0; i < pool->nthreads; i++) {
+	bw_worker_t *w = &pool->workers[i];
+
+	sbthread_wait(w->th);
+	sbthread_free(w->th);
+	fclose(w->scratch);
+	*total_frames += w->total_frames;
+	*total_log_lik += w->total_log_lik;
+    }
+
+    /* Add the counts together pairwise, which keeps the partial sums
+     * of similar size. */
+    for (step = 1; step < pool->nthreads; step *= 2) {
+	for (i = 0; i + step < pool->nthreads; i += 2 * step) {
+	    accum_merge(pool->workers[i].inv, pool->workers[i + step].inv);
+	}
+    }
+
+    for (i = 1; i < pool->nthreads; i++)
+	bw_worker_inv_free(pool->workers[i].inv);
+    ckd_free(pool->workers);
+    ckd_free(pool->queue);
+    sbmtx_free(pool->mtx);
+    sbmtx_free(pool->out_mtx);
+    sbevent_free(pool->job_evt);
+    sbevent_free(pool->space_evt);
+    ckd_free(pool);
+}
+
+/**
+ * Baum-Welch reestimation over the corpus with several threads.
+ */
+static void
+main_reestimate_threaded(model_inventory_t *inv,
+			 lexicon_t *lex,
+			 model_def_t *mdef,
+			 feat_t *feat,
+			 int nthreads,
+			 uint32 seq_no,
+			 uint32 *total_frames,
+			 float64 *total_log_lik,
+			 uint32 *n_frame_skipped)
+{
+    bw_pool_t *pool;
+    model_inventory_t rd;	/* Reader's view of inv, used to build
+				   sentence HMMs */
+    mfcc_t ***f;
+    int32 n_frame_in;
+    int32 n_frame;
+    char *uttid;
+    char *trans;
+    state_t *state_seq;
+    bw_job_t *job;
+    uint32 in_veclen;
+    uint32 maxuttlen;
+    uint32 outputfullpath;
+
+    in_veclen = cmd_ln_int32("-ceplen");
+    maxuttlen = cmd_ln_int32("-maxuttlen");
+    outputfullpath = cmd_ln_int32("-outputfullpath");
+
+    /* next_utt_states() replaces the local to global id maps of the
+     * inventory it is given, so give it one nobody else uses. */
+    rd = *inv;
+    rd.mixw_inverse = NULL;
+    rd.n_mixw_inverse = 0;
+    rd.cb_inverse = NULL;
+    rd.n_cb_inverse = 0;
+    rd.l_mixw_acc = NULL;
+
+    pool = bw_pool_init(inv, feat, nthreads);
+
+    while (corpus_next_utt()) {
+	uttid = (outputfullpath ? corpus_utt_full_name() : corpus_utt());
+
+        if (corpus_get_feat(feat, in_veclen, 9, maxuttlen, &f, &n_frame_in, &n_frame) < 0) {
+	        E_FATAL("Can't read input features\n");
+	}
+
+	if (n_frame_in < 9) {
+	    sbmtx_lock(pool->out_mtx);
+	    printf("utt> %5u %25s %4u\n", seq_no, uttid, n_frame_in);
+	    sbmtx_unlock(pool->out_mtx);
+	    E_WARN("utt %s too short\n", corpus_utt());
+	    continue;
+	}
+
+	if ((maxuttlen > 0) && (n_frame_in > maxuttlen)) {
+	    sbmtx_lock(pool->out_mtx);
+	    printf("utt> %5u %25s %4u\n", seq_no, uttid, n_frame_in);
+	    sbmtx_unlock(pool->out_mtx);
+	    E_INFO("utt # frames > -maxuttlen; skipping\n");
+	    *n_frame_skipped += n_frame_in;
+
+	    continue;
+	}
+
+	job = ckd_calloc(1, sizeof(*job));
+	job->seq_no = seq_no;
+	job->uttid = ckd_salloc(uttid);
+	job->brief = ckd_salloc(corpus_utt_brief_name());
+	job->n_frame_in = n_frame_in;
+	job->f = f;
+	job->n_frame = n_frame;
+
+	corpus_get_sent(&trans);
+	corpus_get_phseg(inv->acmod_set, &job->phseg);
+
+	state_seq = next_utt_states(&job->n_state, lex, &rd, mdef, trans);
+	if (state_seq == NULL) {
+	    sbmtx_lock(pool->out_mtx);
+	    printf("utt> %5u %25s %4u %4u %5u\n",
+		   job->seq_no, job->uttid, job->n_frame_in,
+		   job->n_frame - job->n_frame_in, job->n_state);
+	    sbmtx_unlock(pool->out_mtx);
+	    E_WARN("Skipped utterance '%s'\n", trans);
+	    bw_job_free(job);
+	}
+	else {
+	    /* The state sequence is overwritten by the next call. */
+	    job->state_seq = state_seq_copy(state_seq, job->n_state);
+	    job->mixw_inverse = rd.mixw_inverse;
+	    job->n_mixw_inverse = rd.n_mixw_inverse;
+	    rd.mixw_inverse = NULL;
+	    job->cb_inverse = rd.cb_inverse;
+	    job->n_cb_inverse = rd.n_cb_inverse;
+	    rd.cb_inverse = NULL;
+	    bw_pool_push(pool, job);
+	}
+	free(trans);	/* alloc'ed using strdup() */
+
+	seq_no++;
+    }
+
+    bw_pool_finish(pool, total_frames, total_log_lik);
+    fflush(stdout);
+}
+
 void
 main_reestimate(model_inventory_t *inv,
 		lexicon_t *lex,
@@ -619,9 +1094,8 @@ main_reestimate(model_inventory_t *inv,
 		feat_t *feat,
 		int32 viterbi)
 {
-    vector_t *mfcc;	/* utterance cepstra */	
-    int32 n_frame;	/* # of cepstrum frames  */
-    uint32 svd_n_frame;	/* # of cepstrum frames  */
+    int32 n_frame;	/* # of feature frames */
+    int32 svd_n_frame;	/* # of cepstrum frames  */
     vector_t **f;		/* independent feature streams derived
 				 * from cepstra */
     state_t *state_seq;		/* sentence HMM state sequence for the
@@ -648,6 +1122,7 @@ main_reestimate(model_inventory_t *inv,
 
     int32 pass2var;
     int32 var_is_full;
+    int32 packed;
 
     uint32 n_utt;
 
@@ -661,10 +1136,27 @@ main_reestimate(model_inventory_t *inv,
 
     uint32 outputfullpath = 0;
 
+    int32 nthreads;
+
     E_INFO("Reestimation: %s\n",
 	(viterbi ? "Viterbi" : "Baum-Welch"));
 
+    nthreads = cmd_ln_int32("-nthreads");
+    if (nthreads > 1 &&
+	(viterbi ||
+	 cmd_ln_str("-pdumpdir") ||
+	 cmd_ln_str("-outphsegdir") ||
+	 cmd_ln_str("-ckptintv"))) {
+	E_WARN("-nthreads is not supported with -viterbi, -pdumpdir, "
+	       "-outphsegdir or -ckptintv; using one thread\n");
+	nthreads = 1;
+    }
+
     profile = cmd_ln_int32("-timing");
+    if (profile && nthreads > 1) {
+	E_INFO("Timing information is not available with -nthreads > 1\n");
+	profile = FALSE;
+    }
     if (profile) {
 	E_INFO("Generating profiling information consumes significant CPU resources.\n");
 	E_INFO("If you are not interested in profiling, use -timing no\n");
@@ -689,6 +1181,7 @@ main_reestimate(model_inventory_t *inv,
     var_reest = cmd_ln_int32("-varreest");
     pass2var = cmd_ln_int32("-2passvar");
     var_is_full = cmd_ln_int32("-fullvar");
+    packed = cmd_ln_int32("-packedaccum");
     pdumpdir = cmd_ln_str("-pdumpdir");
     in_veclen = cmd_ln_int32("-ceplen");
 
@@ -738,7 +1231,13 @@ main_reestimate(model_inventory_t *inv,
 
     n_utt = 0;
 
-    while (corpus_next_utt()) {
+    if (nthreads > 1)
+	main_reestimate_threaded(inv, lex, mdef, feat, nthreads, seq_no,
+				 &total_frames, &total_log_lik,
+				 &n_frame_skipped);
+
+    /* The threads above have used up the corpus if they ran. */
+    while (nthreads <= 1 && corpus_next_utt()) {
 	/* Zero timers before utt processing begins */
 	if (timers) {
 	    ptmr_reset(&timers->utt_timer);
@@ -758,37 +1257,24 @@ main_reestimate(model_inventory_t *inv,
 	       seq_no,
 	       (outputfullpath ? corpus_utt_full_name() : corpus_utt()));
 
-        if (corpus_get_generic_featurevec(&mfcc, &n_frame, in_veclen) < 0) {
+        if (corpus_get_feat(feat, in_veclen, 9, maxuttlen, &f, &svd_n_frame, &n_frame) < 0) {
 	        E_FATAL("Can't read input features\n");
 	}
 
-	printf(" %4u", n_frame);
+	printf(" %4u", svd_n_frame);
 
-	if (n_frame < 9) {
+	if (svd_n_frame < 9) {
 	    E_WARN("utt %s too short\n", corpus_utt());
-	    if (mfcc) {
-		ckd_free(mfcc[0]);
-		ckd_free(mfcc);
-	    }
 	    continue;
 	}
 
-	if ((maxuttlen > 0) && (n_frame > maxuttlen)) {
+	if ((maxuttlen > 0) && (svd_n_frame > maxuttlen)) {
 	    E_INFO("utt # frames > -maxuttlen; skipping\n");
-	    n_frame_skipped += n_frame;
-	    if (mfcc) {
-		ckd_free(mfcc[0]);
-		ckd_free(mfcc);
-	    }
+	    n_frame_skipped += svd_n_frame;
 
 	    continue;
 	}
 
-	svd_n_frame = n_frame;
-
-	f = feat_array_alloc(feat, n_frame + feat_window_size(feat));
-	feat_s2mfc2feat_live(feat, mfcc, &n_frame, TRUE, TRUE, f);
-
 	printf(" %4u", n_frame - svd_n_frame);
 
 	/* Get the transcript */
@@ -842,7 +1328,8 @@ main_reestimate(model_inventory_t *inv,
 				  var_is_full,
 				  pdumpfh,
 				  timers,
-				  feat) == S3_SUCCESS) {
+				  feat,
+				  stdout) == S3_SUCCESS) {
 		total_frames += n_frame;
 		total_log_lik += log_lik;
 		
@@ -850,6 +1337,9 @@ main_reestimate(model_inventory_t *inv,
 		       (n_frame > 0 ? log_lik / n_frame : 0.0),
 		       log_lik);
 	    }
+	    else {
+		E_ERROR("%s ignored\n", corpus_utt_brief_name());
+	    }
 
 	} else {
 	    /* Viterbi search and accumulate in it */
@@ -882,8 +1372,6 @@ main_reestimate(model_inventory_t *inv,
 
 	if (pdumpfh)
 		fclose(pdumpfh);
-	free(mfcc[0]);
-	ckd_free(mfcc);
 	feat_array_free(f);
 	free(trans);	/* alloc'ed using strdup() */
 
@@ -910,6 +1398,7 @@ main_reestimate(model_inventory_t *inv,
 			      var_reest,
 			      pass2var,
 			      var_is_full,
+			      packed,
 			      TRUE) != S3_SUCCESS) {
 		static int notified = FALSE;
 		time_t t;
@@ -961,6 +1450,7 @@ main_reestimate(model_inventory_t *inv,
 		      var_reest,
 		      pass2var,
 		      var_is_full,
+		      packed,
 		      FALSE) != S3_SUCCESS) {
 	static int notified = FALSE;
 	time_t t;
@@ -1535,9 +2025,8 @@ main_mmi_reestimate(model_inventory_t *inv,
 		    model_def_t *mdef,
 		    feat_t *feat)
 {
-  vector_t *mfcc;/* utterance cepstra */
-  int32 n_frame;/* # of cepstrum frames  */
-  uint32 svd_n_frame;        /* # of cepstrum frames  */
+  int32 n_frame;/* # of feature frames */
+  int32 svd_n_frame;        /* # of cepstrum frames  */
   vector_t **f;/* independent feature streams derived from cepstra */
   float32 ***lda = NULL;
   uint32 total_frames;        /* # of frames over the corpus */
@@ -1666,37 +2155,23 @@ main_mmi_reestimate(model_inventory_t *inv,
   while (corpus_next_utt()) {
     printf("utt> %5u %25s",  seq_no, corpus_utt());
     
-    if (corpus_get_generic_featurevec(&mfcc, &n_frame, in_veclen) < 0) {
+    if (corpus_get_feat(feat, in_veclen, 9, maxuttlen, &f, &svd_n_frame, &n_frame) < 0) {
 	E_FATAL("Can't read input features\n");
     }
     
-    printf(" %4u", n_frame);
+    printf(" %4u", svd_n_frame);
       
-    if (n_frame < 9) {
+    if (svd_n_frame < 9) {
       E_WARN("utt %s too short\n", corpus_utt());
-      if (mfcc) {
-	ckd_free(mfcc[0]);
-	ckd_free(mfcc);
-      }
       continue;
     }
       
-    if ((maxuttlen > 0) && (n_frame > maxuttlen)) {
+    if ((maxuttlen > 0) && (svd_n_frame > maxuttlen)) {
       E_INFO("utt # frames > -maxuttlen; skipping\n");
-      n_frame_skipped += n_frame;
-      if (mfcc) {
-	ckd_free(mfcc[0]);
-	ckd_free(mfcc);
-      }
+      n_frame_skipped += svd_n_frame;
       continue;
     }
       
-  
-    svd_n_frame = n_frame;
-      
-    f = feat_array_alloc(feat, n_frame + feat_window_size(feat));
-    feat_s2mfc2feat_live(feat, mfcc, &n_frame, TRUE, TRUE, f);
-      
     printf(" %4u", n_frame - svd_n_frame);
       
     /* Get the transcript */
@@ -1769,8 +2244,6 @@ main_mmi_reestimate(model_inventory_t *inv,
       E_WARN("Can't read input lattice");
     }
     
-    free(mfcc[0]);
-    ckd_free(mfcc);
     feat_array_free(f);
     free(trans);
       
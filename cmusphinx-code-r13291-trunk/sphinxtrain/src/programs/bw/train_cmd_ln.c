@@ -397,6 +397,11 @@ If yo want to do parallel training for N machines. Run N trainers with \n\
 	  "mfc",
 	  "The cepstrum file extension" },
 
+	{ "-featcachefn",
+	  ARG_STRING,
+	  NULL,
+	  "Feature cache file made by mk_featcache to read features from" },
+
 	{ "-cepdir",
 	  ARG_STRING,
 	  NULL,
@@ -522,6 +527,16 @@ If yo want to do parallel training for N machines. Run N trainers with \n\
 	  NULL,
 	  "Dump state/mixture posterior probabilities to files in this directory" },
 
+	{ "-packedaccum",
+	  ARG_BOOLEAN,
+	  "no",
+	  "Write the reestimation sums as a single memory-mappable accum_counts file in -accumdir.  Only norm reads this format" },
+
+	{ "-nthreads",
+	  ARG_INT32,
+	  "1",
+	  "Number of threads used for Baum-Welch reestimation.  Counts from all threads are combined before being written" },
+
 	{ "-latdir",
 	  ARG_STRING,
 	  NULL,
@@ -334,7 +334,7 @@ viterbi_update(float64 *log_forw_prob,
     ret = forward(active_alpha, active_astate, n_active_astate, bp,
 		  scale, dscale,
 		  feature, n_obs, state_seq, n_state,
-		  inv, a_beam, phseg, timers, 0);
+		  inv, a_beam, phseg, timers, 0, stdout);
     /* Dump a phoneme segmentation if requested */
     if (cmd_ln_str("-outphsegdir")) {
 	    const char *phsegdir;
@@ -733,7 +733,7 @@ mmi_viterbi_run(float64 *log_forw_prob,
     ret = forward(active_alpha, active_astate, n_active_astate, bp,
 		  scale, dscale,
 		  feature, n_obs, state_seq, n_state,
-		  inv, a_beam, NULL, NULL, 1);
+		  inv, a_beam, NULL, NULL, 1, stdout);
 
     if (ret != S3_SUCCESS) {
 
@@ -869,7 +869,7 @@ mmi_viterbi_update(vector_t **feature,
     ret = forward(active_alpha, active_astate, n_active_astate, bp,
 		  scale, dscale,
 		  feature, n_obs, state_seq, n_state,
-		  inv, a_beam, NULL, NULL, 1);
+		  inv, a_beam, NULL, NULL, 1, stdout);
     
     if (cmd_ln_str("-outphsegdir")) {
 	E_FATAL("current MMI implementation don't support -outphsegdir\n");
@@ -77,7 +77,6 @@ init_gau(lexicon_t *lex,
     char *fn;
     acmod_set_t *acmod_set;
 
-    vector_t *mfcc = NULL;
     int32 n_frame;
     int32 feat_n_frame;
     int32 tmp;
@@ -171,11 +170,6 @@ init_gau(lexicon_t *lex,
     dnom = (float32 ***)ckd_calloc_3d(n_ts, feat_dimension1(feat), 1, sizeof(float32));
 
     while (corpus_next_utt()) {
-	if (mfcc) {
-	    free(mfcc[0]);
-	    ckd_free(mfcc);
-	    mfcc = NULL;
-	}
 	if (trans) {
 	    free(trans);
 	    trans = NULL;
@@ -248,7 +242,8 @@ init_gau(lexicon_t *lex,
 	    sseq = mk_sseq(seg, n_frame, phone, n_phone, mdef);
 	}
 
-        if (corpus_get_generic_featurevec(&mfcc, &tmp, ceplen) < 0) {
+	/* FIXME: This number is bogus, it ought to depend on the type of feature used. */
+        if (corpus_get_feat(feat, ceplen, 9, 0, &f, &tmp, &feat_n_frame) < 0) {
 	        E_FATAL("Can't read input features\n");
 	}
 
@@ -259,21 +254,10 @@ init_gau(lexicon_t *lex,
 		    corpus_utt_brief_name());
 	}
 
-	feat_n_frame = n_frame;
-
-	/* FIXME: This number is bogus, it ought to depend on the type of feature used. */
 	if (n_frame < 9) {
 	    E_WARN("utt %s too short\n", corpus_utt());
-	    if (mfcc) {
-		ckd_free(mfcc[0]);
-		ckd_free(mfcc);
-		mfcc = NULL;
-	    }
 	    continue;
 	}
-	
-	f = feat_array_alloc(feat, feat_n_frame + feat_window_size(feat));
-	feat_s2mfc2feat_live(feat, mfcc, &feat_n_frame, TRUE, TRUE, f);
 
 	if (feat_n_frame != n_frame) {
 	    E_FATAL("# frames compute != # frames of state seg\n");
@@ -308,11 +292,6 @@ init_gau(lexicon_t *lex,
     }
 
     /* free the per utterance data structures from the last utt */
-    if (mfcc) {
-	free(mfcc[0]);
-	ckd_free(mfcc);
-	mfcc = NULL;
-    }
     if (trans) {
 	free(trans);
 	trans = NULL;
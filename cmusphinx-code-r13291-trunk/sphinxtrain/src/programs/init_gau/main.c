@@ -145,6 +145,10 @@ initialize(int argc,
 
     corpus_set_mfcc_dir(cmd_ln_str("-cepdir"));
     corpus_set_mfcc_ext(cmd_ln_str("-cepext"));
+    if (cmd_ln_str("-featcachefn") &&
+	corpus_set_featcache(cmd_ln_str("-featcachefn"), feat) != S3_SUCCESS) {
+	E_FATAL("Unable to use feature cache %s\n", cmd_ln_str("-featcachefn"));
+    }
 
     if (cmd_ln_str("-lsnfn"))
 	corpus_set_lsn_filename(cmd_ln_str("-lsnfn"));
@@ -169,6 +169,11 @@ init_gau -accumdir accumdir -ctlfn controlfn -part 1 -npart 1 -cepdir cepdir -fe
 	  "mfc",
 	  "Extension of the training corpus cepstrum files."},
 
+	{ "-featcachefn",
+	  ARG_STRING,
+	  NULL,
+	  "Feature cache file made by mk_featcache to read features from."},
+
 	cepstral_to_feature_command_line_macro(),
 	{NULL, 0, NULL, NULL}
     };
@@ -0,0 +1,180 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: main.c
+ * 
+ * Description: 
+ *	Computes the feature vectors of every utterance in a control
+ *	file and writes them to a feature cache (see featcache.h).
+ * 
+ *********************************************************************/
+
+#include "parse_cmd_ln.h"
+
+#include <s3/corpus.h>
+#include <s3/featcache.h>
+#include <s3/s3.h>
+
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/feat.h>
+#include <sphinxbase/err.h>
+
+#include <string.h>
+
+static feat_t *feat;
+
+static int
+initialize(int argc,
+	   char *argv[])
+{
+    /* define, parse and (partially) validate the command line */
+    parse_cmd_ln(argc, argv);
+
+    if (cmd_ln_str("-ctlfn") == NULL) {
+	E_FATAL("You must specify a control file using -ctlfn\n");
+    }
+    if (cmd_ln_str("-featcachefn") == NULL) {
+	E_FATAL("You must specify the cache to write using -featcachefn\n");
+    }
+
+    feat = 
+        feat_init(cmd_ln_str("-feat"),
+                  cmn_type_from_str(cmd_ln_str("-cmn")),
+                  cmd_ln_boolean("-varnorm"),
+                  agc_type_from_str(cmd_ln_str("-agc")),
+                  1, cmd_ln_int32("-ceplen"));
+
+    if (cmd_ln_str("-lda")) {
+        E_INFO("Reading linear feature transformation from %s\n",
+               cmd_ln_str("-lda"));
+        if (feat_read_lda(feat,
+                          cmd_ln_str("-lda"),
+                          cmd_ln_int32("-ldadim")) < 0)
+            return -1;
+    }
+
+    if (cmd_ln_str("-svspec")) {
+        int32 **subvecs;
+        E_INFO("Using subvector specification %s\n", 
+               cmd_ln_str("-svspec"));
+        if ((subvecs = parse_subvecs(cmd_ln_str("-svspec"))) == NULL)
+            return -1;
+        if ((feat_set_subvecs(feat, subvecs)) < 0)
+            return -1;
+    }
+
+    if (cmd_ln_exists("-agcthresh")
+        && 0 != strcmp(cmd_ln_str("-agc"), "none")) {
+        agc_set_threshold(feat->agc_struct,
+                          cmd_ln_float32("-agcthresh"));
+    }
+
+    corpus_set_mfcc_dir(cmd_ln_str("-cepdir"));
+    corpus_set_mfcc_ext(cmd_ln_str("-cepext"));
+
+    corpus_set_ctl_filename(cmd_ln_str("-ctlfn"));
+
+    if (cmd_ln_int32("-nskip") && cmd_ln_int32("-runlen")) {
+        corpus_set_interval(cmd_ln_int32("-nskip"),
+			    cmd_ln_int32("-runlen"));
+    } else if (cmd_ln_int32("-part") && cmd_ln_int32("-npart")) {
+	corpus_set_partition(cmd_ln_int32("-part"),
+			     cmd_ln_int32("-npart"));
+    }
+
+    if (corpus_init() != S3_SUCCESS) {
+	return S3_ERROR;
+    }
+
+    return S3_SUCCESS;
+}
+
+static int
+mk_featcache(feat_t *fcb, const char *fn)
+{
+    featcache_writer_t *w;
+    mfcc_t ***f;
+    int32 n_frame_in;
+    int32 n_frame;
+    uint32 ceplen = cmd_ln_int32("-ceplen");
+    uint32 tick_cnt = 0;
+
+    if ((w = featcache_writer_open(fn, fcb)) == NULL)
+	return S3_ERROR;
+
+    while (corpus_next_utt()) {
+	if ((++tick_cnt % 100) == 0) {
+	    printf("[%u] ", tick_cnt);
+	    fflush(stdout);
+	}
+
+	/* short utterances are cached too, so each program can apply
+	   its own limits to them */
+	if (corpus_get_feat(fcb, ceplen, 0, 0, &f, &n_frame_in, &n_frame) < 0) {
+	    E_FATAL("Can't read input features from %s\n", corpus_utt());
+	}
+
+	if (featcache_writer_add(w, corpus_utt_key(),
+				 f, n_frame_in, n_frame) != S3_SUCCESS) {
+	    E_FATAL("Unable to add %s to %s\n", corpus_utt(), fn);
+	}
+
+	if (f)
+	    feat_array_free(f);
+    }
+    printf("\n");
+
+    return featcache_writer_close(w);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (initialize(argc, argv) != S3_SUCCESS) {
+	E_ERROR("Errors initializing.\n");
+	return 1;
+    }
+
+    if (mk_featcache(feat, cmd_ln_str("-featcachefn")) != S3_SUCCESS) {
+	return 1;
+    }
+
+    feat_free(feat);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* ====================================================================
+ * Copyright (c) 2015 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*********************************************************************
+ *
+ * File: parse_cmd_ln.c
+ * 
+ * Description: 
+ * 	These routines define and parse the command line for
+ *	mk_featcache.
+ *
+ * Author: 
+ * 
+ *********************************************************************/
+
+#include "parse_cmd_ln.h"
+
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/feat.h>
+#include <sphinxbase/err.h>
+#include <s3/s3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* defines, parses and (partially) validates the arguments
+   given on the command line */
+
+int
+parse_cmd_ln(int argc, char *argv[])
+{
+  uint32      isHelp;
+  uint32      isExample;
+
+  const char helpstr[] = 
+"Description: \n\
+Compute the feature vectors of a training corpus once and store them \n\
+in a single feature cache file.  bw, init_gau and agg_seg read their \n\
+features from the cache when given it with -featcachefn, instead of \n\
+reading the cepstrum files and computing CMN, AGC, dynamic features \n\
+and LDA on every pass.  The feature arguments must be the same as \n\
+those given to the training programs; a cache made with different \n\
+ones is refused.  Live CMN cannot be cached.";
+
+  const char examplestr[]=
+"Example:\n\
+\n\
+mk_featcache -ctlfn controlfn -cepdir cepdir -feat 1s_c_d_dd -ceplen 13 -cmn current -agc none -featcachefn train.featc";
+
+    static arg_t defn[] = {
+	{ "-help",
+	  ARG_BOOLEAN,
+	  "no",
+	  "Shows the usage of the tool"},
+
+	{ "-example",
+	  ARG_BOOLEAN,
+	  "no",
+	  "Shows example of how to use the tool"},
+
+	{ "-ctlfn",
+	  ARG_STRING,
+	  NULL,
+	  "Control file of the training corpus"},
+	{ "-nskip",
+	  ARG_INT32,
+	  NULL,
+	  "# of lines to skip in the control file"},
+	{ "-runlen",
+	  ARG_INT32,
+	  NULL,
+	  "# of lines to process in the control file (after any skip)"},
+	{ "-part",
+	  ARG_INT32,
+	  NULL,
+	  "Identifies the corpus part number (range 1..NPART)" },
+	{ "-npart",
+	  ARG_INT32,
+	  NULL,
+	  "Partition the corpus into this many equal sized subsets" },
+	{ "-cepdir",
+	  ARG_STRING,
+	  NULL,
+	  "Root directory of the training corpus cepstrum files."},
+	{ "-cepext",
+	  ARG_STRING,
+	  "mfc",
+	  "Extension of the training corpus cepstrum files."},
+	{ "-featcachefn",
+	  ARG_STRING,
+	  NULL,
+	  "Feature cache file to write"},
+
+	cepstral_to_feature_command_line_macro(),
+	{NULL, 0, NULL, NULL}
+    };
+
+    cmd_ln_parse(defn, argc, argv, 1);
+
+    isHelp    = cmd_ln_int32("-help");
+    isExample    = cmd_ln_int32("-example");
+
+    if(isHelp){
+      printf("%s\n\n",helpstr);
+    }
+
+    if(isExample){
+      printf("%s\n\n",examplestr);
+    }
+
+    if(isHelp || isExample){
+      E_INFO("User asked for help or example.\n");
+      exit(0);
+    }
+
+    return 0;
+}
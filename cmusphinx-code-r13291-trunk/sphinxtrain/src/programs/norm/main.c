@@ -54,10 +54,12 @@
 #include <s3/s3mixw_io.h>
 #include <s3/s3tmat_io.h>
 #include <s3/s3acc_io.h>
+#include <s3/s3accpack_io.h>
 #include <s3/mllr.h>
 #include <s3/mllr_io.h>
 
 #include <sphinxbase/matrix.h>
+#include <sphinxbase/sbthread.h>
 
 #include <sys_compat/file.h>
 #include <sys_compat/misc.h>
@@ -68,6 +70,213 @@
 #include <assert.h>
 
 
+/* One thread of the merge of bw -packedaccum containers */
+typedef struct norm_job_s {
+    sbthread_t *th;
+    const char **accum_dir;
+    accpack_t **part;
+    uint32 n_part;
+    float32 **sum;		/* totals per section, NULL if not needed */
+    uint32 n_job;
+    uint32 id;
+    uint32 n_bad;		/* sections failing their checksum */
+} norm_job_t;
+
+/* # of elements of a section summed over all parts at a time */
+#define NORM_SUM_BLK	2048
+
+static int
+norm_verify_main(sbthread_t *th)
+{
+    norm_job_t *job = sbthread_arg(th);
+    uint32 p;
+    int s;
+
+    for (p = job->id; p < job->n_part; p += job->n_job) {
+	for (s = 0; s < ACCPACK_N_SECT; s++) {
+	    if (job->sum[s] && !s3accpack_verify(job->part[p], s)) {
+		E_ERROR("Checksum error in section %d of %s/%s\n",
+			s, job->accum_dir[p], ACCPACK_FILE);
+		++job->n_bad;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+static int
+norm_sum_main(sbthread_t *th)
+{
+    norm_job_t *job = sbthread_arg(th);
+    const accpack_t *pk = job->part[0];
+    const float32 *src;
+    float32 *dst;
+    size_t n_cb, n_per, lo, hi, e, end, i;
+    uint32 p;
+    int s;
+
+    for (s = 0; s < ACCPACK_N_SECT; s++) {
+	if ((dst = job->sum[s]) == NULL)
+	    continue;
+
+	/* each thread takes a range of whole codebooks */
+	if (s == ACCPACK_MIXW)
+	    n_cb = pk->n_mixw;
+	else if (s == ACCPACK_TMAT)
+	    n_cb = pk->n_tmat;
+	else
+	    n_cb = pk->n_mgau;
+	if (n_cb == 0)
+	    continue;
+	n_per = s3accpack_n_elem(pk, s) / n_cb;
+	lo = n_cb * job->id / job->n_job * n_per;
+	hi = n_cb * (job->id + 1) / job->n_job * n_per;
+
+	/* Add the parts in -accumdir order like the rdacc_*()
+	   routines, so the totals are the same to the last bit.  Go a
+	   block at a time to keep the partial totals in cache. */
+	for (e = lo; e < hi; e = end) {
+	    end = (e + NORM_SUM_BLK < hi) ? e + NORM_SUM_BLK : hi;
+
+	    src = pk->sect[s];
+	    memcpy(dst + e, src + e, (end - e) * sizeof(float32));
+	    for (p = 1; p < job->n_part; p++) {
+		src = job->part[p]->sect[s];
+		for (i = e; i < end; i++)
+		    dst[i] += src[i];
+	    }
+	}
+    }
+
+    return 0;
+}
+
+static void
+norm_run(norm_job_t *job, uint32 n_job, sbthread_main fn)
+{
+    uint32 i;
+
+    for (i = 0; i < n_job; i++) {
+	if ((job[i].th = sbthread_start(cmd_ln_get(), fn, &job[i])) == NULL)
+	    E_FATAL("Failed to start thread %u\n", i);
+    }
+    for (i = 0; i < n_job; i++) {
+	sbthread_wait(job[i].th);
+	sbthread_free(job[i].th);
+	job[i].th = NULL;
+    }
+}
+
+/*********************************************************************
+ *
+ * Function: norm_map_packed
+ * 
+ * Description: 
+ *	Maps the accum_counts container of every -accumdir directory
+ *	and checks that they all describe the same model.
+ *
+ * Return Values: 
+ *	The containers, in -accumdir order, or NULL if the directories
+ *	hold the separate count files instead.
+ *
+ *********************************************************************/
+static accpack_t **
+norm_map_packed(const char **accum_dir,
+		uint32 *out_n_part)
+{
+    char fn[MAXPATHLEN+1];
+    struct stat st;
+    accpack_t **part;
+    accpack_t *pk;
+    uint32 i, n_part, n_packed;
+
+    for (n_part = 0, n_packed = 0; accum_dir[n_part]; n_part++) {
+	sprintf(fn, "%s/%s", accum_dir[n_part], ACCPACK_FILE);
+	if (stat(fn, &st) == 0)
+	    ++n_packed;
+    }
+    if (n_packed == 0)
+	return NULL;
+    if (n_packed != n_part) {
+	E_FATAL("Only %u of %u accumulator directories have %s; "
+		"all parts must be run with the same -packedaccum\n",
+		n_packed, n_part, ACCPACK_FILE);
+    }
+
+    part = ckd_calloc(n_part, sizeof(*part));
+    for (i = 0; i < n_part; i++) {
+	sprintf(fn, "%s/%s", accum_dir[i], ACCPACK_FILE);
+	E_INFO("Mapping counts from %s\n", fn);
+
+	if ((part[i] = s3accpack_map(fn)) == NULL)
+	    E_FATAL("Unable to read %s\n", fn);
+
+	pk = part[i];
+	if (pk->flags != part[0]->flags ||
+	    pk->n_mixw != part[0]->n_mixw ||
+	    pk->n_mixw_stream != part[0]->n_mixw_stream ||
+	    pk->n_mixw_density != part[0]->n_mixw_density ||
+	    pk->n_tmat != part[0]->n_tmat ||
+	    pk->n_state_pm != part[0]->n_state_pm ||
+	    pk->n_mgau != part[0]->n_mgau ||
+	    pk->n_feat != part[0]->n_feat ||
+	    pk->n_density != part[0]->n_density ||
+	    (pk->n_feat &&
+	     memcmp(pk->sect[ACCPACK_VECLEN], part[0]->sect[ACCPACK_VECLEN],
+		    pk->n_feat * sizeof(uint32)) != 0)) {
+	    E_FATAL("%s is inconsistent with %s/%s\n",
+		    fn, accum_dir[0], ACCPACK_FILE);
+	}
+    }
+    *out_n_part = n_part;
+
+    return part;
+}
+
+/*********************************************************************
+ *
+ * Function: norm_sum_packed
+ * 
+ * Description: 
+ *	Verifies the checksums of the sections for which sum[] is
+ *	set, then adds them up over all parts into sum[].  Both steps
+ *	are spread over n_job threads, the first by part and the
+ *	second by codebook range.
+ *
+ *********************************************************************/
+static void
+norm_sum_packed(const char **accum_dir,
+		accpack_t **part,
+		uint32 n_part,
+		float32 **sum,
+		uint32 n_job)
+{
+    norm_job_t *job;
+    uint32 i, n_bad;
+
+    job = ckd_calloc(n_job, sizeof(*job));
+    for (i = 0; i < n_job; i++) {
+	job[i].accum_dir = accum_dir;
+	job[i].part = part;
+	job[i].n_part = n_part;
+	job[i].sum = sum;
+	job[i].n_job = n_job;
+	job[i].id = i;
+    }
+
+    norm_run(job, n_job, norm_verify_main);
+    for (i = 0, n_bad = 0; i < n_job; i++)
+	n_bad += job[i].n_bad;
+    if (n_bad)
+	E_FATAL("%u accumulator sections are corrupt\n", n_bad);
+
+    E_INFO("Summing counts from %u parts with %u threads\n", n_part, n_job);
+    norm_run(job, n_job, norm_sum_main);
+
+    ckd_free(job);
+}
+
 static int normalize(void);
 
 static int mmi_normalize(void);
@@ -111,6 +320,8 @@ normalize()
     uint32 n_gau_stream;
     uint32 n_gau_density;
     uint32 *veclen = NULL;
+    accpack_t **part;
+    uint32 n_part;
     
     const char **accum_dir;
     const char *oaccum_dir;
@@ -203,59 +414,147 @@ normalize()
     }
 
     n_stream = 0;
-    for (i = 0; accum_dir[i]; i++) {
-	E_INFO("Reading and accumulating counts from %s\n", accum_dir[i]);
+    if ((part = norm_map_packed(accum_dir, &n_part)) != NULL) {
+	accpack_t *pk = part[0];
+	float32 *sum[ACCPACK_N_SECT];
+	int32 n_thread;
+
+	memset(sum, 0, sizeof(sum));
 
 	if (out_mixw_fn) {
-	    rdacc_mixw(accum_dir[i],
-		       &mixw_acc, &n_mixw, &n_stream, &n_density);
+	    if (!(pk->flags & ACCPACK_HAS(ACCPACK_MIXW))) {
+		E_FATAL("No mixing weight counts in %s/%s\n",
+			accum_dir[0], ACCPACK_FILE);
+	    }
+	    n_mixw = pk->n_mixw;
+	    n_stream = pk->n_mixw_stream;
+	    n_density = pk->n_mixw_density;
+	    mixw_acc = (float32 ***)ckd_calloc_3d(n_mixw, n_stream, n_density,
+						  sizeof(float32));
+	    sum[ACCPACK_MIXW] = mixw_acc[0][0];
 	}
 
 	if (out_tmat_fn) {
-	    rdacc_tmat(accum_dir[i],
-		       &tmat_acc, &n_tmat, &n_state_pm);
+	    if (!(pk->flags & ACCPACK_HAS(ACCPACK_TMAT))) {
+		E_FATAL("No transition matrix counts in %s/%s\n",
+			accum_dir[0], ACCPACK_FILE);
+	    }
+	    n_tmat = pk->n_tmat;
+	    n_state_pm = pk->n_state_pm;
+	    tmat_acc = (float32 ***)ckd_calloc_3d(n_tmat, n_state_pm-1,
+						  n_state_pm,
+						  sizeof(float32));
+	    sum[ACCPACK_TMAT] = tmat_acc[0][0];
 	}
 
 	if (out_mean_fn || out_var_fn) {
-	    if (var_is_full)
-		rdacc_den_full(accum_dir[i],
-			       &wt_mean,
-			       &wt_fullvar,
-			       &pass2var,
-			       &dnom,
-			       &n_mgau,
-			       &n_gau_stream,
-			       &n_gau_density,
-			       &veclen);
-	    else
-		rdacc_den(accum_dir[i],
-			  &wt_mean,
-			  &wt_var,
-			  &pass2var,
-			  &dnom,
-			  &n_mgau,
-			  &n_gau_stream,
-			  &n_gau_density,
-			  &veclen);
+	    if (!(pk->flags & ACCPACK_HAS(ACCPACK_VECLEN))) {
+		E_FATAL("No density counts in %s/%s\n",
+			accum_dir[0], ACCPACK_FILE);
+	    }
+	    if (!var_is_full != !(pk->flags & ACCPACK_FULLVAR)) {
+		E_FATAL("-fullvar does not match the variance counts in %s/%s\n",
+			accum_dir[0], ACCPACK_FILE);
+	    }
+	    n_mgau = pk->n_mgau;
+	    n_gau_stream = pk->n_feat;
+	    n_gau_density = pk->n_density;
+	    veclen = ckd_calloc(n_gau_stream, sizeof(uint32));
+	    memcpy(veclen, pk->sect[ACCPACK_VECLEN],
+		   n_gau_stream * sizeof(uint32));
+	    pass2var = (pk->flags & ACCPACK_PASS2VAR) != 0;
 
-	    if (out_mixw_fn) {
-		if (n_stream != n_gau_stream) {
-		    E_ERROR("mixw inconsistent w/ densities WRT # "
-			    "streams (%u != %u)\n",
-			    n_stream, n_gau_stream);
+	    if (pk->flags & ACCPACK_HAS(ACCPACK_MEAN)) {
+		wt_mean = gauden_alloc_param(n_mgau, n_gau_stream,
+					     n_gau_density, veclen);
+		sum[ACCPACK_MEAN] = wt_mean[0][0][0];
+	    }
+	    if (pk->flags & ACCPACK_HAS(ACCPACK_VAR)) {
+		if (var_is_full) {
+		    wt_fullvar = gauden_alloc_param_full(n_mgau, n_gau_stream,
+							 n_gau_density, veclen);
+		    sum[ACCPACK_VAR] = wt_fullvar[0][0][0][0];
 		}
-
-		if (n_density != n_gau_density) {
-		    E_ERROR("mixw inconsistent w/ densities WRT # "
-			    "den/mix (%u != %u)\n",
-			    n_density, n_gau_density);
+		else {
+		    wt_var = gauden_alloc_param(n_mgau, n_gau_stream,
+						n_gau_density, veclen);
+		    sum[ACCPACK_VAR] = wt_var[0][0][0];
 		}
 	    }
-	    else {
-		n_stream = n_gau_stream;
-		n_density = n_gau_density;
+	    if (pk->flags & ACCPACK_HAS(ACCPACK_DNOM)) {
+		dnom = (float32 ***)ckd_calloc_3d(n_mgau, n_gau_stream,
+						  n_gau_density,
+						  sizeof(float32));
+		sum[ACCPACK_DNOM] = dnom[0][0];
+	    }
+	}
+
+	n_thread = cmd_ln_int32("-nthreads");
+	if (n_thread < 1)
+	    n_thread = 1;
+	norm_sum_packed(accum_dir, part, n_part, sum, n_thread);
+
+	for (i = 0; i < n_part; i++)
+	    s3accpack_free(part[i]);
+	ckd_free(part);
+    }
+    else {
+	for (i = 0; accum_dir[i]; i++) {
+	    E_INFO("Reading and accumulating counts from %s\n", accum_dir[i]);
+
+	    if (out_mixw_fn) {
+		rdacc_mixw(accum_dir[i],
+			   &mixw_acc, &n_mixw, &n_stream, &n_density);
+	    }
+
+	    if (out_tmat_fn) {
+		rdacc_tmat(accum_dir[i],
+			   &tmat_acc, &n_tmat, &n_state_pm);
+	    }
+
+	    if (out_mean_fn || out_var_fn) {
+		if (var_is_full)
+		    rdacc_den_full(accum_dir[i],
+				   &wt_mean,
+				   &wt_fullvar,
+				   &pass2var,
+				   &dnom,
+				   &n_mgau,
+				   &n_gau_stream,
+				   &n_gau_density,
+				   &veclen);
+		else
+		    rdacc_den(accum_dir[i],
+			      &wt_mean,
+			      &wt_var,
+			      &pass2var,
+			      &dnom,
+			      &n_mgau,
+			      &n_gau_stream,
+			      &n_gau_density,
+			      &veclen);
+	    }
+	}
+    }
+
+    if (out_mean_fn || out_var_fn) {
+	if (out_mixw_fn) {
+	    if (n_stream != n_gau_stream) {
+		E_ERROR("mixw inconsistent w/ densities WRT # "
+			"streams (%u != %u)\n",
+			n_stream, n_gau_stream);
+	    }
+
+	    if (n_density != n_gau_density) {
+		E_ERROR("mixw inconsistent w/ densities WRT # "
+			"den/mix (%u != %u)\n",
+			n_density, n_gau_density);
 	    }
 	}
+	else {
+	    n_stream = n_gau_stream;
+	    n_density = n_gau_density;
+	}
     }
 
     if (oaccum_dir && mixw_acc) {
@@ -152,6 +152,11 @@ norm \n\
 	  "3.0",
 	  "Constant E for calculating constant D"},
 
+	{ "-nthreads",
+	  ARG_INT32,
+	  "1",
+	  "Number of threads used to check and sum accum_counts files from bw -packedaccum"},
+
 	{NULL, 0, NULL, NULL}
     };
 
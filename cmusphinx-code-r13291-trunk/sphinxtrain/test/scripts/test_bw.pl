@@ -0,0 +1,76 @@
+#!/usr/local/bin/perl
+
+use strict;
+require './scripts/testlib.pl';
+
+chomp(my $host=`../config.guess | xargs ../config.sub`);
+my $bindir="../bin.$host/";
+my $resdir="res/";
+my $exec_resdir="bw";
+my $bin="$bindir$exec_resdir";
+my $bin_printp="${bindir}printp";
+
+my $hmmdir="./res/hmm";
+my $mixw_out="./bw_mixw.out";
+my $tmat_out="./bw_tmat.out";
+
+my $cmd="$bin ";
+$cmd .= "-moddeffn $hmmdir/RM.1000.mdef -ts2cbfn .cont. ";
+$cmd .= "-meanfn $hmmdir/means -varfn $hmmdir/variances ";
+$cmd .= "-mixwfn $hmmdir/mixture_weights -tmatfn $hmmdir/transition_matrices ";
+$cmd .= "-dictfn ./bw/bw.dic -fdictfn ./bw/bw.filler ";
+$cmd .= "-ctlfn ./bw/bw.fileids -lsnfn ./bw/bw.transcription ";
+$cmd .= "-cepdir ./res/feat/rm -cepext mfc ";
+$cmd .= "-agc none -cmn current -varnorm no -feat 1s_c_d_dd -ceplen 13 ";
+$cmd .= "-lda $hmmdir/RM.lda -abeam 1e-200 -bbeam 1e-200 ";
+
+test_help($bindir,$exec_resdir);
+test_example($bindir,$exec_resdir);
+
+# The model has two densities per mixture, so -topn 2 evaluates all of
+# them and -topn 1 goes through the top-N search.
+my @params=(2,1) ;
+foreach my $i (@params)
+{
+    test_this("$cmd -topn $i -accumdir ./",$exec_resdir,"DRY RUN TEST for -topn $i");
+    test_this("$bin_printp -mixwfn ./mixw_counts > $mixw_out",$exec_resdir,"printp mixw counts for -topn $i");
+    compare_these_two($mixw_out,"./$exec_resdir/test_bw_mixw.topn$i",$exec_resdir,"Mixture weight counts for -topn $i");
+    test_this("$bin_printp -tmatfn ./tmat_counts > $tmat_out",$exec_resdir,"printp tmat counts for -topn $i");
+    compare_these_two($tmat_out,"./$exec_resdir/test_bw_tmat.topn$i",$exec_resdir,"Transition matrix counts for -topn $i");
+}
+
+# Several threads sum the counts in a different order, so they only
+# have to match the single-threaded ones within the usual tolerance.
+test_this("$cmd -topn 2 -nthreads 3 -accumdir ./",$exec_resdir,"DRY RUN TEST for -nthreads 3");
+test_this("$bin_printp -mixwfn ./mixw_counts > $mixw_out",$exec_resdir,"printp mixw counts for -nthreads 3");
+compare_these_two($mixw_out,"./$exec_resdir/test_bw_mixw.topn2",$exec_resdir,"Mixture weight counts for -nthreads 3");
+test_this("$bin_printp -tmatfn ./tmat_counts > $tmat_out",$exec_resdir,"printp tmat counts for -nthreads 3");
+compare_these_two($tmat_out,"./$exec_resdir/test_bw_tmat.topn2",$exec_resdir,"Transition matrix counts for -nthreads 3");
+
+# The same counts written as a single container, merged back into the
+# separate count files by norm.
+my $bin_norm="${bindir}norm";
+my $packdir="./bw_packed";
+mkdir($packdir);
+test_this("$cmd -topn 2 -packedaccum yes -accumdir $packdir",$exec_resdir,"DRY RUN TEST for -packedaccum");
+test_this("$bin_norm -accumdir $packdir -oaccumdir ./ -mixwfn ./bw_mixw -tmatfn ./bw_tmat -nthreads 2",$exec_resdir,"norm of -packedaccum counts");
+test_this("$bin_printp -mixwfn ./mixw_counts > $mixw_out",$exec_resdir,"printp mixw counts for -packedaccum");
+compare_these_two($mixw_out,"./$exec_resdir/test_bw_mixw.topn2",$exec_resdir,"Mixture weight counts for -packedaccum");
+test_this("$bin_printp -tmatfn ./tmat_counts > $tmat_out",$exec_resdir,"printp tmat counts for -packedaccum");
+compare_these_two($tmat_out,"./$exec_resdir/test_bw_tmat.topn2",$exec_resdir,"Transition matrix counts for -packedaccum");
+unlink("$packdir/accum_counts","./bw_mixw","./bw_tmat");
+rmdir($packdir);
+
+# The same counts again, with the features read from a cache made by
+# mk_featcache.
+my $bin_mkfc="${bindir}mk_featcache";
+my $featcache="./bw.featc";
+test_this("$bin_mkfc -ctlfn ./bw/bw.fileids -cepdir ./res/feat/rm -cepext mfc -agc none -cmn current -varnorm no -feat 1s_c_d_dd -ceplen 13 -lda $hmmdir/RM.lda -featcachefn $featcache",$exec_resdir,"mk_featcache");
+test_this("$cmd -topn 2 -featcachefn $featcache -accumdir ./",$exec_resdir,"DRY RUN TEST for -featcachefn");
+test_this("$bin_printp -mixwfn ./mixw_counts > $mixw_out",$exec_resdir,"printp mixw counts for -featcachefn");
+compare_these_two($mixw_out,"./$exec_resdir/test_bw_mixw.topn2",$exec_resdir,"Mixture weight counts for -featcachefn");
+test_this("$bin_printp -tmatfn ./tmat_counts > $tmat_out",$exec_resdir,"printp tmat counts for -featcachefn");
+compare_these_two($tmat_out,"./$exec_resdir/test_bw_tmat.topn2",$exec_resdir,"Transition matrix counts for -featcachefn");
+unlink($featcache);
+
+unlink("./mixw_counts","./tmat_counts","./gauden_counts",$mixw_out,$tmat_out);